@@ -37,6 +37,7 @@
 #include "itkAdvancedCombinationTransform.h"
 
 #include "itkMultiThreader.h"
+#include "itkWorkStealingThreadPool.h"
 
 namespace itk
 {
@@ -140,10 +141,12 @@ public:
   typedef FixedArray< double, Self::MovingImageDimension > MovingImageDerivativeScalesType;
 
   /** Typedefs for the ImageSampler. */
-  typedef ImageSamplerBase< FixedImageType >                      ImageSamplerType;
-  typedef typename ImageSamplerType::Pointer                      ImageSamplerPointer;
-  typedef typename ImageSamplerType::OutputVectorContainerType    ImageSampleContainerType;
-  typedef typename ImageSamplerType::OutputVectorContainerPointer ImageSampleContainerPointer;
+  typedef ImageSamplerBase< FixedImageType >                        ImageSamplerType;
+  typedef typename ImageSamplerType::Pointer                        ImageSamplerPointer;
+  typedef typename ImageSamplerType::OutputVectorContainerType      ImageSampleContainerType;
+  typedef typename ImageSamplerType::OutputVectorContainerPointer   ImageSampleContainerPointer;
+  typedef typename ImageSamplerType::ImageSampleBatchContainerType  ImageSampleBatchContainerType;
+  typedef typename ImageSamplerType::ImageSampleWeightContainerType ImageSampleWeightContainerType;
 
   /** Typedefs for Limiter support. */
   typedef LimiterFunctionBase< RealType, FixedImageDimension >  FixedImageLimiterType;
@@ -159,6 +162,10 @@ public:
     ScalarType, FixedImageDimension, MovingImageDimension >      AdvancedTransformType;
   typedef typename AdvancedTransformType::NumberOfParametersType NumberOfParametersType;
 
+  /** The number of samples that metrics pass at once to the batched
+   * transform functions, see TransformPoints(). */
+  itkStaticConstMacro( SampleBatchSize, unsigned int, 16 );
+
   /** Typedef's for the B-spline transform. */
   typedef AdvancedCombinationTransform< ScalarType, FixedImageDimension >          CombinationTransformType;
   typedef AdvancedBSplineDeformableTransform< ScalarType, FixedImageDimension, 1 > BSplineOrder1TransformType;
@@ -175,6 +182,7 @@ public:
   /** Typedefs for multi-threading. */
   typedef itk::MultiThreader                      ThreaderType;
   typedef typename ThreaderType::ThreadInfoStruct ThreadInfoType;
+  typedef WorkStealingThreadPool                  ThreadPoolType;
 
   /** Public methods ********************/
 
@@ -209,6 +217,11 @@ public:
    * This method allows the user to inspect this setting. */
   itkGetConstMacro( UseImageSampler, bool );
 
+  /** Inheriting classes can specify whether they weight the samples by the
+   * importance weights of the image sampler, see GetFixedImageSampleWeights();
+   * This method allows the user to inspect this setting. */
+  itkGetConstMacro( UseFixedImageSampleWeights, bool );
+
   /** Set/Get the required ratio of valid samples; default 0.25.
    * When less than this ratio*numberOfSamplesTried samples map
    * inside the moving image buffer, an exception will be thrown. */
@@ -277,12 +290,44 @@ public:
   itkGetConstReferenceMacro( UseMetricSingleThreaded, bool );
   itkBooleanMacro( UseMetricSingleThreaded );
 
+  /** Switch the update of the image sampler in BeforeThreadedGetValueAndDerivative
+   * on or off. Copies of a metric that share its image sampler, and that are
+   * evaluated concurrently, should not update it: the owner of the sampler
+   * updates it before they are evaluated. Default: true.
+   */
+  itkSetMacro( UpdateImageSampler, bool );
+  itkGetConstReferenceMacro( UpdateImageSampler, bool );
+  itkBooleanMacro( UpdateImageSampler );
+
   /** Select the use of multi-threading*/
   // \todo: maybe these can be united, check base class.
   itkSetMacro( UseMultiThread, bool );
   itkGetConstReferenceMacro( UseMultiThread, bool );
   itkBooleanMacro( UseMultiThread );
 
+  /** Select the use of the global WorkStealingThreadPool for the multi-threaded
+   * computations. Only has effect when UseMultiThread is true. Metrics that do not
+   * support sample range threading keep using the MultiThreader. */
+  itkSetMacro( UseWorkStealingThreadPool, bool );
+  itkGetConstReferenceMacro( UseWorkStealingThreadPool, bool );
+  itkBooleanMacro( UseWorkStealingThreadPool );
+
+  /** Set/Get the number of samples per chunk of the WorkStealingThreadPool.
+   * Zero selects a chunk size automatically. */
+  itkSetMacro( ThreadPoolChunkSize, SizeValueType );
+  itkGetConstMacro( ThreadPoolChunkSize, SizeValueType );
+
+  /** Get the number of heap allocations made for the per-thread variables
+   * and the per-thread scratch memory. These allocations are made in
+   * InitializeThreadingParameters(), i.e. at most once per resolution, and
+   * not during the iterations. Useful to verify this in a test.
+   */
+  SizeValueType GetNumberOfPerThreadAllocations( void ) const
+  {
+    return this->m_NumberOfPerThreadAllocations;
+  }
+
+
   /** Contains calls from GetValueAndDerivative that are thread-unsafe,
    * together with preparation for multi-threading.
    * Note that the only reason why this function is not protected, is
@@ -409,10 +454,61 @@ protected:
   /** AccumulateDerivatives threader callback function. */
   static ITK_THREAD_RETURN_TYPE AccumulateDerivativesThreaderCallback( void * arg );
 
+  /** Launch MultiThread AccumulateDerivatives. The st_DerivativePointer and
+   * st_NormalizationFactor of m_ThreaderMetricParameters should be set before. */
+  void LaunchAccumulateDerivativesThreaderCallback( void ) const;
+
+  /** Multi-threaded versions of GetValue() and GetValueAndDerivative(), working
+   * on the samples [ begin, end ) of the image sample container. A thread may
+   * process several ranges per call, so the results should be added to the
+   * per-thread variables. Metrics that implement these functions should call
+   * SetSupportsSampleRangeThreading( true ) in their constructor.
+   */
+  virtual inline void ThreadedGetValueOnSampleRange(
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end ){}
+  virtual inline void ThreadedGetValueAndDerivativeOnSampleRange(
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end ){}
+
+  /** WorkStealingThreadPool callback functions. */
+  static void GetValueSampleRangeCallback( void * arg,
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end );
+  static void GetValueAndDerivativeSampleRangeCallback( void * arg,
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end );
+  static void AccumulateDerivativesRangeCallback( void * arg,
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end );
+
+  /** Divide an array of size elements of elementSize bytes each in
+   * numberOfBlocks contiguous blocks, for a reduction in which each thread
+   * writes a disjoint block. The block size is rounded up to whole cache
+   * lines, so that threads do not write to the same cache line.
+   * GetCacheAlignedBlockRange() returns the range [ begin, end [ of block
+   * blockId, which is empty for the trailing blocks of small arrays.
+   */
+  static SizeValueType GetCacheAlignedBlockSize( const SizeValueType size,
+    const SizeValueType elementSize, const ThreadIdType numberOfBlocks );
+  static void GetCacheAlignedBlockRange( const SizeValueType size,
+    const SizeValueType elementSize, const ThreadIdType blockId,
+    const ThreadIdType numberOfBlocks, SizeValueType & begin, SizeValueType & end );
+
+  /** Returns true if the WorkStealingThreadPool should be used. */
+  bool UseThreadPoolForSampleRanges( void ) const
+  {
+    return this->m_UseMultiThread && this->m_UseWorkStealingThreadPool
+           && this->m_SupportsSampleRangeThreading;
+  }
+
+  /** Inheriting classes can specify whether they implement the
+   * Threaded*OnSampleRange functions; default: false. */
+  itkSetMacro( SupportsSampleRangeThreading, bool );
+
   /** Variables for multi-threading. */
-  bool m_UseMetricSingleThreaded;
-  bool m_UseMultiThread;
-  bool m_UseOpenMP;
+  bool          m_UseMetricSingleThreaded;
+  bool          m_UpdateImageSampler;
+  bool          m_UseMultiThread;
+  bool          m_UseOpenMP;
+  bool          m_UseWorkStealingThreadPool;
+  bool          m_SupportsSampleRangeThreading;
+  SizeValueType m_ThreadPoolChunkSize;
 
   /** Helper structs that multi-threads the computation of
    * the metric derivative using ITK threads.
@@ -463,9 +559,47 @@ protected:
   mutable AlignedGetValueAndDerivativePerThreadStruct * m_GetValueAndDerivativePerThreadVariables;
   mutable ThreadIdType                                  m_GetValueAndDerivativePerThreadVariablesSize;
 
+  /** Per-thread scratch memory for the threaded functions: the transform
+   * Jacobian and the image Jacobian with the nonzero Jacobian indices, for
+   * a single sample and for a batch of SampleBatchSize samples. Allocating
+   * these on every call of the threaded functions causes malloc contention
+   * at high thread counts. The arena is sized in InitializeThreadingParameters(),
+   * and persists across iterations and resolutions: memory is only allocated
+   * when the number of threads grows, or when the number of nonzero Jacobian
+   * indices changes. The Jacobian preconditioning arrays are only sized by the metrics
+   * that use them.
+   */
+  struct ThreadScratchStruct
+  {
+    TransformJacobianType                     st_Jacobian;
+    NonZeroJacobianIndicesType                st_NonZeroJacobianIndices;
+    DerivativeType                            st_ImageJacobian;
+    std::vector< NonZeroJacobianIndicesType > st_BatchNonZeroJacobianIndices;
+    std::vector< DerivativeType >             st_BatchImageJacobians;
+    DerivativeType                            st_JacobianPreconditioner;
+    DerivativeType                            st_PreconditioningDivisor;
+  };
+  itkPadStruct( ITK_CACHE_LINE_ALIGNMENT, ThreadScratchStruct,
+    PaddedThreadScratchStruct );
+  itkAlignedTypedef( ITK_CACHE_LINE_ALIGNMENT, PaddedThreadScratchStruct,
+    AlignedThreadScratchStruct );
+  mutable AlignedThreadScratchStruct * m_ThreadScratchVariables;
+  mutable ThreadIdType                 m_ThreadScratchVariablesSize;
+  mutable SizeValueType                m_NumberOfPerThreadAllocations;
+
+  /** Get the scratch memory of a thread. */
+  ThreadScratchStruct & GetThreadScratch( const ThreadIdType threadId ) const
+  {
+    return this->m_ThreadScratchVariables[ threadId ];
+  }
+
+
   /** Initialize some multi-threading related parameters. */
   virtual void InitializeThreadingParameters( void ) const;
 
+  /** Size the per-thread scratch memory; called by InitializeThreadingParameters(). */
+  void InitializeThreadScratch( void ) const;
+
   /** Protected methods ************** */
 
   /** Methods for image sampler support **********/
@@ -477,6 +611,10 @@ protected:
    * Make sure to set it before calling Initialize; default: false. */
   itkSetMacro( UseImageSampler, bool );
 
+  /** Inheriting classes can specify whether they use the importance weights
+   * of the samples; default: false. */
+  itkSetMacro( UseFixedImageSampleWeights, bool );
+
   /** Check if enough samples have been found to compute a reliable
    * estimate of the value/derivative; throws an exception if not. */
   virtual void CheckNumberOfSamples(
@@ -529,6 +667,35 @@ protected:
     const FixedImagePointType & fixedImagePoint,
     MovingImagePointType & mappedPoint ) const;
 
+  /** Transform a batch of points from the FixedImage domain to the MovingImage
+   * domain. This calls TransformPoints() of the transform, which is vectorized
+   * for the recursive B-spline transform. The mapped points should be checked
+   * with IsInsideMovingMask() etc, as for TransformPoint().
+   */
+  virtual void TransformPoints(
+    const FixedImagePointType * fixedImagePoints,
+    MovingImagePointType * mappedPoints,
+    const unsigned int numberOfPoints ) const;
+
+  /** Read the fixed image samples [ begin, begin + numberOfSamples ) of the
+   * image sampler. The structure-of-arrays sample batch container of the
+   * sampler is used if it is up to date, which avoids striding through
+   * the ImageSampleContainer.
+   */
+  void GetFixedImageSamples( const SizeValueType begin,
+    const unsigned int numberOfSamples,
+    FixedImagePointType * fixedImagePoints,
+    RealType * fixedImageValues ) const;
+
+  /** Get the importance weights of the fixed image samples, in the order of
+   * the samples. Empty if the image sampler selects all samples with the
+   * same probability.
+   */
+  const ImageSampleWeightContainerType & GetFixedImageSampleWeights( void ) const
+  {
+    return this->GetImageSampler()->GetSampleWeights();
+  }
+
   /** This function returns a reference to the transform Jacobians.
    * This is either a reference to the full TransformJacobian or
    * a reference to a sparse Jacobians.
@@ -562,6 +729,7 @@ private:
 
   /** Private member variables. */
   bool   m_UseImageSampler;
+  bool   m_UseFixedImageSampleWeights;
   bool   m_UseFixedImageLimiter;
   bool   m_UseMovingImageLimiter;
   double m_RequiredRatioOfValidSamples;
@@ -29,6 +29,8 @@
 
 #include "itkTimeProbe.h"
 
+#include <algorithm>
+
 namespace itk
 {
 
@@ -50,6 +52,7 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
 
   this->m_ImageSampler                = 0;
   this->m_UseImageSampler             = false;
+  this->m_UseFixedImageSampleWeights  = false;
   this->m_RequiredRatioOfValidSamples = 0.25;
 
   this->m_LinearInterpolator              = 0;
@@ -86,7 +89,11 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
 
   /** Threading related variables. */
   this->m_UseMetricSingleThreaded = true;
+  this->m_UpdateImageSampler = true;
   this->m_UseMultiThread = false;
+  this->m_UseWorkStealingThreadPool = false;
+  this->m_SupportsSampleRangeThreading = false;
+  this->m_ThreadPoolChunkSize = 0;
 
 #if ITK_VERSION_MAJOR < 5
   // Note: This `#if` is a workaround for ITK5, which no longer supports calling
@@ -113,6 +120,9 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
   this->m_GetValuePerThreadVariablesSize              = 0;
   this->m_GetValueAndDerivativePerThreadVariables     = NULL;
   this->m_GetValueAndDerivativePerThreadVariablesSize = 0;
+  this->m_ThreadScratchVariables                      = NULL;
+  this->m_ThreadScratchVariablesSize                  = 0;
+  this->m_NumberOfPerThreadAllocations                = 0;
 
 } // end Constructor
 
@@ -127,6 +137,7 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
 {
   delete[] this->m_GetValuePerThreadVariables;
   delete[] this->m_GetValueAndDerivativePerThreadVariables;
+  delete[] this->m_ThreadScratchVariables;
 } // end Destructor
 
 
@@ -211,20 +222,25 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
    * This has performance benefits for larger vector sizes.
    */
 
-  /** Only resize the array of structs when needed. */
-  if( this->m_GetValuePerThreadVariablesSize != numberOfThreads )
+  /** Only resize the array of structs when it is too small. When the number
+   * of threads decreases, the existing structs (and their derivatives) are
+   * kept, so that no reallocation is needed when it increases again.
+   */
+  if( this->m_GetValuePerThreadVariablesSize < numberOfThreads )
   {
     delete[] this->m_GetValuePerThreadVariables;
     this->m_GetValuePerThreadVariables     = new AlignedGetValuePerThreadStruct[ numberOfThreads ];
     this->m_GetValuePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
   }
 
-  /** Only resize the array of structs when needed. */
-  if( this->m_GetValueAndDerivativePerThreadVariablesSize != numberOfThreads )
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_GetValueAndDerivativePerThreadVariablesSize < numberOfThreads )
   {
     delete[] this->m_GetValueAndDerivativePerThreadVariables;
     this->m_GetValueAndDerivativePerThreadVariables     = new AlignedGetValueAndDerivativePerThreadStruct[ numberOfThreads ];
     this->m_GetValueAndDerivativePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
   }
 
   /** Some initialization. */
@@ -233,15 +249,92 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
     this->m_GetValuePerThreadVariables[ i ].st_NumberOfPixelsCounted = NumericTraits< SizeValueType >::Zero;
     this->m_GetValuePerThreadVariables[ i ].st_Value                 = NumericTraits< MeasureType >::Zero;
 
+    DerivativeType & derivative = this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Derivative;
     this->m_GetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted = NumericTraits< SizeValueType >::Zero;
     this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value                 = NumericTraits< MeasureType >::Zero;
-    this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Derivative.SetSize( this->GetNumberOfParameters() );
-    this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Derivative.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
+    if( derivative.GetSize() != this->GetNumberOfParameters() )
+    {
+      derivative.SetSize( this->GetNumberOfParameters() );
+      ++this->m_NumberOfPerThreadAllocations;
+    }
+    derivative.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
   }
 
+  /** Size the scratch memory of the threads. */
+  this->InitializeThreadScratch();
+
 } // end InitializeThreadingParameters()
 
 
+/**
+ * ********************* InitializeThreadScratch ****************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::InitializeThreadScratch( void ) const
+{
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
+
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_ThreadScratchVariablesSize < numberOfThreads )
+  {
+    delete[] this->m_ThreadScratchVariables;
+    this->m_ThreadScratchVariables     = new AlignedThreadScratchStruct[ numberOfThreads ];
+    this->m_ThreadScratchVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
+  }
+
+  /** The scratch arrays depend on the transform, which is only known to be
+   * an advanced transform after CheckForAdvancedTransform().
+   */
+  if( this->m_AdvancedTransform.IsNull() )
+  {
+    return;
+  }
+  const NumberOfParametersType nnzji     = this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices();
+  const unsigned int           batchSize = Self::SampleBatchSize;
+
+  /** Only allocate when the sizes changed. The contents are not initialized;
+   * they are overwritten by the functions that use them.
+   */
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    ThreadScratchStruct & scratch     = this->m_ThreadScratchVariables[ i ];
+    bool                  reallocated = false;
+
+    if( scratch.st_Jacobian.rows() != MovingImageDimension || scratch.st_Jacobian.cols() != nnzji )
+    {
+      scratch.st_Jacobian.SetSize( MovingImageDimension, nnzji );
+      reallocated = true;
+    }
+    if( scratch.st_NonZeroJacobianIndices.size() != nnzji )
+    {
+      scratch.st_NonZeroJacobianIndices.resize( nnzji );
+      reallocated = true;
+    }
+    if( scratch.st_ImageJacobian.GetSize() != nnzji )
+    {
+      scratch.st_ImageJacobian.SetSize( nnzji );
+      reallocated = true;
+    }
+    if( scratch.st_BatchImageJacobians.size() != batchSize
+      || scratch.st_BatchImageJacobians[ 0 ].GetSize() != nnzji )
+    {
+      scratch.st_BatchNonZeroJacobianIndices.assign( batchSize, NonZeroJacobianIndicesType( nnzji ) );
+      scratch.st_BatchImageJacobians.assign( batchSize, DerivativeType( nnzji ) );
+      reallocated = true;
+    }
+    if( reallocated )
+    {
+      ++this->m_NumberOfPerThreadAllocations;
+    }
+  }
+
+} // end InitializeThreadScratch()
+
+
 /**
  * ****************** InitializeLimiters *****************************
  */
@@ -780,6 +873,60 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
 } // end TransformPoint()
 
 
+/**
+ * ************************** TransformPoints *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::TransformPoints(
+  const FixedImagePointType * fixedImagePoints,
+  MovingImagePointType * mappedPoints,
+  const unsigned int numberOfPoints ) const
+{
+  this->m_AdvancedTransform->TransformPoints( fixedImagePoints, mappedPoints, numberOfPoints );
+
+} // end TransformPoints()
+
+
+/**
+ * ************************** GetFixedImageSamples *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::GetFixedImageSamples( const SizeValueType begin,
+  const unsigned int numberOfSamples,
+  FixedImagePointType * fixedImagePoints,
+  RealType * fixedImageValues ) const
+{
+  const ImageSampleBatchContainerType * sampleBatchContainer
+    = this->GetImageSampler()->GetSampleBatchContainer();
+  const ImageSampleContainerType * sampleContainer
+    = this->GetImageSampler()->GetOutput();
+
+  if( sampleBatchContainer->IsCopyOf( sampleContainer ) )
+  {
+    sampleBatchContainer->GetSamples( begin, numberOfSamples,
+      fixedImagePoints, fixedImageValues );
+    return;
+  }
+
+  /** Fall back to the ImageSampleContainer, for example when the sampler
+   * does not generate the sample batch container.
+   */
+  for( unsigned int i = 0; i < numberOfSamples; ++i )
+  {
+    fixedImagePoints[ i ] = sampleContainer->ElementAt( begin + i ).m_ImageCoordinates;
+    fixedImageValues[ i ] = static_cast< RealType >(
+      sampleContainer->ElementAt( begin + i ).m_ImageValue );
+  }
+
+} // end GetFixedImageSamples()
+
+
 /**
  * *************** EvaluateTransformJacobian ****************
  */
@@ -863,7 +1010,7 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
   if( this->m_UseMetricSingleThreaded )
   {
     this->SetTransformParameters( parameters );
-    if( this->m_UseImageSampler )
+    if( this->m_UseImageSampler && this->m_UpdateImageSampler )
     {
       this->GetImageSampler()->Update();
     }
@@ -903,6 +1050,17 @@ void
 AdvancedImageToImageMetric< TFixedImage, TMovingImage >
 ::LaunchGetValueThreaderCallback( void ) const
 {
+  /** Distribute chunks of samples over the persistent thread pool. */
+  if( this->UseThreadPoolForSampleRanges() )
+  {
+    ThreadPoolType::GetInstance()->ParallelFor(
+      this->GetImageSampler()->GetOutput()->Size(),
+      this->m_ThreadPoolChunkSize, Self::GetNumberOfThreads(),
+      this->GetValueSampleRangeCallback,
+      const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ) );
+    return;
+  }
+
   /** Setup threader. */
   this->m_Threader->SetSingleMethod( this->GetValueThreaderCallback,
     const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ) );
@@ -944,6 +1102,17 @@ void
 AdvancedImageToImageMetric< TFixedImage, TMovingImage >
 ::LaunchGetValueAndDerivativeThreaderCallback( void ) const
 {
+  /** Distribute chunks of samples over the persistent thread pool. */
+  if( this->UseThreadPoolForSampleRanges() )
+  {
+    ThreadPoolType::GetInstance()->ParallelFor(
+      this->GetImageSampler()->GetOutput()->Size(),
+      this->m_ThreadPoolChunkSize, Self::GetNumberOfThreads(),
+      this->GetValueAndDerivativeSampleRangeCallback,
+      const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ) );
+    return;
+  }
+
   /** Setup threader. */
   this->m_Threader->SetSingleMethod( this->GetValueAndDerivativeThreaderCallback,
     const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ) );
@@ -970,20 +1139,17 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
   MultiThreaderParameterType * temp
     = static_cast< MultiThreaderParameterType * >( infoStruct->UserData );
 
-  const unsigned int numPar  = temp->st_Metric->GetNumberOfParameters();
-  const unsigned int subSize = static_cast< unsigned int >(
-    std::ceil( static_cast< double >( numPar )
-    / static_cast< double >( nrOfThreads ) ) );
-  const unsigned int jmin = threadID * subSize;
-  unsigned int       jmax = ( threadID + 1 ) * subSize;
-  jmax = ( jmax > numPar ) ? numPar : jmax;
+  /** Blocks of whole cache lines, to prevent false sharing of the derivative. */
+  SizeValueType jmin, jmax;
+  Self::GetCacheAlignedBlockRange( temp->st_Metric->GetNumberOfParameters(),
+    sizeof( DerivativeValueType ), threadID, nrOfThreads, jmin, jmax );
 
   /** This thread accumulates all sub-derivatives into a single one, for the
    * range [ jmin, jmax [. Additionally, the sub-derivatives are reset.
    */
   const DerivativeValueType zero          = NumericTraits< DerivativeValueType >::Zero;
   const DerivativeValueType normalization = 1.0 / temp->st_NormalizationFactor;
-  for( unsigned int j = jmin; j < jmax; ++j )
+  for( SizeValueType j = jmin; j < jmax; ++j )
   {
     DerivativeValueType tmp = zero;
     for( ThreadIdType i = 0; i < nrOfThreads; ++i )
@@ -1001,6 +1167,152 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
 } // end AccumulateDerivativesThreaderCallback()
 
 
+/**
+ *********** LaunchAccumulateDerivativesThreaderCallback *************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::LaunchAccumulateDerivativesThreaderCallback( void ) const
+{
+  /** Use the persistent thread pool, if the metric was also evaluated on it. */
+  if( this->UseThreadPoolForSampleRanges() )
+  {
+    /** Chunks of whole cache lines, a few per thread for load balancing. */
+    const SizeValueType chunkSize = Self::GetCacheAlignedBlockSize(
+      this->GetNumberOfParameters(), sizeof( DerivativeValueType ), 4 * Self::GetNumberOfThreads() );
+    ThreadPoolType::GetInstance()->ParallelFor(
+      this->GetNumberOfParameters(), chunkSize, Self::GetNumberOfThreads(),
+      this->AccumulateDerivativesRangeCallback,
+      const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ) );
+    return;
+  }
+
+  /** Setup threader. */
+  this->m_Threader->SetSingleMethod( this->AccumulateDerivativesThreaderCallback,
+    const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ) );
+
+  /** Launch. */
+  this->m_Threader->SingleMethodExecute();
+
+} // end LaunchAccumulateDerivativesThreaderCallback()
+
+
+/**
+ * **************** GetValueSampleRangeCallback *******
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::GetValueSampleRangeCallback( void * arg,
+  ThreadIdType threadID, SizeValueType begin, SizeValueType end )
+{
+  MultiThreaderParameterType * temp
+    = static_cast< MultiThreaderParameterType * >( arg );
+
+  temp->st_Metric->ThreadedGetValueOnSampleRange( threadID, begin, end );
+
+} // end GetValueSampleRangeCallback()
+
+
+/**
+ * **************** GetValueAndDerivativeSampleRangeCallback *******
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::GetValueAndDerivativeSampleRangeCallback( void * arg,
+  ThreadIdType threadID, SizeValueType begin, SizeValueType end )
+{
+  MultiThreaderParameterType * temp
+    = static_cast< MultiThreaderParameterType * >( arg );
+
+  temp->st_Metric->ThreadedGetValueAndDerivativeOnSampleRange( threadID, begin, end );
+
+} // end GetValueAndDerivativeSampleRangeCallback()
+
+
+/**
+ *********** AccumulateDerivativesRangeCallback *************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::AccumulateDerivativesRangeCallback( void * arg,
+  ThreadIdType itkNotUsed( threadID ), SizeValueType begin, SizeValueType end )
+{
+  MultiThreaderParameterType * temp
+    = static_cast< MultiThreaderParameterType * >( arg );
+
+  const ThreadIdType nrOfThreads = temp->st_Metric->GetNumberOfThreads();
+
+  /** Accumulate all sub-derivatives into a single one, for the parameter
+   * range [ begin, end [. Additionally, the sub-derivatives are reset.
+   */
+  const DerivativeValueType zero          = NumericTraits< DerivativeValueType >::Zero;
+  const DerivativeValueType normalization = 1.0 / temp->st_NormalizationFactor;
+  for( SizeValueType j = begin; j < end; ++j )
+  {
+    DerivativeValueType tmp = zero;
+    for( ThreadIdType i = 0; i < nrOfThreads; ++i )
+    {
+      tmp += temp->st_Metric->m_GetValueAndDerivativePerThreadVariables[ i ].st_Derivative[ j ];
+
+      /** Reset this variable for the next iteration. */
+      temp->st_Metric->m_GetValueAndDerivativePerThreadVariables[ i ].st_Derivative[ j ] = zero;
+    }
+    temp->st_DerivativePointer[ j ] = tmp * normalization;
+  }
+
+} // end AccumulateDerivativesRangeCallback()
+
+
+/**
+ * *********************** GetCacheAlignedBlockSize ***********************
+ */
+
+template< class TFixedImage, class TMovingImage >
+SizeValueType
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::GetCacheAlignedBlockSize( const SizeValueType size,
+  const SizeValueType elementSize, const ThreadIdType numberOfBlocks )
+{
+  const SizeValueType cacheLineLength = ITK_CACHE_LINE_ALIGNMENT;
+  const SizeValueType elementsPerLine
+    = ( elementSize < cacheLineLength ) ? cacheLineLength / elementSize : 1;
+  const SizeValueType blocks = ( numberOfBlocks > 0 ) ? numberOfBlocks : 1;
+
+  /** Round the block size up to a multiple of the cache line length. */
+  const SizeValueType blockSize = ( size + blocks - 1 ) / blocks;
+  return ( ( blockSize + elementsPerLine - 1 ) / elementsPerLine ) * elementsPerLine;
+
+} // end GetCacheAlignedBlockSize()
+
+
+/**
+ * *********************** GetCacheAlignedBlockRange ***********************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedImageToImageMetric< TFixedImage, TMovingImage >
+::GetCacheAlignedBlockRange( const SizeValueType size,
+  const SizeValueType elementSize, const ThreadIdType blockId,
+  const ThreadIdType numberOfBlocks, SizeValueType & begin, SizeValueType & end )
+{
+  const SizeValueType blockSize = Self::GetCacheAlignedBlockSize(
+    size, elementSize, numberOfBlocks );
+
+  begin = std::min( blockId * blockSize, size );
+  end   = std::min( begin + blockSize, size );
+
+} // end GetCacheAlignedBlockRange()
+
+
 /**
  * *********************** CheckNumberOfSamples ***********************
  */
@@ -1038,6 +1350,8 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
      << this->m_ImageSampler.GetPointer() << std::endl;
   os << indent.GetNextIndent() << "UseImageSampler: "
      << this->m_UseImageSampler << std::endl;
+  os << indent.GetNextIndent() << "UseFixedImageSampleWeights: "
+     << this->m_UseFixedImageSampleWeights << std::endl;
 
   /** Variables for the Limiters. */
   os << indent << "Variables related to the Limiters: " << std::endl;
@@ -1099,6 +1413,17 @@ AdvancedImageToImageMetric< TFixedImage, TMovingImage >
   os << indent.GetNextIndent() << "MovingImageDerivativeScales: "
      << this->m_MovingImageDerivativeScales << std::endl;
 
+  /** Variables related to multi-threading. */
+  os << indent << "Variables related to multi-threading: " << std::endl;
+  os << indent.GetNextIndent() << "UseMultiThread: "
+     << this->m_UseMultiThread << std::endl;
+  os << indent.GetNextIndent() << "UseWorkStealingThreadPool: "
+     << this->m_UseWorkStealingThreadPool << std::endl;
+  os << indent.GetNextIndent() << "SupportsSampleRangeThreading: "
+     << this->m_SupportsSampleRangeThreading << std::endl;
+  os << indent.GetNextIndent() << "ThreadPoolChunkSize: "
+     << this->m_ThreadPoolChunkSize << std::endl;
+
 } // end PrintSelf()
 
 
@@ -20,6 +20,8 @@
 
 #include "itkAdvancedImageToImageMetric.h"
 #include "itkKernelFunctionBase2.h"
+#include "itkSparseJointPDFDerivatives.h"
+#include "itkArray2D.h"
 
 
 namespace itk
@@ -50,6 +52,7 @@ namespace itk
  *  - A fixed and moving number of histogram bins can be chosen.
  *  - More use of iterators instead of raw buffer pointers.
  *  - An optional FiniteDifference derivative estimation.
+ *  - An optional sparse storage of the explicit PDF derivatives.
  *
  * \warning This class is not thread safe due the member data structures
  *  used to the store the sampled points and the marginal and joint pdfs.
@@ -121,6 +124,7 @@ public:
   typedef typename Superclass::ImageSamplerPointer             ImageSamplerPointer;
   typedef typename Superclass::ImageSampleContainerType        ImageSampleContainerType;
   typedef typename Superclass::ImageSampleContainerPointer     ImageSampleContainerPointer;
+  typedef typename Superclass::ImageSampleWeightContainerType  ImageSampleWeightContainerType;
   typedef typename Superclass::FixedImageLimiterType           FixedImageLimiterType;
   typedef typename Superclass::MovingImageLimiterType          MovingImageLimiterType;
   typedef typename Superclass::FixedImageLimiterOutputType     FixedImageLimiterOutputType;
@@ -128,6 +132,7 @@ public:
   typedef typename Superclass::MovingImageDerivativeScalesType MovingImageDerivativeScalesType;
   typedef typename Superclass::ThreaderType                    ThreaderType;
   typedef typename Superclass::ThreadInfoType                  ThreadInfoType;
+  typedef typename Superclass::NumberOfParametersType          NumberOfParametersType;
 
   /** The fixed image dimension. */
   itkStaticConstMacro( FixedImageDimension, unsigned int,
@@ -141,7 +146,8 @@ public:
    * (1) Call the superclass' implementation
    * (2) InitializeHistograms()
    * (3) InitializeKernels()
-   * (4) Resize AlphaDerivatives
+   * (4) Initialize the per-thread sparse pdf derivatives, if needed
+   * (5) Resize AlphaDerivatives
    */
   void Initialize( void );
 
@@ -196,6 +202,16 @@ public:
   itkGetConstReferenceMacro( UseExplicitPDFDerivatives, bool );
   itkBooleanMacro( UseExplicitPDFDerivatives );
 
+  /** Option to store the explicit PDF derivatives sparsely, only for the
+   * parameters and bins that are touched by the samples. The memory use then
+   * grows with the number of samples instead of the number of parameters.
+   * Only used if UseExplicitPDFDerivatives is true, and only supported by
+   * inheriting classes that call ComputePDFsAndSparsePDFDerivatives().
+   * This option should be set before calling Initialize(); Default: false.
+   */
+  itkSetMacro( UseSparsePDFDerivatives, bool );
+  itkGetConstMacro( UseSparsePDFDerivatives, bool );
+
   /** Whether you plan to call the GetDerivative/GetValueAndDerivative method or not.
    * This option should be set before calling Initialize(); Default: false.
    */
@@ -215,6 +231,12 @@ public:
   itkSetMacro( FiniteDifferencePerturbation, double );
   itkGetConstMacro( FiniteDifferencePerturbation, double );
 
+  /** Set/get whether to apply the technique introduced by Nicholas Tustison
+   * to the derivative that is computed by ComputeDerivativeLowMemory(); default: false
+   */
+  itkGetConstMacro( UseJacobianPreconditioning, bool );
+  itkSetMacro( UseJacobianPreconditioning, bool );
+
 protected:
 
   /** The constructor. */
@@ -262,13 +284,25 @@ protected:
   typedef IncrementalMarginalPDFType::SizeType         IncrementalMarginalPDFSizeType;
   typedef Array< PDFValueType >                        ParzenValueContainerType;
 
+  /** Typedefs for the weights of the joint histogram derivatives in the
+   * derivative, see ComputeDerivativeLowMemory().
+   */
+  typedef double                PRatioType;
+  typedef Array2D< PRatioType > PRatioArrayType;
+
+  /** Typedefs for the sparse PDF derivatives. */
+  typedef SparseJointPDFDerivatives< PDFDerivativeValueType > SparseJointPDFDerivativesType;
+  typedef typename SparseJointPDFDerivativesType::Pointer     SparseJointPDFDerivativesPointer;
+
   /** Typedefs for Parzen kernel. */
   typedef KernelFunctionBase2< PDFValueType >  KernelFunctionType;
   typedef typename KernelFunctionType::Pointer KernelFunctionPointer;
 
   /** Protected variables **************************** */
 
-  /** Variables for Alpha (the normalization factor of the histogram). */
+  /** Variables for Alpha (the normalization factor of the histogram): one
+   * over the sum of the importance weights of the valid samples, which is
+   * their number if the image sampler does not weight the samples. */
   mutable double         m_Alpha;
   mutable DerivativeType m_PerturbedAlphaRight;
   mutable DerivativeType m_PerturbedAlphaLeft;
@@ -306,13 +340,20 @@ protected:
   struct ParzenWindowHistogramMultiThreaderParameterType // can't we use the one from AdvancedImageToImageMetric ?
   {
     Self * m_Metric;
+    // Used for ComputeDerivativeFromSparsePDFDerivatives
+    const PDFValueType * m_BinWeights;
+    double               m_BinWeightsScale;
+    // Used for ComputeDerivativeLowMemory
+    const PRatioArrayType * m_PRatioArray;
   };
-  ParzenWindowHistogramMultiThreaderParameterType m_ParzenWindowHistogramThreaderParameters;
+  mutable ParzenWindowHistogramMultiThreaderParameterType m_ParzenWindowHistogramThreaderParameters;
 
   struct ParzenWindowHistogramGetValueAndDerivativePerThreadStruct
   {
-    SizeValueType   st_NumberOfPixelsCounted;
-    JointPDFPointer st_JointPDF;
+    SizeValueType                    st_NumberOfPixelsCounted;
+    double                           st_SumOfSampleWeights;
+    JointPDFPointer                  st_JointPDF;
+    SparseJointPDFDerivativesPointer st_JointPDFDerivatives;
   };
   itkPadStruct( ITK_CACHE_LINE_ALIGNMENT, ParzenWindowHistogramGetValueAndDerivativePerThreadStruct,
     PaddedParzenWindowHistogramGetValueAndDerivativePerThreadStruct );
@@ -321,21 +362,52 @@ protected:
   mutable AlignedParzenWindowHistogramGetValueAndDerivativePerThreadStruct * m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables;
   mutable ThreadIdType                                                       m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariablesSize;
 
-  /** Initialize threading related parameters. */
+  /** Initialize threading related parameters; additionally sizes the
+   * per-thread Jacobian preconditioning arrays, if needed. */
   virtual void InitializeThreadingParameters( void ) const;
 
   /** Multi-threaded versions of the ComputePDF function. */
   inline void ThreadedComputePDFs( ThreadIdType threadId );
 
-  /** Single-threadedly accumulate results. */
+  /** Accumulate the results of all threads. */
   inline void AfterThreadedComputePDFs( void ) const;
 
+  /** Multi-threaded accumulation of the joint histograms of all threads.
+   * Each thread sums a disjoint block of bins, see GetCacheAlignedBlockRange().
+   */
+  inline void ThreadedAccumulateJointPDFs( ThreadIdType threadId );
+
+  /** Helper function to launch the threads. */
+  static ITK_THREAD_RETURN_TYPE AccumulateJointPDFsThreaderCallback( void * arg );
+
   /** Helper function to launch the threads. */
   static ITK_THREAD_RETURN_TYPE ComputePDFsThreaderCallback( void * arg );
 
   /** Helper function to launch the threads. */
   void LaunchComputePDFsThreaderCallback( void ) const;
 
+  /** Multi-threaded version of ComputePDFsAndSparsePDFDerivatives(). Each thread
+   * fills its own joint histogram and sparse joint histogram derivatives.
+   */
+  inline void ThreadedComputePDFsAndSparsePDFDerivatives( ThreadIdType threadId );
+
+  /** Helper function to launch the threads. */
+  static ITK_THREAD_RETURN_TYPE ComputePDFsAndSparsePDFDerivativesThreaderCallback( void * arg );
+
+  /** Multi-threaded version of ComputeDerivativeFromSparsePDFDerivatives(). */
+  inline void ThreadedComputeDerivativeFromSparsePDFDerivatives( ThreadIdType threadId );
+
+  /** Helper function to launch the threads. */
+  static ITK_THREAD_RETURN_TYPE ComputeDerivativeFromSparsePDFDerivativesThreaderCallback( void * arg );
+
+  /** Multi-threaded version of ComputeDerivativeLowMemory(). Each thread adds
+   * the contributions of its samples to its own derivative.
+   */
+  inline void ThreadedComputeDerivativeLowMemory( ThreadIdType threadId );
+
+  /** Helper function to launch the threads. */
+  static ITK_THREAD_RETURN_TYPE ComputeDerivativeLowMemoryThreaderCallback( void * arg );
+
   /** Compute the Parzen values given an image value and a starting histogram index
    * Compute the values at (parzenWindowIndex - parzenWindowTerm + k) for
    * k = 0 ... kernelsize-1
@@ -348,14 +420,19 @@ protected:
     ParzenValueContainerType & parzenValues ) const;
 
   /** Update the joint PDF with a pixel pair; on demand also updates the
-   * pdf derivatives (if the Jacobian pointers are nonzero).
+   * pdf derivatives (if the Jacobian pointers are nonzero). The pdf
+   * derivatives are stored in sparseJointPDFDerivatives if it is nonzero,
+   * and in m_JointPDFDerivatives otherwise. The contributions are multiplied
+   * by the importance weight of the sample, see GetFixedImageSampleWeights().
    */
   virtual void UpdateJointPDFAndDerivatives(
     const RealType & fixedImageValue,
     const RealType & movingImageValue,
+    const double sampleWeight,
     const DerivativeType * imageJacobian,
     const NonZeroJacobianIndicesType * nzji,
-    JointPDFType * jointPDF ) const;
+    JointPDFType * jointPDF,
+    SparseJointPDFDerivativesType * sparseJointPDFDerivatives = 0 ) const;
 
   /** Update the joint PDF and the incremental pdfs.
    * The input is a pixel pair (fixed, moving, moving mask) and
@@ -421,6 +498,55 @@ protected:
    */
   virtual void ComputePDFsAndPDFDerivatives( const ParametersType & parameters ) const;
 
+  /** Compute PDFs and sparse pdf derivatives; the variant of
+   * ComputePDFsAndPDFDerivatives() for UseSparsePDFDerivatives == true.
+   * Constructs the m_JointPDF and m_Alpha, and the sparse joint histogram
+   * derivatives of each thread, which are not merged. Executes
+   * multi-threadedly when m_UseMultiThread == true.
+   */
+  virtual void ComputePDFsAndSparsePDFDerivatives( const ParametersType & parameters ) const;
+
+  /** Compute the derivative from the sparse pdf derivatives of the threads:
+   * derivative[ mu ] = scale * \sum_bin binWeights[ bin ] * dh( bin ) / dmu,
+   * with bin = movingBin + fixedBin * NumberOfMovingHistogramBins, and h the
+   * unnormalized joint histogram. The derivative should have the right size.
+   */
+  void ComputeDerivativeFromSparsePDFDerivatives( const PDFValueType * binWeights,
+    const double scale, DerivativeType & derivative ) const;
+
+  /** Compute the derivative without the joint histogram derivatives, by a
+   * second loop over the samples. Each sample adds its image Jacobian times
+   * \sum_i \sum_k pRatioArray(i,k) * dB/dxi(xi,i,k), with i, k the fixed and
+   * moving histogram bins, and dB/dxi the derivative of the moving Parzen
+   * window. The pRatioArray holds the weights of the joint histogram
+   * derivatives, which depend on the metric; it should be computed from the
+   * joint histogram of the same samples. Used by the low memory variants of
+   * the inheriting classes. Executes multi-threadedly when m_UseMultiThread == true.
+   */
+  void ComputeDerivativeLowMemory( const PRatioArrayType & pRatioArray,
+    DerivativeType & derivative ) const;
+
+  /** Single-threaded version of ComputeDerivativeLowMemory(). */
+  void ComputeDerivativeLowMemorySingleThreaded( const PRatioArrayType & pRatioArray,
+    DerivativeType & derivative ) const;
+
+  /** Add the contribution of a sample to the derivative of ComputeDerivativeLowMemory(). */
+  void UpdateDerivativeLowMemory(
+    const PRatioArrayType & pRatioArray,
+    const RealType & fixedImageValue,
+    const RealType & movingImageValue,
+    const double sampleWeight,
+    const DerivativeType & imageJacobian,
+    const NonZeroJacobianIndicesType & nzji,
+    DerivativeType & derivative ) const;
+
+  /** Compute terms to implement preconditioning as proposed by Tustison et al. */
+  virtual void ComputeJacobianPreconditioner(
+    const TransformJacobianType & jac,
+    const NonZeroJacobianIndicesType & nzji,
+    DerivativeType & preconditioner,
+    DerivativeType & divisor ) const;
+
   /** Compute PDFs and incremental pdfs (which you can use to compute finite
    * difference estimate of the derivative).
    * Loops over the fixed image samples and constructs the m_JointPDF,
@@ -495,8 +621,10 @@ private:
   unsigned int  m_MovingKernelBSplineOrder;
   bool          m_UseDerivative;
   bool          m_UseExplicitPDFDerivatives;
+  bool          m_UseSparsePDFDerivatives;
   bool          m_UseFiniteDifferenceDerivative;
   double        m_FiniteDifferencePerturbation;
+  bool          m_UseJacobianPreconditioning;
 
 };
 
@@ -24,7 +24,10 @@
 #include "itkBSplineDerivativeKernelFunction2.h"
 #include "itkImageLinearIteratorWithIndex.h"
 #include "itkImageScanlineIterator.h"
+#include <algorithm>
 #include "vnl/vnl_math.h"
+#include "itkMatrix.h"
+#include "vnl/vnl_inverse.h"
 
 namespace itk
 {
@@ -62,15 +65,21 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
   this->m_UseDerivative                 = false;
   this->m_UseFiniteDifferenceDerivative = false;
   this->m_FiniteDifferencePerturbation  = 1.0;
+  this->m_UseJacobianPreconditioning    = false;
 
   this->SetUseImageSampler( true );
+  this->SetUseFixedImageSampleWeights( true );
   this->SetUseFixedImageLimiter( true );
   this->SetUseMovingImageLimiter( true );
 
   this->m_UseExplicitPDFDerivatives = true;
+  this->m_UseSparsePDFDerivatives   = false;
 
   /** Initialize the m_ParzenWindowHistogramThreaderParameters */
-  this->m_ParzenWindowHistogramThreaderParameters.m_Metric = this;
+  this->m_ParzenWindowHistogramThreaderParameters.m_Metric          = this;
+  this->m_ParzenWindowHistogramThreaderParameters.m_BinWeights      = 0;
+  this->m_ParzenWindowHistogramThreaderParameters.m_BinWeightsScale = 0.0;
+  this->m_ParzenWindowHistogramThreaderParameters.m_PRatioArray     = 0;
 
   // Multi-threading structs
   this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables     = NULL;
@@ -147,6 +156,22 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
   /** Set up the Parzen windows. */
   this->InitializeKernels();
 
+  /** The samples are read in batches, see GetFixedImageSamples(). */
+  if( this->GetImageSampler() )
+  {
+    this->GetImageSampler()->SetGenerateSampleBatchContainer( true );
+  }
+
+  /** The sparse pdf derivatives are stored per thread, also when the
+   * metric is not computed multi-threadedly.
+   */
+  if( !this->m_UseMultiThread && this->GetUseDerivative()
+    && !this->GetUseFiniteDifferenceDerivative()
+    && this->m_UseExplicitPDFDerivatives && this->m_UseSparsePDFDerivatives )
+  {
+    this->InitializeThreadingParameters();
+  }
+
   /** If the user plans to use a finite difference derivative,
    * allocate some memory for the perturbed alpha variables.
    */
@@ -329,7 +354,10 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
     } // end if this->GetUseFiniteDifferenceDerivative()
     else
     {
-      if( this->m_UseExplicitPDFDerivatives )
+      /** The sparse pdf derivatives are stored per thread,
+       * see InitializeThreadingParameters().
+       */
+      if( this->m_UseExplicitPDFDerivatives && !this->m_UseSparsePDFDerivatives )
       {
         this->m_IncrementalJointPDFRight = 0;
         this->m_IncrementalJointPDFLeft  = 0;
@@ -472,20 +500,22 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
 
   const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
 
-  /** Only resize the array of structs when needed. */
-  if( this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariablesSize != numberOfThreads )
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariablesSize < numberOfThreads )
   {
     delete[] this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables;
     this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables
       = new AlignedParzenWindowHistogramGetValueAndDerivativePerThreadStruct[
       numberOfThreads ];
     this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
   }
 
   /** Some initialization. */
   for( ThreadIdType i = 0; i < numberOfThreads; ++i )
   {
     this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted = NumericTraits< SizeValueType >::Zero;
+    this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_SumOfSampleWeights    = 0.0;
 
     // Initialize the joint pdf
     JointPDFPointer & jointPDF = this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_JointPDF;
@@ -494,6 +524,55 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
     {
       jointPDF->SetRegions( jointPDFRegion );
       jointPDF->Allocate();
+      ++this->m_NumberOfPerThreadAllocations;
+    }
+  }
+
+  /** Create the sparse joint pdf derivatives, only when needed. Their memory
+   * is kept over the iterations, see SparseJointPDFDerivatives::Reset().
+   */
+  const bool useSparsePDFDerivatives = this->GetUseDerivative()
+    && !this->GetUseFiniteDifferenceDerivative()
+    && this->m_UseExplicitPDFDerivatives && this->m_UseSparsePDFDerivatives;
+  const SizeValueType numberOfBins = this->m_NumberOfMovingHistogramBins * this->m_NumberOfFixedHistogramBins;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    SparseJointPDFDerivativesPointer & sparseJointPDFDerivatives
+      = this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_JointPDFDerivatives;
+    if( !useSparsePDFDerivatives )
+    {
+      sparseJointPDFDerivatives = 0;
+      continue;
+    }
+
+    if( sparseJointPDFDerivatives.IsNull() )
+    {
+      sparseJointPDFDerivatives = SparseJointPDFDerivativesType::New();
+      ++this->m_NumberOfPerThreadAllocations;
+    }
+    if( sparseJointPDFDerivatives->GetNumberOfBins() != numberOfBins
+      || sparseJointPDFDerivatives->GetNumberOfParameters() != this->GetNumberOfParameters() )
+    {
+      sparseJointPDFDerivatives->Initialize( numberOfBins, this->GetNumberOfParameters(), 8 );
+    }
+  }
+
+  /** Size the Jacobian preconditioning arrays of the thread scratch memory. */
+  if( !this->GetUseJacobianPreconditioning() || this->m_AdvancedTransform.IsNull() )
+  {
+    return;
+  }
+
+  const NumberOfParametersType nnzji = this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices();
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    typename Superclass::ThreadScratchStruct & scratch = this->GetThreadScratch( i );
+    if( scratch.st_JacobianPreconditioner.GetSize() != nnzji
+      || scratch.st_PreconditioningDivisor.GetSize() != this->GetNumberOfParameters() )
+    {
+      scratch.st_JacobianPreconditioner.SetSize( nnzji );
+      scratch.st_PreconditioningDivisor.SetSize( this->GetNumberOfParameters() );
+      ++this->m_NumberOfPerThreadAllocations;
     }
   }
 
@@ -564,9 +643,11 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
 ::UpdateJointPDFAndDerivatives(
   const RealType & fixedImageValue,
   const RealType & movingImageValue,
+  const double sampleWeight,
   const DerivativeType * imageJacobian,
   const NonZeroJacobianIndicesType * nzji,
-  JointPDFType * jointPDF ) const
+  JointPDFType * jointPDF,
+  SparseJointPDFDerivativesType * sparseJointPDFDerivatives ) const
 {
   typedef ImageScanlineIterator< JointPDFType > PDFIteratorType;
 
@@ -611,7 +692,7 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
     /** Loop over the Parzen window region and increment the values. */
     for( unsigned int f = 0; f < fixedParzenValues.GetSize(); ++f )
     {
-      const double fv = fixedParzenValues[ f ];
+      const double fv = fixedParzenValues[ f ] * sampleWeight;
       for( unsigned int m = 0; m < movingParzenValues.GetSize(); ++m )
       {
         it.Value() += static_cast< PDFValueType >( fv * movingParzenValues[ m ] );
@@ -636,14 +717,25 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
      */
     for( unsigned int f = 0; f < fixedParzenValues.GetSize(); ++f )
     {
-      const double fv    = fixedParzenValues[ f ];
+      const double fv    = fixedParzenValues[ f ] * sampleWeight;
       const double fv_et = fv / et;
       for( unsigned int m = 0; m < movingParzenValues.GetSize(); ++m )
       {
         it.Value() += static_cast< PDFValueType >( fv * movingParzenValues[ m ] );
-        this->UpdateJointPDFDerivatives(
-          it.GetIndex(), fv_et * derivativeMovingParzenValues[ m ],
-          *imageJacobian, *nzji );
+        if( sparseJointPDFDerivatives )
+        {
+          const JointPDFIndexType & pdfIndex = it.GetIndex();
+          sparseJointPDFDerivatives->UpdateBin(
+            pdfIndex[ 0 ] + pdfIndex[ 1 ] * this->m_NumberOfMovingHistogramBins,
+            fv_et * derivativeMovingParzenValues[ m ],
+            imageJacobian->data_block(), *nzji );
+        }
+        else
+        {
+          this->UpdateJointPDFDerivatives(
+            it.GetIndex(), fv_et * derivativeMovingParzenValues[ m ],
+            *imageJacobian, *nzji );
+        }
         ++it;
       }
       it.NextLine();
@@ -1055,6 +1147,11 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
   typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
   typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
 
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights      = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights   = !sampleWeights.empty();
+  double                                 sumOfSampleWeights = 0.0;
+
   /** Loop over sample container and compute contribution of each sample to pdfs. */
   for( fiter = fbegin; fiter != fend; ++fiter )
   {
@@ -1093,8 +1190,10 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
       movingImageValue = this->GetMovingImageLimiter()->Evaluate( movingImageValue );
 
       /** Compute this sample's contribution to the joint distributions. */
+      const double sampleWeight = useSampleWeights ? sampleWeights[ fiter.Index() ] : 1.0;
+      sumOfSampleWeights += sampleWeight;
       this->UpdateJointPDFAndDerivatives(
-        fixedImageValue, movingImageValue, 0, 0, this->m_JointPDF.GetPointer() );
+        fixedImageValue, movingImageValue, sampleWeight, 0, 0, this->m_JointPDF.GetPointer() );
     }
 
   } // end iterating over fixed image spatial sample container for loop
@@ -1102,8 +1201,8 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
   /** Check if enough samples were valid. */
   this->CheckNumberOfSamples( sampleContainer->Size(), this->m_NumberOfPixelsCounted );
 
-  /** Compute alpha. */
-  this->m_Alpha = 1.0 / static_cast< double >( this->m_NumberOfPixelsCounted );
+  /** Compute alpha, such that the joint pdf sums to one. */
+  this->m_Alpha = 1.0 / sumOfSampleWeights;
 
 } // end ComputePDFsSingleThreaded()
 
@@ -1177,62 +1276,70 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
   pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
   pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
 
-  /** Create iterator over the sample container. */
-  typename ImageSampleContainerType::ConstIterator fiter;
-  typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
-  typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->Begin();
-  fbegin                                                 += (int)pos_begin;
-  fend                                                   += (int)pos_end;
+  /** The samples are transformed in batches, so that the transform can
+   * evaluate a batch at once, using SIMD instructions if available.
+   */
+  const unsigned int   batchSize = Superclass::SampleBatchSize;
+  FixedImagePointType  fixedPoints[ batchSize ];
+  MovingImagePointType mappedPoints[ batchSize ];
+  RealType             fixedImageValues[ batchSize ];
+
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
 
   /** Create variables to store intermediate results. circumvent false sharing */
   unsigned long numberOfPixelsCounted = 0;
+  double        sumOfSampleWeights    = 0.0;
 
   /** Loop over sample container and compute contribution of each sample to pdfs. */
-  for( fiter = fbegin; fiter != fend; ++fiter )
+  for( unsigned long batchBegin = pos_begin; batchBegin < pos_end; batchBegin += batchSize )
   {
-    /** Read fixed coordinates and initialize some variables. */
-    const FixedImagePointType & fixedPoint = ( *fiter ).Value().m_ImageCoordinates;
-    RealType                    movingImageValue;
-    MovingImagePointType        mappedPoint;
-
-    /** Transform point and check if it is inside the B-spline support region. */
-    bool sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
+    const unsigned int numberOfPoints = static_cast< unsigned int >(
+      ( pos_end - batchBegin < batchSize ) ? pos_end - batchBegin : batchSize );
 
-    /** Check if point is inside mask. */
-    if( sampleOk )
-    {
-      sampleOk = this->IsInsideMovingMask( mappedPoint );
-    }
-
-    /** Compute the moving image value and check if the point is
-     * inside the moving image buffer.
-     */
-    if( sampleOk )
-    {
-      sampleOk = this->EvaluateMovingImageValueAndDerivative(
-        mappedPoint, movingImageValue, 0 );
-    }
+    /** Read the fixed coordinates and values, and transform the points. */
+    this->GetFixedImageSamples( batchBegin, numberOfPoints, fixedPoints, fixedImageValues );
+    this->TransformPoints( fixedPoints, mappedPoints, numberOfPoints );
 
-    if( sampleOk )
+    for( unsigned int i = 0; i < numberOfPoints; ++i )
     {
-      numberOfPixelsCounted++;
+      const MovingImagePointType & mappedPoint = mappedPoints[ i ];
+      RealType                     movingImageValue;
 
-      /** Get the fixed image value. */
-      RealType fixedImageValue = static_cast< RealType >( ( *fiter ).Value().m_ImageValue );
+      /** Check if point is inside mask. */
+      bool sampleOk = this->IsInsideMovingMask( mappedPoint );
 
-      /** Make sure the values fall within the histogram range. */
-      fixedImageValue  = this->GetFixedImageLimiter()->Evaluate( fixedImageValue );
-      movingImageValue = this->GetMovingImageLimiter()->Evaluate( movingImageValue );
+      /** Compute the moving image value and check if the point is
+       * inside the moving image buffer.
+       */
+      if( sampleOk )
+      {
+        sampleOk = this->EvaluateMovingImageValueAndDerivative(
+          mappedPoint, movingImageValue, 0 );
+      }
 
-      /** Compute this sample's contribution to the joint distributions. */
-      this->UpdateJointPDFAndDerivatives(
-        fixedImageValue, movingImageValue, 0, 0,
-        jointPDF.GetPointer() );
+      if( sampleOk )
+      {
+        numberOfPixelsCounted++;
+
+        /** Make sure the values fall within the histogram range. */
+        const RealType fixedImageValue = this->GetFixedImageLimiter()->Evaluate( fixedImageValues[ i ] );
+        movingImageValue = this->GetMovingImageLimiter()->Evaluate( movingImageValue );
+
+        /** Compute this sample's contribution to the joint distributions. */
+        const double sampleWeight = useSampleWeights ? sampleWeights[ batchBegin + i ] : 1.0;
+        sumOfSampleWeights += sampleWeight;
+        this->UpdateJointPDFAndDerivatives(
+          fixedImageValue, movingImageValue, sampleWeight, 0, 0,
+          jointPDF.GetPointer() );
+      }
     }
   } // end iterating over fixed image spatial sample container for loop
 
   /** Only update these variables at the end to prevent unnecessary "false sharing". */
   this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ threadId ].st_NumberOfPixelsCounted = numberOfPixelsCounted;
+  this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ threadId ].st_SumOfSampleWeights    = sumOfSampleWeights;
 
 } // end ThreadedComputePDFs()
 
@@ -1248,16 +1355,21 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
 {
   const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
 
-  /** Accumulate the number of pixels. */
+  /** Accumulate the number of pixels and the sum of their importance weights. */
   this->m_NumberOfPixelsCounted
     = this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ 0 ].st_NumberOfPixelsCounted;
+  double sumOfSampleWeights
+    = this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ 0 ].st_SumOfSampleWeights;
   for( ThreadIdType i = 1; i < numberOfThreads; ++i )
   {
     this->m_NumberOfPixelsCounted
       += this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted;
+    sumOfSampleWeights
+      += this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_SumOfSampleWeights;
 
-    /** Reset this variable for the next iteration. */
+    /** Reset these variables for the next iteration. */
     this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted = 0;
+    this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_SumOfSampleWeights    = 0.0;
   }
 
   /** Check if enough samples were valid. */
@@ -1265,45 +1377,94 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
   this->CheckNumberOfSamples(
     sampleContainer->Size(), this->m_NumberOfPixelsCounted );
 
-  /** Compute alpha. */
-  this->m_Alpha = 1.0 / static_cast< double >( this->m_NumberOfPixelsCounted );
+  /** Compute alpha, such that the joint pdf sums to one. */
+  this->m_Alpha = 1.0 / sumOfSampleWeights;
 
-  /** Accumulate joint histogram. */
-  // could be multi-threaded too, by each thread updating only a part of the JointPDF.
-  typedef ImageScanlineIterator< JointPDFType > JointPDFIteratorType;
-  JointPDFIteratorType                it( this->m_JointPDF, this->m_JointPDF->GetBufferedRegion() );
-  std::vector< JointPDFIteratorType > itT( numberOfThreads );
-  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  /** Accumulate the joint histograms, in parallel over blocks of bins. The
+   * single-threaded option accumulates the same blocks one after another.
+   */
+  if( this->m_UseMultiThread )
   {
-    itT[ i ] = JointPDFIteratorType(
-      this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_JointPDF,
-      this->m_JointPDF->GetBufferedRegion() );
+    this->m_Threader->SetSingleMethod( this->AccumulateJointPDFsThreaderCallback,
+      const_cast< void * >( static_cast< const void * >(
+        &this->m_ParzenWindowHistogramThreaderParameters ) ) );
+    this->m_Threader->SingleMethodExecute();
   }
-
-  PDFValueType sum;
-  while( !it.IsAtEnd() )
+  else
   {
-    while( !it.IsAtEndOfLine() )
-    {
-      sum = NumericTraits< PDFValueType >::Zero;
-      for( ThreadIdType i = 0; i < numberOfThreads; ++i )
-      {
-        sum += itT[ i ].Value();
-        ++itT[ i ];
-      }
-      it.Set( sum );
-      ++it;
-    }
-    it.NextLine();
     for( ThreadIdType i = 0; i < numberOfThreads; ++i )
     {
-      itT[ i ].NextLine();
+      this->m_ParzenWindowHistogramThreaderParameters.m_Metric
+      ->ThreadedAccumulateJointPDFs( i );
     }
   }
 
 } // end AfterThreadedComputePDFs()
 
 
+/**
+ * ******************* ThreadedAccumulateJointPDFs *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedAccumulateJointPDFs( ThreadIdType threadId )
+{
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
+
+  /** The bins [ begin, end [ of this thread. */
+  SizeValueType begin, end;
+  Self::GetCacheAlignedBlockRange(
+    this->m_JointPDF->GetBufferedRegion().GetNumberOfPixels(),
+    sizeof( PDFValueType ), threadId, numberOfThreads, begin, end );
+  if( begin == end )
+  {
+    return;
+  }
+
+  /** Sum the per-thread joint histograms over these bins, in a fixed order,
+   * so that the result does not depend on the scheduling of the threads.
+   */
+  PDFValueType * jointPDFPtr = this->m_JointPDF->GetBufferPointer();
+  const PDFValueType * threadJointPDFPtr
+    = this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ 0 ].st_JointPDF->GetBufferPointer();
+  std::copy( threadJointPDFPtr + begin, threadJointPDFPtr + end, jointPDFPtr + begin );
+  for( ThreadIdType i = 1; i < numberOfThreads; ++i )
+  {
+    threadJointPDFPtr
+      = this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ i ].st_JointPDF->GetBufferPointer();
+    for( SizeValueType k = begin; k < end; ++k )
+    {
+      jointPDFPtr[ k ] += threadJointPDFPtr[ k ];
+    }
+  }
+
+} // end ThreadedAccumulateJointPDFs()
+
+
+/**
+ * **************** AccumulateJointPDFsThreaderCallback *******
+ */
+
+template< class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::AccumulateJointPDFsThreaderCallback( void * arg )
+{
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadId   = infoStruct->ThreadID;
+
+  ParzenWindowHistogramMultiThreaderParameterType * temp
+    = static_cast< ParzenWindowHistogramMultiThreaderParameterType * >( infoStruct->UserData );
+
+  temp->m_Metric->ThreadedAccumulateJointPDFs( threadId );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end AccumulateJointPDFsThreaderCallback()
+
+
 /**
  * **************** ComputePDFsThreaderCallback *******
  */
@@ -1389,6 +1550,11 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
   typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
   typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
 
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights      = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights   = !sampleWeights.empty();
+  double                                 sumOfSampleWeights = 0.0;
+
   /** Loop over sample container and compute contribution of each sample to pdfs. */
   for( fiter = fbegin; fiter != fend; ++fiter )
   {
@@ -1436,8 +1602,11 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
         jacobian, movingImageDerivative, imageJacobian );
 
       /** Update the joint pdf and the joint pdf derivatives. */
+      const double sampleWeight = useSampleWeights ? sampleWeights[ fiter.Index() ] : 1.0;
+      sumOfSampleWeights += sampleWeight;
       this->UpdateJointPDFAndDerivatives(
-        fixedImageValue, movingImageValue, &imageJacobian, &nzji, this->m_JointPDF.GetPointer() );
+        fixedImageValue, movingImageValue, sampleWeight, &imageJacobian, &nzji,
+        this->m_JointPDF.GetPointer() );
 
     } //end if-block check sampleOk
   } // end iterating over fixed image spatial sample container for loop
@@ -1446,121 +1615,965 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
   this->CheckNumberOfSamples(
     sampleContainer->Size(), this->m_NumberOfPixelsCounted );
 
-  /** Compute alpha. */
+  /** Compute alpha, such that the joint pdf sums to one. */
   this->m_Alpha = 0.0;
-  if( this->m_NumberOfPixelsCounted > 0 )
+  if( sumOfSampleWeights > 0.0 )
   {
-    this->m_Alpha = 1.0 / static_cast< double >( this->m_NumberOfPixelsCounted );
+    this->m_Alpha = 1.0 / sumOfSampleWeights;
   }
 
 } // end ComputePDFsAndPDFDerivatives()
 
 
 /**
- * ************************ ComputePDFsAndIncrementalPDFs *******************
+ * ************************ ComputePDFsAndSparsePDFDerivatives *******************
  */
 
 template< class TFixedImage, class TMovingImage >
 void
 ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
-::ComputePDFsAndIncrementalPDFs( const ParametersType & parameters ) const
+::ComputePDFsAndSparsePDFDerivatives( const ParametersType & parameters ) const
 {
-  /** Initialize some variables. */
-  this->m_JointPDF->FillBuffer( 0.0 );
-  this->m_IncrementalJointPDFRight->FillBuffer( 0.0 );
-  this->m_IncrementalJointPDFLeft->FillBuffer( 0.0 );
-  this->m_Alpha = 0.0;
-  this->m_PerturbedAlphaRight.Fill( 0.0 );
-  this->m_PerturbedAlphaLeft.Fill( 0.0 );
-
-  this->m_NumberOfPixelsCounted = 0;
-  double       sumOfMovingMaskValues = 0.0;
-  const double delta                 = this->GetFiniteDifferencePerturbation();
-
-  /** sparse jacobian+indices. */
-  NonZeroJacobianIndicesType nzji( this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices() );
-  TransformJacobianType      jacobian;
-
-  /** Arrays that store dM(x)/dmu and dMask(x)/dmu. */
-  DerivativeType movingImageValuesRight( nzji.size() );
-  DerivativeType movingImageValuesLeft( nzji.size() );
-  DerivativeType movingMaskValuesRight( nzji.size() );
-  DerivativeType movingMaskValuesLeft( nzji.size() );
-
   /** Call non-thread-safe stuff, such as:
    *   this->SetTransformParameters( parameters );
    *   this->GetImageSampler()->Update();
-   * Because of these calls GetValueAndDerivative itself is not thread-safe,
-   * so cannot be called multiple times simultaneously.
-   * This is however needed in the CombinationImageToImageMetric.
-   * In that case, you need to:
-   * - switch the use of this function to on, using m_UseMetricSingleThreaded = true
-   * - call BeforeThreadedGetValueAndDerivative once (single-threaded) before
-   *   calling GetValueAndDerivative
-   * - switch the use of this function to off, using m_UseMetricSingleThreaded = false
-   * - Now you can call GetValueAndDerivative multi-threaded.
+   * See ComputePDFs() for the consequences.
    */
   this->BeforeThreadedGetValueAndDerivative( parameters );
 
+  /** Compute the joint histogram and the sparse joint histogram derivatives
+   * of each thread. The single-threaded option loops over the same parts of
+   * the sample container, so that the per-thread results are equal.
+   */
+  if( this->m_UseMultiThread )
+  {
+    this->m_Threader->SetSingleMethod( this->ComputePDFsAndSparsePDFDerivativesThreaderCallback,
+      const_cast< void * >( static_cast< const void * >(
+        &this->m_ParzenWindowHistogramThreaderParameters ) ) );
+    this->m_Threader->SingleMethodExecute();
+  }
+  else
+  {
+    for( ThreadIdType i = 0; i < Self::GetNumberOfThreads(); ++i )
+    {
+      this->m_ParzenWindowHistogramThreaderParameters.m_Metric
+      ->ThreadedComputePDFsAndSparsePDFDerivatives( i );
+    }
+  }
+
+  /** Accumulate the joint histograms and compute alpha. The sparse joint
+   * histogram derivatives are not accumulated, since the derivative of the
+   * metric is linear in them, see ComputeDerivativeFromSparsePDFDerivatives().
+   */
+  this->AfterThreadedComputePDFs();
+
+} // end ComputePDFsAndSparsePDFDerivatives()
+
+
+/**
+ * ******************* ThreadedComputePDFsAndSparsePDFDerivatives *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedComputePDFsAndSparsePDFDerivatives( ThreadIdType threadId )
+{
+  /** The samples are processed in batches, so that the transform can evaluate
+   * a batch at once, using SIMD instructions if available.
+   */
+  typedef typename Superclass::AdvancedTransformType::MovingImageGradientType MovingImageGradientType;
+  const unsigned int batchSize = Superclass::SampleBatchSize;
+
+  /** Get the pre-allocated arrays that store dM(x)/dmu, and the sparse Jacobian + indices. */
+  typename Superclass::ThreadScratchStruct &  scratch        = this->GetThreadScratch( threadId );
+  std::vector< NonZeroJacobianIndicesType > & nzjis          = scratch.st_BatchNonZeroJacobianIndices;
+  std::vector< DerivativeType > &             imageJacobians = scratch.st_BatchImageJacobians;
+
+  /** Per batch: the fixed points, mapped points, image values and moving image gradients. */
+  FixedImagePointType     fixedPoints[ batchSize ];
+  MovingImagePointType    mappedPoints[ batchSize ];
+  RealType                fixedImageValues[ batchSize ];
+  RealType                movingImageValues[ batchSize ];
+  double                  sampleWeightsOfBatch[ batchSize ];
+  MovingImageGradientType movingImageGradients[ batchSize ];
+
+  /** Get a handle to the pre-allocated joint PDF and sparse joint PDF
+   * derivatives for the current thread, and initialize them.
+   */
+  JointPDFPointer & jointPDF
+    = this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ threadId ].st_JointPDF;
+  SparseJointPDFDerivativesType * jointPDFDerivatives
+    = this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ threadId ].st_JointPDFDerivatives;
+  jointPDF->FillBuffer( NumericTraits< PDFValueType >::ZeroValue() );
+  jointPDFDerivatives->Reset();
+
   /** Get a handle to the sample container. */
-  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+  ImageSampleContainerPointer sampleContainer     = this->GetImageSampler()->GetOutput();
+  const unsigned long         sampleContainerSize = sampleContainer->Size();
 
-  /** Create iterator over the sample container. */
-  typename ImageSampleContainerType::ConstIterator fiter;
-  typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
-  typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
+  /** Get the samples for this thread. */
+  const unsigned long nrOfSamplesPerThreads
+    = static_cast< unsigned long >( std::ceil( static_cast< double >( sampleContainerSize )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
+
+  unsigned long pos_begin = nrOfSamplesPerThreads * threadId;
+  unsigned long pos_end   = nrOfSamplesPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
+  pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
+
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
+
+  /** Create variables to store intermediate results. circumvent false sharing */
+  unsigned long numberOfPixelsCounted = 0;
+  double        sumOfSampleWeights    = 0.0;
 
   /** Loop over sample container and compute contribution of each sample to pdfs. */
-  for( fiter = fbegin; fiter != fend; ++fiter )
+  for( unsigned long batchBegin = pos_begin; batchBegin < pos_end; batchBegin += batchSize )
   {
-    /** Read fixed coordinates. */
-    const FixedImagePointType & fixedPoint = ( *fiter ).Value().m_ImageCoordinates;
+    const unsigned int numberOfPoints = static_cast< unsigned int >(
+      ( pos_end - batchBegin < batchSize ) ? pos_end - batchBegin : batchSize );
 
-    /** Transform point and check if it is inside the B-spline support region.
-     * if not, skip this sample.
-     */
-    MovingImagePointType mappedPoint;
-    bool                 sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
+    /** Read the fixed coordinates and values, and transform the points. */
+    this->GetFixedImageSamples( batchBegin, numberOfPoints, fixedPoints, fixedImageValues );
+    this->TransformPoints( fixedPoints, mappedPoints, numberOfPoints );
 
-    if( sampleOk )
+    /** Keep the valid samples, and move them to the front of the batch arrays. */
+    unsigned int numberOfValidPoints = 0;
+    for( unsigned int i = 0; i < numberOfPoints; ++i )
     {
-      /** Get the fixed image value and make sure the value falls within the histogram range. */
-      RealType fixedImageValue = static_cast< RealType >( ( *fiter ).Value().m_ImageValue );
-      fixedImageValue = this->GetFixedImageLimiter()->Evaluate( fixedImageValue );
+      RealType                  movingImageValue;
+      MovingImageDerivativeType movingImageDerivative;
 
-      /** Check if point is inside mask. */
-      sampleOk = this->IsInsideMovingMask( mappedPoint );
-      RealType movingMaskValue
-        = static_cast< RealType >( static_cast< unsigned char >( sampleOk ) );
+      /** Check if the point is inside the moving mask. */
+      bool sampleOk = this->IsInsideMovingMask( mappedPoints[ i ] );
 
-      /** Compute the moving image value M(T(x)) and check if
-      * the point is inside the moving image buffer.
-      */
-      RealType movingImageValue = itk::NumericTraits< RealType >::Zero;
+      /** Compute the moving image value, its derivative, and check
+       * if the point is inside the moving image buffer.
+       */
       if( sampleOk )
       {
         sampleOk = this->EvaluateMovingImageValueAndDerivative(
-          mappedPoint, movingImageValue, 0 );
-        if( sampleOk )
-        {
-          movingImageValue = this->GetMovingImageLimiter()->Evaluate( movingImageValue );
-        }
-        else
+          mappedPoints[ i ], movingImageValue, &movingImageDerivative );
+      }
+
+      if( sampleOk )
+      {
+        /** Make sure the values fall within the histogram range. */
+        fixedImageValues[ numberOfValidPoints ]
+          = this->GetFixedImageLimiter()->Evaluate( fixedImageValues[ i ] );
+        movingImageValues[ numberOfValidPoints ] = this->GetMovingImageLimiter()
+          ->Evaluate( movingImageValue, movingImageDerivative );
+
+        sampleWeightsOfBatch[ numberOfValidPoints ] = useSampleWeights ? sampleWeights[ batchBegin + i ] : 1.0;
+        fixedPoints[ numberOfValidPoints ]          = fixedPoints[ i ];
+        for( unsigned int d = 0; d < FixedImageDimension; ++d )
         {
-          /** this movingImageValueRight is invalid, even though the mask indicated it is valid. */
-          movingMaskValue = 0.0;
+          movingImageGradients[ numberOfValidPoints ][ d ] = movingImageDerivative[ d ];
         }
+        ++numberOfValidPoints;
       }
+    }
 
-      /** Stop with this sample. It may be possible that with a perturbed parameter
-       * a valid voxel pair is obtained, but:
-       * - this chance is small,
-       * - quitting now saves a lot of time, especially because this situation
-       *   occurs at border pixels (there are a lot of those)
-       * - if we would analytically compute the gradient the same choice is
-       *   somehow made.
-       */
-      if( !sampleOk ) { continue; }
+    /** Compute the inner products of the transform Jacobian dT/dmu and the
+     * moving image gradient dM/dx, for all valid samples of this batch.
+     */
+    this->m_AdvancedTransform->EvaluateJacobianWithImageGradientProducts(
+      fixedPoints, movingImageGradients, &imageJacobians[ 0 ], &nzjis[ 0 ], numberOfValidPoints );
+
+    /** Update the joint pdf and the sparse joint pdf derivatives. */
+    for( unsigned int i = 0; i < numberOfValidPoints; ++i )
+    {
+      this->UpdateJointPDFAndDerivatives(
+        fixedImageValues[ i ], movingImageValues[ i ], sampleWeightsOfBatch[ i ],
+        &imageJacobians[ i ], &nzjis[ i ], jointPDF.GetPointer(), jointPDFDerivatives );
+      sumOfSampleWeights += sampleWeightsOfBatch[ i ];
+    }
+    numberOfPixelsCounted += numberOfValidPoints;
+
+  } // end loop over sample container
+
+  /** Only update these variables at the end to prevent unnecessary "false sharing". */
+  this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ threadId ].st_NumberOfPixelsCounted = numberOfPixelsCounted;
+  this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ threadId ].st_SumOfSampleWeights    = sumOfSampleWeights;
+
+} // end ThreadedComputePDFsAndSparsePDFDerivatives()
+
+
+/**
+ * **************** ComputePDFsAndSparsePDFDerivativesThreaderCallback *******
+ */
+
+template< class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ComputePDFsAndSparsePDFDerivativesThreaderCallback( void * arg )
+{
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadId   = infoStruct->ThreadID;
+
+  ParzenWindowHistogramMultiThreaderParameterType * temp
+    = static_cast< ParzenWindowHistogramMultiThreaderParameterType * >( infoStruct->UserData );
+
+  temp->m_Metric->ThreadedComputePDFsAndSparsePDFDerivatives( threadId );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end ComputePDFsAndSparsePDFDerivativesThreaderCallback()
+
+
+/**
+ * ******************* ComputeDerivativeFromSparsePDFDerivatives *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeDerivativeFromSparsePDFDerivatives( const PDFValueType * binWeights,
+  const double scale, DerivativeType & derivative ) const
+{
+  /** Each thread adds the weighted sum of its own sparse joint histogram
+   * derivatives to its own derivative.
+   */
+  this->m_ParzenWindowHistogramThreaderParameters.m_BinWeights      = binWeights;
+  this->m_ParzenWindowHistogramThreaderParameters.m_BinWeightsScale = scale;
+  if( this->m_UseMultiThread )
+  {
+    this->m_Threader->SetSingleMethod( this->ComputeDerivativeFromSparsePDFDerivativesThreaderCallback,
+      const_cast< void * >( static_cast< const void * >(
+        &this->m_ParzenWindowHistogramThreaderParameters ) ) );
+    this->m_Threader->SingleMethodExecute();
+  }
+  else
+  {
+    for( ThreadIdType i = 0; i < Self::GetNumberOfThreads(); ++i )
+    {
+      this->m_ParzenWindowHistogramThreaderParameters.m_Metric
+      ->ThreadedComputeDerivativeFromSparsePDFDerivatives( i );
+    }
+  }
+
+  /** Sum the derivatives of the threads, which also resets them. */
+  this->m_ThreaderMetricParameters.st_DerivativePointer   = derivative.begin();
+  this->m_ThreaderMetricParameters.st_NormalizationFactor = 1.0;
+  if( this->m_UseMultiThread )
+  {
+    this->LaunchAccumulateDerivativesThreaderCallback();
+  }
+  else
+  {
+    Self::AccumulateDerivativesRangeCallback(
+      const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ),
+      0, 0, this->GetNumberOfParameters() );
+  }
+
+} // end ComputeDerivativeFromSparsePDFDerivatives()
+
+
+/**
+ * ******************* ThreadedComputeDerivativeFromSparsePDFDerivatives *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedComputeDerivativeFromSparsePDFDerivatives( ThreadIdType threadId )
+{
+  this->m_ParzenWindowHistogramGetValueAndDerivativePerThreadVariables[ threadId ].st_JointPDFDerivatives
+  ->AddWeightedSum( this->m_ParzenWindowHistogramThreaderParameters.m_BinWeights,
+    this->m_ParzenWindowHistogramThreaderParameters.m_BinWeightsScale,
+    this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Derivative.data_block() );
+
+} // end ThreadedComputeDerivativeFromSparsePDFDerivatives()
+
+
+/**
+ * **************** ComputeDerivativeFromSparsePDFDerivativesThreaderCallback *******
+ */
+
+template< class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeDerivativeFromSparsePDFDerivativesThreaderCallback( void * arg )
+{
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadId   = infoStruct->ThreadID;
+
+  ParzenWindowHistogramMultiThreaderParameterType * temp
+    = static_cast< ParzenWindowHistogramMultiThreaderParameterType * >( infoStruct->UserData );
+
+  temp->m_Metric->ThreadedComputeDerivativeFromSparsePDFDerivatives( threadId );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end ComputeDerivativeFromSparsePDFDerivativesThreaderCallback()
+
+
+/**
+ * ******************** ComputeDerivativeLowMemory *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeDerivativeLowMemory( const PRatioArrayType & pRatioArray,
+  DerivativeType & derivative ) const
+{
+  derivative.SetSize( this->GetNumberOfParameters() );
+
+  /** Option for now to still use the single threaded code. */
+  if( !this->m_UseMultiThread )
+  {
+    return this->ComputeDerivativeLowMemorySingleThreaded( pRatioArray, derivative );
+  }
+
+  /** Launch multi-threading derivative computation. */
+  this->m_ParzenWindowHistogramThreaderParameters.m_PRatioArray = &pRatioArray;
+  this->m_Threader->SetSingleMethod( this->ComputeDerivativeLowMemoryThreaderCallback,
+    const_cast< void * >( static_cast< const void * >(
+      &this->m_ParzenWindowHistogramThreaderParameters ) ) );
+  this->m_Threader->SingleMethodExecute();
+
+  /** Sum the derivatives of the threads, multi-threadedly, which also resets them. */
+  this->m_ThreaderMetricParameters.st_DerivativePointer   = derivative.begin();
+  this->m_ThreaderMetricParameters.st_NormalizationFactor = 1.0;
+  this->LaunchAccumulateDerivativesThreaderCallback();
+
+} // end ComputeDerivativeLowMemory()
+
+
+/**
+ * ******************** ComputeDerivativeLowMemorySingleThreaded *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeDerivativeLowMemorySingleThreaded( const PRatioArrayType & pRatioArray,
+  DerivativeType & derivative ) const
+{
+  /** Initialize array that stores dM(x)/dmu, and the sparse Jacobian + indices. */
+  const NumberOfParametersType nnzji = this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices();
+  NonZeroJacobianIndicesType   nzji  = NonZeroJacobianIndicesType( nnzji );
+  DerivativeType               imageJacobian( nzji.size() );
+  TransformJacobianType        jacobian;
+  derivative.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
+
+  /** Declare and allocate arrays for Jacobian preconditioning. */
+  DerivativeType jacobianPreconditioner, preconditioningDivisor;
+  if( this->GetUseJacobianPreconditioning() )
+  {
+    jacobianPreconditioner = DerivativeType( nzji.size() );
+    preconditioningDivisor = DerivativeType( this->GetNumberOfParameters() );
+    preconditioningDivisor.Fill( 0.0 );
+  }
+
+  /** Get a handle to the sample container. */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+
+  /** Create iterator over the sample container. */
+  typename ImageSampleContainerType::ConstIterator fiter;
+  typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
+  typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
+
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
+
+  /** Loop over sample container and compute the contribution of each sample. */
+  for( fiter = fbegin; fiter != fend; ++fiter )
+  {
+    /** Read fixed coordinates and create some variables. */
+    const FixedImagePointType & fixedPoint = ( *fiter ).Value().m_ImageCoordinates;
+    RealType                    movingImageValue;
+    MovingImageDerivativeType   movingImageDerivative;
+    MovingImagePointType        mappedPoint;
+
+    /** Transform point and check if it is inside the B-spline support region. */
+    bool sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
+
+    /** Check if the point is inside the moving mask. */
+    if( sampleOk )
+    {
+      sampleOk = this->IsInsideMovingMask( mappedPoint );
+    }
+
+    /** Compute the moving image value, its derivative, and check
+     * if the point is inside the moving image buffer.
+     */
+    if( sampleOk )
+    {
+      sampleOk = this->EvaluateMovingImageValueAndDerivative(
+        mappedPoint, movingImageValue, &movingImageDerivative );
+    }
+
+    if( sampleOk )
+    {
+      /** Get the fixed image value. */
+      RealType fixedImageValue = static_cast< RealType >( ( *fiter ).Value().m_ImageValue );
+
+      /** Make sure the values fall within the histogram range. */
+      fixedImageValue = this->GetFixedImageLimiter()
+        ->Evaluate( fixedImageValue );
+      movingImageValue = this->GetMovingImageLimiter()
+        ->Evaluate( movingImageValue, movingImageDerivative );
+
+      /** Get the transform Jacobian dT/dmu. */
+      this->EvaluateTransformJacobian( fixedPoint, jacobian, nzji );
+
+      /** Compute the inner product (dM/dx)^T (dT/dmu). */
+      this->EvaluateTransformJacobianInnerProduct(
+        jacobian, movingImageDerivative, imageJacobian );
+
+      /** If desired, apply the technique introduced by Tustison. */
+      if( this->GetUseJacobianPreconditioning() )
+      {
+        this->ComputeJacobianPreconditioner( jacobian, nzji,
+          jacobianPreconditioner, preconditioningDivisor );
+        DerivativeValueType * imjacit   = imageJacobian.begin();
+        DerivativeValueType * jacprecit = jacobianPreconditioner.begin();
+        for( unsigned int i = 0; i < nzji.size(); ++i )
+        {
+          while( imjacit != imageJacobian.end() )
+          {
+            ( *imjacit ) *= ( *jacprecit );
+            ++imjacit;
+            ++jacprecit;
+          }
+        }
+      }
+
+      /** Compute this sample's contribution to the derivative. */
+      this->UpdateDerivativeLowMemory( pRatioArray,
+        fixedImageValue, movingImageValue,
+        useSampleWeights ? sampleWeights[ fiter.Index() ] : 1.0,
+        imageJacobian, nzji, derivative );
+
+    } // end sampleOk
+  } // end loop over sample container
+
+  /** If desired, apply the technique introduced by Tustison */
+  if( this->GetUseJacobianPreconditioning() )
+  {
+    DerivativeValueType * derivit = derivative.begin();
+    DerivativeValueType * divisit = preconditioningDivisor.begin();
+
+    /** This normalization was not in the Tustison paper, but it helps,
+     * especially for localized mutual information.
+     */
+    const double normalizationFactor = preconditioningDivisor.mean();
+    while( derivit != derivative.end() )
+    {
+      ( *derivit ) *= normalizationFactor / ( ( *divisit ) + 1e-14 );
+      ++derivit;
+      ++divisit;
+    }
+  }
+
+} // end ComputeDerivativeLowMemorySingleThreaded()
+
+
+/**
+ * ******************* ThreadedComputeDerivativeLowMemory *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedComputeDerivativeLowMemory( ThreadIdType threadId )
+{
+  /** The samples are processed in batches, so that the transform can evaluate
+   * a batch at once, using SIMD instructions if available.
+   */
+  typedef typename Superclass::AdvancedTransformType::MovingImageGradientType MovingImageGradientType;
+  const unsigned int batchSize = Superclass::SampleBatchSize;
+
+  /** The weights of the joint histogram derivatives. */
+  const PRatioArrayType & pRatioArray = *this->m_ParzenWindowHistogramThreaderParameters.m_PRatioArray;
+
+  /** Get the pre-allocated arrays that store dM(x)/dmu, and the sparse Jacobian + indices. */
+  typename Superclass::ThreadScratchStruct &  scratch        = this->GetThreadScratch( threadId );
+  std::vector< NonZeroJacobianIndicesType > & nzjis          = scratch.st_BatchNonZeroJacobianIndices;
+  std::vector< DerivativeType > &             imageJacobians = scratch.st_BatchImageJacobians;
+  TransformJacobianType &                     jacobian       = scratch.st_Jacobian;
+
+  /** Per batch: the fixed points, mapped points, image values and moving image gradients. */
+  FixedImagePointType     fixedPoints[ batchSize ];
+  MovingImagePointType    mappedPoints[ batchSize ];
+  RealType                fixedImageValues[ batchSize ];
+  RealType                movingImageValues[ batchSize ];
+  double                  sampleWeightsOfBatch[ batchSize ];
+  MovingImageGradientType movingImageGradients[ batchSize ];
+
+  /** Get a handle to the pre-allocated derivative for the current thread.
+   * The initialization is performed at the beginning of each resolution in
+   * InitializeThreadingParameters(), and at the end of each iteration in
+   * the accumulate functions.
+   */
+  DerivativeType & derivative = this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Derivative;
+
+  /** Get the pre-allocated arrays for Jacobian preconditioning. */
+  DerivativeType & jacobianPreconditioner = scratch.st_JacobianPreconditioner;
+  DerivativeType & preconditioningDivisor = scratch.st_PreconditioningDivisor;
+  if( this->GetUseJacobianPreconditioning() )
+  {
+    preconditioningDivisor.Fill( 0.0 );
+  }
+
+  /** Get a handle to the sample container. */
+  ImageSampleContainerPointer sampleContainer     = this->GetImageSampler()->GetOutput();
+  const unsigned long         sampleContainerSize = sampleContainer->Size();
+
+  /** Get the samples for this thread. */
+  const unsigned long nrOfSamplesPerThreads
+    = static_cast< unsigned long >( std::ceil( static_cast< double >( sampleContainerSize )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
+
+  unsigned long pos_begin = nrOfSamplesPerThreads * threadId;
+  unsigned long pos_end   = nrOfSamplesPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
+  pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
+
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
+
+  /** Loop over sample container and compute the contribution of each sample. */
+  for( unsigned long batchBegin = pos_begin; batchBegin < pos_end; batchBegin += batchSize )
+  {
+    const unsigned int numberOfPoints = static_cast< unsigned int >(
+      ( pos_end - batchBegin < batchSize ) ? pos_end - batchBegin : batchSize );
+
+    /** Read the fixed coordinates and values, and transform the points. */
+    this->GetFixedImageSamples( batchBegin, numberOfPoints, fixedPoints, fixedImageValues );
+    this->TransformPoints( fixedPoints, mappedPoints, numberOfPoints );
+
+    /** Keep the valid samples, and move them to the front of the batch arrays. */
+    unsigned int numberOfValidPoints = 0;
+    for( unsigned int i = 0; i < numberOfPoints; ++i )
+    {
+      RealType                  movingImageValue;
+      MovingImageDerivativeType movingImageDerivative;
+
+      /** Check if the point is inside the moving mask. */
+      bool sampleOk = this->IsInsideMovingMask( mappedPoints[ i ] );
+
+      /** Compute the moving image value, its derivative, and check
+       * if the point is inside the moving image buffer.
+       */
+      if( sampleOk )
+      {
+        sampleOk = this->EvaluateMovingImageValueAndDerivative(
+          mappedPoints[ i ], movingImageValue, &movingImageDerivative );
+      }
+
+      if( sampleOk )
+      {
+        /** Make sure the values fall within the histogram range. */
+        fixedImageValues[ numberOfValidPoints ]
+          = this->GetFixedImageLimiter()->Evaluate( fixedImageValues[ i ] );
+        movingImageValues[ numberOfValidPoints ] = this->GetMovingImageLimiter()
+          ->Evaluate( movingImageValue, movingImageDerivative );
+
+        sampleWeightsOfBatch[ numberOfValidPoints ] = useSampleWeights ? sampleWeights[ batchBegin + i ] : 1.0;
+        fixedPoints[ numberOfValidPoints ]          = fixedPoints[ i ];
+        for( unsigned int d = 0; d < FixedImageDimension; ++d )
+        {
+          movingImageGradients[ numberOfValidPoints ][ d ] = movingImageDerivative[ d ];
+        }
+        ++numberOfValidPoints;
+      }
+    }
+
+    /** Compute the inner products of the transform Jacobian dT/dmu and the
+     * moving image gradient dM/dx, for all valid samples of this batch.
+     */
+    this->m_AdvancedTransform->EvaluateJacobianWithImageGradientProducts(
+      fixedPoints, movingImageGradients, &imageJacobians[ 0 ], &nzjis[ 0 ], numberOfValidPoints );
+
+    for( unsigned int i = 0; i < numberOfValidPoints; ++i )
+    {
+      DerivativeType &             imageJacobian = imageJacobians[ i ];
+      NonZeroJacobianIndicesType & nzji          = nzjis[ i ];
+
+      /** If desired, apply the technique introduced by Tustison. */
+      if( this->GetUseJacobianPreconditioning() )
+      {
+        this->EvaluateTransformJacobian( fixedPoints[ i ], jacobian, nzji );
+
+        this->ComputeJacobianPreconditioner( jacobian, nzji,
+          jacobianPreconditioner, preconditioningDivisor );
+        DerivativeValueType * imjacit   = imageJacobian.begin();
+        DerivativeValueType * jacprecit = jacobianPreconditioner.begin();
+        for( unsigned int j = 0; j < nzji.size(); ++j )
+        {
+          while( imjacit != imageJacobian.end() )
+          {
+            ( *imjacit ) *= ( *jacprecit );
+            ++imjacit;
+            ++jacprecit;
+          }
+        }
+      }
+
+      /** Compute this sample's contribution to the derivative. */
+      this->UpdateDerivativeLowMemory( pRatioArray,
+        fixedImageValues[ i ], movingImageValues[ i ], sampleWeightsOfBatch[ i ],
+        imageJacobian, nzji, derivative );
+
+    } // end loop over valid samples
+  } // end loop over sample container
+
+  /** If desired, apply the technique introduced by Tustison. */
+  if( this->GetUseJacobianPreconditioning() )
+  {
+    DerivativeValueType * derivit = derivative.begin();
+    DerivativeValueType * divisit = preconditioningDivisor.begin();
+
+    /** This normalization was not in the Tustison paper, but it helps,
+     * especially for localized mutual information.
+     */
+    const double normalizationFactor = preconditioningDivisor.mean();
+    while( derivit != derivative.end() )
+    {
+      ( *derivit ) *= normalizationFactor / ( ( *divisit ) + 1e-14 );
+      ++derivit;
+      ++divisit;
+    }
+  }
+
+} // end ThreadedComputeDerivativeLowMemory()
+
+
+/**
+ * **************** ComputeDerivativeLowMemoryThreaderCallback *******
+ */
+
+template< class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeDerivativeLowMemoryThreaderCallback( void * arg )
+{
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadId   = infoStruct->ThreadID;
+
+  ParzenWindowHistogramMultiThreaderParameterType * temp
+    = static_cast< ParzenWindowHistogramMultiThreaderParameterType * >( infoStruct->UserData );
+
+  temp->m_Metric->ThreadedComputeDerivativeLowMemory( threadId );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end ComputeDerivativeLowMemoryThreaderCallback()
+
+
+/**
+ * ******************* UpdateDerivativeLowMemory *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::UpdateDerivativeLowMemory(
+  const PRatioArrayType & pRatioArray,
+  const RealType & fixedImageValue,
+  const RealType & movingImageValue,
+  const double sampleWeight,
+  const DerivativeType & imageJacobian,
+  const NonZeroJacobianIndicesType & nzji,
+  DerivativeType & derivative ) const
+{
+  /** In this function we need to do (see eq. 24 of Thevenaz [3]):
+   *      derivative += imageJacobian *
+   *          \sum_i \sum_k PRatio(i,k) * dB/dxi(xi,i,k),
+   * with i, k, the fixed and moving histogram bins,
+   * PRatio the precomputed weights of the joint histogram derivatives, and
+   * dB/dxi the B-spline derivative.
+   *
+   * Note (1) that we only have to loop over i,k within the support
+   * of the B-spline Parzen-window.
+   * Note (2) that imageJacobian may be sparse.
+   */
+
+  /** Determine Parzen window arguments (see eq. 6 of Mattes paper [2]). */
+  const double fixedImageParzenWindowTerm
+    = fixedImageValue / this->m_FixedImageBinSize - this->m_FixedImageNormalizedMin;
+  const double movingImageParzenWindowTerm
+    = movingImageValue / this->m_MovingImageBinSize - this->m_MovingImageNormalizedMin;
+
+  /** The lowest bin numbers affected by this pixel: */
+  const int fixedParzenWindowIndex
+    = static_cast< int >( std::floor(
+    fixedImageParzenWindowTerm + this->m_FixedParzenTermToIndexOffset ) );
+  const int movingParzenWindowIndex
+    = static_cast< int >( std::floor(
+    movingImageParzenWindowTerm + this->m_MovingParzenTermToIndexOffset ) );
+
+  /** Compute the fixed Parzen values. */
+  ParzenValueContainerType fixedParzenValues( this->m_JointPDFWindow.GetSize()[ 1 ] );
+  this->EvaluateParzenValues(
+    fixedImageParzenWindowTerm, fixedParzenWindowIndex,
+    this->m_FixedKernel, fixedParzenValues );
+
+  /** Compute the derivatives of the moving Parzen window. */
+  ParzenValueContainerType derivativeMovingParzenValues( this->m_JointPDFWindow.GetSize()[ 0 ] );
+  this->EvaluateParzenValues(
+    movingImageParzenWindowTerm, movingParzenWindowIndex,
+    this->m_DerivativeMovingKernel, derivativeMovingParzenValues );
+
+  /** Get the moving image bin size. */
+  const double et = static_cast< double >( this->m_MovingImageBinSize );
+
+  /** Loop over the Parzen window region and increment sum. */
+  PDFValueType sum = 0.0;
+  for( unsigned int f = 0; f < fixedParzenValues.GetSize(); ++f )
+  {
+    const double fv_et = fixedParzenValues[ f ] / et;
+    for( unsigned int m = 0; m < derivativeMovingParzenValues.GetSize(); ++m )
+    {
+      sum += pRatioArray[ f + fixedParzenWindowIndex ][ m + movingParzenWindowIndex ]
+        * fv_et * derivativeMovingParzenValues[ m ];
+    }
+  }
+
+  /** Weight this sample's contribution by its importance weight. */
+  sum *= sampleWeight;
+
+  /** Now compute derivative += sum * imageJacobian. */
+  if( nzji.size() == this->GetNumberOfParameters() )
+  {
+    /** Loop over all Jacobians. */
+    for( unsigned int mu = 0; mu < this->GetNumberOfParameters(); ++mu )
+    {
+      derivative[ mu ] += static_cast< DerivativeValueType >(
+        imageJacobian[ mu ] * sum );
+    }
+  }
+  else
+  {
+    /** Loop only over the non-zero Jacobians. */
+    for( unsigned int i = 0; i < imageJacobian.GetSize(); ++i )
+    {
+      const unsigned int mu = nzji[ i ];
+      derivative[ mu ] += static_cast< DerivativeValueType >(
+        imageJacobian[ i ] * sum );
+    }
+  }
+
+} // end UpdateDerivativeLowMemory()
+
+
+/**
+ * ******************** ComputeJacobianPreconditioner *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeJacobianPreconditioner(
+  const TransformJacobianType & jac,
+  const NonZeroJacobianIndicesType & nzji,
+  DerivativeType & preconditioner,
+  DerivativeType & divisor ) const
+{
+  typedef typename TransformJacobianType::ValueType TransformJacobianValueType;
+  const unsigned int M = nzji.size();
+  typedef Matrix< double, MovingImageDimension, MovingImageDimension > MatrixType;
+  MatrixType jacjact;
+
+  /** Compute jac * jac' */
+  for( unsigned int drow = 0; drow < MovingImageDimension; ++drow )
+  {
+    for( unsigned int dcol = drow; dcol < MovingImageDimension; ++dcol )
+    {
+      const TransformJacobianValueType * jacit1 = jac[ drow ];
+      const TransformJacobianValueType * jacit2 = jac[ dcol ];
+      double                             sum    = 0.0;
+      for( unsigned int mu = 0; mu < M; ++mu )
+      {
+        sum += ( *jacit1 ) * ( *jacit2 );
+        ++jacit1;
+        ++jacit2;
+      }
+      jacjact( drow, dcol ) = sum;
+      jacjact( dcol, drow ) = sum;
+    }
+  }
+
+  /** Invert */
+  const double addtodiag = 1e-10;
+  for( unsigned int drow = 0; drow < MovingImageDimension; ++drow )
+  {
+    jacjact( drow, drow ) += addtodiag;
+  }
+  jacjact = vnl_inverse( jacjact.GetVnlMatrix() );
+
+  /** Compute preconditioner = diag( jac' * m * jac ),
+   * with m = inv(jacjact)
+   * implementation:
+   * preconditioner = sum_dr sum_dc m(dr,dc) jac(dr,:) * jac(dc,:)
+   */
+  preconditioner.Fill( 0.0 );
+  for( unsigned int drow = 0; drow < MovingImageDimension; ++drow )
+  {
+    for( unsigned int dcol = drow; dcol < MovingImageDimension; ++dcol )
+    {
+      DerivativeValueType *              precondit = preconditioner.begin();
+      const TransformJacobianValueType * jacit1    = jac[ drow ];
+      const TransformJacobianValueType * jacit2    = jac[ dcol ];
+      /** count twice if off-diagonal */
+      const double fac = drow == dcol ? 1.0 : 2.0;
+      const double m   = fac * jacjact( drow, dcol );
+      for( unsigned int mu = 0; mu < M; ++mu )
+      {
+        *precondit += m * ( *jacit1 ) * ( *jacit2 );
+        ++precondit;
+        ++jacit1;
+        ++jacit2;
+
+      }
+    }
+  }
+
+  /** Update divisor = sum_samples diag(jac'*jac) */
+  DerivativeType temp( M );
+  temp.Fill( 0.0 );
+  /** Compute this sample's contribution */
+  for( unsigned int drow = 0; drow < MovingImageDimension; ++drow )
+  {
+    DerivativeValueType *              tempit = temp.begin();
+    const TransformJacobianValueType * jacit1 = jac[ drow ];
+    for( unsigned int mu = 0; mu < M; ++mu )
+    {
+      *tempit += vnl_math_sqr( *jacit1 );
+      ++tempit;
+      ++jacit1;
+    }
+  }
+  /** Update divisor */
+  for( unsigned int mu = 0; mu < M; ++mu )
+  {
+    divisor[ nzji[ mu ] ] += temp[ mu ];
+  }
+
+} // end ComputeJacobianPreconditioner()
+
+
+/**
+ * ************************ ComputePDFsAndIncrementalPDFs *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
+::ComputePDFsAndIncrementalPDFs( const ParametersType & parameters ) const
+{
+  /** Initialize some variables. */
+  this->m_JointPDF->FillBuffer( 0.0 );
+  this->m_IncrementalJointPDFRight->FillBuffer( 0.0 );
+  this->m_IncrementalJointPDFLeft->FillBuffer( 0.0 );
+  this->m_Alpha = 0.0;
+  this->m_PerturbedAlphaRight.Fill( 0.0 );
+  this->m_PerturbedAlphaLeft.Fill( 0.0 );
+
+  this->m_NumberOfPixelsCounted = 0;
+  double       sumOfMovingMaskValues = 0.0;
+  const double delta                 = this->GetFiniteDifferencePerturbation();
+
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
+
+  /** sparse jacobian+indices. */
+  NonZeroJacobianIndicesType nzji( this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices() );
+  TransformJacobianType      jacobian;
+
+  /** Arrays that store dM(x)/dmu and dMask(x)/dmu. */
+  DerivativeType movingImageValuesRight( nzji.size() );
+  DerivativeType movingImageValuesLeft( nzji.size() );
+  DerivativeType movingMaskValuesRight( nzji.size() );
+  DerivativeType movingMaskValuesLeft( nzji.size() );
+
+  /** Call non-thread-safe stuff, such as:
+   *   this->SetTransformParameters( parameters );
+   *   this->GetImageSampler()->Update();
+   * Because of these calls GetValueAndDerivative itself is not thread-safe,
+   * so cannot be called multiple times simultaneously.
+   * This is however needed in the CombinationImageToImageMetric.
+   * In that case, you need to:
+   * - switch the use of this function to on, using m_UseMetricSingleThreaded = true
+   * - call BeforeThreadedGetValueAndDerivative once (single-threaded) before
+   *   calling GetValueAndDerivative
+   * - switch the use of this function to off, using m_UseMetricSingleThreaded = false
+   * - Now you can call GetValueAndDerivative multi-threaded.
+   */
+  this->BeforeThreadedGetValueAndDerivative( parameters );
+
+  /** Get a handle to the sample container. */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+
+  /** Create iterator over the sample container. */
+  typename ImageSampleContainerType::ConstIterator fiter;
+  typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
+  typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
+
+  /** Loop over sample container and compute contribution of each sample to pdfs. */
+  for( fiter = fbegin; fiter != fend; ++fiter )
+  {
+    /** Read fixed coordinates. */
+    const FixedImagePointType & fixedPoint = ( *fiter ).Value().m_ImageCoordinates;
+
+    /** Transform point and check if it is inside the B-spline support region.
+     * if not, skip this sample.
+     */
+    MovingImagePointType mappedPoint;
+    bool                 sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
+
+    if( sampleOk )
+    {
+      /** Get the fixed image value and make sure the value falls within the histogram range. */
+      RealType fixedImageValue = static_cast< RealType >( ( *fiter ).Value().m_ImageValue );
+      fixedImageValue = this->GetFixedImageLimiter()->Evaluate( fixedImageValue );
+
+      /** Check if point is inside mask. */
+      sampleOk = this->IsInsideMovingMask( mappedPoint );
+      RealType movingMaskValue
+        = static_cast< RealType >( static_cast< unsigned char >( sampleOk ) );
+
+      /** Compute the moving image value M(T(x)) and check if
+      * the point is inside the moving image buffer.
+      */
+      RealType movingImageValue = itk::NumericTraits< RealType >::Zero;
+      if( sampleOk )
+      {
+        sampleOk = this->EvaluateMovingImageValueAndDerivative(
+          mappedPoint, movingImageValue, 0 );
+        if( sampleOk )
+        {
+          movingImageValue = this->GetMovingImageLimiter()->Evaluate( movingImageValue );
+        }
+        else
+        {
+          /** this movingImageValueRight is invalid, even though the mask indicated it is valid. */
+          movingMaskValue = 0.0;
+        }
+      }
+
+      /** Stop with this sample. It may be possible that with a perturbed parameter
+       * a valid voxel pair is obtained, but:
+       * - this chance is small,
+       * - quitting now saves a lot of time, especially because this situation
+       *   occurs at border pixels (there are a lot of those)
+       * - if we would analytically compute the gradient the same choice is
+       *   somehow made.
+       */
+      if( !sampleOk ) { continue; }
+
+      /** Weight the sample by its importance weight, via its moving mask values. */
+      const double sampleWeight = useSampleWeights ? sampleWeights[ fiter.Index() ] : 1.0;
+      movingMaskValue *= sampleWeight;
 
       /** Count how many samples were used. */
       sumOfMovingMaskValues         += movingMaskValue;
@@ -1607,7 +2620,7 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
             movingMaskValueRight = 0.0;
           }
         }
-        movingMaskValuesRight[ i ] = movingMaskValueRight;
+        movingMaskValuesRight[ i ] = movingMaskValueRight * sampleWeight;
 
         /** Compute the moving mask and moving image value at the left perturbed positions. */
         sampleOk = this->IsInsideMovingMask( mappedPointLeft );
@@ -1630,7 +2643,7 @@ ParzenWindowHistogramImageToImageMetric< TFixedImage, TMovingImage >
             movingMaskValueLeft = 0.0;
           }
         }
-        movingMaskValuesLeft[ i ] = movingMaskValueLeft;
+        movingMaskValuesLeft[ i ] = movingMaskValueLeft * sampleWeight;
 
       } // next parameter to perturb
 
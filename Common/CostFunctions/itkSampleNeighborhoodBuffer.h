@@ -0,0 +1,200 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef __itkSampleNeighborhoodBuffer_h
+#define __itkSampleNeighborhoodBuffer_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImageSample.h"
+#include "itkVectorDataContainer.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace itk
+{
+
+/**
+ * \class SampleNeighborhoodBuffer
+ * \brief Stores values on the grid of an image, for the pixels in the
+ * neighborhoods of a set of image samples only.
+ *
+ * Metrics that compare the neighborhoods of the samples, such as the
+ * gradient and pattern intensity based metrics for 2D-3D registration,
+ * need the moved image at the pixels around each sample. Instead of
+ * resampling the complete moving image, these metrics can let this class
+ * determine the pixels that are needed, evaluate the moved image at
+ * these pixels only, and store the results with SetPixelValue().
+ *
+ * Update() maps each sample to the nearest pixel, and collects the pixels
+ * within Radius of these. It only does so when the samples have changed,
+ * so that the same pixels can be evaluated for several transform
+ * parameters, as in a finite difference derivative. The buffer itself is
+ * allocated once, for the buffered region of the image.
+ *
+ * Pixels outside the buffered region are replaced by the nearest pixel
+ * inside it, which is the ZeroFluxNeumannBoundaryCondition.
+ *
+ * SetPixelValue() may be called by several threads simultaneously, for
+ * different pixels. The class is otherwise not thread-safe.
+ *
+ * \ingroup Metrics
+ */
+
+template< class TImage >
+class SampleNeighborhoodBuffer : public Object
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef SampleNeighborhoodBuffer   Self;
+  typedef Object                     Superclass;
+  typedef SmartPointer< Self >       Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( SampleNeighborhoodBuffer, Object );
+
+  /** The image dimension. */
+  itkStaticConstMacro( ImageDimension, unsigned int, TImage::ImageDimension );
+
+  /** Typedefs. */
+  typedef TImage                                                ImageType;
+  typedef typename ImageType::ConstPointer                      ImageConstPointer;
+  typedef typename ImageType::IndexType                         IndexType;
+  typedef typename ImageType::SizeType                          SizeType;
+  typedef typename ImageType::RegionType                        RegionType;
+  typedef typename ImageType::PointType                         PointType;
+  typedef ImageSample< ImageType >                              ImageSampleType;
+  typedef VectorDataContainer< unsigned long, ImageSampleType > ImageSampleContainerType;
+  typedef double                                                ValueType;
+
+  /** Set/Get the image that defines the grid. */
+  itkSetConstObjectMacro( Image, ImageType );
+  itkGetConstObjectMacro( Image, ImageType );
+
+  /** Set/Get the radius of the neighborhoods. */
+  itkSetMacro( Radius, SizeType );
+  itkGetConstReferenceMacro( Radius, SizeType );
+
+  /** Determine the pixels in the neighborhoods of the samples. Returns
+   * false if nothing had to be done, because the samples, the image and
+   * the radius did not change since the last call.
+   */
+  bool Update( const ImageSampleContainerType * samples );
+
+  /** Get the number of samples of the last Update(). */
+  SizeValueType GetNumberOfSamples( void ) const
+  {
+    return this->m_SampleIndices.size();
+  }
+
+
+  /** Get the pixel nearest to sample s. */
+  const IndexType & GetSampleIndex( const SizeValueType s ) const
+  {
+    return this->m_SampleIndices[ s ];
+  }
+
+
+  /** Get the number of pixels in the neighborhoods of the samples. */
+  SizeValueType GetNumberOfPixels( void ) const
+  {
+    return this->m_PixelOffsets.size();
+  }
+
+
+  /** Get the index of the p-th pixel in the neighborhoods of the samples. */
+  IndexType GetPixelIndex( const SizeValueType p ) const
+  {
+    return this->m_Image->ComputeIndex( this->m_PixelOffsets[ p ] );
+  }
+
+
+  /** Set the value of the p-th pixel in the neighborhoods of the samples. */
+  void SetPixelValue( const SizeValueType p, const ValueType value )
+  {
+    this->m_Values[ this->m_PixelOffsets[ p ] ] = value;
+  }
+
+
+  /** Get the value of the p-th pixel in the neighborhoods of the samples. */
+  ValueType GetPixelValue( const SizeValueType p ) const
+  {
+    return this->m_Values[ this->m_PixelOffsets[ p ] ];
+  }
+
+
+  /** Get the value at a pixel in the neighborhood of a sample. Indices
+   * outside the buffered region of the image are clamped to it.
+   */
+  ValueType GetValue( const IndexType & index ) const
+  {
+    IndexType clampedIndex;
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+      clampedIndex[ d ] = std::min( std::max( index[ d ], this->m_FirstIndex[ d ] ),
+        this->m_LastIndex[ d ] );
+    }
+    return this->m_Values[ this->m_Image->ComputeOffset( clampedIndex ) ];
+  }
+
+
+protected:
+
+  SampleNeighborhoodBuffer();
+  virtual ~SampleNeighborhoodBuffer() {}
+
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+private:
+
+  SampleNeighborhoodBuffer( const Self & ); // purposely not implemented
+  void operator=( const Self & );           // purposely not implemented
+
+  ImageConstPointer m_Image;
+  SizeType          m_Radius;
+  IndexType         m_FirstIndex;
+  IndexType         m_LastIndex;
+
+  /** The samples, image and radius of the last Update(). */
+  const ImageSampleContainerType * m_Samples;
+  ModifiedTimeType                 m_SamplesMTime;
+  TimeStamp                        m_UpdateTime;
+
+  /** The nearest pixels of the samples, the offsets of the pixels in their
+   * neighborhoods, and the values on the buffered region of the image.
+   */
+  std::vector< IndexType >       m_SampleIndices;
+  std::vector< OffsetValueType > m_PixelOffsets;
+  std::vector< unsigned char >   m_IsNeeded;
+  std::vector< ValueType >       m_Values;
+
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSampleNeighborhoodBuffer.hxx"
+#endif
+
+#endif // end #ifndef __itkSampleNeighborhoodBuffer_h
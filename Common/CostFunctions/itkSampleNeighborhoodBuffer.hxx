@@ -0,0 +1,166 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkSampleNeighborhoodBuffer_hxx
+#define __itkSampleNeighborhoodBuffer_hxx
+
+#include "itkSampleNeighborhoodBuffer.h"
+#include "itkContinuousIndex.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMath.h"
+
+namespace itk
+{
+
+/**
+ * ********************* Constructor ****************************
+ */
+
+template< class TImage >
+SampleNeighborhoodBuffer< TImage >
+::SampleNeighborhoodBuffer()
+{
+  this->m_Radius.Fill( 1 );
+  this->m_FirstIndex.Fill( 0 );
+  this->m_LastIndex.Fill( 0 );
+  this->m_Samples      = 0;
+  this->m_SamplesMTime = 0;
+
+} // end Constructor
+
+
+/**
+ * ********************* Update ****************************
+ */
+
+template< class TImage >
+bool
+SampleNeighborhoodBuffer< TImage >
+::Update( const ImageSampleContainerType * samples )
+{
+  if( this->m_Image.IsNull() || samples == 0 )
+  {
+    itkExceptionMacro( << "ERROR: the image and the samples should be set." );
+  }
+
+  /** The samples are regenerated by the sampler, which changes the update
+   * time of the container, or modified by hand, which changes its MTime.
+   */
+  const ModifiedTimeType samplesMTime
+    = std::max( samples->GetMTime(), samples->GetUpdateMTime() );
+  if( samples == this->m_Samples && samplesMTime == this->m_SamplesMTime
+    && this->GetMTime() < this->m_UpdateTime.GetMTime()
+    && this->m_Image->GetMTime() < this->m_UpdateTime.GetMTime() )
+  {
+    return false;
+  }
+
+  /** Allocate the buffer, only when the image size changed. */
+  const RegionType    bufferedRegion = this->m_Image->GetBufferedRegion();
+  const SizeValueType numberOfPixels = bufferedRegion.GetNumberOfPixels();
+  if( this->m_Values.size() != numberOfPixels )
+  {
+    this->m_Values.assign( numberOfPixels, NumericTraits< ValueType >::Zero );
+    this->m_IsNeeded.assign( numberOfPixels, 0 );
+  }
+  else
+  {
+    std::fill( this->m_IsNeeded.begin(), this->m_IsNeeded.end(), 0 );
+  }
+
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+  {
+    this->m_FirstIndex[ d ] = bufferedRegion.GetIndex()[ d ];
+    this->m_LastIndex[ d ]  = bufferedRegion.GetIndex()[ d ]
+      + static_cast< IndexValueType >( bufferedRegion.GetSize()[ d ] ) - 1;
+  }
+
+  /** The neighborhood of a pixel, clipped to the buffered region. */
+  SizeType neighborhoodSize;
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+  {
+    neighborhoodSize[ d ] = 2 * this->m_Radius[ d ] + 1;
+  }
+  RegionType neighborhood;
+
+  /** Map the samples to the nearest pixel, and collect their neighbors. */
+  const SizeValueType numberOfSamples = samples->Size();
+  this->m_SampleIndices.resize( numberOfSamples );
+  this->m_PixelOffsets.clear();
+
+  typedef ContinuousIndex< double, ImageDimension > ContinuousIndexType;
+  ContinuousIndexType cindex;
+  IndexType           neighborhoodIndex;
+  for( SizeValueType s = 0; s < numberOfSamples; ++s )
+  {
+    this->m_Image->TransformPhysicalPointToContinuousIndex(
+      samples->ElementAt( s ).m_ImageCoordinates, cindex );
+
+    IndexType & index = this->m_SampleIndices[ s ];
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+      index[ d ] = std::min( std::max( Math::Round< IndexValueType >( cindex[ d ] ),
+        this->m_FirstIndex[ d ] ), this->m_LastIndex[ d ] );
+      neighborhoodIndex[ d ] = index[ d ] - static_cast< IndexValueType >( this->m_Radius[ d ] );
+    }
+
+    neighborhood.SetIndex( neighborhoodIndex );
+    neighborhood.SetSize( neighborhoodSize );
+    neighborhood.Crop( bufferedRegion );
+
+    ImageRegionConstIteratorWithIndex< ImageType > it( this->m_Image, neighborhood );
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+      const OffsetValueType offset = this->m_Image->ComputeOffset( it.GetIndex() );
+      if( !this->m_IsNeeded[ offset ] )
+      {
+        this->m_IsNeeded[ offset ] = 1;
+        this->m_PixelOffsets.push_back( offset );
+      }
+    }
+  }
+
+  this->m_Samples      = samples;
+  this->m_SamplesMTime = samplesMTime;
+  this->m_UpdateTime.Modified();
+
+  return true;
+
+} // end Update()
+
+
+/**
+ * ********************* PrintSelf ****************************
+ */
+
+template< class TImage >
+void
+SampleNeighborhoodBuffer< TImage >
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Radius: " << this->m_Radius << std::endl;
+  os << indent << "NumberOfSamples: " << this->GetNumberOfSamples() << std::endl;
+  os << indent << "NumberOfPixels: " << this->GetNumberOfPixels() << std::endl;
+
+} // end PrintSelf()
+
+
+} // end namespace itk
+
+#endif // end #ifndef __itkSampleNeighborhoodBuffer_hxx
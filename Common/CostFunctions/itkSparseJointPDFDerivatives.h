@@ -0,0 +1,153 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef __itkSparseJointPDFDerivatives_h
+#define __itkSparseJointPDFDerivatives_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkIntTypes.h"
+
+#include <vector>
+#include <unordered_map>
+
+namespace itk
+{
+
+/**
+ * \class SparseJointPDFDerivatives
+ * \brief Stores the derivatives of a joint histogram with respect to the
+ * transform parameters, for the parameters and bins that are touched only.
+ *
+ * The dense representation of the joint histogram derivatives, an image of
+ * size NumberOfParameters x NumberOfMovingBins x NumberOfFixedBins, does not
+ * fit in memory for large B-spline grids. Each sample however only touches
+ * the parameters with a nonzero Jacobian, and the few bins of its Parzen
+ * window. This class therefore divides the parameters in blocks of
+ * BlockSize consecutive parameters, and stores a dense array of BlockSize
+ * values for each (block, bin) pair that has been touched. The memory use
+ * grows with the number of samples, not with the number of parameters.
+ *
+ * The bins are numbered like the buffer of the joint histogram image:
+ * bin = movingBin + fixedBin * NumberOfMovingBins.
+ *
+ * The class is not thread-safe; each thread should use its own instance.
+ * Since the derivative of a metric is usually a weighted sum of the
+ * histogram derivatives over the bins, the instances of the threads do
+ * not need to be merged, see AddWeightedSum().
+ *
+ * \ingroup Metrics
+ */
+
+template< class TValue >
+class SparseJointPDFDerivatives : public Object
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef SparseJointPDFDerivatives  Self;
+  typedef Object                     Superclass;
+  typedef SmartPointer< Self >       Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( SparseJointPDFDerivatives, Object );
+
+  /** Typedefs. */
+  typedef TValue                       ValueType;
+  typedef std::vector< unsigned long > NonZeroJacobianIndicesType;
+
+  /** Set the number of bins and parameters, and the number of parameters
+   * per block, and remove all values.
+   */
+  void Initialize( const SizeValueType numberOfBins,
+    const SizeValueType numberOfParameters, const unsigned int blockSize );
+
+  /** Remove all values, but keep the allocated memory for the next use. */
+  void Reset( void );
+
+  /** Add -factor * imageJacobian[ i ] to the derivative of the given bin
+   * with respect to parameter nzji[ i ], for all i. The indices in nzji
+   * should be sorted, to touch each block once.
+   */
+  void UpdateBin( const SizeValueType bin, const double factor,
+    const double * imageJacobian, const NonZeroJacobianIndicesType & nzji );
+
+  /** Add scale * \sum_bin binWeights[ bin ] * dh( bin ) / dmu to
+   * derivative[ mu ], for all mu.
+   */
+  void AddWeightedSum( const double * binWeights, const double scale,
+    double * derivative ) const;
+
+  /** Get the settings. */
+  itkGetConstMacro( NumberOfBins, SizeValueType );
+  itkGetConstMacro( NumberOfParameters, SizeValueType );
+  itkGetConstMacro( BlockSize, unsigned int );
+
+  /** Get the number of (block, bin) pairs that have been touched. */
+  SizeValueType GetNumberOfActiveBlocks( void ) const
+  {
+    return this->m_Keys.size();
+  }
+
+
+  /** Get the number of bytes that is allocated for the values. */
+  SizeValueType GetAllocatedMemorySize( void ) const;
+
+protected:
+
+  SparseJointPDFDerivatives();
+  virtual ~SparseJointPDFDerivatives() {}
+
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+private:
+
+  SparseJointPDFDerivatives( const Self & ); // purposely not implemented
+  void operator=( const Self & );            // purposely not implemented
+
+  /** Get the values of a (block, bin) pair, and create them if needed. */
+  ValueType * GetBlockValues( const SizeValueType block, const SizeValueType bin );
+
+  typedef unsigned long long                           KeyType;
+  typedef std::unordered_map< KeyType, SizeValueType > KeyToOffsetMapType;
+
+  SizeValueType m_NumberOfBins;
+  SizeValueType m_NumberOfParameters;
+  unsigned int  m_BlockSize;
+
+  /** The offsets in m_Values of the active (block, bin) pairs, with the
+   * key block * NumberOfBins + bin. The keys are also stored in order of
+   * creation, to loop over the pairs without the map.
+   */
+  KeyToOffsetMapType       m_Offsets;
+  std::vector< KeyType >   m_Keys;
+  std::vector< ValueType > m_Values;
+
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSparseJointPDFDerivatives.hxx"
+#endif
+
+#endif // end #ifndef __itkSparseJointPDFDerivatives_h
@@ -0,0 +1,206 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkSparseJointPDFDerivatives_hxx
+#define __itkSparseJointPDFDerivatives_hxx
+
+#include "itkSparseJointPDFDerivatives.h"
+#include "itkNumericTraits.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+/**
+ * ********************* Constructor ****************************
+ */
+
+template< class TValue >
+SparseJointPDFDerivatives< TValue >
+::SparseJointPDFDerivatives()
+{
+  this->m_NumberOfBins       = 0;
+  this->m_NumberOfParameters = 0;
+  this->m_BlockSize          = 8;
+
+} // end Constructor
+
+
+/**
+ * ********************* Initialize ****************************
+ */
+
+template< class TValue >
+void
+SparseJointPDFDerivatives< TValue >
+::Initialize( const SizeValueType numberOfBins,
+  const SizeValueType numberOfParameters, const unsigned int blockSize )
+{
+  this->m_NumberOfBins       = numberOfBins;
+  this->m_NumberOfParameters = numberOfParameters;
+  this->m_BlockSize          = std::max( blockSize, 1u );
+
+  this->Reset();
+
+} // end Initialize()
+
+
+/**
+ * ********************* Reset ****************************
+ */
+
+template< class TValue >
+void
+SparseJointPDFDerivatives< TValue >
+::Reset( void )
+{
+  /** clear() keeps the buckets of the map and the capacity of the vectors. */
+  this->m_Offsets.clear();
+  this->m_Keys.clear();
+  this->m_Values.clear();
+
+} // end Reset()
+
+
+/**
+ * ********************* GetBlockValues ****************************
+ */
+
+template< class TValue >
+typename SparseJointPDFDerivatives< TValue >::ValueType *
+SparseJointPDFDerivatives< TValue >
+::GetBlockValues( const SizeValueType block, const SizeValueType bin )
+{
+  const KeyType key = static_cast< KeyType >( block ) * this->m_NumberOfBins + bin;
+
+  std::pair< typename KeyToOffsetMapType::iterator, bool > inserted
+    = this->m_Offsets.insert( std::make_pair( key, static_cast< SizeValueType >( this->m_Values.size() ) ) );
+  if( inserted.second )
+  {
+    this->m_Keys.push_back( key );
+    this->m_Values.resize( this->m_Values.size() + this->m_BlockSize, ValueType( 0 ) );
+  }
+
+  return &this->m_Values[ inserted.first->second ];
+
+} // end GetBlockValues()
+
+
+/**
+ * ********************* UpdateBin ****************************
+ */
+
+template< class TValue >
+void
+SparseJointPDFDerivatives< TValue >
+::UpdateBin( const SizeValueType bin, const double factor,
+  const double * imageJacobian, const NonZeroJacobianIndicesType & nzji )
+{
+  const SizeValueType blockSize    = this->m_BlockSize;
+  SizeValueType       currentBlock = NumericTraits< SizeValueType >::max();
+  ValueType *         blockValues  = 0;
+
+  for( SizeValueType i = 0; i < nzji.size(); ++i )
+  {
+    const SizeValueType mu    = nzji[ i ];
+    const SizeValueType block = mu / blockSize;
+    if( block != currentBlock )
+    {
+      blockValues  = this->GetBlockValues( block, bin );
+      currentBlock = block;
+    }
+    blockValues[ mu - block * blockSize ] -= static_cast< ValueType >( imageJacobian[ i ] * factor );
+  }
+
+} // end UpdateBin()
+
+
+/**
+ * ********************* AddWeightedSum ****************************
+ */
+
+template< class TValue >
+void
+SparseJointPDFDerivatives< TValue >
+::AddWeightedSum( const double * binWeights, const double scale,
+  double * derivative ) const
+{
+  const SizeValueType blockSize = this->m_BlockSize;
+
+  for( SizeValueType k = 0; k < this->m_Keys.size(); ++k )
+  {
+    const SizeValueType bin    = static_cast< SizeValueType >( this->m_Keys[ k ] % this->m_NumberOfBins );
+    const double        weight = scale * binWeights[ bin ];
+    if( weight == 0.0 )
+    {
+      continue;
+    }
+
+    /** The values are stored in order of creation, see GetBlockValues(). */
+    const SizeValueType block       = static_cast< SizeValueType >( this->m_Keys[ k ] / this->m_NumberOfBins );
+    const ValueType *   blockValues = &this->m_Values[ k * blockSize ];
+    const SizeValueType muBegin     = block * blockSize;
+    const SizeValueType muEnd       = std::min( muBegin + blockSize, this->m_NumberOfParameters );
+    for( SizeValueType mu = muBegin; mu < muEnd; ++mu )
+    {
+      derivative[ mu ] += weight * blockValues[ mu - muBegin ];
+    }
+  }
+
+} // end AddWeightedSum()
+
+
+/**
+ * ********************* GetAllocatedMemorySize ****************************
+ */
+
+template< class TValue >
+SizeValueType
+SparseJointPDFDerivatives< TValue >
+::GetAllocatedMemorySize( void ) const
+{
+  return this->m_Values.capacity() * sizeof( ValueType )
+         + this->m_Keys.capacity() * sizeof( KeyType )
+         + this->m_Offsets.bucket_count() * sizeof( void * )
+         + this->m_Offsets.size() * ( sizeof( KeyType ) + sizeof( SizeValueType ) + sizeof( void * ) );
+
+} // end GetAllocatedMemorySize()
+
+
+/**
+ * ********************* PrintSelf ****************************
+ */
+
+template< class TValue >
+void
+SparseJointPDFDerivatives< TValue >
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "NumberOfBins: " << this->m_NumberOfBins << std::endl;
+  os << indent << "NumberOfParameters: " << this->m_NumberOfParameters << std::endl;
+  os << indent << "BlockSize: " << this->m_BlockSize << std::endl;
+  os << indent << "NumberOfActiveBlocks: " << this->GetNumberOfActiveBlocks() << std::endl;
+
+} // end PrintSelf()
+
+
+} // end namespace itk
+
+#endif // end #ifndef __itkSparseJointPDFDerivatives_hxx
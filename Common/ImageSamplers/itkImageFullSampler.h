@@ -63,6 +63,7 @@ public:
   typedef typename Superclass::ImageSampleType              ImageSampleType;
   typedef typename Superclass::ImageSampleContainerType     ImageSampleContainerType;
   typedef typename Superclass::ImageSampleContainerPointer  ImageSampleContainerPointer;
+  typedef typename Superclass::ImageSampleBatchContainerType ImageSampleBatchContainerType;
   typedef typename Superclass::MaskType                     MaskType;
 
   /** The input image dimension. */
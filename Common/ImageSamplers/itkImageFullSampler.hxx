@@ -53,6 +53,10 @@ ImageFullSampler< TInputImage >
   typedef ImageRegionConstIteratorWithIndex< InputImageType > InputImageIterator;
   InputImageIterator iter( inputImage, this->GetCroppedInputImageRegion() );
 
+  /** The mask can only reduce the number of samples. */
+  ImageSampleBatchContainerType * sampleBatchContainer
+    = this->BeginSampleBatchContainer( this->GetCroppedInputImageRegion().GetNumberOfPixels() );
+
   /** Fill the sample container. */
   if( mask.IsNull() )
   {
@@ -94,6 +98,10 @@ ImageFullSampler< TInputImage >
 
       /** Store in container */
       sampleContainer->SetElement( ind, tempSample );
+      if( sampleBatchContainer )
+      {
+        sampleBatchContainer->SetSample( ind, tempSample.m_ImageCoordinates, tempSample.m_ImageValue );
+      }
 
     } // end for
   } // end if no mask
@@ -121,6 +129,11 @@ ImageFullSampler< TInputImage >
         tempSample.m_ImageValue = iter.Get();
 
         /** Store in container. */
+        if( sampleBatchContainer )
+        {
+          sampleBatchContainer->SetSample( sampleContainer->Size(),
+            tempSample.m_ImageCoordinates, tempSample.m_ImageValue );
+        }
         sampleContainer->push_back( tempSample );
 
       } // end if
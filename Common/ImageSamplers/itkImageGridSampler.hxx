@@ -118,6 +118,10 @@ ImageGridSampler< TInputImage >
   }
   index = sampleGridIndex;
 
+  /** The mask can only reduce the number of samples. */
+  ImageSampleBatchContainerType * sampleBatchContainer
+    = this->BeginSampleBatchContainer( numberOfSamplesOnGrid );
+
   if( mask.IsNull() )
   {
     /** Ugly loop over the grid. */
@@ -142,6 +146,11 @@ ImageGridSampler< TInputImage >
             index[ 0 ] += this->m_SampleGridSpacing[ 0 ];
 
             // Store sample in container.
+            if( sampleBatchContainer )
+            {
+              sampleBatchContainer->SetSample( sampleContainer->Size(),
+                tempsample.m_ImageCoordinates, tempsample.m_ImageValue );
+            }
             sampleContainer->push_back( tempsample );
 
           } // end x
@@ -190,6 +199,11 @@ ImageGridSampler< TInputImage >
               tempsample.m_ImageValue = inputImage->GetPixel( index );
 
               // Store sample in container.
+              if( sampleBatchContainer )
+              {
+                sampleBatchContainer->SetSample( sampleContainer->Size(),
+                  tempsample.m_ImageCoordinates, tempsample.m_ImageValue );
+              }
               sampleContainer->push_back( tempsample );
 
             } // end if in mask
@@ -0,0 +1,205 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __ImageImportanceSampler_h
+#define __ImageImportanceSampler_h
+
+#include "itkImageRandomSamplerBase.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class ImageImportanceSampler
+ *
+ * \brief Samples voxels of an image randomly, with a probability that is
+ * proportional to an importance weight.
+ *
+ * The importance of a voxel is the value of the WeightImage at the voxel,
+ * or, if no WeightImage is set, the gradient magnitude of the input image.
+ * Homogeneous regions, which do not contribute to the derivative of a
+ * metric, are then sampled less often. A fraction UniformWeightFraction of
+ * the probability is spread uniformly over all voxels, so that every voxel
+ * inside the mask can be selected.
+ *
+ * The probabilities are stored in an alias table (Walker, Vose), which is
+ * built once, and only again when the input image, the weight image, the
+ * mask or the region changes. Each sample is then drawn in constant time,
+ * with two random numbers.
+ *
+ * The samples are not uniformly distributed, so the sampler provides an
+ * importance weight per sample, see GetSampleWeights(): the ratio of the
+ * uniform probability of the voxel and its actual probability. A metric that
+ * multiplies the contribution of each sample by its weight computes an
+ * unbiased estimate of its uniformly sampled value.
+ *
+ * \ingroup ImageSamplers
+ */
+
+template< class TInputImage >
+class ImageImportanceSampler :
+  public ImageRandomSamplerBase< TInputImage >
+{
+public:
+
+  /** Standard ITK-stuff. */
+  typedef ImageImportanceSampler                Self;
+  typedef ImageRandomSamplerBase< TInputImage > Superclass;
+  typedef SmartPointer< Self >                  Pointer;
+  typedef SmartPointer< const Self >            ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( ImageImportanceSampler, ImageRandomSamplerBase );
+
+  /** Typedefs inherited from the superclass. */
+  typedef typename Superclass::DataObjectPointer            DataObjectPointer;
+  typedef typename Superclass::OutputVectorContainerType    OutputVectorContainerType;
+  typedef typename Superclass::OutputVectorContainerPointer OutputVectorContainerPointer;
+  typedef typename Superclass::InputImageType               InputImageType;
+  typedef typename Superclass::InputImagePointer            InputImagePointer;
+  typedef typename Superclass::InputImageConstPointer       InputImageConstPointer;
+  typedef typename Superclass::InputImageRegionType         InputImageRegionType;
+  typedef typename Superclass::InputImagePixelType          InputImagePixelType;
+  typedef typename Superclass::ImageSampleType              ImageSampleType;
+  typedef typename Superclass::ImageSampleValueType         ImageSampleValueType;
+  typedef typename Superclass::ImageSampleContainerType     ImageSampleContainerType;
+  typedef typename Superclass::ImageSampleContainerPointer  ImageSampleContainerPointer;
+  typedef typename Superclass::MaskType                     MaskType;
+
+  /** The input image dimension. */
+  itkStaticConstMacro( InputImageDimension, unsigned int,
+    Superclass::InputImageDimension );
+
+  /** Other typedefs. */
+  typedef typename InputImageType::IndexType InputImageIndexType;
+  typedef typename InputImageType::PointType InputImagePointType;
+
+  /** The image with the importance of the voxels. */
+  typedef Image< float, itkGetStaticConstMacro( InputImageDimension ) > WeightImageType;
+
+  /** The random number generator used to select the voxels. */
+  typedef itk::Statistics::MersenneTwisterRandomVariateGenerator RandomGeneratorType;
+  typedef typename RandomGeneratorType::Pointer                  RandomGeneratorPointer;
+
+  /** Set/Get the weight image. The importance of a voxel of the input image
+   * is the weight of the nearest voxel of the weight image, or zero outside
+   * the weight image, so the weight image may have another grid than the
+   * input image. If no weight image is set, the gradient magnitude of the
+   * input image is used. Default: 0.
+   */
+  itkSetConstObjectMacro( WeightImage, WeightImageType );
+  itkGetConstObjectMacro( WeightImage, WeightImageType );
+
+  /** Set/Get the fraction of the probability that is spread uniformly
+   * over all voxels. Default: 0.1.
+   */
+  itkSetClampMacro( UniformWeightFraction, double, 0.0, 1.0 );
+  itkGetConstMacro( UniformWeightFraction, double );
+
+  /** Get the number of voxels that may be selected: the voxels of the
+   * cropped input image region that are inside the mask. Valid after an update.
+   */
+  SizeValueType GetNumberOfCandidateVoxels( void ) const
+  {
+    return static_cast< SizeValueType >( this->m_CandidateOffsets.size() );
+  }
+
+
+protected:
+
+  /** The constructor. */
+  ImageImportanceSampler();
+
+  /** The destructor. */
+  virtual ~ImageImportanceSampler() {}
+
+  /** PrintSelf. */
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+  /** Function that does the work. */
+  virtual void GenerateData( void );
+
+  /** Multi-threaded functionality that does the work. */
+  virtual void BeforeThreadedGenerateData( void );
+
+  virtual void ThreadedGenerateData(
+    const InputImageRegionType & inputRegionForThread,
+    ThreadIdType threadId );
+
+  /** Build the alias table of the candidate voxels, if the input image,
+   * the weight image, the mask, the region or the uniform weight fraction
+   * changed since it was last built.
+   */
+  virtual void UpdateAliasTable( void );
+
+  /** Select a candidate voxel from a random column of the alias table,
+   * and a random number in [0, 1).
+   */
+  SizeValueType SelectCandidate( const SizeValueType column, const double u ) const;
+
+  /** Compute the sample and the weight of a candidate voxel. */
+  void ComputeCandidateSample( const SizeValueType candidate,
+    ImageSampleType & sample, double & weight ) const;
+
+  RandomGeneratorPointer m_RandomGenerator;
+
+private:
+
+  /** The private constructor. */
+  ImageImportanceSampler( const Self & );   // purposely not implemented
+  /** The private copy constructor. */
+  void operator=( const Self & );           // purposely not implemented
+
+  /** Compute the importance of the voxels of the cropped input image region. */
+  typename WeightImageType::Pointer ComputeGradientMagnitudeImage( void ) const;
+
+  typename WeightImageType::ConstPointer m_WeightImage;
+  double                                 m_UniformWeightFraction;
+
+  /** The alias table. For every candidate voxel: its offset in the cropped
+   * input image region, the probability to keep it when its column is
+   * selected, the candidate that is selected otherwise, and its weight.
+   */
+  std::vector< SizeValueType > m_CandidateOffsets;
+  std::vector< float >         m_AcceptanceProbabilities;
+  std::vector< unsigned int >  m_Aliases;
+  std::vector< float >         m_CandidateWeights;
+
+  /** The inputs for which the alias table was built. */
+  const InputImageType *  m_AliasTableInput;
+  ModifiedTimeType        m_AliasTableInputMTime;
+  const WeightImageType * m_AliasTableWeightImage;
+  ModifiedTimeType        m_AliasTableWeightImageMTime;
+  const MaskType *        m_AliasTableMask;
+  ModifiedTimeType        m_AliasTableMaskMTime;
+  InputImageRegionType    m_AliasTableRegion;
+  double                  m_AliasTableUniformWeightFraction;
+
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkImageImportanceSampler.hxx"
+#endif
+
+#endif // end #ifndef __ImageImportanceSampler_h
@@ -0,0 +1,436 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __ImageImportanceSampler_hxx
+#define __ImageImportanceSampler_hxx
+
+#include "itkImageImportanceSampler.h"
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkGradientMagnitudeImageFilter.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+/**
+ * ******************* Constructor *******************
+ */
+
+template< class TInputImage >
+ImageImportanceSampler< TInputImage >
+::ImageImportanceSampler()
+{
+  /** Setup random generator. */
+  this->m_RandomGenerator = RandomGeneratorType::GetInstance();
+
+  this->m_WeightImage           = 0;
+  this->m_UniformWeightFraction = 0.1;
+
+  this->m_AliasTableInput                 = 0;
+  this->m_AliasTableInputMTime            = 0;
+  this->m_AliasTableWeightImage           = 0;
+  this->m_AliasTableWeightImageMTime      = 0;
+  this->m_AliasTableMask                  = 0;
+  this->m_AliasTableMaskMTime             = 0;
+  this->m_AliasTableUniformWeightFraction = -1.0;
+
+} // end Constructor
+
+
+/**
+ * ******************* GenerateData *******************
+ */
+
+template< class TInputImage >
+void
+ImageImportanceSampler< TInputImage >
+::GenerateData( void )
+{
+  /** Get a handle to the output sample container. */
+  ImageSampleContainerPointer sampleContainer = this->GetOutput();
+
+  /** Clear the container. */
+  sampleContainer->Initialize();
+
+  /** Make sure the alias table is up-to-date. */
+  this->UpdateAliasTable();
+  if( this->m_CandidateOffsets.empty() )
+  {
+    itkExceptionMacro( << "ERROR: the mask does not contain any voxel of the input image region." );
+  }
+
+  /** The weights are written per sample, also by the threads. */
+  this->m_SampleWeights.resize( this->GetNumberOfSamples() );
+
+  /** If desired we exercise a multi-threaded version. */
+  if( this->m_UseMultiThread )
+  {
+    /** Calls ThreadedGenerateData(). */
+    return Superclass::GenerateData();
+  }
+
+  /** Take random samples from the candidate voxels. */
+  const SizeValueType numberOfCandidates             = this->m_CandidateOffsets.size();
+  const bool          useCounterBasedRandomGenerator = this->GetUseCounterBasedRandomGenerator();
+  if( useCounterBasedRandomGenerator )
+  {
+    this->GenerateCounterBasedKey();
+  }
+  sampleContainer->Reserve( this->GetNumberOfSamples() );
+  for( unsigned long i = 0; i < this->GetNumberOfSamples(); ++i )
+  {
+    SizeValueType column;
+    double        u;
+    if( useCounterBasedRandomGenerator )
+    {
+      column = this->GetCounterBasedRandomInteger( 2 * i, numberOfCandidates );
+      u      = this->GetCounterBasedRandomInteger( 2 * i + 1, 1UL << 30 ) / static_cast< double >( 1UL << 30 );
+    }
+    else
+    {
+      column = this->m_RandomGenerator->GetIntegerVariate( numberOfCandidates - 1 );
+      u      = this->m_RandomGenerator->GetVariateWithOpenUpperRange();
+    }
+    this->ComputeCandidateSample( this->SelectCandidate( column, u ),
+      sampleContainer->ElementAt( i ), this->m_SampleWeights[ i ] );
+  }
+
+} // end GenerateData()
+
+
+/**
+ * ******************* BeforeThreadedGenerateData *******************
+ */
+
+template< class TInputImage >
+void
+ImageImportanceSampler< TInputImage >
+::BeforeThreadedGenerateData( void )
+{
+  /** With the counter-based generator the threads draw the random numbers. */
+  if( this->GetUseCounterBasedRandomGenerator() )
+  {
+    this->GenerateCounterBasedKey();
+    this->InitializeThreaderSampleContainers();
+    return;
+  }
+
+  /** Clear the random number list. Per sample, it contains the column of
+   * the alias table and the number that selects the column or its alias.
+   */
+  const SizeValueType numberOfCandidates = this->m_CandidateOffsets.size();
+  this->m_RandomNumberList.resize( 0 );
+  this->m_RandomNumberList.reserve( 2 * this->m_NumberOfSamples );
+
+  /** Fill the list with random numbers. */
+  for( unsigned long i = 0; i < this->GetNumberOfSamples(); ++i )
+  {
+    this->m_RandomNumberList.push_back(
+      this->m_RandomGenerator->GetIntegerVariate( numberOfCandidates - 1 ) );
+    this->m_RandomNumberList.push_back(
+      this->m_RandomGenerator->GetVariateWithOpenUpperRange() );
+  }
+
+  /** Initialize variables needed for threads. */
+  this->InitializeThreaderSampleContainers();
+
+} // end BeforeThreadedGenerateData()
+
+
+/**
+ * ******************* ThreadedGenerateData *******************
+ */
+
+template< class TInputImage >
+void
+ImageImportanceSampler< TInputImage >
+::ThreadedGenerateData( const InputImageRegionType &, ThreadIdType threadId )
+{
+  /** Figure out which samples to process. */
+  unsigned long chunkSize   = this->GetNumberOfSamples() / this->GetNumberOfThreads();
+  unsigned long sampleStart = threadId * chunkSize;
+  if( threadId == this->GetNumberOfThreads() - 1 )
+  {
+    chunkSize = this->GetNumberOfSamples()
+      - ( ( this->GetNumberOfThreads() - 1 ) * chunkSize );
+  }
+
+  /** Get a reference to the output and reserve memory for it. */
+  ImageSampleContainerPointer & sampleContainerThisThread
+    = this->m_ThreaderSampleContainer[ threadId ];
+  sampleContainerThisThread->Reserve( chunkSize );
+
+  /** Setup an iterator over the sampleContainerThisThread. */
+  typename ImageSampleContainerType::Iterator iter;
+  typename ImageSampleContainerType::ConstIterator end = sampleContainerThisThread->End();
+
+  /** Compute the samples of the selected candidate voxels. */
+  const SizeValueType numberOfCandidates             = this->m_CandidateOffsets.size();
+  const bool          useCounterBasedRandomGenerator = this->GetUseCounterBasedRandomGenerator();
+  unsigned long       sampleId                       = sampleStart;
+  for( iter = sampleContainerThisThread->Begin(); iter != end; ++iter, sampleId++ )
+  {
+    SizeValueType column;
+    double        u;
+    if( useCounterBasedRandomGenerator )
+    {
+      column = this->GetCounterBasedRandomInteger( 2 * sampleId, numberOfCandidates );
+      u      = this->GetCounterBasedRandomInteger( 2 * sampleId + 1, 1UL << 30 ) / static_cast< double >( 1UL << 30 );
+    }
+    else
+    {
+      column = static_cast< SizeValueType >( this->m_RandomNumberList[ 2 * sampleId ] );
+      u      = this->m_RandomNumberList[ 2 * sampleId + 1 ];
+    }
+    this->ComputeCandidateSample( this->SelectCandidate( column, u ),
+      ( *iter ).Value(), this->m_SampleWeights[ sampleId ] );
+  }
+
+} // end ThreadedGenerateData()
+
+
+/**
+ * ******************* ComputeGradientMagnitudeImage *******************
+ */
+
+template< class TInputImage >
+typename ImageImportanceSampler< TInputImage >::WeightImageType::Pointer
+ImageImportanceSampler< TInputImage >
+::ComputeGradientMagnitudeImage( void ) const
+{
+  typedef GradientMagnitudeImageFilter< InputImageType, WeightImageType > GradientMagnitudeFilterType;
+  typename GradientMagnitudeFilterType::Pointer gradientMagnitudeFilter
+    = GradientMagnitudeFilterType::New();
+  gradientMagnitudeFilter->SetInput( this->GetInput() );
+  gradientMagnitudeFilter->Update();
+
+  typename WeightImageType::Pointer gradientMagnitude = gradientMagnitudeFilter->GetOutput();
+  gradientMagnitude->DisconnectPipeline();
+  return gradientMagnitude;
+
+} // end ComputeGradientMagnitudeImage()
+
+
+/**
+ * ******************* UpdateAliasTable *******************
+ */
+
+template< class TInputImage >
+void
+ImageImportanceSampler< TInputImage >
+::UpdateAliasTable( void )
+{
+  InputImageConstPointer          inputImage  = this->GetInput();
+  typename MaskType::ConstPointer mask        = this->GetMask();
+  const WeightImageType *         weightImage = this->m_WeightImage.GetPointer();
+  const InputImageRegionType &    region      = this->GetCroppedInputImageRegion();
+
+  if( mask.IsNotNull() && mask->GetSource() )
+  {
+    mask->GetSource()->Update();
+  }
+
+  /** Check if the table is still valid. */
+  if( this->m_AliasTableInput == inputImage.GetPointer()
+    && this->m_AliasTableInputMTime == inputImage->GetMTime()
+    && this->m_AliasTableWeightImage == weightImage
+    && this->m_AliasTableWeightImageMTime == ( weightImage ? weightImage->GetMTime() : 0 )
+    && this->m_AliasTableMask == mask.GetPointer()
+    && this->m_AliasTableMaskMTime == ( mask.IsNotNull() ? mask->GetMTime() : 0 )
+    && this->m_AliasTableRegion == region
+    && this->m_AliasTableUniformWeightFraction == this->m_UniformWeightFraction )
+  {
+    return;
+  }
+
+  /** Without a weight image, the importance is the gradient magnitude,
+   * which has the grid of the input image.
+   */
+  typename WeightImageType::Pointer gradientMagnitude;
+  if( !weightImage )
+  {
+    gradientMagnitude = this->ComputeGradientMagnitudeImage();
+  }
+
+  /** Loop over the region, and store the voxels inside the mask, with their importance. */
+  this->m_CandidateOffsets.clear();
+  std::vector< double > importances;
+
+  typedef ImageRegionConstIteratorWithIndex< InputImageType > InputImageIterator;
+  InputImageIterator                  iter( inputImage, region );
+  InputImagePointType                 point;
+  typename WeightImageType::IndexType weightIndex;
+  SizeValueType                       offset          = 0;
+  double                              totalImportance = 0.0;
+  for( iter.GoToBegin(); !iter.IsAtEnd(); ++iter, ++offset )
+  {
+    inputImage->TransformIndexToPhysicalPoint( iter.GetIndex(), point );
+    if( mask.IsNotNull() && !mask->IsInside( point ) )
+    {
+      continue;
+    }
+
+    double importance = 0.0;
+    if( weightImage )
+    {
+      if( weightImage->TransformPhysicalPointToIndex( point, weightIndex ) )
+      {
+        importance = std::max( 0.0, static_cast< double >( weightImage->GetPixel( weightIndex ) ) );
+      }
+    }
+    else
+    {
+      importance = gradientMagnitude->GetPixel( iter.GetIndex() );
+    }
+
+    this->m_CandidateOffsets.push_back( offset );
+    importances.push_back( importance );
+    totalImportance += importance;
+  }
+
+  /** Compute the probabilities, scaled by the number of candidates, so that
+   * a uniform probability is one. Without any importance, sample uniformly.
+   */
+  const SizeValueType numberOfCandidates = this->m_CandidateOffsets.size();
+  const double        alpha              = totalImportance > 0.0 ? this->m_UniformWeightFraction : 1.0;
+  const double        scale              = totalImportance > 0.0
+    ? ( 1.0 - alpha ) * numberOfCandidates / totalImportance : 0.0;
+
+  this->m_CandidateWeights.resize( numberOfCandidates );
+  for( SizeValueType i = 0; i < numberOfCandidates; ++i )
+  {
+    importances[ i ]              = alpha + scale * importances[ i ];
+    this->m_CandidateWeights[ i ] = importances[ i ] > 0.0
+      ? static_cast< float >( 1.0 / importances[ i ] ) : 0.0f;
+  }
+
+  /** Build the alias table (Vose). Every column that has less than the
+   * average probability is filled up by a column with more.
+   */
+  this->m_AcceptanceProbabilities.assign( numberOfCandidates, 1.0f );
+  this->m_Aliases.resize( numberOfCandidates );
+  std::vector< unsigned int > small;
+  std::vector< unsigned int > large;
+  for( SizeValueType i = 0; i < numberOfCandidates; ++i )
+  {
+    this->m_Aliases[ i ] = static_cast< unsigned int >( i );
+    if( importances[ i ] < 1.0 )
+    {
+      small.push_back( static_cast< unsigned int >( i ) );
+    }
+    else
+    {
+      large.push_back( static_cast< unsigned int >( i ) );
+    }
+  }
+  while( !small.empty() && !large.empty() )
+  {
+    const unsigned int s = small.back();
+    const unsigned int l = large.back();
+    small.pop_back();
+
+    this->m_AcceptanceProbabilities[ s ] = static_cast< float >( importances[ s ] );
+    this->m_Aliases[ s ]                 = l;
+
+    importances[ l ] -= 1.0 - importances[ s ];
+    if( importances[ l ] < 1.0 )
+    {
+      large.pop_back();
+      small.push_back( l );
+    }
+  }
+  /** The remaining columns have probability one, up to rounding errors. */
+
+  this->m_AliasTableInput                 = inputImage.GetPointer();
+  this->m_AliasTableInputMTime            = inputImage->GetMTime();
+  this->m_AliasTableWeightImage           = weightImage;
+  this->m_AliasTableWeightImageMTime      = weightImage ? weightImage->GetMTime() : 0;
+  this->m_AliasTableMask                  = mask.GetPointer();
+  this->m_AliasTableMaskMTime             = mask.IsNotNull() ? mask->GetMTime() : 0;
+  this->m_AliasTableRegion                = region;
+  this->m_AliasTableUniformWeightFraction = this->m_UniformWeightFraction;
+
+} // end UpdateAliasTable()
+
+
+/**
+ * ******************* SelectCandidate *******************
+ */
+
+template< class TInputImage >
+SizeValueType
+ImageImportanceSampler< TInputImage >
+::SelectCandidate( const SizeValueType column, const double u ) const
+{
+  return u < this->m_AcceptanceProbabilities[ column ] ? column : this->m_Aliases[ column ];
+
+} // end SelectCandidate()
+
+
+/**
+ * ******************* ComputeCandidateSample *******************
+ */
+
+template< class TInputImage >
+void
+ImageImportanceSampler< TInputImage >
+::ComputeCandidateSample( const SizeValueType candidate,
+  ImageSampleType & sample, double & weight ) const
+{
+  /** Convert the offset in the cropped region to an index. */
+  const InputImageRegionType & region = this->m_AliasTableRegion;
+  SizeValueType                offset = this->m_CandidateOffsets[ candidate ];
+  InputImageIndexType          index;
+  for( unsigned int d = 0; d < InputImageDimension; ++d )
+  {
+    const SizeValueType size = region.GetSize()[ d ];
+    index[ d ] = region.GetIndex()[ d ] + static_cast< IndexValueType >( offset % size );
+    offset    /= size;
+  }
+
+  /** Compute the point and the image value of the sample. */
+  this->m_AliasTableInput->TransformIndexToPhysicalPoint( index, sample.m_ImageCoordinates );
+  sample.m_ImageValue = static_cast< ImageSampleValueType >( this->m_AliasTableInput->GetPixel( index ) );
+  weight              = this->m_CandidateWeights[ candidate ];
+
+} // end ComputeCandidateSample()
+
+
+/**
+ * ******************* PrintSelf *******************
+ */
+
+template< class TInputImage >
+void
+ImageImportanceSampler< TInputImage >
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "WeightImage: " << this->m_WeightImage.GetPointer() << std::endl;
+  os << indent << "UniformWeightFraction: " << this->m_UniformWeightFraction << std::endl;
+  os << indent << "NumberOfCandidateVoxels: " << this->m_CandidateOffsets.size() << std::endl;
+  os << indent << "RandomGenerator: " << this->m_RandomGenerator.GetPointer() << std::endl;
+
+} // end PrintSelf()
+
+
+} // end namespace itk
+
+#endif // end #ifndef __ImageImportanceSampler_hxx
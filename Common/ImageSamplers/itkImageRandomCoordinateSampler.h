@@ -33,6 +33,17 @@ namespace itk
  * This image sampler generates not only samples that correspond with
  * pixel locations, but selects points in physical space.
  *
+ * By default the coordinates are independent and uniformly distributed.
+ * With UseLowDiscrepancySequence, the coordinates are the points of a
+ * Halton sequence, with base 2, 3, 5, ... per dimension, rotated by a random
+ * shift modulo the sample region (Cranley-Patterson rotation). The points
+ * of every sample set are then spread evenly over the region, while the
+ * random shift keeps every point uniformly distributed, so that the metric
+ * estimates stay unbiased and have a smaller variance for the same number
+ * of samples. The shift is drawn once per update; the i-th point only
+ * depends on i and the shift, so the threads compute their points
+ * independently, and the samples do not depend on the number of threads.
+ *
  * \ingroup ImageSamplers
  */
 
@@ -66,6 +77,7 @@ public:
   typedef typename Superclass::ImageSampleType              ImageSampleType;
   typedef typename Superclass::ImageSampleContainerType     ImageSampleContainerType;
   typedef typename Superclass::ImageSampleContainerPointer  ImageSampleContainerPointer;
+  typedef typename Superclass::ImageSampleBatchContainerType ImageSampleBatchContainerType;
   typedef typename Superclass::MaskType                     MaskType;
   typedef typename Superclass::InputImageSizeType           InputImageSizeType;
   typedef typename InputImageType::SpacingType              InputImageSpacingType;
@@ -105,6 +117,12 @@ public:
   itkGetConstMacro( UseRandomSampleRegion, bool );
   itkSetMacro( UseRandomSampleRegion, bool );
 
+  /** Set/Get whether to use a randomly shifted Halton sequence instead of
+   * independent random coordinates. Default: false. */
+  itkSetMacro( UseLowDiscrepancySequence, bool );
+  itkGetConstMacro( UseLowDiscrepancySequence, bool );
+  itkBooleanMacro( UseLowDiscrepancySequence );
+
 protected:
 
   typedef typename InterpolatorType::ContinuousIndexType InputImageContinuousIndexType;
@@ -133,6 +151,21 @@ protected:
     const InputImageContinuousIndexType & largestContIndex,
     InputImageContinuousIndexType &       randomContIndex );
 
+  /** Draw the random shift of the low-discrepancy sequence. */
+  virtual void GenerateSequenceShift( void );
+
+  /** Generate the point with the given number of the shifted Halton
+   * sequence in a bounding box. Thread-safe. */
+  virtual void GenerateLowDiscrepancyCoordinate(
+    const SizeValueType sampleNumber,
+    const InputImageContinuousIndexType & smallestContIndex,
+    const InputImageContinuousIndexType & largestContIndex,
+    InputImageContinuousIndexType &       sampleContIndex ) const;
+
+  /** The radical inverse of a number: its digits in the given base,
+   * mirrored around the decimal point. */
+  static double RadicalInverse( SizeValueType number, const unsigned int base );
+
   InterpolatorPointer    m_Interpolator;
   RandomGeneratorPointer m_RandomGenerator;
   InputImageSpacingType  m_SampleRegionSize;
@@ -156,6 +189,13 @@ private:
   void operator=( const Self & );                 // purposely not implemented
 
   bool m_UseRandomSampleRegion;
+  bool m_UseLowDiscrepancySequence;
+
+  /** The shift of the low-discrepancy sequence, and the sample region of
+   * the threads, set in BeforeThreadedGenerateData(). */
+  FixedArray< double, InputImageDimension > m_SequenceShift;
+  InputImageContinuousIndexType             m_SmallestContIndex;
+  InputImageContinuousIndexType             m_LargestContIndex;
 
 };
 
@@ -44,6 +44,9 @@ ImageRandomCoordinateSampler< TInputImage >
   this->m_UseRandomSampleRegion = false;
   this->m_SampleRegionSize.Fill( 1.0 );
 
+  this->m_UseLowDiscrepancySequence = false;
+  this->m_SequenceShift.Fill( 0.0 );
+
 } // end Constructor
 
 
@@ -85,15 +88,22 @@ ImageRandomCoordinateSampler< TInputImage >
   InputImageContinuousIndexType largestContIndex;
   this->GenerateSampleRegion( smallestImageContIndex, largestImageContIndex,
     smallestContIndex, largestContIndex );
+  if( this->m_UseLowDiscrepancySequence )
+  {
+    this->GenerateSequenceShift();
+  }
 
   /** Reserve memory for the output. */
   sampleContainer->Reserve( this->GetNumberOfSamples() );
+  ImageSampleBatchContainerType * sampleBatchContainer
+    = this->BeginSampleBatchContainer( this->GetNumberOfSamples() );
 
   /** Setup an iterator over the output, which is of ImageSampleContainerType. */
   typename ImageSampleContainerType::Iterator iter;
   typename ImageSampleContainerType::ConstIterator end = sampleContainer->End();
 
   InputImageContinuousIndexType sampleContIndex;
+  SizeValueType                 sampleNumber = 0;
   /** Fill the sample container. */
   if( mask.IsNull() )
   {
@@ -105,7 +115,15 @@ ImageRandomCoordinateSampler< TInputImage >
       ImageSampleValueType & sampleValue = ( *iter ).Value().m_ImageValue;
 
       /** Walk over the image until we find a valid point. */
-      this->GenerateRandomCoordinate( smallestContIndex, largestContIndex, sampleContIndex );
+      if( this->m_UseLowDiscrepancySequence )
+      {
+        this->GenerateLowDiscrepancyCoordinate( sampleNumber++,
+          smallestContIndex, largestContIndex, sampleContIndex );
+      }
+      else
+      {
+        this->GenerateRandomCoordinate( smallestContIndex, largestContIndex, sampleContIndex );
+      }
 
       /** Convert to point */
       inputImage->TransformContinuousIndexToPhysicalPoint( sampleContIndex, samplePoint );
@@ -113,6 +131,10 @@ ImageRandomCoordinateSampler< TInputImage >
       /** Compute the value at the continuous index. */
       sampleValue = static_cast< ImageSampleValueType >(
         this->m_Interpolator->EvaluateAtContinuousIndex( sampleContIndex ) );
+      if( sampleBatchContainer )
+      {
+        sampleBatchContainer->SetSample( iter.Index(), samplePoint, sampleValue );
+      }
 
     } // end for loop
   } // end if no mask
@@ -151,8 +173,17 @@ ImageRandomCoordinateSampler< TInputImage >
                              << "reasonable time. Probably the mask is too small" );
         }
 
-        /** Generate a point in the input image region. */
-        this->GenerateRandomCoordinate( smallestContIndex, largestContIndex, sampleContIndex );
+        /** Generate a point in the input image region. The points of the
+         * low-discrepancy sequence that are outside the mask are skipped. */
+        if( this->m_UseLowDiscrepancySequence )
+        {
+          this->GenerateLowDiscrepancyCoordinate( sampleNumber++,
+            smallestContIndex, largestContIndex, sampleContIndex );
+        }
+        else
+        {
+          this->GenerateRandomCoordinate( smallestContIndex, largestContIndex, sampleContIndex );
+        }
         inputImage->TransformContinuousIndexToPhysicalPoint( sampleContIndex, samplePoint );
 
       }
@@ -162,6 +193,10 @@ ImageRandomCoordinateSampler< TInputImage >
       /** Compute the value at the point. */
       sampleValue = static_cast< ImageSampleValueType >(
         this->m_Interpolator->EvaluateAtContinuousIndex( sampleContIndex ) );
+      if( sampleBatchContainer )
+      {
+        sampleBatchContainer->SetSample( iter.Index(), samplePoint, sampleValue );
+      }
 
     } // end for loop
   } // end if mask
@@ -198,6 +233,16 @@ ImageRandomCoordinateSampler< TInputImage >
   this->GenerateSampleRegion( smallestImageCIndex, largestImageCIndex,
     smallestCIndex, largestCIndex );
 
+  /** The points of the low-discrepancy sequence are computed by the threads. */
+  if( this->m_UseLowDiscrepancySequence )
+  {
+    this->GenerateSequenceShift();
+    this->m_SmallestContIndex = smallestCIndex;
+    this->m_LargestContIndex  = largestCIndex;
+    this->InitializeThreaderSampleContainers();
+    return;
+  }
+
   /** Fill the list with random numbers. */
   for( unsigned long i = 0; i < this->m_NumberOfSamples; i++ )
   {
@@ -209,12 +254,7 @@ ImageRandomCoordinateSampler< TInputImage >
   }
 
   /** Initialize variables needed for threads. */
-  this->m_ThreaderSampleContainer.clear();
-  this->m_ThreaderSampleContainer.resize( this->GetNumberOfThreads() );
-  for( std::size_t i = 0; i < this->GetNumberOfThreads(); i++ )
-  {
-    this->m_ThreaderSampleContainer[ i ] = ImageSampleContainerType::New();
-  }
+  this->InitializeThreaderSampleContainers();
 
 } // end BeforeThreadedGenerateData()
 
@@ -258,13 +298,23 @@ ImageRandomCoordinateSampler< TInputImage >
 
   /** Fill the local sample container. */
   InputImageContinuousIndexType sampleCIndex;
-  unsigned long                 sampleId = sampleStart;
+  unsigned long                 sampleId     = sampleStart;
+  SizeValueType                 sampleNumber = sampleStart / InputImageDimension;
   for( iter = sampleContainerThisThread->Begin(); iter != end; ++iter )
   {
-    /** Create a random point out of InputImageDimension random numbers. */
-    for( unsigned int j = 0; j < InputImageDimension; ++j, sampleId++ )
+    if( this->m_UseLowDiscrepancySequence )
     {
-      sampleCIndex[ j ] = this->m_RandomNumberList[ sampleId ];
+      /** Compute the point of the shifted Halton sequence. */
+      this->GenerateLowDiscrepancyCoordinate( sampleNumber++,
+        this->m_SmallestContIndex, this->m_LargestContIndex, sampleCIndex );
+    }
+    else
+    {
+      /** Create a random point out of InputImageDimension random numbers. */
+      for( unsigned int j = 0; j < InputImageDimension; ++j, sampleId++ )
+      {
+        sampleCIndex[ j ] = this->m_RandomNumberList[ sampleId ];
+      }
     }
 
     /** Make a reference to the current sample in the container. */
@@ -304,6 +354,76 @@ ImageRandomCoordinateSampler< TInputImage >
 } // end GenerateRandomCoordinate()
 
 
+/**
+ * ******************* GenerateSequenceShift *******************
+ */
+
+template< class TInputImage >
+void
+ImageRandomCoordinateSampler< TInputImage >
+::GenerateSequenceShift( void )
+{
+  for( unsigned int i = 0; i < InputImageDimension; ++i )
+  {
+    this->m_SequenceShift[ i ] = this->m_RandomGenerator->GetUniformVariate( 0.0, 1.0 );
+  }
+
+} // end GenerateSequenceShift()
+
+
+/**
+ * ******************* GenerateLowDiscrepancyCoordinate *******************
+ */
+
+template< class TInputImage >
+void
+ImageRandomCoordinateSampler< TInputImage >
+::GenerateLowDiscrepancyCoordinate(
+  const SizeValueType sampleNumber,
+  const InputImageContinuousIndexType & smallestContIndex,
+  const InputImageContinuousIndexType & largestContIndex,
+  InputImageContinuousIndexType &       sampleContIndex ) const
+{
+  /** The first primes, the bases of the Halton sequence. */
+  static const unsigned int primes[] = { 2, 3, 5, 7, 11, 13, 17, 19, 23, 29 };
+
+  for( unsigned int i = 0; i < InputImageDimension; ++i )
+  {
+    double u = RadicalInverse( sampleNumber, primes[ i ] ) + this->m_SequenceShift[ i ];
+    if( u >= 1.0 )
+    {
+      u -= 1.0;
+    }
+    sampleContIndex[ i ] = static_cast< InputImagePointValueType >(
+      smallestContIndex[ i ] + u * ( largestContIndex[ i ] - smallestContIndex[ i ] ) );
+  }
+
+} // end GenerateLowDiscrepancyCoordinate()
+
+
+/**
+ * ******************* RadicalInverse *******************
+ */
+
+template< class TInputImage >
+double
+ImageRandomCoordinateSampler< TInputImage >
+::RadicalInverse( SizeValueType number, const unsigned int base )
+{
+  const double inverseBase = 1.0 / base;
+  double       digitWeight = inverseBase;
+  double       result      = 0.0;
+  while( number > 0 )
+  {
+    result      += ( number % base ) * digitWeight;
+    number      /= base;
+    digitWeight *= inverseBase;
+  }
+  return result;
+
+} // end RadicalInverse()
+
+
 /**
  * ******************* GenerateSampleRegion *******************
  */
@@ -361,6 +481,9 @@ ImageRandomCoordinateSampler< TInputImage >
 
   os << indent << "Interpolator: " << this->m_Interpolator.GetPointer() << std::endl;
   os << indent << "RandomGenerator: " << this->m_RandomGenerator.GetPointer() << std::endl;
+  os << indent << "UseRandomSampleRegion: " << this->m_UseRandomSampleRegion << std::endl;
+  os << indent << "SampleRegionSize: " << this->m_SampleRegionSize << std::endl;
+  os << indent << "UseLowDiscrepancySequence: " << this->m_UseLowDiscrepancySequence << std::endl;
 
 } // end PrintSelf()
 
@@ -32,6 +32,10 @@ namespace itk
  * mask. If the mask is very sparse, this may take some time. In this case,
  * consider using the ImageRandomSamplerSparseMask.
  *
+ * With UseCounterBasedRandomGenerator, the i-th candidate voxel is selected
+ * by the i-th number of the counter-based random generator. The samples are
+ * then the same, single-threaded or multi-threaded, for any number of threads.
+ *
  * \ingroup ImageSamplers
  */
 
@@ -66,6 +70,7 @@ public:
   typedef typename Superclass::ImageSampleValueType         ImageSampleValueType;
   typedef typename Superclass::ImageSampleContainerType     ImageSampleContainerType;
   typedef typename Superclass::ImageSampleContainerPointer  ImageSampleContainerPointer;
+  typedef typename Superclass::ImageSampleBatchContainerType ImageSampleBatchContainerType;
   typedef typename Superclass::MaskType                     MaskType;
   typedef typename Superclass::InputImageSizeType           InputImageSizeType;
 
@@ -91,6 +96,14 @@ protected:
     const InputImageRegionType & inputRegionForThread,
     ThreadIdType threadId );
 
+  /** Generate the samples with the counter-based random generator,
+   * single-threaded. Used with a mask, or when multi-threading is off.
+   */
+  virtual void GenerateDataWithCounterBasedRandomGenerator( void );
+
+  /** Convert a position in the cropped input image region to an index. */
+  void ComputeIndexOfPosition( unsigned long position, InputImageIndexType & index ) const;
+
 private:
 
   /** The private constructor. */
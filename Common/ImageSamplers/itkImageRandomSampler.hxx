@@ -42,6 +42,10 @@ ImageRandomSampler< TInputImage >
     /** Calls ThreadedGenerateData(). */
     return Superclass::GenerateData();
   }
+  if( this->GetUseCounterBasedRandomGenerator() )
+  {
+    return this->GenerateDataWithCounterBasedRandomGenerator();
+  }
 
   /** Get handles to the input image, output sample container. */
   InputImageConstPointer inputImage = this->GetInput();
@@ -49,6 +53,8 @@ ImageRandomSampler< TInputImage >
 
   /** Reserve memory for the output. */
   sampleContainer->Reserve( this->GetNumberOfSamples() );
+  ImageSampleBatchContainerType * sampleBatchContainer
+    = this->BeginSampleBatchContainer( this->GetNumberOfSamples() );
 
   /** Setup a random iterator over the input image. */
   typedef ImageRandomConstIteratorWithIndex< InputImageType > RandomIteratorType;
@@ -73,6 +79,11 @@ ImageRandomSampler< TInputImage >
         ( *iter ).Value().m_ImageCoordinates );
       /** Get the value and put it in the sample. */
       ( *iter ).Value().m_ImageValue = randIter.Get();
+      if( sampleBatchContainer )
+      {
+        sampleBatchContainer->SetSample( iter.Index(),
+          ( *iter ).Value().m_ImageCoordinates, ( *iter ).Value().m_ImageValue );
+      }
       /** Jump to a random position. */
       ++randIter;
 
@@ -121,6 +132,10 @@ ImageRandomSampler< TInputImage >
       /** Put the coordinates and the value in the sample. */
       ( *iter ).Value().m_ImageCoordinates = inputPoint;
       ( *iter ).Value().m_ImageValue       = randIter.Get();
+      if( sampleBatchContainer )
+      {
+        sampleBatchContainer->SetSample( iter.Index(), inputPoint, ( *iter ).Value().m_ImageValue );
+      }
 
     } // end for loop
 
@@ -171,24 +186,17 @@ ImageRandomSampler< TInputImage >
   typename ImageSampleContainerType::ConstIterator end = sampleContainerThisThread->End();
 
   /** Fill the local sample container. */
-  unsigned long       sampleId    = sampleStart;
-  InputImageSizeType  regionSize  = this->GetCroppedInputImageRegion().GetSize();
-  InputImageIndexType regionIndex = this->GetCroppedInputImageRegion().GetIndex();
+  const bool          useCounterBasedRandomGenerator = this->GetUseCounterBasedRandomGenerator();
+  const SizeValueType numberOfPixels                 = this->GetCroppedInputImageRegion().GetNumberOfPixels();
+  unsigned long       sampleId                       = sampleStart;
+  InputImageIndexType positionIndex;
   for( iter = sampleContainerThisThread->Begin(); iter != end; ++iter, sampleId++ )
   {
-    unsigned long randomPosition = static_cast< unsigned long >( this->m_RandomNumberList[ sampleId ] );
-
-    /** Translate randomPosition to an index, copied from ImageRandomConstIteratorWithIndex. */
-    unsigned long       residual;
-    InputImageIndexType positionIndex;
-    for( unsigned int dim = 0; dim < InputImageDimension; dim++ )
-    {
-      const unsigned long sizeInThisDimension = regionSize[ dim ];
-      residual             = randomPosition % sizeInThisDimension;
-      positionIndex[ dim ] = residual + regionIndex[ dim ];
-      randomPosition      -= residual;
-      randomPosition      /= sizeInThisDimension;
-    }
+    /** Get the random position of this sample, and its index. */
+    const unsigned long randomPosition = useCounterBasedRandomGenerator
+      ? this->GetCounterBasedRandomInteger( sampleId, numberOfPixels )
+      : static_cast< unsigned long >( this->m_RandomNumberList[ sampleId ] );
+    this->ComputeIndexOfPosition( randomPosition, positionIndex );
 
     /** Transform index to the physical coordinates and put it in the sample. */
     inputImage->TransformIndexToPhysicalPoint( positionIndex,
@@ -202,6 +210,105 @@ ImageRandomSampler< TInputImage >
 } // end ThreadedGenerateData()
 
 
+/**
+ * ******************* GenerateDataWithCounterBasedRandomGenerator *******************
+ */
+
+template< class TInputImage >
+void
+ImageRandomSampler< TInputImage >
+::GenerateDataWithCounterBasedRandomGenerator( void )
+{
+  /** Get handles to the mask, the input image and the output sample container. */
+  typename MaskType::ConstPointer mask = this->GetMask();
+  InputImageConstPointer inputImage = this->GetInput();
+  typename ImageSampleContainerType::Pointer sampleContainer = this->GetOutput();
+
+  /** Update the mask. */
+  if( mask.IsNotNull() && mask->GetSource() )
+  {
+    mask->GetSource()->Update();
+  }
+
+  /** Reserve memory for the output. */
+  sampleContainer->Reserve( this->GetNumberOfSamples() );
+  ImageSampleBatchContainerType * sampleBatchContainer
+    = this->BeginSampleBatchContainer( this->GetNumberOfSamples() );
+
+  /** Make sure we are not eternally trying to find samples. Without a mask
+   * every candidate is accepted, as in ThreadedGenerateData().
+   */
+  this->GenerateCounterBasedKey();
+  const SizeValueType numberOfPixels = this->GetCroppedInputImageRegion().GetNumberOfPixels();
+  const SizeValueType maximumNumberOfSamplesToTry = 10 * this->GetNumberOfSamples();
+  SizeValueType       numberOfSamplesTried        = 0;
+
+  /** Loop over the sample container. */
+  typename ImageSampleContainerType::Iterator iter;
+  typename ImageSampleContainerType::ConstIterator end = sampleContainer->End();
+  InputImageIndexType index;
+  InputImagePointType inputPoint;
+  for( iter = sampleContainer->Begin(); iter != end; ++iter )
+  {
+    /** Loop until a valid sample is found. */
+    do
+    {
+      /** Check if we are not trying eternally to find a valid point. */
+      if( numberOfSamplesTried == maximumNumberOfSamplesToTry )
+      {
+        /** Squeeze the sample container to the size that is still valid. */
+        typename ImageSampleContainerType::iterator stlnow = sampleContainer->begin();
+        typename ImageSampleContainerType::iterator stlend = sampleContainer->end();
+        stlnow                                            += iter.Index();
+        sampleContainer->erase( stlnow, stlend );
+        itkExceptionMacro( << "Could not find enough image samples within "
+                           << "reasonable time. Probably the mask is too small" );
+      }
+
+      /** Get the index of the next candidate, and its physical coordinates. */
+      this->ComputeIndexOfPosition(
+        this->GetCounterBasedRandomInteger( numberOfSamplesTried++, numberOfPixels ), index );
+      inputImage->TransformIndexToPhysicalPoint( index, inputPoint );
+    }
+    while( mask.IsNotNull() && !mask->IsInside( inputPoint ) );
+
+    /** Put the coordinates and the value in the sample. */
+    ( *iter ).Value().m_ImageCoordinates = inputPoint;
+    ( *iter ).Value().m_ImageValue       = static_cast< ImageSampleValueType >( inputImage->GetPixel( index ) );
+    if( sampleBatchContainer )
+    {
+      sampleBatchContainer->SetSample( iter.Index(), inputPoint, ( *iter ).Value().m_ImageValue );
+    }
+
+  } // end for loop
+
+} // end GenerateDataWithCounterBasedRandomGenerator()
+
+
+/**
+ * ******************* ComputeIndexOfPosition *******************
+ */
+
+template< class TInputImage >
+void
+ImageRandomSampler< TInputImage >
+::ComputeIndexOfPosition( unsigned long position, InputImageIndexType & index ) const
+{
+  /** Translate the position to an index, copied from ImageRandomConstIteratorWithIndex. */
+  const InputImageSizeType  regionSize  = this->GetCroppedInputImageRegion().GetSize();
+  const InputImageIndexType regionIndex = this->GetCroppedInputImageRegion().GetIndex();
+  for( unsigned int dim = 0; dim < InputImageDimension; dim++ )
+  {
+    const unsigned long sizeInThisDimension = regionSize[ dim ];
+    const unsigned long residual            = position % sizeInThisDimension;
+    index[ dim ] = residual + regionIndex[ dim ];
+    position    -= residual;
+    position    /= sizeInThisDimension;
+  }
+
+} // end ComputeIndexOfPosition()
+
+
 } // end namespace itk
 
 #endif // end #ifndef __ImageRandomSampler_hxx
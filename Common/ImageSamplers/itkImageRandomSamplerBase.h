@@ -29,6 +29,14 @@ namespace itk
  *
  * It adds the Set/GetNumberOfSamples function.
  *
+ * It also provides a counter-based random generator (Philox-4x32-10, Salmon
+ * et al., "Parallel random numbers: as easy as 1, 2, 3", SC 2011), that
+ * computes the i-th random number of an update directly from i and a key.
+ * The key is drawn once per update from the global Mersenne Twister, so the
+ * random numbers depend on the random seed and change every update. As no
+ * state is shared, the threads can draw their random numbers themselves,
+ * and the samples do not depend on the number of threads.
+ *
  * \ingroup ImageSamplers
  */
 
@@ -62,6 +70,7 @@ public:
   typedef typename Superclass::ImageSampleType              ImageSampleType;
   typedef typename Superclass::ImageSampleContainerType     ImageSampleContainerType;
   typedef typename Superclass::ImageSampleContainerPointer  ImageSampleContainerPointer;
+  typedef typename Superclass::ImageSampleBatchContainerType ImageSampleBatchContainerType;
   typedef typename Superclass::MaskType                     MaskType;
 
   /** The input image dimension. */
@@ -71,6 +80,13 @@ public:
   /** Set the number of samples. */
   itkSetClampMacro( NumberOfSamples, unsigned long, 1, NumericTraits< unsigned long >::max() );
 
+  /** Set/Get whether to use the counter-based random generator, instead of
+   * the global random generator, for the selection of the samples. Default: false.
+   */
+  itkSetMacro( UseCounterBasedRandomGenerator, bool );
+  itkGetConstMacro( UseCounterBasedRandomGenerator, bool );
+  itkBooleanMacro( UseCounterBasedRandomGenerator );
+
 protected:
 
   /** The constructor. */
@@ -85,6 +101,15 @@ protected:
   /** PrintSelf. */
   void PrintSelf( std::ostream & os, Indent indent ) const;
 
+  /** Draw a new key of the counter-based random generator. */
+  void GenerateCounterBasedKey( void );
+
+  /** Get the random integer in [0, n) of the counter-based random
+   * generator for the given counter. Thread-safe.
+   */
+  SizeValueType GetCounterBasedRandomInteger(
+    const SizeValueType counter, const SizeValueType n ) const;
+
   /** Member variable used when threading. */
   std::vector< double > m_RandomNumberList;
 
@@ -95,6 +120,9 @@ private:
   /** The private copy constructor. */
   void operator=( const Self & );             // purposely not implemented
 
+  bool     m_UseCounterBasedRandomGenerator;
+  uint32_t m_CounterBasedKey[ 2 ];
+
 };
 
 } // end namespace itk
@@ -34,7 +34,10 @@ template< class TInputImage >
 ImageRandomSamplerBase< TInputImage >
 ::ImageRandomSamplerBase()
 {
-  this->m_NumberOfSamples = 1000;
+  this->m_NumberOfSamples                = 1000;
+  this->m_UseCounterBasedRandomGenerator = false;
+  this->m_CounterBasedKey[ 0 ]           = 0;
+  this->m_CounterBasedKey[ 1 ]           = 0;
 
 } // end Constructor
 
@@ -48,6 +51,14 @@ void
 ImageRandomSamplerBase< TInputImage >
 ::BeforeThreadedGenerateData( void )
 {
+  /** With the counter-based generator the threads draw the random numbers. */
+  if( this->m_UseCounterBasedRandomGenerator )
+  {
+    this->GenerateCounterBasedKey();
+    Superclass::BeforeThreadedGenerateData();
+    return;
+  }
+
   /** Create a random number generator. Also used in the ImageRandomConstIteratorWithIndex. */
   typedef typename Statistics::MersenneTwisterRandomVariateGenerator::Pointer GeneratorPointer;
   GeneratorPointer localGenerator = Statistics::MersenneTwisterRandomVariateGenerator::GetInstance();
@@ -74,6 +85,71 @@ ImageRandomSamplerBase< TInputImage >
 } // end BeforeThreadedGenerateData()
 
 
+/**
+ * ******************* GenerateCounterBasedKey *******************
+ */
+
+template< class TInputImage >
+void
+ImageRandomSamplerBase< TInputImage >
+::GenerateCounterBasedKey( void )
+{
+  typedef Statistics::MersenneTwisterRandomVariateGenerator GeneratorType;
+  typename GeneratorType::Pointer generator = GeneratorType::GetInstance();
+
+  this->m_CounterBasedKey[ 0 ] = static_cast< uint32_t >( generator->GetIntegerVariate() );
+  this->m_CounterBasedKey[ 1 ] = static_cast< uint32_t >( generator->GetIntegerVariate() );
+
+} // end GenerateCounterBasedKey()
+
+
+/**
+ * ******************* GetCounterBasedRandomInteger *******************
+ */
+
+template< class TInputImage >
+SizeValueType
+ImageRandomSamplerBase< TInputImage >
+::GetCounterBasedRandomInteger( const SizeValueType counter, const SizeValueType n ) const
+{
+  /** Philox-4x32-10: ten rounds of multiplications and xors of the counter,
+   * with a key that is incremented every round.
+   */
+  const uint32_t multiplier0   = 0xD2511F53u;
+  const uint32_t multiplier1   = 0xCD9E8D57u;
+  const uint32_t keyIncrement0 = 0x9E3779B9u;
+  const uint32_t keyIncrement1 = 0xBB67AE85u;
+
+  uint32_t x[ 4 ];
+  x[ 0 ] = static_cast< uint32_t >( counter );
+  x[ 1 ] = static_cast< uint32_t >( static_cast< uint64_t >( counter ) >> 32 );
+  x[ 2 ] = 0;
+  x[ 3 ] = 0;
+  uint32_t key0 = this->m_CounterBasedKey[ 0 ];
+  uint32_t key1 = this->m_CounterBasedKey[ 1 ];
+  for( unsigned int round = 0; round < 10; ++round )
+  {
+    const uint64_t product0 = static_cast< uint64_t >( multiplier0 ) * x[ 0 ];
+    const uint64_t product1 = static_cast< uint64_t >( multiplier1 ) * x[ 2 ];
+    const uint32_t x1       = x[ 1 ];
+    const uint32_t x3       = x[ 3 ];
+    x[ 0 ] = static_cast< uint32_t >( product1 >> 32 ) ^ x1 ^ key0;
+    x[ 1 ] = static_cast< uint32_t >( product1 );
+    x[ 2 ] = static_cast< uint32_t >( product0 >> 32 ) ^ x3 ^ key1;
+    x[ 3 ] = static_cast< uint32_t >( product0 );
+    key0  += keyIncrement0;
+    key1  += keyIncrement1;
+  }
+
+  /** Map 53 random bits to [0, n). */
+  const uint64_t      bits    = ( static_cast< uint64_t >( x[ 0 ] ) << 21 ) ^ ( x[ 1 ] >> 11 );
+  const double        variate = static_cast< double >( bits ) * ( 1.0 / 9007199254740992.0 );
+  const SizeValueType result  = static_cast< SizeValueType >( variate * n );
+  return result < n ? result : n - 1;
+
+} // end GetCounterBasedRandomInteger()
+
+
 /**
  * ******************* PrintSelf *******************
  */
@@ -86,6 +162,7 @@ ImageRandomSamplerBase< TInputImage >
   Superclass::PrintSelf( os, indent );
 
   os << indent << "NumberOfSamples: " << this->m_NumberOfSamples << std::endl;
+  os << indent << "UseCounterBasedRandomGenerator: " << this->m_UseCounterBasedRandomGenerator << std::endl;
 
 } // end PrintSelf()
 
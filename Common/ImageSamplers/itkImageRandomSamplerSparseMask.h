@@ -20,7 +20,8 @@
 
 #include "itkImageRandomSamplerBase.h"
 #include "itkMersenneTwisterRandomVariateGenerator.h"
-#include "itkImageFullSampler.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -31,6 +32,21 @@ namespace itk
  * This version takes into account that the mask may be very small.
  * Also, it may be more efficient when very many different sample sets
  * of the same input image are required, because it does some precomputation.
+ *
+ * The precomputation is a compressed index of the voxels inside the mask:
+ * the runs of consecutive masked voxels along the first dimension of the
+ * cropped input image region, with the number of masked voxels before each
+ * run. It is built once, and only again when the input image, the mask or
+ * the region changes. A lookup table with the run of every 64th masked voxel
+ * finds the run of the k-th masked voxel in constant time on average. The
+ * physical point and the image value are computed for the selected samples
+ * only, so the memory and time needed per update depend on the number of
+ * samples, and not on the size of the mask.
+ *
+ * With UseCounterBasedRandomGenerator, the threads select their samples
+ * themselves, instead of from a list that is drawn before threading, and the
+ * samples do not depend on the number of threads.
+ *
  * \ingroup ImageSamplers
  */
 
@@ -62,8 +78,10 @@ public:
   typedef typename Superclass::InputImageRegionType         InputImageRegionType;
   typedef typename Superclass::InputImagePixelType          InputImagePixelType;
   typedef typename Superclass::ImageSampleType              ImageSampleType;
+  typedef typename Superclass::ImageSampleValueType         ImageSampleValueType;
   typedef typename Superclass::ImageSampleContainerType     ImageSampleContainerType;
   typedef typename Superclass::ImageSampleContainerPointer  ImageSampleContainerPointer;
+  typedef typename Superclass::ImageSampleBatchContainerType ImageSampleBatchContainerType;
   typedef typename Superclass::MaskType                     MaskType;
 
   /** The input image dimension. */
@@ -78,10 +96,19 @@ public:
   typedef itk::Statistics::MersenneTwisterRandomVariateGenerator RandomGeneratorType;
   typedef typename RandomGeneratorType::Pointer                  RandomGeneratorPointer;
 
-protected:
+  /** Get the number of voxels inside the mask, within the cropped input
+   * image region. Valid after an update.
+   */
+  itkGetConstMacro( NumberOfMaskedVoxels, SizeValueType );
+
+  /** Get the number of runs of masked voxels in the index. */
+  SizeValueType GetNumberOfMaskRuns( void ) const
+  {
+    return static_cast< SizeValueType >( this->m_RunOffsets.size() );
+  }
 
-  typedef itk::ImageFullSampler< InputImageType >   InternalFullSamplerType;
-  typedef typename InternalFullSamplerType::Pointer InternalFullSamplerPointer;
+
+protected:
 
   /** The constructor. */
   ImageRandomSamplerSparseMask();
@@ -101,8 +128,17 @@ protected:
     const InputImageRegionType & inputRegionForThread,
     ThreadIdType threadId );
 
-  RandomGeneratorPointer     m_RandomGenerator;
-  InternalFullSamplerPointer m_InternalFullSampler;
+  /** Build the index of the masked voxels, if the input image, the mask or
+   * the cropped input image region changed since it was last built.
+   */
+  virtual void UpdateMaskIndex( void );
+
+  /** Compute the sample of the k-th masked voxel, in the order of the
+   * cropped input image region.
+   */
+  void ComputeMaskedSample( const SizeValueType k, ImageSampleType & sample ) const;
+
+  RandomGeneratorPointer m_RandomGenerator;
 
 private:
 
@@ -111,6 +147,25 @@ private:
   /** The private copy constructor. */
   void operator=( const Self & );                // purposely not implemented
 
+  /** The lookup table has an entry for every 2^RunLookupShift masked voxels. */
+  itkStaticConstMacro( RunLookupShift, unsigned int, 6 );
+
+  /** The index of the masked voxels. For every run: the offset of its first
+   * voxel in the cropped input image region, and the number of masked voxels
+   * before it. The latter has one extra element: the number of masked voxels.
+   */
+  std::vector< SizeValueType > m_RunOffsets;
+  std::vector< SizeValueType > m_RunCumulativeLengths;
+  std::vector< SizeValueType > m_RunLookupTable;
+  SizeValueType                m_NumberOfMaskedVoxels;
+
+  /** The input image, mask and region for which the index was built. */
+  const InputImageType * m_MaskIndexInput;
+  ModifiedTimeType       m_MaskIndexInputMTime;
+  const MaskType *       m_MaskIndexMask;
+  ModifiedTimeType       m_MaskIndexMaskMTime;
+  InputImageRegionType   m_MaskIndexRegion;
+
 };
 
 } // end namespace itk
@@ -20,6 +20,10 @@
 
 #include "itkImageRandomSamplerSparseMask.h"
 
+#include "itkImageRegionConstIteratorWithIndex.h"
+
+#include <algorithm>
+
 namespace itk
 {
 
@@ -34,7 +38,11 @@ ImageRandomSamplerSparseMask< TInputImage >
   /** Setup random generator. */
   this->m_RandomGenerator = RandomGeneratorType::GetInstance();
 
-  this->m_InternalFullSampler = InternalFullSamplerType::New();
+  this->m_NumberOfMaskedVoxels = 0;
+  this->m_MaskIndexInput       = 0;
+  this->m_MaskIndexInputMTime  = 0;
+  this->m_MaskIndexMask        = 0;
+  this->m_MaskIndexMaskMTime   = 0;
 
 } // end Constructor
 
@@ -57,42 +65,17 @@ ImageRandomSamplerSparseMask< TInputImage >
     itkExceptionMacro( << "ERROR: do not call this function when no mask is supplied." );
   }
 
-  /** Get handles to the input image and output sample container. */
-  InputImageConstPointer      inputImage      = this->GetInput();
+  /** Get a handle to the output sample container. */
   ImageSampleContainerPointer sampleContainer = this->GetOutput();
 
   /** Clear the container. */
   sampleContainer->Initialize();
 
-  /** Make sure the internal full sampler is up-to-date. */
-  this->m_InternalFullSampler->SetInput( inputImage );
-  this->m_InternalFullSampler->SetMask( mask );
-  this->m_InternalFullSampler->SetInputImageRegion( this->GetCroppedInputImageRegion() );
-
-  /** Use try/catch, since the full sampler may crash, due to insufficient memory. */
-  try
-  {
-    this->m_InternalFullSampler->Update();
-  }
-  catch( ExceptionObject & err )
+  /** Make sure the index of the masked voxels is up-to-date. */
+  this->UpdateMaskIndex();
+  if( this->m_NumberOfMaskedVoxels == 0 )
   {
-    std::string message = "ERROR: This ImageSampler internally uses the "
-      "ImageFullSampler. Updating of this internal sampler raised the "
-      "exception:\n";
-    message += err.GetDescription();
-
-    std::string            fullSamplerMessage = err.GetDescription();
-    std::string::size_type loc                = fullSamplerMessage.find(
-      "ERROR: failed to allocate memory for the sample container", 0 );
-    if( loc != std::string::npos && this->GetMask() == 0 )
-    {
-      message += "\nYou are using the ImageRandomSamplerSparseMask sampler, "
-        "but you did not set a mask. The internal ImageFullSampler therefore "
-        "requires a lot of memory. Consider using the ImageRandomSampler "
-        "instead.";
-    }
-    const char * message2 = message.c_str();
-    itkExceptionMacro( << message2 );
+    itkExceptionMacro( << "ERROR: the mask does not contain any voxel of the input image region." );
   }
 
   /** If desired we exercise a multi-threaded version. */
@@ -102,17 +85,26 @@ ImageRandomSamplerSparseMask< TInputImage >
     return Superclass::GenerateData();
   }
 
-  /** Get a handle to the full sampler output. */
-  typename ImageSampleContainerType::Pointer allValidSamples
-    = this->m_InternalFullSampler->GetOutput();
-  unsigned long numberOfValidSamples = allValidSamples->Size();
-
-  /** Take random samples from the allValidSamples-container. */
+  /** Take random samples from the masked voxels. */
+  const bool useCounterBasedRandomGenerator = this->GetUseCounterBasedRandomGenerator();
+  if( useCounterBasedRandomGenerator )
+  {
+    this->GenerateCounterBasedKey();
+  }
+  sampleContainer->Reserve( this->GetNumberOfSamples() );
+  ImageSampleBatchContainerType * sampleBatchContainer
+    = this->BeginSampleBatchContainer( this->GetNumberOfSamples() );
   for( unsigned int i = 0; i < this->GetNumberOfSamples(); ++i )
   {
-    unsigned long randomIndex
-      = this->m_RandomGenerator->GetIntegerVariate( numberOfValidSamples - 1 );
-    sampleContainer->push_back( allValidSamples->ElementAt( randomIndex ) );
+    unsigned long randomIndex = useCounterBasedRandomGenerator
+      ? this->GetCounterBasedRandomInteger( i, this->m_NumberOfMaskedVoxels )
+      : this->m_RandomGenerator->GetIntegerVariate( this->m_NumberOfMaskedVoxels - 1 );
+    ImageSampleType & sample = sampleContainer->ElementAt( i );
+    this->ComputeMaskedSample( randomIndex, sample );
+    if( sampleBatchContainer )
+    {
+      sampleBatchContainer->SetSample( i, sample.m_ImageCoordinates, sample.m_ImageValue );
+    }
   }
 
 } // end GenerateData()
@@ -127,29 +119,28 @@ void
 ImageRandomSamplerSparseMask< TInputImage >
 ::BeforeThreadedGenerateData( void )
 {
+  /** With the counter-based generator the threads draw the random numbers. */
+  if( this->GetUseCounterBasedRandomGenerator() )
+  {
+    this->GenerateCounterBasedKey();
+    this->InitializeThreaderSampleContainers();
+    return;
+  }
+
   /** Clear the random number list. */
   this->m_RandomNumberList.resize( 0 );
   this->m_RandomNumberList.reserve( this->m_NumberOfSamples );
 
-  /** Get a handle to the full sampler output size. */
-  const unsigned long numberOfValidSamples
-    = this->m_InternalFullSampler->GetOutput()->Size();
-
   /** Fill the list with random numbers. */
   for( unsigned int i = 0; i < this->GetNumberOfSamples(); ++i )
   {
     unsigned long randomIndex
-      = this->m_RandomGenerator->GetIntegerVariate( numberOfValidSamples - 1 );
+      = this->m_RandomGenerator->GetIntegerVariate( this->m_NumberOfMaskedVoxels - 1 );
     this->m_RandomNumberList.push_back( randomIndex );
   }
 
   /** Initialize variables needed for threads. */
-  this->m_ThreaderSampleContainer.clear();
-  this->m_ThreaderSampleContainer.resize( this->GetNumberOfThreads() );
-  for( std::size_t i = 0; i < this->GetNumberOfThreads(); i++ )
-  {
-    this->m_ThreaderSampleContainer[ i ] = ImageSampleContainerType::New();
-  }
+  this->InitializeThreaderSampleContainers();
 
 } // end BeforeThreadedGenerateData()
 
@@ -163,10 +154,6 @@ void
 ImageRandomSamplerSparseMask< TInputImage >
 ::ThreadedGenerateData( const InputImageRegionType &, ThreadIdType threadId )
 {
-  /** Get a handle to the full sampler output. */
-  typename ImageSampleContainerType::Pointer allValidSamples
-    = this->m_InternalFullSampler->GetOutput();
-
   /** Figure out which samples to process. */
   unsigned long chunkSize   = this->GetNumberOfSamples() / this->GetNumberOfThreads();
   unsigned long sampleStart = threadId * chunkSize;
@@ -185,17 +172,151 @@ ImageRandomSamplerSparseMask< TInputImage >
   typename ImageSampleContainerType::Iterator iter;
   typename ImageSampleContainerType::ConstIterator end = sampleContainerThisThread->End();
 
-  /** Take random samples from the allValidSamples-container. */
-  unsigned long sampleId = sampleStart;
+  /** Compute the samples of the selected masked voxels. */
+  const bool    useCounterBasedRandomGenerator = this->GetUseCounterBasedRandomGenerator();
+  unsigned long sampleId                       = sampleStart;
   for( iter = sampleContainerThisThread->Begin(); iter != end; ++iter, sampleId++ )
   {
-    unsigned long randomIndex = static_cast< unsigned long >( this->m_RandomNumberList[ sampleId ] );
-    ( *iter ).Value() = allValidSamples->ElementAt( randomIndex );
+    unsigned long randomIndex = useCounterBasedRandomGenerator
+      ? this->GetCounterBasedRandomInteger( sampleId, this->m_NumberOfMaskedVoxels )
+      : static_cast< unsigned long >( this->m_RandomNumberList[ sampleId ] );
+    this->ComputeMaskedSample( randomIndex, ( *iter ).Value() );
   }
 
 } // end ThreadedGenerateData()
 
 
+/**
+ * ******************* UpdateMaskIndex *******************
+ */
+
+template< class TInputImage >
+void
+ImageRandomSamplerSparseMask< TInputImage >
+::UpdateMaskIndex( void )
+{
+  InputImageConstPointer          inputImage = this->GetInput();
+  typename MaskType::ConstPointer mask       = this->GetMask();
+  const InputImageRegionType &    region     = this->GetCroppedInputImageRegion();
+
+  if( mask->GetSource() )
+  {
+    mask->GetSource()->Update();
+  }
+
+  /** Check if the index is still valid. */
+  if( this->m_MaskIndexInput == inputImage.GetPointer()
+    && this->m_MaskIndexInputMTime == inputImage->GetMTime()
+    && this->m_MaskIndexMask == mask.GetPointer()
+    && this->m_MaskIndexMaskMTime == mask->GetMTime()
+    && this->m_MaskIndexRegion == region )
+  {
+    return;
+  }
+
+  this->m_RunOffsets.clear();
+  this->m_RunCumulativeLengths.clear();
+  this->m_RunLookupTable.clear();
+  this->m_NumberOfMaskedVoxels = 0;
+
+  /** Loop over the region, and store the runs of voxels inside the mask.
+   * A run ends at the end of a row.
+   */
+  typedef ImageRegionConstIteratorWithIndex< InputImageType > InputImageIterator;
+  InputImageIterator  iter( inputImage, region );
+  InputImagePointType point;
+  const SizeValueType rowSize = region.GetSize()[ 0 ];
+  SizeValueType       offset  = 0;
+  bool                inRun   = false;
+  for( iter.GoToBegin(); !iter.IsAtEnd(); ++iter, ++offset )
+  {
+    inputImage->TransformIndexToPhysicalPoint( iter.GetIndex(), point );
+    if( mask->IsInside( point ) )
+    {
+      if( !inRun || offset % rowSize == 0 )
+      {
+        this->m_RunOffsets.push_back( offset );
+        this->m_RunCumulativeLengths.push_back( this->m_NumberOfMaskedVoxels );
+        inRun = true;
+      }
+      ++this->m_NumberOfMaskedVoxels;
+    }
+    else
+    {
+      inRun = false;
+    }
+  }
+  this->m_RunCumulativeLengths.push_back( this->m_NumberOfMaskedVoxels );
+
+  /** For every 2^RunLookupShift masked voxels, store the run that contains it.
+   * The last entry is the last run, so that every masked voxel lies between the
+   * runs of two consecutive entries.
+   */
+  if( this->m_NumberOfMaskedVoxels > 0 )
+  {
+    const SizeValueType numberOfEntries
+      = ( ( this->m_NumberOfMaskedVoxels - 1 ) >> Self::RunLookupShift ) + 1;
+    this->m_RunLookupTable.reserve( numberOfEntries + 1 );
+    SizeValueType run = 0;
+    for( SizeValueType entry = 0; entry < numberOfEntries; ++entry )
+    {
+      const SizeValueType k = entry << Self::RunLookupShift;
+      while( this->m_RunCumulativeLengths[ run + 1 ] <= k )
+      {
+        ++run;
+      }
+      this->m_RunLookupTable.push_back( run );
+    }
+    this->m_RunLookupTable.push_back( this->m_RunOffsets.size() - 1 );
+  }
+
+  this->m_MaskIndexInput      = inputImage.GetPointer();
+  this->m_MaskIndexInputMTime = inputImage->GetMTime();
+  this->m_MaskIndexMask       = mask.GetPointer();
+  this->m_MaskIndexMaskMTime  = mask->GetMTime();
+  this->m_MaskIndexRegion     = region;
+
+} // end UpdateMaskIndex()
+
+
+/**
+ * ******************* ComputeMaskedSample *******************
+ */
+
+template< class TInputImage >
+void
+ImageRandomSamplerSparseMask< TInputImage >
+::ComputeMaskedSample( const SizeValueType k, ImageSampleType & sample ) const
+{
+  /** Find the run that contains the k-th masked voxel. It lies between the
+   * runs of the lookup table entries before and after k.
+   */
+  const SizeValueType entry = k >> Self::RunLookupShift;
+  std::vector< SizeValueType >::const_iterator first
+    = this->m_RunCumulativeLengths.begin() + this->m_RunLookupTable[ entry ];
+  std::vector< SizeValueType >::const_iterator last
+    = this->m_RunCumulativeLengths.begin() + this->m_RunLookupTable[ entry + 1 ] + 1;
+  const SizeValueType run = static_cast< SizeValueType >(
+    std::upper_bound( first, last, k ) - this->m_RunCumulativeLengths.begin() ) - 1;
+
+  /** Convert the offset in the cropped region to an index. */
+  const InputImageRegionType & region = this->m_MaskIndexRegion;
+  SizeValueType                offset = this->m_RunOffsets[ run ] + ( k - this->m_RunCumulativeLengths[ run ] );
+  InputImageIndexType          index;
+  for( unsigned int d = 0; d < InputImageDimension; ++d )
+  {
+    const SizeValueType size = region.GetSize()[ d ];
+    index[ d ] = region.GetIndex()[ d ] + static_cast< IndexValueType >( offset % size );
+    offset    /= size;
+  }
+
+  /** Compute the point and the image value of the sample. */
+  this->m_MaskIndexInput->TransformIndexToPhysicalPoint( index, sample.m_ImageCoordinates );
+  sample.m_ImageValue = static_cast< ImageSampleValueType >( this->m_MaskIndexInput->GetPixel( index ) );
+
+} // end ComputeMaskedSample()
+
+
 /**
  * ******************* PrintSelf *******************
  */
@@ -207,7 +328,8 @@ ImageRandomSamplerSparseMask< TInputImage >
 {
   Superclass::PrintSelf( os, indent );
 
-  os << indent << "InternalFullSampler: " << this->m_InternalFullSampler.GetPointer() << std::endl;
+  os << indent << "NumberOfMaskedVoxels: " << this->m_NumberOfMaskedVoxels << std::endl;
+  os << indent << "NumberOfMaskRuns: " << this->m_RunOffsets.size() << std::endl;
   os << indent << "RandomGenerator: " << this->m_RandomGenerator.GetPointer() << std::endl;
 
 } // end PrintSelf()
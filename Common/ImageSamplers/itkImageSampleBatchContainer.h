@@ -0,0 +1,234 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkImageSampleBatchContainer_h
+#define __itkImageSampleBatchContainer_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImageSample.h"
+#include "itkVectorDataContainer.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class ImageSampleBatchContainer
+ *
+ * \brief A container of image samples in structure-of-arrays layout.
+ *
+ * The ImageSampleContainer stores a point and a value per sample, which
+ * means that the coordinates of a single dimension are not contiguous in
+ * memory. This container stores the samples as separate arrays: one array
+ * of coordinates per dimension, and one array of values. Each array starts
+ * at a 64-byte aligned address, so that batches of samples can be loaded
+ * directly into SIMD registers.
+ *
+ * The memory is reused when the number of samples changes: it is only
+ * reallocated when the number of samples exceeds the capacity. The number
+ * of allocations is counted, which is useful for testing.
+ *
+ * The container is filled by the image samplers while they generate their
+ * output, and is meant to be consumed by the metrics in blocks of samples,
+ * see GetSamples().
+ *
+ * \ingroup ImageSamplers
+ */
+
+template< class TImage >
+class ImageSampleBatchContainer : public Object
+{
+public:
+
+  /** Standard ITK-stuff. */
+  typedef ImageSampleBatchContainer  Self;
+  typedef Object                     Superclass;
+  typedef SmartPointer< Self >       Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( ImageSampleBatchContainer, Object );
+
+  /** Typedefs. */
+  typedef TImage                                                ImageType;
+  typedef ImageSample< ImageType >                              ImageSampleType;
+  typedef VectorDataContainer< unsigned long, ImageSampleType > ImageSampleContainerType;
+  typedef typename ImageSampleType::PointType                   PointType;
+  typedef typename ImageSampleType::RealType                    RealType;
+  typedef typename PointType::ValueType                         CoordinateType;
+
+  /** The image dimension. */
+  itkStaticConstMacro( ImageDimension, unsigned int, ImageType::ImageDimension );
+
+  /** The alignment of the arrays, in bytes. */
+  itkStaticConstMacro( Alignment, unsigned int, 64 );
+
+  /** Set the number of samples. The contents of the arrays are undefined
+   * afterwards. Memory is only allocated if the capacity is too small.
+   */
+  void SetNumberOfSamples( const SizeValueType numberOfSamples );
+
+  /** Get the number of samples. */
+  SizeValueType GetNumberOfSamples( void ) const
+  {
+    return this->m_NumberOfSamples;
+  }
+
+
+  /** Get the number of samples that fit in the allocated memory. */
+  itkGetConstMacro( Capacity, SizeValueType );
+
+  /** Get the number of times memory was allocated. */
+  itkGetConstMacro( NumberOfAllocations, SizeValueType );
+
+  /** Release the memory. */
+  void Initialize( void );
+
+  /** Get the array of coordinates of dimension dim. */
+  CoordinateType * GetCoordinates( const unsigned int dim )
+  {
+    return this->m_Coordinates[ dim ];
+  }
+
+
+  const CoordinateType * GetCoordinates( const unsigned int dim ) const
+  {
+    return this->m_Coordinates[ dim ];
+  }
+
+
+  /** Get the array of sample values. */
+  RealType * GetValues( void )
+  {
+    return this->m_Values;
+  }
+
+
+  const RealType * GetValues( void ) const
+  {
+    return this->m_Values;
+  }
+
+
+  /** Set a single sample. */
+  void SetSample( const SizeValueType id, const PointType & point, const RealType & value )
+  {
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+      this->m_Coordinates[ d ][ id ] = point[ d ];
+    }
+    this->m_Values[ id ] = value;
+  }
+
+
+  /** Copy the block of samples [ begin, begin + numberOfSamples ) to the
+   * points and values arrays. This is how the metrics read their samples,
+   * so the point and value types of the metric are accepted.
+   */
+  template< class TPoint, class TValue >
+  void GetSamples( const SizeValueType begin, const unsigned int numberOfSamples,
+    TPoint * points, TValue * values ) const
+  {
+    for( unsigned int d = 0; d < ImageDimension; ++d )
+    {
+      const CoordinateType * coordinates = this->m_Coordinates[ d ] + begin;
+      for( unsigned int i = 0; i < numberOfSamples; ++i )
+      {
+        points[ i ][ d ] = coordinates[ i ];
+      }
+    }
+
+    const RealType * sampleValues = this->m_Values + begin;
+    for( unsigned int i = 0; i < numberOfSamples; ++i )
+    {
+      values[ i ] = static_cast< TValue >( sampleValues[ i ] );
+    }
+  }
+
+
+  /** Fill this container with the samples of an ImageSampleContainer.
+   * The container and its update time are remembered, see IsCopyOf().
+   */
+  void CopyFrom( const ImageSampleContainerType * sampleContainer );
+
+  /** Remember that the first sampleContainer->Size() samples of this
+   * container, which were written with SetSample() while sampleContainer
+   * was generated, are the samples of sampleContainer. See IsCopyOf().
+   */
+  void SetSampleContainer( const ImageSampleContainerType * sampleContainer );
+
+  /** Returns whether this container holds the samples of sampleContainer,
+   * as they were when sampleContainer was last generated. A sample
+   * container that was regenerated since CopyFrom() has a newer update
+   * time, even if the number of samples did not change.
+   */
+  bool IsCopyOf( const ImageSampleContainerType * sampleContainer ) const
+  {
+    return sampleContainer == this->m_SampleContainer
+           && sampleContainer->GetUpdateMTime() == this->m_SampleContainerUpdateMTime
+           && sampleContainer->Size() == this->m_NumberOfSamples;
+  }
+
+
+protected:
+
+  ImageSampleBatchContainer();
+  virtual ~ImageSampleBatchContainer() {}
+
+  /** PrintSelf. */
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+private:
+
+  ImageSampleBatchContainer( const Self & ); // purposely not implemented
+  void operator=( const Self & );            // purposely not implemented
+
+  /** Return a pointer into buffer, aligned to Alignment bytes. */
+  template< class T >
+  static T * AlignPointer( T * pointer );
+
+  /** The coordinates and values are stored in two buffers. The buffers
+   * are over-allocated, so that the arrays can be aligned.
+   */
+  std::vector< CoordinateType > m_CoordinateBuffer;
+  std::vector< RealType >       m_ValueBuffer;
+  CoordinateType *              m_Coordinates[ ImageDimension ];
+  RealType *                    m_Values;
+
+  SizeValueType m_NumberOfSamples;
+  SizeValueType m_Capacity;
+  SizeValueType m_NumberOfAllocations;
+
+  /** The sample container of the last CopyFrom() or SetSampleContainer(),
+   * and its update time.
+   */
+  const ImageSampleContainerType * m_SampleContainer;
+  ModifiedTimeType                 m_SampleContainerUpdateMTime;
+
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkImageSampleBatchContainer.hxx"
+#endif
+
+#endif // end #ifndef __itkImageSampleBatchContainer_h
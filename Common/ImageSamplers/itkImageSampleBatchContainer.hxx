@@ -0,0 +1,198 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkImageSampleBatchContainer_hxx
+#define __itkImageSampleBatchContainer_hxx
+
+#include "itkImageSampleBatchContainer.h"
+
+namespace itk
+{
+
+/**
+ * ******************* Constructor *******************
+ */
+
+template< class TImage >
+ImageSampleBatchContainer< TImage >
+::ImageSampleBatchContainer()
+{
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+  {
+    this->m_Coordinates[ d ] = 0;
+  }
+  this->m_Values              = 0;
+  this->m_NumberOfSamples     = 0;
+  this->m_Capacity            = 0;
+  this->m_NumberOfAllocations = 0;
+  this->m_SampleContainer     = 0;
+  this->m_SampleContainerUpdateMTime = 0;
+
+} // end Constructor()
+
+
+/**
+ * ******************* AlignPointer *******************
+ */
+
+template< class TImage >
+template< class T >
+T *
+ImageSampleBatchContainer< TImage >
+::AlignPointer( T * pointer )
+{
+  const std::size_t address = reinterpret_cast< std::size_t >( pointer );
+  const std::size_t aligned = ( address + Alignment - 1 ) / Alignment * Alignment;
+  return reinterpret_cast< T * >( aligned );
+
+} // end AlignPointer()
+
+
+/**
+ * ******************* SetNumberOfSamples *******************
+ */
+
+template< class TImage >
+void
+ImageSampleBatchContainer< TImage >
+::SetNumberOfSamples( const SizeValueType numberOfSamples )
+{
+  this->m_NumberOfSamples = numberOfSamples;
+  if( numberOfSamples <= this->m_Capacity )
+  {
+    return;
+  }
+
+  /** Round the capacity up, such that every coordinate array starts at an
+   * aligned address. The coordinate types are assumed to divide Alignment.
+   */
+  const SizeValueType coordinatesPerBlock = Alignment / sizeof( CoordinateType );
+  const SizeValueType valuesPerBlock      = Alignment / sizeof( RealType );
+  const SizeValueType capacity
+    = ( numberOfSamples + coordinatesPerBlock - 1 ) / coordinatesPerBlock * coordinatesPerBlock;
+
+  /** Allocate new buffers; the old contents need not be preserved. */
+  std::vector< CoordinateType >( ImageDimension * capacity + coordinatesPerBlock ).swap( this->m_CoordinateBuffer );
+  std::vector< RealType >( capacity + valuesPerBlock ).swap( this->m_ValueBuffer );
+
+  CoordinateType * coordinates = AlignPointer( &( this->m_CoordinateBuffer[ 0 ] ) );
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+  {
+    this->m_Coordinates[ d ] = coordinates + d * capacity;
+  }
+  this->m_Values = AlignPointer( &( this->m_ValueBuffer[ 0 ] ) );
+
+  this->m_Capacity = capacity;
+  ++this->m_NumberOfAllocations;
+
+} // end SetNumberOfSamples()
+
+
+/**
+ * ******************* Initialize *******************
+ */
+
+template< class TImage >
+void
+ImageSampleBatchContainer< TImage >
+::Initialize( void )
+{
+  std::vector< CoordinateType >().swap( this->m_CoordinateBuffer );
+  std::vector< RealType >().swap( this->m_ValueBuffer );
+  for( unsigned int d = 0; d < ImageDimension; ++d )
+  {
+    this->m_Coordinates[ d ] = 0;
+  }
+  this->m_Values          = 0;
+  this->m_NumberOfSamples = 0;
+  this->m_Capacity        = 0;
+  this->m_SampleContainer = 0;
+  this->m_SampleContainerUpdateMTime = 0;
+
+} // end Initialize()
+
+
+/**
+ * ******************* CopyFrom *******************
+ */
+
+template< class TImage >
+void
+ImageSampleBatchContainer< TImage >
+::CopyFrom( const ImageSampleContainerType * sampleContainer )
+{
+  const SizeValueType numberOfSamples = sampleContainer->Size();
+  this->SetNumberOfSamples( numberOfSamples );
+
+  for( SizeValueType i = 0; i < numberOfSamples; ++i )
+  {
+    const ImageSampleType & sample = sampleContainer->ElementAt( i );
+    this->SetSample( i, sample.m_ImageCoordinates, sample.m_ImageValue );
+  }
+  this->m_SampleContainer            = sampleContainer;
+  this->m_SampleContainerUpdateMTime = sampleContainer->GetUpdateMTime();
+  this->Modified();
+
+} // end CopyFrom()
+
+
+/**
+ * ******************* SetSampleContainer *******************
+ */
+
+template< class TImage >
+void
+ImageSampleBatchContainer< TImage >
+::SetSampleContainer( const ImageSampleContainerType * sampleContainer )
+{
+  const SizeValueType numberOfSamples = sampleContainer->Size();
+  if( numberOfSamples > this->m_Capacity )
+  {
+    itkExceptionMacro( << "ERROR: the sample container has " << numberOfSamples
+                       << " samples, more than the capacity of the batch container: "
+                       << this->m_Capacity );
+  }
+
+  this->m_NumberOfSamples            = numberOfSamples;
+  this->m_SampleContainer            = sampleContainer;
+  this->m_SampleContainerUpdateMTime = sampleContainer->GetUpdateMTime();
+  this->Modified();
+
+} // end SetSampleContainer()
+
+
+/**
+ * ******************* PrintSelf *******************
+ */
+
+template< class TImage >
+void
+ImageSampleBatchContainer< TImage >
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "NumberOfSamples: " << this->m_NumberOfSamples << std::endl;
+  os << indent << "Capacity: " << this->m_Capacity << std::endl;
+  os << indent << "NumberOfAllocations: " << this->m_NumberOfAllocations << std::endl;
+
+} // end PrintSelf()
+
+
+} // end namespace itk
+
+#endif // end #ifndef __itkImageSampleBatchContainer_hxx
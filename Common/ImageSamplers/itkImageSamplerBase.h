@@ -20,6 +20,7 @@
 
 #include "itkImageToVectorContainerFilter.h"
 #include "itkImageSample.h"
+#include "itkImageSampleBatchContainer.h"
 #include "itkVectorDataContainer.h"
 #include "itkSpatialObject.h"
 
@@ -77,6 +78,8 @@ public:
   typedef ImageSample< InputImageType >                         ImageSampleType;
   typedef VectorDataContainer< unsigned long, ImageSampleType > ImageSampleContainerType;
   typedef typename ImageSampleContainerType::Pointer            ImageSampleContainerPointer;
+  typedef ImageSampleBatchContainer< InputImageType >           ImageSampleBatchContainerType;
+  typedef typename ImageSampleBatchContainerType::Pointer       ImageSampleBatchContainerPointer;
   typedef typename InputImageType::SizeType                     InputImageSizeType;
   typedef typename InputImageType::IndexType                    InputImageIndexType;
   typedef typename InputImageType::PointType                    InputImagePointType;
@@ -87,6 +90,7 @@ public:
   typedef typename MaskType::ConstPointer                       MaskConstPointer;
   typedef std::vector< MaskConstPointer >                       MaskVectorType;
   typedef std::vector< InputImageRegionType >                   InputImageRegionVectorType;
+  typedef std::vector< double >                                 ImageSampleWeightContainerType;
 
   /** ******************** Masks ******************** */
 
@@ -168,9 +172,43 @@ public:
   itkSetClampMacro( NumberOfSamples, unsigned long, 1, NumericTraits< unsigned long >::max() );
   itkGetConstMacro( NumberOfSamples, unsigned long );
 
+  /** Get the samples in structure-of-arrays layout. The container is
+   * filled together with the output, and has the same samples in the
+   * same order. Its memory is reused between updates. Use
+   * ImageSampleBatchContainer::IsCopyOf() to check that it holds the
+   * current output, which is not the case if the output was generated
+   * in another way than by Update().
+   */
+  virtual const ImageSampleBatchContainerType * GetSampleBatchContainer( void ) const
+  {
+    return this->m_SampleBatchContainer.GetPointer();
+  }
+
+
+  /** Set/Get whether the sample batch container is generated. Default: false.
+   * The metrics that read their samples in batches switch it on. If false,
+   * the container is kept empty.
+   */
+  itkSetMacro( GenerateSampleBatchContainer, bool );
+  itkGetConstMacro( GenerateSampleBatchContainer, bool );
+
+  /** Get the importance weights of the samples, in the order of the output.
+   * The container is empty if all samples have the same weight, as is the
+   * case for the samplers that select their samples uniformly. Otherwise the
+   * weights are normalized such that their expected value is one, so that a
+   * metric can multiply the contribution of each sample by its weight.
+   */
+  itkGetConstReferenceMacro( SampleWeights, ImageSampleWeightContainerType );
+
   /** \todo: Temporary, should think about interface. */
   itkSetMacro( UseMultiThread, bool );
 
+  /** Generate the output, and the sample batch container. The batch
+   * container is finished here, after the update time of the output has
+   * been set, so that the batch container can record it.
+   */
+  virtual void UpdateOutputData( DataObject * output );
+
 protected:
 
   /** The constructor. */
@@ -204,9 +242,30 @@ protected:
 
   virtual void AfterThreadedGenerateData( void );
 
+  /** Prepare one sample container per thread. Existing containers are
+   * cleared but keep their memory, to avoid reallocations every iteration.
+   */
+  void InitializeThreaderSampleContainers( void );
+
+  /** Prepare the sample batch container for at most maximumNumberOfSamples
+   * samples. The samplers call this in GenerateData(), and write each sample
+   * to the returned container with SetSample(), at the same position as in
+   * the output. Returns 0 if the sample batch container is not generated.
+   */
+  ImageSampleBatchContainerType * BeginSampleBatchContainer( const SizeValueType maximumNumberOfSamples );
+
+  /** Finish the sample batch container after the output has been generated.
+   * The output is copied if the sampler did not write the samples itself.
+   */
+  void UpdateSampleBatchContainer( void );
+
   /***/
   unsigned long                              m_NumberOfSamples;
   std::vector< ImageSampleContainerPointer > m_ThreaderSampleContainer;
+  ImageSampleBatchContainerPointer           m_SampleBatchContainer;
+  bool                                       m_GenerateSampleBatchContainer;
+  bool                                       m_SampleBatchContainerIsWritten;
+  ImageSampleWeightContainerType             m_SampleWeights;
 
   //tmp?
   bool m_UseMultiThread;
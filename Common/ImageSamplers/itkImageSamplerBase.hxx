@@ -31,10 +31,13 @@ template< class TInputImage >
 ImageSamplerBase< TInputImage >
 ::ImageSamplerBase()
 {
-  this->m_Mask                      = 0;
-  this->m_NumberOfMasks             = 0;
-  this->m_NumberOfInputImageRegions = 0;
-  this->m_NumberOfSamples           = 0;
+  this->m_Mask                         = 0;
+  this->m_NumberOfMasks                = 0;
+  this->m_NumberOfInputImageRegions    = 0;
+  this->m_NumberOfSamples              = 0;
+  this->m_SampleBatchContainer         = ImageSampleBatchContainerType::New();
+  this->m_GenerateSampleBatchContainer  = false;
+  this->m_SampleBatchContainerIsWritten = false;
 
   //tmp?
   this->m_UseMultiThread = false;
@@ -416,12 +419,7 @@ ImageSamplerBase< TInputImage >
 ::BeforeThreadedGenerateData( void )
 {
   /** Initialize variables needed for threads. */
-  this->m_ThreaderSampleContainer.clear();
-  this->m_ThreaderSampleContainer.resize( this->GetNumberOfThreads() );
-  for( std::size_t i = 0; i < this->GetNumberOfThreads(); i++ )
-  {
-    this->m_ThreaderSampleContainer[ i ] = ImageSampleContainerType::New();
-  }
+  this->InitializeThreaderSampleContainers();
 
 } // end BeforeThreadedGenerateData()
 
@@ -448,16 +446,129 @@ ImageSamplerBase< TInputImage >
   sampleContainer->reserve( this->m_NumberOfSamples );
 
   /** Combine the results of all threads. */
+  ImageSampleBatchContainerType * sampleBatchContainer
+    = this->BeginSampleBatchContainer( this->m_NumberOfSamples );
   for( std::size_t i = 0; i < this->GetNumberOfThreads(); i++ )
   {
+    const ImageSampleContainerType & threaderSampleContainer = *this->m_ThreaderSampleContainer[ i ];
+    if( sampleBatchContainer )
+    {
+      const SizeValueType offset = sampleContainer->Size();
+      for( SizeValueType j = 0; j < threaderSampleContainer.Size(); ++j )
+      {
+        const ImageSampleType & sample = threaderSampleContainer.ElementAt( j );
+        sampleBatchContainer->SetSample( offset + j, sample.m_ImageCoordinates, sample.m_ImageValue );
+      }
+    }
     sampleContainer->insert( sampleContainer->end(),
-      this->m_ThreaderSampleContainer[ i ]->begin(),
-      this->m_ThreaderSampleContainer[ i ]->end() );
+      threaderSampleContainer.begin(), threaderSampleContainer.end() );
   }
 
 } // end AfterThreadedGenerateData()
 
 
+/**
+ * ******************* InitializeThreaderSampleContainers *******************
+ */
+
+template< class TInputImage >
+void
+ImageSamplerBase< TInputImage >
+::InitializeThreaderSampleContainers( void )
+{
+  /** Only create new containers if the number of threads changed.
+   * Otherwise clear them: std::vector::clear() keeps the capacity.
+   */
+  const std::size_t numberOfThreads = this->GetNumberOfThreads();
+  if( this->m_ThreaderSampleContainer.size() != numberOfThreads )
+  {
+    this->m_ThreaderSampleContainer.clear();
+    this->m_ThreaderSampleContainer.resize( numberOfThreads );
+  }
+
+  for( std::size_t i = 0; i < numberOfThreads; i++ )
+  {
+    if( this->m_ThreaderSampleContainer[ i ].IsNull() )
+    {
+      this->m_ThreaderSampleContainer[ i ] = ImageSampleContainerType::New();
+    }
+    else
+    {
+      this->m_ThreaderSampleContainer[ i ]->clear();
+    }
+  }
+
+} // end InitializeThreaderSampleContainers()
+
+
+/**
+ * ******************* UpdateOutputData *******************
+ */
+
+template< class TInputImage >
+void
+ImageSamplerBase< TInputImage >
+::UpdateOutputData( DataObject * output )
+{
+  /** Generate the output, which also sets its update time. */
+  this->m_SampleBatchContainerIsWritten = false;
+  this->Superclass::UpdateOutputData( output );
+
+  /** Also provide the samples in structure-of-arrays layout. */
+  this->UpdateSampleBatchContainer();
+
+} // end UpdateOutputData()
+
+
+/**
+ * ******************* BeginSampleBatchContainer *******************
+ */
+
+template< class TInputImage >
+typename ImageSamplerBase< TInputImage >::ImageSampleBatchContainerType
+* ImageSamplerBase< TInputImage >
+::BeginSampleBatchContainer( const SizeValueType maximumNumberOfSamples )
+{
+  if( !this->m_GenerateSampleBatchContainer )
+  {
+    return 0;
+  }
+
+  this->m_SampleBatchContainer->SetNumberOfSamples( maximumNumberOfSamples );
+  this->m_SampleBatchContainerIsWritten = true;
+  return this->m_SampleBatchContainer.GetPointer();
+
+} // end BeginSampleBatchContainer()
+
+
+/**
+ * ******************* UpdateSampleBatchContainer *******************
+ */
+
+template< class TInputImage >
+void
+ImageSamplerBase< TInputImage >
+::UpdateSampleBatchContainer( void )
+{
+  if( !this->m_GenerateSampleBatchContainer )
+  {
+    this->m_SampleBatchContainer->Initialize();
+  }
+  else if( this->m_SampleBatchContainerIsWritten )
+  {
+    /** The samples were written while the output was generated. */
+    this->m_SampleBatchContainer->SetSampleContainer( this->GetOutput() );
+  }
+  else
+  {
+    /** Samplers that do not write the batch container themselves. */
+    this->m_SampleBatchContainer->CopyFrom( this->GetOutput() );
+  }
+  this->m_SampleBatchContainerIsWritten = false;
+
+} // end UpdateSampleBatchContainer()
+
+
 /**
  * ******************* PrintSelf *******************
  */
@@ -485,6 +596,7 @@ ImageSamplerBase< TInputImage >
     os << indent.GetNextIndent() << this->m_InputImageRegionVector[ i ] << std::endl;
   }
   os << indent << "CroppedInputImageRegion" << this->m_CroppedInputImageRegion << std::endl;
+  os << indent << "GenerateSampleBatchContainer: " << this->m_GenerateSampleBatchContainer << std::endl;
 
 } // end PrintSelf()
 
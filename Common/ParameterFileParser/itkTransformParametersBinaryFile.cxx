@@ -0,0 +1,419 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef __itkTransformParametersBinaryFile_cxx
+#define __itkTransformParametersBinaryFile_cxx
+
+#include "itkTransformParametersBinaryFile.h"
+#include "itkByteSwapper.h"
+
+#include <itksys/SystemTools.hxx>
+
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+
+/** The first bytes of the file. */
+const char MagicString[ 8 ] = { 'E', 'L', 'X', 'T', 'P', 'B', 'I', 'N' };
+
+/** Helpers to store unsigned integers little-endian, independent of the
+ * byte order of the system.
+ */
+void
+EncodeLittleEndian( char * buffer, unsigned long long value, const unsigned int numberOfBytes )
+{
+  for( unsigned int i = 0; i < numberOfBytes; ++i )
+  {
+    buffer[ i ] = static_cast< char >( value & 0xff );
+    value     >>= 8;
+  }
+} // end EncodeLittleEndian()
+
+
+unsigned long long
+DecodeLittleEndian( const char * buffer, const unsigned int numberOfBytes )
+{
+  unsigned long long value = 0;
+  for( unsigned int i = numberOfBytes; i > 0; --i )
+  {
+    value = ( value << 8 ) | static_cast< unsigned char >( buffer[ i - 1 ] );
+  }
+  return value;
+} // end DecodeLittleEndian()
+
+
+} // end namespace
+
+namespace itk
+{
+
+/**
+ * **************** Constructor ***************
+ */
+
+TransformParametersBinaryFile
+::TransformParametersBinaryFile()
+{
+  this->m_FileName           = "";
+  this->m_Parameters         = 0;
+  this->m_NumberOfParameters = 0;
+  this->m_IsMemoryMapped     = false;
+  this->m_MappedMemory       = 0;
+  this->m_MappedSize         = 0;
+  this->m_FileHandle         = 0;
+  this->m_MappingHandle      = 0;
+
+} // end Constructor()
+
+
+/**
+ * **************** Destructor ***************
+ */
+
+TransformParametersBinaryFile
+::~TransformParametersBinaryFile()
+{
+  this->Close();
+
+} // end Destructor()
+
+
+/**
+ * **************** IsBinaryFile ***************
+ */
+
+bool
+TransformParametersBinaryFile
+::IsBinaryFile( const std::string & fileName )
+{
+  std::ifstream file( fileName.c_str(), std::ios::in | std::ios::binary );
+  if( !file.is_open() )
+  {
+    return false;
+  }
+
+  char magic[ 8 ];
+  file.read( magic, 8 );
+  return file.good() && std::memcmp( magic, MagicString, 8 ) == 0;
+
+} // end IsBinaryFile()
+
+
+/**
+ * **************** Write ***************
+ */
+
+void
+TransformParametersBinaryFile
+::Write( const ValueType * parameters, const SizeValueType numberOfParameters ) const
+{
+  std::ofstream file( this->m_FileName.c_str(), std::ios::out | std::ios::binary );
+  if( !file.is_open() )
+  {
+    itkExceptionMacro( << "ERROR: could not open \"" << this->m_FileName << "\" for writing." );
+  }
+
+  /** Write the header. */
+  char header[ HeaderSize ];
+  std::memset( header, 0, HeaderSize );
+  std::memcpy( header, MagicString, 8 );
+  EncodeLittleEndian( header + 8, FormatVersion, 4 );
+  EncodeLittleEndian( header + 12, sizeof( ValueType ), 4 );
+  EncodeLittleEndian( header + 16, numberOfParameters, 8 );
+  EncodeLittleEndian( header + 24, HeaderSize, 8 );
+  file.write( header, HeaderSize );
+
+  /** Write the parameters, swapping them on big-endian systems. */
+  if( ByteSwapper< ValueType >::SystemIsLittleEndian() )
+  {
+    file.write( reinterpret_cast< const char * >( parameters ),
+      numberOfParameters * sizeof( ValueType ) );
+  }
+  else
+  {
+    std::vector< ValueType > swapped( parameters, parameters + numberOfParameters );
+    ByteSwapper< ValueType >::SwapRangeFromSystemToLittleEndian(
+      &swapped[ 0 ], static_cast< SizeValueType >( swapped.size() ) );
+    file.write( reinterpret_cast< const char * >( &swapped[ 0 ] ),
+      numberOfParameters * sizeof( ValueType ) );
+  }
+
+  if( !file.good() )
+  {
+    itkExceptionMacro( << "ERROR: could not write to \"" << this->m_FileName << "\"." );
+  }
+
+} // end Write()
+
+
+/**
+ * **************** ReadHeader ***************
+ */
+
+void
+TransformParametersBinaryFile
+::ReadHeader( const char * header, const SizeValueType fileSize,
+  SizeValueType & dataOffset )
+{
+  if( std::memcmp( header, MagicString, 8 ) != 0 )
+  {
+    itkExceptionMacro( << "ERROR: \"" << this->m_FileName
+                       << "\" is not a binary transform parameter file." );
+  }
+
+  const unsigned long long version   = DecodeLittleEndian( header + 8, 4 );
+  const unsigned long long valueSize = DecodeLittleEndian( header + 12, 4 );
+  if( version > FormatVersion )
+  {
+    itkExceptionMacro( << "ERROR: \"" << this->m_FileName << "\" has format version "
+                       << version << ", only versions up to " << FormatVersion << " are supported." );
+  }
+  if( valueSize != sizeof( ValueType ) )
+  {
+    itkExceptionMacro( << "ERROR: \"" << this->m_FileName << "\" stores parameters of "
+                       << valueSize << " bytes, expected " << sizeof( ValueType ) << "." );
+  }
+
+  const unsigned long long numberOfParameters = DecodeLittleEndian( header + 16, 8 );
+  const unsigned long long offset             = DecodeLittleEndian( header + 24, 8 );
+  if( offset < HeaderSize || offset % sizeof( ValueType ) != 0 || offset > fileSize
+    || numberOfParameters > ( fileSize - offset ) / sizeof( ValueType ) )
+  {
+    itkExceptionMacro( << "ERROR: \"" << this->m_FileName << "\" is truncated or corrupt: "
+                       << numberOfParameters << " parameters at offset " << offset
+                       << " do not fit in " << fileSize << " bytes." );
+  }
+
+  this->m_NumberOfParameters = static_cast< SizeValueType >( numberOfParameters );
+  dataOffset                 = static_cast< SizeValueType >( offset );
+
+} // end ReadHeader()
+
+
+/**
+ * **************** MapFile ***************
+ */
+
+bool
+TransformParametersBinaryFile
+::MapFile( SizeValueType & fileSize )
+{
+#ifdef _WIN32
+  HANDLE file = ::CreateFileA( this->m_FileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+    NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+  if( file == INVALID_HANDLE_VALUE )
+  {
+    return false;
+  }
+
+  LARGE_INTEGER size;
+  if( !::GetFileSizeEx( file, &size ) || size.QuadPart < HeaderSize )
+  {
+    ::CloseHandle( file );
+    return false;
+  }
+
+  /** A copy-on-write view, so that the parameters may be modified in memory. */
+  HANDLE mapping = ::CreateFileMappingA( file, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+  if( mapping == NULL )
+  {
+    ::CloseHandle( file );
+    return false;
+  }
+  void * memory = ::MapViewOfFile( mapping, FILE_MAP_COPY, 0, 0, 0 );
+  if( memory == NULL )
+  {
+    ::CloseHandle( mapping );
+    ::CloseHandle( file );
+    return false;
+  }
+
+  this->m_FileHandle    = file;
+  this->m_MappingHandle = mapping;
+  fileSize              = static_cast< SizeValueType >( size.QuadPart );
+#else
+  const int file = ::open( this->m_FileName.c_str(), O_RDONLY );
+  if( file < 0 )
+  {
+    return false;
+  }
+
+  struct stat status;
+  if( ::fstat( file, &status ) != 0 || status.st_size < static_cast< off_t >( HeaderSize ) )
+  {
+    ::close( file );
+    return false;
+  }
+
+  /** A private mapping is copy-on-write, so that the parameters may be
+   * modified in memory without changing the file. The mapping stays valid
+   * after the file is closed.
+   */
+  void * memory = ::mmap( 0, static_cast< std::size_t >( status.st_size ),
+    PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0 );
+  ::close( file );
+  if( memory == MAP_FAILED )
+  {
+    return false;
+  }
+  fileSize = static_cast< SizeValueType >( status.st_size );
+#endif
+
+  this->m_MappedMemory = memory;
+  this->m_MappedSize   = fileSize;
+  return true;
+
+} // end MapFile()
+
+
+/**
+ * **************** Read ***************
+ */
+
+void
+TransformParametersBinaryFile
+::Read( void )
+{
+  this->Close();
+
+  if( !itksys::SystemTools::FileExists( this->m_FileName.c_str(), true ) )
+  {
+    itkExceptionMacro( << "ERROR: the file \"" << this->m_FileName << "\" does not exist." );
+  }
+
+  /** Map the file, if the parameters can be used as stored. */
+  SizeValueType fileSize   = 0;
+  SizeValueType dataOffset = 0;
+  if( ByteSwapper< ValueType >::SystemIsLittleEndian() && this->MapFile( fileSize ) )
+  {
+    try
+    {
+      this->ReadHeader( static_cast< const char * >( this->m_MappedMemory ), fileSize, dataOffset );
+    }
+    catch( ExceptionObject & )
+    {
+      this->Close();
+      throw;
+    }
+    this->m_Parameters = reinterpret_cast< const ValueType * >(
+      static_cast< const char * >( this->m_MappedMemory ) + dataOffset );
+    this->m_IsMemoryMapped = true;
+    return;
+  }
+
+  /** Otherwise read the parameters into a buffer. */
+  std::ifstream file( this->m_FileName.c_str(), std::ios::in | std::ios::binary );
+  if( !file.is_open() )
+  {
+    itkExceptionMacro( << "ERROR: could not open \"" << this->m_FileName << "\" for reading." );
+  }
+  file.seekg( 0, std::ios::end );
+  fileSize = static_cast< SizeValueType >( file.tellg() );
+  file.seekg( 0, std::ios::beg );
+
+  char header[ HeaderSize ];
+  if( fileSize < HeaderSize || !file.read( header, HeaderSize ) )
+  {
+    itkExceptionMacro( << "ERROR: \"" << this->m_FileName
+                       << "\" is too small to be a binary transform parameter file." );
+  }
+  this->ReadHeader( header, fileSize, dataOffset );
+
+  this->m_Buffer.resize( this->m_NumberOfParameters );
+  if( this->m_NumberOfParameters > 0 )
+  {
+    file.seekg( static_cast< std::streamoff >( dataOffset ), std::ios::beg );
+    file.read( reinterpret_cast< char * >( &this->m_Buffer[ 0 ] ),
+      this->m_NumberOfParameters * sizeof( ValueType ) );
+    if( !file.good() )
+    {
+      itkExceptionMacro( << "ERROR: could not read the parameters from \"" << this->m_FileName << "\"." );
+    }
+    ByteSwapper< ValueType >::SwapRangeFromSystemToLittleEndian(
+      &this->m_Buffer[ 0 ], this->m_NumberOfParameters );
+  }
+  this->m_Parameters = this->m_Buffer.empty() ? 0 : &this->m_Buffer[ 0 ];
+
+} // end Read()
+
+
+/**
+ * **************** Close ***************
+ */
+
+void
+TransformParametersBinaryFile
+::Close( void )
+{
+  if( this->m_MappedMemory != 0 )
+  {
+#ifdef _WIN32
+    ::UnmapViewOfFile( this->m_MappedMemory );
+    ::CloseHandle( static_cast< HANDLE >( this->m_MappingHandle ) );
+    ::CloseHandle( static_cast< HANDLE >( this->m_FileHandle ) );
+#else
+    ::munmap( this->m_MappedMemory, static_cast< std::size_t >( this->m_MappedSize ) );
+#endif
+  }
+  this->m_MappedMemory  = 0;
+  this->m_MappedSize    = 0;
+  this->m_FileHandle    = 0;
+  this->m_MappingHandle = 0;
+
+  std::vector< ValueType >().swap( this->m_Buffer );
+  this->m_Parameters         = 0;
+  this->m_NumberOfParameters = 0;
+  this->m_IsMemoryMapped     = false;
+
+} // end Close()
+
+
+/**
+ * **************** PrintSelf ***************
+ */
+
+void
+TransformParametersBinaryFile
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "FileName: " << this->m_FileName << std::endl;
+  os << indent << "NumberOfParameters: " << this->m_NumberOfParameters << std::endl;
+  os << indent << "IsMemoryMapped: " << this->m_IsMemoryMapped << std::endl;
+
+} // end PrintSelf()
+
+
+} // end namespace itk
+
+#endif // end __itkTransformParametersBinaryFile_cxx
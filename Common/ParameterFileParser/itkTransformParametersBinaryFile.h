@@ -0,0 +1,160 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkTransformParametersBinaryFile_h
+#define __itkTransformParametersBinaryFile_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkMacro.h"
+#include "itkIntTypes.h"
+
+#include <string>
+#include <vector>
+
+namespace itk
+{
+
+/** \class TransformParametersBinaryFile
+ *
+ * \brief Reads and writes transform parameters in a binary file.
+ *
+ * Writing a large parameter vector, such as the coefficients of a B-spline
+ * transform, as text in the transform parameter file, and parsing it again,
+ * is slow. With this class the parameters are stored in a separate binary
+ * file, which the transform parameter file refers to:\n
+ * (TransformParameters "TransformParameters.0.txt.dat")\n
+ * (UseBinaryFormatForTransformationParameters "true")\n
+ *
+ * The file consists of a header of HeaderSize bytes, followed by the
+ * parameters as IEEE 754 doubles. All numbers are stored little-endian.
+ * The header contains:\n
+ * - bytes 0-7: the characters "ELXTPBIN",\n
+ * - bytes 8-11: the format version (uint32),\n
+ * - bytes 12-15: the size of a parameter in bytes, 8 (uint32),\n
+ * - bytes 16-23: the number of parameters (uint64),\n
+ * - bytes 24-31: the offset of the parameters in the file (uint64),\n
+ * - bytes 32-63: reserved, zero.\n
+ *
+ * Read() maps the file into memory, copy-on-write, so the parameters are
+ * not copied. GetParameters() points into the mapping, and stays valid
+ * until Close() is called or the object is destroyed. If the file cannot
+ * be mapped, or the system is big-endian, the parameters are read into a
+ * buffer instead.
+ *
+ * Files written by older versions, without a header, are not recognized
+ * by IsBinaryFile(); see elastix::TransformBase::ReadFromFile().
+ *
+ * \sa itk::ParameterFileParser
+ */
+
+class TransformParametersBinaryFile : public Object
+{
+public:
+
+  /** Standard ITK typedefs. */
+  typedef TransformParametersBinaryFile Self;
+  typedef Object                        Superclass;
+  typedef SmartPointer< Self >          Pointer;
+  typedef SmartPointer< const Self >    ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( TransformParametersBinaryFile, Object );
+
+  /** The type of the parameters. */
+  typedef double ValueType;
+
+  /** The version of the format that is written. */
+  itkStaticConstMacro( FormatVersion, unsigned int, 1 );
+
+  /** The size of the header in bytes. The parameters follow the header,
+   * so that they are aligned in memory when the file is mapped.
+   */
+  itkStaticConstMacro( HeaderSize, unsigned int, 64 );
+
+  /** Set the name of the binary file. */
+  itkSetStringMacro( FileName );
+  itkGetStringMacro( FileName );
+
+  /** Write the parameters to the file. */
+  void Write( const ValueType * parameters, const SizeValueType numberOfParameters ) const;
+
+  /** Read the header and map the parameters into memory. Throws an
+   * exception if the file cannot be opened or is not a valid file.
+   */
+  void Read( void );
+
+  /** Release the memory of the parameters. */
+  void Close( void );
+
+  /** Get the parameters. Only valid after Read(). */
+  const ValueType * GetParameters( void ) const
+  {
+    return this->m_Parameters;
+  }
+
+
+  /** Get the number of parameters. Only valid after Read(). */
+  itkGetConstMacro( NumberOfParameters, SizeValueType );
+
+  /** Whether the parameters point into a memory mapping of the file. */
+  itkGetConstMacro( IsMemoryMapped, bool );
+
+  /** Check whether the file starts with the header of this format. */
+  static bool IsBinaryFile( const std::string & fileName );
+
+protected:
+
+  TransformParametersBinaryFile();
+  virtual ~TransformParametersBinaryFile();
+
+  /** PrintSelf. */
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+private:
+
+  TransformParametersBinaryFile( const Self & ); // purposely not implemented
+  void operator=( const Self & );                // purposely not implemented
+
+  /** Map the whole file into memory. Returns false on failure. */
+  bool MapFile( SizeValueType & fileSize );
+
+  /** Check the header, and get the number of parameters and their offset. */
+  void ReadHeader( const char * header, const SizeValueType fileSize,
+    SizeValueType & dataOffset );
+
+  /** Member variables. */
+  std::string              m_FileName;
+  const ValueType *        m_Parameters;
+  SizeValueType            m_NumberOfParameters;
+  bool                     m_IsMemoryMapped;
+  std::vector< ValueType > m_Buffer;
+
+  /** The memory mapping. The handles are only used on Windows. */
+  void *        m_MappedMemory;
+  SizeValueType m_MappedSize;
+  void *        m_FileHandle;
+  void *        m_MappingHandle;
+
+};
+
+} // end of namespace itk
+
+#endif // end __itkTransformParametersBinaryFile_h
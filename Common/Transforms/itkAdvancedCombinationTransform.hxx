@@ -1652,6 +1652,108 @@ AdvancedCombinationTransform< TScalarType, NDimensions >
 } // end EvaluateJacobianWithImageGradientProduct()
 
 
+/**
+ * ****************** TransformPoints ****************************
+ */
+
+template< typename TScalarType, unsigned int NDimensions >
+void
+AdvancedCombinationTransform< TScalarType, NDimensions >
+::TransformPoints(
+  const InputPointType * inputPoints,
+  OutputPointType * outputPoints,
+  const unsigned int numberOfPoints ) const
+{
+  if( this->m_CurrentTransform.IsNull() )
+  {
+    this->NoCurrentTransformSet();
+  }
+  else if( this->m_InitialTransform.IsNull() )
+  {
+    this->m_CurrentTransform->TransformPoints( inputPoints, outputPoints, numberOfPoints );
+  }
+  else if( this->m_UseAddition )
+  {
+    /** T(x) = T_0(x) + T_1(x) - x. Keep a copy of x, since the input and
+     * output array may be the same.
+     */
+    const unsigned int blockSize = 16;
+    InputPointType     points[ blockSize ];
+    for( unsigned int b = 0; b < numberOfPoints; b += blockSize )
+    {
+      const unsigned int n = ( numberOfPoints - b < blockSize ) ? numberOfPoints - b : blockSize;
+      for( unsigned int i = 0; i < n; ++i )
+      {
+        points[ i ] = inputPoints[ b + i ];
+      }
+      this->m_CurrentTransform->TransformPoints( points, outputPoints + b, n );
+      for( unsigned int i = 0; i < n; ++i )
+      {
+        const OutputPointType out0 = this->m_InitialTransform->TransformPoint( points[ i ] );
+        for( unsigned int d = 0; d < SpaceDimension; ++d )
+        {
+          outputPoints[ b + i ][ d ] += ( out0[ d ] - points[ i ][ d ] );
+        }
+      }
+    }
+  }
+  else
+  {
+    /** T(x) = T_1( T_0(x) ). */
+    for( unsigned int i = 0; i < numberOfPoints; ++i )
+    {
+      outputPoints[ i ] = this->m_InitialTransform->TransformPoint( inputPoints[ i ] );
+    }
+    this->m_CurrentTransform->TransformPoints( outputPoints, outputPoints, numberOfPoints );
+  }
+
+} // end TransformPoints()
+
+
+/**
+ * ****************** EvaluateJacobianWithImageGradientProducts ****************************
+ */
+
+template< typename TScalarType, unsigned int NDimensions >
+void
+AdvancedCombinationTransform< TScalarType, NDimensions >
+::EvaluateJacobianWithImageGradientProducts(
+  const InputPointType * inputPoints,
+  const MovingImageGradientType * movingImageGradients,
+  DerivativeType * imageJacobians,
+  NonZeroJacobianIndicesType * nonZeroJacobianIndices,
+  const unsigned int numberOfPoints ) const
+{
+  if( this->m_CurrentTransform.IsNull() )
+  {
+    this->NoCurrentTransformSet();
+  }
+  else if( this->m_InitialTransform.IsNull() || this->m_UseAddition )
+  {
+    /** J(x) = J_1(x) */
+    this->m_CurrentTransform->EvaluateJacobianWithImageGradientProducts(
+      inputPoints, movingImageGradients, imageJacobians, nonZeroJacobianIndices, numberOfPoints );
+  }
+  else
+  {
+    /** J(x) = J_1( T_0(x) ), evaluated in blocks to avoid a heap allocation. */
+    const unsigned int blockSize = 16;
+    InputPointType     mappedPoints[ blockSize ];
+    for( unsigned int b = 0; b < numberOfPoints; b += blockSize )
+    {
+      const unsigned int n = ( numberOfPoints - b < blockSize ) ? numberOfPoints - b : blockSize;
+      for( unsigned int i = 0; i < n; ++i )
+      {
+        mappedPoints[ i ] = this->m_InitialTransform->TransformPoint( inputPoints[ b + i ] );
+      }
+      this->m_CurrentTransform->EvaluateJacobianWithImageGradientProducts( mappedPoints,
+        movingImageGradients + b, imageJacobians + b, nonZeroJacobianIndices + b, n );
+    }
+  }
+
+} // end EvaluateJacobianWithImageGradientProducts()
+
+
 /**
  * ****************** GetSpatialJacobian ****************************
  */
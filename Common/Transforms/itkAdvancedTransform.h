@@ -206,6 +206,28 @@ public:
     DerivativeType & imageJacobian,
     NonZeroJacobianIndicesType & nonZeroJacobianIndices ) const;
 
+  /** Transform a batch of points. The default implementation calls
+   * TransformPoint() for each point; the recursive B-spline transform
+   * overrides it with a vectorized version. The input and output arrays
+   * may be the same array.
+   */
+  virtual void TransformPoints(
+    const InputPointType * inputPoints,
+    OutputPointType * outputPoints,
+    const unsigned int numberOfPoints ) const;
+
+  /** Batched version of EvaluateJacobianWithImageGradientProduct().
+   * The image Jacobians and nonzero Jacobian indices of point i are stored
+   * in imageJacobians[ i ] and nonZeroJacobianIndices[ i ], which should
+   * have the size GetNumberOfNonZeroJacobianIndices().
+   */
+  virtual void EvaluateJacobianWithImageGradientProducts(
+    const InputPointType * inputPoints,
+    const MovingImageGradientType * movingImageGradients,
+    DerivativeType * imageJacobians,
+    NonZeroJacobianIndicesType * nonZeroJacobianIndices,
+    const unsigned int numberOfPoints ) const;
+
   /** Compute the spatial Jacobian of the transformation.
    *
    * The spatial Jacobian is expressed as a vector of partial derivatives of the
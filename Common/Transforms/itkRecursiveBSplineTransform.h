@@ -148,6 +148,22 @@ public:
     DerivativeType & imageJacobian,
     NonZeroJacobianIndicesType & nonZeroJacobianIndices ) const;
 
+  /** Transform a batch of points. The points are processed in groups of
+   * RecursiveBSplineBatchVector::Size, using SIMD instructions if available.
+   */
+  virtual void TransformPoints(
+    const InputPointType * inputPoints,
+    OutputPointType * outputPoints,
+    const unsigned int numberOfPoints ) const;
+
+  /** Batched version of EvaluateJacobianWithImageGradientProduct(). */
+  virtual void EvaluateJacobianWithImageGradientProducts(
+    const InputPointType * inputPoints,
+    const MovingImageGradientType * movingImageGradients,
+    DerivativeType * imageJacobians,
+    NonZeroJacobianIndicesType * nonZeroJacobianIndices,
+    const unsigned int numberOfPoints ) const;
+
   /** Compute the spatial Jacobian of the transformation. */
   virtual void GetSpatialJacobian(
     const InputPointType & ipp,
@@ -198,6 +214,18 @@ protected:
 
   typename RecursiveBSplineWeightFunctionType::Pointer m_RecursiveBSplineWeightFunction;
 
+  /** Compute the weights of a batch of points, in the layout used by
+   * RecursiveBSplineTransformBatchImplementation. For each point the offset
+   * to the start of its support region is returned; points beyond
+   * numberOfPoints and points outside the valid region get zero weights.
+   */
+  void ComputeBatchWeights(
+    const InputPointType * inputPoints,
+    const unsigned int numberOfPoints,
+    double * weights1D,
+    OffsetValueType * offsets,
+    bool * inside ) const;
+
   /** Compute the nonzero Jacobian indices. */
   virtual void ComputeNonZeroJacobianIndices(
     NonZeroJacobianIndicesType & nonZeroJacobianIndices,
@@ -21,6 +21,7 @@
 #include "itkRecursiveBSplineTransform.h"
 
 #include "itkRecursiveBSplineTransformImplementation.h"
+#include "itkRecursiveBSplineTransformBatchImplementation.h"
 
 
 namespace itk
@@ -250,6 +251,237 @@ RecursiveBSplineTransform< TScalar, NDimensions, VSplineOrder >
 } // end EvaluateJacobianWithImageGradientProduct()
 
 
+/**
+ * ********************* ComputeBatchWeights ****************************
+ */
+
+template< class TScalar, unsigned int NDimensions, unsigned int VSplineOrder >
+void
+RecursiveBSplineTransform< TScalar, NDimensions, VSplineOrder >
+::ComputeBatchWeights(
+  const InputPointType * inputPoints,
+  const unsigned int numberOfPoints,
+  double * weights1D,
+  OffsetValueType * offsets,
+  bool * inside ) const
+{
+  typedef RecursiveBSplineBatchVector                 BatchVectorType;
+  typedef RecursiveBSplineBatchWeights< SplineOrder > BatchWeightsType;
+  const unsigned int      batchSize          = BatchVectorType::Size;
+  const OffsetValueType * bsplineOffsetTable = this->m_CoefficientImages[ 0 ]->GetOffsetTable();
+
+  /** Compute the start of the support region and the distance to it, per point.
+   * This is the same computation as in RecursiveBSplineInterpolationWeightFunction.
+   */
+  double x[ SpaceDimension * batchSize ];
+  for( unsigned int p = 0; p < batchSize; ++p )
+  {
+    offsets[ p ] = 0;
+    inside[ p ]  = false;
+    if( p < numberOfPoints )
+    {
+      ContinuousIndexType cindex;
+      this->TransformPointToContinuousGridIndex( inputPoints[ p ], cindex );
+      inside[ p ] = this->InsideValidRegion( cindex );
+      if( inside[ p ] )
+      {
+        for( unsigned int d = 0; d < SpaceDimension; ++d )
+        {
+          const OffsetValueType startIndex
+            = Math::Floor< IndexValueType >( cindex[ d ] + 0.5 - SplineOrder / 2.0 );
+          x[ d * batchSize + p ] = cindex[ d ] - static_cast< double >( startIndex );
+          offsets[ p ]          += startIndex * bsplineOffsetTable[ d ];
+        }
+      }
+    }
+
+    /** Dummy distance for invalid points; their weights are zeroed below. */
+    if( !inside[ p ] )
+    {
+      for( unsigned int d = 0; d < SpaceDimension; ++d )
+      {
+        x[ d * batchSize + p ] = 0.5 * ( SplineOrder + 1 );
+      }
+    }
+  }
+
+  /** Compute the weights, per dimension for the whole batch. */
+  for( unsigned int d = 0; d < SpaceDimension; ++d )
+  {
+    BatchWeightsType::Evaluate( this->m_Kernel.GetPointer(),
+      x + d * batchSize, weights1D + d * ( SplineOrder + 1 ) * batchSize );
+  }
+
+  /** Invalid points get zero weights, so zero displacement and Jacobian. */
+  for( unsigned int p = 0; p < batchSize; ++p )
+  {
+    if( !inside[ p ] )
+    {
+      for( unsigned int i = 0; i < SpaceDimension * ( SplineOrder + 1 ); ++i )
+      {
+        weights1D[ i * batchSize + p ] = 0.0;
+      }
+    }
+  }
+
+} // end ComputeBatchWeights()
+
+
+/**
+ * ********************* TransformPoints ****************************
+ */
+
+template< class TScalar, unsigned int NDimensions, unsigned int VSplineOrder >
+void
+RecursiveBSplineTransform< TScalar, NDimensions, VSplineOrder >
+::TransformPoints(
+  const InputPointType * inputPoints,
+  OutputPointType * outputPoints,
+  const unsigned int numberOfPoints ) const
+{
+  /** Check if the coefficient image has been set. */
+  if( !this->m_CoefficientImages[ 0 ] )
+  {
+    Superclass::TransformPoints( inputPoints, outputPoints, numberOfPoints );
+    return;
+  }
+
+  typedef RecursiveBSplineTransformBatchImplementation<
+    SpaceDimension, SpaceDimension, SplineOrder, TScalar > BatchImplementationType;
+  const unsigned int batchSize       = RecursiveBSplineBatchVector::Size;
+  const unsigned int numberOfWeights = RecursiveBSplineWeightFunctionType::NumberOfWeights;
+
+  /** Initialize (helper) variables. */
+  const OffsetValueType * bsplineOffsetTable = this->m_CoefficientImages[ 0 ]->GetOffsetTable();
+  const ScalarType *      coefficients[ SpaceDimension ];
+  for( unsigned int j = 0; j < SpaceDimension; ++j )
+  {
+    coefficients[ j ] = this->m_CoefficientImages[ j ]->GetBufferPointer();
+  }
+
+  double          weightsArray1D[ numberOfWeights * batchSize ];
+  double          displacements[ SpaceDimension * batchSize ];
+  OffsetValueType offsets[ batchSize ];
+  bool            inside[ batchSize ];
+
+  for( unsigned int b = 0; b < numberOfPoints; b += batchSize )
+  {
+    const unsigned int n = ( numberOfPoints - b < batchSize ) ? numberOfPoints - b : batchSize;
+
+    /** Compute the weights and call the recursive batched TransformPoint function. */
+    this->ComputeBatchWeights( inputPoints + b, n, weightsArray1D, offsets, inside );
+    BatchImplementationType::TransformPoint( displacements, coefficients,
+      offsets, bsplineOffsetTable, weightsArray1D );
+
+    /** The output point is the start point + displacement, which is zero
+     * for points outside the valid region.
+     */
+    for( unsigned int p = 0; p < n; ++p )
+    {
+      for( unsigned int j = 0; j < SpaceDimension; ++j )
+      {
+        outputPoints[ b + p ][ j ] = inputPoints[ b + p ][ j ] + displacements[ j * batchSize + p ];
+      }
+    }
+  }
+
+} // end TransformPoints()
+
+
+/**
+ * ********************* EvaluateJacobianWithImageGradientProducts ****************************
+ */
+
+template< class TScalar, unsigned int NDimensions, unsigned int VSplineOrder >
+void
+RecursiveBSplineTransform< TScalar, NDimensions, VSplineOrder >
+::EvaluateJacobianWithImageGradientProducts(
+  const InputPointType * inputPoints,
+  const MovingImageGradientType * movingImageGradients,
+  DerivativeType * imageJacobians,
+  NonZeroJacobianIndicesType * nonZeroJacobianIndices,
+  const unsigned int numberOfPoints ) const
+{
+  /** Check if the coefficient image has been set. */
+  if( !this->m_CoefficientImages[ 0 ] )
+  {
+    Superclass::EvaluateJacobianWithImageGradientProducts( inputPoints, movingImageGradients,
+      imageJacobians, nonZeroJacobianIndices, numberOfPoints );
+    return;
+  }
+
+  typedef RecursiveBSplineTransformBatchImplementation<
+    SpaceDimension, SpaceDimension, SplineOrder, TScalar > BatchImplementationType;
+  const unsigned int batchSize       = RecursiveBSplineBatchVector::Size;
+  const unsigned int numberOfWeights = RecursiveBSplineWeightFunctionType::NumberOfWeights;
+  const unsigned int numberOfIndices = RecursiveBSplineWeightFunctionType::NumberOfIndices;
+  const unsigned int nnzji           = SpaceDimension * numberOfIndices;
+
+  const OffsetValueType * bsplineOffsetTable = this->m_CoefficientImages[ 0 ]->GetOffsetTable();
+  const unsigned long     parametersPerDim   = this->GetNumberOfParametersPerDimension();
+
+  double          weightsArray1D[ numberOfWeights * batchSize ];
+  double          migArray[ SpaceDimension * batchSize ];
+  double          imageJacobianArray[ nnzji * batchSize ];
+  double          ones[ batchSize ];
+  OffsetValueType offsets[ batchSize ];
+  bool            inside[ batchSize ];
+  for( unsigned int p = 0; p < batchSize; ++p )
+  {
+    ones[ p ] = 1.0;
+  }
+
+  for( unsigned int b = 0; b < numberOfPoints; b += batchSize )
+  {
+    const unsigned int n = ( numberOfPoints - b < batchSize ) ? numberOfPoints - b : batchSize;
+
+    /** Compute the weights, and store the moving image gradients per dimension. */
+    this->ComputeBatchWeights( inputPoints + b, n, weightsArray1D, offsets, inside );
+    for( unsigned int p = 0; p < batchSize; ++p )
+    {
+      for( unsigned int j = 0; j < SpaceDimension; ++j )
+      {
+        migArray[ j * batchSize + p ] = ( p < n ) ? movingImageGradients[ b + p ][ j ] : 0.0;
+      }
+    }
+
+    /** Recursively compute the inner products of the Jacobian and the moving image gradient.
+     * The pointer has changed after this function call.
+     */
+    double * imageJacobianPointer = imageJacobianArray;
+    BatchImplementationType::EvaluateJacobianWithImageGradientProduct(
+      imageJacobianPointer, migArray, weightsArray1D, ones );
+
+    /** Copy the results to the output, and compute the nonzero Jacobian indices. */
+    for( unsigned int p = 0; p < n; ++p )
+    {
+      ParametersValueType * imageJacobian = imageJacobians[ b + p ].data_block();
+      for( unsigned int mu = 0; mu < nnzji; ++mu )
+      {
+        imageJacobian[ mu ] = imageJacobianArray[ mu * batchSize + p ];
+      }
+
+      NonZeroJacobianIndicesType & nzji = nonZeroJacobianIndices[ b + p ];
+      nzji.resize( nnzji );
+      if( inside[ p ] )
+      {
+        unsigned long * nzjiPointer = &nzji[ 0 ];
+        RecursiveBSplineTransformImplementation< SpaceDimension, SpaceDimension, SplineOrder, TScalar >
+          ::ComputeNonZeroJacobianIndices( nzjiPointer, parametersPerDim, offsets[ p ], bsplineOffsetTable );
+      }
+      else
+      {
+        for( unsigned int mu = 0; mu < nnzji; ++mu )
+        {
+          nzji[ mu ] = mu;
+        }
+      }
+    }
+  }
+
+} // end EvaluateJacobianWithImageGradientProducts()
+
+
 /**
  * ********************* GetSpatialJacobian ****************************
  */
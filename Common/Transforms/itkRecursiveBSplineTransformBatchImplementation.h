@@ -0,0 +1,345 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkRecursiveBSplineTransformBatchImplementation_h
+#define __itkRecursiveBSplineTransformBatchImplementation_h
+
+#include "itkRecursiveBSplineInterpolationWeightFunction.h"
+
+#if defined( __AVX512F__ ) || ( defined( __AVX2__ ) && defined( __FMA__ ) )
+#include <immintrin.h>
+#endif
+
+namespace itk
+{
+
+/** \class RecursiveBSplineBatchVector
+ *
+ * \brief Element-wise operations on a batch of doubles, one per point.
+ *
+ * The batched B-spline functions store all quantities in a
+ * structure-of-arrays layout: element p of a batch vector belongs to
+ * point p of the batch. The operations below are implemented with AVX-512
+ * or AVX2/FMA intrinsics when the compiler targets these instruction sets
+ * (see the CMake variable ELASTIX_SIMD_INSTRUCTION_SET), and with plain
+ * loops otherwise.
+ *
+ * \ingroup ITKTransform
+ */
+
+class RecursiveBSplineBatchVector
+{
+public:
+
+  /** The number of points in a batch. */
+#if defined( __AVX512F__ )
+  itkStaticConstMacro( Size, unsigned int, 8 );
+#else
+  itkStaticConstMacro( Size, unsigned int, 4 );
+#endif
+
+  /** out = a * b */
+  static inline void Multiply( double * out, const double * a, const double * b )
+  {
+#if defined( __AVX512F__ )
+    _mm512_storeu_pd( out, _mm512_mul_pd( _mm512_loadu_pd( a ), _mm512_loadu_pd( b ) ) );
+#elif defined( __AVX2__ ) && defined( __FMA__ )
+    _mm256_storeu_pd( out, _mm256_mul_pd( _mm256_loadu_pd( a ), _mm256_loadu_pd( b ) ) );
+#else
+    for( unsigned int p = 0; p < Size; ++p )
+    {
+      out[ p ] = a[ p ] * b[ p ];
+    }
+#endif
+  } // end Multiply()
+
+
+  /** acc += a * b */
+  static inline void MultiplyAdd( double * acc, const double * a, const double * b )
+  {
+#if defined( __AVX512F__ )
+    _mm512_storeu_pd( acc, _mm512_fmadd_pd(
+      _mm512_loadu_pd( a ), _mm512_loadu_pd( b ), _mm512_loadu_pd( acc ) ) );
+#elif defined( __AVX2__ ) && defined( __FMA__ )
+    _mm256_storeu_pd( acc, _mm256_fmadd_pd(
+      _mm256_loadu_pd( a ), _mm256_loadu_pd( b ), _mm256_loadu_pd( acc ) ) );
+#else
+    for( unsigned int p = 0; p < Size; ++p )
+    {
+      acc[ p ] += a[ p ] * b[ p ];
+    }
+#endif
+  } // end MultiplyAdd()
+
+
+  /** out[ p ] = base[ offsets[ p ] ], for double coefficients. */
+  static inline void Gather( double * out, const double * base, const OffsetValueType * offsets )
+  {
+#if defined( __AVX512F__ )
+    if( sizeof( OffsetValueType ) == 8 )
+    {
+      const __m512i vindex = _mm512_loadu_si512( reinterpret_cast< const void * >( offsets ) );
+      _mm512_storeu_pd( out, _mm512_mask_i64gather_pd(
+        _mm512_setzero_pd(), 0xFF, vindex, base, 8 ) );
+      return;
+    }
+#elif defined( __AVX2__ ) && defined( __FMA__ )
+    if( sizeof( OffsetValueType ) == 8 )
+    {
+      const __m256i vindex = _mm256_loadu_si256( reinterpret_cast< const __m256i * >( offsets ) );
+      _mm256_storeu_pd( out, _mm256_i64gather_pd( base, vindex, 8 ) );
+      return;
+    }
+#endif
+    for( unsigned int p = 0; p < Size; ++p )
+    {
+      out[ p ] = base[ offsets[ p ] ];
+    }
+  } // end Gather()
+
+
+  /** out[ p ] = base[ offsets[ p ] ], for float coefficients. */
+  static inline void Gather( double * out, const float * base, const OffsetValueType * offsets )
+  {
+    for( unsigned int p = 0; p < Size; ++p )
+    {
+      out[ p ] = static_cast< double >( base[ offsets[ p ] ] );
+    }
+  } // end Gather()
+
+
+};
+
+
+/** \class RecursiveBSplineBatchWeights
+ *
+ * \brief Computes the 1D B-spline weights of a batch of points.
+ *
+ * The input x holds, for a single dimension, the distance of each point
+ * to the start of its support region. On return, the weight k of point p
+ * is stored in weights[ k * Size + p ]. The generic version calls the
+ * kernel for each point; the cubic version is vectorized.
+ *
+ * \ingroup ITKTransform
+ */
+
+template< unsigned int SplineOrder >
+class RecursiveBSplineBatchWeights
+{
+public:
+
+  typedef RecursiveBSplineBatchVector VectorType;
+
+  template< class TKernel >
+  static inline void Evaluate( const TKernel * kernel, const double * x, double * weights )
+  {
+    double tmp[ SplineOrder + 1 ];
+    for( unsigned int p = 0; p < VectorType::Size; ++p )
+    {
+      kernel->Evaluate( x[ p ], tmp );
+      for( unsigned int k = 0; k <= SplineOrder; ++k )
+      {
+        weights[ k * VectorType::Size + p ] = tmp[ k ];
+      }
+    }
+  } // end Evaluate()
+
+
+};
+
+template< >
+class RecursiveBSplineBatchWeights< 3 >
+{
+public:
+
+  typedef RecursiveBSplineBatchVector VectorType;
+
+  /** Same polynomials as BSplineKernelFunction2< 3 >, where x lies in [1,2). */
+  template< class TKernel >
+  static inline void Evaluate( const TKernel *, const double * x, double * weights )
+  {
+    static const double onesixth = 1.0 / 6.0;
+    double * w0 = weights;
+    double * w1 = weights + VectorType::Size;
+    double * w2 = weights + 2 * VectorType::Size;
+    double * w3 = weights + 3 * VectorType::Size;
+    for( unsigned int p = 0; p < VectorType::Size; ++p )
+    {
+      const double u   = x[ p ];
+      const double uu  = u * u;
+      const double uuu = uu * u;
+      w0[ p ] = (  8.0 - 12.0 * u +  6.0 * uu -       uuu ) * onesixth;
+      w1[ p ] = ( -5.0 + 21.0 * u - 15.0 * uu + 3.0 * uuu ) * onesixth;
+      w2[ p ] = (  4.0 - 12.0 * u + 12.0 * uu - 3.0 * uuu ) * onesixth;
+      w3[ p ] = ( -1.0 +  3.0 * u -  3.0 * uu +       uuu ) * onesixth;
+    }
+  } // end Evaluate()
+
+
+};
+
+
+/** \class RecursiveBSplineTransformBatchImplementation
+ *
+ * \brief Batched version of RecursiveBSplineTransformImplementation.
+ *
+ * The functions of this class process RecursiveBSplineBatchVector::Size
+ * points at once. All arrays use a structure-of-arrays layout:
+ * - the 1D weights of point p are stored in
+ *   weights1D[ ( d * ( SplineOrder + 1 ) + k ) * BatchSize + p ],
+ * - the output of TransformPoint in opp[ j * BatchSize + p ],
+ * - the moving image gradient in movingImageGradient[ j * BatchSize + p ],
+ * - the image Jacobian in imageJacobian[ ( j * NumberOfIndices + i ) * BatchSize + p ].
+ * The offsets point to the first coefficient of the support region of each
+ * point. Points that are not valid should get zero weights and a valid offset.
+ *
+ * \ingroup ITKTransform
+ */
+
+template< unsigned int OutputDimension, unsigned int SpaceDimension, unsigned int SplineOrder, class TScalar >
+class RecursiveBSplineTransformBatchImplementation
+{
+public:
+
+  typedef TScalar                     ScalarType;
+  typedef RecursiveBSplineBatchVector VectorType;
+
+  itkStaticConstMacro( BatchSize, unsigned int, VectorType::Size );
+
+  /** Helper constant variable. */
+  itkStaticConstMacro( HelperConstVariable, unsigned int,
+    ( SpaceDimension - 1 ) * ( SplineOrder + 1 ) );
+
+  /** TransformPoint recursive implementation. */
+  static inline void TransformPoint(
+    double * opp, const ScalarType * const * coefficients,
+    const OffsetValueType * offsets,
+    const OffsetValueType * gridOffsetTable,
+    const double * weights1D )
+  {
+    /** Make a copy of the offsets. They will move later. */
+    OffsetValueType tmp_offsets[ BatchSize ];
+    for( unsigned int p = 0; p < BatchSize; ++p )
+    {
+      tmp_offsets[ p ] = offsets[ p ];
+    }
+
+    /** Create a temporary opp and initialize the original. */
+    double tmp_opp[ OutputDimension * BatchSize ];
+    for( unsigned int n = 0; n < OutputDimension * BatchSize; ++n )
+    {
+      opp[ n ] = 0.0;
+    }
+
+    const OffsetValueType bot = gridOffsetTable[ SpaceDimension - 1 ];
+    for( unsigned int k = 0; k <= SplineOrder; ++k )
+    {
+      /** Recurse. */
+      RecursiveBSplineTransformBatchImplementation< OutputDimension, SpaceDimension - 1, SplineOrder, TScalar >
+        ::TransformPoint( tmp_opp, coefficients, tmp_offsets, gridOffsetTable, weights1D );
+
+      /** Accumulate the weights. */
+      const double * w = weights1D + ( k + HelperConstVariable ) * BatchSize;
+      for( unsigned int j = 0; j < OutputDimension; ++j )
+      {
+        VectorType::MultiplyAdd( opp + j * BatchSize, tmp_opp + j * BatchSize, w );
+      }
+
+      // move to the next coefficient
+      for( unsigned int p = 0; p < BatchSize; ++p )
+      {
+        tmp_offsets[ p ] += bot;
+      }
+    }
+  } // end TransformPoint()
+
+
+  /** EvaluateJacobianWithImageGradientProduct recursive implementation. */
+  static inline void EvaluateJacobianWithImageGradientProduct(
+    double * & imageJacobian, const double * movingImageGradient,
+    const double * weights1D, const double * value )
+  {
+    double tmp_value[ BatchSize ];
+    for( unsigned int k = 0; k <= SplineOrder; ++k )
+    {
+      VectorType::Multiply( tmp_value, value, weights1D + ( k + HelperConstVariable ) * BatchSize );
+
+      /** Recurse. */
+      RecursiveBSplineTransformBatchImplementation< OutputDimension, SpaceDimension - 1, SplineOrder, TScalar >
+        ::EvaluateJacobianWithImageGradientProduct( imageJacobian, movingImageGradient, weights1D, tmp_value );
+    }
+  } // end EvaluateJacobianWithImageGradientProduct()
+
+
+};
+
+
+/** \class RecursiveBSplineTransformBatchImplementation
+ *
+ * \brief Define the end case for SpaceDimension = 0.
+ */
+
+template< unsigned int OutputDimension, unsigned int SplineOrder, class TScalar >
+class RecursiveBSplineTransformBatchImplementation< OutputDimension, 0, SplineOrder, TScalar >
+{
+public:
+
+  typedef TScalar                     ScalarType;
+  typedef RecursiveBSplineBatchVector VectorType;
+
+  itkStaticConstMacro( BatchSize, unsigned int, VectorType::Size );
+
+  /** Typedef to know the number of indices at compile time. */
+  typedef itk::RecursiveBSplineInterpolationWeightFunction<
+    TScalar, OutputDimension, SplineOrder > RecursiveBSplineWeightFunctionType;
+  itkStaticConstMacro( BSplineNumberOfIndices, unsigned int,
+    RecursiveBSplineWeightFunctionType::NumberOfIndices );
+
+  /** TransformPoint recursive implementation. */
+  static inline void TransformPoint(
+    double * opp, const ScalarType * const * coefficients,
+    const OffsetValueType * offsets,
+    const OffsetValueType * itkNotUsed( gridOffsetTable ),
+    const double * itkNotUsed( weights1D ) )
+  {
+    for( unsigned int j = 0; j < OutputDimension; ++j )
+    {
+      VectorType::Gather( opp + j * BatchSize, coefficients[ j ], offsets );
+    }
+  } // end TransformPoint()
+
+
+  /** EvaluateJacobianWithImageGradientProduct recursive implementation. */
+  static inline void EvaluateJacobianWithImageGradientProduct(
+    double * & imageJacobian, const double * movingImageGradient,
+    const double * itkNotUsed( weights1D ), const double * value )
+  {
+    for( unsigned int j = 0; j < OutputDimension; ++j )
+    {
+      VectorType::Multiply( imageJacobian + j * BSplineNumberOfIndices * BatchSize,
+        value, movingImageGradient + j * BatchSize );
+    }
+    imageJacobian += BatchSize;
+  } // end EvaluateJacobianWithImageGradientProduct()
+
+
+};
+
+
+} // end namespace itk
+
+#endif /* __itkRecursiveBSplineTransformBatchImplementation_h */
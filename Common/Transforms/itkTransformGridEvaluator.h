@@ -0,0 +1,261 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkTransformGridEvaluator_h
+#define __itkTransformGridEvaluator_h
+
+#include "itkAdvancedTransform.h"
+#include "itkAdvancedBSplineDeformableTransformBase.h"
+#include "itkImageBase.h"
+#include "itkObject.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class TransformGridEvaluator
+ * \brief Evaluates the displacement or the spatial Jacobian of a transform
+ * at all voxels of an image grid, row by row.
+ *
+ * The transform is decomposed into terms: an AdvancedCombinationTransform
+ * without initial transform, or one that adds its transforms, contributes the
+ * terms of its subtransforms. The displacement of the transform is the sum of
+ * the displacements of the terms, and the spatial Jacobian is the identity
+ * plus the sum of the spatial Jacobians of the terms minus the identity.
+ *
+ * Terms that are an AdvancedBSplineDeformableTransform or a
+ * RecursiveBSplineTransform of order 1, 2 or 3, with a grid that has the same
+ * orientation as the image, are evaluated separably. A B-spline displacement is
+ * a tensor product: \f$\sum_k \prod_d w_d(x_d, k_d) c_k\f$, so the 1D weights
+ * along an axis only depend on the index along that axis. They are computed
+ * once in Initialize(). The coefficients are then contracted one dimension at
+ * a time: once per slice along the last dimension, once per row along the next,
+ * and so on, until only \f$SplineOrder+1\f$ multiplications per voxel and
+ * component are left. The inner loops run over contiguous memory, and are
+ * vectorized by the compiler. For the spatial Jacobian this is done once for
+ * every derivative direction, with the derivative weights along that direction.
+ *
+ * All other terms, such as composed transforms, are evaluated point by point.
+ *
+ * EvaluateRegion() is thread-safe, so that image sources can call it from
+ * ThreadedGenerateData() for the region of each thread. It calls a function
+ * object for every row of the region:\n
+ *   rowFunction( index, values )\n
+ * with the index of the first voxel of the row, and the values of all voxels
+ * of the row. A voxel has either the Dimension components of the displacement,
+ * or the Dimension x Dimension elements of the spatial Jacobian, row-major.
+ *
+ * \sa TransformToDisplacementFieldSource, TransformToSpatialJacobianSource,
+ *   TransformToDeterminantOfSpatialJacobianSource
+ * \ingroup Transforms
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+class TransformGridEvaluator : public Object
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef TransformGridEvaluator     Self;
+  typedef Object                     Superclass;
+  typedef SmartPointer< Self >       Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( TransformGridEvaluator, Object );
+
+  /** Dimension of the domain space. */
+  itkStaticConstMacro( Dimension, unsigned int, NDimensions );
+
+  /** Typedefs for the transform. */
+  typedef AdvancedTransform< TScalarType, NDimensions, NDimensions > TransformType;
+  typedef typename TransformType::ConstPointer                       TransformPointerType;
+
+  /** Typedefs for the image grid. */
+  typedef ImageBase< NDimensions >              ImageBaseType;
+  typedef typename ImageBaseType::RegionType    RegionType;
+  typedef typename RegionType::SizeType         SizeType;
+  typedef typename RegionType::IndexType        IndexType;
+  typedef typename ImageBaseType::SpacingType   SpacingType;
+  typedef typename ImageBaseType::PointType     OriginType;
+  typedef typename ImageBaseType::DirectionType DirectionType;
+
+  /** The type of the computed values, the type of the B-spline coefficients. */
+  typedef typename AdvancedBSplineDeformableTransformBase<
+    TScalarType, NDimensions >::PixelType ValueType;
+
+  /** Set the transform. */
+  itkSetConstObjectMacro( Transform, TransformType );
+  itkGetConstObjectMacro( Transform, TransformType );
+
+  /** Set the image grid. The region is the largest region that will be
+   * evaluated.
+   */
+  itkSetMacro( Region, RegionType );
+  itkGetConstReferenceMacro( Region, RegionType );
+  itkSetMacro( Spacing, SpacingType );
+  itkGetConstReferenceMacro( Spacing, SpacingType );
+  itkSetMacro( Origin, OriginType );
+  itkGetConstReferenceMacro( Origin, OriginType );
+  itkSetMacro( Direction, DirectionType );
+  itkGetConstReferenceMacro( Direction, DirectionType );
+
+  /** Compute the spatial Jacobian instead of the displacement. Default: false. */
+  itkSetMacro( ComputeSpatialJacobian, bool );
+  itkGetConstMacro( ComputeSpatialJacobian, bool );
+  itkBooleanMacro( ComputeSpatialJacobian );
+
+  /** Use the separable evaluation of B-spline transforms. Default: true.
+   * When false, every term is evaluated point by point.
+   */
+  itkSetMacro( UseSeparableBSplineEvaluation, bool );
+  itkGetConstMacro( UseSeparableBSplineEvaluation, bool );
+  itkBooleanMacro( UseSeparableBSplineEvaluation );
+
+  /** Decompose the transform into terms, and compute the 1D weights of the
+   * separable terms. Call it after setting the transform and the grid, and
+   * before EvaluateRegion().
+   */
+  virtual void Initialize( void );
+
+  /** Get the number of terms that are evaluated separably, and point by point. */
+  SizeValueType GetNumberOfSeparableTerms( void ) const
+  {
+    return static_cast< SizeValueType >( this->m_SeparableTerms.size() );
+  }
+
+
+  SizeValueType GetNumberOfPointWiseTerms( void ) const
+  {
+    return static_cast< SizeValueType >( this->m_PointWiseTerms.size() );
+  }
+
+
+  /** Get the number of values per voxel: Dimension, or Dimension x Dimension. */
+  unsigned int GetNumberOfValuesPerVoxel( void ) const
+  {
+    return this->m_ComputeSpatialJacobian ? NDimensions * NDimensions : NDimensions;
+  }
+
+
+  /** Evaluate all rows of a part of the region, in order. Thread-safe. */
+  template< class TRowFunction >
+  void EvaluateRegion( const RegionType & region, TRowFunction & rowFunction ) const;
+
+protected:
+
+  TransformGridEvaluator();
+  virtual ~TransformGridEvaluator() {}
+
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+  typedef Matrix< double, NDimensions, NDimensions > MatrixType;
+
+  /** A B-spline term, with its 1D weights along every axis of the grid. */
+  struct SeparableTermType
+  {
+    /** The coefficient images, and the strides of their dimensions. */
+    const ValueType * m_Coefficients[ NDimensions ];
+    SizeValueType     m_GridStride[ NDimensions + 1 ];
+    unsigned int      m_SupportSize;
+
+    /** For every index along an axis, the first grid index of the support,
+     * relative to the grid region, or -1 outside the valid region, and the
+     * SupportSize weights and derivative weights.
+     */
+    std::vector< OffsetValueType > m_StartIndex[ NDimensions ];
+    std::vector< ValueType >       m_Weights[ NDimensions ];
+    std::vector< ValueType >       m_DerivativeWeights[ NDimensions ];
+
+    /** The derivative of the continuous grid index to the physical point. */
+    MatrixType m_PointToGridIndex;
+  };
+
+  /** The per-thread buffers of EvaluateRegion(). */
+  struct EvaluationStateType
+  {
+    IndexType                m_Index;
+    std::vector< ValueType > m_Row;
+
+    /** For every separable term: the partially contracted coefficients,
+     * indexed by ( level * NumberOfPasses + pass ) * Dimension + component,
+     * and whether the term is inside its valid region, per level.
+     */
+    std::vector< std::vector< ValueType > >     m_Scratch;
+    std::vector< std::vector< ValueType * > >   m_Levels;
+    std::vector< std::vector< unsigned char > > m_Active;
+  };
+
+  /** Add the terms of a transform. */
+  virtual void AddTerms( const TransformType * transform );
+
+  /** Add a separable term, if the transform is a B-spline transform of the
+   * given order with a grid that is aligned with the image grid.
+   */
+  template< unsigned int VSplineOrder >
+  bool AddSeparableTerm( const TransformType * transform );
+
+  /** Evaluate the rows of the region, along the given dimension and below. */
+  template< class TRowFunction >
+  void EvaluateRows( const RegionType & region, const unsigned int dimension,
+    EvaluationStateType & state, TRowFunction & rowFunction ) const;
+
+  /** Add the values of the separable terms and point-wise terms to a row. */
+  void AddSeparableTermsToRow( const RegionType & region, EvaluationStateType & state ) const;
+
+  void AddPointWiseTermsToRow( const RegionType & region, EvaluationStateType & state ) const;
+
+  /** The number of contractions of a separable term: one for the displacement,
+   * or one per derivative direction for the spatial Jacobian.
+   */
+  unsigned int GetNumberOfPasses( void ) const
+  {
+    return this->m_ComputeSpatialJacobian ? NDimensions : 1;
+  }
+
+
+private:
+
+  TransformGridEvaluator( const Self & ); // purposely not implemented
+  void operator=( const Self & );         // purposely not implemented
+
+  /** Member variables. */
+  TransformPointerType m_Transform;
+  RegionType           m_Region;
+  SpacingType          m_Spacing;
+  OriginType           m_Origin;
+  DirectionType        m_Direction;
+  MatrixType           m_IndexToPoint;
+  bool                 m_ComputeSpatialJacobian;
+  bool                 m_UseSeparableBSplineEvaluation;
+
+  std::vector< SeparableTermType >    m_SeparableTerms;
+  std::vector< TransformPointerType > m_PointWiseTerms;
+
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTransformGridEvaluator.hxx"
+#endif
+
+#endif // end #ifndef __itkTransformGridEvaluator_h
@@ -0,0 +1,587 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkTransformGridEvaluator_hxx
+#define __itkTransformGridEvaluator_hxx
+
+#include "itkTransformGridEvaluator.h"
+
+#include "itkAdvancedCombinationTransform.h"
+#include "itkAdvancedBSplineDeformableTransform.h"
+#include "itkBSplineKernelFunction2.h"
+#include "itkBSplineDerivativeKernelFunction2.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+
+/**
+ * ********************* Constructor ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+TransformGridEvaluator< TScalarType, NDimensions >
+::TransformGridEvaluator()
+{
+  this->m_Spacing.Fill( 1.0 );
+  this->m_Origin.Fill( 0.0 );
+  this->m_Direction.SetIdentity();
+  this->m_IndexToPoint.SetIdentity();
+
+  SizeType size;
+  size.Fill( 0 );
+  this->m_Region.SetSize( size );
+
+  this->m_ComputeSpatialJacobian        = false;
+  this->m_UseSeparableBSplineEvaluation = true;
+
+} // end Constructor
+
+
+/**
+ * ********************* PrintSelf ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+TransformGridEvaluator< TScalarType, NDimensions >
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "Transform: " << this->m_Transform.GetPointer() << std::endl;
+  os << indent << "Region: " << this->m_Region << std::endl;
+  os << indent << "Spacing: " << this->m_Spacing << std::endl;
+  os << indent << "Origin: " << this->m_Origin << std::endl;
+  os << indent << "Direction: " << this->m_Direction << std::endl;
+  os << indent << "ComputeSpatialJacobian: " << this->m_ComputeSpatialJacobian << std::endl;
+  os << indent << "UseSeparableBSplineEvaluation: "
+     << this->m_UseSeparableBSplineEvaluation << std::endl;
+  os << indent << "NumberOfSeparableTerms: " << this->m_SeparableTerms.size() << std::endl;
+  os << indent << "NumberOfPointWiseTerms: " << this->m_PointWiseTerms.size() << std::endl;
+
+} // end PrintSelf()
+
+
+/**
+ * ********************* Initialize ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+TransformGridEvaluator< TScalarType, NDimensions >
+::Initialize( void )
+{
+  if( !this->m_Transform )
+  {
+    itkExceptionMacro( << "ERROR: the transform is not set." );
+  }
+
+  /** The physical point of an index, as in ImageBase. */
+  MatrixType scale;
+  scale.Fill( 0.0 );
+  for( unsigned int d = 0; d < NDimensions; ++d )
+  {
+    scale[ d ][ d ] = this->m_Spacing[ d ];
+  }
+  this->m_IndexToPoint = this->m_Direction * scale;
+
+  this->m_SeparableTerms.clear();
+  this->m_PointWiseTerms.clear();
+  this->AddTerms( this->m_Transform );
+
+} // end Initialize()
+
+
+/**
+ * ********************* AddTerms ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+TransformGridEvaluator< TScalarType, NDimensions >
+::AddTerms( const TransformType * transform )
+{
+  typedef AdvancedCombinationTransform< TScalarType, NDimensions > CombinationTransformType;
+
+  /** The displacement of T1( x ) + T0( x ) - x is the sum of the
+   * displacements of T0 and T1. A composition has to be evaluated point-wise.
+   */
+  const CombinationTransformType * combination
+    = dynamic_cast< const CombinationTransformType * >( transform );
+  if( combination && combination->GetCurrentTransform() )
+  {
+    const TransformType * initialTransform = combination->GetInitialTransform();
+    if( !initialTransform )
+    {
+      this->AddTerms( combination->GetCurrentTransform() );
+      return;
+    }
+    if( combination->GetUseAddition() )
+    {
+      this->AddTerms( initialTransform );
+      this->AddTerms( combination->GetCurrentTransform() );
+      return;
+    }
+  }
+  else if( this->m_UseSeparableBSplineEvaluation
+    && ( this->template AddSeparableTerm< 1 >( transform )
+    || this->template AddSeparableTerm< 2 >( transform )
+    || this->template AddSeparableTerm< 3 >( transform ) ) )
+  {
+    return;
+  }
+
+  this->m_PointWiseTerms.push_back( transform );
+
+} // end AddTerms()
+
+
+/**
+ * ********************* AddSeparableTerm ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+template< unsigned int VSplineOrder >
+bool
+TransformGridEvaluator< TScalarType, NDimensions >
+::AddSeparableTerm( const TransformType * transform )
+{
+  typedef AdvancedBSplineDeformableTransform<
+    TScalarType, NDimensions, VSplineOrder >               BSplineTransformType;
+  typedef BSplineKernelFunction2< VSplineOrder >           KernelType;
+  typedef BSplineDerivativeKernelFunction2< VSplineOrder > DerivativeKernelType;
+
+  /** Derived classes, such as the cyclic B-spline transform, may compute
+   * the displacement differently, so only accept the exact classes.
+   */
+  const BSplineTransformType * bspline = dynamic_cast< const BSplineTransformType * >( transform );
+  if( !bspline )
+  {
+    return false;
+  }
+  const std::string nameOfClass = bspline->GetNameOfClass();
+  if( nameOfClass != "AdvancedBSplineDeformableTransform"
+    && nameOfClass != "RecursiveBSplineTransform" )
+  {
+    return false;
+  }
+  if( !bspline->GetCoefficientImages()[ 0 ] )
+  {
+    return false;
+  }
+
+  /** The continuous grid index of index i is a + M i, with
+   * M = ( D_g S_g )^-1 D S. The weights along an axis only depend
+   * on the index along that axis if M is diagonal.
+   */
+  MatrixType gridScale;
+  gridScale.Fill( 0.0 );
+  for( unsigned int d = 0; d < NDimensions; ++d )
+  {
+    gridScale[ d ][ d ] = bspline->GetGridSpacing()[ d ];
+  }
+  const MatrixType pointToGridIndex( ( bspline->GetGridDirection() * gridScale ).GetInverse() );
+  const MatrixType indexToGridIndex = pointToGridIndex * this->m_IndexToPoint;
+
+  double maximumDiagonal = 0.0;
+  for( unsigned int d = 0; d < NDimensions; ++d )
+  {
+    maximumDiagonal = std::max( maximumDiagonal, std::abs( indexToGridIndex[ d ][ d ] ) );
+  }
+  for( unsigned int i = 0; i < NDimensions; ++i )
+  {
+    for( unsigned int j = 0; j < NDimensions; ++j )
+    {
+      if( i != j && std::abs( indexToGridIndex[ i ][ j ] ) > 1e-9 * maximumDiagonal )
+      {
+        return false;
+      }
+    }
+  }
+
+  typename KernelType::Pointer           kernel           = KernelType::New();
+  typename DerivativeKernelType::Pointer derivativeKernel = DerivativeKernelType::New();
+  const typename BSplineTransformType::RegionType gridRegion = bspline->GetGridRegion();
+
+  SeparableTermType term;
+  term.m_SupportSize      = VSplineOrder + 1;
+  term.m_PointToGridIndex = pointToGridIndex;
+  term.m_GridStride[ 0 ]  = 1;
+  for( unsigned int d = 0; d < NDimensions; ++d )
+  {
+    term.m_Coefficients[ d ]   = bspline->GetCoefficientImages()[ d ]->GetBufferPointer();
+    term.m_GridStride[ d + 1 ] = term.m_GridStride[ d ] * gridRegion.GetSize()[ d ];
+  }
+
+  /** Compute the 1D weights along every axis. The valid region is the same as
+   * in AdvancedBSplineDeformableTransform; outside it the displacement is zero
+   * and the spatial Jacobian is the identity.
+   */
+  for( unsigned int d = 0; d < NDimensions; ++d )
+  {
+    double offset = 0.0;
+    for( unsigned int e = 0; e < NDimensions; ++e )
+    {
+      offset += pointToGridIndex[ d ][ e ]
+        * ( this->m_Origin[ e ] - bspline->GetGridOrigin()[ e ] );
+    }
+    const double scale      = indexToGridIndex[ d ][ d ];
+    const double gridIndex  = static_cast< double >( gridRegion.GetIndex()[ d ] );
+    const double validBegin = gridIndex + ( VSplineOrder - 1.0 ) / 2.0;
+    const double validEnd   = gridIndex + ( gridRegion.GetSize()[ d ] - 1.0 ) - ( VSplineOrder - 1.0 ) / 2.0;
+
+    const SizeValueType size = this->m_Region.GetSize()[ d ];
+    term.m_StartIndex[ d ].assign( size, -1 );
+    term.m_Weights[ d ].assign( size * term.m_SupportSize, 0.0 );
+    if( this->m_ComputeSpatialJacobian )
+    {
+      term.m_DerivativeWeights[ d ].assign( size * term.m_SupportSize, 0.0 );
+    }
+    for( SizeValueType i = 0; i < size; ++i )
+    {
+      const double cindex = offset + scale * static_cast< double >( this->m_Region.GetIndex()[ d ] + i );
+      if( cindex < validBegin || cindex >= validEnd )
+      {
+        continue;
+      }
+
+      const double startIndex = std::floor( cindex - ( VSplineOrder - 1.0 ) / 2.0 );
+      term.m_StartIndex[ d ][ i ] = static_cast< OffsetValueType >( startIndex - gridIndex );
+      kernel->Evaluate( cindex - startIndex, &term.m_Weights[ d ][ i * term.m_SupportSize ] );
+
+      /** As in BSplineInterpolationDerivativeWeightFunction. */
+      if( this->m_ComputeSpatialJacobian )
+      {
+        double x = cindex - startIndex;
+        for( unsigned int k = 0; k < term.m_SupportSize; ++k )
+        {
+          term.m_DerivativeWeights[ d ][ i * term.m_SupportSize + k ] = derivativeKernel->Evaluate( x );
+          x -= 1.0;
+        }
+      }
+    }
+  }
+
+  this->m_SeparableTerms.push_back( term );
+  return true;
+
+} // end AddSeparableTerm()
+
+
+/**
+ * ********************* EvaluateRegion ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+template< class TRowFunction >
+void
+TransformGridEvaluator< TScalarType, NDimensions >
+::EvaluateRegion( const RegionType & region, TRowFunction & rowFunction ) const
+{
+  if( region.GetNumberOfPixels() == 0 )
+  {
+    return;
+  }
+
+  /** Allocate the buffers of this thread. Level l holds the coefficients
+   * contracted along the dimensions above l: GridStride[ l + 1 ] values
+   * per pass and component.
+   */
+  const unsigned int numberOfPasses = this->GetNumberOfPasses();
+  const std::size_t  numberOfTerms  = this->m_SeparableTerms.size();
+
+  EvaluationStateType state;
+  state.m_Index = region.GetIndex();
+  state.m_Row.resize( region.GetSize()[ 0 ] * this->GetNumberOfValuesPerVoxel() );
+  state.m_Scratch.resize( numberOfTerms );
+  state.m_Levels.resize( numberOfTerms );
+  state.m_Active.resize( numberOfTerms );
+  for( std::size_t t = 0; t < numberOfTerms; ++t )
+  {
+    const SeparableTermType & term      = this->m_SeparableTerms[ t ];
+    SizeValueType             levelSize = 0;
+    for( unsigned int l = 0; l + 1 < NDimensions; ++l )
+    {
+      levelSize += term.m_GridStride[ l + 1 ];
+    }
+    state.m_Scratch[ t ].resize( numberOfPasses * NDimensions * levelSize );
+    state.m_Levels[ t ].resize( ( NDimensions - 1 ) * numberOfPasses * NDimensions );
+    state.m_Active[ t ].assign( NDimensions, 1 );
+
+    ValueType * level = state.m_Scratch[ t ].empty() ? 0 : &state.m_Scratch[ t ][ 0 ];
+    for( unsigned int l = 0; l + 1 < NDimensions; ++l )
+    {
+      for( unsigned int j = 0; j < numberOfPasses * NDimensions; ++j )
+      {
+        state.m_Levels[ t ][ l * numberOfPasses * NDimensions + j ] = level;
+        level += term.m_GridStride[ l + 1 ];
+      }
+    }
+  }
+
+  this->EvaluateRows( region, NDimensions - 1, state, rowFunction );
+
+} // end EvaluateRegion()
+
+
+/**
+ * ********************* EvaluateRows ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+template< class TRowFunction >
+void
+TransformGridEvaluator< TScalarType, NDimensions >
+::EvaluateRows( const RegionType & region, const unsigned int dimension,
+  EvaluationStateType & state, TRowFunction & rowFunction ) const
+{
+  /** Along the first dimension, sum the terms and pass the row on. */
+  if( dimension == 0 )
+  {
+    state.m_Index[ 0 ] = region.GetIndex()[ 0 ];
+    std::fill( state.m_Row.begin(), state.m_Row.end(), 0.0 );
+    this->AddSeparableTermsToRow( region, state );
+    this->AddPointWiseTermsToRow( region, state );
+
+    if( this->m_ComputeSpatialJacobian )
+    {
+      const SizeValueType size = region.GetSize()[ 0 ];
+      for( SizeValueType i = 0; i < size; ++i )
+      {
+        for( unsigned int c = 0; c < NDimensions; ++c )
+        {
+          state.m_Row[ ( i * NDimensions + c ) * NDimensions + c ] += 1.0;
+        }
+      }
+    }
+
+    rowFunction( state.m_Index, &state.m_Row[ 0 ] );
+    return;
+  }
+
+  /** Otherwise contract the slice of the coefficients of every separable term
+   * along this dimension, and continue with the next lower dimension.
+   */
+  const unsigned int  numberOfPasses = this->GetNumberOfPasses();
+  const SizeValueType size           = region.GetSize()[ dimension ];
+  const SizeValueType tableBegin     = region.GetIndex()[ dimension ] - this->m_Region.GetIndex()[ dimension ];
+  for( SizeValueType i = 0; i < size; ++i )
+  {
+    state.m_Index[ dimension ] = region.GetIndex()[ dimension ] + static_cast< OffsetValueType >( i );
+
+    for( std::size_t t = 0; t < this->m_SeparableTerms.size(); ++t )
+    {
+      const SeparableTermType & term       = this->m_SeparableTerms[ t ];
+      const OffsetValueType     startIndex = term.m_StartIndex[ dimension ][ tableBegin + i ];
+      const bool                active     = startIndex >= 0
+        && ( dimension + 1 == NDimensions || state.m_Active[ t ][ dimension ] );
+      state.m_Active[ t ][ dimension - 1 ] = active;
+      if( !active )
+      {
+        continue;
+      }
+
+      const unsigned int  supportSize = term.m_SupportSize;
+      const SizeValueType stride      = term.m_GridStride[ dimension ];
+      for( unsigned int p = 0; p < numberOfPasses; ++p )
+      {
+        const std::vector< ValueType > & table
+          = ( this->m_ComputeSpatialJacobian && p == dimension )
+          ? term.m_DerivativeWeights[ dimension ] : term.m_Weights[ dimension ];
+        const ValueType * w = &table[ ( tableBegin + i ) * supportSize ];
+
+        for( unsigned int c = 0; c < NDimensions; ++c )
+        {
+          const ValueType * in = ( dimension + 1 == NDimensions )
+            ? term.m_Coefficients[ c ]
+            : state.m_Levels[ t ][ ( dimension * numberOfPasses + p ) * NDimensions + c ];
+          in += startIndex * stride;
+          ValueType * sum = state.m_Levels[ t ][ ( ( dimension - 1 ) * numberOfPasses + p ) * NDimensions + c ];
+
+          for( SizeValueType j = 0; j < stride; ++j )
+          {
+            sum[ j ] = w[ 0 ] * in[ j ];
+          }
+          for( unsigned int k = 1; k < supportSize; ++k )
+          {
+            const ValueType   wk  = w[ k ];
+            const ValueType * ink = in + k * stride;
+            for( SizeValueType j = 0; j < stride; ++j )
+            {
+              sum[ j ] += wk * ink[ j ];
+            }
+          }
+        }
+      }
+    }
+
+    this->EvaluateRows( region, dimension - 1, state, rowFunction );
+  }
+
+} // end EvaluateRows()
+
+
+/**
+ * ********************* AddSeparableTermsToRow ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+TransformGridEvaluator< TScalarType, NDimensions >
+::AddSeparableTermsToRow( const RegionType & region, EvaluationStateType & state ) const
+{
+  const unsigned int  numberOfPasses = this->GetNumberOfPasses();
+  const SizeValueType size           = region.GetSize()[ 0 ];
+  const SizeValueType tableBegin     = region.GetIndex()[ 0 ] - this->m_Region.GetIndex()[ 0 ];
+  ValueType *         row            = &state.m_Row[ 0 ];
+
+  for( std::size_t t = 0; t < this->m_SeparableTerms.size(); ++t )
+  {
+    const SeparableTermType & term = this->m_SeparableTerms[ t ];
+    if( NDimensions > 1 && !state.m_Active[ t ][ 0 ] )
+    {
+      continue;
+    }
+
+    const unsigned int      supportSize  = term.m_SupportSize;
+    const OffsetValueType * startIndices = &term.m_StartIndex[ 0 ][ tableBegin ];
+    for( unsigned int p = 0; p < numberOfPasses; ++p )
+    {
+      const std::vector< ValueType > & table
+        = ( this->m_ComputeSpatialJacobian && p == 0 )
+        ? term.m_DerivativeWeights[ 0 ] : term.m_Weights[ 0 ];
+      const ValueType * weights = &table[ tableBegin * supportSize ];
+
+      for( unsigned int c = 0; c < NDimensions; ++c )
+      {
+        const ValueType * in = ( NDimensions == 1 )
+          ? term.m_Coefficients[ c ]
+          : state.m_Levels[ t ][ p * NDimensions + c ];
+
+        for( SizeValueType i = 0; i < size; ++i )
+        {
+          if( startIndices[ i ] < 0 )
+          {
+            continue;
+          }
+          const ValueType * w   = weights + i * supportSize;
+          const ValueType * ini = in + startIndices[ i ];
+          ValueType         sum = 0.0;
+          for( unsigned int k = 0; k < supportSize; ++k )
+          {
+            sum += w[ k ] * ini[ k ];
+          }
+
+          /** The spatial Jacobian is the derivative to the grid index,
+           * times the derivative of the grid index to the point.
+           */
+          if( this->m_ComputeSpatialJacobian )
+          {
+            ValueType * sj = row + ( i * NDimensions + c ) * NDimensions;
+            for( unsigned int e = 0; e < NDimensions; ++e )
+            {
+              sj[ e ] += sum * term.m_PointToGridIndex[ p ][ e ];
+            }
+          }
+          else
+          {
+            row[ i * NDimensions + c ] += sum;
+          }
+        }
+      }
+    }
+  }
+
+} // end AddSeparableTermsToRow()
+
+
+/**
+ * ********************* AddPointWiseTermsToRow ****************************
+ */
+
+template< class TScalarType, unsigned int NDimensions >
+void
+TransformGridEvaluator< TScalarType, NDimensions >
+::AddPointWiseTermsToRow( const RegionType & region, EvaluationStateType & state ) const
+{
+  if( this->m_PointWiseTerms.empty() )
+  {
+    return;
+  }
+
+  typedef typename TransformType::InputPointType      InputPointType;
+  typedef typename TransformType::OutputPointType     OutputPointType;
+  typedef typename TransformType::SpatialJacobianType SpatialJacobianType;
+
+  const SizeValueType size = region.GetSize()[ 0 ];
+  ValueType *         row  = &state.m_Row[ 0 ];
+
+  /** The physical point of the first voxel of the row. */
+  InputPointType rowPoint;
+  for( unsigned int d = 0; d < NDimensions; ++d )
+  {
+    rowPoint[ d ] = this->m_Origin[ d ];
+    for( unsigned int e = 0; e < NDimensions; ++e )
+    {
+      rowPoint[ d ] += this->m_IndexToPoint[ d ][ e ] * state.m_Index[ e ];
+    }
+  }
+
+  InputPointType      point;
+  OutputPointType     transformedPoint;
+  SpatialJacobianType sj;
+  for( SizeValueType i = 0; i < size; ++i )
+  {
+    for( unsigned int d = 0; d < NDimensions; ++d )
+    {
+      point[ d ] = rowPoint[ d ] + this->m_IndexToPoint[ d ][ 0 ] * static_cast< double >( i );
+    }
+
+    for( std::size_t t = 0; t < this->m_PointWiseTerms.size(); ++t )
+    {
+      if( this->m_ComputeSpatialJacobian )
+      {
+        this->m_PointWiseTerms[ t ]->GetSpatialJacobian( point, sj );
+        ValueType * rowSJ = row + i * NDimensions * NDimensions;
+        for( unsigned int c = 0; c < NDimensions; ++c )
+        {
+          for( unsigned int e = 0; e < NDimensions; ++e )
+          {
+            rowSJ[ c * NDimensions + e ] += sj[ c ][ e ] - ( c == e ? 1.0 : 0.0 );
+          }
+        }
+      }
+      else
+      {
+        transformedPoint = this->m_PointWiseTerms[ t ]->TransformPoint( point );
+        for( unsigned int c = 0; c < NDimensions; ++c )
+        {
+          row[ i * NDimensions + c ] += transformedPoint[ c ] - point[ c ];
+        }
+      }
+    }
+  }
+
+} // end AddPointWiseTermsToRow()
+
+
+} // end namespace itk
+
+#endif // end #ifndef __itkTransformGridEvaluator_hxx
@@ -36,6 +36,9 @@
 
 #include "itkAdvancedTransform.h"
 #include "itkImageSource.h"
+#include "itkProgressReporter.h"
+#include "itkTransformGridEvaluator.h"
+#include "vnl/vnl_det.h"
 
 namespace itk
 {
@@ -104,6 +107,9 @@ public:
     itkGetStaticConstMacro( ImageDimension ) >     TransformType;
   typedef typename TransformType::ConstPointer        TransformPointerType;
   typedef typename TransformType::SpatialJacobianType SpatialJacobianType;
+  typedef TransformGridEvaluator< TTransformPrecisionType,
+    itkGetStaticConstMacro( ImageDimension ) >     EvaluatorType;
+  typedef typename EvaluatorType::ValueType        EvaluatorValueType;
 
   /** Typedefs for output image. */
   typedef typename OutputImageType::PixelType PixelType;
@@ -171,6 +177,13 @@ public:
   /** Helper method to set the output parameters based on this image */
   void SetOutputParametersFromImage( const ImageBaseType * image );
 
+  /** Use the separable evaluation of B-spline transforms. Default: true.
+   * See TransformGridEvaluator.
+   */
+  itkSetMacro( UseSeparableBSplineEvaluation, bool );
+  itkGetConstMacro( UseSeparableBSplineEvaluation, bool );
+  itkBooleanMacro( UseSeparableBSplineEvaluation );
+
   /** TransformToDeterminantOfSpatialJacobianSource produces a floating value image. */
   virtual void GenerateOutputInformation( void );
 
@@ -195,8 +208,9 @@ protected:
     const OutputImageRegionType & outputRegionForThread,
     ThreadIdType threadId );
 
-  /** Default implementation for resampling that works for any
-   * transformation type.
+  /** Default implementation that works for any transformation type.
+   * B-spline transforms, also when added to other transforms, are
+   * evaluated separably by a TransformGridEvaluator.
    */
   void NonlinearThreadedGenerateData(
     const OutputImageRegionType & outputRegionForThread,
@@ -206,6 +220,28 @@ protected:
    *  transformation types. Unthreaded. */
   void LinearGenerateData( void );
 
+  /** Writes the determinants of the rows of the evaluator to the output image. */
+  struct RowWriterType
+  {
+    OutputImageType *  m_Output;
+    SizeValueType      m_RowSize;
+    ProgressReporter * m_Progress;
+
+    void operator()( const IndexType & index, const EvaluatorValueType * values )
+    {
+      typedef vnl_matrix_fixed< EvaluatorValueType, ImageDimension, ImageDimension > MatrixType;
+      PixelType * output = this->m_Output->GetBufferPointer() + this->m_Output->ComputeOffset( index );
+      for( SizeValueType i = 0; i < this->m_RowSize; ++i )
+      {
+        const MatrixType sj( values + i * ImageDimension * ImageDimension );
+        output[ i ] = static_cast< PixelType >( vnl_det( sj ) );
+      }
+      this->m_Progress->CompletedPixel();
+    }
+
+
+  };
+
 private:
 
   TransformToDeterminantOfSpatialJacobianSource( const Self & ); // purposely not implemented
@@ -217,6 +253,9 @@ private:
   SpacingType          m_OutputSpacing;        // output image spacing
   OriginType           m_OutputOrigin;         // output image origin
   DirectionType        m_OutputDirection;      // output image direction cosines
+  bool                 m_UseSeparableBSplineEvaluation;
+
+  typename EvaluatorType::Pointer m_Evaluator;
 
 };
 
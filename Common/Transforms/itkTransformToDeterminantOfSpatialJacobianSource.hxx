@@ -38,7 +38,6 @@
 
 #include "itkAdvancedIdentityTransform.h"
 #include "itkProgressReporter.h"
-#include "itkImageRegionIteratorWithIndex.h"
 #include "vnl/vnl_det.h"
 
 namespace itk
@@ -65,6 +64,9 @@ TransformToDeterminantOfSpatialJacobianSource< TOutputImage, TTransformPrecision
 
   this->m_Transform = AdvancedIdentityTransform< TTransformPrecisionType, ImageDimension >::New();
 
+  this->m_UseSeparableBSplineEvaluation = true;
+  this->m_Evaluator                     = EvaluatorType::New();
+
 #if ITK_VERSION_MAJOR >= 5
   // Use the classic (ITK4) threading model, to ensure ThreadedGenerateData is being called.
   this->itk::ImageSource<TOutputImage>::DynamicMultiThreadingOff();
@@ -90,6 +92,8 @@ TransformToDeterminantOfSpatialJacobianSource< TOutputImage, TTransformPrecision
   os << indent << "OutputOrigin: " << this->m_OutputOrigin << std::endl;
   os << indent << "OutputDirection: " << this->m_OutputDirection << std::endl;
   os << indent << "Transform: " << this->m_Transform.GetPointer() << std::endl;
+  os << indent << "UseSeparableBSplineEvaluation: "
+     << this->m_UseSeparableBSplineEvaluation << std::endl;
 
 } // end PrintSelf()
 
@@ -210,8 +214,19 @@ TransformToDeterminantOfSpatialJacobianSource< TOutputImage, TTransformPrecision
   if( this->m_Transform->IsLinear() )
   {
     this->LinearGenerateData();
+    return;
   }
 
+  // Otherwise decompose the transform, and compute the weights of the B-splines.
+  this->m_Evaluator->SetTransform( this->m_Transform );
+  this->m_Evaluator->SetRegion( this->m_OutputRegion );
+  this->m_Evaluator->SetSpacing( this->m_OutputSpacing );
+  this->m_Evaluator->SetOrigin( this->m_OutputOrigin );
+  this->m_Evaluator->SetDirection( this->m_OutputDirection );
+  this->m_Evaluator->SetComputeSpatialJacobian( true );
+  this->m_Evaluator->SetUseSeparableBSplineEvaluation( this->m_UseSeparableBSplineEvaluation );
+  this->m_Evaluator->Initialize();
+
 } // end BeforeThreadedGenerateData()
 
 
@@ -246,37 +261,22 @@ TransformToDeterminantOfSpatialJacobianSource< TOutputImage, TTransformPrecision
   const OutputImageRegionType & outputRegionForThread,
   ThreadIdType threadId )
 {
-  // Get the output pointer
-  OutputImagePointer outputPtr = this->GetOutput();
-
-  // Create an iterator that will walk the output region for this thread.
-  typedef ImageRegionIteratorWithIndex< TOutputImage > OutputIteratorType;
-  OutputIteratorType it( outputPtr, outputRegionForThread );
-  it.GoToBegin();
-
-  // pixel coordinates
-  PointType point;
-
-  // Support for progress methods/callbacks
-  ProgressReporter progress( this, threadId, outputRegionForThread.GetNumberOfPixels() );
-
-  // Walk the output region
-  while( !it.IsAtEnd() )
+  if( outputRegionForThread.GetNumberOfPixels() == 0 )
   {
-    // Determine the coordinates of the current voxel
-    outputPtr->TransformIndexToPhysicalPoint( it.GetIndex(), point );
-
-    SpatialJacobianType sj;
-    this->m_Transform->GetSpatialJacobian( point, sj );
-    const PixelType detjac = static_cast< PixelType >( vnl_det( sj.GetVnlMatrix() ) );
+    return;
+  }
 
-    // Set it
-    it.Set( detjac );
+  // Support for progress methods/callbacks, per row
+  const SizeValueType numberOfRows
+    = outputRegionForThread.GetNumberOfPixels() / outputRegionForThread.GetSize()[ 0 ];
+  ProgressReporter progress( this, threadId, numberOfRows );
 
-    // Update progress and iterator
-    progress.CompletedPixel();
-    ++it;
-  }
+  // Evaluate the spatial Jacobian row by row
+  RowWriterType rowWriter;
+  rowWriter.m_Output   = this->GetOutput();
+  rowWriter.m_RowSize  = outputRegionForThread.GetSize()[ 0 ];
+  rowWriter.m_Progress = &progress;
+  this->m_Evaluator->EvaluateRegion( outputRegionForThread, rowWriter );
 
 } // end NonlinearThreadedGenerateData()
 
@@ -328,7 +328,6 @@ TransformToDeterminantOfSpatialJacobianSource< TOutputImage, TTransformPrecision
   outputPtr->SetSpacing( m_OutputSpacing );
   outputPtr->SetOrigin( m_OutputOrigin );
   outputPtr->SetDirection( m_OutputDirection );
-  outputPtr->Allocate();
 
 } // end GenerateOutputInformation()
 
@@ -0,0 +1,234 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkTransformToDisplacementFieldSource_h
+#define __itkTransformToDisplacementFieldSource_h
+
+#include "itkAdvancedTransform.h"
+#include "itkImageSource.h"
+#include "itkProgressReporter.h"
+#include "itkTransformGridEvaluator.h"
+
+namespace itk
+{
+
+/** \class TransformToDisplacementFieldSource
+ * \brief Generate a displacement field from a coordinate transform.
+ *
+ * This class computes the displacement \f$T(x) - x\f$ of an AdvancedTransform
+ * at every voxel of the output image, like itk::TransformToDisplacementFieldFilter,
+ * but exploits the structure of B-spline transforms.
+ *
+ * The work is done by a TransformGridEvaluator: B-spline transforms, also when
+ * added to other transforms, are evaluated separably, with 1D weights that are
+ * computed once per row, column and slice, and contractions of the coefficients
+ * one dimension at a time. All other transforms, such as composed transforms,
+ * are evaluated point by point.
+ *
+ * The filter is multi-threaded over slabs of the output image.
+ *
+ * \sa TransformToDeterminantOfSpatialJacobianSource
+ * \ingroup GeometricTransforms
+ */
+template< class TOutputImage,
+class TTransformPrecisionType = double >
+class TransformToDisplacementFieldSource :
+  public ImageSource< TOutputImage >
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef TransformToDisplacementFieldSource Self;
+  typedef ImageSource< TOutputImage >        Superclass;
+  typedef SmartPointer< Self >               Pointer;
+  typedef SmartPointer< const Self >         ConstPointer;
+
+  typedef TOutputImage                           OutputImageType;
+  typedef typename OutputImageType::Pointer      OutputImagePointer;
+  typedef typename OutputImageType::ConstPointer OutputImageConstPointer;
+  typedef typename OutputImageType::RegionType   OutputImageRegionType;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( TransformToDisplacementFieldSource, ImageSource );
+
+  /** Number of dimensions. */
+  itkStaticConstMacro( ImageDimension, unsigned int,
+    TOutputImage::ImageDimension );
+
+  /** Typedefs for transform. */
+  typedef AdvancedTransform< TTransformPrecisionType,
+    itkGetStaticConstMacro( ImageDimension ),
+    itkGetStaticConstMacro( ImageDimension ) >     TransformType;
+  typedef typename TransformType::ConstPointer TransformPointerType;
+  typedef TransformGridEvaluator< TTransformPrecisionType,
+    itkGetStaticConstMacro( ImageDimension ) >     EvaluatorType;
+  typedef typename EvaluatorType::ValueType        EvaluatorValueType;
+
+  /** Typedefs for output image. */
+  typedef typename OutputImageType::PixelType     PixelType;
+  typedef typename PixelType::ValueType           PixelValueType;
+  typedef typename OutputImageType::RegionType    RegionType;
+  typedef typename RegionType::SizeType           SizeType;
+  typedef typename OutputImageType::IndexType     IndexType;
+  typedef typename OutputImageType::PointType     PointType;
+  typedef typename OutputImageType::SpacingType   SpacingType;
+  typedef typename OutputImageType::PointType     OriginType;
+  typedef typename OutputImageType::DirectionType DirectionType;
+
+  /** Typedefs for base image. */
+  typedef ImageBase< itkGetStaticConstMacro( ImageDimension ) > ImageBaseType;
+
+  /** Set the coordinate transformation. It should map points of the output
+   * image to the moving image, as for resampling.
+   */
+  itkSetConstObjectMacro( Transform, TransformType );
+
+  /** Get a pointer to the coordinate transform. */
+  itkGetConstObjectMacro( Transform, TransformType );
+
+  /** Set the size of the output image. */
+  virtual void SetOutputSize( const SizeType & size );
+
+  /** Get the size of the output image. */
+  virtual const SizeType & GetOutputSize();
+
+  /** Set the start index of the output largest possible region.
+   * The default is an index of all zeros.
+   */
+  virtual void SetOutputIndex( const IndexType & index );
+
+  /** Get the start index of the output largest possible region. */
+  virtual const IndexType & GetOutputIndex();
+
+  /** Set the region of the output image. */
+  itkSetMacro( OutputRegion, OutputImageRegionType );
+
+  /** Get the region of the output image. */
+  itkGetConstReferenceMacro( OutputRegion, OutputImageRegionType );
+
+  /** Set the output image spacing. */
+  itkSetMacro( OutputSpacing, SpacingType );
+
+  /** Get the output image spacing. */
+  itkGetConstReferenceMacro( OutputSpacing, SpacingType );
+
+  /** Set the output image origin. */
+  itkSetMacro( OutputOrigin, OriginType );
+
+  /** Get the output image origin. */
+  itkGetConstReferenceMacro( OutputOrigin, OriginType );
+
+  /** Set the output direction cosine matrix. */
+  itkSetMacro( OutputDirection, DirectionType );
+  itkGetConstReferenceMacro( OutputDirection, DirectionType );
+
+  /** Helper method to set the output parameters based on this image. */
+  void SetOutputParametersFromImage( const ImageBaseType * image );
+
+  /** Use the separable evaluation of B-spline transforms. Default: true.
+   * When false, every term is evaluated point by point.
+   */
+  itkSetMacro( UseSeparableBSplineEvaluation, bool );
+  itkGetConstMacro( UseSeparableBSplineEvaluation, bool );
+  itkBooleanMacro( UseSeparableBSplineEvaluation );
+
+  /** Get the number of terms of the transform that are evaluated separably,
+   * and point by point. Valid after Update().
+   */
+  SizeValueType GetNumberOfSeparableTerms( void ) const
+  {
+    return this->m_Evaluator->GetNumberOfSeparableTerms();
+  }
+
+
+  SizeValueType GetNumberOfPointWiseTerms( void ) const
+  {
+    return this->m_Evaluator->GetNumberOfPointWiseTerms();
+  }
+
+
+  /** Set the output image information. */
+  virtual void GenerateOutputInformation( void );
+
+  /** Initialize the evaluator. */
+  virtual void BeforeThreadedGenerateData( void );
+
+  /** Compute the Modified Time based on changes to the components. */
+  ModifiedTimeType GetMTime( void ) const;
+
+protected:
+
+  TransformToDisplacementFieldSource();
+  ~TransformToDisplacementFieldSource() {}
+
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+  /** Evaluate the displacements in the region of a thread. */
+  void ThreadedGenerateData(
+    const OutputImageRegionType & outputRegionForThread,
+    ThreadIdType threadId );
+
+  /** Writes the rows of the evaluator to the output image. */
+  struct RowWriterType
+  {
+    OutputImageType *  m_Output;
+    SizeValueType      m_RowSize;
+    ProgressReporter * m_Progress;
+
+    void operator()( const IndexType & index, const EvaluatorValueType * values )
+    {
+      PixelType * output = this->m_Output->GetBufferPointer() + this->m_Output->ComputeOffset( index );
+      for( SizeValueType i = 0; i < this->m_RowSize; ++i )
+      {
+        for( unsigned int d = 0; d < ImageDimension; ++d )
+        {
+          output[ i ][ d ] = static_cast< PixelValueType >( values[ i * ImageDimension + d ] );
+        }
+      }
+      this->m_Progress->CompletedPixel();
+    }
+
+
+  };
+
+private:
+
+  TransformToDisplacementFieldSource( const Self & ); // purposely not implemented
+  void operator=( const Self & );                     // purposely not implemented
+
+  /** Member variables. */
+  RegionType           m_OutputRegion;    // region of the output image
+  TransformPointerType m_Transform;       // Coordinate transform to use
+  SpacingType          m_OutputSpacing;   // output image spacing
+  OriginType           m_OutputOrigin;    // output image origin
+  DirectionType        m_OutputDirection; // output image direction cosines
+  bool                 m_UseSeparableBSplineEvaluation;
+
+  typename EvaluatorType::Pointer m_Evaluator;
+
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkTransformToDisplacementFieldSource.hxx"
+#endif
+
+#endif // end #ifndef __itkTransformToDisplacementFieldSource_h
@@ -0,0 +1,275 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkTransformToDisplacementFieldSource_hxx
+#define __itkTransformToDisplacementFieldSource_hxx
+
+#include "itkTransformToDisplacementFieldSource.h"
+
+#include "itkAdvancedIdentityTransform.h"
+
+namespace itk
+{
+
+/**
+ * ********************* Constructor ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::TransformToDisplacementFieldSource()
+{
+  this->m_OutputSpacing.Fill( 1.0 );
+  this->m_OutputOrigin.Fill( 0.0 );
+  this->m_OutputDirection.SetIdentity();
+
+  SizeType size;
+  size.Fill( 0 );
+  this->m_OutputRegion.SetSize( size );
+
+  IndexType index;
+  index.Fill( 0 );
+  this->m_OutputRegion.SetIndex( index );
+
+  this->m_Transform = AdvancedIdentityTransform< TTransformPrecisionType, ImageDimension >::New();
+
+  this->m_UseSeparableBSplineEvaluation = true;
+  this->m_Evaluator                     = EvaluatorType::New();
+
+#if ITK_VERSION_MAJOR >= 5
+  // Use the classic (ITK4) threading model, to ensure ThreadedGenerateData is being called.
+  this->itk::ImageSource< TOutputImage >::DynamicMultiThreadingOff();
+#endif
+
+} // end Constructor
+
+
+/**
+ * ********************* PrintSelf ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+void
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "OutputRegion: " << this->m_OutputRegion << std::endl;
+  os << indent << "OutputSpacing: " << this->m_OutputSpacing << std::endl;
+  os << indent << "OutputOrigin: " << this->m_OutputOrigin << std::endl;
+  os << indent << "OutputDirection: " << this->m_OutputDirection << std::endl;
+  os << indent << "Transform: " << this->m_Transform.GetPointer() << std::endl;
+  os << indent << "UseSeparableBSplineEvaluation: "
+     << this->m_UseSeparableBSplineEvaluation << std::endl;
+
+} // end PrintSelf()
+
+
+/**
+ * ********************* SetOutputSize ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+void
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::SetOutputSize( const SizeType & size )
+{
+  this->m_OutputRegion.SetSize( size );
+  this->Modified();
+
+} // end SetOutputSize()
+
+
+/**
+ * ********************* GetOutputSize ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+const typename TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::SizeType
+& TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::GetOutputSize()
+{
+  return this->m_OutputRegion.GetSize();
+
+} // end GetOutputSize()
+
+
+/**
+ * ********************* SetOutputIndex ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+void
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::SetOutputIndex( const IndexType & index )
+{
+  this->m_OutputRegion.SetIndex( index );
+  this->Modified();
+
+} // end SetOutputIndex()
+
+
+/**
+ * ********************* GetOutputIndex ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+const typename TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::IndexType
+& TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::GetOutputIndex()
+{
+  return this->m_OutputRegion.GetIndex();
+
+} // end GetOutputIndex()
+
+
+/**
+ * ********************* SetOutputParametersFromImage ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+void
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::SetOutputParametersFromImage( const ImageBaseType * image )
+{
+  if( !image )
+  {
+    itkExceptionMacro( << "Cannot use a null image reference" );
+  }
+
+  this->SetOutputOrigin( image->GetOrigin() );
+  this->SetOutputSpacing( image->GetSpacing() );
+  this->SetOutputDirection( image->GetDirection() );
+  this->SetOutputRegion( image->GetLargestPossibleRegion() );
+
+} // end SetOutputParametersFromImage()
+
+
+/**
+ * ********************* GenerateOutputInformation ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+void
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::GenerateOutputInformation( void )
+{
+  // call the superclass' implementation of this method
+  Superclass::GenerateOutputInformation();
+
+  // get pointer to the output
+  OutputImagePointer outputPtr = this->GetOutput();
+  if( !outputPtr )
+  {
+    return;
+  }
+
+  outputPtr->SetLargestPossibleRegion( this->m_OutputRegion );
+  outputPtr->SetSpacing( this->m_OutputSpacing );
+  outputPtr->SetOrigin( this->m_OutputOrigin );
+  outputPtr->SetDirection( this->m_OutputDirection );
+
+} // end GenerateOutputInformation()
+
+
+/**
+ * ********************* BeforeThreadedGenerateData ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+void
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::BeforeThreadedGenerateData( void )
+{
+  if( !this->m_Transform )
+  {
+    itkExceptionMacro( << "Transform not set" );
+  }
+
+  /** Decompose the transform, and compute the weights of the B-splines. */
+  this->m_Evaluator->SetTransform( this->m_Transform );
+  this->m_Evaluator->SetRegion( this->m_OutputRegion );
+  this->m_Evaluator->SetSpacing( this->m_OutputSpacing );
+  this->m_Evaluator->SetOrigin( this->m_OutputOrigin );
+  this->m_Evaluator->SetDirection( this->m_OutputDirection );
+  this->m_Evaluator->SetComputeSpatialJacobian( false );
+  this->m_Evaluator->SetUseSeparableBSplineEvaluation( this->m_UseSeparableBSplineEvaluation );
+  this->m_Evaluator->Initialize();
+
+} // end BeforeThreadedGenerateData()
+
+
+/**
+ * ********************* ThreadedGenerateData ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+void
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::ThreadedGenerateData(
+  const OutputImageRegionType & outputRegionForThread,
+  ThreadIdType threadId )
+{
+  if( outputRegionForThread.GetNumberOfPixels() == 0 )
+  {
+    return;
+  }
+
+  /** Report progress per row. */
+  const SizeValueType numberOfRows
+    = outputRegionForThread.GetNumberOfPixels() / outputRegionForThread.GetSize()[ 0 ];
+  ProgressReporter progress( this, threadId, numberOfRows );
+
+  RowWriterType rowWriter;
+  rowWriter.m_Output   = this->GetOutput();
+  rowWriter.m_RowSize  = outputRegionForThread.GetSize()[ 0 ];
+  rowWriter.m_Progress = &progress;
+  this->m_Evaluator->EvaluateRegion( outputRegionForThread, rowWriter );
+
+} // end ThreadedGenerateData()
+
+
+/**
+ * ********************* GetMTime ****************************
+ */
+
+template< class TOutputImage, class TTransformPrecisionType >
+ModifiedTimeType
+TransformToDisplacementFieldSource< TOutputImage, TTransformPrecisionType >
+::GetMTime( void ) const
+{
+  ModifiedTimeType latestTime = Object::GetMTime();
+
+  if( this->m_Transform )
+  {
+    if( latestTime < this->m_Transform->GetMTime() )
+    {
+      latestTime = this->m_Transform->GetMTime();
+    }
+  }
+
+  return latestTime;
+
+} // end GetMTime()
+
+
+} // end namespace itk
+
+#endif // end #ifndef __itkTransformToDisplacementFieldSource_hxx
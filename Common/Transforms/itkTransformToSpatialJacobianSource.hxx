@@ -22,7 +22,6 @@
 
 #include "itkAdvancedIdentityTransform.h"
 #include "itkProgressReporter.h"
-#include "itkImageRegionIteratorWithIndex.h"
 #include "vnl/vnl_copy.h"
 
 namespace itk
@@ -49,6 +48,9 @@ TransformToSpatialJacobianSource< TOutputImage, TTransformPrecisionType >
 
   this->m_Transform = AdvancedIdentityTransform< TTransformPrecisionType, ImageDimension >::New();
 
+  this->m_UseSeparableBSplineEvaluation = true;
+  this->m_Evaluator                     = EvaluatorType::New();
+
   // Check if the output pixel type is valid
   // TODO: should maybe be done at compile time, using concept checking.
   const unsigned int pixrow  = PixelType::RowDimensions;
@@ -85,6 +87,8 @@ TransformToSpatialJacobianSource< TOutputImage, TTransformPrecisionType >
   os << indent << "OutputOrigin: " << this->m_OutputOrigin << std::endl;
   os << indent << "OutputDirection: " << this->m_OutputDirection << std::endl;
   os << indent << "Transform: " << this->m_Transform.GetPointer() << std::endl;
+  os << indent << "UseSeparableBSplineEvaluation: "
+     << this->m_UseSeparableBSplineEvaluation << std::endl;
 
 } // end PrintSelf()
 
@@ -205,8 +209,19 @@ TransformToSpatialJacobianSource< TOutputImage, TTransformPrecisionType >
   if( this->m_Transform->IsLinear() )
   {
     this->LinearGenerateData();
+    return;
   }
 
+  // Otherwise decompose the transform, and compute the weights of the B-splines.
+  this->m_Evaluator->SetTransform( this->m_Transform );
+  this->m_Evaluator->SetRegion( this->m_OutputRegion );
+  this->m_Evaluator->SetSpacing( this->m_OutputSpacing );
+  this->m_Evaluator->SetOrigin( this->m_OutputOrigin );
+  this->m_Evaluator->SetDirection( this->m_OutputDirection );
+  this->m_Evaluator->SetComputeSpatialJacobian( true );
+  this->m_Evaluator->SetUseSeparableBSplineEvaluation( this->m_UseSeparableBSplineEvaluation );
+  this->m_Evaluator->Initialize();
+
 } // end BeforeThreadedGenerateData()
 
 
@@ -241,43 +256,22 @@ TransformToSpatialJacobianSource< TOutputImage, TTransformPrecisionType >
   const OutputImageRegionType & outputRegionForThread,
   ThreadIdType threadId )
 {
-  // Get the output pointer
-  OutputImagePointer outputPtr = this->GetOutput();
-
-  // Create an iterator that will walk the output region for this thread.
-  typedef ImageRegionIteratorWithIndex< TOutputImage > OutputIteratorType;
-  OutputIteratorType it( outputPtr, outputRegionForThread );
-  it.GoToBegin();
-
-  // pixel coordinates
-  PointType point;
-
-  // Support for progress methods/callbacks
-  ProgressReporter progress( this, threadId, outputRegionForThread.GetNumberOfPixels() );
-
-  SpatialJacobianType sj;
-  PixelType           sjOut;
-  const unsigned int  nrElements = sj.GetVnlMatrix().size();
-
-  // Walk the output region
-  while( !it.IsAtEnd() )
+  if( outputRegionForThread.GetNumberOfPixels() == 0 )
   {
-    // Determine the coordinates of the current voxel
-    outputPtr->TransformIndexToPhysicalPoint( it.GetIndex(), point );
-
-    this->m_Transform->GetSpatialJacobian( point, sj );
-
-    // cast spatial jacobian to output pixel type
-    vnl_copy( sj.GetVnlMatrix().begin(), sjOut.GetVnlMatrix().begin(),
-      nrElements );
+    return;
+  }
 
-    // Set it
-    it.Set( sjOut );
+  // Support for progress methods/callbacks, per row
+  const SizeValueType numberOfRows
+    = outputRegionForThread.GetNumberOfPixels() / outputRegionForThread.GetSize()[ 0 ];
+  ProgressReporter progress( this, threadId, numberOfRows );
 
-    // Update progress and iterator
-    progress.CompletedPixel();
-    ++it;
-  }
+  // Evaluate the spatial Jacobian row by row
+  RowWriterType rowWriter;
+  rowWriter.m_Output   = this->GetOutput();
+  rowWriter.m_RowSize  = outputRegionForThread.GetSize()[ 0 ];
+  rowWriter.m_Progress = &progress;
+  this->m_Evaluator->EvaluateRegion( outputRegionForThread, rowWriter );
 
 } // end NonlinearThreadedGenerateData()
 
@@ -335,7 +329,6 @@ TransformToSpatialJacobianSource< TOutputImage, TTransformPrecisionType >
   outputPtr->SetSpacing( m_OutputSpacing );
   outputPtr->SetOrigin( m_OutputOrigin );
   outputPtr->SetDirection( m_OutputDirection );
-  outputPtr->Allocate();
 
 } // end GenerateOutputInformation()
 
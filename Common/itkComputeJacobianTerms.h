@@ -22,6 +22,12 @@
 #include "itkImageRandomSamplerBase.h"
 #include "itkImageRandomCoordinateSampler.h"
 #include "itkScaledSingleValuedNonLinearOptimizer.h"
+#include "itkMultiThreader.h"
+
+#include "vnl/vnl_diag_matrix.h"
+#include "vnl/vnl_sparse_matrix.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -31,6 +37,11 @@ namespace itk
  * More specifically this class computes the Jacobian terms related to the automatic
  * parameter estimation for the adaptive stochastic gradient descent optimizer.
  * Details can be found in the paper.
+ *
+ * By default the terms are computed multi-threaded: the threads accumulate
+ * the covariance matrix C over their own part of the samples, then sum the
+ * thread contributions over their own block of rows of C, and finally compute
+ * the maxima over their own part of the samples again.
  */
 
 template< class TFixedImage, class TTransform >
@@ -103,14 +114,50 @@ public:
   /** Get the region over which the metric will be computed. */
   itkGetConstReferenceMacro( FixedImageRegion, FixedImageRegionType );
 
-  /** The main functions that performs the computation. */
+  /** The main function that performs the multi-threaded computation. */
   virtual void Compute( double & TrC, double & TrCC,
     double & maxJJ, double & maxJCJ );
 
+  /** The main function that performs the single-threaded computation. */
+  virtual void ComputeSingleThreaded( double & TrC, double & TrCC,
+    double & maxJJ, double & maxJCJ );
+
+  /** Set the number of threads. */
+  void SetNumberOfThreads( ThreadIdType numberOfThreads )
+  {
+    this->m_Threader->SetNumberOfThreads( numberOfThreads );
+  }
+
+
+  /** Set/Get whether to use the multi-threaded computation. Default: true. */
+  itkSetMacro( UseMultiThread, bool );
+  itkGetConstMacro( UseMultiThread, bool );
+
 protected:
 
   ComputeJacobianTerms();
-  virtual ~ComputeJacobianTerms() {}
+  virtual ~ComputeJacobianTerms();
+
+  /** Typedefs for multi-threading. */
+  typedef itk::MultiThreader             ThreaderType;
+  typedef ThreaderType::ThreadInfoStruct ThreadInfoType;
+
+  /** Typedefs for the covariance matrix. The elements of the most occurring
+   * bands are stored in a band matrix, the others in a sparse matrix.
+   */
+  typedef double                                   CovarianceValueType;
+  typedef Array2D< CovarianceValueType >           CovarianceMatrixType;
+  typedef vnl_sparse_matrix< CovarianceValueType > SparseCovarianceMatrixType;
+  typedef SparseCovarianceMatrixType::row          SparseRowType;
+  typedef vnl_diag_matrix< CovarianceValueType >   DiagCovarianceMatrixType;
+  typedef std::vector< unsigned int >              BandCovarianceMapType;
+
+  /** The band matrix is stored in blocks of BandCovarianceBlockSize rows,
+   * which are only allocated when a sample contributes to them, so that a
+   * thread only holds the rows of the parameters that its samples touch.
+   */
+  itkStaticConstMacro( BandCovarianceBlockSize, unsigned int, 64 );
+  typedef std::vector< std::vector< CovarianceValueType > > BandCovarianceMatrixType;
 
   typename FixedImageType::ConstPointer m_FixedImage;
   FixedImageRegionType       m_FixedImageRegion;
@@ -119,9 +166,10 @@ protected:
   ScalesType                 m_Scales;
   bool                       m_UseScales;
 
-  unsigned int  m_MaxBandCovSize;
-  unsigned int  m_NumberOfBandStructureSamples;
-  SizeValueType m_NumberOfJacobianMeasurements;
+  unsigned int          m_MaxBandCovSize;
+  unsigned int          m_NumberOfBandStructureSamples;
+  SizeValueType         m_NumberOfJacobianMeasurements;
+  ThreaderType::Pointer m_Threader;
 
   typedef typename  FixedImageType::IndexType   FixedImageIndexType;
   typedef typename  FixedImageType::PointType   FixedImagePointType;
@@ -151,6 +199,101 @@ protected:
   virtual void SampleFixedImageForJacobianTerms(
     ImageSampleContainerPointer & sampleContainer );
 
+  /** Guess the band structure of the covariance matrix from a few samples.
+   * bandcovMap maps a parameter number difference q-p to a column of the
+   * band matrix, or to bandcovMap2.size() if q-p is not stored in the band
+   * matrix; bandcovMap2 maps a column of the band matrix back to q-p.
+   */
+  virtual void ComputeBandStructure(
+    const ImageSampleContainerType * sampleContainer,
+    BandCovarianceMapType & bandcovMap,
+    BandCovarianceMapType & bandcovMap2 ) const;
+
+  /** Add the upper triangular part of J_j^T J_j / n, summed over samples
+   * with the same nonzero Jacobian indices, to the band or the sparse matrix.
+   */
+  void UpdateCovarianceMatrix( const CovarianceMatrixType & jactjac,
+    const NonZeroJacobianIndicesType & jacind, const double n,
+    const BandCovarianceMapType & bandcovMap, const unsigned int bandcovsize,
+    BandCovarianceMatrixType & bandcov, SparseCovarianceMatrixType & cov ) const;
+
+  /** Compute ||J_j||_F^2 + 2\sqrt{2} || J_j J_j^T ||_F and
+   * Tr( J_j C J_j^T ) + 2\sqrt{2} || J_j C J_j^T ||_F for a range of samples,
+   * and return their maxima.
+   */
+  void ComputeMaximumJacobianTerms(
+    const SizeValueType pos_begin, const SizeValueType pos_end,
+    double & maxJJ, double & maxJCJ );
+
+  /** Launch MultiThread Compute. */
+  void LaunchComputeThreaderCallback( void ) const;
+
+  /** Compute threader callback function. */
+  static ITK_THREAD_RETURN_TYPE ComputeThreaderCallback( void * arg );
+
+  /** The threaded implementation of Compute(): calls one of the functions
+   * below, depending on m_ThreadedComputeStage.
+   */
+  virtual inline void ThreadedCompute( ThreadIdType threadID );
+
+  /** Accumulate the covariance matrix over the samples of this thread. */
+  virtual void ThreadedComputeCovariance( ThreadIdType threadID );
+
+  /** Sum the covariance matrices of all threads over the rows of this thread,
+   * apply the scales, and compute the contributions to TrC and TrCC.
+   */
+  virtual void ThreadedReduceCovariance( ThreadIdType threadID );
+
+  /** Compute maxJJ and maxJCJ over the samples of this thread. */
+  virtual void ThreadedComputeMaximumJacobianTerms( ThreadIdType threadID );
+
+  /** Initialize some multi-threading related parameters. */
+  virtual void InitializeThreadingParameters( void );
+
+  /** Get the range [begin, end) of the part of size items of this thread. */
+  void GetThreadRange( const SizeValueType size, const ThreadIdType threadID,
+    SizeValueType & pos_begin, SizeValueType & pos_end ) const;
+
+  /** To give the threads access to all member variables and functions. */
+  struct MultiThreaderParameterType
+  {
+    Self * st_Self;
+  };
+  mutable MultiThreaderParameterType m_ThreaderParameters;
+
+  struct ComputePerThreadStruct
+  {
+    /**  Used for accumulating variables. */
+    BandCovarianceMatrixType   st_BandCovariance;
+    SparseCovarianceMatrixType st_Covariance;
+    double                     st_TrC;
+    double                     st_TrCC;
+    double                     st_MaxJJ;
+    double                     st_MaxJCJ;
+  };
+  itkPadStruct( ITK_CACHE_LINE_ALIGNMENT, ComputePerThreadStruct,
+    PaddedComputePerThreadStruct );
+  itkAlignedTypedef( ITK_CACHE_LINE_ALIGNMENT, PaddedComputePerThreadStruct,
+    AlignedComputePerThreadStruct );
+  mutable AlignedComputePerThreadStruct * m_ComputePerThreadVariables;
+  mutable ThreadIdType                    m_ComputePerThreadVariablesSize;
+
+  /** The stage of the multi-threaded computation. */
+  enum ThreadedComputeStageType
+  {
+    CovarianceStage,
+    ReductionStage,
+    MaximumJacobianTermsStage
+  };
+
+  bool                        m_UseMultiThread;
+  ThreadedComputeStageType    m_ThreadedComputeStage;
+  ImageSampleContainerPointer m_SampleContainer;
+  BandCovarianceMapType       m_BandCovarianceMap;
+  BandCovarianceMapType       m_BandCovarianceMap2;
+  SparseCovarianceMatrixType  m_Covariance;
+  DiagCovarianceMatrixType    m_DiagonalCovariance;
+
 private:
 
   ComputeJacobianTerms( const Self & ); // purposely not implemented
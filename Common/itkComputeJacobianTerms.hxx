@@ -22,8 +22,8 @@
 
 #include "vnl/vnl_math.h"
 #include "vnl/vnl_fastops.h"
-#include "vnl/vnl_diag_matrix.h"
-#include "vnl/vnl_sparse_matrix.h"
+
+#include <algorithm>
 
 namespace itk
 {
@@ -44,18 +44,80 @@ ComputeJacobianTerms< TFixedImage, TTransform >
   this->m_MaxBandCovSize               = 0;
   this->m_NumberOfBandStructureSamples = 0;
   this->m_NumberOfJacobianMeasurements = 0;
+  this->m_SampleContainer              = 0;
+
+  /** Threading related variables. */
+  this->m_UseMultiThread       = true;
+  this->m_ThreadedComputeStage = CovarianceStage;
+  this->m_Threader             = ThreaderType::New();
+
+#if ITK_VERSION_MAJOR < 5
+  // Note: This `#if` is a workaround for ITK5, which no longer supports calling
+  // `threader->SetUseThreadPool(false)`. ITK5 does not use thread pools by default.
+  this->m_Threader->SetUseThreadPool( false );
+#endif
+
+  /** Initialize the m_ThreaderParameters. */
+  this->m_ThreaderParameters.st_Self = this;
+
+  // Multi-threading structs
+  this->m_ComputePerThreadVariables     = NULL;
+  this->m_ComputePerThreadVariablesSize = 0;
 
 } // end Constructor
 
 
 /**
- * ************************* Compute ************************
+ * ************************* Destructor ************************
+ */
+
+template< class TFixedImage, class TTransform >
+ComputeJacobianTerms< TFixedImage, TTransform >
+::~ComputeJacobianTerms()
+{
+  delete[] this->m_ComputePerThreadVariables;
+} // end Destructor
+
+
+/**
+ * ************************* InitializeThreadingParameters ************************
  */
 
 template< class TFixedImage, class TTransform >
 void
 ComputeJacobianTerms< TFixedImage, TTransform >
-::Compute( double & TrC, double & TrCC, double & maxJJ, double & maxJCJ )
+::InitializeThreadingParameters( void )
+{
+  const ThreadIdType numberOfThreads = this->m_Threader->GetNumberOfThreads();
+
+  /** Only resize the array of structs when needed. */
+  if( this->m_ComputePerThreadVariablesSize != numberOfThreads )
+  {
+    delete[] this->m_ComputePerThreadVariables;
+    this->m_ComputePerThreadVariables     = new AlignedComputePerThreadStruct[ numberOfThreads ];
+    this->m_ComputePerThreadVariablesSize = numberOfThreads;
+  }
+
+  /** Some initialization. The covariance matrices are sized by the threads. */
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    this->m_ComputePerThreadVariables[ i ].st_TrC    = NumericTraits< double >::Zero;
+    this->m_ComputePerThreadVariables[ i ].st_TrCC   = NumericTraits< double >::Zero;
+    this->m_ComputePerThreadVariables[ i ].st_MaxJJ  = NumericTraits< double >::Zero;
+    this->m_ComputePerThreadVariables[ i ].st_MaxJCJ = NumericTraits< double >::Zero;
+  }
+
+} // end InitializeThreadingParameters()
+
+
+/**
+ * ************************* ComputeSingleThreaded ************************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::ComputeSingleThreaded( double & TrC, double & TrCC, double & maxJJ, double & maxJCJ )
 {
   /** This function computes four terms needed for the automatic parameter
    * estimation. The equation number refers to the IJCV paper.
@@ -73,20 +135,12 @@ ComputeJacobianTerms< TFixedImage, TTransform >
    * Term 4: maxJCJ, see (54)
    */
 
-  typedef double                                   CovarianceValueType;
-  typedef itk::Array2D< CovarianceValueType >      CovarianceMatrixType;
-  typedef vnl_sparse_matrix< CovarianceValueType > SparseCovarianceMatrixType;
-  typedef SparseCovarianceMatrixType::row          SparseRowType;
-  typedef itk::Array< SizeValueType >              NonZeroJacobianIndicesExpandedType;
-  typedef vnl_diag_matrix< CovarianceValueType >   DiagCovarianceMatrixType;
-
   /** Initialize. */
   TrC = TrCC = maxJJ = maxJCJ = 0.0;
 
   /** Get samples. */
-  ImageSampleContainerPointer sampleContainer; // default-constructed (null)
-  SampleFixedImageForJacobianTerms( sampleContainer );
-  const SizeValueType nrofsamples = sampleContainer->Size();
+  this->SampleFixedImageForJacobianTerms( this->m_SampleContainer );
+  const SizeValueType nrofsamples = this->m_SampleContainer->Size();
   const double        n           = static_cast< double >( nrofsamples );
 
   /** Get the number of parameters. */
@@ -103,9 +157,8 @@ ComputeJacobianTerms< TFixedImage, TTransform >
 
   /** Create iterator over the sample container. */
   typename ImageSampleContainerType::ConstIterator iter;
-  typename ImageSampleContainerType::ConstIterator begin = sampleContainer->Begin();
-  typename ImageSampleContainerType::ConstIterator end   = sampleContainer->End();
-  unsigned int samplenr = 0;
+  typename ImageSampleContainerType::ConstIterator begin = this->m_SampleContainer->Begin();
+  typename ImageSampleContainerType::ConstIterator end   = this->m_SampleContainer->End();
 
   /** Variables for nonzerojacobian indices and the Jacobian. */
   NumberOfParametersType sizejacind
@@ -118,14 +171,530 @@ ComputeJacobianTerms< TFixedImage, TTransform >
   NonZeroJacobianIndicesType prevjacind = jacind;
 
   /** Initialize covariance matrix. Sparse, diagonal, and band form. */
-  SparseCovarianceMatrixType cov( P, P );
-  DiagCovarianceMatrixType   diagcov( P, 0.0 );
-  CovarianceMatrixType       bandcov;
+  SparseCovarianceMatrixType & cov = this->m_Covariance;
+  cov.set_size( P, P );
+  this->m_DiagonalCovariance = DiagCovarianceMatrixType( P, 0.0 );
+  DiagCovarianceMatrixType & diagcov = this->m_DiagonalCovariance;
+  BandCovarianceMatrixType   bandcov;
 
   /** For temporary storage of J'J. */
   CovarianceMatrixType jactjac( sizejacind, sizejacind );
   jactjac.Fill( 0.0 );
 
+  /** Try to guess the band structure of the covariance matrix. */
+  this->ComputeBandStructure( this->m_SampleContainer,
+    this->m_BandCovarianceMap, this->m_BandCovarianceMap2 );
+  const BandCovarianceMapType & bandcovMap  = this->m_BandCovarianceMap;
+  const BandCovarianceMapType & bandcovMap2 = this->m_BandCovarianceMap2;
+  const unsigned int            bandcovsize = static_cast< unsigned int >( bandcovMap2.size() );
+
+  /**
+   *    TERM 1
+   *
+   * Loop over image and compute Jacobian.
+   * Compute C = 1/n \sum_i J_i^T J_i
+   * Possibly apply scaling afterwards.
+   */
+  jacind[ 0 ] = 0;
+  if( sizejacind > 1 ) { jacind[ 1 ] = 0; }
+  for( iter = begin; iter != end; ++iter )
+  {
+    /** Read fixed coordinates and get Jacobian J_j. */
+    const FixedImagePointType & point = ( *iter ).Value().m_ImageCoordinates;
+    this->m_Transform->GetJacobian( point, jacj, jacind  );
+
+    /** Skip invalid Jacobians in the beginning, if any. */
+    if( sizejacind > 1 )
+    {
+      if( jacind[ 0 ] == jacind[ 1 ] ) { continue; }
+    }
+
+    if( jacind == prevjacind )
+    {
+      /** Update sum of J_j^T J_j. */
+      vnl_fastops::inc_X_by_AtA( jactjac, jacj );
+    }
+    else
+    {
+      /** The following should only be done after the first sample. */
+      if( iter != begin )
+      {
+        /** Update covariance matrix. */
+        this->UpdateCovarianceMatrix( jactjac, prevjacind, n,
+          bandcovMap, bandcovsize, bandcov, cov );
+      }
+
+      /** Initialize jactjac by J_j^T J_j. */
+      vnl_fastops::AtA( jactjac, jacj );
+
+      /** Remember nonzerojacobian indices. */
+      prevjacind = jacind;
+    } // end else
+
+  } // end iter loop: end computation of covariance matrix
+
+  /** Update covariance matrix once again to include last jactjac updates. */
+  this->UpdateCovarianceMatrix( jactjac, prevjacind, n,
+    bandcovMap, bandcovsize, bandcov, cov );
+
+  /** Copy the bandmatrix into the sparse matrix and empty the bandcov matrix.
+   * \todo: perhaps work further with this bandmatrix instead.
+   */
+  const unsigned int blockSize = Self::BandCovarianceBlockSize;
+  for( unsigned int block = 0; block < bandcov.size(); ++block )
+  {
+    if( bandcov[ block ].empty() ) { continue; }
+    const unsigned int rowEnd = vnl_math_min( P, ( block + 1 ) * blockSize );
+    for( unsigned int p = block * blockSize; p < rowEnd; ++p )
+    {
+      const CovarianceValueType * bandrow
+        = &bandcov[ block ][ ( p - block * blockSize ) * bandcovsize ];
+      for( unsigned int b = 0; b < bandcovsize; ++b )
+      {
+        const double tempval = bandrow[ b ];
+        if( std::abs( tempval ) > 1e-14 )
+        {
+          const unsigned int q = p + bandcovMap2[ b ];
+          cov( p, q ) = tempval;
+        }
+      }
+    }
+  }
+  bandcov.clear();
+
+  /** Apply scales. the use of m_Scales maybe something wrong. */
+  if( this->m_UseScales )
+  {
+    for( unsigned int p = 0; p < P; ++p )
+    {
+      cov.scale_row( p, 1.0 / this->m_Scales[ p ] );
+    }
+    /**  \todo: this might be faster with get_row instead of the iterator */
+    cov.reset();
+    bool notfinished = cov.next();
+    while( notfinished )
+    {
+      const int col = cov.getcolumn();
+      cov( cov.getrow(), col ) /= scales[ col ];
+      notfinished               = cov.next();
+    }
+  }
+
+  /** Compute TrC = trace(C), and diagcov. */
+  for( unsigned int p = 0; p < P; ++p )
+  {
+    if( !cov.empty_row( p ) )
+    {
+      //avoid creation of element if the row is empty
+      CovarianceValueType & covpp = cov( p, p );
+      TrC         += covpp;
+      diagcov[ p ] = covpp;
+    }
+  }
+
+  /**
+   *    TERM 2
+   *
+   * Compute TrCC = ||C||_F^2.
+   */
+  cov.reset();
+  bool notfinished2 = cov.next();
+  while( notfinished2 )
+  {
+    TrCC        += vnl_math_sqr( cov.value() );
+    notfinished2 = cov.next();
+  }
+
+  /** Symmetry: multiply by 2 and subtract sumsqr(diagcov). */
+  TrCC *= 2.0;
+  TrCC -= diagcov.diagonal().squared_magnitude();
+
+  /**
+   *    TERM 3 and 4
+   *
+   * Compute maxJJ and maxJCJ
+   * \li maxJJ = max_j [ ||J_j||_F^2 + 2\sqrt{2} || J_j J_j^T ||_F ]
+   * \li maxJCJ = max_j [ Tr( J_j C J_j^T ) + 2\sqrt{2} || J_j C J_j^T ||_F ]
+   */
+  this->ComputeMaximumJacobianTerms( 0, nrofsamples, maxJJ, maxJCJ );
+
+  /** Release the memory of the covariance matrix. */
+  cov.set_size( 0, 0 );
+
+} // end ComputeSingleThreaded()
+
+
+/**
+ * ************************* Compute ************************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::Compute( double & TrC, double & TrCC, double & maxJJ, double & maxJCJ )
+{
+  /** Option for now to still use the single threaded code. */
+  if( !this->m_UseMultiThread )
+  {
+    return this->ComputeSingleThreaded( TrC, TrCC, maxJJ, maxJCJ );
+  }
+
+  /** Initialize. */
+  TrC = TrCC = maxJJ = maxJCJ = 0.0;
+
+  /** Initialize multi-threading. */
+  this->InitializeThreadingParameters();
+  const ThreadIdType numberOfThreads = this->m_Threader->GetNumberOfThreads();
+
+  /** Get samples and guess the band structure of the covariance matrix. */
+  this->SampleFixedImageForJacobianTerms( this->m_SampleContainer );
+  this->ComputeBandStructure( this->m_SampleContainer,
+    this->m_BandCovarianceMap, this->m_BandCovarianceMap2 );
+
+  /** TERM 1: each thread accumulates C over its own samples. */
+  this->m_ThreadedComputeStage = CovarianceStage;
+  this->LaunchComputeThreaderCallback();
+
+  /** Each thread sums the contributions to its own rows of C, and computes
+   * its part of TERM 2. The rows of a vnl_sparse_matrix are independent,
+   * so the threads can fill them simultaneously.
+   */
+  const unsigned int P = static_cast< unsigned int >(
+    this->m_Transform->GetNumberOfParameters() );
+  this->m_Covariance.set_size( P, P );
+  this->m_DiagonalCovariance = DiagCovarianceMatrixType( P, 0.0 );
+  this->m_ThreadedComputeStage = ReductionStage;
+  this->LaunchComputeThreaderCallback();
+
+  /** Gather TrC and TrCC, and release the memory of the thread matrices. */
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    TrC  += this->m_ComputePerThreadVariables[ i ].st_TrC;
+    TrCC += this->m_ComputePerThreadVariables[ i ].st_TrCC;
+    this->m_ComputePerThreadVariables[ i ].st_BandCovariance.clear();
+    this->m_ComputePerThreadVariables[ i ].st_Covariance.set_size( 0, 0 );
+  }
+
+  /** Symmetry: multiply by 2 and subtract sumsqr(diagcov). */
+  TrCC *= 2.0;
+  TrCC -= this->m_DiagonalCovariance.diagonal().squared_magnitude();
+
+  /** TERMS 3 and 4: each thread computes the maxima over its own samples. */
+  this->m_ThreadedComputeStage = MaximumJacobianTermsStage;
+  this->LaunchComputeThreaderCallback();
+
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    maxJJ  = vnl_math_max( maxJJ, this->m_ComputePerThreadVariables[ i ].st_MaxJJ );
+    maxJCJ = vnl_math_max( maxJCJ, this->m_ComputePerThreadVariables[ i ].st_MaxJCJ );
+  }
+
+  /** Release the memory of the covariance matrix. */
+  this->m_Covariance.set_size( 0, 0 );
+
+} // end Compute()
+
+
+/**
+ * *********************** LaunchComputeThreaderCallback***************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::LaunchComputeThreaderCallback( void ) const
+{
+  /** Setup threader. */
+  this->m_Threader->SetSingleMethod( this->ComputeThreaderCallback,
+    const_cast< void * >( static_cast< const void * >( &this->m_ThreaderParameters ) ) );
+
+  /** Launch. */
+  this->m_Threader->SingleMethodExecute();
+
+} // end LaunchComputeThreaderCallback()
+
+
+/**
+ * ************ ComputeThreaderCallback ****************************
+ */
+
+template< class TFixedImage, class TTransform >
+ITK_THREAD_RETURN_TYPE
+ComputeJacobianTerms< TFixedImage, TTransform >
+::ComputeThreaderCallback( void * arg )
+{
+  /** Get the current thread id and user data. */
+  ThreadInfoType *             infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType                 threadID   = infoStruct->ThreadID;
+  MultiThreaderParameterType * temp
+    = static_cast< MultiThreaderParameterType * >( infoStruct->UserData );
+
+  /** Call the real implementation. */
+  temp->st_Self->ThreadedCompute( threadID );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end ComputeThreaderCallback()
+
+
+/**
+ * ************************* ThreadedCompute ************************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::ThreadedCompute( ThreadIdType threadId )
+{
+  switch( this->m_ThreadedComputeStage )
+  {
+    case CovarianceStage:
+      this->ThreadedComputeCovariance( threadId );
+      break;
+    case ReductionStage:
+      this->ThreadedReduceCovariance( threadId );
+      break;
+    case MaximumJacobianTermsStage:
+      this->ThreadedComputeMaximumJacobianTerms( threadId );
+      break;
+  }
+
+} // end ThreadedCompute()
+
+
+/**
+ * ************************* GetThreadRange ************************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::GetThreadRange( const SizeValueType size, const ThreadIdType threadId,
+  SizeValueType & pos_begin, SizeValueType & pos_end ) const
+{
+  const ThreadIdType  numberOfThreads = this->m_Threader->GetNumberOfThreads();
+  const SizeValueType sizePerThread
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( size )
+    / static_cast< double >( numberOfThreads ) ) );
+
+  pos_begin = sizePerThread * threadId;
+  pos_end   = sizePerThread * ( threadId + 1 );
+  pos_begin = ( pos_begin > size ) ? size : pos_begin;
+  pos_end   = ( pos_end > size ) ? size : pos_end;
+
+} // end GetThreadRange()
+
+
+/**
+ * ************************* ThreadedComputeCovariance ************************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::ThreadedComputeCovariance( ThreadIdType threadId )
+{
+  /** Get the samples for this thread. */
+  SizeValueType pos_begin, pos_end;
+  const double  n = static_cast< double >( this->m_SampleContainer->Size() );
+  this->GetThreadRange( this->m_SampleContainer->Size(), threadId, pos_begin, pos_end );
+
+  const unsigned int P = static_cast< unsigned int >(
+    this->m_Transform->GetNumberOfParameters() );
+  const unsigned int outdim      = this->m_Transform->GetOutputSpaceDimension();
+  const unsigned int bandcovsize = static_cast< unsigned int >( this->m_BandCovarianceMap2.size() );
+
+  /** The covariance matrices of this thread. */
+  BandCovarianceMatrixType &   bandcov = this->m_ComputePerThreadVariables[ threadId ].st_BandCovariance;
+  SparseCovarianceMatrixType & cov     = this->m_ComputePerThreadVariables[ threadId ].st_Covariance;
+  bandcov.clear();
+  cov.set_size( P, P );
+
+  /** Variables for nonzerojacobian indices and the Jacobian. */
+  const NumberOfParametersType sizejacind
+    = this->m_Transform->GetNumberOfNonZeroJacobianIndices();
+  JacobianType jacj( outdim, sizejacind );
+  jacj.Fill( 0.0 );
+  NonZeroJacobianIndicesType jacind( sizejacind );
+  jacind[ 0 ] = 0;
+  if( sizejacind > 1 ) { jacind[ 1 ] = 0; }
+  NonZeroJacobianIndicesType prevjacind = jacind;
+
+  /** For temporary storage of J'J. */
+  CovarianceMatrixType jactjac( sizejacind, sizejacind );
+  jactjac.Fill( 0.0 );
+  bool jactjacIsValid = false;
+
+  /** Loop over the samples of this thread, and accumulate C. */
+  for( SizeValueType i = pos_begin; i < pos_end; ++i )
+  {
+    /** Read fixed coordinates and get Jacobian J_j. */
+    const FixedImagePointType & point = this->m_SampleContainer->ElementAt( i ).m_ImageCoordinates;
+    this->m_Transform->GetJacobian( point, jacj, jacind );
+
+    /** Skip invalid Jacobians, if any. */
+    if( sizejacind > 1 )
+    {
+      if( jacind[ 0 ] == jacind[ 1 ] ) { continue; }
+    }
+
+    if( jactjacIsValid && jacind == prevjacind )
+    {
+      /** Update sum of J_j^T J_j. */
+      vnl_fastops::inc_X_by_AtA( jactjac, jacj );
+    }
+    else
+    {
+      if( jactjacIsValid )
+      {
+        this->UpdateCovarianceMatrix( jactjac, prevjacind, n,
+          this->m_BandCovarianceMap, bandcovsize, bandcov, cov );
+      }
+
+      /** Initialize jactjac by J_j^T J_j. */
+      vnl_fastops::AtA( jactjac, jacj );
+      prevjacind     = jacind;
+      jactjacIsValid = true;
+    }
+  }
+
+  /** Include the last jactjac updates. */
+  if( jactjacIsValid )
+  {
+    this->UpdateCovarianceMatrix( jactjac, prevjacind, n,
+      this->m_BandCovarianceMap, bandcovsize, bandcov, cov );
+  }
+
+} // end ThreadedComputeCovariance()
+
+
+/**
+ * ************************* ThreadedReduceCovariance ************************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::ThreadedReduceCovariance( ThreadIdType threadId )
+{
+  /** Get the rows for this thread. */
+  const unsigned int P = static_cast< unsigned int >(
+    this->m_Transform->GetNumberOfParameters() );
+  SizeValueType row_begin, row_end;
+  this->GetThreadRange( P, threadId, row_begin, row_end );
+
+  const ThreadIdType numberOfThreads = this->m_Threader->GetNumberOfThreads();
+  const unsigned int bandcovsize     = static_cast< unsigned int >( this->m_BandCovarianceMap2.size() );
+  const unsigned int blockSize       = Self::BandCovarianceBlockSize;
+  const ScalesType & scales          = this->m_Scales;
+
+  SparseCovarianceMatrixType & cov     = this->m_Covariance;
+  DiagCovarianceMatrixType &   diagcov = this->m_DiagonalCovariance;
+  double                       TrC     = 0.0;
+  double                       TrCC    = 0.0;
+
+  for( unsigned int p = row_begin; p < row_end; ++p )
+  {
+    /** Sum the sparse rows of all threads. */
+    for( ThreadIdType t = 0; t < numberOfThreads; ++t )
+    {
+      SparseRowType & threadrow = this->m_ComputePerThreadVariables[ t ].st_Covariance.get_row( p );
+      for( typename SparseRowType::const_iterator it = threadrow.begin(); it != threadrow.end(); ++it )
+      {
+        cov( p, ( *it ).first ) += ( *it ).second;
+      }
+    }
+
+    /** Sum the band rows of all threads, and copy them into the sparse matrix. */
+    const unsigned int block = p / blockSize;
+    for( unsigned int b = 0; b < bandcovsize; ++b )
+    {
+      double tempval = 0.0;
+      for( ThreadIdType t = 0; t < numberOfThreads; ++t )
+      {
+        const BandCovarianceMatrixType & bandcov = this->m_ComputePerThreadVariables[ t ].st_BandCovariance;
+        if( block < bandcov.size() && !bandcov[ block ].empty() )
+        {
+          tempval += bandcov[ block ][ ( p - block * blockSize ) * bandcovsize + b ];
+        }
+      }
+      if( std::abs( tempval ) > 1e-14 )
+      {
+        const unsigned int q = p + this->m_BandCovarianceMap2[ b ];
+        cov( p, q ) += tempval;
+      }
+    }
+
+    if( cov.empty_row( p ) ) { continue; }
+
+    /** Apply scales. */
+    SparseRowType & covrowp = cov.get_row( p );
+    if( this->m_UseScales )
+    {
+      for( typename SparseRowType::iterator it = covrowp.begin(); it != covrowp.end(); ++it )
+      {
+        ( *it ).second = ( *it ).second / scales[ p ] / scales[ ( *it ).first ];
+      }
+    }
+
+    /** Compute this row's part of TrC = trace(C), and diagcov. */
+    const CovarianceValueType covpp = cov( p, p );
+    TrC         += covpp;
+    diagcov[ p ] = covpp;
+
+    /** Compute this row's part of TrCC = ||C||_F^2. */
+    for( typename SparseRowType::const_iterator it = covrowp.begin(); it != covrowp.end(); ++it )
+    {
+      TrCC += vnl_math_sqr( ( *it ).second );
+    }
+  }
+
+  this->m_ComputePerThreadVariables[ threadId ].st_TrC  = TrC;
+  this->m_ComputePerThreadVariables[ threadId ].st_TrCC = TrCC;
+
+} // end ThreadedReduceCovariance()
+
+
+/**
+ * ************************* ThreadedComputeMaximumJacobianTerms ************************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::ThreadedComputeMaximumJacobianTerms( ThreadIdType threadId )
+{
+  SizeValueType pos_begin, pos_end;
+  this->GetThreadRange( this->m_SampleContainer->Size(), threadId, pos_begin, pos_end );
+
+  this->ComputeMaximumJacobianTerms( pos_begin, pos_end,
+    this->m_ComputePerThreadVariables[ threadId ].st_MaxJJ,
+    this->m_ComputePerThreadVariables[ threadId ].st_MaxJCJ );
+
+} // end ThreadedComputeMaximumJacobianTerms()
+
+
+/**
+ * ************************* ComputeBandStructure ************************
+ */
+
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::ComputeBandStructure( const ImageSampleContainerType * sampleContainer,
+  BandCovarianceMapType & bandcovMap, BandCovarianceMapType & bandcovMap2 ) const
+{
+  const SizeValueType nrofsamples = sampleContainer->Size();
+  const unsigned int  P           = static_cast< unsigned int >(
+    this->m_Transform->GetNumberOfParameters() );
+  const unsigned int outdim = this->m_Transform->GetOutputSpaceDimension();
+
+  /** Variables for nonzerojacobian indices and the Jacobian. */
+  const NumberOfParametersType sizejacind
+    = this->m_Transform->GetNumberOfNonZeroJacobianIndices();
+  JacobianType               jacj( outdim, sizejacind );
+  NonZeroJacobianIndicesType jacind( sizejacind );
+
   typedef std::vector< unsigned int >             DifHistType;
   typedef std::pair< unsigned int, unsigned int > FreqPairType;
   typedef std::vector< FreqPairType >             DifHist2Type;
@@ -200,9 +769,9 @@ ComputeJacobianTerms< TFixedImage, TTransform >
     static_cast< unsigned int >( difHist2.size() ) );
 
   /** Maps parameterNrDifference (q-p) to colnr in bandcov. */
-  std::vector< unsigned int > bandcovMap( P, bandcovsize );
+  bandcovMap.assign( P, bandcovsize );
   /** Maps colnr in bandcov to parameterNrDifference (q-p). */
-  std::vector< unsigned int > bandcovMap2( bandcovsize, P );
+  bandcovMap2.assign( bandcovsize, P );
 
   /** Sort the difHist2 based on the frequencies. */
   std::sort( difHist2.begin(), difHist2.end() );
@@ -216,90 +785,29 @@ ComputeJacobianTerms< TFixedImage, TTransform >
     bandcovMap2[ b ]                 = difHist2It->second;
   }
 
-  /** Initialize band matrix. */
-  bandcov = CovarianceMatrixType( P, bandcovsize );
-  bandcov.Fill( 0.0 );
-
-  /**
-   *    TERM 1
-   *
-   * Loop over image and compute Jacobian.
-   * Compute C = 1/n \sum_i J_i^T J_i
-   * Possibly apply scaling afterwards.
-   */
-  jacind[ 0 ] = 0;
-  if( sizejacind > 1 ) { jacind[ 1 ] = 0; }
-  for( iter = begin; iter != end; ++iter )
-  {
-    /** Print progress 0-50%.
-     *progressObserver->UpdateAndPrintProgress( samplenr );*/
-    ++samplenr;
-
-    /** Read fixed coordinates and get Jacobian J_j. */
-    const FixedImagePointType & point = ( *iter ).Value().m_ImageCoordinates;
-    this->m_Transform->GetJacobian( point, jacj, jacind  );
-
-    /** Skip invalid Jacobians in the beginning, if any. */
-    if( sizejacind > 1 )
-    {
-      if( jacind[ 0 ] == jacind[ 1 ] ) { continue; }
-    }
+} // end ComputeBandStructure()
 
-    if( jacind == prevjacind )
-    {
-      /** Update sum of J_j^T J_j. */
-      vnl_fastops::inc_X_by_AtA( jactjac, jacj );
-    }
-    else
-    {
-      /** The following should only be done after the first sample. */
-      if( iter != begin )
-      {
-        /** Update covariance matrix. */
-        for( unsigned int pi = 0; pi < sizejacind; ++pi )
-        {
-          const unsigned int p = prevjacind[ pi ];
-          for( unsigned int qi = 0; qi < sizejacind; ++qi )
-          {
-            const unsigned int q = prevjacind[ qi ];
-            if( q >= p )
-            {
-              const double tempval = jactjac( pi, qi ) / n;
-              if( std::abs( tempval ) > 1e-14 )
-              {
-                const unsigned int bandindex = bandcovMap[ q - p ];
-                if( bandindex < bandcovsize )
-                {
-                  bandcov( p, bandindex ) += tempval;
-                }
-                else
-                {
-                  cov( p, q ) += tempval;
-                }
-              }
-            }
-          } // qi
-        }   // pi
-      }     // end if
 
-      /** Initialize jactjac by J_j^T J_j. */
-      vnl_fastops::AtA( jactjac, jacj );
-
-      /** Remember nonzerojacobian indices. */
-      prevjacind = jacind;
-    } // end else
-
-  } // end iter loop: end computation of covariance matrix
+/**
+ * ************************* UpdateCovarianceMatrix ************************
+ */
 
-  /** Update covariance matrix once again to include last jactjac updates
-   * \todo: a bit ugly that this loop is copied from above.
-   */
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::UpdateCovarianceMatrix( const CovarianceMatrixType & jactjac,
+  const NonZeroJacobianIndicesType & jacind, const double n,
+  const BandCovarianceMapType & bandcovMap, const unsigned int bandcovsize,
+  BandCovarianceMatrixType & bandcov, SparseCovarianceMatrixType & cov ) const
+{
+  const unsigned int blockSize  = Self::BandCovarianceBlockSize;
+  const unsigned int sizejacind = static_cast< unsigned int >( jacind.size() );
   for( unsigned int pi = 0; pi < sizejacind; ++pi )
   {
-    const unsigned int p = prevjacind[ pi ];
+    const unsigned int p = jacind[ pi ];
     for( unsigned int qi = 0; qi < sizejacind; ++qi )
     {
-      const unsigned int q = prevjacind[ qi ];
+      const unsigned int q = jacind[ qi ];
       if( q >= p )
       {
         const double tempval = jactjac( pi, qi ) / n;
@@ -308,7 +816,17 @@ ComputeJacobianTerms< TFixedImage, TTransform >
           const unsigned int bandindex = bandcovMap[ q - p ];
           if( bandindex < bandcovsize )
           {
-            bandcov( p, bandindex ) += tempval;
+            /** Allocate the block of rows of p on first use. */
+            const unsigned int block = p / blockSize;
+            if( block >= bandcov.size() )
+            {
+              bandcov.resize( block + 1 );
+            }
+            if( bandcov[ block ].empty() )
+            {
+              bandcov[ block ].assign( blockSize * bandcovsize, 0.0 );
+            }
+            bandcov[ block ][ ( p - block * blockSize ) * bandcovsize + bandindex ] += tempval;
           }
           else
           {
@@ -319,77 +837,37 @@ ComputeJacobianTerms< TFixedImage, TTransform >
     } // qi
   }   // pi
 
-  /** Copy the bandmatrix into the sparse matrix and empty the bandcov matrix.
-   * \todo: perhaps work further with this bandmatrix instead.
-   */
-  for( unsigned int p = 0; p < P; ++p )
-  {
-    for( unsigned int b = 0; b < bandcovsize; ++b )
-    {
-      const double tempval = bandcov( p, b );
-      if( std::abs( tempval ) > 1e-14 )
-      {
-        const unsigned int q = p + bandcovMap2[ b ];
-        cov( p, q ) = tempval;
-      }
-    }
-  }
-  bandcov.set_size( 0, 0 );
+} // end UpdateCovarianceMatrix()
 
-  /** Apply scales. the use of m_Scales maybe something wrong. */
-  if( this->m_UseScales )
-  {
-    for( unsigned int p = 0; p < P; ++p )
-    {
-      cov.scale_row( p, 1.0 / this->m_Scales[ p ] );
-    }
-    /**  \todo: this might be faster with get_row instead of the iterator */
-    cov.reset();
-    bool notfinished = cov.next();
-    while( notfinished )
-    {
-      const int col = cov.getcolumn();
-      cov( cov.getrow(), col ) /= scales[ col ];
-      notfinished               = cov.next();
-    }
-  }
 
-  /** Compute TrC = trace(C), and diagcov. */
-  for( unsigned int p = 0; p < P; ++p )
-  {
-    if( !cov.empty_row( p ) )
-    {
-      //avoid creation of element if the row is empty
-      CovarianceValueType & covpp = cov( p, p );
-      TrC         += covpp;
-      diagcov[ p ] = covpp;
-    }
-  }
+/**
+ * ************************* ComputeMaximumJacobianTerms ************************
+ */
 
-  /**
-   *    TERM 2
-   *
-   * Compute TrCC = ||C||_F^2.
-   */
-  cov.reset();
-  bool notfinished2 = cov.next();
-  while( notfinished2 )
-  {
-    TrCC        += vnl_math_sqr( cov.value() );
-    notfinished2 = cov.next();
-  }
+template< class TFixedImage, class TTransform >
+void
+ComputeJacobianTerms< TFixedImage, TTransform >
+::ComputeMaximumJacobianTerms(
+  const SizeValueType pos_begin, const SizeValueType pos_end,
+  double & maxJJ, double & maxJCJ )
+{
+  typedef itk::Array< SizeValueType > NonZeroJacobianIndicesExpandedType;
 
-  /** Symmetry: multiply by 2 and subtract sumsqr(diagcov). */
-  TrCC *= 2.0;
-  TrCC -= diagcov.diagonal().squared_magnitude();
+  const unsigned int P = static_cast< unsigned int >(
+    this->m_Transform->GetNumberOfParameters() );
+  const unsigned int outdim = this->m_Transform->GetOutputSpaceDimension();
+  const ScalesType & scales = this->m_Scales;
+
+  SparseCovarianceMatrixType &     cov     = this->m_Covariance;
+  const DiagCovarianceMatrixType & diagcov = this->m_DiagonalCovariance;
+
+  /** Variables for nonzerojacobian indices and the Jacobian. */
+  const NumberOfParametersType sizejacind
+    = this->m_Transform->GetNumberOfNonZeroJacobianIndices();
+  JacobianType jacj( outdim, sizejacind );
+  jacj.Fill( 0.0 );
+  NonZeroJacobianIndicesType jacind( sizejacind );
 
-  /**
-   *    TERM 3 and 4
-   *
-   * Compute maxJJ and maxJCJ
-   * \li maxJJ = max_j [ ||J_j||_F^2 + 2\sqrt{2} || J_j J_j^T ||_F ]
-   * \li maxJCJ = max_j [ Tr( J_j C J_j^T ) + 2\sqrt{2} || J_j C J_j^T ||_F ]
-   */
   maxJJ  = 0.0;
   maxJCJ = 0.0;
   const double sqrt2 = std::sqrt( static_cast< double >( 2.0 ) );
@@ -402,11 +880,10 @@ ComputeJacobianTerms< TFixedImage, TTransform >
   JacobianType                       jacjcovjacj( outdim, outdim );
   NonZeroJacobianIndicesExpandedType jacindExpanded( P );
 
-  samplenr = 0;
-  for( iter = begin; iter != end; ++iter )
+  for( SizeValueType i = pos_begin; i < pos_end; ++i )
   {
     /** Read fixed coordinates and get Jacobian. */
-    const FixedImagePointType & point = ( *iter ).Value().m_ImageCoordinates;
+    const FixedImagePointType & point = this->m_SampleContainer->ElementAt( i ).m_ImageCoordinates;
     this->m_Transform->GetJacobian( point, jacj, jacind  );
 
     /** Apply scales, if necessary. */
@@ -456,8 +933,8 @@ ComputeJacobianTerms< TFixedImage, TTransform >
       const unsigned int p = jacind[ pi ];
       if( !cov.empty_row( p ) )
       {
-        SparseRowType & covrowp = cov.get_row( p );
-        typename SparseRowType::iterator covrowpit;
+        const SparseRowType & covrowp = cov.get_row( p );
+        typename SparseRowType::const_iterator covrowpit;
 
         /** Loop over row p of the sparse cov matrix. */
         for( covrowpit = covrowp.begin(); covrowpit != covrowp.end(); ++covrowpit )
@@ -502,16 +979,9 @@ ComputeJacobianTerms< TFixedImage, TTransform >
     /** Max_j [JCJ_j]. */
     maxJCJ = vnl_math_max( maxJCJ, JCJ_j );
 
-    /** Show progress 50-100%. */
-    //progressObserver->UpdateAndPrintProgress( samplenr + nrofsamples );
-    ++samplenr;
-
   } // end loop over sample container
 
-  /** Finalize progress information. */
-  //progressObserver->PrintProgress( 1.0 );
-
-} // end Compute()
+} // end ComputeMaximumJacobianTerms()
 
 
 /**
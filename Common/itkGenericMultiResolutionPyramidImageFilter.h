@@ -21,6 +21,8 @@
 #include "itkMultiResolutionPyramidImageFilter.h"
 #include "itkSmoothingRecursiveGaussianImageFilter.h"
 
+#include <future>
+
 namespace itk
 {
 /** \class GenericMultiResolutionPyramidImageFilter
@@ -96,7 +98,12 @@ namespace itk
  *
  * The GenericMultiResolutionPyramidImageFilter provides direct control to
  * compute only single level of the pyramid via SetCurrentLevel() and
- * SetComputeOnlyForCurrentLevel() methods.
+ * SetComputeOnlyForCurrentLevel() methods. In that mode the levels that
+ * are not current are released, and with SetComputeNextLevelInBackground()
+ * the next level is computed in a background thread as soon as the current
+ * level has been computed. A registration that walks through the levels in
+ * order then finds the next level ready when it gets there, while at most
+ * two levels are in memory at any time.
  *
  * \author Denis P. Shamonin and Marius Staring. Division of Image Processing,
  * Department of Radiology, Leiden, The Netherlands
@@ -220,6 +227,24 @@ public:
   itkGetConstMacro( ComputeOnlyForCurrentLevel, bool );
   itkBooleanMacro( ComputeOnlyForCurrentLevel );
 
+  /** Set whether the level after the current level is computed in a
+   * background thread, directly after the current level has been computed.
+   * Only used when ComputeOnlyForCurrentLevel is true. Default: false.
+   */
+  itkSetMacro( ComputeNextLevelInBackground, bool );
+  itkGetConstMacro( ComputeNextLevelInBackground, bool );
+  itkBooleanMacro( ComputeNextLevelInBackground );
+
+  /** Get the level that is computed in the background, and the future that
+   * gives its image. Returns false if no level is computed in the background.
+   * Users of the pyramid may wait for the image in a background thread of their
+   * own, to prepare the next level as well. The pyramid may still discard the
+   * image, if the filter or its input changed in the meantime, so the image is
+   * only valid if its pixel container is that of the output of the level.
+   */
+  bool GetNextLevelInBackground( unsigned int & level,
+    std::shared_future< OutputImagePointer > & image ) const;
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   /** Begin concept checking */
   itkConceptMacro( SameDimensionCheck,
@@ -232,7 +257,7 @@ public:
 protected:
 
   GenericMultiResolutionPyramidImageFilter();
-  ~GenericMultiResolutionPyramidImageFilter() {}
+  ~GenericMultiResolutionPyramidImageFilter();
 
   /** PrintSelf. */
   void PrintSelf( std::ostream & os, Indent indent ) const;
@@ -265,6 +290,7 @@ protected:
   SmoothingScheduleType m_SmoothingSchedule;
   unsigned int          m_CurrentLevel;
   bool                  m_ComputeOnlyForCurrentLevel;
+  bool                  m_ComputeNextLevelInBackground;
   bool                  m_SmoothingScheduleDefined;
 
 private:
@@ -302,6 +328,33 @@ private:
     typename ImageToImageFilterSameTypes::Pointer & rescaleSameTypes,
     typename ImageToImageFilterDifferentTypes::Pointer & rescaleDifferentTypes );
 
+  /** Compute a level into an allocated image. The filters are created when
+   * null, and reused otherwise.
+   */
+  void GenerateLevel( const unsigned int level,
+    const InputImageConstPointer & input,
+    const OutputImagePointer & outputPtr,
+    typename SmootherType::Pointer & smoother,
+    typename ImageToImageFilterSameTypes::Pointer & rescaleSameTypes,
+    typename ImageToImageFilterDifferentTypes::Pointer & rescaleDifferentTypes );
+
+  /** Start computing the level after the current level in a background thread. */
+  void StartComputingNextLevel( const InputImageConstPointer & input );
+
+  /** Allocate and compute a level; executed by the background thread. */
+  OutputImagePointer ComputeLevelInBackground( const unsigned int level,
+    InputImagePointer input, OutputImagePointer outputPtr );
+
+  /** Wait for the level computed in the background, and graft it onto the
+   * output of that level. Returns false, and discards the computed level, if
+   * it is not the requested level, or if the filter or its input changed
+   * after it was started.
+   */
+  bool GraftNextLevel( const unsigned int level, const InputImageConstPointer & input );
+
+  /** Wait for the level computed in the background, and discard it. */
+  void DiscardNextLevel( void );
+
   /** Defines Shrink or Resample filters. */
   void DefineShrinkerOrResampler(
     const bool sameType,
@@ -353,6 +406,15 @@ private:
   GenericMultiResolutionPyramidImageFilter( const Self & ); // purposely not implemented
   void operator=( const Self & );                           // purposely not implemented
 
+  /** The level that is computed in the background, and the modification
+   * times of this filter and of its input when it was started.
+   */
+  std::shared_future< OutputImagePointer > m_NextLevelImage;
+  unsigned int                             m_NextLevel;
+  ModifiedTimeType                         m_NextLevelMTime;
+  const InputImageType *                   m_NextLevelInput;
+  ModifiedTimeType                         m_NextLevelInputMTime;
+
 };
 
 } // namespace itk
@@ -30,20 +30,18 @@ namespace // anonymous namespace
  * ******************* UpdateAndGraft ***********************
  */
 
-template< class GenericMultiResolutionPyramidImageFilterType,
-class ImageToImageFilterType, typename OutputImageType >
+template< class ImageToImageFilterType, typename OutputImageType >
 void
 UpdateAndGraft(
-  typename GenericMultiResolutionPyramidImageFilterType::Pointer thisFilter,
   typename ImageToImageFilterType::Pointer & filter,
-  OutputImageType * outImage, const unsigned int ilevel )
+  OutputImageType * outImage )
 {
   filter->GraftOutput( outImage );
 
   // force to always update in case shrink factors are the same
   filter->Modified();
   filter->UpdateLargestPossibleRegion();
-  thisFilter->GraftNthOutput( ilevel, filter->GetOutput() );
+  outImage->Graft( filter->GetOutput() );
 } // end UpdateAndGraft()
 
 
@@ -59,8 +57,13 @@ template< class TInputImage, class TOutputImage, class TPrecisionType >
 GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
 ::GenericMultiResolutionPyramidImageFilter()
 {
-  this->m_CurrentLevel               = 0;
-  this->m_ComputeOnlyForCurrentLevel = false;
+  this->m_CurrentLevel                 = 0;
+  this->m_ComputeOnlyForCurrentLevel   = false;
+  this->m_ComputeNextLevelInBackground = false;
+  this->m_NextLevel                    = 0;
+  this->m_NextLevelMTime               = 0;
+  this->m_NextLevelInput               = 0;
+  this->m_NextLevelInputMTime          = 0;
   SmoothingScheduleType temp( this->GetNumberOfLevels(), ImageDimension );
   temp.Fill( NumericTraits< ScalarRealType >::ZeroValue() );
   this->m_SmoothingSchedule        = temp;
@@ -68,6 +71,20 @@ GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionT
 } // end Constructor
 
 
+/**
+ * ******************* Destructor ***********************
+ */
+
+template< class TInputImage, class TOutputImage, class TPrecisionType >
+GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
+::~GenericMultiResolutionPyramidImageFilter()
+{
+  /** The background thread uses this filter, so it has to finish first. */
+  this->DiscardNextLevel();
+
+} // end Destructor
+
+
 /**
  * ******************* SetNumberOfLevels ***********************
  */
@@ -110,10 +127,18 @@ GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionT
     }
     this->ReleaseOutputs();
 
-    /** Only set the modified flag for this filter if the output is computed per level. */
+    /** Only set the modified flag for this filter if the output is computed per level.
+     * A level that is computed in the background stays valid, as long as nothing
+     * else than the current level was modified since it was started.
+     */
     if( this->m_ComputeOnlyForCurrentLevel )
     {
+      const bool nextLevelIsValid = this->m_NextLevelMTime == this->GetMTime();
       this->Modified();
+      if( nextLevelIsValid )
+      {
+        this->m_NextLevelMTime = this->GetMTime();
+      }
     }
   }
 } // end SetCurrentLevel()
@@ -343,45 +368,217 @@ GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionT
 
     if( this->ComputeForCurrentLevel( level ) )
     {
+      // Use the level that was computed in the background, if any
+      if( this->m_ComputeOnlyForCurrentLevel && this->GraftNextLevel( level, input ) )
+      {
+        continue;
+      }
+
       // Allocate memory for each output
       OutputImagePointer outputPtr = this->GetOutput( level );
       outputPtr->SetBufferedRegion( outputPtr->GetRequestedRegion() );
       outputPtr->Allocate();
 
-      // Setup the smoother
-      const bool smootherIsUsed = this->SetupSmoother( level, smoother, input );
+      this->GenerateLevel( level, input, outputPtr,
+        smoother, rescaleSameTypes, rescaleDifferentTypes );
+    }
+  } // end for ilevel
+
+  // Start on the next level, while the current level is being used
+  if( this->m_ComputeOnlyForCurrentLevel && this->m_ComputeNextLevelInBackground )
+  {
+    this->StartComputingNextLevel( input );
+  }
+} // end GenerateData()
 
-      // Setup the shrinker or resampler
-      const int shrinkerOrResamplerIsUsed = this->SetupShrinkerOrResampler( level,
-        smoother, smootherIsUsed, input, outputPtr,
-        rescaleSameTypes, rescaleDifferentTypes );
 
-      // Update the pipeline and graft or copy results to this filters output
-      if( shrinkerOrResamplerIsUsed == 0 && smootherIsUsed )
-      {
-        UpdateAndGraft< Self, SmootherType, OutputImageType >(
-          this, smoother, outputPtr, level );
-      }
-      else if( shrinkerOrResamplerIsUsed == 0 )
-      {
-        ImageAlgorithm::Copy( input.GetPointer(), outputPtr.GetPointer(),
-          input->GetLargestPossibleRegion(), outputPtr->GetLargestPossibleRegion() );
-      }
-      else if( shrinkerOrResamplerIsUsed == 1 )
-      {
-        UpdateAndGraft< Self, ImageToImageFilterSameTypes, OutputImageType >(
-          this, rescaleSameTypes, outputPtr, level );
-      }
-      else if( shrinkerOrResamplerIsUsed == 2 )
-      {
-        UpdateAndGraft< Self, ImageToImageFilterDifferentTypes, OutputImageType >(
-          this, rescaleDifferentTypes, outputPtr, level );
-      }
-      // no else needed
+/**
+ * ******************* GenerateLevel ***********************
+ */
+
+template< class TInputImage, class TOutputImage, class TPrecisionType >
+void
+GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
+::GenerateLevel( const unsigned int level,
+  const InputImageConstPointer & input,
+  const OutputImagePointer & outputPtr,
+  typename SmootherType::Pointer & smoother,
+  typename ImageToImageFilterSameTypes::Pointer & rescaleSameTypes,
+  typename ImageToImageFilterDifferentTypes::Pointer & rescaleDifferentTypes )
+{
+  // Setup the smoother
+  const bool smootherIsUsed = this->SetupSmoother( level, smoother, input );
+
+  // Setup the shrinker or resampler
+  const int shrinkerOrResamplerIsUsed = this->SetupShrinkerOrResampler( level,
+    smoother, smootherIsUsed, input, outputPtr,
+    rescaleSameTypes, rescaleDifferentTypes );
+
+  // Update the pipeline and graft or copy results to the output
+  if( shrinkerOrResamplerIsUsed == 0 && smootherIsUsed )
+  {
+    UpdateAndGraft< SmootherType, OutputImageType >( smoother, outputPtr );
+  }
+  else if( shrinkerOrResamplerIsUsed == 0 )
+  {
+    ImageAlgorithm::Copy( input.GetPointer(), outputPtr.GetPointer(),
+      input->GetLargestPossibleRegion(), outputPtr->GetLargestPossibleRegion() );
+  }
+  else if( shrinkerOrResamplerIsUsed == 1 )
+  {
+    UpdateAndGraft< ImageToImageFilterSameTypes, OutputImageType >(
+      rescaleSameTypes, outputPtr );
+  }
+  else if( shrinkerOrResamplerIsUsed == 2 )
+  {
+    UpdateAndGraft< ImageToImageFilterDifferentTypes, OutputImageType >(
+      rescaleDifferentTypes, outputPtr );
+  }
+  // no else needed
+
+} // end GenerateLevel()
+
+
+/**
+ * ******************* StartComputingNextLevel ***********************
+ */
+
+template< class TInputImage, class TOutputImage, class TPrecisionType >
+void
+GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
+::StartComputingNextLevel( const InputImageConstPointer & input )
+{
+  this->DiscardNextLevel();
+
+  const unsigned int nextLevel = this->m_CurrentLevel + 1;
+  if( nextLevel >= this->m_NumberOfLevels )
+  {
+    return;
+  }
 
+  /** The background thread works on a graft of the input, without a source,
+   * so that it never runs the upstream pipeline, or changes the requested
+   * region of the input while the current level is used.
+   */
+  InputImagePointer inputGraft = InputImageType::New();
+  inputGraft->Graft( input );
+
+  /** The output information of all levels is already known. */
+  OutputImagePointer nextLevelImage = OutputImageType::New();
+  nextLevelImage->CopyInformation( this->GetOutput( nextLevel ) );
+  nextLevelImage->SetRequestedRegion( this->GetOutput( nextLevel )->GetRequestedRegion() );
+  nextLevelImage->SetBufferedRegion( nextLevelImage->GetRequestedRegion() );
+
+  this->m_NextLevel           = nextLevel;
+  this->m_NextLevelMTime      = this->GetMTime();
+  this->m_NextLevelInput      = input.GetPointer();
+  this->m_NextLevelInputMTime = input->GetMTime();
+  this->m_NextLevelImage      = std::async( std::launch::async,
+    &Self::ComputeLevelInBackground, this, nextLevel, inputGraft, nextLevelImage ).share();
+
+} // end StartComputingNextLevel()
+
+
+/**
+ * ******************* ComputeLevelInBackground ***********************
+ */
+
+template< class TInputImage, class TOutputImage, class TPrecisionType >
+typename GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
+::OutputImagePointer
+GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
+::ComputeLevelInBackground( const unsigned int level,
+  InputImagePointer input, OutputImagePointer outputPtr )
+{
+  /** The filters are local to this thread. */
+  typename SmootherType::Pointer smoother;
+  typename ImageToImageFilterSameTypes::Pointer rescaleSameTypes;
+  typename ImageToImageFilterDifferentTypes::Pointer rescaleDifferentTypes;
+
+  outputPtr->Allocate();
+  this->GenerateLevel( level, input.GetPointer(), outputPtr,
+    smoother, rescaleSameTypes, rescaleDifferentTypes );
+  return outputPtr;
+
+} // end ComputeLevelInBackground()
+
+
+/**
+ * ******************* GraftNextLevel ***********************
+ */
+
+template< class TInputImage, class TOutputImage, class TPrecisionType >
+bool
+GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
+::GraftNextLevel( const unsigned int level, const InputImageConstPointer & input )
+{
+  if( !this->m_NextLevelImage.valid() )
+  {
+    return false;
+  }
+
+  /** Wait for the background thread. Exceptions thrown there are rethrown here. */
+  std::shared_future< OutputImagePointer > nextLevel = std::move( this->m_NextLevelImage );
+  OutputImagePointer                       nextLevelImage = nextLevel.get();
+
+  if( level != this->m_NextLevel
+    || this->m_NextLevelMTime != this->GetMTime()
+    || this->m_NextLevelInput != input.GetPointer()
+    || this->m_NextLevelInputMTime != input->GetMTime() )
+  {
+    return false;
+  }
+
+  this->GraftNthOutput( level, nextLevelImage );
+  return true;
+
+} // end GraftNextLevel()
+
+
+/**
+ * ******************* GetNextLevelInBackground ***********************
+ */
+
+template< class TInputImage, class TOutputImage, class TPrecisionType >
+bool
+GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
+::GetNextLevelInBackground( unsigned int & level,
+  std::shared_future< OutputImagePointer > & image ) const
+{
+  if( !this->m_NextLevelImage.valid() )
+  {
+    return false;
+  }
+
+  level = this->m_NextLevel;
+  image = this->m_NextLevelImage;
+  return true;
+
+} // end GetNextLevelInBackground()
+
+
+/**
+ * ******************* DiscardNextLevel ***********************
+ */
+
+template< class TInputImage, class TOutputImage, class TPrecisionType >
+void
+GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionType >
+::DiscardNextLevel( void )
+{
+  if( this->m_NextLevelImage.valid() )
+  {
+    /** Exceptions of a level that is not used anymore are ignored. */
+    std::shared_future< OutputImagePointer > nextLevel = std::move( this->m_NextLevelImage );
+    try
+    {
+      nextLevel.get();
     }
-  } // end for ilevel
-} // end GenerateData()
+    catch( ... )
+    {}
+  }
+
+} // end DiscardNextLevel()
 
 
 /**
@@ -914,6 +1111,8 @@ GenericMultiResolutionPyramidImageFilter< TInputImage, TOutputImage, TPrecisionT
      << this->m_CurrentLevel << std::endl;
   os << indent << "ComputeOnlyForCurrentLevel: "
      << ( this->m_ComputeOnlyForCurrentLevel ? "true" : "false" ) << std::endl;
+  os << indent << "ComputeNextLevelInBackground: "
+     << ( this->m_ComputeNextLevelInBackground ? "true" : "false" ) << std::endl;
   os << indent << "SmoothingScheduleDefined: "
      << ( this->m_SmoothingScheduleDefined ? "true" : "false" ) << std::endl;
   os << indent << "Smoothing Schedule: ";
@@ -106,7 +106,9 @@ protected:
     localInputImage->Graft( inputImage );
 #endif
 
+    /** When the writer streams, only a piece of the image is buffered. */
     caster->SetInput( localInputImage );
+    caster->GetOutput()->SetRequestedRegion( localInputImage->GetBufferedRegion() );
     caster->Update();
 
     /** return the pixel buffer of the casted image */
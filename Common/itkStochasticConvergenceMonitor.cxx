@@ -0,0 +1,241 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkStochasticConvergenceMonitor.h"
+
+#include <cmath>
+
+namespace itk
+{
+
+/**
+ * ********************* Constructor ****************************
+ */
+
+StochasticConvergenceMonitor
+::StochasticConvergenceMonitor()
+{
+  this->m_WindowSize                  = 100;
+  this->m_MinimumNumberOfIterations   = 0;
+  this->m_RelativeValueTolerance      = 1e-3;
+  this->m_ConfidenceFactor            = 2.0;
+  this->m_GradientMagnitudeTolerance  = 0.0;
+  this->m_SmoothingFactor             = 0.1;
+  this->m_ValidationPatience          = 3;
+  this->m_ValidationRelativeTolerance = 1e-4;
+
+  this->Initialize();
+
+} // end Constructor
+
+
+/**
+ * ********************* Initialize ****************************
+ */
+
+void
+StochasticConvergenceMonitor
+::Initialize( void )
+{
+  this->m_Values.assign( this->m_WindowSize, 0.0 );
+
+  this->m_ConvergenceCriterion                       = NotConverged;
+  this->m_NumberOfIterations                         = 0;
+  this->m_SmoothedValue                              = 0.0;
+  this->m_SmoothedGradientMagnitude                  = 0.0;
+  this->m_MaximumSmoothedGradientMagnitude           = 0.0;
+  this->m_ValueSlope                                 = 0.0;
+  this->m_ValueSlopeStandardError                    = 0.0;
+  this->m_BestValidationValue                        = 0.0;
+  this->m_NumberOfValidationValues                   = 0;
+  this->m_NumberOfValidationValuesWithoutImprovement = 0;
+
+} // end Initialize()
+
+
+/**
+ * ********************* AddIteration ****************************
+ */
+
+void
+StochasticConvergenceMonitor
+::AddIteration( const double value, const double gradientMagnitude )
+{
+  /** The window size may have been changed after Initialize(). */
+  if( this->m_Values.size() != this->m_WindowSize )
+  {
+    this->Initialize();
+  }
+
+  /** Store the value in the circular buffer. */
+  this->m_Values[ this->m_NumberOfIterations % this->m_WindowSize ] = value;
+  ++this->m_NumberOfIterations;
+
+  /** Update the exponential moving averages. */
+  if( this->m_NumberOfIterations == 1 )
+  {
+    this->m_SmoothedValue             = value;
+    this->m_SmoothedGradientMagnitude = gradientMagnitude;
+  }
+  else
+  {
+    const double alpha = this->m_SmoothingFactor;
+    this->m_SmoothedValue             = ( 1.0 - alpha ) * this->m_SmoothedValue + alpha * value;
+    this->m_SmoothedGradientMagnitude = ( 1.0 - alpha ) * this->m_SmoothedGradientMagnitude
+      + alpha * gradientMagnitude;
+  }
+  if( this->m_SmoothedGradientMagnitude > this->m_MaximumSmoothedGradientMagnitude )
+  {
+    this->m_MaximumSmoothedGradientMagnitude = this->m_SmoothedGradientMagnitude;
+  }
+
+  /** The criteria need a full window. */
+  if( this->m_NumberOfIterations < this->m_WindowSize )
+  {
+    return;
+  }
+  const bool valueConverged = this->TestValueConvergence();
+
+  if( this->GetConverged()
+    || this->m_NumberOfIterations < this->m_MinimumNumberOfIterations )
+  {
+    return;
+  }
+
+  if( this->m_RelativeValueTolerance > 0.0 && valueConverged )
+  {
+    this->m_ConvergenceCriterion = ValueConverged;
+  }
+  else if( this->m_GradientMagnitudeTolerance > 0.0
+    && this->m_SmoothedGradientMagnitude
+    <= this->m_GradientMagnitudeTolerance * this->m_MaximumSmoothedGradientMagnitude )
+  {
+    this->m_ConvergenceCriterion = GradientMagnitudeConverged;
+  }
+
+} // end AddIteration()
+
+
+/**
+ * ********************* TestValueConvergence ****************************
+ */
+
+bool
+StochasticConvergenceMonitor
+::TestValueConvergence( void )
+{
+  /** Fit y = mean + slope * ( x - xmean ), with x = 0 for the oldest value
+   * in the window, which is the next one to be overwritten.
+   */
+  const unsigned int  W      = this->m_WindowSize;
+  const SizeValueType oldest = this->m_NumberOfIterations % W;
+  const double        xmean  = 0.5 * ( W - 1 );
+  const double        Sxx    = W * ( static_cast< double >( W ) * W - 1.0 ) / 12.0;
+
+  double ymean = 0.0;
+  double Sxy   = 0.0;
+  for( unsigned int x = 0; x < W; ++x )
+  {
+    const double y = this->m_Values[ ( oldest + x ) % W ];
+    ymean += y;
+    Sxy   += ( x - xmean ) * y;
+  }
+  ymean /= W;
+  const double slope = Sxy / Sxx;
+
+  /** The standard error of the slope, from the residuals of the fit. */
+  double residualSquares = 0.0;
+  for( unsigned int x = 0; x < W; ++x )
+  {
+    const double residual = this->m_Values[ ( oldest + x ) % W ]
+      - ymean - slope * ( x - xmean );
+    residualSquares += residual * residual;
+  }
+  this->m_ValueSlope              = slope;
+  this->m_ValueSlopeStandardError = std::sqrt( residualSquares / ( W - 2 ) / Sxx );
+
+  /** An optimistic estimate of the decrease in the next W iterations. */
+  const double decrease = ( -slope + this->m_ConfidenceFactor * this->m_ValueSlopeStandardError ) * W;
+  return decrease <= this->m_RelativeValueTolerance * std::abs( ymean );
+
+} // end TestValueConvergence()
+
+
+/**
+ * ********************* AddValidationValue ****************************
+ */
+
+void
+StochasticConvergenceMonitor
+::AddValidationValue( const double value )
+{
+  ++this->m_NumberOfValidationValues;
+
+  if( this->m_NumberOfValidationValues == 1
+    || this->m_BestValidationValue - value
+    > this->m_ValidationRelativeTolerance * std::abs( this->m_BestValidationValue ) )
+  {
+    this->m_BestValidationValue                        = value;
+    this->m_NumberOfValidationValuesWithoutImprovement = 0;
+  }
+  else
+  {
+    ++this->m_NumberOfValidationValuesWithoutImprovement;
+  }
+
+  if( !this->GetConverged()
+    && this->m_ValidationPatience > 0
+    && this->m_NumberOfValidationValuesWithoutImprovement >= this->m_ValidationPatience
+    && this->m_NumberOfIterations >= this->m_MinimumNumberOfIterations )
+  {
+    this->m_ConvergenceCriterion = ValidationValueConverged;
+  }
+
+} // end AddValidationValue()
+
+
+/**
+ * ********************* PrintSelf ****************************
+ */
+
+void
+StochasticConvergenceMonitor
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "WindowSize: " << this->m_WindowSize << std::endl;
+  os << indent << "MinimumNumberOfIterations: " << this->m_MinimumNumberOfIterations << std::endl;
+  os << indent << "RelativeValueTolerance: " << this->m_RelativeValueTolerance << std::endl;
+  os << indent << "ConfidenceFactor: " << this->m_ConfidenceFactor << std::endl;
+  os << indent << "GradientMagnitudeTolerance: " << this->m_GradientMagnitudeTolerance << std::endl;
+  os << indent << "SmoothingFactor: " << this->m_SmoothingFactor << std::endl;
+  os << indent << "ValidationPatience: " << this->m_ValidationPatience << std::endl;
+  os << indent << "ValidationRelativeTolerance: " << this->m_ValidationRelativeTolerance << std::endl;
+  os << indent << "ConvergenceCriterion: " << this->m_ConvergenceCriterion << std::endl;
+  os << indent << "NumberOfIterations: " << this->m_NumberOfIterations << std::endl;
+  os << indent << "SmoothedValue: " << this->m_SmoothedValue << std::endl;
+  os << indent << "SmoothedGradientMagnitude: " << this->m_SmoothedGradientMagnitude << std::endl;
+  os << indent << "ValueSlope: " << this->m_ValueSlope << std::endl;
+  os << indent << "ValueSlopeStandardError: " << this->m_ValueSlopeStandardError << std::endl;
+  os << indent << "BestValidationValue: " << this->m_BestValidationValue << std::endl;
+
+} // end PrintSelf()
+
+
+} // end namespace itk
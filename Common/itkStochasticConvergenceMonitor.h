@@ -0,0 +1,212 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkStochasticConvergenceMonitor_h
+#define __itkStochasticConvergenceMonitor_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkIntTypes.h"
+#include "itkNumericTraits.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class StochasticConvergenceMonitor
+ *
+ * \brief Decides when a stochastic optimizer has converged, from the noisy
+ * metric values and gradient magnitudes of its iterations.
+ *
+ * Stochastic gradient descent optimizers compute the metric value and
+ * derivative on a small random set of samples, so a single value says
+ * little about convergence. This class therefore tests statistical
+ * criteria on the history of the optimization, of which each can be
+ * switched off by setting its tolerance to zero:
+ *
+ * \li Value: a straight line is fitted through the metric values of the
+ * last WindowSize iterations. The optimization has converged if even the
+ * upper confidence bound of the decrease per iteration, -slope +
+ * ConfidenceFactor * standardError(slope), predicts a decrease over the
+ * next WindowSize iterations of less than RelativeValueTolerance times
+ * the mean value in the window.
+ * \li Gradient: the exponential moving average of the gradient magnitude
+ * (with weight SmoothingFactor for the newest value) has dropped below
+ * GradientMagnitudeTolerance times its maximum so far.
+ * \li Validation: the caller may add metric values that are computed on a
+ * fixed set of samples now and then, see AddValidationValue(). The
+ * optimization has converged if ValidationPatience consecutive validation
+ * values did not improve the best validation value by more than
+ * ValidationRelativeTolerance times its magnitude.
+ *
+ * No criterion is tested before MinimumNumberOfIterations iterations have
+ * been added. The metric value is assumed to be minimized.
+ *
+ * \ingroup Optimizers
+ */
+
+class StochasticConvergenceMonitor : public Object
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef StochasticConvergenceMonitor Self;
+  typedef Object                       Superclass;
+  typedef SmartPointer< Self >         Pointer;
+  typedef SmartPointer< const Self >   ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( StochasticConvergenceMonitor, Object );
+
+  /** Codes of the criteria that decided the convergence. */
+  typedef enum {
+    NotConverged,
+    ValueConverged,
+    GradientMagnitudeConverged,
+    ValidationValueConverged
+  } ConvergenceCriterionType;
+
+  /** Set/Get the number of iterations in which the trend of the metric
+   * value is estimated. Default: 100.
+   */
+  itkSetClampMacro( WindowSize, unsigned int, 3, NumericTraits< unsigned int >::max() );
+  itkGetConstMacro( WindowSize, unsigned int );
+
+  /** Set/Get the number of iterations before which convergence is never
+   * reported. Default: 0.
+   */
+  itkSetMacro( MinimumNumberOfIterations, SizeValueType );
+  itkGetConstMacro( MinimumNumberOfIterations, SizeValueType );
+
+  /** Set/Get the tolerance of the value criterion. Zero switches the
+   * criterion off. Default: 1e-3.
+   */
+  itkSetMacro( RelativeValueTolerance, double );
+  itkGetConstMacro( RelativeValueTolerance, double );
+
+  /** Set/Get the number of standard errors that is added to the estimated
+   * decrease per iteration in the value criterion. Default: 2.0.
+   */
+  itkSetMacro( ConfidenceFactor, double );
+  itkGetConstMacro( ConfidenceFactor, double );
+
+  /** Set/Get the tolerance of the gradient criterion. Zero switches the
+   * criterion off. Default: 0.
+   */
+  itkSetMacro( GradientMagnitudeTolerance, double );
+  itkGetConstMacro( GradientMagnitudeTolerance, double );
+
+  /** Set/Get the weight of the newest value in the exponential moving
+   * averages. Default: 0.1.
+   */
+  itkSetClampMacro( SmoothingFactor, double, 0.0, 1.0 );
+  itkGetConstMacro( SmoothingFactor, double );
+
+  /** Set/Get the number of validation values without improvement after
+   * which the optimization has converged. Zero switches the criterion off.
+   * Default: 3.
+   */
+  itkSetMacro( ValidationPatience, unsigned int );
+  itkGetConstMacro( ValidationPatience, unsigned int );
+
+  /** Set/Get the relative improvement of the best validation value that
+   * resets the patience. Default: 1e-4.
+   */
+  itkSetMacro( ValidationRelativeTolerance, double );
+  itkGetConstMacro( ValidationRelativeTolerance, double );
+
+  /** Forget the history, for example at the start of a resolution. */
+  void Initialize( void );
+
+  /** Add the metric value and the gradient magnitude of an iteration,
+   * and test the value and gradient criteria.
+   */
+  void AddIteration( const double value, const double gradientMagnitude );
+
+  /** Add a metric value computed on a fixed set of samples, and test the
+   * validation criterion.
+   */
+  void AddValidationValue( const double value );
+
+  /** Get whether the optimization has converged, and by which criterion. */
+  bool GetConverged( void ) const
+  {
+    return this->m_ConvergenceCriterion != NotConverged;
+  }
+
+
+  itkGetConstMacro( ConvergenceCriterion, ConvergenceCriterionType );
+
+  /** Get some statistics of the history. */
+  itkGetConstMacro( NumberOfIterations, SizeValueType );
+  itkGetConstMacro( SmoothedValue, double );
+  itkGetConstMacro( SmoothedGradientMagnitude, double );
+  itkGetConstMacro( ValueSlope, double );
+  itkGetConstMacro( ValueSlopeStandardError, double );
+  itkGetConstMacro( BestValidationValue, double );
+
+protected:
+
+  StochasticConvergenceMonitor();
+  virtual ~StochasticConvergenceMonitor() {}
+
+  void PrintSelf( std::ostream & os, Indent indent ) const;
+
+  /** Fit a straight line through the values in the window, and test the
+   * value criterion.
+   */
+  bool TestValueConvergence( void );
+
+private:
+
+  StochasticConvergenceMonitor( const Self & ); // purposely not implemented
+  void operator=( const Self & );               // purposely not implemented
+
+  /** Settings. */
+  unsigned int  m_WindowSize;
+  SizeValueType m_MinimumNumberOfIterations;
+  double        m_RelativeValueTolerance;
+  double        m_ConfidenceFactor;
+  double        m_GradientMagnitudeTolerance;
+  double        m_SmoothingFactor;
+  unsigned int  m_ValidationPatience;
+  double        m_ValidationRelativeTolerance;
+
+  /** The metric values of the last WindowSize iterations, in a circular buffer. */
+  std::vector< double > m_Values;
+
+  /** State. */
+  ConvergenceCriterionType m_ConvergenceCriterion;
+  SizeValueType            m_NumberOfIterations;
+  double                   m_SmoothedValue;
+  double                   m_SmoothedGradientMagnitude;
+  double                   m_MaximumSmoothedGradientMagnitude;
+  double                   m_ValueSlope;
+  double                   m_ValueSlopeStandardError;
+  double                   m_BestValidationValue;
+  SizeValueType            m_NumberOfValidationValues;
+  unsigned int             m_NumberOfValidationValuesWithoutImprovement;
+
+};
+
+} // end namespace itk
+
+#endif // end #ifndef __itkStochasticConvergenceMonitor_h
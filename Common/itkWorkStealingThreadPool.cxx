@@ -0,0 +1,484 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#include "itkWorkStealingThreadPool.h"
+
+#include "itkMultiThreader.h"
+
+#include <algorithm>
+
+namespace itk
+{
+
+namespace
+{
+/** Set while the current thread executes chunks of a job. Used to detect
+ * (unsupported) nested calls to ParallelFor(). */
+thread_local bool t_InsideWorkStealingJob = false;
+}
+
+/**
+ * ********************* GetInstance ****************************
+ */
+
+WorkStealingThreadPool::Pointer
+WorkStealingThreadPool
+::GetInstance( void )
+{
+  static std::mutex instanceMutex;
+  static Pointer    instance;
+
+  std::lock_guard< std::mutex > lock( instanceMutex );
+  if( instance.IsNull() )
+  {
+    instance = new Self;
+    instance->UnRegister();
+  }
+  return instance;
+
+} // end GetInstance()
+
+
+/**
+ * ********************* Constructor ****************************
+ */
+
+WorkStealingThreadPool
+::WorkStealingThreadPool()
+{
+  this->m_NumberOfWorkers              = 0;
+  this->m_Generation                   = 0;
+  this->m_JobActive                    = false;
+  this->m_Terminate                    = false;
+  this->m_NumberOfActiveWorkers        = 0;
+  this->m_Callback                     = 0;
+  this->m_UserData                     = 0;
+  this->m_NumberOfItems                = 0;
+  this->m_ChunkSize                    = 1;
+  this->m_NumberOfParticipatingWorkers = 0;
+  this->m_ExceptionOccurred            = false;
+  this->m_NumberOfJobs                 = 0;
+  this->m_NumberOfStolenChunks         = 0;
+
+  this->StartWorkers( MultiThreader::GetGlobalDefaultNumberOfThreads() );
+
+} // end Constructor
+
+
+/**
+ * ********************* Destructor ****************************
+ */
+
+WorkStealingThreadPool
+::~WorkStealingThreadPool()
+{
+  this->StopWorkers();
+} // end Destructor
+
+
+/**
+ * ********************* SetNumberOfWorkers ****************************
+ */
+
+void
+WorkStealingThreadPool
+::SetNumberOfWorkers( ThreadIdType numberOfWorkers )
+{
+  numberOfWorkers = std::max( numberOfWorkers, static_cast< ThreadIdType >( 1 ) );
+
+  std::lock_guard< std::mutex > jobLock( this->m_JobMutex );
+  if( numberOfWorkers == this->m_NumberOfWorkers )
+  {
+    return;
+  }
+
+  this->StopWorkers();
+  this->StartWorkers( numberOfWorkers );
+  this->Modified();
+
+} // end SetNumberOfWorkers()
+
+
+/**
+ * ********************* GetNumberOfWorkers ****************************
+ */
+
+ThreadIdType
+WorkStealingThreadPool
+::GetNumberOfWorkers( void ) const
+{
+  return this->m_NumberOfWorkers;
+} // end GetNumberOfWorkers()
+
+
+/**
+ * ********************* StartWorkers ****************************
+ */
+
+void
+WorkStealingThreadPool
+::StartWorkers( ThreadIdType numberOfWorkers )
+{
+  numberOfWorkers = std::max( numberOfWorkers, static_cast< ThreadIdType >( 1 ) );
+
+  this->m_Queues.resize( numberOfWorkers );
+  for( ThreadIdType i = 0; i < numberOfWorkers; ++i )
+  {
+    this->m_Queues[ i ]          = new WorkerQueueType;
+    this->m_Queues[ i ]->m_Begin = 0;
+    this->m_Queues[ i ]->m_End   = 0;
+  }
+  this->m_NumberOfWorkers = numberOfWorkers;
+
+  /** Worker 0 is the thread that calls ParallelFor(). */
+  this->m_Threads.reserve( numberOfWorkers - 1 );
+  for( ThreadIdType i = 1; i < numberOfWorkers; ++i )
+  {
+    this->m_Threads.push_back( std::thread( &Self::WorkerLoop, this, i ) );
+  }
+
+} // end StartWorkers()
+
+
+/**
+ * ********************* StopWorkers ****************************
+ */
+
+void
+WorkStealingThreadPool
+::StopWorkers( void )
+{
+  {
+    std::lock_guard< std::mutex > lock( this->m_StateMutex );
+    this->m_Terminate = true;
+  }
+  this->m_WakeUpCondition.notify_all();
+
+  for( std::size_t i = 0; i < this->m_Threads.size(); ++i )
+  {
+    this->m_Threads[ i ].join();
+  }
+  this->m_Threads.clear();
+
+  for( std::size_t i = 0; i < this->m_Queues.size(); ++i )
+  {
+    delete this->m_Queues[ i ];
+  }
+  this->m_Queues.clear();
+
+  this->m_NumberOfWorkers = 0;
+  this->m_Terminate       = false;
+
+} // end StopWorkers()
+
+
+/**
+ * ********************* WorkerLoop ****************************
+ */
+
+void
+WorkStealingThreadPool
+::WorkerLoop( ThreadIdType workerID )
+{
+  SizeValueType seenGeneration = 0;
+  {
+    std::lock_guard< std::mutex > lock( this->m_StateMutex );
+    seenGeneration = this->m_Generation;
+  }
+
+  while( true )
+  {
+    /** Sleep until there is a new job, or until the pool is stopped. */
+    {
+      std::unique_lock< std::mutex > lock( this->m_StateMutex );
+      while( !this->m_Terminate
+        && !( this->m_JobActive && this->m_Generation != seenGeneration ) )
+      {
+        this->m_WakeUpCondition.wait( lock );
+      }
+      if( this->m_Terminate )
+      {
+        return;
+      }
+
+      seenGeneration = this->m_Generation;
+      if( workerID >= this->m_NumberOfParticipatingWorkers )
+      {
+        continue;
+      }
+      ++this->m_NumberOfActiveWorkers;
+    }
+
+    t_InsideWorkStealingJob = true;
+    this->ExecuteChunks( workerID );
+    t_InsideWorkStealingJob = false;
+
+    {
+      std::lock_guard< std::mutex > lock( this->m_StateMutex );
+      --this->m_NumberOfActiveWorkers;
+    }
+    this->m_DoneCondition.notify_all();
+  }
+
+} // end WorkerLoop()
+
+
+/**
+ * ********************* PopChunk ****************************
+ */
+
+bool
+WorkStealingThreadPool
+::PopChunk( ThreadIdType workerID, SizeValueType & chunk )
+{
+  WorkerQueueType * queue = this->m_Queues[ workerID ];
+
+  std::lock_guard< std::mutex > lock( queue->m_Mutex );
+  if( queue->m_Begin == queue->m_End )
+  {
+    return false;
+  }
+  chunk = queue->m_Begin++;
+  return true;
+
+} // end PopChunk()
+
+
+/**
+ * ********************* StealChunks ****************************
+ */
+
+bool
+WorkStealingThreadPool
+::StealChunks( ThreadIdType workerID )
+{
+  const ThreadIdType numberOfWorkers = this->m_NumberOfParticipatingWorkers;
+
+  /** Visit the other workers in a round robin fashion, starting at the next
+   * one, and take the last half of the first non-empty queue found. */
+  for( ThreadIdType i = 1; i < numberOfWorkers; ++i )
+  {
+    WorkerQueueType * victim = this->m_Queues[ ( workerID + i ) % numberOfWorkers ];
+
+    SizeValueType begin = 0;
+    SizeValueType end   = 0;
+    {
+      std::lock_guard< std::mutex > lock( victim->m_Mutex );
+      const SizeValueType remaining = victim->m_End - victim->m_Begin;
+      if( remaining == 0 )
+      {
+        continue;
+      }
+      end           = victim->m_End;
+      begin         = end - ( remaining + 1 ) / 2;
+      victim->m_End = begin;
+    }
+
+    WorkerQueueType * queue = this->m_Queues[ workerID ];
+    {
+      std::lock_guard< std::mutex > lock( queue->m_Mutex );
+      queue->m_Begin = begin;
+      queue->m_End   = end;
+    }
+    this->m_NumberOfStolenChunks += end - begin;
+    return true;
+  }
+
+  return false;
+
+} // end StealChunks()
+
+
+/**
+ * ********************* ExecuteChunks ****************************
+ */
+
+void
+WorkStealingThreadPool
+::ExecuteChunks( ThreadIdType workerID )
+{
+  while( true )
+  {
+    SizeValueType chunk = 0;
+    if( !this->PopChunk( workerID, chunk ) )
+    {
+      if( this->StealChunks( workerID ) )
+      {
+        continue;
+      }
+      break;
+    }
+
+    /** After an exception the remaining chunks are only drained. */
+    if( this->m_ExceptionOccurred )
+    {
+      continue;
+    }
+
+    const SizeValueType begin = chunk * this->m_ChunkSize;
+    const SizeValueType end   = std::min( begin + this->m_ChunkSize, this->m_NumberOfItems );
+    try
+    {
+      this->m_Callback( this->m_UserData, workerID, begin, end );
+    }
+    catch( ... )
+    {
+      std::lock_guard< std::mutex > lock( this->m_StateMutex );
+      if( !this->m_ExceptionOccurred )
+      {
+        this->m_Exception         = std::current_exception();
+        this->m_ExceptionOccurred = true;
+      }
+    }
+  }
+
+} // end ExecuteChunks()
+
+
+/**
+ * ********************* ParallelFor ****************************
+ */
+
+void
+WorkStealingThreadPool
+::ParallelFor( SizeValueType numberOfItems, SizeValueType chunkSize,
+  ThreadIdType maximumNumberOfWorkers,
+  RangeCallbackType callback, void * userData )
+{
+  if( numberOfItems == 0 )
+  {
+    return;
+  }
+  if( t_InsideWorkStealingJob )
+  {
+    itkExceptionMacro( << "ParallelFor() can not be called from within a job of the same pool." );
+  }
+
+  std::lock_guard< std::mutex > jobLock( this->m_JobMutex );
+
+  /** Determine the number of participating workers and the chunk size. */
+  ThreadIdType numberOfWorkers = this->m_NumberOfWorkers;
+  if( maximumNumberOfWorkers > 0 && maximumNumberOfWorkers < numberOfWorkers )
+  {
+    numberOfWorkers = maximumNumberOfWorkers;
+  }
+  if( chunkSize == 0 )
+  {
+    const SizeValueType numberOfChunksPerWorker = 8;
+    chunkSize = ( numberOfItems + numberOfWorkers * numberOfChunksPerWorker - 1 )
+      / ( numberOfWorkers * numberOfChunksPerWorker );
+  }
+  const SizeValueType numberOfChunks = ( numberOfItems + chunkSize - 1 ) / chunkSize;
+  ++this->m_NumberOfJobs;
+
+  /** Nothing to distribute: do all the work on the calling thread. */
+  if( numberOfWorkers == 1 || numberOfChunks == 1 )
+  {
+    t_InsideWorkStealingJob = true;
+    try
+    {
+      callback( userData, 0, 0, numberOfItems );
+    }
+    catch( ... )
+    {
+      t_InsideWorkStealingJob = false;
+      throw;
+    }
+    t_InsideWorkStealingJob = false;
+    return;
+  }
+
+  /** Give each participating worker an equally sized, contiguous block of chunks. */
+  const SizeValueType chunksPerWorker = numberOfChunks / numberOfWorkers;
+  const SizeValueType remainder       = numberOfChunks % numberOfWorkers;
+  SizeValueType       first           = 0;
+  for( ThreadIdType i = 0; i < this->m_NumberOfWorkers; ++i )
+  {
+    SizeValueType size = 0;
+    if( i < numberOfWorkers )
+    {
+      size = chunksPerWorker + ( i < remainder ? 1 : 0 );
+    }
+    std::lock_guard< std::mutex > lock( this->m_Queues[ i ]->m_Mutex );
+    this->m_Queues[ i ]->m_Begin = first;
+    this->m_Queues[ i ]->m_End   = first + size;
+    first                       += size;
+  }
+
+  /** Publish the job and wake up the workers. */
+  {
+    std::lock_guard< std::mutex > lock( this->m_StateMutex );
+    this->m_Callback                     = callback;
+    this->m_UserData                     = userData;
+    this->m_NumberOfItems                = numberOfItems;
+    this->m_ChunkSize                    = chunkSize;
+    this->m_NumberOfParticipatingWorkers = numberOfWorkers;
+    this->m_Exception                    = std::exception_ptr();
+    this->m_ExceptionOccurred            = false;
+    this->m_JobActive                    = true;
+    ++this->m_Generation;
+  }
+  this->m_WakeUpCondition.notify_all();
+
+  /** The calling thread is worker 0. */
+  t_InsideWorkStealingJob = true;
+  this->ExecuteChunks( 0 );
+  t_InsideWorkStealingJob = false;
+
+  /** Wait until all workers that picked up this job are finished. Workers
+   * that wake up later will find the job inactive. */
+  std::exception_ptr exception;
+  {
+    std::unique_lock< std::mutex > lock( this->m_StateMutex );
+    while( this->m_NumberOfActiveWorkers > 0 )
+    {
+      this->m_DoneCondition.wait( lock );
+    }
+    this->m_JobActive = false;
+    this->m_Callback  = 0;
+    this->m_UserData  = 0;
+    exception         = this->m_Exception;
+    this->m_Exception = std::exception_ptr();
+  }
+
+  if( exception )
+  {
+    std::rethrow_exception( exception );
+  }
+
+} // end ParallelFor()
+
+
+/**
+ * ********************* PrintSelf ****************************
+ */
+
+void
+WorkStealingThreadPool
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+
+  os << indent << "NumberOfWorkers: " << this->m_NumberOfWorkers << std::endl;
+  os << indent << "NumberOfJobs: " << this->m_NumberOfJobs << std::endl;
+  os << indent << "NumberOfStolenChunks: " << this->m_NumberOfStolenChunks.load() << std::endl;
+
+} // end PrintSelf()
+
+
+} // end namespace itk
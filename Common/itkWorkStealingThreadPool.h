@@ -0,0 +1,181 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkWorkStealingThreadPool_h
+#define __itkWorkStealingThreadPool_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkIntTypes.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+namespace itk
+{
+
+/** \class WorkStealingThreadPool
+ *
+ * \brief A persistent pool of worker threads that executes chunked index
+ * ranges with work stealing.
+ *
+ * The itk::MultiThreader creates and joins its threads on every
+ * SingleMethodExecute() call, and gives each thread a fixed, equally sized
+ * part of the work. For the metrics, which are evaluated thousands of times
+ * per resolution, both the thread creation and the imbalance between the
+ * threads (due to masks and samples mapping outside the moving image) are
+ * costly. This class keeps its threads alive between calls, and splits the
+ * index range [0, numberOfItems) into chunks. Every worker starts on its own
+ * contiguous block of chunks, and steals half of the remaining chunks of
+ * another worker when it runs out of work.
+ *
+ * There is a single global instance, obtained with GetInstance(), that is
+ * shared by metrics, samplers and optimizers. The calling thread takes part
+ * in the work as worker 0. A caller can restrict the number of workers that
+ * participate in a job, so that per-thread variables sized to a component's
+ * own number of threads remain valid.
+ *
+ * Jobs from different calling threads are executed one after the other.
+ * ParallelFor() must not be called from within a running job.
+ *
+ * \ingroup ITKSystemObjects
+ */
+
+class WorkStealingThreadPool : public Object
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef WorkStealingThreadPool     Self;
+  typedef Object                     Superclass;
+  typedef SmartPointer< Self >       Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( WorkStealingThreadPool, Object );
+
+  /** The signature of the functions executed by the pool. Each call
+   * processes the items [ begin, end ) on the worker with id workerID,
+   * where 0 <= workerID < the number of participating workers.
+   */
+  typedef void ( *RangeCallbackType )( void * userData,
+    ThreadIdType workerID, SizeValueType begin, SizeValueType end );
+
+  /** Get the global instance; it is created on first use, with
+   * MultiThreader::GetGlobalDefaultNumberOfThreads() workers.
+   */
+  static Pointer GetInstance( void );
+
+  /** Set/Get the number of workers, including the calling thread.
+   * Changing the number of workers restarts the worker threads, so this
+   * should be done only between iterations, e.g. at each resolution.
+   */
+  void SetNumberOfWorkers( ThreadIdType numberOfWorkers );
+  ThreadIdType GetNumberOfWorkers( void ) const;
+
+  /** Execute callback for all items in [0, numberOfItems), in chunks of
+   * chunkSize items. A chunkSize of 0 selects a chunk size that gives each
+   * worker about eight chunks. At most maximumNumberOfWorkers workers
+   * take part; 0 means all workers. Returns after all chunks are done.
+   */
+  void ParallelFor( SizeValueType numberOfItems, SizeValueType chunkSize,
+    ThreadIdType maximumNumberOfWorkers,
+    RangeCallbackType callback, void * userData );
+
+  /** Get the number of jobs executed, and the number of chunks that were
+   * stolen from another worker. Useful for diagnostics and testing. */
+  SizeValueType GetNumberOfJobs( void ) const { return this->m_NumberOfJobs; }
+  SizeValueType GetNumberOfStolenChunks( void ) const { return this->m_NumberOfStolenChunks; }
+
+protected:
+
+  WorkStealingThreadPool();
+  virtual ~WorkStealingThreadPool();
+
+  void PrintSelf( std::ostream & os, Indent indent ) const ITK_OVERRIDE;
+
+private:
+
+  WorkStealingThreadPool( const Self & ); // purposely not implemented
+  void operator=( const Self & );         // purposely not implemented
+
+  /** The chunk range of a single worker. The struct is padded to prevent
+   * false sharing of the range bounds between workers.
+   */
+  struct WorkerQueueType
+  {
+    std::mutex    m_Mutex;
+    SizeValueType m_Begin;
+    SizeValueType m_End;
+    char          m_Padding[ 64 ];
+  };
+
+  /** Start and stop the worker threads. */
+  void StartWorkers( ThreadIdType numberOfWorkers );
+  void StopWorkers( void );
+
+  /** The loop executed by the background worker threads. */
+  void WorkerLoop( ThreadIdType workerID );
+
+  /** Execute chunks of the current job until no chunk can be obtained
+   * anymore, neither from the own queue nor by stealing. */
+  void ExecuteChunks( ThreadIdType workerID );
+
+  /** Obtain the next chunk for a worker; returns false if there is none. */
+  bool PopChunk( ThreadIdType workerID, SizeValueType & chunk );
+  bool StealChunks( ThreadIdType workerID );
+
+  /** The worker threads and their queues. Worker 0 is the calling thread,
+   * so m_Threads has m_NumberOfWorkers - 1 elements.
+   */
+  std::vector< std::thread >       m_Threads;
+  std::vector< WorkerQueueType * > m_Queues;
+  ThreadIdType                     m_NumberOfWorkers;
+
+  /** Synchronization between the calling thread and the workers. */
+  std::mutex              m_JobMutex;   // serializes ParallelFor() calls
+  std::mutex              m_StateMutex; // protects the variables below
+  std::condition_variable m_WakeUpCondition;
+  std::condition_variable m_DoneCondition;
+  SizeValueType           m_Generation;
+  bool                    m_JobActive;
+  bool                    m_Terminate;
+  ThreadIdType            m_NumberOfActiveWorkers;
+
+  /** The current job. The first exception thrown by the callback is
+   * stored, and rethrown on the calling thread. */
+  RangeCallbackType   m_Callback;
+  void *              m_UserData;
+  SizeValueType       m_NumberOfItems;
+  SizeValueType       m_ChunkSize;
+  ThreadIdType        m_NumberOfParticipatingWorkers;
+  std::exception_ptr  m_Exception;
+  std::atomic< bool > m_ExceptionOccurred;
+
+  /** Statistics. */
+  SizeValueType                m_NumberOfJobs;
+  std::atomic< SizeValueType > m_NumberOfStolenChunks;
+
+};
+
+} // end namespace itk
+
+#endif // end #ifndef __itkWorkStealingThreadPool_h
@@ -153,6 +153,14 @@ FixedGenericPyramid< TElastix >
     "ComputePyramidImagesPerResolution", 0, false );
   this->SetComputeOnlyForCurrentLevel( computeThisResolution );
 
+  /** Decide whether or not to compute the pyramid images of the next resolution
+   * in the background, while the current resolution is registered.
+   */
+  bool computeInBackground = false;
+  this->m_Configuration->ReadParameter( computeInBackground,
+    "ComputePyramidImagesInBackground", 0, false );
+  this->SetComputeNextLevelInBackground( computeThisResolution && computeInBackground );
+
 } // end SetFixedSchedule()
 
 
@@ -0,0 +1,141 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+
+#ifndef __elxImportanceSampler_hxx
+#define __elxImportanceSampler_hxx
+
+#include "elxImportanceSampler.h"
+
+#include "itkImageFileReader.h"
+#include "itkChangeInformationImageFilter.h"
+
+namespace elastix
+{
+
+/**
+* ******************* BeforeRegistration ******************
+*/
+
+template< class TElastix >
+void
+ImportanceSampler< TElastix >
+::BeforeRegistration( void )
+{
+  /** The samples of this sampler are only representative for the image when
+   * they are weighted by their importance weights, so check that the metrics
+   * that use this sampler do so. The registration has set the samplers of
+   * the metrics already.
+   */
+  for( unsigned int i = 0; i < this->GetElastix()->GetNumberOfMetrics(); ++i )
+  {
+    if( this->GetElastix()->GetElxMetricBase( i )->GetAdvancedMetricImageSampler()
+      == this->GetAsITKBaseType()
+      && !this->GetElastix()->GetElxMetricBase( i )->GetAdvancedMetricUseFixedImageSampleWeights() )
+    {
+      xl::xout[ "error" ] << "ERROR: The Importance image sampler is used by "
+                          << this->GetElastix()->GetElxMetricBase( i )->GetComponentLabel()
+                          << ", which does not support sample weights." << std::endl;
+      itkExceptionMacro( << "ERROR: The Importance image sampler requires a metric "
+                         << "that weights the samples, such as AdvancedMeanSquares, "
+                         << "AdvancedMattesMutualInformation or NormalizedMutualInformation." );
+    }
+  }
+
+  /** Read the importance weight image if desired. */
+  std::string weightImageName = "";
+  this->GetConfiguration()->ReadParameter( weightImageName,
+    "ImportanceWeightImageName", this->GetComponentLabel(), 0, -1, false );
+  if( weightImageName == "" )
+  {
+    return;
+  }
+
+  typedef itk::ImageFileReader< WeightImageType >              WeightImageReaderType;
+  typedef itk::ChangeInformationImageFilter< WeightImageType > ChangeInfoFilterType;
+  typedef typename WeightImageType::DirectionType              DirectionType;
+
+  /** Create the reader and set the filename. */
+  typename WeightImageReaderType::Pointer weightImageReader = WeightImageReaderType::New();
+  weightImageReader->SetFileName( weightImageName.c_str() );
+
+  /** Possibly overrule the direction cosines. */
+  typename ChangeInfoFilterType::Pointer infoChanger = ChangeInfoFilterType::New();
+  DirectionType direction;
+  direction.SetIdentity();
+  infoChanger->SetOutputDirection( direction );
+  infoChanger->SetChangeDirection( !this->GetElastix()->GetUseDirectionCosines() );
+  infoChanger->SetInput( weightImageReader->GetOutput() );
+
+  /** Do the reading. */
+  try
+  {
+    infoChanger->Update();
+  }
+  catch( itk::ExceptionObject & excp )
+  {
+    /** Add information to the exception. */
+    excp.SetLocation( "ImportanceSampler - BeforeRegistration()" );
+    std::string err_str = excp.GetDescription();
+    err_str += "\nError occurred while reading the importance weight image.\n";
+    excp.SetDescription( err_str );
+    /** Pass the exception to an higher level. */
+    throw excp;
+  }
+
+  this->SetWeightImage( infoChanger->GetOutput() );
+
+} // end BeforeRegistration()
+
+
+/**
+* ******************* BeforeEachResolution ******************
+*/
+
+template< class TElastix >
+void
+ImportanceSampler< TElastix >
+::BeforeEachResolution( void )
+{
+  const unsigned int level
+    = ( this->m_Registration->GetAsITKBaseType() )->GetCurrentLevel();
+
+  /** Set the NumberOfSpatialSamples. */
+  unsigned long numberOfSpatialSamples = 5000;
+  this->GetConfiguration()->ReadParameter( numberOfSpatialSamples,
+    "NumberOfSpatialSamples", this->GetComponentLabel(), level, 0 );
+
+  this->SetNumberOfSamples( numberOfSpatialSamples );
+
+  /** Set the UniformWeightFraction. */
+  double uniformWeightFraction = 0.1;
+  this->GetConfiguration()->ReadParameter( uniformWeightFraction,
+    "UniformWeightFraction", this->GetComponentLabel(), level, 0 );
+  this->SetUniformWeightFraction( uniformWeightFraction );
+
+  /** Set the UseCounterBasedRandomGenerator bool. */
+  bool useCounterBasedRandomGenerator = false;
+  this->GetConfiguration()->ReadParameter( useCounterBasedRandomGenerator,
+    "UseCounterBasedRandomGenerator", this->GetComponentLabel(), level, 0 );
+  this->SetUseCounterBasedRandomGenerator( useCounterBasedRandomGenerator );
+
+} // end BeforeEachResolution()
+
+
+} // end namespace elastix
+
+#endif // end #ifndef __elxImportanceSampler_hxx
@@ -44,6 +44,13 @@ namespace elastix
  *    metric value and its derivative in each iteration. Must be given for each resolution.\n
  *    example: <tt>(NumberOfSpatialSamples 2048 2048 4000)</tt> \n
  *    The default is 5000.
+ * \parameter UseCounterBasedRandomGenerator: Defines whether to select the samples with a
+ *    counter-based random generator, keyed on the RandomSeed and the iteration. The threads of
+ *    the multi-threaded sampler then select their samples themselves, and the samples are the
+ *    same for any number of threads. The selected samples differ from those of the default
+ *    generator.\n
+ *    example: <tt>(UseCounterBasedRandomGenerator "true")</tt>\n
+ *    Default: false. The parameter can be specified for each resolution.
  *
  * \ingroup ImageSamplers
  */
@@ -108,6 +115,7 @@ public:
 
   /** Execute stuff before each resolution:
    * \li Set the number of samples.
+   * \li Set the UseCounterBasedRandomGenerator flag.
    */
   virtual void BeforeEachResolution( void );
 
@@ -42,6 +42,12 @@ RandomSampler< TElastix >
 
   this->SetNumberOfSamples( numberOfSpatialSamples );
 
+  /** Set the UseCounterBasedRandomGenerator bool. */
+  bool useCounterBasedRandomGenerator = false;
+  this->GetConfiguration()->ReadParameter( useCounterBasedRandomGenerator,
+    "UseCounterBasedRandomGenerator", this->GetComponentLabel(), level, 0 );
+  this->SetUseCounterBasedRandomGenerator( useCounterBasedRandomGenerator );
+
 } // end BeforeEachResolution
 
 
@@ -70,6 +70,12 @@ namespace elastix
  *    With this option you can specify the order of interpolation.\n
  *    example: <tt>(FixedImageBSplineInterpolationOrder 0 0 1)</tt>\n
  *    Default value: 1. The parameter can be specified for each resolution.
+ * \parameter UseLowDiscrepancySequence: Defines whether to take the coordinates from a
+ *    randomly shifted Halton sequence instead of independent random coordinates. The
+ *    coordinates then cover the sample region more evenly, so that fewer samples give
+ *    the same accuracy of the metric and its derivative.\n
+ *    example: <tt>(UseLowDiscrepancySequence "true")</tt>\n
+ *    Default: false. The parameter can be specified for each resolution.
  *
  * \ingroup ImageSamplers
  */
@@ -146,6 +152,7 @@ public:
    * \li Set the number of samples.
    * \li Set the fixed image interpolation order
    * \li Set the UseRandomSampleRegion flag and the SampleRegionSize
+   * \li Set the UseLowDiscrepancySequence flag
    */
   virtual void BeforeEachResolution( void );
 
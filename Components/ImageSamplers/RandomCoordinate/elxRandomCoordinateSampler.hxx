@@ -68,6 +68,12 @@ RandomCoordinateSampler< TElastix >
     "UseRandomSampleRegion", this->GetComponentLabel(), level, 0 );
   this->SetUseRandomSampleRegion( useRandomSampleRegion );
 
+  /** Set the UseLowDiscrepancySequence bool. */
+  bool useLowDiscrepancySequence = false;
+  this->GetConfiguration()->ReadParameter( useLowDiscrepancySequence,
+    "UseLowDiscrepancySequence", this->GetComponentLabel(), level, 0 );
+  this->SetUseLowDiscrepancySequence( useLowDiscrepancySequence );
+
   /** Set the SampleRegionSize. */
   if( useRandomSampleRegion )
   {
@@ -43,6 +43,12 @@ RandomSamplerSparseMask< TElastix >
 
   this->SetNumberOfSamples( numberOfSpatialSamples );
 
+  /** Set the UseCounterBasedRandomGenerator bool. */
+  bool useCounterBasedRandomGenerator = false;
+  this->GetConfiguration()->ReadParameter( useCounterBasedRandomGenerator,
+    "UseCounterBasedRandomGenerator", this->GetComponentLabel(), level, 0 );
+  this->SetUseCounterBasedRandomGenerator( useCounterBasedRandomGenerator );
+
 } // end BeforeEachResolution()
 
 
@@ -21,6 +21,8 @@
 #include "elxIncludes.h" // include first to avoid MSVS warning
 #include "itkBSplineInterpolateImageFunction.h"
 
+#include <future>
+
 namespace elastix
 {
 
@@ -42,6 +44,13 @@ namespace elastix
  *    example: <tt>(BSplineInterpolationOrder 3 2 3)</tt> \n
  *    The default order is 1. The parameter can be specified for each resolution.\n
  *    If only given for one resolution, that value is used for the other resolutions as well.
+ * \parameter ComputeBSplineCoefficientsInBackground: a flag to determine if the B-spline
+ *    coefficients of the moving image of the next resolution are computed in a background
+ *    thread, while the current resolution is registered. Choose from {"true", "false"} \n
+ *    example: <tt>(ComputeBSplineCoefficientsInBackground "true")</tt> \n
+ *    The default is "false". The moving image of the next resolution is available during
+ *    the current one if the pyramid computes all levels at once, or if the generic pyramid
+ *    computes them per resolution with ComputePyramidImagesInBackground "true".
  *
  * \ingroup Interpolators
  */
@@ -95,6 +104,9 @@ public:
   typedef typename Superclass1::CoefficientFilter        CoefficientFilter;
   typedef typename Superclass1::CoefficientFilterPointer CoefficientFilterPointer;
   typedef typename Superclass1::CovariantVectorType      CovariantVectorType;
+  typedef typename InputImageType::Pointer               InputImagePointer;
+  typedef typename InputImageType::ConstPointer          InputImageConstPointer;
+  typedef typename CoefficientImageType::Pointer         CoefficientImagePointer;
 
   /** Typedefs inherited from Elastix. */
   typedef typename Superclass2::ElastixType          ElastixType;
@@ -110,13 +122,56 @@ public:
    */
   virtual void BeforeEachResolution( void );
 
+  /** Set the input image. The B-spline coefficients that were computed in
+   * the background are used, if they belong to the pixels of this image and
+   * to the current spline order. Otherwise they are computed here.
+   */
+  virtual void SetInputImage( const InputImageType * inputData );
+
+  /** Compute the B-spline coefficients of an image in a background thread,
+   * for the given resolution level and spline order. The image is given by a
+   * future, so that the thread can wait for the image to be computed as well.
+   * SetInputImage() uses the coefficients at that level.
+   */
+  void ComputeCoefficientsInBackground(
+    const std::shared_future< InputImagePointer > & image,
+    const unsigned int level, const unsigned int splineOrder );
+
 protected:
 
   /** The constructor. */
-  BSplineInterpolator() {}
+  BSplineInterpolator();
   /** The destructor. */
   virtual ~BSplineInterpolator() {}
 
+  /** Typedefs for the moving image pyramid. */
+  typedef typename RegistrationType::ITKBaseType               ITKRegistrationType;
+  typedef typename ITKRegistrationType::MovingImagePyramidType MovingImagePyramidType;
+
+  /** The coefficients computed in the background, with the image and the
+   * spline order they were computed for. The image holds on to its pixel
+   * container, so that the container is not reused by another image.
+   */
+  struct BackgroundCoefficientsType
+  {
+    InputImageConstPointer  m_Image;
+    itk::ModifiedTimeType   m_PixelContainerMTime;
+    unsigned int            m_SplineOrder;
+    CoefficientImagePointer m_Coefficients;
+  };
+
+  /** Compute the coefficients; executed by the background thread. */
+  static BackgroundCoefficientsType ComputeCoefficients(
+    std::shared_future< InputImagePointer > image, const unsigned int splineOrder );
+
+  /** Start computing the coefficients of the moving image of the next level. */
+  void StartComputingNextCoefficients( void );
+
+  /** Wait for the coefficients computed in the background, and return them
+   * if they belong to inputData and the current level and spline order.
+   */
+  CoefficientImagePointer GetBackgroundCoefficients( const InputImageType * inputData );
+
 private:
 
   /** The private constructor. */
@@ -124,6 +179,10 @@ private:
   /** The private copy constructor. */
   void operator=( const Self & );       // purposely not implemented
 
+  bool                                      m_ComputeCoefficientsInBackground;
+  std::future< BackgroundCoefficientsType > m_BackgroundCoefficients;
+  unsigned int                              m_BackgroundCoefficientsLevel;
+
 };
 
 } // end namespace elastix
@@ -20,10 +20,25 @@
 #define __elxBSplineInterpolator_hxx
 
 #include "elxBSplineInterpolator.h"
+#include "itkGenericMultiResolutionPyramidImageFilter.h"
 
 namespace elastix
 {
 
+/**
+ * ***************** Constructor ***********************
+ */
+
+template< class TElastix >
+BSplineInterpolator< TElastix >
+::BSplineInterpolator()
+{
+  this->m_ComputeCoefficientsInBackground = false;
+  this->m_BackgroundCoefficientsLevel     = 0;
+
+} // end Constructor()
+
+
 /**
  * ***************** BeforeEachResolution ***********************
  */
@@ -55,9 +70,207 @@ BSplineInterpolator< TElastix >
   /** Set the splineOrder. */
   this->SetSplineOrder( splineOrder );
 
+  /** Decide whether or not to compute the coefficients of the next resolution
+   * in the background, while the current resolution is registered.
+   */
+  this->m_ComputeCoefficientsInBackground = false;
+  this->GetConfiguration()->ReadParameter( this->m_ComputeCoefficientsInBackground,
+    "ComputeBSplineCoefficientsInBackground", 0, false );
+
+  /** The background thread reads the pixels of the moving image of this level.
+   * Let it finish before the pyramid may be updated for this level.
+   */
+  if( this->m_BackgroundCoefficients.valid() )
+  {
+    this->m_BackgroundCoefficients.wait();
+  }
+
 } // end BeforeEachResolution()
 
 
+/**
+ * ***************** SetInputImage ***********************
+ */
+
+template< class TElastix >
+void
+BSplineInterpolator< TElastix >
+::SetInputImage( const InputImageType * inputData )
+{
+  CoefficientImagePointer coefficients = this->GetBackgroundCoefficients( inputData );
+  if( coefficients.IsNull() )
+  {
+    this->Superclass1::SetInputImage( inputData );
+  }
+  else
+  {
+    /** Skip the B-spline decomposition of the superclass. */
+    this->Superclass1::Superclass::SetInputImage( inputData );
+    this->m_Coefficients = coefficients;
+    this->m_DataLength   = inputData->GetBufferedRegion().GetSize();
+  }
+
+  /** Start on the coefficients of the next level. */
+  if( inputData && this->m_ComputeCoefficientsInBackground )
+  {
+    this->StartComputingNextCoefficients();
+  }
+
+} // end SetInputImage()
+
+
+/**
+ * ***************** ComputeCoefficientsInBackground ***********************
+ */
+
+template< class TElastix >
+void
+BSplineInterpolator< TElastix >
+::ComputeCoefficientsInBackground(
+  const std::shared_future< InputImagePointer > & image,
+  const unsigned int level, const unsigned int splineOrder )
+{
+  this->m_BackgroundCoefficientsLevel = level;
+  this->m_BackgroundCoefficients      = std::async( std::launch::async,
+    &Self::ComputeCoefficients, image, splineOrder );
+
+} // end ComputeCoefficientsInBackground()
+
+
+/**
+ * ***************** ComputeCoefficients ***********************
+ */
+
+template< class TElastix >
+typename BSplineInterpolator< TElastix >::BackgroundCoefficientsType
+BSplineInterpolator< TElastix >
+::ComputeCoefficients( std::shared_future< InputImagePointer > image,
+  const unsigned int splineOrder )
+{
+  BackgroundCoefficientsType coefficients;
+  coefficients.m_Image               = image.get();
+  coefficients.m_PixelContainerMTime = coefficients.m_Image->GetPixelContainer()->GetMTime();
+  coefficients.m_SplineOrder         = splineOrder;
+
+  /** The decomposition is local to this thread, and works on a graft of the
+   * image, so that the pipeline of the image is not touched.
+   */
+  InputImagePointer imageGraft = InputImageType::New();
+  imageGraft->Graft( coefficients.m_Image );
+  CoefficientFilterPointer decomposition = CoefficientFilter::New();
+  decomposition->SetSplineOrder( splineOrder );
+  decomposition->SetInput( imageGraft );
+  decomposition->Update();
+  coefficients.m_Coefficients = decomposition->GetOutput();
+
+  return coefficients;
+
+} // end ComputeCoefficients()
+
+
+/**
+ * ***************** StartComputingNextCoefficients ***********************
+ */
+
+template< class TElastix >
+void
+BSplineInterpolator< TElastix >
+::StartComputingNextCoefficients( void )
+{
+  ITKRegistrationType * registration = this->m_Registration->GetAsITKBaseType();
+  const unsigned int    nextLevel    = registration->GetCurrentLevel() + 1;
+  if( nextLevel >= registration->GetNumberOfLevels()
+    || ( this->m_BackgroundCoefficients.valid() && this->m_BackgroundCoefficientsLevel == nextLevel ) )
+  {
+    return;
+  }
+
+  /** The moving image of the next level is computed in the background by the
+   * generic pyramid, if it computes the levels one by one. Other pyramids
+   * have computed all levels at once.
+   */
+  typedef itk::GenericMultiResolutionPyramidImageFilter<
+    InputImageType, InputImageType >                    GenericPyramidType;
+  std::shared_future< InputImagePointer > nextImage;
+  MovingImagePyramidType *                pyramid        = registration->GetMovingImagePyramid();
+  const GenericPyramidType *              genericPyramid = dynamic_cast< const GenericPyramidType * >( pyramid );
+  if( genericPyramid && genericPyramid->GetComputeOnlyForCurrentLevel() )
+  {
+    unsigned int backgroundLevel = 0;
+    if( !genericPyramid->GetNextLevelInBackground( backgroundLevel, nextImage )
+      || backgroundLevel != nextLevel )
+    {
+      return;
+    }
+  }
+  else
+  {
+    const InputImageType * image = pyramid->GetOutput( nextLevel );
+    if( image->GetBufferedRegion().GetNumberOfPixels() == 0 )
+    {
+      return;
+    }
+    InputImagePointer imageGraft = InputImageType::New();
+    imageGraft->Graft( image );
+    std::promise< InputImagePointer > computedImage;
+    computedImage.set_value( imageGraft );
+    nextImage = computedImage.get_future().share();
+  }
+
+  /** The spline order of the next level. */
+  unsigned int splineOrder = 1;
+  this->GetConfiguration()->ReadParameter( splineOrder,
+    "BSplineInterpolationOrder", this->GetComponentLabel(), nextLevel, 0, false );
+
+  this->ComputeCoefficientsInBackground( nextImage, nextLevel, splineOrder );
+
+} // end StartComputingNextCoefficients()
+
+
+/**
+ * ***************** GetBackgroundCoefficients ***********************
+ */
+
+template< class TElastix >
+typename BSplineInterpolator< TElastix >::CoefficientImagePointer
+BSplineInterpolator< TElastix >
+::GetBackgroundCoefficients( const InputImageType * inputData )
+{
+  if( !inputData || !this->m_BackgroundCoefficients.valid()
+    || this->m_BackgroundCoefficientsLevel
+    != this->m_Registration->GetAsITKBaseType()->GetCurrentLevel() )
+  {
+    return 0;
+  }
+
+  /** Errors in the background are not reported; the coefficients are
+   * then computed again, by the superclass.
+   */
+  std::future< BackgroundCoefficientsType > backgroundCoefficients
+    = std::move( this->m_BackgroundCoefficients );
+  BackgroundCoefficientsType coefficients;
+  try
+  {
+    coefficients = backgroundCoefficients.get();
+  }
+  catch( ... )
+  {
+    return 0;
+  }
+
+  if( coefficients.m_Image->GetPixelContainer() != inputData->GetPixelContainer()
+    || coefficients.m_Image->GetPixelContainer()->GetMTime() != coefficients.m_PixelContainerMTime
+    || coefficients.m_Image->GetBufferedRegion() != inputData->GetBufferedRegion()
+    || coefficients.m_SplineOrder != this->GetSplineOrder() )
+  {
+    return 0;
+  }
+
+  return coefficients.m_Coefficients;
+
+} // end GetBackgroundCoefficients()
+
+
 } // end namespace elastix
 
 #endif // end #ifndef __elxBSplineInterpolator_hxx
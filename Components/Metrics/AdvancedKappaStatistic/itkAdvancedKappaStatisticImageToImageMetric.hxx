@@ -78,12 +78,13 @@ AdvancedKappaStatisticImageToImageMetric< TFixedImage, TMovingImage >
 
   const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
 
-  /** Only resize the array of structs when needed. */
-  if( this->m_KappaGetValueAndDerivativePerThreadVariablesSize != numberOfThreads)
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_KappaGetValueAndDerivativePerThreadVariablesSize < numberOfThreads )
   {
     delete[] this->m_KappaGetValueAndDerivativePerThreadVariables;
     this->m_KappaGetValueAndDerivativePerThreadVariables     = new AlignedKappaGetValueAndDerivativePerThreadStruct[ numberOfThreads ];
     this->m_KappaGetValueAndDerivativePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
   }
 
   /** Some initialization. */
@@ -94,12 +95,19 @@ AdvancedKappaStatisticImageToImageMetric< TFixedImage, TMovingImage >
     this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted = zero1;
     this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_AreaSum               = zero1;
     this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_AreaIntersection      = zero1;
-    this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeSum1.SetSize( this->GetNumberOfParameters() );
-    this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeSum2.SetSize( this->GetNumberOfParameters() );
+    if( this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeSum1.GetSize() != this->GetNumberOfParameters() )
+    {
+      this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeSum1.SetSize( this->GetNumberOfParameters() );
+      this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeSum2.SetSize( this->GetNumberOfParameters() );
+      ++this->m_NumberOfPerThreadAllocations;
+    }
     this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeSum1.Fill( zero2 );
     this->m_KappaGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeSum2.Fill( zero2 );
   }
 
+  /** Size the scratch memory of the threads. */
+  this->InitializeThreadScratch();
+
 } // end InitializeThreadingParameters()
 
 
@@ -462,10 +470,10 @@ void
 AdvancedKappaStatisticImageToImageMetric< TFixedImage, TMovingImage >
 ::ThreadedGetValueAndDerivative( ThreadIdType threadId )
 {
-  /** Initialize array that stores dM(x)/dmu, and the sparse Jacobian + indices. */
-  const NumberOfParametersType nnzji = this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices();
-  NonZeroJacobianIndicesType   nzji  = NonZeroJacobianIndicesType( nnzji );
-  DerivativeType               imageJacobian( nzji.size() );
+  /** Get the pre-allocated arrays that store dM(x)/dmu, and the sparse Jacobian + indices. */
+  typename Superclass::ThreadScratchStruct & scratch       = this->GetThreadScratch( threadId );
+  NonZeroJacobianIndicesType &               nzji          = scratch.st_NonZeroJacobianIndices;
+  DerivativeType &                           imageJacobian = scratch.st_ImageJacobian;
 
   /** Get handles to the pre-allocated derivatives for the current thread.
    * The initialization is performed at the beginning of each resolution in
@@ -91,6 +91,14 @@ namespace elastix
  *    B-spline grids.
  *    example: <tt>(UseFastAndLowMemoryVersion "false")</tt> \n
  *    The default is "true".
+ * \parameter UseSparsePDFDerivatives: Only used if UseFastAndLowMemoryVersion
+ *    is "false". Stores the derivatives of the joint histogram only for the
+ *    parameters and bins that are affected by the samples, instead of in the
+ *    large 3D matrix. The memory use then grows with the number of samples
+ *    instead of the number of parameters, while the samples are still visited
+ *    only once. Can be given for each resolution. \n
+ *    example: <tt>(UseSparsePDFDerivatives "true")</tt> \n
+ *    The default is "false".
  *
  * \sa ParzenWindowMutualInformationImageToImageMetric
  * \ingroup Metrics
@@ -125,6 +125,12 @@ AdvancedMattesMutualInformationMetric< TElastix >
     "UseFastAndLowMemoryVersion", this->GetComponentLabel(), level, 0 );
   this->SetUseExplicitPDFDerivatives( !useFastAndLowMemoryVersion );
 
+  /** Set whether the explicit joint histogram derivatives are stored sparsely. */
+  bool useSparsePDFDerivatives = false;
+  this->GetConfiguration()->ReadParameter( useSparsePDFDerivatives,
+    "UseSparsePDFDerivatives", this->GetComponentLabel(), level, 0 );
+  this->SetUseSparsePDFDerivatives( useSparsePDFDerivatives );
+
   /** Set whether to use Nick Tustison's preconditioning technique. */
   bool useJacobianPreconditioning = false;
   this->GetConfiguration()->ReadParameter( useJacobianPreconditioning,
@@ -131,6 +131,8 @@ public:
   typedef typename Superclass::ImageSampleContainerType   ImageSampleContainerType;
   typedef typename
     Superclass::ImageSampleContainerPointer ImageSampleContainerPointer;
+  typedef typename
+    Superclass::ImageSampleWeightContainerType ImageSampleWeightContainerType;
   typedef typename Superclass::FixedImageLimiterType  FixedImageLimiterType;
   typedef typename Superclass::MovingImageLimiterType MovingImageLimiterType;
   typedef typename
@@ -153,10 +155,6 @@ public:
   /**  Get the value. */
   MeasureType GetValue( const ParametersType & parameters ) const;
 
-  /** Set/get whether to apply the technique introduced by Nicholas Tustison; default: false */
-  itkGetConstMacro( UseJacobianPreconditioning, bool );
-  itkSetMacro( UseJacobianPreconditioning, bool );
-
 protected:
 
   /** The constructor. */
@@ -192,6 +190,8 @@ protected:
   typedef typename Superclass::ParzenValueContainerType            ParzenValueContainerType;
   typedef typename Superclass::KernelFunctionType                  KernelFunctionType;
   typedef typename Superclass::NonZeroJacobianIndicesType          NonZeroJacobianIndicesType;
+  typedef typename Superclass::PRatioType                          PRatioType;
+  typedef typename Superclass::PRatioArrayType                     PRatioArrayType;
 
   /**  Get the value and analytic derivative.
    * Called by GetValueAndDerivative if UseFiniteDifferenceDerivative == false.
@@ -217,6 +217,19 @@ protected:
     const ParametersType & parameters,
     MeasureType & value, DerivativeType & derivative ) const;
 
+  /**  Get the value and analytic derivative.
+   * Called by GetValueAndDerivative if UseFiniteDifferenceDerivative == false,
+   * UseExplicitPDFDerivatives == true and UseSparsePDFDerivatives == true.
+   *
+   * Loops over the samples once, like the explicit variant, but stores the
+   * joint histogram derivatives sparsely, per thread. The derivative is then
+   * a weighted sum of these, with the m_PRatioArray of the low memory variant
+   * as weights.
+   */
+  virtual void GetValueAndAnalyticDerivativeSparse(
+    const ParametersType & parameters,
+    MeasureType & value, DerivativeType & derivative ) const;
+
   /**  Get the value and finite difference derivative.
    * Called by GetValueAndDerivative if UseFiniteDifferenceDerivative == true.
    *
@@ -226,36 +239,9 @@ protected:
     const ParametersType & parameters,
     MeasureType & value, DerivativeType & derivative ) const;
 
-  /** Compute terms to implement preconditioning as proposed by Tustison et al. */
-  virtual void ComputeJacobianPreconditioner(
-    const TransformJacobianType & jac,
-    const NonZeroJacobianIndicesType & nzji,
-    DerivativeType & preconditioner,
-    DerivativeType & divisor ) const;
-
   /** Some initialization functions, called by Initialize. */
   virtual void InitializeHistograms( void );
 
-  /** Threading related parameters. */
-  struct ParzenWindowMutualInformationMultiThreaderParameterType
-  {
-    Self * m_Metric;
-  };
-  ParzenWindowMutualInformationMultiThreaderParameterType m_ParzenWindowMutualInformationThreaderParameters;
-
-  /** Multi-threaded versions of the ComputePDF function. */
-  inline void ThreadedComputeDerivativeLowMemory( ThreadIdType threadId );
-
-  /** Single-threadedly accumulate results. */
-  inline void AfterThreadedComputeDerivativeLowMemory(
-    DerivativeType & derivative ) const;
-
-  /** Helper function to launch the threads. */
-  static ITK_THREAD_RETURN_TYPE ComputeDerivativeLowMemoryThreaderCallback( void * arg );
-
-  /** Helper function to launch the threads. */
-  void LaunchComputeDerivativeLowMemoryThreaderCallback( void ) const;
-
 private:
 
   /** The private constructor. */
@@ -264,26 +250,8 @@ private:
   void operator=( const Self & );                                  // purposely not implemented
 
   /** Helper array for storing the values of the JointPDF ratios. */
-  typedef double                PRatioType;
-  typedef Array2D< PRatioType > PRatioArrayType;
   mutable PRatioArrayType m_PRatioArray;
 
-  /** Setting */
-  bool m_UseJacobianPreconditioning;
-
-  /** Helper function to compute the derivative for the low memory variant. */
-  void ComputeDerivativeLowMemorySingleThreaded( DerivativeType & derivative ) const;
-
-  void ComputeDerivativeLowMemory( DerivativeType & derivative ) const;
-
-  /** Helper function to update the derivative for the low memory variant. */
-  void UpdateDerivativeLowMemory(
-    const RealType & fixedImageValue,
-    const RealType & movingImageValue,
-    const DerivativeType & imageJacobian,
-    const NonZeroJacobianIndicesType & nzji,
-    DerivativeType & derivative ) const;
-
   /** Helper function to compute m_PRatioArray in case of low memory consumption. */
   void ComputeValueAndPRatioArray( double & MI ) const;
 
@@ -23,13 +23,6 @@
 #include "itkImageLinearConstIteratorWithIndex.h"
 #include "itkImageScanlineConstIterator.h"
 #include "vnl/vnl_math.h"
-#include "itkMatrix.h"
-#include "vnl/vnl_inverse.h"
-#include "vnl/vnl_det.h"
-
-#ifdef ELASTIX_USE_OPENMP
-#include <omp.h>
-#endif
 
 namespace itk
 {
@@ -41,11 +34,6 @@ template< class TFixedImage, class TMovingImage >
 ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
 ::ParzenWindowMutualInformationImageToImageMetric()
 {
-  this->m_UseJacobianPreconditioning = false;
-
-  /** Initialize the m_ParzenWindowHistogramThreaderParameters. */
-  this->m_ParzenWindowMutualInformationThreaderParameters.m_Metric = this;
-
 } // end constructor
 
 
@@ -62,7 +50,7 @@ ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
   this->Superclass::InitializeHistograms();
 
   /** Allocate small amount of memory for the m_PRatioArray. */
-  if( !this->GetUseExplicitPDFDerivatives() )
+  if( !this->GetUseExplicitPDFDerivatives() || this->GetUseSparsePDFDerivatives() )
   {
     this->m_PRatioArray.SetSize(
       this->GetNumberOfFixedHistogramBins(),
@@ -158,6 +146,14 @@ ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
     return;
   }
 
+  /** Sparse variant of the explicit pdf derivatives. */
+  if( this->GetUseSparsePDFDerivatives() )
+  {
+    this->GetValueAndAnalyticDerivativeSparse(
+      parameters, value, derivative );
+    return;
+  }
+
   /** Initialize some variables. */
   value      = NumericTraits< MeasureType >::Zero;
   derivative = DerivativeType( this->GetNumberOfParameters() );
@@ -241,6 +237,48 @@ ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
 } // end GetValueAndAnalyticDerivative()
 
 
+/**
+ * ******************** GetValueAndAnalyticDerivativeSparse *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::GetValueAndAnalyticDerivativeSparse(
+  const ParametersType & parameters,
+  MeasureType & value,
+  DerivativeType & derivative ) const
+{
+  /** Construct the JointPDF, Alpha, and the sparse JointPDFDerivatives
+   * of each thread.
+   */
+  this->ComputePDFsAndSparsePDFDerivatives( parameters );
+
+  /** Normalize the joint histogram by alpha. */
+  this->NormalizeJointPDF( this->m_JointPDF, this->m_Alpha );
+
+  /** Compute the fixed and moving marginal pdf by summing over the histogram. */
+  this->ComputeMarginalPDF( this->m_JointPDF, this->m_FixedImageMarginalPDF, 0 );
+  this->ComputeMarginalPDF( this->m_JointPDF, this->m_MovingImageMarginalPDF, 1 );
+
+  /** Compute the metric value and m_PRatioArray = alpha * log( p / pm ). */
+  double MI = 0.0;
+  this->ComputeValueAndPRatioArray( MI );
+  value = static_cast< MeasureType >( -1.0 * MI );
+
+  /** Compute the derivative: -\sum_bin dh( bin ) / dmu * m_PRatioArray( bin ).
+   * This equals eq 23 of Thevenaz & Unser paper [3], with log( p / pm )
+   * instead of log( p / ( pf pm ) ), since the sum of dh / dmu over the
+   * moving bins is zero. The m_PRatioArray has the same layout as the
+   * buffer of the joint histogram.
+   */
+  derivative.SetSize( this->GetNumberOfParameters() );
+  this->ComputeDerivativeFromSparsePDFDerivatives(
+    this->m_PRatioArray.data_block(), -1.0, derivative );
+
+} // end GetValueAndAnalyticDerivativeSparse()
+
+
 /**
  * ******************** GetValueAndAnalyticDerivativeLowMemory *******************
  */
@@ -281,405 +319,11 @@ ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
    * This function contains a second loop over the samples.
    * It executes multi-threadedly when m_UseMultiThread == true.
    */
-  this->ComputeDerivativeLowMemory( derivative );
+  this->ComputeDerivativeLowMemory( this->m_PRatioArray, derivative );
 
 } // end GetValueAndAnalyticDerivativeLowMemory()
 
 
-/**
- * ******************** ComputeDerivativeLowMemorySingleThreaded *******************
- */
-
-template< class TFixedImage, class TMovingImage >
-void
-ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeDerivativeLowMemorySingleThreaded( DerivativeType & derivative ) const
-{
-  /** Initialize array that stores dM(x)/dmu, and the sparse Jacobian + indices. */
-  const NumberOfParametersType nnzji = this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices();
-  NonZeroJacobianIndicesType   nzji  = NonZeroJacobianIndicesType( nnzji );
-  DerivativeType               imageJacobian( nzji.size() );
-  TransformJacobianType        jacobian;
-  derivative.Fill( NumericTraits< double >::ZeroValue() );
-
-  /** Declare and allocate arrays for Jacobian preconditioning. */
-  DerivativeType jacobianPreconditioner, preconditioningDivisor;
-  if( this->GetUseJacobianPreconditioning() )
-  {
-    jacobianPreconditioner = DerivativeType( nzji.size() );
-    preconditioningDivisor = DerivativeType( this->GetNumberOfParameters() );
-    preconditioningDivisor.Fill( 0.0 );
-  }
-
-  /** Get a handle to the sample container. */
-  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
-
-  /** Create iterator over the sample container. */
-  typename ImageSampleContainerType::ConstIterator fiter;
-  typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
-  typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
-
-  /** Loop over sample container and compute contribution of each sample to pdfs. */
-  for( fiter = fbegin; fiter != fend; ++fiter )
-  {
-    /** Read fixed coordinates and create some variables. */
-    const FixedImagePointType & fixedPoint = ( *fiter ).Value().m_ImageCoordinates;
-    RealType                    movingImageValue;
-    MovingImageDerivativeType   movingImageDerivative;
-    MovingImagePointType        mappedPoint;
-
-    /** Transform point and check if it is inside the B-spline support region. */
-    bool sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
-
-    /** Check if the point is inside the moving mask. */
-    if( sampleOk )
-    {
-      sampleOk = this->IsInsideMovingMask( mappedPoint );
-    }
-
-    /** Compute the moving image value, its derivative, and check
-     * if the point is inside the moving image buffer.
-     */
-    if( sampleOk )
-    {
-      sampleOk = this->EvaluateMovingImageValueAndDerivative(
-        mappedPoint, movingImageValue, &movingImageDerivative );
-    }
-
-    if( sampleOk )
-    {
-      /** Get the fixed image value. */
-      RealType fixedImageValue = static_cast< RealType >( ( *fiter ).Value().m_ImageValue );
-
-      /** Make sure the values fall within the histogram range. */
-      fixedImageValue = this->GetFixedImageLimiter()
-        ->Evaluate( fixedImageValue );
-      movingImageValue = this->GetMovingImageLimiter()
-        ->Evaluate( movingImageValue, movingImageDerivative );
-
-      /** Get the transform Jacobian dT/dmu. */
-      this->EvaluateTransformJacobian( fixedPoint, jacobian, nzji );
-
-      /** Compute the inner product (dM/dx)^T (dT/dmu). */
-      this->EvaluateTransformJacobianInnerProduct(
-        jacobian, movingImageDerivative, imageJacobian );
-
-      /** If desired, apply the technique introduced by Tustison. */
-      if( this->GetUseJacobianPreconditioning() )
-      {
-        this->ComputeJacobianPreconditioner( jacobian, nzji,
-          jacobianPreconditioner, preconditioningDivisor );
-        DerivativeValueType * imjacit   = imageJacobian.begin();
-        DerivativeValueType * jacprecit = jacobianPreconditioner.begin();
-        for( unsigned int i = 0; i < nzji.size(); ++i )
-        {
-          while( imjacit != imageJacobian.end() )
-          {
-            ( *imjacit ) *= ( *jacprecit );
-            ++imjacit;
-            ++jacprecit;
-          }
-        }
-      }
-
-      /** Compute this sample's contribution to the joint distributions. */
-      this->UpdateDerivativeLowMemory(
-        fixedImageValue, movingImageValue, imageJacobian, nzji, derivative );
-
-    } // end sampleOk
-  } // end loop over sample container
-
-  /** If desired, apply the technique introduced by Tustison */
-  if( this->GetUseJacobianPreconditioning() )
-  {
-    DerivativeValueType * derivit = derivative.begin();
-    DerivativeValueType * divisit = preconditioningDivisor.begin();
-
-    /** This normalization was not in the Tustison paper, but it helps,
-     * especially for localized mutual information.
-     */
-    const double normalizationFactor = preconditioningDivisor.mean();
-    while( derivit != derivative.end() )
-    {
-      ( *derivit ) *= normalizationFactor / ( ( *divisit ) + 1e-14 );
-      ++derivit;
-      ++divisit;
-    }
-  }
-
-} // end ComputeDerivativeLowMemorySingleThreaded()
-
-
-/**
- * ******************** ComputeDerivativeLowMemory *******************
- */
-
-template< class TFixedImage, class TMovingImage >
-void
-ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeDerivativeLowMemory( DerivativeType & derivative ) const
-{
-  /** Option for now to still use the single threaded code. */
-  if( !this->m_UseMultiThread )
-  {
-    return this->ComputeDerivativeLowMemorySingleThreaded( derivative );
-  }
-
-  /** Launch multi-threading derivative computation. */
-  this->LaunchComputeDerivativeLowMemoryThreaderCallback();
-
-  /** Gather the results from all threads. */
-  this->AfterThreadedComputeDerivativeLowMemory( derivative );
-
-} // end ComputeDerivativeLowMemory()
-
-
-/**
- * ******************* ThreadedComputeDerivativeLowMemory *******************
- */
-
-template< class TFixedImage, class TMovingImage >
-void
-ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::ThreadedComputeDerivativeLowMemory( ThreadIdType threadId )
-{
-  /** Initialize array that stores dM(x)/dmu, and the sparse Jacobian + indices. */
-  const NumberOfParametersType nnzji = this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices();
-  NonZeroJacobianIndicesType   nzji  = NonZeroJacobianIndicesType( nnzji );
-  DerivativeType               imageJacobian( nzji.size() );
-
-  /** Get a handle to the pre-allocated derivative for the current thread.
-   * The initialization is performed at the beginning of each resolution in
-   * InitializeThreadingParameters(), and at the end of each iteration in
-   * AfterThreadedGetValueAndDerivative() and the accumulate functions.
-   */
-  DerivativeType & derivative = this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Derivative;
-
-  /** Declare and allocate arrays for Jacobian preconditioning. */
-  DerivativeType jacobianPreconditioner, preconditioningDivisor;
-  if( this->GetUseJacobianPreconditioning() )
-  {
-    jacobianPreconditioner = DerivativeType( nzji.size() );
-    preconditioningDivisor = DerivativeType( this->GetNumberOfParameters() );
-    preconditioningDivisor.Fill( 0.0 );
-  }
-
-  /** Get a handle to the sample container. */
-  ImageSampleContainerPointer sampleContainer     = this->GetImageSampler()->GetOutput();
-  const unsigned long         sampleContainerSize = sampleContainer->Size();
-
-  /** Get the samples for this thread. */
-  const unsigned long nrOfSamplesPerThreads
-    = static_cast< unsigned long >( std::ceil( static_cast< double >( sampleContainerSize )
-    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
-
-  unsigned long pos_begin = nrOfSamplesPerThreads * threadId;
-  unsigned long pos_end   = nrOfSamplesPerThreads * ( threadId + 1 );
-  pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
-  pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
-
-  /** Create iterator over the sample container. */
-  typename ImageSampleContainerType::ConstIterator fiter;
-  typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
-  typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->Begin();
-  fbegin                                                 += (int)pos_begin;
-  fend                                                   += (int)pos_end;
-
-  /** Loop over sample container and compute contribution of each sample to pdfs. */
-  for( fiter = fbegin; fiter != fend; ++fiter )
-  {
-    /** Read fixed coordinates and create some variables. */
-    const FixedImagePointType & fixedPoint = ( *fiter ).Value().m_ImageCoordinates;
-    RealType                    movingImageValue;
-    MovingImageDerivativeType   movingImageDerivative;
-    MovingImagePointType        mappedPoint;
-
-    /** Transform point and check if it is inside the B-spline support region. */
-    bool sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
-
-    /** Check if the point is inside the moving mask. */
-    if( sampleOk )
-    {
-      sampleOk = this->IsInsideMovingMask( mappedPoint );
-    }
-
-    /** Compute the moving image value, its derivative, and check
-     * if the point is inside the moving image buffer.
-     */
-    if( sampleOk )
-    {
-      sampleOk = this->EvaluateMovingImageValueAndDerivative(
-        mappedPoint, movingImageValue, &movingImageDerivative );
-    }
-
-    if( sampleOk )
-    {
-      /** Get the fixed image value. */
-      RealType fixedImageValue = static_cast< RealType >( ( *fiter ).Value().m_ImageValue );
-
-      /** Make sure the values fall within the histogram range. */
-      fixedImageValue  = this->GetFixedImageLimiter()->Evaluate( fixedImageValue );
-      movingImageValue = this->GetMovingImageLimiter()
-        ->Evaluate( movingImageValue, movingImageDerivative );
-
-#if 0
-      /** Get the TransformJacobian dT/dmu. */
-      this->EvaluateTransformJacobian( fixedPoint, jacobian, nzji );
-
-      /** Compute the inner products (dM/dx)^T (dT/dmu). */
-      this->EvaluateTransformJacobianInnerProduct(
-        jacobian, movingImageDerivative, imageJacobian );
-#else
-      /** Compute the inner product of the transform Jacobian dT/dmu and the moving image gradient dM/dx. */
-      this->m_AdvancedTransform->EvaluateJacobianWithImageGradientProduct(
-        fixedPoint, movingImageDerivative, imageJacobian, nzji );
-#endif
-
-      /** If desired, apply the technique introduced by Tustison. */
-      TransformJacobianType jacobian;
-      if( this->GetUseJacobianPreconditioning() )
-      {
-        this->EvaluateTransformJacobian( fixedPoint, jacobian, nzji );
-
-        this->ComputeJacobianPreconditioner( jacobian, nzji,
-          jacobianPreconditioner, preconditioningDivisor );
-        DerivativeValueType * imjacit   = imageJacobian.begin();
-        DerivativeValueType * jacprecit = jacobianPreconditioner.begin();
-        for( unsigned int i = 0; i < nzji.size(); ++i )
-        {
-          while( imjacit != imageJacobian.end() )
-          {
-            ( *imjacit ) *= ( *jacprecit );
-            ++imjacit;
-            ++jacprecit;
-          }
-        }
-      }
-
-      /** Compute this sample's contribution to the joint distributions. */
-      this->UpdateDerivativeLowMemory(
-        fixedImageValue, movingImageValue, imageJacobian, nzji,
-        derivative );
-
-    } // end sampleOk
-  } // end loop over sample container
-
-  /** If desired, apply the technique introduced by Tustison. */
-  if( this->GetUseJacobianPreconditioning() )
-  {
-    DerivativeValueType * derivit = derivative.begin();
-    DerivativeValueType * divisit = preconditioningDivisor.begin();
-
-    /** This normalization was not in the Tustison paper, but it helps,
-     * especially for localized mutual information.
-     */
-    const double normalizationFactor = preconditioningDivisor.mean();
-    while( derivit != derivative.end() )
-    {
-      ( *derivit ) *= normalizationFactor / ( ( *divisit ) + 1e-14 );
-      ++derivit;
-      ++divisit;
-    }
-  }
-
-} // end ThreadedComputeDerivativeLowMemory()
-
-
-/**
- * ******************* AfterThreadedComputeDerivativeLowMemory *******************
- */
-
-template< class TFixedImage, class TMovingImage >
-void
-ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::AfterThreadedComputeDerivativeLowMemory( DerivativeType & derivative ) const
-{
-  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
-
-  /** Accumulate derivatives. */
-  // compute single-threadedly
-  if( !this->m_UseMultiThread && false ) // force multi-threaded
-  {
-    derivative = this->m_GetValueAndDerivativePerThreadVariables[ 0 ].st_Derivative;
-    for( ThreadIdType i = 1; i < numberOfThreads; ++i )
-    {
-      derivative += this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Derivative;
-    }
-  }
-#ifdef ELASTIX_USE_OPENMP
-  // compute multi-threadedly with openmp
-  else if( false ) //this->m_UseOpenMP )
-  {
-    const int spaceDimension = static_cast< int >( this->GetNumberOfParameters() );
-
-    #pragma omp parallel for
-    for( int j = 0; j < spaceDimension; ++j )
-    {
-      DerivativeValueType sum = this->m_GetValueAndDerivativePerThreadVariables[ 0 ].st_Derivative[ j ];
-      for( ThreadIdType i = 1; i < numberOfThreads; ++i )
-      {
-        sum += this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Derivative[ j ];
-      }
-      derivative[ j ] = sum;
-    }
-  }
-#endif
-  // compute multi-threadedly with itk threads
-  else
-  {
-    this->m_ThreaderMetricParameters.st_DerivativePointer   = derivative.begin();
-    this->m_ThreaderMetricParameters.st_NormalizationFactor = 1.0;
-
-    this->m_Threader->SetSingleMethod( this->AccumulateDerivativesThreaderCallback,
-      const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ) );
-    this->m_Threader->SingleMethodExecute();
-  }
-
-} // end AfterThreadedComputeDerivativeLowMemory()
-
-
-/**
- * **************** ComputeDerivativeLowMemoryThreaderCallback *******
- */
-
-template< class TFixedImage, class TMovingImage >
-ITK_THREAD_RETURN_TYPE
-ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeDerivativeLowMemoryThreaderCallback( void * arg )
-{
-  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
-  ThreadIdType     threadId   = infoStruct->ThreadID;
-
-  ParzenWindowMutualInformationMultiThreaderParameterType * temp
-    = static_cast< ParzenWindowMutualInformationMultiThreaderParameterType * >( infoStruct->UserData );
-
-  temp->m_Metric->ThreadedComputeDerivativeLowMemory( threadId );
-
-  return ITK_THREAD_RETURN_VALUE;
-
-} // end ComputeDerivativeLowMemoryThreaderCallback()
-
-
-/**
- * *********************** LaunchComputeDerivativeLowMemoryThreaderCallback***************
- */
-
-template< class TFixedImage, class TMovingImage >
-void
-ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::LaunchComputeDerivativeLowMemoryThreaderCallback( void ) const
-{
-  /** Setup threader. */
-  this->m_Threader->SetSingleMethod( this->ComputeDerivativeLowMemoryThreaderCallback,
-    const_cast< void * >( static_cast< const void * >(
-      &this->m_ParzenWindowMutualInformationThreaderParameters ) ) );
-
-  /** Launch. */
-  this->m_Threader->SingleMethodExecute();
-
-} // end LaunchComputeDerivativeLowMemoryThreaderCallback()
-
-
 /**
  * ******************* ComputeValueAndPRatioArray *******************
  */
@@ -757,99 +401,6 @@ ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
 } // end ComputeValueAndPRatioArray()
 
 
-/**
- * ******************* UpdateDerivativeLowMemory *******************
- */
-
-template< class TFixedImage, class TMovingImage >
-void
-ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::UpdateDerivativeLowMemory(
-  const RealType & fixedImageValue,
-  const RealType & movingImageValue,
-  const DerivativeType & imageJacobian,
-  const NonZeroJacobianIndicesType & nzji,
-  DerivativeType & derivative ) const
-{
-  /** In this function we need to do (see eq. 24 of Thevenaz [3]):
-   *      derivative -= constant * imageJacobian *
-   *          \sum_i \sum_k PRatio(i,k) * dB/dxi(xi,i,k),
-   * with i, k, the fixed and moving histogram bins,
-   * PRatio the precomputed log( p(i,k) / p(i) ), and
-   * dB/dxi the B-spline derivative.
-   *
-   * Note (1) that we only have to loop over i,k within the support
-   * of the B-spline Parzen-window.
-   * Note (2) that imageJacobian may be sparse.
-   */
-
-  /** Determine the affected region. */
-
-  /** Determine Parzen window arguments (see eq. 6 of Mattes paper [2]). */
-  const double fixedImageParzenWindowTerm
-    = fixedImageValue / this->m_FixedImageBinSize - this->m_FixedImageNormalizedMin;
-  const double movingImageParzenWindowTerm
-    = movingImageValue / this->m_MovingImageBinSize - this->m_MovingImageNormalizedMin;
-
-  /** The lowest bin numbers affected by this pixel: */
-  const int fixedParzenWindowIndex
-    = static_cast< int >( std::floor(
-    fixedImageParzenWindowTerm + this->m_FixedParzenTermToIndexOffset ) );
-  const int movingParzenWindowIndex
-    = static_cast< int >( std::floor(
-    movingImageParzenWindowTerm + this->m_MovingParzenTermToIndexOffset ) );
-
-  /** Compute the fixed Parzen values. */
-  ParzenValueContainerType fixedParzenValues( this->m_JointPDFWindow.GetSize()[ 1 ] );
-  this->EvaluateParzenValues(
-    fixedImageParzenWindowTerm, fixedParzenWindowIndex,
-    this->m_FixedKernel, fixedParzenValues );
-
-  /** Compute the derivatives of the moving Parzen window. */
-  ParzenValueContainerType derivativeMovingParzenValues( this->m_JointPDFWindow.GetSize()[ 0 ] );
-  this->EvaluateParzenValues(
-    movingImageParzenWindowTerm, movingParzenWindowIndex,
-    this->m_DerivativeMovingKernel, derivativeMovingParzenValues );
-
-  /** Get the moving image bin size. */
-  const double et = static_cast< double >( this->m_MovingImageBinSize );
-
-  /** Loop over the Parzen window region and increment sum. */
-  PDFValueType sum = 0.0;
-  for( unsigned int f = 0; f < fixedParzenValues.GetSize(); ++f )
-  {
-    const double fv_et = fixedParzenValues[ f ] / et;
-    for( unsigned int m = 0; m < derivativeMovingParzenValues.GetSize(); ++m )
-    {
-      sum += this->m_PRatioArray[ f + fixedParzenWindowIndex ][ m + movingParzenWindowIndex ]
-        * fv_et * derivativeMovingParzenValues[ m ];
-    }
-  }
-
-  /** Now compute derivative -= sum * imageJacobian. */
-  if( nzji.size() == this->GetNumberOfParameters() )
-  {
-    /** Loop over all Jacobians. */
-    for( unsigned int mu = 0; mu < this->GetNumberOfParameters(); ++mu )
-    {
-      derivative[ mu ] += static_cast< DerivativeValueType >(
-        imageJacobian[ mu ] * sum );
-    }
-  }
-  else
-  {
-    /** Loop only over the non-zero Jacobians. */
-    for( unsigned int i = 0; i < imageJacobian.GetSize(); ++i )
-    {
-      const unsigned int mu = nzji[ i ];
-      derivative[ mu ] += static_cast< DerivativeValueType >(
-        imageJacobian[ i ] * sum );
-    }
-  }
-
-} // end UpdateDerivativeLowMemory()
-
-
 /**
  * ******************** GetValueAndFiniteDifferenceDerivative *******************
  */
@@ -1054,102 +605,6 @@ ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
 } // end GetValueAndFiniteDifferenceDerivative
 
 
-/**
- * ******************** ComputeJacobianPreconditioner *******************
- */
-
-template< class TFixedImage, class TMovingImage >
-void
-ParzenWindowMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeJacobianPreconditioner(
-  const TransformJacobianType & jac,
-  const NonZeroJacobianIndicesType & nzji,
-  DerivativeType & preconditioner,
-  DerivativeType & divisor ) const
-{
-  typedef typename TransformJacobianType::ValueType TransformJacobianValueType;
-  const unsigned int M = nzji.size();
-  typedef Matrix< double, MovingImageDimension, MovingImageDimension > MatrixType;
-  MatrixType jacjact;
-
-  /** Compute jac * jac' */
-  for( unsigned int drow = 0; drow < MovingImageDimension; ++drow )
-  {
-    for( unsigned int dcol = drow; dcol < MovingImageDimension; ++dcol )
-    {
-      const TransformJacobianValueType * jacit1 = jac[ drow ];
-      const TransformJacobianValueType * jacit2 = jac[ dcol ];
-      double                             sum    = 0.0;
-      for( unsigned int mu = 0; mu < M; ++mu )
-      {
-        sum += ( *jacit1 ) * ( *jacit2 );
-        ++jacit1;
-        ++jacit2;
-      }
-      jacjact( drow, dcol ) = sum;
-      jacjact( dcol, drow ) = sum;
-    }
-  }
-
-  /** Invert */
-  const double addtodiag = 1e-10;
-  for( unsigned int drow = 0; drow < MovingImageDimension; ++drow )
-  {
-    jacjact( drow, drow ) += addtodiag;
-  }
-  jacjact = vnl_inverse( jacjact.GetVnlMatrix() );
-
-  /** Compute preconditioner = diag( jac' * m * jac ),
-   * with m = inv(jacjact)
-   * implementation:
-   * preconditioner = sum_dr sum_dc m(dr,dc) jac(dr,:) * jac(dc,:)
-   */
-  preconditioner.Fill( 0.0 );
-  for( unsigned int drow = 0; drow < MovingImageDimension; ++drow )
-  {
-    for( unsigned int dcol = drow; dcol < MovingImageDimension; ++dcol )
-    {
-      DerivativeValueType *              precondit = preconditioner.begin();
-      const TransformJacobianValueType * jacit1    = jac[ drow ];
-      const TransformJacobianValueType * jacit2    = jac[ dcol ];
-      /** count twice if off-diagonal */
-      const double fac = drow == dcol ? 1.0 : 2.0;
-      const double m   = fac * jacjact( drow, dcol );
-      for( unsigned int mu = 0; mu < M; ++mu )
-      {
-        *precondit += m * ( *jacit1 ) * ( *jacit2 );
-        ++precondit;
-        ++jacit1;
-        ++jacit2;
-
-      }
-    }
-  }
-
-  /** Update divisor = sum_samples diag(jac'*jac) */
-  DerivativeType temp( M );
-  temp.Fill( 0.0 );
-  /** Compute this sample's contribution */
-  for( unsigned int drow = 0; drow < MovingImageDimension; ++drow )
-  {
-    DerivativeValueType *              tempit = temp.begin();
-    const TransformJacobianValueType * jacit1 = jac[ drow ];
-    for( unsigned int mu = 0; mu < M; ++mu )
-    {
-      *tempit += vnl_math_sqr( *jacit1 );
-      ++tempit;
-      ++jacit1;
-    }
-  }
-  /** Update divisor */
-  for( unsigned int mu = 0; mu < M; ++mu )
-  {
-    divisor[ nzji[ mu ] ] += temp[ mu ];
-  }
-
-} // end ComputeJacobianPreconditioner()
-
-
 } // end namespace itk
 
 #endif // end #ifndef _itkParzenWindowMutualInformationImageToImageMetric_HXX__
@@ -110,6 +110,8 @@ public:
   typedef typename Superclass::ImageSampleContainerType   ImageSampleContainerType;
   typedef typename
     Superclass::ImageSampleContainerPointer ImageSampleContainerPointer;
+  typedef typename
+    Superclass::ImageSampleWeightContainerType ImageSampleWeightContainerType;
   typedef typename Superclass::FixedImageLimiterType  FixedImageLimiterType;
   typedef typename Superclass::MovingImageLimiterType MovingImageLimiterType;
   typedef typename
@@ -220,11 +222,13 @@ protected:
 
   double m_NormalizationFactor;
 
-  /** Compute a pixel's contribution to the measure and derivatives;
+  /** Compute a pixel's contribution to the measure and derivatives,
+   * multiplied by the importance weight of its sample;
    * Called by GetValueAndDerivative(). */
   void UpdateValueAndDerivativeTerms(
     const RealType fixedImageValue,
     const RealType movingImageValue,
+    const RealType sampleWeight,
     const DerivativeType & imageJacobian,
     const NonZeroJacobianIndicesType & nzji,
     MeasureType & measure,
@@ -240,12 +244,20 @@ protected:
   /** Get value for each thread. */
   inline void ThreadedGetValue( ThreadIdType threadID );
 
+  /** Get value for a range of samples. */
+  inline void ThreadedGetValueOnSampleRange( ThreadIdType threadID,
+    SizeValueType begin, SizeValueType end );
+
   /** Gather the values from all threads. */
   inline void AfterThreadedGetValue( MeasureType & value ) const;
 
   /** Get value and derivatives for each thread. */
   inline void ThreadedGetValueAndDerivative( ThreadIdType threadID );
 
+  /** Get value and derivatives for a range of samples. */
+  inline void ThreadedGetValueAndDerivativeOnSampleRange( ThreadIdType threadID,
+    SizeValueType begin, SizeValueType end );
+
   /** Gather the values and derivatives from all threads. */
   inline void AfterThreadedGetValueAndDerivative(
     MeasureType & value, DerivativeType & derivative ) const;
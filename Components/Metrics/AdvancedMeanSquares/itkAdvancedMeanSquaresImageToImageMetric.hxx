@@ -39,8 +39,10 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
 ::AdvancedMeanSquaresImageToImageMetric()
 {
   this->SetUseImageSampler( true );
+  this->SetUseFixedImageSampleWeights( true );
   this->SetUseFixedImageLimiter( false );
   this->SetUseMovingImageLimiter( false );
+  this->SetSupportsSampleRangeThreading( true );
 
   this->m_UseNormalization    = false;
   this->m_NormalizationFactor = 1.0;
@@ -67,6 +69,12 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
   /** Initialize transform, interpolator, etc. */
   Superclass::Initialize();
 
+  /** The samples are read in batches, see GetFixedImageSamples(). */
+  if( this->GetImageSampler() )
+  {
+    this->GetImageSampler()->SetGenerateSampleBatchContainer( true );
+  }
+
   if( this->GetUseNormalization() )
   {
     /** Try to guess a normalization factor. */
@@ -209,6 +217,10 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
   typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
   typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
 
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
+
   /** Loop over the fixed image samples to calculate the mean squares. */
   for( fiter = fbegin; fiter != fend; ++fiter )
   {
@@ -244,7 +256,7 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
 
       /** The difference squared. */
       const RealType diff = movingImageValue - fixedImageValue;
-      measure += diff * diff;
+      measure += useSampleWeights ? sampleWeights[ fiter.Index() ] * diff * diff : diff * diff;
 
     } // end if sampleOk
 
@@ -319,9 +331,8 @@ void
 AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
 ::ThreadedGetValue( ThreadIdType threadId )
 {
-  /** Get a handle to the sample container. */
-  ImageSampleContainerPointer sampleContainer     = this->GetImageSampler()->GetOutput();
-  const unsigned long         sampleContainerSize = sampleContainer->Size();
+  /** Get the size of the sample container. */
+  const unsigned long sampleContainerSize = this->GetImageSampler()->GetOutput()->Size();
 
   /** Get the samples for this thread. */
   const unsigned long nrOfSamplesPerThreads
@@ -333,6 +344,24 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
   pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
   pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
 
+  this->ThreadedGetValueOnSampleRange( threadId, pos_begin, pos_end );
+
+} // end ThreadedGetValue()
+
+
+/**
+ * ******************* ThreadedGetValueOnSampleRange *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValueOnSampleRange( ThreadIdType threadId,
+  SizeValueType pos_begin, SizeValueType pos_end )
+{
+  /** Get a handle to the sample container. */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+
   /** Create iterator over the sample container. */
   typename ImageSampleContainerType::ConstIterator threader_fiter;
   typename ImageSampleContainerType::ConstIterator threader_fbegin = sampleContainer->Begin();
@@ -345,6 +374,10 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
   unsigned long numberOfPixelsCounted = 0;
   MeasureType   measure               = NumericTraits< MeasureType >::Zero;
 
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
+
   /** Loop over the fixed image to calculate the mean squares. */
   for( threader_fiter = threader_fbegin; threader_fiter != threader_fend; ++threader_fiter )
   {
@@ -381,17 +414,18 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
 
       /** The difference squared. */
       const RealType diff = movingImageValue - fixedImageValue;
-      measure += diff * diff;
+      measure += useSampleWeights ? sampleWeights[ threader_fiter.Index() ] * diff * diff : diff * diff;
 
     } // end if sampleOk
 
   } // end for loop over the image sample container
 
-  /** Only update these variables at the end to prevent unnecessary "false sharing". */
-  this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_NumberOfPixelsCounted = numberOfPixelsCounted;
-  this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Value                 = measure;
+  /** Only update these variables at the end to prevent unnecessary "false sharing".
+   * A thread may process several sample ranges, so add to them. */
+  this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_NumberOfPixelsCounted += numberOfPixelsCounted;
+  this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Value                 += measure;
 
-} // end ThreadedGetValue()
+} // end ThreadedGetValueOnSampleRange()
 
 
 /**
@@ -405,14 +439,20 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
 {
   const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
 
-  /** Accumulate the number of pixels. */
-  this->m_NumberOfPixelsCounted = this->m_GetValueAndDerivativePerThreadVariables[ 0 ].st_NumberOfPixelsCounted;
-  for( ThreadIdType i = 1; i < numberOfThreads; ++i )
+  /** Accumulate the number of pixels and the values. The per-thread
+   * variables are reset before the number of samples is checked, so that
+   * no partial sums are left behind when the check throws.
+   */
+  this->m_NumberOfPixelsCounted = 0;
+  value = NumericTraits< MeasureType >::Zero;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
   {
     this->m_NumberOfPixelsCounted += this->m_GetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted;
+    value                         += this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value;
 
-    /** Reset this variable for the next iteration. */
+    /** Reset these variables for the next iteration. */
     this->m_GetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted = 0;
+    this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value                 = NumericTraits< MeasureType >::Zero;
   }
 
   /** Check if enough samples were valid. */
@@ -424,15 +464,6 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
   DerivativeValueType normal_sum = this->m_NormalizationFactor
     / static_cast< DerivativeValueType >( this->m_NumberOfPixelsCounted );
 
-  /** Accumulate values. */
-  value = NumericTraits< MeasureType >::Zero;
-  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
-  {
-    value += this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value;
-
-    /** Reset this variable for the next iteration. */
-    this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value = NumericTraits< MeasureType >::Zero;
-  }
   value *= normal_sum;
 
 } // end AfterThreadedGetValue()
@@ -508,6 +539,10 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
   typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
   typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
 
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
+
   /** Loop over the fixed image to calculate the mean squares. */
   for( fiter = fbegin; fiter != fend; ++fiter )
   {
@@ -560,6 +595,7 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
       /** Compute this pixel's contribution to the measure and derivatives. */
       this->UpdateValueAndDerivativeTerms(
         fixedImageValue, movingImageValue,
+        useSampleWeights ? sampleWeights[ fiter.Index() ] : 1.0,
         imageJacobian, nzji,
         measure, derivative );
 
@@ -638,21 +674,8 @@ void
 AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
 ::ThreadedGetValueAndDerivative( ThreadIdType threadId )
 {
-  /** Initialize array that stores dM(x)/dmu, and the sparse Jacobian + indices. */
-  const NumberOfParametersType nnzji = this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices();
-  NonZeroJacobianIndicesType   nzji  = NonZeroJacobianIndicesType( nnzji );
-  DerivativeType               imageJacobian( nnzji );
-
-  /** Get a handle to the pre-allocated derivative for the current thread.
-   * The initialization is performed at the beginning of each resolution in
-   * InitializeThreadingParameters(), and at the end of each iteration in
-   * AfterThreadedGetValueAndDerivative() and the accumulate functions.
-   */
-  DerivativeType & derivative = this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Derivative;
-
-  /** Get a handle to the sample container. */
-  ImageSampleContainerPointer sampleContainer     = this->GetImageSampler()->GetOutput();
-  const unsigned long         sampleContainerSize = sampleContainer->Size();
+  /** Get the size of the sample container. */
+  const unsigned long sampleContainerSize = this->GetImageSampler()->GetOutput()->Size();
 
   /** Get the samples for this thread. */
   const unsigned long nrOfSamplesPerThreads
@@ -664,81 +687,125 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
   pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
   pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
 
-  /** Create iterator over the sample container. */
-  typename ImageSampleContainerType::ConstIterator threader_fiter;
-  typename ImageSampleContainerType::ConstIterator threader_fbegin = sampleContainer->Begin();
-  typename ImageSampleContainerType::ConstIterator threader_fend   = sampleContainer->Begin();
+  this->ThreadedGetValueAndDerivativeOnSampleRange( threadId, pos_begin, pos_end );
 
-  threader_fbegin += (int)pos_begin;
-  threader_fend   += (int)pos_end;
+} // end ThreadedGetValueAndDerivative()
+
+
+/**
+ * ******************* ThreadedGetValueAndDerivativeOnSampleRange *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValueAndDerivativeOnSampleRange( ThreadIdType threadId,
+  SizeValueType pos_begin, SizeValueType pos_end )
+{
+  /** The samples are processed in batches, so that the transform can evaluate
+   * a batch at once, using SIMD instructions if available.
+   */
+  typedef typename Superclass::AdvancedTransformType::MovingImageGradientType MovingImageGradientType;
+  const unsigned int batchSize = Superclass::SampleBatchSize;
+
+  /** Get the pre-allocated arrays that store dM(x)/dmu, and the sparse Jacobian + indices. */
+  typename Superclass::ThreadScratchStruct &  scratch       = this->GetThreadScratch( threadId );
+  std::vector< NonZeroJacobianIndicesType > & nzji          = scratch.st_BatchNonZeroJacobianIndices;
+  std::vector< DerivativeType > &             imageJacobian = scratch.st_BatchImageJacobians;
+
+  /** Per batch: the fixed points, mapped points, image values and moving image gradients. */
+  FixedImagePointType     fixedPoints[ batchSize ];
+  MovingImagePointType    mappedPoints[ batchSize ];
+  RealType                fixedImageValues[ batchSize ];
+  RealType                movingImageValues[ batchSize ];
+  RealType                sampleWeightValues[ batchSize ];
+  MovingImageGradientType movingImageGradients[ batchSize ];
+
+  /** The importance weights of the samples, if the sampler provides them. */
+  const ImageSampleWeightContainerType & sampleWeights    = this->GetFixedImageSampleWeights();
+  const bool                             useSampleWeights = !sampleWeights.empty();
+
+  /** Get a handle to the pre-allocated derivative for the current thread.
+   * The initialization is performed at the beginning of each resolution in
+   * InitializeThreadingParameters(), and at the end of each iteration in
+   * AfterThreadedGetValueAndDerivative() and the accumulate functions.
+   */
+  DerivativeType & derivative = this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Derivative;
 
   /** Create variables to store intermediate results. circumvent false sharing */
   unsigned long numberOfPixelsCounted = 0;
   MeasureType   measure               = NumericTraits< MeasureType >::Zero;
 
-  /** Loop over the fixed image to calculate the mean squares. */
-  for( threader_fiter = threader_fbegin; threader_fiter != threader_fend; ++threader_fiter )
+  /** Loop over the fixed image samples, in batches, to calculate the mean squares. */
+  for( SizeValueType batchBegin = pos_begin; batchBegin < pos_end; batchBegin += batchSize )
   {
-    /** Read fixed coordinates and initialize some variables. */
-    const FixedImagePointType & fixedPoint = ( *threader_fiter ).Value().m_ImageCoordinates;
-    RealType                    movingImageValue;
-    MovingImagePointType        mappedPoint;
-    MovingImageDerivativeType   movingImageDerivative;
+    const unsigned int numberOfPoints = static_cast< unsigned int >(
+      ( pos_end - batchBegin < batchSize ) ? pos_end - batchBegin : batchSize );
 
-    /** Transform point and check if it is inside the B-spline support region. */
-    bool sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
+    /** Read the fixed coordinates and values of this batch. */
+    this->GetFixedImageSamples( batchBegin, numberOfPoints, fixedPoints, fixedImageValues );
 
-    /** Check if point is inside mask. */
-    if( sampleOk )
-    {
-      sampleOk = this->IsInsideMovingMask( mappedPoint ); // thread-safe?
-    }
+    /** Transform the points of this batch. */
+    this->TransformPoints( fixedPoints, mappedPoints, numberOfPoints );
 
-    /** Compute the moving image value M(T(x)) and derivative dM/dx and check if
-     * the point is inside the moving image buffer.
-     */
-    if( sampleOk )
+    /** Keep the valid samples, and move them to the front of the batch arrays. */
+    unsigned int numberOfValidPoints = 0;
+    for( unsigned int i = 0; i < numberOfPoints; ++i )
     {
-      sampleOk = this->EvaluateMovingImageValueAndDerivative(
-        mappedPoint, movingImageValue, &movingImageDerivative );
-    }
+      RealType                  movingImageValue;
+      MovingImageDerivativeType movingImageDerivative;
 
-    if( sampleOk )
-    {
-      numberOfPixelsCounted++;
+      /** Check if point is inside mask. */
+      bool sampleOk = this->IsInsideMovingMask( mappedPoints[ i ] );
 
-      /** Get the fixed image value. */
-      const RealType & fixedImageValue
-        = static_cast< RealType >( ( *threader_fiter ).Value().m_ImageValue );
+      /** Compute the moving image value M(T(x)) and derivative dM/dx and check if
+       * the point is inside the moving image buffer.
+       */
+      if( sampleOk )
+      {
+        sampleOk = this->EvaluateMovingImageValueAndDerivative(
+          mappedPoints[ i ], movingImageValue, &movingImageDerivative );
+      }
 
-#if 0
-      /** Get the TransformJacobian dT/dmu. */
-      this->EvaluateTransformJacobian( fixedPoint, jacobian, nzji );
+      if( sampleOk )
+      {
+        fixedPoints[ numberOfValidPoints ]       = fixedPoints[ i ];
+        fixedImageValues[ numberOfValidPoints ]  = fixedImageValues[ i ];
+        movingImageValues[ numberOfValidPoints ] = movingImageValue;
+        sampleWeightValues[ numberOfValidPoints ]
+          = useSampleWeights ? sampleWeights[ batchBegin + i ] : 1.0;
+        for( unsigned int d = 0; d < FixedImageDimension; ++d )
+        {
+          movingImageGradients[ numberOfValidPoints ][ d ] = movingImageDerivative[ d ];
+        }
+        ++numberOfValidPoints;
+      }
+    }
+    numberOfPixelsCounted += numberOfValidPoints;
 
-      /** Compute the inner products (dM/dx)^T (dT/dmu). */
-      this->EvaluateTransformJacobianInnerProduct(
-        jacobian, movingImageDerivative, imageJacobian );
-#else
-      /** Compute the inner product of the transform Jacobian dT/dmu and the moving image gradient dM/dx. */
-      this->m_AdvancedTransform->EvaluateJacobianWithImageGradientProduct(
-        fixedPoint, movingImageDerivative, imageJacobian, nzji );
-#endif
+    /** Compute the inner products of the transform Jacobian dT/dmu and the
+     * moving image gradient dM/dx, for all valid samples of this batch.
+     */
+    this->m_AdvancedTransform->EvaluateJacobianWithImageGradientProducts(
+      fixedPoints, movingImageGradients, &imageJacobian[ 0 ], &nzji[ 0 ], numberOfValidPoints );
 
-      /** Compute this pixel's contribution to the measure and derivatives. */
+    /** Compute the contributions to the measure and derivatives. */
+    for( unsigned int i = 0; i < numberOfValidPoints; ++i )
+    {
       this->UpdateValueAndDerivativeTerms(
-        fixedImageValue, movingImageValue,
-        imageJacobian, nzji,
+        fixedImageValues[ i ], movingImageValues[ i ], sampleWeightValues[ i ],
+        imageJacobian[ i ], nzji[ i ],
         measure, derivative );
-
-    } // end if sampleOk
+    }
 
   } // end for loop over the image sample container
 
-  /** Only update these variables at the end to prevent unnecessary "false sharing". */
-  this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_NumberOfPixelsCounted = numberOfPixelsCounted;
-  this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Value                 = measure;
+  /** Only update these variables at the end to prevent unnecessary "false sharing".
+   * A thread may process several sample ranges, so add to them. */
+  this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_NumberOfPixelsCounted += numberOfPixelsCounted;
+  this->m_GetValueAndDerivativePerThreadVariables[ threadId ].st_Value                 += measure;
 
-} // end ThreadedGetValueAndDerivative()
+} // end ThreadedGetValueAndDerivativeOnSampleRange()
 
 
 /**
@@ -753,34 +820,45 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
 {
   const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
 
-  /** Accumulate the number of pixels. */
-  this->m_NumberOfPixelsCounted = this->m_GetValueAndDerivativePerThreadVariables[ 0 ].st_NumberOfPixelsCounted;
-  for( ThreadIdType i = 1; i < numberOfThreads; ++i )
+  /** Accumulate the number of pixels and the values. The per-thread
+   * variables are reset before the number of samples is checked, so that
+   * no partial sums are left behind when the check throws.
+   */
+  this->m_NumberOfPixelsCounted = 0;
+  value = NumericTraits< MeasureType >::Zero;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
   {
     this->m_NumberOfPixelsCounted += this->m_GetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted;
+    value                         += this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value;
 
-    /** Reset this variable for the next iteration. */
+    /** Reset these variables for the next iteration. */
     this->m_GetValueAndDerivativePerThreadVariables[ i ].st_NumberOfPixelsCounted = 0;
+    this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value                 = NumericTraits< MeasureType >::Zero;
   }
 
-  /** Check if enough samples were valid. */
+  /** Check if enough samples were valid. If not, reset the derivatives,
+   * which are otherwise reset while they are accumulated.
+   */
   ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
-  this->CheckNumberOfSamples(
-    sampleContainer->Size(), this->m_NumberOfPixelsCounted );
+  try
+  {
+    this->CheckNumberOfSamples(
+      sampleContainer->Size(), this->m_NumberOfPixelsCounted );
+  }
+  catch( ExceptionObject & )
+  {
+    for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+    {
+      this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Derivative.Fill(
+        NumericTraits< DerivativeValueType >::ZeroValue() );
+    }
+    throw;
+  }
 
   /** The normalization factor. */
   DerivativeValueType normal_sum = this->m_NormalizationFactor
     / static_cast< DerivativeValueType >( this->m_NumberOfPixelsCounted );
 
-  /** Accumulate values. */
-  value = NumericTraits< MeasureType >::Zero;
-  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
-  {
-    value += this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value;
-
-    /** Reset this variable for the next iteration. */
-    this->m_GetValueAndDerivativePerThreadVariables[ i ].st_Value = NumericTraits< MeasureType >::Zero;
-  }
   value *= normal_sum;
 
   /** Accumulate derivatives. */
@@ -799,9 +877,7 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
     this->m_ThreaderMetricParameters.st_DerivativePointer   = derivative.begin();
     this->m_ThreaderMetricParameters.st_NormalizationFactor = 1.0 / normal_sum;
 
-    this->m_Threader->SetSingleMethod( this->AccumulateDerivativesThreaderCallback,
-      const_cast< void * >( static_cast< const void * >( &this->m_ThreaderMetricParameters ) ) );
-    this->m_Threader->SingleMethodExecute();
+    this->LaunchAccumulateDerivativesThreaderCallback();
   }
 #ifdef ELASTIX_USE_OPENMP
   // compute multi-threadedly with openmp
@@ -835,6 +911,7 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
 ::UpdateValueAndDerivativeTerms(
   const RealType fixedImageValue,
   const RealType movingImageValue,
+  const RealType sampleWeight,
   const DerivativeType & imageJacobian,
   const NonZeroJacobianIndicesType & nzji,
   MeasureType & measure,
@@ -843,10 +920,10 @@ AdvancedMeanSquaresImageToImageMetric< TFixedImage, TMovingImage >
   /** The difference squared. */
   const RealType diff     = movingImageValue - fixedImageValue;
   const RealType diffdiff = diff * diff;
-  measure += diffdiff;
+  measure += sampleWeight * diffdiff;
 
   /** Calculate the contributions to the derivatives with respect to each parameter. */
-  const RealType diff_2 = diff * 2.0;
+  const RealType diff_2 = sampleWeight * diff * 2.0;
   if( nzji.size() == this->GetNumberOfParameters() )
   {
     /** Loop over all Jacobians. */
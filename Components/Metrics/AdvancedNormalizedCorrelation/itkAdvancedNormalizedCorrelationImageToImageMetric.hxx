@@ -78,13 +78,14 @@ AdvancedNormalizedCorrelationImageToImageMetric< TFixedImage, TMovingImage >
    * which has performance benefits for larger vector sizes.
    */
 
-  /** Only resize the array of structs when needed. */
-  if( this->m_CorrelationGetValueAndDerivativePerThreadVariablesSize != numberOfThreads )
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_CorrelationGetValueAndDerivativePerThreadVariablesSize < numberOfThreads )
   {
     delete[] this->m_CorrelationGetValueAndDerivativePerThreadVariables;
     this->m_CorrelationGetValueAndDerivativePerThreadVariables
       = new AlignedCorrelationGetValueAndDerivativePerThreadStruct[ numberOfThreads ];
     this->m_CorrelationGetValueAndDerivativePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
   }
 
   /** Some initialization. */
@@ -98,14 +99,21 @@ AdvancedNormalizedCorrelationImageToImageMetric< TFixedImage, TMovingImage >
     this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_Sfm                   = zero1;
     this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_Sf                    = zero1;
     this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_Sm                    = zero1;
-    this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeF.SetSize( this->GetNumberOfParameters() );
-    this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeM.SetSize( this->GetNumberOfParameters() );
-    this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_Differential.SetSize( this->GetNumberOfParameters() );
+    if( this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeF.GetSize() != this->GetNumberOfParameters() )
+    {
+      this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeF.SetSize( this->GetNumberOfParameters() );
+      this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeM.SetSize( this->GetNumberOfParameters() );
+      this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_Differential.SetSize( this->GetNumberOfParameters() );
+      ++this->m_NumberOfPerThreadAllocations;
+    }
     this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeF.Fill( zero2 );
     this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_DerivativeM.Fill( zero2 );
     this->m_CorrelationGetValueAndDerivativePerThreadVariables[ i ].st_Differential.Fill( zero2 );
   }
 
+  /** Size the scratch memory of the threads. */
+  this->InitializeThreadScratch();
+
 } // end InitializeThreadingParameters()
 
 
@@ -531,10 +539,10 @@ void
 AdvancedNormalizedCorrelationImageToImageMetric< TFixedImage, TMovingImage >
 ::ThreadedGetValueAndDerivative( ThreadIdType threadId )
 {
-  /** Initialize array that stores dM(x)/dmu, and the sparse Jacobian + indices. */
-  const NumberOfParametersType nnzji = this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices();
-  NonZeroJacobianIndicesType   nzji  = NonZeroJacobianIndicesType( nnzji );
-  DerivativeType               imageJacobian( nzji.size() );
+  /** Get the pre-allocated arrays that store dM(x)/dmu, and the sparse Jacobian + indices. */
+  typename Superclass::ThreadScratchStruct & scratch       = this->GetThreadScratch( threadId );
+  NonZeroJacobianIndicesType &               nzji          = scratch.st_NonZeroJacobianIndices;
+  DerivativeType &                           imageJacobian = scratch.st_ImageJacobian;
 
   /** Get handles to the pre-allocated derivatives for the current thread.
    * The initialization is performed at the beginning of each resolution in
@@ -74,7 +74,10 @@ DisplacementMagnitudePenaltyTerm< TFixedImage, TScalarType >
   this->SetTransformParameters( parameters );
 
   /** Update the imageSampler and get a handle to the sample container. */
-  this->GetImageSampler()->Update();
+  if( this->GetUpdateImageSampler() )
+  {
+    this->GetImageSampler()->Update();
+  }
   ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
 
   /** Create iterator over the sample container. */
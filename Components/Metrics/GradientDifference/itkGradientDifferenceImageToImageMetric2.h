@@ -40,10 +40,12 @@
 #include "itkNeighborhoodOperatorImageFilter.h"
 #include "itkPoint.h"
 #include "itkCastImageFilter.h"
-#include "itkResampleImageFilter.h"
 #include "itkOptimizer.h"
 #include "itkAdvancedCombinationTransform.h"
 #include "itkAdvancedRayCastInterpolateImageFunction.h"
+#include "itkSampleNeighborhoodBuffer.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -64,6 +66,16 @@ namespace itk
  * on it. Values at these non-grid position of the Fixed image are
  * interpolated using a user-selected Interpolator.
  *
+ * The metric is computed at the samples of the image sampler. The moved
+ * image, i.e. the projection of the moving image computed by the ray cast
+ * interpolator, is only evaluated at the pixels of the fixed image grid
+ * that are needed for the Sobel gradients at the samples; see
+ * SampleNeighborhoodBuffer. These evaluations and the computation of the
+ * moved image gradients are multi-threaded. The subtraction factor uses the
+ * maximum moved image gradient over the samples, so a full image sampler
+ * without a mask gives the same value as resampling the complete moving
+ * image.
+ *
  * Implementation of this class is based on:
  * Hipwell, J. H., et. al. (2003), "Intensity-Based 2-D-3D Registration of
  * Cerebral Angiograms,", IEEE Transactions on Medical Imaging,
@@ -98,24 +110,30 @@ public:
   typedef typename Superclass::RealType RealType;
   #endif
 
-  typedef typename Superclass::TransformType           TransformType;
-  typedef typename TransformType::ScalarType           ScalarType;
-  typedef typename Superclass::TransformPointer        TransformPointer;
-  typedef typename Superclass::TransformParametersType TransformParametersType;
-  typedef typename Superclass::TransformJacobianType   TransformJacobianType;
-  typedef typename Superclass::InterpolatorType        InterpolatorType;
-  typedef typename InterpolatorType::Pointer           InterpolatorPointer;
-  typedef typename Superclass::MeasureType             MeasureType;
-  typedef typename Superclass::DerivativeType          DerivativeType;
-  typedef typename Superclass::FixedImageType          FixedImageType;
-  typedef typename Superclass::MovingImageType         MovingImageType;
-  typedef typename Superclass::FixedImageConstPointer  FixedImageConstPointer;
-  typedef typename Superclass::MovingImageConstPointer MovingImageConstPointer;
-  typedef typename TFixedImage::PixelType              FixedImagePixelType;
-  typedef typename TMovingImage::PixelType             MovedImagePixelType;
-  typedef typename MovingImageType::RegionType         MovingImageRegionType;
-  typedef typename itk::Optimizer                      OptimizerType;
-  typedef typename OptimizerType::ScalesType           ScalesType;
+  typedef typename Superclass::TransformType               TransformType;
+  typedef typename TransformType::ScalarType               ScalarType;
+  typedef typename Superclass::TransformPointer            TransformPointer;
+  typedef typename Superclass::TransformParametersType     TransformParametersType;
+  typedef typename Superclass::TransformJacobianType       TransformJacobianType;
+  typedef typename Superclass::InterpolatorType            InterpolatorType;
+  typedef typename InterpolatorType::Pointer               InterpolatorPointer;
+  typedef typename Superclass::MeasureType                 MeasureType;
+  typedef typename Superclass::DerivativeType              DerivativeType;
+  typedef typename Superclass::FixedImageType              FixedImageType;
+  typedef typename Superclass::MovingImageType             MovingImageType;
+  typedef typename Superclass::FixedImageConstPointer      FixedImageConstPointer;
+  typedef typename Superclass::MovingImageConstPointer     MovingImageConstPointer;
+  typedef typename Superclass::ImageSampleContainerType    ImageSampleContainerType;
+  typedef typename Superclass::ImageSampleContainerPointer ImageSampleContainerPointer;
+  typedef typename Superclass::ThreaderType                ThreaderType;
+  typedef typename Superclass::ThreadInfoType              ThreadInfoType;
+  typedef typename TFixedImage::PixelType                  FixedImagePixelType;
+  typedef typename TFixedImage::IndexType                  FixedImageIndexType;
+  typedef typename TFixedImage::OffsetType                 FixedImageOffsetType;
+  typedef typename TMovingImage::PixelType                 MovedImagePixelType;
+  typedef typename MovingImageType::RegionType             MovingImageRegionType;
+  typedef typename itk::Optimizer                          OptimizerType;
+  typedef typename OptimizerType::ScalesType               ScalesType;
 
   itkStaticConstMacro( FixedImageDimension, unsigned int,
     FixedImageType::ImageDimension );
@@ -125,13 +143,11 @@ public:
   typedef typename itk::AdvancedCombinationTransform< ScalarType, FixedImageDimension >
     CombinationTransformType;
   typedef typename CombinationTransformType::Pointer CombinationTransformPointer;
-  typedef itk::Image< FixedImagePixelType, itkGetStaticConstMacro( FixedImageDimension ) >
-    TransformedMovingImageType;
-  typedef itk::ResampleImageFilter< MovingImageType, TransformedMovingImageType >
-    TransformMovingImageFilterType;
   typedef typename itk::AdvancedRayCastInterpolateImageFunction<
     MovingImageType, ScalarType >             RayCastInterpolatorType;
-  typedef typename RayCastInterpolatorType::Pointer RayCastInterpolatorPointer;
+  typedef typename RayCastInterpolatorType::Pointer          RayCastInterpolatorPointer;
+  typedef typename RayCastInterpolatorType::TransformType    RayCastTransformType;
+  typedef typename RayCastInterpolatorType::TransformPointer RayCastTransformPointer;
   typedef itk::Image< RealType, itkGetStaticConstMacro( FixedImageDimension ) >
     FixedGradientImageType;
   typedef itk::CastImageFilter< FixedImageType, FixedGradientImageType >
@@ -140,11 +156,12 @@ public:
   typedef typename FixedGradientImageType::PixelType FixedGradientPixelType;
   typedef itk::Image< RealType, itkGetStaticConstMacro( MovedImageDimension ) >
     MovedGradientImageType;
-  typedef itk::CastImageFilter< TransformedMovingImageType, MovedGradientImageType >
-    CastMovedImageFilterType;
-  typedef typename CastMovedImageFilterType::Pointer CastMovedImageFilterPointer;
   typedef typename MovedGradientImageType::PixelType MovedGradientPixelType;
 
+  /** The buffer for the moved image at the neighborhoods of the samples. */
+  typedef SampleNeighborhoodBuffer< FixedImageType >     SampleNeighborhoodBufferType;
+  typedef typename SampleNeighborhoodBufferType::Pointer SampleNeighborhoodBufferPointer;
+
   /** Get the derivatives of the match measure. */
   void GetDerivative( const TransformParametersType & parameters,
     DerivativeType  & derivative ) const;
@@ -173,24 +190,86 @@ public:
 protected:
 
   GradientDifferenceImageToImageMetric();
-  virtual ~GradientDifferenceImageToImageMetric() {}
+  virtual ~GradientDifferenceImageToImageMetric();
   void PrintSelf( std::ostream & os, Indent indent ) const;
 
-  /** Compute the range of the moved image gradients. */
-  void ComputeMovedGradientRange( void ) const;
-
   /** Compute the variance and range of the moving image gradients. */
   void ComputeVariance( void ) const;
 
-  /** Compute the similarity measure using a specified subtraction factor. */
-  MeasureType ComputeMeasure( const TransformParametersType & parameters,
-    const double * subtractionFactor ) const;
-
   typedef NeighborhoodOperatorImageFilter<
     FixedGradientImageType, FixedGradientImageType > FixedSobelFilter;
 
-  typedef NeighborhoodOperatorImageFilter<
-    MovedGradientImageType, MovedGradientImageType > MovedSobelFilter;
+  /** Initialize some multi-threading related parameters. */
+  virtual void InitializeThreadingParameters( void ) const;
+
+  /** Evaluate the moved image at the pixels in the neighborhoods of the
+   * samples, multi-threaded if m_UseMultiThread == true.
+   */
+  void ComputeMovedImageValues( void ) const;
+
+  /** Evaluate the moved image at the pixels [ begin, end ) of the
+   * SampleNeighborhoodBuffer.
+   */
+  void ComputeMovedImageValuesOnRange( SizeValueType begin, SizeValueType end ) const;
+
+  /** Multi-threaded version of ComputeMovedImageValues(). */
+  inline void ThreadedComputeMovedImageValues( ThreadIdType threadId );
+
+  /** Helper function to launch the threads. */
+  static ITK_THREAD_RETURN_TYPE ComputeMovedImageValuesThreaderCallback( void * arg );
+
+  /** Compute the moved image gradients at the samples [ begin, end ),
+   * and their maximum.
+   */
+  virtual void ThreadedGetValue( ThreadIdType threadId );
+
+  virtual void ThreadedGetValueOnSampleRange( ThreadIdType threadId,
+    SizeValueType begin, SizeValueType end );
+
+  /** Compute the similarity measure using the subtraction factor of the
+   * maximum moved image gradients of all threads.
+   */
+  virtual void AfterThreadedGetValue( MeasureType & value ) const;
+
+  /** The type of the per-thread sums of the similarity measure. */
+  typedef typename NumericTraits< MeasureType >::AccumulateType AccumulateType;
+
+  /** Sum the similarity measure over the samples, multi-threaded if
+   * m_UseMultiThread == true. Needs the subtraction factors.
+   */
+  AccumulateType ComputeMeasure( void ) const;
+
+  /** Sum the similarity measure over the samples [ begin, end ). */
+  AccumulateType ComputeMeasureOnRange( SizeValueType begin, SizeValueType end ) const;
+
+  /** Multi-threaded version of ComputeMeasure(). */
+  inline void ThreadedComputeMeasure( ThreadIdType threadId );
+
+  /** Helper function to launch the threads. */
+  static ITK_THREAD_RETURN_TYPE ComputeMeasureThreaderCallback( void * arg );
+
+  /** Threading related parameters. */
+  struct GradientDifferenceMultiThreaderParameterType
+  {
+    Self * m_Metric;
+  };
+  GradientDifferenceMultiThreaderParameterType m_GradientDifferenceThreaderParameters;
+
+  /** The maximum moved image gradients and the sum of the similarity
+   * measure per thread.
+   */
+  struct GradientDifferenceGetValuePerThreadStruct
+  {
+    SizeValueType          st_NumberOfPixelsCounted;
+    MovedGradientPixelType st_MaxMovedGradient[ FixedImageDimension ];
+    AccumulateType         st_Measure;
+  };
+  itkPadStruct( ITK_CACHE_LINE_ALIGNMENT, GradientDifferenceGetValuePerThreadStruct,
+    PaddedGradientDifferenceGetValuePerThreadStruct );
+  itkAlignedTypedef( ITK_CACHE_LINE_ALIGNMENT, PaddedGradientDifferenceGetValuePerThreadStruct,
+    AlignedGradientDifferenceGetValuePerThreadStruct );
+  mutable AlignedGradientDifferenceGetValuePerThreadStruct * m_GradientDifferenceGetValuePerThreadVariables;
+  mutable ThreadIdType                                       m_GradientDifferenceGetValuePerThreadVariablesSize;
 
 private:
 
@@ -200,16 +279,23 @@ private:
   /** The variance of the moving image gradients. */
   mutable MovedGradientPixelType m_Variance[ FixedImageDimension ];
 
-  /** The range of the moving image gradients. */
-  mutable MovedGradientPixelType m_MinMovedGradient[ MovedImageDimension ];
-  mutable MovedGradientPixelType m_MaxMovedGradient[ MovedImageDimension ];
-
   /** The range of the fixed image gradients. */
   mutable FixedGradientPixelType m_MinFixedGradient[ FixedImageDimension ];
   mutable FixedGradientPixelType m_MaxFixedGradient[ FixedImageDimension ];
 
-  /** The filter for transforming the moving image. */
-  typename TransformMovingImageFilterType::Pointer m_TransformMovingImageFilter;
+  /** The factors that scale the moved gradients to the range of the fixed
+   * gradients, for the current transform parameters.
+   */
+  mutable MovedGradientPixelType m_SubtractionFactor[ FixedImageDimension ];
+
+  /** The ray cast interpolator and its transform, which map a point of the
+   * fixed image to the moved image.
+   */
+  RayCastInterpolatorPointer m_RayCastInterpolator;
+  RayCastTransformPointer    m_RayCastTransform;
+
+  /** The moved image at the pixels in the neighborhoods of the samples. */
+  SampleNeighborhoodBufferPointer m_SampleNeighborhoodBuffer;
 
   /** The Sobel gradients of the fixed image */
   CastFixedImageFilterPointer m_CastFixedImageFilter;
@@ -221,18 +307,20 @@ private:
   typename FixedSobelFilter::Pointer m_FixedSobelFilters[ itkGetStaticConstMacro
     ( FixedImageDimension ) ];
 
-  ZeroFluxNeumannBoundaryCondition< MovedGradientImageType > m_MovedBoundCond;
   ZeroFluxNeumannBoundaryCondition< FixedGradientImageType > m_FixedBoundCond;
 
-  /** The Sobel gradients of the moving image */
-  CastMovedImageFilterPointer m_CastMovedImageFilter;
-
+  /** The Sobel operators for the moved image, which is defined on the grid
+   * of the fixed image, with their offsets and weights stored contiguously.
+   */
   SobelOperator< MovedGradientPixelType,
-  itkGetStaticConstMacro( MovedImageDimension ) >
-  m_MovedSobelOperators[ MovedImageDimension ];
+  itkGetStaticConstMacro( FixedImageDimension ) >
+  m_MovedSobelOperators[ FixedImageDimension ];
+
+  std::vector< FixedImageOffsetType > m_SobelOffsets;
+  std::vector< RealType >             m_SobelWeights;
 
-  typename MovedSobelFilter::Pointer m_MovedSobelFilters[ itkGetStaticConstMacro
-    ( MovedImageDimension ) ];
+  /** The moved image gradients at the samples, stored per sample. */
+  mutable std::vector< MovedGradientPixelType > m_MovedGradients;
 
   ScalesType                  m_Scales;
   double                      m_DerivativeDelta;
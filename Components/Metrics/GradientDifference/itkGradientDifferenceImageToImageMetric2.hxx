@@ -37,14 +37,8 @@
 #include "itkGradientDifferenceImageToImageMetric2.h"
 #include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkNumericTraits.h"
-#include "itkRescaleIntensityImageFilter.h"
-#include "itkImageFileWriter.h"
 
-#include <iostream>
-#include <iomanip>
-#include <stdio.h>
-
-#include "itkSimpleFilterWatcher.h"
+#include <cmath>
 
 namespace itk
 {
@@ -58,29 +52,43 @@ GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
 ::GradientDifferenceImageToImageMetric()
 {
   unsigned int iDimension;
-  this->m_CastMovedImageFilter       = CastMovedImageFilterType::New();
-  this->m_CastFixedImageFilter       = CastFixedImageFilterType::New();
-  this->m_CombinationTransform       = CombinationTransformType::New();
-  this->m_TransformMovingImageFilter = TransformMovingImageFilterType::New();
+  this->m_CastFixedImageFilter     = CastFixedImageFilterType::New();
+  this->m_CombinationTransform     = CombinationTransformType::New();
+  this->m_SampleNeighborhoodBuffer = SampleNeighborhoodBufferType::New();
 
   for( iDimension = 0; iDimension < FixedImageDimension; iDimension++ )
   {
-    this->m_MinFixedGradient[ iDimension ] = 0;
-    this->m_MaxFixedGradient[ iDimension ] = 0;
-    this->m_Variance[ iDimension ]         = 0;
-  }
-
-  for( iDimension = 0; iDimension < MovedImageDimension; iDimension++ )
-  {
-    this->m_MinMovedGradient[ iDimension ] = 0;
-    this->m_MaxMovedGradient[ iDimension ] = 0;
+    this->m_MinFixedGradient[ iDimension ]  = 0;
+    this->m_MaxFixedGradient[ iDimension ]  = 0;
+    this->m_Variance[ iDimension ]          = 0;
+    this->m_SubtractionFactor[ iDimension ] = 0;
   }
 
   this->m_DerivativeDelta = 0.001;
   this->m_Rescalingfactor = 1.0;
+
+  this->SetUseImageSampler( true );
+  this->SetSupportsSampleRangeThreading( true );
+
+  // Multi-threading structs
+  this->m_GradientDifferenceThreaderParameters.m_Metric    = this;
+  this->m_GradientDifferenceGetValuePerThreadVariables     = NULL;
+  this->m_GradientDifferenceGetValuePerThreadVariablesSize = 0;
 }
 
 
+/**
+ * ********************* Destructor ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::~GradientDifferenceImageToImageMetric()
+{
+  delete[] this->m_GradientDifferenceGetValuePerThreadVariables;
+} // end Destructor
+
+
 /**
  * ********************* Initialize ******************************
  */
@@ -110,40 +118,50 @@ GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
     this->m_FixedSobelFilters[ iFilter ]->UpdateLargestPossibleRegion();
   }
 
-  /** Resampling for 3D->2D */
+  /** Projection for 3D->2D */
   RayCastInterpolatorType * rayCaster = dynamic_cast< RayCastInterpolatorType * >(
     const_cast< InterpolatorType * >( this->GetInterpolator() ) );
   if( rayCaster != 0 )
   {
-    this->m_TransformMovingImageFilter->SetTransform( rayCaster->GetTransform() );
+    this->m_RayCastInterpolator = rayCaster;
+    this->m_RayCastTransform    = rayCaster->GetTransform();
   }
   else
   {
-    itkExceptionMacro( << "ERROR: the NormalizedGradientCorrelationImageToImageMetric is currently "
+    itkExceptionMacro( << "ERROR: the GradientDifferenceImageToImageMetric is currently "
                        << "only suitable for 2D-3D registration.\n"
                        << "  Therefore it expects an interpolator of type RayCastInterpolator." );
   }
-  this->m_TransformMovingImageFilter->SetInterpolator( this->m_Interpolator );
-  this->m_TransformMovingImageFilter->SetInput( this->m_MovingImage );
-  this->m_TransformMovingImageFilter->SetDefaultPixelValue( 0 );
-  this->m_TransformMovingImageFilter->SetSize( this->m_FixedImage->GetLargestPossibleRegion().GetSize() );
-  this->m_TransformMovingImageFilter->SetOutputOrigin( this->m_FixedImage->GetOrigin() );
-  this->m_TransformMovingImageFilter->SetOutputSpacing( this->m_FixedImage->GetSpacing() );
-  this->m_TransformMovingImageFilter->SetOutputDirection( this->m_FixedImage->GetDirection() );
-  this->m_TransformMovingImageFilter->Update();
-
-  this->m_CastMovedImageFilter->SetInput(
-    this->m_TransformMovingImageFilter->GetOutput() );
-
-  for( iFilter = 0; iFilter < MovedImageDimension; iFilter++ )
+
+  /** Set up the Sobel operators of the moved image. */
+  for( iFilter = 0; iFilter < FixedImageDimension; iFilter++ )
   {
     this->m_MovedSobelOperators[ iFilter ].SetDirection( iFilter );
     this->m_MovedSobelOperators[ iFilter ].CreateDirectional();
-    this->m_MovedSobelFilters[ iFilter ] = MovedSobelFilter::New();
-    this->m_MovedSobelFilters[ iFilter ]->OverrideBoundaryCondition( &this->m_MovedBoundCond );
-    this->m_MovedSobelFilters[ iFilter ]->SetOperator( this->m_MovedSobelOperators[ iFilter ] );
-    this->m_MovedSobelFilters[ iFilter ]->SetInput( this->m_CastMovedImageFilter->GetOutput() );
-    this->m_MovedSobelFilters[ iFilter ]->UpdateLargestPossibleRegion();
+  }
+
+  const SizeValueType neighborhoodSize = this->m_MovedSobelOperators[ 0 ].Size();
+  this->m_SobelOffsets.resize( neighborhoodSize );
+  this->m_SobelWeights.resize( FixedImageDimension * neighborhoodSize );
+  for( SizeValueType i = 0; i < neighborhoodSize; ++i )
+  {
+    this->m_SobelOffsets[ i ] = this->m_MovedSobelOperators[ 0 ].GetOffset( i );
+    for( iFilter = 0; iFilter < FixedImageDimension; iFilter++ )
+    {
+      this->m_SobelWeights[ iFilter * neighborhoodSize + i ] = this->m_MovedSobelOperators[ iFilter ][ i ];
+    }
+  }
+
+  /** The moved image is only evaluated in the neighborhoods of the samples. */
+  this->m_SampleNeighborhoodBuffer->SetImage( this->m_FixedImage );
+  this->m_SampleNeighborhoodBuffer->SetRadius( this->m_MovedSobelOperators[ 0 ].GetRadius() );
+
+  /** The maximum moved gradients are stored per thread, also when the
+   * metric is not computed multi-threadedly.
+   */
+  if( !this->m_UseMultiThread )
+  {
+    this->InitializeThreadingParameters();
   }
 
   /** Compute the variance */
@@ -161,62 +179,57 @@ GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
 
 
 /**
- * ********************* PrintSelf ******************************
+ * ********************* InitializeThreadingParameters ******************************
  */
 
 template< class TFixedImage, class TMovingImage >
 void
 GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
-::PrintSelf( std::ostream & os, Indent indent ) const
+::InitializeThreadingParameters( void ) const
 {
-  Superclass::PrintSelf( os, indent );
-  os << indent << "DerivativeDelta: " << this->m_DerivativeDelta << std::endl;
+  /** Initialize the superclass parameters. */
+  Superclass::InitializeThreadingParameters();
 
-}
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
+
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_GradientDifferenceGetValuePerThreadVariablesSize < numberOfThreads )
+  {
+    delete[] this->m_GradientDifferenceGetValuePerThreadVariables;
+    this->m_GradientDifferenceGetValuePerThreadVariables
+      = new AlignedGradientDifferenceGetValuePerThreadStruct[ numberOfThreads ];
+    this->m_GradientDifferenceGetValuePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
+  }
+
+  /** Some initialization. */
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    this->m_GradientDifferenceGetValuePerThreadVariables[ i ].st_NumberOfPixelsCounted = NumericTraits< SizeValueType >::Zero;
+    for( unsigned int d = 0; d < FixedImageDimension; ++d )
+    {
+      this->m_GradientDifferenceGetValuePerThreadVariables[ i ].st_MaxMovedGradient[ d ]
+        = NumericTraits< MovedGradientPixelType >::NonpositiveMin();
+    }
+    this->m_GradientDifferenceGetValuePerThreadVariables[ i ].st_Measure = NumericTraits< AccumulateType >::Zero;
+  }
+
+} // end InitializeThreadingParameters()
 
 
 /**
- * ******************** ComputeMovedGradientRange ******************************
+ * ********************* PrintSelf ******************************
  */
 
 template< class TFixedImage, class TMovingImage >
 void
 GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeMovedGradientRange( void ) const
+::PrintSelf( std::ostream & os, Indent indent ) const
 {
-  unsigned int           iDimension;
-  MovedGradientPixelType gradient;
-
-  for( iDimension = 0; iDimension < FixedImageDimension; iDimension++ )
-  {
-    typedef itk::ImageRegionConstIteratorWithIndex<
-      MovedGradientImageType > IteratorType;
-
-    IteratorType iterate( m_MovedSobelFilters[ iDimension ]->GetOutput(),
-    this->GetFixedImageRegion() );
-
-    gradient = iterate.Get();
-
-    m_MinMovedGradient[ iDimension ] = gradient;
-    m_MaxMovedGradient[ iDimension ] = gradient;
-
-    while( !iterate.IsAtEnd() )
-    {
-      gradient = iterate.Get();
-
-      if( gradient > m_MaxMovedGradient[ iDimension ] )
-      {
-        m_MaxMovedGradient[ iDimension ] = gradient;
-      }
-
-      if( gradient < m_MinMovedGradient[ iDimension ] )
-      {
-        m_MinMovedGradient[ iDimension ] = gradient;
-      }
+  Superclass::PrintSelf( os, indent );
+  os << indent << "DerivativeDelta: " << this->m_DerivativeDelta << std::endl;
+  os << indent << "SampleNeighborhoodBuffer: " << this->m_SampleNeighborhoodBuffer << std::endl;
 
-      ++iterate;
-    }
-  }
 }
 
 
@@ -246,9 +259,6 @@ GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
     gradient           = iterate.Get();
     mean[ iDimension ] = 0;
 
-    this->m_MinMovedGradient[ iDimension ] = gradient;
-    this->m_MaxMovedGradient[ iDimension ] = gradient;
-
     typename FixedImageType::IndexType currentIndex;
     typename FixedImageType::PointType point;
     bool sampleOK = false;
@@ -344,14 +354,111 @@ GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
 
 
 /**
- * ******************** ComputeMeasure ******************************
+ * ******************** ComputeMovedImageValues ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeMovedImageValues( void ) const
+{
+  /** Option to compute single-threadedly. */
+  if( !this->m_UseMultiThread )
+  {
+    this->ComputeMovedImageValuesOnRange( 0, this->m_SampleNeighborhoodBuffer->GetNumberOfPixels() );
+    return;
+  }
+
+  /** Launch the threads. Each thread evaluates a different part of the
+   * pixels, so they write to different elements of the buffer.
+   */
+  this->m_Threader->SetSingleMethod( this->ComputeMovedImageValuesThreaderCallback,
+    const_cast< void * >( static_cast< const void * >(
+      &this->m_GradientDifferenceThreaderParameters ) ) );
+  this->m_Threader->SingleMethodExecute();
+
+} // end ComputeMovedImageValues()
+
+
+/**
+ * ******************** ThreadedComputeMovedImageValues ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedComputeMovedImageValues( ThreadIdType threadId )
+{
+  /** Get the pixels for this thread. */
+  const SizeValueType numberOfPixels = this->m_SampleNeighborhoodBuffer->GetNumberOfPixels();
+  const SizeValueType nrOfPixelsPerThreads
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( numberOfPixels )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
+
+  SizeValueType pos_begin = nrOfPixelsPerThreads * threadId;
+  SizeValueType pos_end   = nrOfPixelsPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > numberOfPixels ) ? numberOfPixels : pos_begin;
+  pos_end   = ( pos_end > numberOfPixels ) ? numberOfPixels : pos_end;
+
+  this->ComputeMovedImageValuesOnRange( pos_begin, pos_end );
+
+} // end ThreadedComputeMovedImageValues()
+
+
+/**
+ * ******************** ComputeMovedImageValuesOnRange ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeMovedImageValuesOnRange( SizeValueType begin, SizeValueType end ) const
+{
+  /** The moved image value at a pixel is the ray cast from the transformed
+   * pixel, as in a ResampleImageFilter with the transform of the ray caster.
+   */
+  typename FixedImageType::PointType point;
+  for( SizeValueType p = begin; p < end; ++p )
+  {
+    this->m_FixedImage->TransformIndexToPhysicalPoint(
+      this->m_SampleNeighborhoodBuffer->GetPixelIndex( p ), point );
+    this->m_SampleNeighborhoodBuffer->SetPixelValue( p, static_cast< double >(
+        this->m_RayCastInterpolator->Evaluate( this->m_RayCastTransform->TransformPoint( point ) ) ) );
+  }
+
+} // end ComputeMovedImageValuesOnRange()
+
+
+/**
+ * ******************** ComputeMovedImageValuesThreaderCallback ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeMovedImageValuesThreaderCallback( void * arg )
+{
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadId   = infoStruct->ThreadID;
+
+  GradientDifferenceMultiThreaderParameterType * temp
+    = static_cast< GradientDifferenceMultiThreaderParameterType * >( infoStruct->UserData );
+
+  temp->m_Metric->ThreadedComputeMovedImageValues( threadId );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end ComputeMovedImageValuesThreaderCallback()
+
+
+/**
+ * ******************** GetValue ******************************
  */
 
 template< class TFixedImage, class TMovingImage >
 typename GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >::MeasureType
 GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeMeasure( const TransformParametersType & parameters,
-  const double * subtractionFactor ) const
+::GetValue( const TransformParametersType & parameters ) const
 {
   /** Call non-thread-safe stuff, such as:
    *   this->SetTransformParameters( parameters );
@@ -367,132 +474,313 @@ GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
    * - Now you can call GetValueAndDerivative multi-threaded.
    */
   this->BeforeThreadedGetValueAndDerivative( parameters );
-  //this->SetTransformParameters( parameters );
 
-  unsigned int iDimension;
-  this->m_TransformMovingImageFilter->Modified();
-  this->m_TransformMovingImageFilter->UpdateLargestPossibleRegion();
-  MeasureType measure = NumericTraits< MeasureType >::Zero;
+  /** Determine the pixels that are needed for the Sobel gradients at the
+   * samples. This is only done when the samples have changed, so not for
+   * the finite difference derivative.
+   */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+  this->m_SampleNeighborhoodBuffer->Update( sampleContainer );
+  this->m_MovedGradients.resize( sampleContainer->Size() * FixedImageDimension );
 
-  typename FixedImageType::IndexType currentIndex;
-  typename FixedImageType::PointType point;
+  /** Evaluate the moved image at these pixels. */
+  this->ComputeMovedImageValues();
 
-  for( iDimension = 0; iDimension < FixedImageDimension; iDimension++ )
+  /** Compute the moved image gradients at the samples, and their maximum. */
+  if( !this->m_UseMultiThread )
+  {
+    this->ThreadedGetValueOnSampleRange( 0, 0, sampleContainer->Size() );
+  }
+  else
+  {
+    this->LaunchGetValueThreaderCallback();
+  }
+
+  /** Compute the similarity measure. */
+  MeasureType value = NumericTraits< MeasureType >::Zero;
+  this->AfterThreadedGetValue( value );
+
+  return value;
+
+} // end GetValue()
+
+
+/**
+ * ******************** ThreadedGetValue ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValue( ThreadIdType threadId )
+{
+  /** Get the size of the sample container. */
+  const SizeValueType sampleContainerSize = this->GetImageSampler()->GetOutput()->Size();
+
+  /** Get the samples for this thread. */
+  const SizeValueType nrOfSamplesPerThreads
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( sampleContainerSize )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
+
+  SizeValueType pos_begin = nrOfSamplesPerThreads * threadId;
+  SizeValueType pos_end   = nrOfSamplesPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
+  pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
+
+  this->ThreadedGetValueOnSampleRange( threadId, pos_begin, pos_end );
+
+} // end ThreadedGetValue()
+
+
+/**
+ * ******************** ThreadedGetValueOnSampleRange ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValueOnSampleRange( ThreadIdType threadId,
+  SizeValueType pos_begin, SizeValueType pos_end )
+{
+  /** The moved image values in the neighborhood of a sample. */
+  const SizeValueType     neighborhoodSize = this->m_SobelOffsets.size();
+  std::vector< RealType > neighborhoodValues( neighborhoodSize );
+
+  /** Create variables to store intermediate results. circumvent false sharing */
+  MovedGradientPixelType maxMovedGradient[ FixedImageDimension ];
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    maxMovedGradient[ d ] = NumericTraits< MovedGradientPixelType >::NonpositiveMin();
+  }
+
+  /** Loop over the samples. */
+  for( SizeValueType s = pos_begin; s < pos_end; ++s )
   {
+    const FixedImageIndexType & index = this->m_SampleNeighborhoodBuffer->GetSampleIndex( s );
 
-    if( this->m_Variance[ iDimension ] == NumericTraits< MovedGradientPixelType >::ZeroValue() )
+    /** Gather the moved image values of the neighbors once for all dimensions. */
+    for( SizeValueType i = 0; i < neighborhoodSize; ++i )
     {
-      continue;
+      neighborhoodValues[ i ] = this->m_SampleNeighborhoodBuffer->GetValue( index + this->m_SobelOffsets[ i ] );
     }
 
-    /** Iterate over the fixed and moving gradient images
-     *  calculating the similarity measure
+    /** The Sobel gradients of the moved image are dot products. Different
+     * threads write to different samples of m_MovedGradients.
      */
+    MovedGradientPixelType * movedGradients = &this->m_MovedGradients[ s * FixedImageDimension ];
+    for( unsigned int d = 0; d < FixedImageDimension; ++d )
+    {
+      const RealType * weights       = &this->m_SobelWeights[ d * neighborhoodSize ];
+      RealType         movedGradient = NumericTraits< RealType >::Zero;
+      for( SizeValueType i = 0; i < neighborhoodSize; ++i )
+      {
+        movedGradient += weights[ i ] * neighborhoodValues[ i ];
+      }
+
+      movedGradients[ d ] = movedGradient;
+      if( movedGradient > maxMovedGradient[ d ] )
+      {
+        maxMovedGradient[ d ] = movedGradient;
+      }
+    }
+  }
 
-    MovedGradientPixelType movedGradient;
-    FixedGradientPixelType fixedGradient;
-    MovedGradientPixelType diff;
+  /** Only update these variables at the end to prevent unnecessary "false sharing".
+   * A thread may process several sample ranges, so take the maximum. */
+  AlignedGradientDifferenceGetValuePerThreadStruct & threadVariables
+    = this->m_GradientDifferenceGetValuePerThreadVariables[ threadId ];
+  threadVariables.st_NumberOfPixelsCounted += pos_end - pos_begin;
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    if( maxMovedGradient[ d ] > threadVariables.st_MaxMovedGradient[ d ] )
+    {
+      threadVariables.st_MaxMovedGradient[ d ] = maxMovedGradient[ d ];
+    }
+  }
 
-    typedef  itk::ImageRegionConstIteratorWithIndex< FixedGradientImageType >
-      FixedIteratorType;
+} // end ThreadedGetValueOnSampleRange()
 
-    FixedIteratorType fixedIterator( this->m_FixedSobelFilters[ iDimension ]->GetOutput(),
-    this->GetFixedImageRegion() );
 
-    typedef  itk::ImageRegionConstIteratorWithIndex< MovedGradientImageType >
-      MovedIteratorType;
+/**
+ * ******************** AfterThreadedGetValue ******************************
+ */
 
-    MovedIteratorType movedIterator( this->m_MovedSobelFilters[ iDimension ]->GetOutput(),
-    this->GetFixedImageRegion() );
+template< class TFixedImage, class TMovingImage >
+void
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::AfterThreadedGetValue( MeasureType & value ) const
+{
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
 
-    this->m_FixedSobelFilters[ iDimension ]->UpdateLargestPossibleRegion();
-    this->m_MovedSobelFilters[ iDimension ]->UpdateLargestPossibleRegion();
+  /** Gather the maximum moved gradients of the threads, and reset them for
+   * the next iteration.
+   */
+  MovedGradientPixelType maxMovedGradient[ FixedImageDimension ];
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    maxMovedGradient[ d ] = NumericTraits< MovedGradientPixelType >::NonpositiveMin();
+  }
 
-    bool sampleOK = false;
+  this->m_NumberOfPixelsCounted = 0;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    AlignedGradientDifferenceGetValuePerThreadStruct & threadVariables
+      = this->m_GradientDifferenceGetValuePerThreadVariables[ i ];
 
-    if( this->m_FixedImageMask.IsNull() )
+    this->m_NumberOfPixelsCounted += threadVariables.st_NumberOfPixelsCounted;
+    for( unsigned int d = 0; d < FixedImageDimension; ++d )
     {
-      sampleOK = true;
+      if( threadVariables.st_MaxMovedGradient[ d ] > maxMovedGradient[ d ] )
+      {
+        maxMovedGradient[ d ] = threadVariables.st_MaxMovedGradient[ d ];
+      }
+      threadVariables.st_MaxMovedGradient[ d ] = NumericTraits< MovedGradientPixelType >::NonpositiveMin();
     }
+    threadVariables.st_NumberOfPixelsCounted = 0;
+  }
+
+  /** Check if enough samples were valid. */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+  const SizeValueType         sampleContainerSize = sampleContainer->Size();
+  this->CheckNumberOfSamples( sampleContainerSize, this->m_NumberOfPixelsCounted );
 
-    while( !fixedIterator.IsAtEnd() )
+  /** The subtraction factors scale the moved gradients to the range of
+   * the fixed gradients.
+   */
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    this->m_SubtractionFactor[ d ] = NumericTraits< MovedGradientPixelType >::Zero;
+    if( maxMovedGradient[ d ] != NumericTraits< MovedGradientPixelType >::Zero )
     {
-      /** Get current index */
-      currentIndex = fixedIterator.GetIndex();
-      this->m_FixedImage->TransformIndexToPhysicalPoint( currentIndex, point );
+      this->m_SubtractionFactor[ d ] = this->m_MaxFixedGradient[ d ] / maxMovedGradient[ d ];
+    }
+  }
 
-      /** if fixedMask is given */
-      if( !this->m_FixedImageMask.IsNull() )
-      {
+  /** Compute the similarity measure in a second pass over the samples. */
+  const MeasureType measure = this->ComputeMeasure();
 
-        if( this->m_FixedImageMask->IsInside( point ) )   // sample is good
-        {
-          sampleOK = true;
-        }
-        else  // sample no good
-        {
-          sampleOK = false;
-        }
-      }
+  value = measure / -this->m_Rescalingfactor; //negative for minimization
 
-      if( sampleOK )
-      {
-        movedGradient = movedIterator.Get();
-        fixedGradient = fixedIterator.Get();
-        diff          = fixedGradient - subtractionFactor[ iDimension ] * movedGradient;
-        measure      += this->m_Variance[ iDimension ] / ( this->m_Variance[ iDimension ] + diff * diff );
+} // end AfterThreadedGetValue()
 
-      } // end if sampleOK
 
-      ++fixedIterator;
-      ++movedIterator;
-    } // end while fixedIterator
+/**
+ * ******************** ComputeMeasure ******************************
+ */
 
-  } // end for iDimension
+template< class TFixedImage, class TMovingImage >
+typename GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >::AccumulateType
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeMeasure( void ) const
+{
+  /** Option to compute single-threadedly. */
+  if( !this->m_UseMultiThread )
+  {
+    return this->ComputeMeasureOnRange( 0, this->GetImageSampler()->GetOutput()->Size() );
+  }
+
+  /** Launch the threads. Each thread sums the measure over a different part
+   * of the samples.
+   */
+  this->m_Threader->SetSingleMethod( this->ComputeMeasureThreaderCallback,
+    const_cast< void * >( static_cast< const void * >(
+      &this->m_GradientDifferenceThreaderParameters ) ) );
+  this->m_Threader->SingleMethodExecute();
+
+  /** Gather the sums of the threads, and reset them for the next iteration. */
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
+  AccumulateType     measure         = NumericTraits< AccumulateType >::Zero;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    measure += this->m_GradientDifferenceGetValuePerThreadVariables[ i ].st_Measure;
+    this->m_GradientDifferenceGetValuePerThreadVariables[ i ].st_Measure = NumericTraits< AccumulateType >::Zero;
+  }
 
-  return measure /= -this->m_Rescalingfactor; //negative for minimization
+  return measure;
 
 } // end ComputeMeasure()
 
 
 /**
- * ******************** GetValue ******************************
+ * ******************** ThreadedComputeMeasure ******************************
  */
 
 template< class TFixedImage, class TMovingImage >
-typename GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >::MeasureType
+void
 GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
-::GetValue( const TransformParametersType & parameters ) const
+::ThreadedComputeMeasure( ThreadIdType threadId )
 {
-  unsigned int iFilter;
-  unsigned int iDimension;
-  this->SetTransformParameters( parameters );
-  this->m_TransformMovingImageFilter->Modified();
-  this->m_TransformMovingImageFilter->UpdateLargestPossibleRegion();
+  /** Get the samples for this thread. */
+  const SizeValueType sampleContainerSize = this->GetImageSampler()->GetOutput()->Size();
+  const SizeValueType nrOfSamplesPerThreads
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( sampleContainerSize )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
 
-  /** Update the gradient images */
-  for( iFilter = 0; iFilter < MovedImageDimension; iFilter++ )
-  {
-    this->m_MovedSobelFilters[ iFilter ]->UpdateLargestPossibleRegion();
-  }
+  SizeValueType pos_begin = nrOfSamplesPerThreads * threadId;
+  SizeValueType pos_end   = nrOfSamplesPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
+  pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
 
-  /** Compute the range of the moved image gradients */
-  this->ComputeMovedGradientRange();
+  /** Only update the thread variable at the end to prevent "false sharing". */
+  this->m_GradientDifferenceGetValuePerThreadVariables[ threadId ].st_Measure
+    = this->ComputeMeasureOnRange( pos_begin, pos_end );
 
-  MovedGradientPixelType subtractionFactor[ FixedImageDimension ];
-  MeasureType            currentMeasure;
+} // end ThreadedComputeMeasure()
 
-  for( iDimension = 0; iDimension < FixedImageDimension; iDimension++ )
+
+/**
+ * ******************** ComputeMeasureOnRange ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+typename GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >::AccumulateType
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeMeasureOnRange( SizeValueType begin, SizeValueType end ) const
+{
+  AccumulateType measure = NumericTraits< AccumulateType >::Zero;
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
   {
-    subtractionFactor[ iDimension ] = this->m_MaxFixedGradient[ iDimension ]
-      / this->m_MaxMovedGradient[ iDimension ];
+    if( this->m_Variance[ d ] == NumericTraits< MovedGradientPixelType >::ZeroValue() )
+    {
+      continue;
+    }
+
+    const FixedGradientImageType * fixedGradientImage = this->m_FixedSobelFilters[ d ]->GetOutput();
+    for( SizeValueType s = begin; s < end; ++s )
+    {
+      const FixedGradientPixelType fixedGradient
+        = fixedGradientImage->GetPixel( this->m_SampleNeighborhoodBuffer->GetSampleIndex( s ) );
+      const MovedGradientPixelType diff
+        = fixedGradient - this->m_SubtractionFactor[ d ] * this->m_MovedGradients[ s * FixedImageDimension + d ];
+      measure += this->m_Variance[ d ] / ( this->m_Variance[ d ] + diff * diff );
+    }
   }
 
-  currentMeasure = this->ComputeMeasure( parameters, subtractionFactor );
+  return measure;
 
-  return currentMeasure;
+} // end ComputeMeasureOnRange()
 
-} // end GetValue()
+
+/**
+ * ******************** ComputeMeasureThreaderCallback ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+GradientDifferenceImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeMeasureThreaderCallback( void * arg )
+{
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadId   = infoStruct->ThreadID;
+
+  GradientDifferenceMultiThreaderParameterType * temp
+    = static_cast< GradientDifferenceMultiThreaderParameterType * >( infoStruct->UserData );
+
+  temp->m_Metric->ThreadedComputeMeasure( threadId );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end ComputeMeasureThreaderCallback()
 
 
 /**
@@ -48,6 +48,16 @@ enum  {ANN_IN=0, ANN_OUT=1};  // shrinking indices
                 // what to do in case of error
 enum ANNerr {ANNwarn = 0, ANNabort = 1};
 
+//----------------------------------------------------------------------
+//  Thread-local search state
+//    The search routines keep their state (query point, set of closest
+//    points, ...) in global variables. These are declared thread-local,
+//    so that different threads can search the same or different trees
+//    simultaneously. Tree construction does not use these variables.
+//----------------------------------------------------------------------
+
+#define ANN_THREAD_LOCAL thread_local
+
 //----------------------------------------------------------------------
 //  Maximum number of points to visit
 //  We have an option for terminating the search early if the
@@ -57,7 +67,7 @@ enum ANNerr {ANNwarn = 0, ANNabort = 1};
 //----------------------------------------------------------------------
 
 extern int    ANNmaxPtsVisited; // maximum number of pts visited
-extern int    ANNptsVisited;    // number of pts visited in search
+extern ANN_THREAD_LOCAL int ANNptsVisited; // number of pts visited in search
 
 //----------------------------------------------------------------------
 //  Global function declarations
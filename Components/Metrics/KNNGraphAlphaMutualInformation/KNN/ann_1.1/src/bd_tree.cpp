@@ -94,6 +94,23 @@ void ANNbd_shrink::getStats(          // get subtree statistics
   st.n_shr++;                 // increment number of shrinks
 }
 
+//----------------------------------------------------------------------
+//  Refitting
+//    The inner box of a shrinking node separates its points, which
+//    no longer holds when the points have moved. Shrinking nodes are
+//    therefore not refitted, the tree must be rebuilt instead.
+//----------------------------------------------------------------------
+
+ANNbool ANNbd_shrink::refit(          // refit shrinking node
+  int         dim,          // dimension of space
+  ANNpointArray   pa,           // the points
+  ANNpoint      lo,           // bounding box low (modified)
+  ANNpoint      hi,           // bounding box high (modified)
+  ANNpoint      ws)           // workspace for the subtrees
+{
+  return ANNfalse;
+}
+
 //----------------------------------------------------------------------
 // bd-tree constructor
 //    This is the main constructor for bd-trees given a set of points.
@@ -91,6 +91,8 @@ public:
         ANNorthRect &bnd_box);      // bounding box
   virtual void print(int level, ostream &out);// print node
   virtual void dump(ostream &out);      // dump node
+  virtual ANNbool refit(int dim, ANNpointArray pa,
+        ANNpoint lo, ANNpoint hi, ANNpoint ws); // refit to moved points
 
   virtual void ann_search(ANNdist);     // standard search
   virtual void ann_pri_search(ANNdist);   // priority search
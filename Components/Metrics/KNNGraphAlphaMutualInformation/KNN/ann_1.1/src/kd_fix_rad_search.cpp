@@ -42,14 +42,14 @@
 //    These are given below.
 //----------------------------------------------------------------------
 
-int       ANNkdFRDim;       // dimension of space
-ANNpoint    ANNkdFRQ;       // query point
-ANNdist     ANNkdFRSqRad;     // squared radius search bound
-double      ANNkdFRMaxErr;      // max tolerable squared error
-ANNpointArray ANNkdFRPts;       // the points
-ANNmin_k*   ANNkdFRPointMK;     // set of k closest points
-int       ANNkdFRPtsVisited;    // total points visited
-int       ANNkdFRPtsInRange;    // number of points in the range
+ANN_THREAD_LOCAL int       ANNkdFRDim;       // dimension of space
+ANN_THREAD_LOCAL ANNpoint    ANNkdFRQ;       // query point
+ANN_THREAD_LOCAL ANNdist     ANNkdFRSqRad;     // squared radius search bound
+ANN_THREAD_LOCAL double      ANNkdFRMaxErr;      // max tolerable squared error
+ANN_THREAD_LOCAL ANNpointArray ANNkdFRPts;       // the points
+ANN_THREAD_LOCAL ANNmin_k*   ANNkdFRPointMK;     // set of k closest points
+ANN_THREAD_LOCAL int       ANNkdFRPtsVisited;    // total points visited
+ANN_THREAD_LOCAL int       ANNkdFRPtsInRange;    // number of points in the range
 
 //----------------------------------------------------------------------
 //  annkFRSearch - fixed radius search for k nearest neighbors
@@ -111,9 +111,13 @@ void ANNkd_split::ann_FR_search(ANNdist box_dist)
     ANNcoord box_diff = cd_bnds[ANN_LO] - ANNkdFRQ[cut_dim];
     if (box_diff < 0)       // within bounds - ignore
       box_diff = 0;
+                    // distance to high child
+    ANNcoord far_diff = ch_bnds[ANN_HI] - ANNkdFRQ[cut_dim];
+    if (far_diff < 0)       // overlap after refit - ignore
+      far_diff = 0;
                     // distance to further box
     box_dist = (ANNdist) ANN_SUM(box_dist,
-        ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+        ANN_DIFF(ANN_POW(box_diff), ANN_POW(far_diff)));
 
                     // visit further child if in range
     if (box_dist * ANNkdFRMaxErr <= ANNkdFRSqRad)
@@ -126,9 +130,13 @@ void ANNkd_split::ann_FR_search(ANNdist box_dist)
     ANNcoord box_diff = ANNkdFRQ[cut_dim] - cd_bnds[ANN_HI];
     if (box_diff < 0)       // within bounds - ignore
       box_diff = 0;
+                    // distance to low child
+    ANNcoord far_diff = ANNkdFRQ[cut_dim] - ch_bnds[ANN_LO];
+    if (far_diff < 0)       // overlap after refit - ignore
+      far_diff = 0;
                     // distance to further box
     box_dist = (ANNdist) ANN_SUM(box_dist,
-        ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+        ANN_DIFF(ANN_POW(box_diff), ANN_POW(far_diff)));
 
                     // visit further child if close enough
     if (box_dist * ANNkdFRMaxErr <= ANNkdFRSqRad)
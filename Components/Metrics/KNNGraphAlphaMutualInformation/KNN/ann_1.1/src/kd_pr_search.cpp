@@ -72,13 +72,13 @@
 //    These are given below.
 //----------------------------------------------------------------------
 
-double      ANNprEps;       // the error bound
-int       ANNprDim;       // dimension of space
-ANNpoint    ANNprQ;         // query point
-double      ANNprMaxErr;      // max tolerable squared error
-ANNpointArray ANNprPts;       // the points
-ANNpr_queue   *ANNprBoxPQ;      // priority queue for boxes
-ANNmin_k    *ANNprPointMK;      // set of k closest points
+ANN_THREAD_LOCAL double      ANNprEps;       // the error bound
+ANN_THREAD_LOCAL int       ANNprDim;       // dimension of space
+ANN_THREAD_LOCAL ANNpoint    ANNprQ;         // query point
+ANN_THREAD_LOCAL double      ANNprMaxErr;      // max tolerable squared error
+ANN_THREAD_LOCAL ANNpointArray ANNprPts;       // the points
+ANN_THREAD_LOCAL ANNpr_queue   *ANNprBoxPQ;      // priority queue for boxes
+ANN_THREAD_LOCAL ANNmin_k    *ANNprPointMK;      // set of k closest points
 
 //----------------------------------------------------------------------
 //  annkPriSearch - priority search for k nearest neighbors
@@ -146,9 +146,13 @@ void ANNkd_split::ann_pri_search(ANNdist box_dist)
     ANNcoord box_diff = cd_bnds[ANN_LO] - ANNprQ[cut_dim];
     if (box_diff < 0)       // within bounds - ignore
       box_diff = 0;
+                    // distance to high child
+    ANNcoord far_diff = ch_bnds[ANN_HI] - ANNprQ[cut_dim];
+    if (far_diff < 0)       // overlap after refit - ignore
+      far_diff = 0;
                     // distance to further box
     new_dist = (ANNdist) ANN_SUM(box_dist,
-        ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+        ANN_DIFF(ANN_POW(box_diff), ANN_POW(far_diff)));
 
     if (child[ANN_HI] != KD_TRIVIAL)// enqueue if not trivial
       ANNprBoxPQ->insert(new_dist, child[ANN_HI]);
@@ -159,9 +163,13 @@ void ANNkd_split::ann_pri_search(ANNdist box_dist)
     ANNcoord box_diff = ANNprQ[cut_dim] - cd_bnds[ANN_HI];
     if (box_diff < 0)       // within bounds - ignore
       box_diff = 0;
+                    // distance to low child
+    ANNcoord far_diff = ANNprQ[cut_dim] - ch_bnds[ANN_LO];
+    if (far_diff < 0)       // overlap after refit - ignore
+      far_diff = 0;
                     // distance to further box
     new_dist = (ANNdist) ANN_SUM(box_dist,
-        ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+        ANN_DIFF(ANN_POW(box_diff), ANN_POW(far_diff)));
 
     if (child[ANN_LO] != KD_TRIVIAL)// enqueue if not trivial
       ANNprBoxPQ->insert(new_dist, child[ANN_LO]);
@@ -76,11 +76,11 @@
 //    These are given below.
 //----------------------------------------------------------------------
 
-int       ANNkdDim;       // dimension of space
-ANNpoint    ANNkdQ;         // query point
-double      ANNkdMaxErr;      // max tolerable squared error
-ANNpointArray ANNkdPts;       // the points
-ANNmin_k    *ANNkdPointMK;      // set of k closest points
+ANN_THREAD_LOCAL int       ANNkdDim;       // dimension of space
+ANN_THREAD_LOCAL ANNpoint    ANNkdQ;         // query point
+ANN_THREAD_LOCAL double      ANNkdMaxErr;      // max tolerable squared error
+ANN_THREAD_LOCAL ANNpointArray ANNkdPts;       // the points
+ANN_THREAD_LOCAL ANNmin_k    *ANNkdPointMK;      // set of k closest points
 
 //----------------------------------------------------------------------
 //  annkSearch - search for the k nearest neighbors
@@ -135,9 +135,13 @@ void ANNkd_split::ann_search(ANNdist box_dist)
     ANNcoord box_diff = cd_bnds[ANN_LO] - ANNkdQ[cut_dim];
     if (box_diff < 0)       // within bounds - ignore
       box_diff = 0;
+                    // distance to high child
+    ANNcoord far_diff = ch_bnds[ANN_HI] - ANNkdQ[cut_dim];
+    if (far_diff < 0)       // overlap after refit - ignore
+      far_diff = 0;
                     // distance to further box
     box_dist = (ANNdist) ANN_SUM(box_dist,
-        ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+        ANN_DIFF(ANN_POW(box_diff), ANN_POW(far_diff)));
 
                     // visit further child if close enough
     if (box_dist * ANNkdMaxErr < ANNkdPointMK->max_key())
@@ -150,9 +154,13 @@ void ANNkd_split::ann_search(ANNdist box_dist)
     ANNcoord box_diff = ANNkdQ[cut_dim] - cd_bnds[ANN_HI];
     if (box_diff < 0)       // within bounds - ignore
       box_diff = 0;
+                    // distance to low child
+    ANNcoord far_diff = ANNkdQ[cut_dim] - ch_bnds[ANN_LO];
+    if (far_diff < 0)       // overlap after refit - ignore
+      far_diff = 0;
                     // distance to further box
     box_dist = (ANNdist) ANN_SUM(box_dist,
-        ANN_DIFF(ANN_POW(box_diff), ANN_POW(cut_diff)));
+        ANN_DIFF(ANN_POW(box_diff), ANN_POW(far_diff)));
 
                     // visit further child if close enough
     if (box_dist * ANNkdMaxErr < ANNkdPointMK->max_key())
@@ -33,6 +33,8 @@
 #include "kd_util.h"          // kd-tree utilities
 #include <ANN/ANNperf.h>        // performance evaluation
 
+#include <mutex>            // guards KD_TRIVIAL
+
 //----------------------------------------------------------------------
 //  Global data
 //
@@ -48,6 +50,7 @@
 //----------------------------------------------------------------------
 static int        IDX_TRIVIAL[] = {0};  // trivial point index
 ANNkd_leaf        *KD_TRIVIAL = NULL;   // trivial leaf node
+static std::mutex    KD_TRIVIAL_MUTEX;   // trees may be built concurrently
 
 //----------------------------------------------------------------------
 //  Printing the kd-tree 
@@ -200,6 +203,104 @@ void ANNkd_tree::getStats(            // get tree statistics
   }
 }
 
+//----------------------------------------------------------------------
+//  Refitting
+//    The points may have moved since the tree was built. The tree
+//    is refitted bottom-up: each node computes the bounding box of
+//    its points, and each splitting node stores the extents of its
+//    two children along the cutting dimension. The cutting value is
+//    moved halfway between the children, it is only used to decide
+//    which child is visited first. An empty subtree returns a box
+//    with lo > hi. A splitting node keeps the box of its high child
+//    in the first two points of the workspace ws, and passes the
+//    rest of the workspace on to its children, so the workspace
+//    needs two points per level of splitting nodes.
+//----------------------------------------------------------------------
+
+ANNbool ANNkd_leaf::refit(            // refit leaf node
+  int         dim,          // dimension of space
+  ANNpointArray   pa,           // the points
+  ANNpoint      lo,           // bounding box low (modified)
+  ANNpoint      hi,           // bounding box high (modified)
+  ANNpoint      ws)           // workspace (unused)
+{
+  for (int d = 0; d < dim; d++) {
+    lo[d] =  ANN_DBL_MAX;
+    hi[d] = -ANN_DBL_MAX;
+  }
+  for (int i = 0; i < n_pts; i++) {
+    ANNpoint p = pa[bkt[i]];
+    for (int d = 0; d < dim; d++) {
+      if (p[d] < lo[d]) lo[d] = p[d];
+      if (p[d] > hi[d]) hi[d] = p[d];
+    }
+  }
+  return ANNtrue;
+}
+
+ANNbool ANNkd_split::refit(           // refit splitting node
+  int         dim,          // dimension of space
+  ANNpointArray   pa,           // the points
+  ANNpoint      lo,           // bounding box low (modified)
+  ANNpoint      hi,           // bounding box high (modified)
+  ANNpoint      ws)           // workspace for the subtrees
+{
+  ANNpoint hc_lo = ws;            // box of high child
+  ANNpoint hc_hi = ws + dim;
+  ANNpoint ch_ws = ws + 2*dim;        // workspace of the children
+  ANNbool ok = child[ANN_LO]->refit(dim, pa, lo, hi, ch_ws);
+  if (ok) ok = child[ANN_HI]->refit(dim, pa, hc_lo, hc_hi, ch_ws);
+
+  if (ok) {
+    ANNbool lc_empty = (ANNbool) (lo[cut_dim] > hi[cut_dim]);
+    ANNbool hc_empty = (ANNbool) (hc_lo[cut_dim] > hc_hi[cut_dim]);
+    if (!lc_empty || !hc_empty) {
+                        // extents along cut_dim
+      ch_bnds[ANN_LO] = lc_empty ? hc_lo[cut_dim] : hi[cut_dim];
+      ch_bnds[ANN_HI] = hc_empty ? hi[cut_dim] : hc_lo[cut_dim];
+      cut_val = (ch_bnds[ANN_LO] + ch_bnds[ANN_HI]) / 2;
+    }
+    for (int d = 0; d < dim; d++) {     // merge the boxes
+      if (hc_lo[d] < lo[d]) lo[d] = hc_lo[d];
+      if (hc_hi[d] > hi[d]) hi[d] = hc_hi[d];
+    }
+    if (!lc_empty || !hc_empty) {
+      cd_bnds[ANN_LO] = lo[cut_dim];
+      cd_bnds[ANN_HI] = hi[cut_dim];
+    }
+  }
+  return ok;
+}
+
+//----------------------------------------------------------------------
+//  Refit
+//    Refits the tree to the current coordinates of its points.
+//    Returns ANNfalse if the tree contains nodes that cannot be
+//    refitted, in which case the tree must be rebuilt.
+//----------------------------------------------------------------------
+
+ANNbool ANNkd_tree::Refit()
+{
+  if (root == NULL || n_pts == 0) return ANNfalse;
+
+  if (refit_ws == NULL) {         // first refit of this tree
+    ANNkdStats st;
+    getStats(st);             // the depth of the tree
+                        // the box and two points per level
+    refit_ws = annAllocPt(2*dim*(st.depth+1));
+  }
+  ANNpoint lo = refit_ws;
+  ANNpoint hi = refit_ws + dim;
+  ANNbool ok = root->refit(dim, pts, lo, hi, refit_ws + 2*dim);
+  if (ok) {
+    for (int d = 0; d < dim; d++) {     // new bounding box
+      bnd_box_lo[d] = lo[d];
+      bnd_box_hi[d] = hi[d];
+    }
+  }
+  return ok;
+}
+
 //----------------------------------------------------------------------
 //  kd_tree destructor
 //    The destructor just frees the various elements that were
@@ -212,6 +313,7 @@ ANNkd_tree::~ANNkd_tree()       // tree destructor
   if (pidx != NULL) delete [] pidx;
   if (bnd_box_lo != NULL) annDeallocPt(bnd_box_lo);
   if (bnd_box_hi != NULL) annDeallocPt(bnd_box_hi);
+  if (refit_ws != NULL) annDeallocPt(refit_ws);
 }
 
 //----------------------------------------------------------------------
@@ -220,6 +322,7 @@ ANNkd_tree::~ANNkd_tree()       // tree destructor
 //----------------------------------------------------------------------
 void annClose()       // close use of ANN
 {
+  std::lock_guard< std::mutex > lock(KD_TRIVIAL_MUTEX);
   if (KD_TRIVIAL != NULL) {
     delete KD_TRIVIAL;
     KD_TRIVIAL = NULL;
@@ -266,6 +369,8 @@ void ANNkd_tree::SkeletonTree(      // construct skeleton tree
   }
 
   bnd_box_lo = bnd_box_hi = NULL;   // bounding box is nonexistent
+  refit_ws = NULL;            // no refit yet
+  std::lock_guard< std::mutex > lock(KD_TRIVIAL_MUTEX);
   if (KD_TRIVIAL == NULL)       // no trivial leaf node yet?
     KD_TRIVIAL = new ANNkd_leaf(0, IDX_TRIVIAL);  // allocate it
 }
@@ -58,6 +58,13 @@ public:
                         // print node
   virtual void print(int level, ostream &out) = 0;
   virtual void dump(ostream &out) = 0;    // dump node
+                        // refit to moved points
+  virtual ANNbool refit(
+        int dim,            // dimension of space
+        ANNpointArray pa,       // the points
+        ANNpoint lo,          // bounding box low (modified)
+        ANNpoint hi,          // bounding box high (modified)
+        ANNpoint ws) = 0;       // workspace for the subtrees
 
   friend class ANNkd_tree;          // allow kd-tree to access us
 };
@@ -109,6 +116,8 @@ public:
         ANNorthRect &bnd_box);      // bounding box
   virtual void print(int level, ostream &out);// print node
   virtual void dump(ostream &out);      // dump node
+  virtual ANNbool refit(int dim, ANNpointArray pa,
+        ANNpoint lo, ANNpoint hi, ANNpoint ws); // refit to moved points
 
   virtual void ann_search(ANNdist);     // standard search
   virtual void ann_pri_search(ANNdist);   // priority search
@@ -137,6 +146,12 @@ extern ANNkd_leaf *KD_TRIVIAL;          // trivial (empty) leaf node
 //    to box distance calculations) [we do not store the entire bounding
 //    box since this may be wasteful of space in high dimensions].
 //    We also store pointers to the 2 children.
+//
+//    After the points have moved, the tree may be refitted instead of
+//    rebuilt (see ANNkd_tree::Refit). The children may then overlap
+//    along the cutting dimension, so the upper bound of the low child
+//    and the lower bound of the high child are stored as well. In a
+//    tree that was not refitted, both are equal to cut_val.
 //----------------------------------------------------------------------
 
 class ANNkd_split : public ANNkd_node // splitting node of a kd-tree
@@ -145,6 +160,8 @@ class ANNkd_split : public ANNkd_node // splitting node of a kd-tree
   ANNcoord      cut_val;    // location of cutting plane
   ANNcoord      cd_bnds[2];   // lower and upper bounds of
                     // rectangle along cut_dim
+  ANNcoord      ch_bnds[2];   // upper bound of low child and
+                    // lower bound of high child
   ANNkd_ptr     child[2];   // left and right children
 public:
   ANNkd_split(            // constructor
@@ -157,6 +174,8 @@ public:
       cut_val   = cv;         // cutting value
       cd_bnds[ANN_LO] = lv;       // lower bound for rectangle
       cd_bnds[ANN_HI] = hv;       // upper bound for rectangle
+      ch_bnds[ANN_LO] = cv;       // upper bound for low child
+      ch_bnds[ANN_HI] = cv;       // lower bound for high child
       child[ANN_LO] = lc;       // left child
       child[ANN_HI] = hc;       // right child
     }
@@ -175,6 +194,8 @@ public:
         ANNorthRect &bnd_box);      // bounding box
   virtual void print(int level, ostream &out);// print node
   virtual void dump(ostream &out);      // dump node
+  virtual ANNbool refit(int dim, ANNpointArray pa,
+        ANNpoint lo, ANNpoint hi, ANNpoint ws); // refit to moved points
 
   virtual void ann_search(ANNdist);     // standard search
   virtual void ann_pri_search(ANNdist);   // priority search
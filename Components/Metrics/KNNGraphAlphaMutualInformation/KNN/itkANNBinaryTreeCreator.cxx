@@ -25,6 +25,7 @@ namespace itk
 {
 
 unsigned int ANNBinaryTreeCreator::m_NumberOfANNBinaryTrees = 0;
+std::mutex   ANNBinaryTreeCreator::m_ReferenceCountMutex;
 
 /**
  * ************************ CreateANNkDTree *************************
@@ -106,6 +107,7 @@ ANNBinaryTreeCreator::DeleteANNBruteForceTree( ANNBruteForceTreeType * & tree )
 void
 ANNBinaryTreeCreator::IncreaseReferenceCount( void )
 {
+  std::lock_guard< std::mutex > lock( m_ReferenceCountMutex );
   m_NumberOfANNBinaryTrees++;
 } // end IncreaseReferenceCount
 
@@ -117,6 +119,7 @@ ANNBinaryTreeCreator::IncreaseReferenceCount( void )
 void
 ANNBinaryTreeCreator::DecreaseReferenceCount( void )
 {
+  std::lock_guard< std::mutex > lock( m_ReferenceCountMutex );
   m_NumberOfANNBinaryTrees--;
   if( m_NumberOfANNBinaryTrees == 0 )
   {
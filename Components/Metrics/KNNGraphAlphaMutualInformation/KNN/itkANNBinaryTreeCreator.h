@@ -23,6 +23,8 @@
 #include "itkObjectFactory.h"
 #include "ANN/ANN.h"
 
+#include <mutex>
+
 namespace itk
 {
 
@@ -100,8 +102,11 @@ private:
   ANNBinaryTreeCreator( const Self & );   // purposely not implemented
   void operator=( const Self & );         // purposely not implemented
 
-  /** Member variables. */
+  /** Member variables. The trees may be created and deleted by several
+   * threads simultaneously, so the reference count is guarded by a mutex.
+   */
   static unsigned int m_NumberOfANNBinaryTrees;
+  static std::mutex   m_ReferenceCountMutex;
 
 };
 
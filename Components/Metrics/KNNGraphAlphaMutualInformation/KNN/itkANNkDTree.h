@@ -81,6 +81,14 @@ public:
   /** Generate the tree. */
   virtual void GenerateTree( void );
 
+  /** Refit the tree to the changed sample values. The structure of the
+   * tree is kept and only its bounds are recomputed, which is linear in
+   * the number of data points. The search results are the same as those of
+   * a regenerated tree, but the search may become slower when the points
+   * have moved much. If the tree can not be refitted, it is regenerated.
+   */
+  virtual void RefitTree( void );
+
   /** Get the ANN tree. */
   virtual ANNPointSetType * GetANNTree( void ) const
   {
@@ -142,6 +142,33 @@ ANNkDTree< TListSample >
 } // end GenerateTree()
 
 
+/**
+ * ************************ RefitTree *************************
+ */
+
+template< class TListSample >
+void
+ANNkDTree< TListSample >
+::RefitTree( void )
+{
+  int dim = static_cast< int >( this->GetDataDimension() );
+  int nop = static_cast< int >( this->GetActualNumberOfDataPoints() );
+
+  /** The tree can only be refitted if it was generated on the same points. */
+  if( this->m_ANNTree != 0
+    && this->m_ANNTree->thePoints() == this->GetSample()->GetInternalContainer()
+    && this->m_ANNTree->nPoints() == nop
+    && this->m_ANNTree->theDim() == dim
+    && this->m_ANNTree->Refit() )
+  {
+    return;
+  }
+
+  this->GenerateTree();
+
+} // end RefitTree()
+
+
 /**
  * ************************ PrintSelf *************************
  */
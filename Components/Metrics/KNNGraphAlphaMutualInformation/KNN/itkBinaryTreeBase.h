@@ -70,6 +70,16 @@ public:
   /** Generate the tree. */
   virtual void GenerateTree( void ) = 0;
 
+  /** Update the tree after the values of the sample have been changed in
+   * place, without changing the number of data points. Trees that can keep
+   * their structure override this; by default the tree is regenerated.
+   */
+  virtual void RefitTree( void )
+  {
+    this->GenerateTree();
+  }
+
+
 protected:
 
   /** Constructor. */
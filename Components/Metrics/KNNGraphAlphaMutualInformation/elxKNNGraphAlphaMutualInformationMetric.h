@@ -67,6 +67,12 @@ namespace elastix
  *    This option is only appropiate for FixedRadius search. \n
  *    <tt>(SquaredSearchRadius 32.0 8.0 8.0)</tt> \n
  *    The default is 0.0 for all resolutions, which means no radius.
+ * \parameter TreeRebuildInterval: the number of metric evaluations after which the kNN trees
+ *    are rebuilt. In between, the trees keep their structure and are refitted to the new
+ *    feature values, which is cheaper and gives the same neighbours. The trees are always
+ *    rebuilt when new samples are selected. This option only affects the kd-trees. \n
+ *    <tt>(TreeRebuildInterval 10 10 5)</tt> \n
+ *    The default is 1 for all resolutions, which means rebuilding at every evaluation.
  * \parameter AvoidDivisionBy: a small number to avoid division by zero in the implentation. \n
  *    <tt>(AvoidDivisionBy 0.000000001)</tt> \n
  *    The default is 1e-5.
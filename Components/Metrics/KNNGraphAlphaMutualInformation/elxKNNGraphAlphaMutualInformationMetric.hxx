@@ -185,6 +185,12 @@ KNNGraphAlphaMutualInformationMetric< TElastix >
                        << treeType << "\" implemented." );
   }
 
+  /** Get the number of evaluations after which the trees are rebuilt. */
+  unsigned int treeRebuildInterval = 1;
+  this->m_Configuration->ReadParameter( treeRebuildInterval,
+    "TreeRebuildInterval", this->GetComponentLabel(), level, 0 );
+  this->SetTreeRebuildInterval( treeRebuildInterval );
+
   /** Get the parameters for the search tree. */
 
   /** Get the tree search type. */
@@ -67,6 +67,13 @@ namespace itk
  * IEEE Transactions on Medical Imaging, vol. 28, no. 9, pp. 1412 - 1421,
  * September 2009.
  *
+ * When UseMultiThread is true, the computation of the feature vectors, the
+ * construction of the three kNN trees, and the nearest neighbour queries
+ * plus the accumulation of the derivative are distributed over the threads.
+ * The threads either run on the WorkStealingThreadPool, if it is selected,
+ * or on the MultiThreader of the metric. The search state of the ANN library
+ * is thread-local, so all threads share the same tree searchers.
+ *
  * \ingroup RegistrationMetrics
  */
 
@@ -134,6 +141,9 @@ public:
   typedef typename
     Superclass::MovingImageLimiterOutputType MovingImageLimiterOutputType;
   typedef typename Superclass::NonZeroJacobianIndicesType NonZeroJacobianIndicesType;
+  typedef typename Superclass::ThreaderType               ThreaderType;
+  typedef typename Superclass::ThreadInfoType             ThreadInfoType;
+  typedef typename Superclass::ThreadPoolType             ThreadPoolType;
 
   /** Typedef's for storing multiple inputs. */
   typedef typename Superclass::FixedImageVectorType             FixedImageVectorType;
@@ -247,17 +257,34 @@ public:
   /** Avoid division by a small number. */
   itkGetConstReferenceMacro( AvoidDivisionBy, double );
 
+  /** Set the number of evaluations after which the kNN trees are rebuilt.
+   * In between, the trees keep their structure and are only refitted to the
+   * new feature values, see ANNkDTree::RefitTree(). The neighbours are the
+   * same, up to the ErrorBound of the tree searcher, but the search slows
+   * down when the features change much. The trees are always rebuilt when
+   * the image sampler selected new samples. The default of 1 rebuilds the
+   * trees at every evaluation.
+   */
+  itkSetClampMacro( TreeRebuildInterval, unsigned int, 1, NumericTraits< unsigned int >::max() );
+  itkGetConstMacro( TreeRebuildInterval, unsigned int );
+
 protected:
 
   /** Constructor. */
   KNNGraphAlphaMutualInformationImageToImageMetric();
 
   /** Destructor. */
-  virtual ~KNNGraphAlphaMutualInformationImageToImageMetric() {}
+  virtual ~KNNGraphAlphaMutualInformationImageToImageMetric();
 
   /** PrintSelf. */
   virtual void PrintSelf( std::ostream & os, Indent indent ) const;
 
+  /** Initialize some multi-threading related parameters.
+   * Overrides function in AdvancedImageToImageMetric, because
+   * here we use other parameters.
+   */
+  virtual void InitializeThreadingParameters( void ) const;
+
   /** Member variables. */
   BinaryKNNTreePointer m_BinaryKNNTreeFixed;
   BinaryKNNTreePointer m_BinaryKNNTreeMoving;
@@ -267,8 +294,9 @@ protected:
   BinaryKNNTreeSearchPointer m_BinaryKNNTreeSearcherMoving;
   BinaryKNNTreeSearchPointer m_BinaryKNNTreeSearcherJoint;
 
-  double m_Alpha;
-  double m_AvoidDivisionBy;
+  double       m_Alpha;
+  double       m_AvoidDivisionBy;
+  unsigned int m_TreeRebuildInterval;
 
 private:
 
@@ -285,6 +313,9 @@ private:
   typedef std::vector< NonZeroJacobianIndicesType > TransformJacobianIndicesContainerType;
   typedef Array2D< double >                         SpatialDerivativeType;
   typedef std::vector< SpatialDerivativeType >      SpatialDerivativeContainerType;
+  typedef typename NumericTraits< MeasureType >::AccumulateType AccumulateType;
+  typedef typename ImageSampleContainerType::Element            ImageSampleType;
+  typedef typename ThreadPoolType::RangeCallbackType            RangeCallbackType;
 
   /** This function takes the fixed image samples from the ImageSampler
    * and puts them in the listSampleFixed, together with the fixed feature
@@ -306,6 +337,128 @@ private:
     TransformJacobianIndicesContainerType & jacobiansIndices,
     SpatialDerivativeContainerType & spatialDerivatives ) const;
 
+  /** Compute the feature vectors of a single fixed image sample, and put
+   * them at the given position of the list samples. If the derivative is
+   * requested, also the transform Jacobian and the spatial derivatives of
+   * the moving (feature) images are computed. Returns false if the sample
+   * is not valid, i.e. it maps outside the moving images or masks.
+   */
+  bool ComputeListSample(
+    const FixedImagePointType & fixedPoint,
+    const RealType & fixedImageValue,
+    const unsigned long position,
+    TransformJacobianType & jacobian,
+    NonZeroJacobianIndicesType & nzji,
+    SpatialDerivativeType & spatialDerivatives ) const;
+
+  /** Compute the feature vectors of the image samples [ begin, end ).
+   * Sample i is stored at position i; invalid samples are removed afterwards.
+   */
+  void ThreadedComputeListSamplesOnSampleRange(
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end ) const;
+
+  /** Generate the binary trees [ begin, end ), where 0 is the fixed,
+   * 1 the moving and 2 the joint tree.
+   */
+  void ThreadedGenerateTrees(
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end ) const;
+
+  /** Search the nearest neighbours of the query points [ begin, end ),
+   * and add their contribution to the value and, if requested, to the
+   * derivative to the variables of thread threadID.
+   */
+  void ThreadedComputeValueAndDerivativeOnSampleRange(
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end ) const;
+
+  /** Generate or refit the three trees from the list samples and connect
+   * them to the tree searchers.
+   */
+  void GenerateTrees( void ) const;
+
+  /** Compute the value and, if requested, the derivative from the
+   * list samples, which should have been computed before.
+   */
+  void ComputeValueAndDerivative( MeasureType & value, DerivativeType & derivative ) const;
+
+  /** Execute callback for the items [ 0, numberOfItems ). With multi-threading,
+   * the items are distributed over the WorkStealingThreadPool, if selected,
+   * or in equal parts over the threads of the MultiThreader.
+   */
+  void LaunchKNNThreaderCallback( SizeValueType numberOfItems,
+    SizeValueType chunkSize, RangeCallbackType callback ) const;
+
+  /** The number of threads that take part in the computations. */
+  ThreadIdType GetNumberOfThreadsInUse( void ) const
+  {
+    return this->m_UseMultiThread ? Self::GetNumberOfThreads() : 1;
+  }
+
+
+  /** Callback functions for the WorkStealingThreadPool. */
+  static void ComputeListSamplesRangeCallback( void * arg,
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end );
+  static void GenerateTreesRangeCallback( void * arg,
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end );
+  static void ComputeValueAndDerivativeRangeCallback( void * arg,
+    ThreadIdType threadID, SizeValueType begin, SizeValueType end );
+
+  /** MultiThreader callback function, which calls the range callback
+   * for an equal part of the items.
+   */
+  static ITK_THREAD_RETURN_TYPE KNNThreaderCallback( void * arg );
+
+  /** Helper struct that gives the threads access to the list samples
+   * and the derivative information.
+   */
+  struct KNNGraphThreaderParameterType
+  {
+    const Self *                            st_Metric;
+    ListSampleType *                        st_ListSampleFixed;
+    ListSampleType *                        st_ListSampleMoving;
+    ListSampleType *                        st_ListSampleJoint;
+    bool                                    st_DoDerivative;
+    TransformJacobianContainerType *        st_JacobianContainer;
+    TransformJacobianIndicesContainerType * st_JacobianIndicesContainer;
+    SpatialDerivativeContainerType *        st_SpatialDerivativesContainer;
+    RangeCallbackType                       st_RangeCallback;
+    SizeValueType                           st_NumberOfItems;
+  };
+  mutable KNNGraphThreaderParameterType m_KNNGraphThreaderParameters;
+
+  /** Marks the valid samples when the list samples are computed multi-threaded. */
+  mutable std::vector< unsigned char > m_SampleIsValid;
+
+  /** The list samples are kept between evaluations, so that the trees,
+   * which point to their memory, can be refitted instead of rebuilt.
+   */
+  mutable ListSamplePointer m_ListSampleFixed;
+  mutable ListSamplePointer m_ListSampleMoving;
+  mutable ListSamplePointer m_ListSampleJoint;
+
+  /** Book-keeping of the trees: whether they are refitted in this evaluation,
+   * the number of refits since the last rebuild, and the samples they were
+   * rebuilt from.
+   */
+  mutable bool             m_RefitTrees;
+  mutable unsigned int     m_NumberOfTreeRefits;
+  mutable ModifiedTimeType m_TreeSampleContainerTime;
+  mutable unsigned long    m_TreeNumberOfSamples;
+
+  /** The per-thread variables for the value and derivative. */
+  struct KNNGraphGetValueAndDerivativePerThreadStruct
+  {
+    AccumulateType st_SumG;
+    DerivativeType st_Contribution;
+    DerivativeType st_DGamma_M;
+    DerivativeType st_DGamma_J;
+  };
+  itkPadStruct( ITK_CACHE_LINE_ALIGNMENT, KNNGraphGetValueAndDerivativePerThreadStruct,
+    PaddedKNNGraphGetValueAndDerivativePerThreadStruct );
+  itkAlignedTypedef( ITK_CACHE_LINE_ALIGNMENT, PaddedKNNGraphGetValueAndDerivativePerThreadStruct,
+    AlignedKNNGraphGetValueAndDerivativePerThreadStruct );
+  mutable AlignedKNNGraphGetValueAndDerivativePerThreadStruct * m_KNNGraphGetValueAndDerivativePerThreadVariables;
+  mutable ThreadIdType                                          m_KNNGraphGetValueAndDerivativePerThreadVariablesSize;
+
   /** This function calculates the spatial derivative of the
    * featureNr feature image at the point mappedPoint.
    * \todo move this to base class.
@@ -33,8 +33,9 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
 {
   this->SetComputeGradient( false ); // don't use the default gradient
   this->SetUseImageSampler( true );
-  this->m_Alpha           = 0.99;
-  this->m_AvoidDivisionBy = 1e-10;
+  this->m_Alpha               = 0.99;
+  this->m_AvoidDivisionBy     = 1e-10;
+  this->m_TreeRebuildInterval = 1;
 
   this->m_BinaryKNNTreeFixed  = 0;
   this->m_BinaryKNNTreeMoving = 0;
@@ -44,9 +45,43 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
   this->m_BinaryKNNTreeSearcherMoving = 0;
   this->m_BinaryKNNTreeSearcherJoint  = 0;
 
+  this->m_KNNGraphThreaderParameters.st_Metric                      = this;
+  this->m_KNNGraphThreaderParameters.st_ListSampleFixed             = 0;
+  this->m_KNNGraphThreaderParameters.st_ListSampleMoving            = 0;
+  this->m_KNNGraphThreaderParameters.st_ListSampleJoint             = 0;
+  this->m_KNNGraphThreaderParameters.st_DoDerivative                = false;
+  this->m_KNNGraphThreaderParameters.st_JacobianContainer           = 0;
+  this->m_KNNGraphThreaderParameters.st_JacobianIndicesContainer    = 0;
+  this->m_KNNGraphThreaderParameters.st_SpatialDerivativesContainer = 0;
+  this->m_KNNGraphThreaderParameters.st_RangeCallback               = 0;
+  this->m_KNNGraphThreaderParameters.st_NumberOfItems               = 0;
+
+  this->m_KNNGraphGetValueAndDerivativePerThreadVariables     = NULL;
+  this->m_KNNGraphGetValueAndDerivativePerThreadVariablesSize = 0;
+
+  this->m_ListSampleFixed         = ListSampleType::New();
+  this->m_ListSampleMoving        = ListSampleType::New();
+  this->m_ListSampleJoint         = ListSampleType::New();
+  this->m_RefitTrees              = false;
+  this->m_NumberOfTreeRefits      = 0;
+  this->m_TreeSampleContainerTime = 0;
+  this->m_TreeNumberOfSamples     = 0;
+
 } // end Constructor()
 
 
+/**
+ * ******************* Destructor *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::~KNNGraphAlphaMutualInformationImageToImageMetric()
+{
+  delete[] this->m_KNNGraphGetValueAndDerivativePerThreadVariables;
+} // end Destructor()
+
+
 /**
  * ************************ SetANNkDTree *************************
  */
@@ -301,20 +336,20 @@ typename KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingI
 KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
 ::GetValue( const TransformParametersType & parameters ) const
 {
-  /** Initialize some variables. */
-  MeasureType measure = NumericTraits< MeasureType >::Zero;
-
   /** Make sure the transform parameters are up to date. */
   this->SetTransformParameters( parameters );
 
+  /** Reset the per-thread variables. */
+  this->InitializeThreadingParameters();
+
   /**
    * *************** Create the three list samples ******************
    */
 
-  /** Create list samples. */
-  ListSamplePointer listSampleFixed  = ListSampleType::New();
-  ListSamplePointer listSampleMoving = ListSampleType::New();
-  ListSamplePointer listSampleJoint  = ListSampleType::New();
+  /** Get the list samples. They are reused, so that the trees can be refitted. */
+  const ListSamplePointer & listSampleFixed  = this->m_ListSampleFixed;
+  const ListSamplePointer & listSampleMoving = this->m_ListSampleMoving;
+  const ListSamplePointer & listSampleJoint  = this->m_ListSampleJoint;
 
   /** Compute the three list samples. */
   TransformJacobianContainerType        dummyJacobianContainer;
@@ -330,152 +365,15 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
   this->CheckNumberOfSamples( size,
     this->m_NumberOfPixelsCounted );
 
-  /**
-   * *************** Generate the three trees ******************
-   *
-   * and connect them to the searchers.
-   */
+  /** Generate the three trees and connect them to the searchers. */
+  this->GenerateTrees();
 
-  /** Generate the tree for the fixed image samples. */
-  this->m_BinaryKNNTreeFixed->SetSample( listSampleFixed );
-  this->m_BinaryKNNTreeFixed->GenerateTree();
+  /** Estimate the \alpha MI. */
+  MeasureType    value = NumericTraits< MeasureType >::Zero;
+  DerivativeType dummyDerivative;
+  this->ComputeValueAndDerivative( value, dummyDerivative );
 
-  /** Generate the tree for the moving image samples. */
-  this->m_BinaryKNNTreeMoving->SetSample( listSampleMoving );
-  this->m_BinaryKNNTreeMoving->GenerateTree();
-
-  /** Generate the tree for the joint image samples. */
-  this->m_BinaryKNNTreeJoint->SetSample( listSampleJoint );
-  this->m_BinaryKNNTreeJoint->GenerateTree();
-
-  /** Initialize tree searchers. */
-  this->m_BinaryKNNTreeSearcherFixed
-  ->SetBinaryTree( this->m_BinaryKNNTreeFixed );
-  this->m_BinaryKNNTreeSearcherMoving
-  ->SetBinaryTree( this->m_BinaryKNNTreeMoving );
-  this->m_BinaryKNNTreeSearcherJoint
-  ->SetBinaryTree( this->m_BinaryKNNTreeJoint );
-
-  /**
-   * *************** Estimate the \alpha MI ******************
-   *
-   * This is done by searching for the nearest neighbours of each point
-   * and calculating the distances.
-   *
-   * The estimate for the alpha - mutual information is given by:
-   *
-   *  \alpha MI = 1 / ( \alpha - 1 ) * \log 1/n^\alpha * \sum_{i=1}^n \sum_{p=1}^k
-   *              ( jointLength / \sqrt( fixedLength * movingLength ) )^(2 \gamma),
-   *
-   * where
-   *   - \alpha is set by the user and refers to \alpha - mutual information
-   *   - n is the number of samples
-   *   - k is the number of nearest neighbours
-   *   - jointLength  is the distances to one of the nearest neighbours in listSampleJoint
-   *   - fixedLength  is the distances to one of the nearest neighbours in listSampleFixed
-   *   - movingLength is the distances to one of the nearest neighbours in listSampleMoving
-   *   - \gamma relates to the distance metric and relates to \alpha as:
-   *
-   *        \gamma = d * ( 1 - \alpha ),
-   *
-   *     where d is the dimension of the feature space.
-   *
-   * In the original paper it is assumed that the mutual information of
-   * two feature sets of equal dimension is calculated. If this is not
-   * true, then
-   *
-   *        \gamma = ( ( d1 + d2 ) / 2 ) * ( 1 - alpha ),
-   *
-   * where d1 and d2 are the possibly different dimensions of the two feature sets.
-   */
-
-  /** Temporary variables. */
-  typedef typename NumericTraits< MeasureType >::AccumulateType AccumulateType;
-  MeasurementVectorType z_F, z_M, z_J;
-  IndexArrayType        indices_F, indices_M, indices_J;
-  DistanceArrayType     distances_F, distances_M, distances_J;
-
-  MeasureType    H, G;
-  AccumulateType sumG = NumericTraits< AccumulateType >::Zero;
-
-  /** Get the size of the feature vectors. */
-  unsigned int fixedSize  = this->GetNumberOfFixedImages();
-  unsigned int movingSize = this->GetNumberOfMovingImages();
-  unsigned int jointSize  = fixedSize + movingSize;
-
-  /** Get the number of neighbours and \gamma. */
-  unsigned int k        = this->m_BinaryKNNTreeSearcherFixed->GetKNearestNeighbors();
-  double       twoGamma = jointSize * ( 1.0 - this->m_Alpha );
-
-  /** Loop over all query points, i.e. all samples. */
-  for( unsigned long i = 0; i < this->m_NumberOfPixelsCounted; i++ )
-  {
-    /** Get the i-th query point. */
-    listSampleFixed->GetMeasurementVector(  i, z_F );
-    listSampleMoving->GetMeasurementVector( i, z_M );
-    listSampleJoint->GetMeasurementVector(  i, z_J );
-
-    /** Search for the K nearest neighbours of the current query point. */
-    this->m_BinaryKNNTreeSearcherFixed->Search(  z_F, indices_F, distances_F );
-    this->m_BinaryKNNTreeSearcherMoving->Search( z_M, indices_M, distances_M );
-    this->m_BinaryKNNTreeSearcherJoint->Search(  z_J, indices_J, distances_J );
-
-    /** Add the distances between the points to get the total graph length.
-     * The outcommented implementation calculates: sum J/sqrt(F*M)
-     *
-    for ( unsigned int j = 0; j < K; j++ )
-    {
-    enumerator = std::sqrt( distsJ[ j ] );
-    denominator = std::sqrt( std::sqrt( distsF[ j ] ) * std::sqrt( distsM[ j ] ) );
-    if ( denominator > 1e-14 )
-    {
-    contribution += std::pow( enumerator / denominator, twoGamma );
-    }
-    }*/
-
-    /** Add the distances of all neighbours of the query point,
-    * for the three graphs:
-    * sum M / sqrt( sum F * sum M)
-    */
-
-    /** Variables to compute the measure. */
-    AccumulateType Gamma_F = NumericTraits< AccumulateType >::Zero;
-    AccumulateType Gamma_M = NumericTraits< AccumulateType >::Zero;
-    AccumulateType Gamma_J = NumericTraits< AccumulateType >::Zero;
-
-    /** Loop over the neighbours. */
-    for( unsigned int p = 0; p < k; p++ )
-    {
-      Gamma_F += std::sqrt( distances_F[ p ] );
-      Gamma_M += std::sqrt( distances_M[ p ] );
-      Gamma_J += std::sqrt( distances_J[ p ] );
-    } // end loop over the k neighbours
-
-    /** Calculate the contribution of this query point. */
-    H = std::sqrt( Gamma_F * Gamma_M );
-    if( H > this->m_AvoidDivisionBy )
-    {
-      /** Compute some sums. */
-      G     = Gamma_J / H;
-      sumG += std::pow( G, twoGamma );
-    }
-  } // end looping over all query points
-
-  /**
-   * *************** Finally, calculate the metric value \alpha MI ******************
-   */
-
-  double n, number;
-  if( sumG > this->m_AvoidDivisionBy )
-  {
-    /** Compute the measure. */
-    n       = static_cast< double >( this->m_NumberOfPixelsCounted );
-    number  = std::pow( n, this->m_Alpha );
-    measure = std::log( sumG / number ) / ( this->m_Alpha - 1.0 );
-  }
-
-  /** Return the negative alpha - mutual information. */
-  return -measure;
+  return value;
 
 } // end GetValue()
 
@@ -515,7 +413,6 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
   DerivativeType & derivative ) const
 {
   /** Initialize some variables. */
-  MeasureType measure = NumericTraits< MeasureType >::Zero;
   derivative = DerivativeType( this->GetNumberOfParameters() );
   derivative.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
 
@@ -534,14 +431,17 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
    */
   this->BeforeThreadedGetValueAndDerivative( parameters );
 
+  /** Reset the per-thread variables. */
+  this->InitializeThreadingParameters();
+
   /**
    * *************** Create the three list samples ******************
    */
 
-  /** Create list samples. */
-  ListSamplePointer listSampleFixed  = ListSampleType::New();
-  ListSamplePointer listSampleMoving = ListSampleType::New();
-  ListSamplePointer listSampleJoint  = ListSampleType::New();
+  /** Get the list samples. They are reused, so that the trees can be refitted. */
+  const ListSamplePointer & listSampleFixed  = this->m_ListSampleFixed;
+  const ListSamplePointer & listSampleMoving = this->m_ListSampleMoving;
+  const ListSamplePointer & listSampleJoint  = this->m_ListSampleJoint;
 
   /** Compute the three list samples and the derivatives. */
   TransformJacobianContainerType        jacobianContainer;
@@ -555,23 +455,414 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
   unsigned long size = this->GetImageSampler()->GetOutput()->Size();
   this->CheckNumberOfSamples( size, this->m_NumberOfPixelsCounted );
 
-  /**
-   * *************** Generate the three trees ******************
-   *
-   * and connect them to the searchers.
+  /** Generate the three trees and connect them to the searchers. */
+  this->GenerateTrees();
+
+  /** Estimate the \alpha MI and its derivatives. */
+  this->ComputeValueAndDerivative( value, derivative );
+
+} // end GetValueAndDerivative()
+
+
+/**
+ * ************************ InitializeThreadingParameters *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::InitializeThreadingParameters( void ) const
+{
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreadsInUse();
+
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_KNNGraphGetValueAndDerivativePerThreadVariablesSize < numberOfThreads )
+  {
+    delete[] this->m_KNNGraphGetValueAndDerivativePerThreadVariables;
+    this->m_KNNGraphGetValueAndDerivativePerThreadVariables
+      = new AlignedKNNGraphGetValueAndDerivativePerThreadStruct[ numberOfThreads ];
+    this->m_KNNGraphGetValueAndDerivativePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
+  }
+
+  /** Some initialization. The dGamma's are reset for every query point. */
+  const DerivativeValueType zero = NumericTraits< DerivativeValueType >::ZeroValue();
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    AlignedKNNGraphGetValueAndDerivativePerThreadStruct & threadVariables
+      = this->m_KNNGraphGetValueAndDerivativePerThreadVariables[ i ];
+    threadVariables.st_SumG = NumericTraits< AccumulateType >::Zero;
+    if( threadVariables.st_Contribution.GetSize() != this->GetNumberOfParameters() )
+    {
+      threadVariables.st_Contribution.SetSize( this->GetNumberOfParameters() );
+      threadVariables.st_DGamma_M.SetSize( this->GetNumberOfParameters() );
+      threadVariables.st_DGamma_J.SetSize( this->GetNumberOfParameters() );
+      ++this->m_NumberOfPerThreadAllocations;
+    }
+    threadVariables.st_Contribution.Fill( zero );
+  }
+
+  /** Size the scratch memory of the threads. */
+  this->InitializeThreadScratch();
+
+} // end InitializeThreadingParameters()
+
+
+/**
+ * ************************ ComputeListSampleValuesAndDerivativePlusJacobian *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeListSampleValuesAndDerivativePlusJacobian(
+  const ListSamplePointer & listSampleFixed,
+  const ListSamplePointer & listSampleMoving,
+  const ListSamplePointer & listSampleJoint,
+  const bool & doDerivative,
+  TransformJacobianContainerType & jacobianContainer,
+  TransformJacobianIndicesContainerType & jacobianIndicesContainer,
+  SpatialDerivativeContainerType & spatialDerivativesContainer ) const
+{
+  /** Initialize. */
+  this->m_NumberOfPixelsCounted = 0;
+  jacobianContainer.resize( 0 );
+  jacobianIndicesContainer.resize( 0 );
+  spatialDerivativesContainer.resize( 0 );
+
+  /** Get a handle to the sample container. */
+  ImageSampleContainerPointer sampleContainer      = this->GetImageSampler()->GetOutput();
+  const unsigned long         nrOfRequestedSamples = sampleContainer->Size();
+
+  /** Get the size of the feature vectors. */
+  const unsigned int fixedSize  = this->GetNumberOfFixedImages();
+  const unsigned int movingSize = this->GetNumberOfMovingImages();
+  const unsigned int jointSize  = fixedSize + movingSize;
+
+  /** Resize the list samples so that enough memory is allocated. The memory
+   * is kept if the sizes did not change, since the trees refer to it.
    */
+  if( listSampleFixed->Size() != nrOfRequestedSamples
+    || listSampleFixed->GetMeasurementVectorSize() != fixedSize )
+  {
+    listSampleFixed->SetMeasurementVectorSize( fixedSize );
+    listSampleFixed->Resize( nrOfRequestedSamples );
+  }
+  if( listSampleMoving->Size() != nrOfRequestedSamples
+    || listSampleMoving->GetMeasurementVectorSize() != movingSize )
+  {
+    listSampleMoving->SetMeasurementVectorSize( movingSize );
+    listSampleMoving->Resize( nrOfRequestedSamples );
+  }
+  if( listSampleJoint->Size() != nrOfRequestedSamples
+    || listSampleJoint->GetMeasurementVectorSize() != jointSize )
+  {
+    listSampleJoint->SetMeasurementVectorSize( jointSize );
+    listSampleJoint->Resize( nrOfRequestedSamples );
+  }
 
-  /** Generate the tree for the fixed image samples. */
-  this->m_BinaryKNNTreeFixed->SetSample( listSampleFixed );
-  this->m_BinaryKNNTreeFixed->GenerateTree();
+  /** Give the threads access to the list samples and the containers. */
+  KNNGraphThreaderParameterType & threaderParameters = this->m_KNNGraphThreaderParameters;
+  threaderParameters.st_ListSampleFixed             = listSampleFixed.GetPointer();
+  threaderParameters.st_ListSampleMoving            = listSampleMoving.GetPointer();
+  threaderParameters.st_ListSampleJoint             = listSampleJoint.GetPointer();
+  threaderParameters.st_DoDerivative                = doDerivative;
+  threaderParameters.st_JacobianContainer           = &jacobianContainer;
+  threaderParameters.st_JacobianIndicesContainer    = &jacobianIndicesContainer;
+  threaderParameters.st_SpatialDerivativesContainer = &spatialDerivativesContainer;
+
+  if( this->m_UseMultiThread )
+  {
+    /** Every sample is computed at its own position, so that the threads
+     * do not need to synchronize.
+     */
+    this->m_SampleIsValid.resize( nrOfRequestedSamples );
+    if( doDerivative )
+    {
+      jacobianContainer.resize( nrOfRequestedSamples );
+      jacobianIndicesContainer.resize( nrOfRequestedSamples );
+      spatialDerivativesContainer.resize( nrOfRequestedSamples );
+    }
+
+    this->LaunchKNNThreaderCallback( nrOfRequestedSamples,
+      this->m_ThreadPoolChunkSize, Self::ComputeListSamplesRangeCallback );
+
+    /** Move the valid samples to the front. */
+    MeasurementVectorType z_F, z_M, z_J;
+    for( unsigned long i = 0; i < nrOfRequestedSamples; ++i )
+    {
+      if( !this->m_SampleIsValid[ i ] )
+      {
+        continue;
+      }
+
+      const unsigned long position = this->m_NumberOfPixelsCounted;
+      if( position != i )
+      {
+        listSampleFixed->GetMeasurementVector(  i, z_F );
+        listSampleMoving->GetMeasurementVector( i, z_M );
+        listSampleJoint->GetMeasurementVector(  i, z_J );
+        listSampleFixed->SetMeasurementVector(  position, z_F );
+        listSampleMoving->SetMeasurementVector( position, z_M );
+        listSampleJoint->SetMeasurementVector(  position, z_J );
+
+        if( doDerivative )
+        {
+          std::swap( jacobianContainer[ position ], jacobianContainer[ i ] );
+          std::swap( jacobianIndicesContainer[ position ], jacobianIndicesContainer[ i ] );
+          std::swap( spatialDerivativesContainer[ position ], spatialDerivativesContainer[ i ] );
+        }
+      }
+      this->m_NumberOfPixelsCounted++;
+    }
+
+    if( doDerivative )
+    {
+      jacobianContainer.resize( this->m_NumberOfPixelsCounted );
+      jacobianIndicesContainer.resize( this->m_NumberOfPixelsCounted );
+      spatialDerivativesContainer.resize( this->m_NumberOfPixelsCounted );
+    }
+  }
+  else
+  {
+    /** Potential speedup: it avoids re-allocations. I noticed performance
+     * gains when nrOfRequestedSamples is about 10000 or higher.
+     */
+    jacobianContainer.reserve( nrOfRequestedSamples );
+    jacobianIndicesContainer.reserve( nrOfRequestedSamples );
+    spatialDerivativesContainer.reserve( nrOfRequestedSamples );
+
+    /** Create variables to store intermediate results. */
+    NonZeroJacobianIndicesType nzji(
+    this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices() );
+    TransformJacobianType jacobian;
+    SpatialDerivativeType spatialDerivatives;
+
+    /** Create an iterator over the sample container. */
+    typename ImageSampleContainerType::ConstIterator fiter;
+    typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
+    typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
+
+    /** Loop over the fixed image samples to calculate the list samples. */
+    for( fiter = fbegin; fiter != fend; ++fiter )
+    {
+      const FixedImagePointType & fixedPoint      = ( *fiter ).Value().m_ImageCoordinates;
+      const RealType              fixedImageValue = static_cast< RealType >(
+        ( *fiter ).Value().m_ImageValue );
+
+      /** Add the sample to the list samples, if it is valid. */
+      const bool sampleOk = this->ComputeListSample( fixedPoint, fixedImageValue,
+        this->m_NumberOfPixelsCounted, jacobian, nzji, spatialDerivatives );
+
+      if( sampleOk )
+      {
+        if( doDerivative )
+        {
+          jacobianContainer.push_back( jacobian );
+          jacobianIndicesContainer.push_back( nzji );
+          spatialDerivativesContainer.push_back( spatialDerivatives );
+        }
+
+        /** Update the NumberOfPixelsCounted. */
+        this->m_NumberOfPixelsCounted++;
+      }
+
+    } // end for loop over the image sample container
+  }
+
+  /** The listSamples are of size sampleContainer->Size(). However, not all of
+   * those points made it to the respective list samples. Therefore, we set
+   * the actual number of pixels in the sample container, so that the binary
+   * trees know where to loop over. This must not be forgotten!
+   */
+  listSampleFixed->SetActualSize( this->m_NumberOfPixelsCounted );
+  listSampleMoving->SetActualSize( this->m_NumberOfPixelsCounted );
+  listSampleJoint->SetActualSize( this->m_NumberOfPixelsCounted );
+
+} // end ComputeListSampleValuesAndDerivativePlusJacobian()
+
+
+/**
+ * ************************ ComputeListSample *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+bool
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeListSample(
+  const FixedImagePointType & fixedPoint,
+  const RealType & fixedImageValue,
+  const unsigned long position,
+  TransformJacobianType & jacobian,
+  NonZeroJacobianIndicesType & nzji,
+  SpatialDerivativeType & spatialDerivatives ) const
+{
+  const KNNGraphThreaderParameterType & threaderParameters = this->m_KNNGraphThreaderParameters;
+  ListSampleType * listSampleFixed  = threaderParameters.st_ListSampleFixed;
+  ListSampleType * listSampleMoving = threaderParameters.st_ListSampleMoving;
+  ListSampleType * listSampleJoint  = threaderParameters.st_ListSampleJoint;
+  const bool       doDerivative     = threaderParameters.st_DoDerivative;
+
+  /** Transform point and check if it is inside the B-spline support region. */
+  MovingImagePointType mappedPoint;
+  bool                 sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
+
+  /** Check if point is inside all moving masks. */
+  if( sampleOk )
+  {
+    sampleOk = this->IsInsideMovingMask( mappedPoint );
+  }
 
-  /** Generate the tree for the moving image samples. */
-  this->m_BinaryKNNTreeMoving->SetSample( listSampleMoving );
-  this->m_BinaryKNNTreeMoving->GenerateTree();
+  /** Compute the moving image value M(T(x)) and possibly the
+   * derivative dM/dx and check if the point is inside all
+   * moving images buffers.
+   */
+  RealType                  movingImageValue;
+  MovingImageDerivativeType movingImageDerivative;
+  if( sampleOk )
+  {
+    if( doDerivative )
+    {
+      sampleOk = this->EvaluateMovingImageValueAndDerivative(
+        mappedPoint, movingImageValue, &movingImageDerivative );
+    }
+    else
+    {
+      sampleOk = this->EvaluateMovingImageValueAndDerivative(
+        mappedPoint, movingImageValue, 0 );
+    }
+  }
+
+  if( !sampleOk )
+  {
+    return false;
+  }
 
-  /** Generate the tree for the joint image samples. */
-  this->m_BinaryKNNTreeJoint->SetSample( listSampleJoint );
-  this->m_BinaryKNNTreeJoint->GenerateTree();
+  /** This is a valid sample: add it to the ListSampleCarrays. */
+  listSampleFixed->SetMeasurement(  position, 0, fixedImageValue );
+  listSampleMoving->SetMeasurement( position, 0, movingImageValue );
+  listSampleJoint->SetMeasurement(  position, 0, fixedImageValue );
+  listSampleJoint->SetMeasurement(  position,
+    this->GetNumberOfFixedImages(), movingImageValue );
+
+  /** Get and set the values of the fixed feature images. */
+  for( unsigned int j = 1; j < this->GetNumberOfFixedImages(); j++ )
+  {
+    const double fixedFeatureValue = this->m_FixedImageInterpolatorVector[ j ]
+      ->Evaluate( fixedPoint );
+    listSampleFixed->SetMeasurement( position, j, fixedFeatureValue );
+    listSampleJoint->SetMeasurement( position, j, fixedFeatureValue );
+  }
+
+  /** Get and set the values of the moving feature images. */
+  for( unsigned int j = 1; j < this->GetNumberOfMovingImages(); j++ )
+  {
+    const double movingFeatureValue = this->m_InterpolatorVector[ j ]
+      ->Evaluate( mappedPoint );
+    listSampleMoving->SetMeasurement( position, j, movingFeatureValue );
+    listSampleJoint->SetMeasurement( position,
+      j + this->GetNumberOfFixedImages(), movingFeatureValue );
+  }
+
+  /** Compute additional stuff for the computation of the derivative, if necessary.
+   * - the Jacobian of the transform: dT/dmu(x_i).
+   * - the spatial derivative of all moving feature images: dz_q^m/dx(T(x_i)).
+   */
+  if( doDerivative )
+  {
+    /** Get the TransformJacobian dT/dmu. */
+    this->EvaluateTransformJacobian( fixedPoint, jacobian, nzji );
+
+    /** Get the spatial derivative of the moving image. */
+    spatialDerivatives.SetSize( this->GetNumberOfMovingImages(),
+      this->FixedImageDimension );
+    spatialDerivatives.set_row( 0, movingImageDerivative.GetDataPointer() );
+
+    /** Get the spatial derivatives of the moving feature images. */
+    SpatialDerivativeType movingFeatureImageDerivatives(
+    this->GetNumberOfMovingImages() - 1,
+    this->FixedImageDimension );
+    this->EvaluateMovingFeatureImageDerivatives(
+      mappedPoint, movingFeatureImageDerivatives );
+    spatialDerivatives.update( movingFeatureImageDerivatives, 1, 0 );
+  }
+
+  return true;
+
+} // end ComputeListSample()
+
+
+/**
+ * ************************ ThreadedComputeListSamplesOnSampleRange *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedComputeListSamplesOnSampleRange(
+  ThreadIdType threadID, SizeValueType begin, SizeValueType end ) const
+{
+  const KNNGraphThreaderParameterType & threaderParameters = this->m_KNNGraphThreaderParameters;
+  ImageSampleContainerPointer           sampleContainer    = this->GetImageSampler()->GetOutput();
+
+  /** The Jacobian is computed in the scratch memory of this thread, and
+   * only copied to the container for valid samples.
+   */
+  typename Superclass::ThreadScratchStruct & scratch = this->GetThreadScratch( threadID );
+  SpatialDerivativeType dummySpatialDerivatives;
+
+  for( SizeValueType i = begin; i < end; ++i )
+  {
+    const ImageSampleType & sample = sampleContainer->ElementAt( i );
+
+    SpatialDerivativeType & spatialDerivatives = threaderParameters.st_DoDerivative
+      ? ( *threaderParameters.st_SpatialDerivativesContainer )[ i ] : dummySpatialDerivatives;
+
+    const bool sampleOk = this->ComputeListSample( sample.m_ImageCoordinates,
+      static_cast< RealType >( sample.m_ImageValue ), i,
+      scratch.st_Jacobian, scratch.st_NonZeroJacobianIndices, spatialDerivatives );
+
+    if( sampleOk && threaderParameters.st_DoDerivative )
+    {
+      ( *threaderParameters.st_JacobianContainer )[ i ]        = scratch.st_Jacobian;
+      ( *threaderParameters.st_JacobianIndicesContainer )[ i ] = scratch.st_NonZeroJacobianIndices;
+    }
+    this->m_SampleIsValid[ i ] = sampleOk ? 1 : 0;
+  }
+
+} // end ThreadedComputeListSamplesOnSampleRange()
+
+
+/**
+ * ************************ GenerateTrees *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::GenerateTrees( void ) const
+{
+  /** The trees are refitted instead of rebuilt, unless the rebuild interval
+   * has passed, or the samples differ from those of the last rebuild.
+   */
+  const ModifiedTimeType sampleContainerTime
+    = this->GetImageSampler()->GetOutput()->GetUpdateMTime();
+  this->m_RefitTrees = this->m_NumberOfTreeRefits + 1 < this->m_TreeRebuildInterval
+    && sampleContainerTime == this->m_TreeSampleContainerTime
+    && this->m_NumberOfPixelsCounted == this->m_TreeNumberOfSamples;
+  if( this->m_RefitTrees )
+  {
+    ++this->m_NumberOfTreeRefits;
+  }
+  else
+  {
+    this->m_NumberOfTreeRefits      = 0;
+    this->m_TreeSampleContainerTime = sampleContainerTime;
+    this->m_TreeNumberOfSamples     = this->m_NumberOfPixelsCounted;
+  }
+
+  /** The three trees are independent, so they are generated simultaneously. */
+  this->LaunchKNNThreaderCallback( 3, 1, Self::GenerateTreesRangeCallback );
 
   /** Initialize tree searchers. */
   this->m_BinaryKNNTreeSearcherFixed
@@ -581,6 +872,76 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
   this->m_BinaryKNNTreeSearcherJoint
   ->SetBinaryTree( this->m_BinaryKNNTreeJoint );
 
+} // end GenerateTrees()
+
+
+/**
+ * ************************ ThreadedGenerateTrees *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGenerateTrees(
+  ThreadIdType itkNotUsed( threadID ), SizeValueType begin, SizeValueType end ) const
+{
+  const KNNGraphThreaderParameterType & threaderParameters = this->m_KNNGraphThreaderParameters;
+
+  for( SizeValueType i = begin; i < end; ++i )
+  {
+    if( i == 0 )
+    {
+      /** Generate or refit the tree for the fixed image samples. */
+      this->m_BinaryKNNTreeFixed->SetSample( threaderParameters.st_ListSampleFixed );
+      if( this->m_RefitTrees )
+      {
+        this->m_BinaryKNNTreeFixed->RefitTree();
+      }
+      else
+      {
+        this->m_BinaryKNNTreeFixed->GenerateTree();
+      }
+    }
+    else if( i == 1 )
+    {
+      /** Generate or refit the tree for the moving image samples. */
+      this->m_BinaryKNNTreeMoving->SetSample( threaderParameters.st_ListSampleMoving );
+      if( this->m_RefitTrees )
+      {
+        this->m_BinaryKNNTreeMoving->RefitTree();
+      }
+      else
+      {
+        this->m_BinaryKNNTreeMoving->GenerateTree();
+      }
+    }
+    else
+    {
+      /** Generate or refit the tree for the joint image samples. */
+      this->m_BinaryKNNTreeJoint->SetSample( threaderParameters.st_ListSampleJoint );
+      if( this->m_RefitTrees )
+      {
+        this->m_BinaryKNNTreeJoint->RefitTree();
+      }
+      else
+      {
+        this->m_BinaryKNNTreeJoint->GenerateTree();
+      }
+    }
+  }
+
+} // end ThreadedGenerateTrees()
+
+
+/**
+ * ************************ ComputeValueAndDerivative *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeValueAndDerivative( MeasureType & value, DerivativeType & derivative ) const
+{
   /**
    * *************** Estimate the \alpha MI and its derivatives ******************
    *
@@ -606,16 +967,91 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
    *     where d is the dimension of the feature space.
    *
    * In the original paper it is assumed that the mutual information of
-   * two feature sets of equal dimension is calculated. If not this is not
+   * two feature sets of equal dimension is calculated. If this is not
    * true, then
    *
    *        \gamma = ( ( d1 + d2 ) / 2 ) * ( 1 - alpha ),
    *
    * where d1 and d2 are the possibly different dimensions of the two feature sets.
+   *
+   * Every thread adds the contributions of its query points to sumG and
+   * to the derivative; these are gathered below.
+   */
+  this->LaunchKNNThreaderCallback( this->m_NumberOfPixelsCounted,
+    this->m_ThreadPoolChunkSize, Self::ComputeValueAndDerivativeRangeCallback );
+
+  /** Gather the sums of all threads. */
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreadsInUse();
+  AccumulateType     sumG            = NumericTraits< AccumulateType >::Zero;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    sumG += this->m_KNNGraphGetValueAndDerivativePerThreadVariables[ i ].st_SumG;
+  }
+
+  /**
+   * *************** Finally, calculate the metric value and derivative ******************
    */
 
+  /** Get the size of the feature vectors. */
+  const unsigned int jointSize = this->GetNumberOfFixedImages() + this->GetNumberOfMovingImages();
+
+  /** Compute the value. */
+  MeasureType measure = NumericTraits< MeasureType >::Zero;
+  if( sumG > this->m_AvoidDivisionBy )
+  {
+    /** Compute the measure. */
+    const double n      = static_cast< double >( this->m_NumberOfPixelsCounted );
+    const double number = std::pow( n, this->m_Alpha );
+    measure = std::log( sumG / number ) / ( this->m_Alpha - 1.0 );
+
+    /** Compute the derivative (-2.0 * d = -jointSize). */
+    if( this->m_KNNGraphThreaderParameters.st_DoDerivative )
+    {
+      DerivativeType & contribution
+        = this->m_KNNGraphGetValueAndDerivativePerThreadVariables[ 0 ].st_Contribution;
+      for( ThreadIdType i = 1; i < numberOfThreads; ++i )
+      {
+        contribution += this->m_KNNGraphGetValueAndDerivativePerThreadVariables[ i ].st_Contribution;
+      }
+      derivative = ( static_cast< AccumulateType >( jointSize ) / sumG ) * contribution;
+    }
+  }
+
+  /** Return the negative alpha - mutual information. */
+  value = -measure;
+
+} // end ComputeValueAndDerivative()
+
+
+/**
+ * ************************ ThreadedComputeValueAndDerivativeOnSampleRange *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedComputeValueAndDerivativeOnSampleRange(
+  ThreadIdType threadID, SizeValueType begin, SizeValueType end ) const
+{
+  const KNNGraphThreaderParameterType & threaderParameters = this->m_KNNGraphThreaderParameters;
+  const ListSampleType *                listSampleFixed    = threaderParameters.st_ListSampleFixed;
+  const ListSampleType *                listSampleMoving   = threaderParameters.st_ListSampleMoving;
+  const ListSampleType *                listSampleJoint    = threaderParameters.st_ListSampleJoint;
+  const bool                            doDerivative       = threaderParameters.st_DoDerivative;
+
+  /** Get the derivative information, if needed. */
+  const TransformJacobianContainerType &        jacobianContainer           = *threaderParameters.st_JacobianContainer;
+  const TransformJacobianIndicesContainerType & jacobianIndicesContainer    = *threaderParameters.st_JacobianIndicesContainer;
+  const SpatialDerivativeContainerType &        spatialDerivativesContainer = *threaderParameters.st_SpatialDerivativesContainer;
+
+  /** Get the variables of this thread. */
+  AlignedKNNGraphGetValueAndDerivativePerThreadStruct & threadVariables
+    = this->m_KNNGraphGetValueAndDerivativePerThreadVariables[ threadID ];
+  DerivativeType & contribution = threadVariables.st_Contribution;
+  DerivativeType & dGamma_M     = threadVariables.st_DGamma_M;
+  DerivativeType & dGamma_J     = threadVariables.st_DGamma_J;
+
   /** Temporary variables. */
-  typedef typename NumericTraits< MeasureType >::AccumulateType AccumulateType;
   MeasurementVectorType z_F, z_M, z_J, z_M_ip, z_J_ip, diff_M, diff_J;
   IndexArrayType        indices_F,   indices_M,   indices_J;
   DistanceArrayType     distances_F, distances_M, distances_J;
@@ -624,10 +1060,7 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
   MeasureType    H, G, Gpow;
   AccumulateType sumG = NumericTraits< AccumulateType >::Zero;
 
-  DerivativeType contribution( this->GetNumberOfParameters() );
-  contribution.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
-  DerivativeType dGamma_M( this->GetNumberOfParameters() );
-  DerivativeType dGamma_J( this->GetNumberOfParameters() );
+  SpatialDerivativeType D1sparse, D2sparse_M, D2sparse_J;
 
   /** Get the size of the feature vectors. */
   unsigned int fixedSize  = this->GetNumberOfFixedImages();
@@ -638,8 +1071,10 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
   unsigned int k        = this->m_BinaryKNNTreeSearcherFixed->GetKNearestNeighbors();
   double       twoGamma = jointSize * ( 1.0 - this->m_Alpha );
 
-  /** Loop over all query points, i.e. all samples. */
-  for( unsigned long i = 0; i < this->m_NumberOfPixelsCounted; i++ )
+  /** Loop over the query points [ begin, end ). The searchers may be shared
+   * by the threads, because the search state of ANN is thread-local.
+   */
+  for( SizeValueType i = begin; i < end; i++ )
   {
     /** Get the i-th query point. */
     listSampleFixed->GetMeasurementVector(  i, z_F );
@@ -651,24 +1086,27 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
     this->m_BinaryKNNTreeSearcherMoving->Search( z_M, indices_M, distances_M );
     this->m_BinaryKNNTreeSearcherJoint->Search(  z_J, indices_J, distances_J );
 
+    /** Add the distances of all neighbours of the query point,
+     * for the three graphs:
+     * sum M / sqrt( sum F * sum M)
+     */
+
     /** Variables to compute the measure and its derivative. */
     AccumulateType Gamma_F = NumericTraits< AccumulateType >::Zero;
     AccumulateType Gamma_M = NumericTraits< AccumulateType >::Zero;
     AccumulateType Gamma_J = NumericTraits< AccumulateType >::Zero;
 
-    SpatialDerivativeType D1sparse, D2sparse_M, D2sparse_J;
-    D1sparse = spatialDerivativesContainer[ i ] * jacobianContainer[ i ];
+    if( doDerivative )
+    {
+      D1sparse = spatialDerivativesContainer[ i ] * jacobianContainer[ i ];
 
-    dGamma_M.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
-    dGamma_J.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
+      dGamma_M.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
+      dGamma_J.Fill( NumericTraits< DerivativeValueType >::ZeroValue() );
+    }
 
     /** Loop over the neighbours. */
     for( unsigned int p = 0; p < k; p++ )
     {
-      /** Get the neighbour point z_ip^M. */
-      listSampleMoving->GetMeasurementVector( indices_M[ p ], z_M_ip );
-      listSampleMoving->GetMeasurementVector( indices_J[ p ], z_J_ip );
-
       /** Get the distances. */
       distance_F = std::sqrt( distances_F[ p ] );
       distance_M = std::sqrt( distances_M[ p ] );
@@ -679,6 +1117,15 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
       Gamma_M += distance_M;
       Gamma_J += distance_J;
 
+      if( !doDerivative )
+      {
+        continue;
+      }
+
+      /** Get the neighbour point z_ip^M. */
+      listSampleMoving->GetMeasurementVector( indices_M[ p ], z_M_ip );
+      listSampleMoving->GetMeasurementVector( indices_J[ p ], z_J_ip );
+
       /** Get the difference of z_ip^M with z_i^M. */
       diff_M = z_M - z_M_ip;
       diff_J = z_M - z_J_ip;
@@ -710,222 +1157,141 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
       sumG += std::pow( G, twoGamma );
 
       /** Compute the contribution to the derivative. */
-      Gpow          = std::pow( G, twoGamma - 1.0 );
-      contribution += ( Gpow / H ) * ( dGamma_J - ( 0.5 * Gamma_J / Gamma_M ) * dGamma_M );
+      if( doDerivative )
+      {
+        Gpow          = std::pow( G, twoGamma - 1.0 );
+        contribution += ( Gpow / H ) * ( dGamma_J - ( 0.5 * Gamma_J / Gamma_M ) * dGamma_M );
+      }
     }
 
-  } // end looping over all query points
+  } // end looping over the query points
 
-  /**
-   * *************** Finally, calculate the metric value and derivative ******************
-   */
+  /** A thread may process several ranges. */
+  threadVariables.st_SumG += sumG;
 
-  /** Compute the value. */
-  double n, number;
-  if( sumG > this->m_AvoidDivisionBy )
+} // end ThreadedComputeValueAndDerivativeOnSampleRange()
+
+
+/**
+ * ************************ LaunchKNNThreaderCallback *************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::LaunchKNNThreaderCallback( SizeValueType numberOfItems,
+  SizeValueType chunkSize, RangeCallbackType callback ) const
+{
+  KNNGraphThreaderParameterType & threaderParameters = this->m_KNNGraphThreaderParameters;
+  threaderParameters.st_Metric        = this;
+  threaderParameters.st_RangeCallback = callback;
+  threaderParameters.st_NumberOfItems = numberOfItems;
+  void * userData = static_cast< void * >( &threaderParameters );
+
+  /** Single-threaded: process all items at once. */
+  if( !this->m_UseMultiThread )
   {
-    /** Compute the measure. */
-    n       = static_cast< double >( this->m_NumberOfPixelsCounted );
-    number  = std::pow( n, this->m_Alpha );
-    measure = std::log( sumG / number ) / ( this->m_Alpha - 1.0 );
+    callback( userData, 0, 0, numberOfItems );
+    return;
+  }
 
-    /** Compute the derivative (-2.0 * d = -jointSize). */
-    derivative = ( static_cast< AccumulateType >( jointSize ) / sumG ) * contribution;
+  /** Distribute chunks of items over the persistent thread pool. */
+  if( this->m_UseWorkStealingThreadPool )
+  {
+    ThreadPoolType::GetInstance()->ParallelFor( numberOfItems, chunkSize,
+      Self::GetNumberOfThreads(), callback, userData );
+    return;
   }
-  value = -measure;
 
-} // end GetValueAndDerivative()
+  /** Setup threader and launch. */
+  this->m_Threader->SetSingleMethod( Self::KNNThreaderCallback, userData );
+  this->m_Threader->SingleMethodExecute();
+
+} // end LaunchKNNThreaderCallback()
 
 
 /**
- * ************************ ComputeListSampleValuesAndDerivativePlusJacobian *************************
+ * ************************ KNNThreaderCallback *************************
  */
 
 template< class TFixedImage, class TMovingImage >
-void
+ITK_THREAD_RETURN_TYPE
 KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeListSampleValuesAndDerivativePlusJacobian(
-  const ListSamplePointer & listSampleFixed,
-  const ListSamplePointer & listSampleMoving,
-  const ListSamplePointer & listSampleJoint,
-  const bool & doDerivative,
-  TransformJacobianContainerType & jacobianContainer,
-  TransformJacobianIndicesContainerType & jacobianIndicesContainer,
-  SpatialDerivativeContainerType & spatialDerivativesContainer ) const
+::KNNThreaderCallback( void * arg )
 {
-  /** Initialize. */
-  this->m_NumberOfPixelsCounted = 0;
-  jacobianContainer.resize( 0 );
-  jacobianIndicesContainer.resize( 0 );
-  spatialDerivativesContainer.resize( 0 );
+  ThreadInfoType * infoStruct  = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadID    = infoStruct->ThreadID;
+  ThreadIdType     nrOfThreads = infoStruct->NumberOfThreads;
+
+  KNNGraphThreaderParameterType * temp
+    = static_cast< KNNGraphThreaderParameterType * >( infoStruct->UserData );
+
+  /** Process an equal part of the items. */
+  const SizeValueType numberOfItems = temp->st_NumberOfItems;
+  const SizeValueType begin         = numberOfItems * threadID / nrOfThreads;
+  const SizeValueType end           = numberOfItems * ( threadID + 1 ) / nrOfThreads;
+  if( begin < end )
+  {
+    temp->st_RangeCallback( temp, threadID, begin, end );
+  }
 
-  /** Get a handle to the sample container. */
-  ImageSampleContainerPointer sampleContainer      = this->GetImageSampler()->GetOutput();
-  const unsigned long         nrOfRequestedSamples = sampleContainer->Size();
+  return ITK_THREAD_RETURN_VALUE;
 
-  /** Create an iterator over the sample container. */
-  typename ImageSampleContainerType::ConstIterator fiter;
-  typename ImageSampleContainerType::ConstIterator fbegin = sampleContainer->Begin();
-  typename ImageSampleContainerType::ConstIterator fend   = sampleContainer->End();
+} // end KNNThreaderCallback()
 
-  /** Get the size of the feature vectors. */
-  const unsigned int fixedSize  = this->GetNumberOfFixedImages();
-  const unsigned int movingSize = this->GetNumberOfMovingImages();
-  const unsigned int jointSize  = fixedSize + movingSize;
 
-  /** Resize the list samples so that enough memory is allocated. */
-  listSampleFixed->SetMeasurementVectorSize( fixedSize );
-  listSampleFixed->Resize( nrOfRequestedSamples );
-  listSampleMoving->SetMeasurementVectorSize( movingSize );
-  listSampleMoving->Resize( nrOfRequestedSamples );
-  listSampleJoint->SetMeasurementVectorSize( jointSize );
-  listSampleJoint->Resize( nrOfRequestedSamples );
+/**
+ * ************************ ComputeListSamplesRangeCallback *************************
+ */
 
-  /** Potential speedup: it avoids re-allocations. I noticed performance
-   * gains when nrOfRequestedSamples is about 10000 or higher.
-   */
-  jacobianContainer.reserve( nrOfRequestedSamples );
-  jacobianIndicesContainer.reserve( nrOfRequestedSamples );
-  spatialDerivativesContainer.reserve( nrOfRequestedSamples );
-
-  /** Create variables to store intermediate results. */
-  RealType                   movingImageValue;
-  MovingImagePointType       mappedPoint;
-  double                     fixedFeatureValue  = 0.0;
-  double                     movingFeatureValue = 0.0;
-  NonZeroJacobianIndicesType nzji(
-  this->m_AdvancedTransform->GetNumberOfNonZeroJacobianIndices() );
-  TransformJacobianType jacobian;
-
-  /** Loop over the fixed image samples to calculate the list samples. */
-  unsigned int ii = 0;
-  for( fiter = fbegin; fiter != fend; ++fiter )
-  {
-    /** Read fixed coordinates and initialize some variables. */
-    const FixedImagePointType & fixedPoint = ( *fiter ).Value().m_ImageCoordinates;
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeListSamplesRangeCallback( void * arg,
+  ThreadIdType threadID, SizeValueType begin, SizeValueType end )
+{
+  KNNGraphThreaderParameterType * temp
+    = static_cast< KNNGraphThreaderParameterType * >( arg );
 
-    /** Transform point and check if it is inside the B-spline support region. */
-    bool sampleOk = this->TransformPoint( fixedPoint, mappedPoint );
+  temp->st_Metric->ThreadedComputeListSamplesOnSampleRange( threadID, begin, end );
 
-    /** Check if point is inside all moving masks. */
-    if( sampleOk )
-    {
-      sampleOk = this->IsInsideMovingMask( mappedPoint );
-    }
+} // end ComputeListSamplesRangeCallback()
 
-    /** Compute the moving image value M(T(x)) and possibly the
-     * derivative dM/dx and check if the point is inside all
-     * moving images buffers.
-     */
-    MovingImageDerivativeType movingImageDerivative;
-    if( sampleOk )
-    {
-      if( doDerivative )
-      {
-        sampleOk = this->EvaluateMovingImageValueAndDerivative(
-          mappedPoint, movingImageValue, &movingImageDerivative );
-      }
-      else
-      {
-        sampleOk = this->EvaluateMovingImageValueAndDerivative(
-          mappedPoint, movingImageValue, 0 );
-      }
-    }
 
-    /** This is a valid sample: in this if-statement the actual
-     * addition to the list samples is done.
-     */
-    if( sampleOk )
-    {
-      /** Get the fixed image value. */
-      const RealType & fixedImageValue = static_cast< RealType >(
-        ( *fiter ).Value().m_ImageValue );
+/**
+ * ************************ GenerateTreesRangeCallback *************************
+ */
 
-      /** Add the samples to the ListSampleCarrays. */
-      listSampleFixed->SetMeasurement(  this->m_NumberOfPixelsCounted, 0,
-        fixedImageValue );
-      listSampleMoving->SetMeasurement( this->m_NumberOfPixelsCounted, 0,
-        movingImageValue );
-      listSampleJoint->SetMeasurement(  this->m_NumberOfPixelsCounted, 0,
-        fixedImageValue );
-      listSampleJoint->SetMeasurement(  this->m_NumberOfPixelsCounted,
-        this->GetNumberOfFixedImages(), movingImageValue );
-
-      /** Get and set the values of the fixed feature images. */
-      for( unsigned int j = 1; j < this->GetNumberOfFixedImages(); j++ )
-      {
-        fixedFeatureValue = this->m_FixedImageInterpolatorVector[ j ]
-          ->Evaluate( fixedPoint );
-        listSampleFixed->SetMeasurement(
-          this->m_NumberOfPixelsCounted, j, fixedFeatureValue );
-        listSampleJoint->SetMeasurement(
-          this->m_NumberOfPixelsCounted, j, fixedFeatureValue );
-      }
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::GenerateTreesRangeCallback( void * arg,
+  ThreadIdType threadID, SizeValueType begin, SizeValueType end )
+{
+  KNNGraphThreaderParameterType * temp
+    = static_cast< KNNGraphThreaderParameterType * >( arg );
 
-      /** Get and set the values of the moving feature images. */
-      for( unsigned int j = 1; j < this->GetNumberOfMovingImages(); j++ )
-      {
-        movingFeatureValue = this->m_InterpolatorVector[ j ]
-          ->Evaluate( mappedPoint );
-        listSampleMoving->SetMeasurement(
-          this->m_NumberOfPixelsCounted,
-          j,
-          movingFeatureValue );
-        listSampleJoint->SetMeasurement(
-          this->m_NumberOfPixelsCounted,
-          j + this->GetNumberOfFixedImages(),
-          movingFeatureValue );
-      }
+  temp->st_Metric->ThreadedGenerateTrees( threadID, begin, end );
 
-      /** Compute additional stuff for the computation of the derivative, if necessary.
-       * - the Jacobian of the transform: dT/dmu(x_i).
-       * - the spatial derivative of all moving feature images: dz_q^m/dx(T(x_i)).
-       */
-      if( doDerivative )
-      {
-        /** Get the TransformJacobian dT/dmu. */
-        this->EvaluateTransformJacobian( fixedPoint, jacobian, nzji );
-        jacobianContainer.push_back( jacobian );
-        jacobianIndicesContainer.push_back( nzji );
-
-        /** Get the spatial derivative of the moving image. */
-        SpatialDerivativeType spatialDerivatives(
-        this->GetNumberOfMovingImages(),
-        this->FixedImageDimension );
-        spatialDerivatives.set_row( 0, movingImageDerivative.GetDataPointer() );
-
-        /** Get the spatial derivatives of the moving feature images. */
-        SpatialDerivativeType movingFeatureImageDerivatives(
-        this->GetNumberOfMovingImages() - 1,
-        this->FixedImageDimension );
-        this->EvaluateMovingFeatureImageDerivatives(
-          mappedPoint, movingFeatureImageDerivatives );
-        spatialDerivatives.update( movingFeatureImageDerivatives, 1, 0 );
-
-        /** Put the spatial derivatives of this sample into the container. */
-        spatialDerivativesContainer.push_back( spatialDerivatives );
-
-      } // end if doDerivative
-
-      /** Update the NumberOfPixelsCounted. */
-      this->m_NumberOfPixelsCounted++;
+} // end GenerateTreesRangeCallback()
 
-      ii++;
 
-    } // end if sampleOk
+/**
+ * ************************ ComputeValueAndDerivativeRangeCallback *************************
+ */
 
-  } // end for loop over the image sample container
+template< class TFixedImage, class TMovingImage >
+void
+KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeValueAndDerivativeRangeCallback( void * arg,
+  ThreadIdType threadID, SizeValueType begin, SizeValueType end )
+{
+  KNNGraphThreaderParameterType * temp
+    = static_cast< KNNGraphThreaderParameterType * >( arg );
 
-  /** The listSamples are of size sampleContainer->Size(). However, not all of
-   * those points made it to the respective list samples. Therefore, we set
-   * the actual number of pixels in the sample container, so that the binary
-   * trees know where to loop over. This must not be forgotten!
-   */
-  listSampleFixed->SetActualSize( this->m_NumberOfPixelsCounted );
-  listSampleMoving->SetActualSize( this->m_NumberOfPixelsCounted );
-  listSampleJoint->SetActualSize( this->m_NumberOfPixelsCounted );
+  temp->st_Metric->ThreadedComputeValueAndDerivativeOnSampleRange( threadID, begin, end );
 
-} // end ComputeListSampleValuesAndDerivativePlusJacobian()
+} // end ComputeValueAndDerivativeRangeCallback()
 
 
 /**
@@ -1089,6 +1455,7 @@ KNNGraphAlphaMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
 
   os << indent << "Alpha: " << this->m_Alpha << std::endl;
   os << indent << "AvoidDivisionBy: " << this->m_AvoidDivisionBy << std::endl;
+  os << indent << "TreeRebuildInterval: " << this->m_TreeRebuildInterval << std::endl;
 
   os << indent << "BinaryKNNTreeFixed: "
      << this->m_BinaryKNNTreeFixed.GetPointer() << std::endl;
@@ -28,6 +28,9 @@ namespace elastix
  * \class NormalizedGradientCorrelationMetric
  * \brief An metric based on the itk::NormalizedGradientCorrelationImageToImageMetric.
  *
+ * The metric is computed at the samples of the ImageSampler, so only the
+ * pixels of the projection around these samples are ray cast. Use
+ * <tt>(ImageSampler "Full")</tt> to compute it on the complete fixed image.
  *
  * \ingroup Metrics
  *
@@ -23,10 +23,12 @@
 #include "itkNeighborhoodOperatorImageFilter.h"
 #include "itkPoint.h"
 #include "itkCastImageFilter.h"
-#include "itkResampleImageFilter.h"
 #include "itkOptimizer.h"
 #include "itkAdvancedCombinationTransform.h"
 #include "itkAdvancedRayCastInterpolateImageFunction.h"
+#include "itkSampleNeighborhoodBuffer.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -35,6 +37,19 @@ namespace itk
  * \class NormalizedGradientCorrelationImageToImageMetric
  * \brief An metric based on the itk::NormalizedGradientCorrelationImageToImageMetric.
  *
+ * The metric is the normalized cross correlation of the Sobel gradients of
+ * the fixed image and the moved image, i.e. the projection of the moving
+ * image computed by the ray cast interpolator, for 2D-3D registration.
+ *
+ * The metric is computed at the samples of the image sampler. The moved
+ * image is only evaluated at the pixels of the fixed image grid that are
+ * needed for the Sobel gradients at the samples, instead of resampling the
+ * complete moving image; see SampleNeighborhoodBuffer. These evaluations
+ * and the loop over the samples are multi-threaded. Using a full image
+ * sampler gives the same value as resampling the complete moving image.
+ *
+ * The derivative is computed by finite differences, so the transform
+ * should have a small number of parameters.
  *
  * \ingroup Metrics
  *
@@ -66,27 +81,33 @@ public:
   typedef typename Superclass::RealType RealType;
   #endif
 
-  typedef typename Superclass::TransformType           TransformType;
-  typedef typename TransformType::ScalarType           ScalarType;
-  typedef typename Superclass::TransformPointer        TransformPointer;
-  typedef typename TransformType::ConstPointer         TransformConstPointer;
-  typedef typename Superclass::TransformParametersType TransformParametersType;
-  typedef typename Superclass::TransformJacobianType   TransformJacobianType;
-  typedef typename Superclass::InterpolatorType        InterpolatorType;
-  typedef typename InterpolatorType::Pointer           InterpolatorPointer;
-  typedef typename Superclass::MeasureType             MeasureType;
-  typedef typename Superclass::DerivativeType          DerivativeType;
-  typedef typename Superclass::FixedImageType          FixedImageType;
-  typedef typename Superclass::FixedImageRegionType    FixedImageRegionType;
-  typedef typename Superclass::MovingImageType         MovingImageType;
-  typedef typename Superclass::MovingImageRegionType   MovingImageRegionType;
-  typedef typename Superclass::FixedImageConstPointer  FixedImageConstPointer;
-  typedef typename Superclass::MovingImageConstPointer MovingImageConstPointer;
-  typedef typename Superclass::MovingImagePointer      MovingImagePointer;
-  typedef typename TFixedImage::PixelType              FixedImagePixelType;
-  typedef typename TMovingImage::PixelType             MovedImagePixelType;
-  typedef typename itk::Optimizer                      OptimizerType;
-  typedef typename OptimizerType::ScalesType           ScalesType;
+  typedef typename Superclass::TransformType               TransformType;
+  typedef typename TransformType::ScalarType               ScalarType;
+  typedef typename Superclass::TransformPointer            TransformPointer;
+  typedef typename TransformType::ConstPointer             TransformConstPointer;
+  typedef typename Superclass::TransformParametersType     TransformParametersType;
+  typedef typename Superclass::TransformJacobianType       TransformJacobianType;
+  typedef typename Superclass::InterpolatorType            InterpolatorType;
+  typedef typename InterpolatorType::Pointer               InterpolatorPointer;
+  typedef typename Superclass::MeasureType                 MeasureType;
+  typedef typename Superclass::DerivativeType              DerivativeType;
+  typedef typename Superclass::FixedImageType              FixedImageType;
+  typedef typename Superclass::FixedImageRegionType        FixedImageRegionType;
+  typedef typename Superclass::MovingImageType             MovingImageType;
+  typedef typename Superclass::MovingImageRegionType       MovingImageRegionType;
+  typedef typename Superclass::FixedImageConstPointer      FixedImageConstPointer;
+  typedef typename Superclass::MovingImageConstPointer     MovingImageConstPointer;
+  typedef typename Superclass::MovingImagePointer          MovingImagePointer;
+  typedef typename Superclass::ImageSampleContainerType    ImageSampleContainerType;
+  typedef typename Superclass::ImageSampleContainerPointer ImageSampleContainerPointer;
+  typedef typename Superclass::ThreaderType                ThreaderType;
+  typedef typename Superclass::ThreadInfoType              ThreadInfoType;
+  typedef typename TFixedImage::PixelType                  FixedImagePixelType;
+  typedef typename TFixedImage::IndexType                  FixedImageIndexType;
+  typedef typename TFixedImage::OffsetType                 FixedImageOffsetType;
+  typedef typename TMovingImage::PixelType                 MovedImagePixelType;
+  typedef typename itk::Optimizer                          OptimizerType;
+  typedef typename OptimizerType::ScalesType               ScalesType;
 
   itkStaticConstMacro( FixedImageDimension, unsigned int, TFixedImage::ImageDimension );
 
@@ -94,17 +115,14 @@ public:
   typedef typename itk::AdvancedCombinationTransform<
     ScalarType, FixedImageDimension >                    CombinationTransformType;
   typedef typename CombinationTransformType::Pointer CombinationTransformPointer;
-  typedef itk::Image< FixedImagePixelType,
-    itkGetStaticConstMacro( FixedImageDimension ) >   TransformedMovingImageType;
   typedef itk::Image< unsigned char,
     itkGetStaticConstMacro( FixedImageDimension ) >   MaskImageType;
   typedef typename MaskImageType::Pointer MaskImageTypePointer;
-  typedef itk::ResampleImageFilter<
-    MovingImageType, TransformedMovingImageType >       TransformMovingImageFilterType;
-  typedef typename TransformMovingImageFilterType::Pointer TransformMovingImageFilterPointer;
   typedef typename itk::AdvancedRayCastInterpolateImageFunction
     < MovingImageType, ScalarType >                     RayCastInterpolatorType;
-  typedef typename RayCastInterpolatorType::Pointer RayCastInterpolatorPointer;
+  typedef typename RayCastInterpolatorType::Pointer          RayCastInterpolatorPointer;
+  typedef typename RayCastInterpolatorType::TransformType    RayCastTransformType;
+  typedef typename RayCastInterpolatorType::TransformPointer RayCastTransformPointer;
 
   /** Sobel filters to compute the gradients of the Fixed Image */
   typedef itk::Image< RealType,
@@ -114,15 +132,16 @@ public:
   typedef typename CastFixedImageFilterType::Pointer CastFixedImageFilterPointer;
   typedef typename FixedGradientImageType::PixelType FixedGradientPixelType;
 
-  /** Sobel filters to compute the gradients of the Moved Image */
+  /** Sobel operators to compute the gradients of the Moved Image */
   itkStaticConstMacro( MovedImageDimension, unsigned int, MovingImageType::ImageDimension );
   typedef itk::Image< RealType,
     itkGetStaticConstMacro( MovedImageDimension ) >       MovedGradientImageType;
-  typedef itk::CastImageFilter< TransformedMovingImageType,
-    MovedGradientImageType >                              CastMovedImageFilterType;
-  typedef typename CastMovedImageFilterType::Pointer CastMovedImageFilterPointer;
   typedef typename MovedGradientImageType::PixelType MovedGradientPixelType;
 
+  /** The buffer for the moved image at the neighborhoods of the samples. */
+  typedef SampleNeighborhoodBuffer< FixedImageType >     SampleNeighborhoodBufferType;
+  typedef typename SampleNeighborhoodBufferType::Pointer SampleNeighborhoodBufferPointer;
+
   /** Get the derivatives of the match measure. */
   virtual void GetDerivative( const TransformParametersType & parameters,
     DerivativeType  & derivative ) const;
@@ -158,21 +177,66 @@ public:
 protected:
 
   NormalizedGradientCorrelationImageToImageMetric();
-  virtual ~NormalizedGradientCorrelationImageToImageMetric() {}
+  virtual ~NormalizedGradientCorrelationImageToImageMetric();
   virtual void PrintSelf( std::ostream & os, Indent indent ) const;
 
-  /** Compute the mean of the fixed and moved image gradients. */
-  void ComputeMeanMovedGradient( void ) const;
+  typedef NeighborhoodOperatorImageFilter<
+    FixedGradientImageType, FixedGradientImageType >        FixedSobelFilter;
 
-  void ComputeMeanFixedGradient( void ) const;
+  /** Initialize some multi-threading related parameters. */
+  virtual void InitializeThreadingParameters( void ) const;
 
-  /** Compute the similarity measure  */
-  MeasureType ComputeMeasure( const TransformParametersType & parameters ) const;
+  /** Evaluate the moved image at the pixels in the neighborhoods of the
+   * samples, multi-threaded if m_UseMultiThread == true.
+   */
+  void ComputeMovedImageValues( void ) const;
 
-  typedef NeighborhoodOperatorImageFilter<
-    FixedGradientImageType, FixedGradientImageType >        FixedSobelFilter;
-  typedef NeighborhoodOperatorImageFilter<
-    MovedGradientImageType, MovedGradientImageType >        MovedSobelFilter;
+  /** Evaluate the moved image at the pixels [ begin, end ) of the
+   * SampleNeighborhoodBuffer.
+   */
+  void ComputeMovedImageValuesOnRange( SizeValueType begin, SizeValueType end ) const;
+
+  /** Multi-threaded version of ComputeMovedImageValues(). */
+  inline void ThreadedComputeMovedImageValues( ThreadIdType threadId );
+
+  /** Helper function to launch the threads. */
+  static ITK_THREAD_RETURN_TYPE ComputeMovedImageValuesThreaderCallback( void * arg );
+
+  /** Compute the sums of the fixed and moved image gradients, and of their
+   * products, over the samples [ begin, end ).
+   */
+  virtual void ThreadedGetValue( ThreadIdType threadId );
+
+  virtual void ThreadedGetValueOnSampleRange( ThreadIdType threadId,
+    SizeValueType begin, SizeValueType end );
+
+  /** Gather the sums of the threads and compute the metric value. */
+  virtual void AfterThreadedGetValue( MeasureType & value ) const;
+
+  /** Threading related parameters. */
+  struct NormalizedGradientCorrelationMultiThreaderParameterType
+  {
+    Self * m_Metric;
+  };
+  NormalizedGradientCorrelationMultiThreaderParameterType m_NormalizedGradientCorrelationThreaderParameters;
+
+  /** The sums of the gradients per thread. */
+  typedef typename NumericTraits< MeasureType >::AccumulateType AccumulateType;
+  struct NormalizedGradientCorrelationGetValuePerThreadStruct
+  {
+    SizeValueType  st_NumberOfPixelsCounted;
+    AccumulateType st_Sf[ FixedImageDimension ];
+    AccumulateType st_Sm[ FixedImageDimension ];
+    AccumulateType st_Sff;
+    AccumulateType st_Smm;
+    AccumulateType st_Sfm;
+  };
+  itkPadStruct( ITK_CACHE_LINE_ALIGNMENT, NormalizedGradientCorrelationGetValuePerThreadStruct,
+    PaddedNormalizedGradientCorrelationGetValuePerThreadStruct );
+  itkAlignedTypedef( ITK_CACHE_LINE_ALIGNMENT, PaddedNormalizedGradientCorrelationGetValuePerThreadStruct,
+    AlignedNormalizedGradientCorrelationGetValuePerThreadStruct );
+  mutable AlignedNormalizedGradientCorrelationGetValuePerThreadStruct * m_NormalizedGradientCorrelationGetValuePerThreadVariables;
+  mutable ThreadIdType                                                  m_NormalizedGradientCorrelationGetValuePerThreadVariablesSize;
 
 private:
 
@@ -183,14 +247,14 @@ private:
   double                      m_DerivativeDelta;
   CombinationTransformPointer m_CombinationTransform;
 
-  /** The mean of the moving image gradients. */
-  mutable MovedGradientPixelType m_MeanMovedGradient[ MovedImageDimension ];
-
-  /** The mean of the fixed image gradients. */
-  mutable FixedGradientPixelType m_MeanFixedGradient[ FixedImageDimension ];
+  /** The ray cast interpolator and its transform, which map a point of the
+   * fixed image to the moved image.
+   */
+  RayCastInterpolatorPointer m_RayCastInterpolator;
+  RayCastTransformPointer    m_RayCastTransform;
 
-  /** The filter for transforming the moving images. */
-  TransformMovingImageFilterPointer m_TransformMovingImageFilter;
+  /** The moved image at the pixels in the neighborhoods of the samples. */
+  SampleNeighborhoodBufferPointer m_SampleNeighborhoodBuffer;
 
   /** The Sobel gradients of the fixed image */
   CastFixedImageFilterPointer m_CastFixedImageFilter;
@@ -202,17 +266,18 @@ private:
   typename FixedSobelFilter::Pointer m_FixedSobelFilters
   [ itkGetStaticConstMacro( FixedImageDimension ) ];
 
-  ZeroFluxNeumannBoundaryCondition< MovedGradientImageType > m_MovedBoundCond;
   ZeroFluxNeumannBoundaryCondition< FixedGradientImageType > m_FixedBoundCond;
 
-  /** The Sobel gradients of the moving image */
-  CastMovedImageFilterPointer m_CastMovedImageFilter;
+  /** The Sobel operators for the moved image, which is defined on the grid
+   * of the fixed image. The offsets of the neighbors and the weights of the
+   * operators are stored contiguously, the weights per dimension.
+   */
   SobelOperator< MovedGradientPixelType,
-  itkGetStaticConstMacro( MovedImageDimension ) >
-  m_MovedSobelOperators[ MovedImageDimension ];
+  itkGetStaticConstMacro( FixedImageDimension ) >
+  m_MovedSobelOperators[ FixedImageDimension ];
 
-  typename MovedSobelFilter::Pointer m_MovedSobelFilters[
-    itkGetStaticConstMacro( MovedImageDimension ) ];
+  std::vector< FixedImageOffsetType > m_SobelOffsets;
+  std::vector< RealType >             m_SobelWeights;
 
 };
 
@@ -19,13 +19,9 @@
 #define __itkNormalizedGradientCorrelationImageToImageMetric_hxx
 
 #include "itkNormalizedGradientCorrelationImageToImageMetric.h"
-#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkNumericTraits.h"
-#include "itkSimpleFilterWatcher.h"
 
-#include <iostream>
-#include <iomanip>
-#include <stdio.h>
+#include <cmath>
 
 namespace itk
 {
@@ -38,21 +34,34 @@ template< class TFixedImage, class TMovingImage >
 NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
 ::NormalizedGradientCorrelationImageToImageMetric()
 {
-  this->m_CastFixedImageFilter       = CastFixedImageFilterType::New();
-  this->m_CastMovedImageFilter       = CastMovedImageFilterType::New();
-  this->m_CombinationTransform       = CombinationTransformType::New();
-  this->m_TransformMovingImageFilter = TransformMovingImageFilterType::New();
-  this->m_DerivativeDelta            = 0.001;
+  this->m_CastFixedImageFilter     = CastFixedImageFilterType::New();
+  this->m_CombinationTransform     = CombinationTransformType::New();
+  this->m_SampleNeighborhoodBuffer = SampleNeighborhoodBufferType::New();
+  this->m_DerivativeDelta          = 0.001;
 
-  for( unsigned int iDimension = 0; iDimension < MovedImageDimension; iDimension++ )
-  {
-    this->m_MeanFixedGradient[ iDimension ] = 0;
-    this->m_MeanMovedGradient[ iDimension ] = 0;
-  }
+  this->SetUseImageSampler( true );
+  this->SetSupportsSampleRangeThreading( true );
+
+  // Multi-threading structs
+  this->m_NormalizedGradientCorrelationThreaderParameters.m_Metric     = this;
+  this->m_NormalizedGradientCorrelationGetValuePerThreadVariables     = NULL;
+  this->m_NormalizedGradientCorrelationGetValuePerThreadVariablesSize = 0;
 
 } // end Constructor
 
 
+/**
+ * ***************** Destructor *****************
+ */
+
+template< class TFixedImage, class TMovingImage >
+NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
+::~NormalizedGradientCorrelationImageToImageMetric()
+{
+  delete[] this->m_NormalizedGradientCorrelationGetValuePerThreadVariables;
+} // end Destructor
+
+
 /**
  * ***************** Initialize *****************
  */
@@ -82,14 +91,13 @@ NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
     this->m_FixedSobelFilters[ iFilter ]->UpdateLargestPossibleRegion();
   }
 
-  this->ComputeMeanFixedGradient();
-
-  /** Resampling for 3D->2D */
+  /** Projection for 3D->2D */
   RayCastInterpolatorType * rayCaster = dynamic_cast< RayCastInterpolatorType * >(
     const_cast< InterpolatorType * >( this->GetInterpolator() ) );
   if( rayCaster != 0 )
   {
-    this->m_TransformMovingImageFilter->SetTransform( rayCaster->GetTransform() );
+    this->m_RayCastInterpolator = rayCaster;
+    this->m_RayCastTransform    = rayCaster->GetTransform();
   }
   else
   {
@@ -97,32 +105,83 @@ NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
                        << "only suitable for 2D-3D registration.\n"
                        << "  Therefore it expects an interpolator of type RayCastInterpolator." );
   }
-  this->m_TransformMovingImageFilter->SetInterpolator( this->m_Interpolator );
-  this->m_TransformMovingImageFilter->SetInput( this->m_MovingImage );
-  this->m_TransformMovingImageFilter->SetDefaultPixelValue( 0 );
-  this->m_TransformMovingImageFilter->SetSize( this->m_FixedImage->GetLargestPossibleRegion().GetSize() );
-  this->m_TransformMovingImageFilter->SetOutputOrigin( this->m_FixedImage->GetOrigin() );
-  this->m_TransformMovingImageFilter->SetOutputSpacing( this->m_FixedImage->GetSpacing() );
-  this->m_TransformMovingImageFilter->SetOutputDirection( this->m_FixedImage->GetDirection() );
-  this->m_TransformMovingImageFilter->Update();
-
-  this->m_CastMovedImageFilter->SetInput(
-    this->m_TransformMovingImageFilter->GetOutput() );
-
-  for( iFilter = 0; iFilter < MovedImageDimension; iFilter++ )
+
+  /** Set up the Sobel operators of the moved image. */
+  for( iFilter = 0; iFilter < FixedImageDimension; iFilter++ )
   {
     this->m_MovedSobelOperators[ iFilter ].SetDirection( iFilter );
     this->m_MovedSobelOperators[ iFilter ].CreateDirectional();
-    this->m_MovedSobelFilters[ iFilter ] = MovedSobelFilter::New();
-    this->m_MovedSobelFilters[ iFilter ]->OverrideBoundaryCondition( &this->m_MovedBoundCond );
-    this->m_MovedSobelFilters[ iFilter ]->SetOperator( this->m_MovedSobelOperators[ iFilter ] );
-    this->m_MovedSobelFilters[ iFilter ]->SetInput( this->m_CastMovedImageFilter->GetOutput() );
-    this->m_MovedSobelFilters[ iFilter ]->UpdateLargestPossibleRegion();
+  }
+
+  const SizeValueType neighborhoodSize = this->m_MovedSobelOperators[ 0 ].Size();
+  this->m_SobelOffsets.resize( neighborhoodSize );
+  this->m_SobelWeights.resize( FixedImageDimension * neighborhoodSize );
+  for( SizeValueType i = 0; i < neighborhoodSize; ++i )
+  {
+    this->m_SobelOffsets[ i ] = this->m_MovedSobelOperators[ 0 ].GetOffset( i );
+    for( iFilter = 0; iFilter < FixedImageDimension; iFilter++ )
+    {
+      this->m_SobelWeights[ iFilter * neighborhoodSize + i ] = this->m_MovedSobelOperators[ iFilter ][ i ];
+    }
+  }
+
+  /** The moved image is only evaluated in the neighborhoods of the samples. */
+  this->m_SampleNeighborhoodBuffer->SetImage( this->m_FixedImage );
+  this->m_SampleNeighborhoodBuffer->SetRadius( this->m_MovedSobelOperators[ 0 ].GetRadius() );
+
+  /** The sums are stored per thread, also when the metric is not computed
+   * multi-threadedly.
+   */
+  if( !this->m_UseMultiThread )
+  {
+    this->InitializeThreadingParameters();
   }
 
 } // end Initialize()
 
 
+/**
+ * ***************** InitializeThreadingParameters *****************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
+::InitializeThreadingParameters( void ) const
+{
+  /** Initialize the superclass parameters. */
+  Superclass::InitializeThreadingParameters();
+
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
+
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_NormalizedGradientCorrelationGetValuePerThreadVariablesSize < numberOfThreads )
+  {
+    delete[] this->m_NormalizedGradientCorrelationGetValuePerThreadVariables;
+    this->m_NormalizedGradientCorrelationGetValuePerThreadVariables
+      = new AlignedNormalizedGradientCorrelationGetValuePerThreadStruct[ numberOfThreads ];
+    this->m_NormalizedGradientCorrelationGetValuePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
+  }
+
+  /** Some initialization. */
+  const AccumulateType zero = NumericTraits< AccumulateType >::Zero;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    this->m_NormalizedGradientCorrelationGetValuePerThreadVariables[ i ].st_NumberOfPixelsCounted = NumericTraits< SizeValueType >::Zero;
+    for( unsigned int d = 0; d < FixedImageDimension; ++d )
+    {
+      this->m_NormalizedGradientCorrelationGetValuePerThreadVariables[ i ].st_Sf[ d ] = zero;
+      this->m_NormalizedGradientCorrelationGetValuePerThreadVariables[ i ].st_Sm[ d ] = zero;
+    }
+    this->m_NormalizedGradientCorrelationGetValuePerThreadVariables[ i ].st_Sff = zero;
+    this->m_NormalizedGradientCorrelationGetValuePerThreadVariables[ i ].st_Smm = zero;
+    this->m_NormalizedGradientCorrelationGetValuePerThreadVariables[ i ].st_Sfm = zero;
+  }
+
+} // end InitializeThreadingParameters()
+
+
 /**
  * ***************** PrintSelf *****************
  */
@@ -134,312 +193,342 @@ NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
 {
   Superclass::PrintSelf( os, indent );
   os << indent << "DerivativeDelta: " << this->m_DerivativeDelta << std::endl;
+  os << indent << "SampleNeighborhoodBuffer: " << this->m_SampleNeighborhoodBuffer << std::endl;
 } // end PrintSelf()
 
 
 /**
- * ***************** ComputeMeanFixedGradient *****************
+ * ***************** ComputeMovedImageValues *****************
  */
 
 template< class TFixedImage, class TMovingImage >
 void
 NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeMeanFixedGradient( void ) const
+::ComputeMovedImageValues( void ) const
 {
-  typename FixedGradientImageType::IndexType currentIndex;
-  typename FixedGradientImageType::PointType point;
-
-  for( int iDimension = 0; iDimension < FixedImageDimension; iDimension++ )
-  {
-    this->m_FixedSobelFilters[ iDimension ]->UpdateLargestPossibleRegion();
-  }
-
-  typedef  itk::ImageRegionConstIteratorWithIndex< FixedGradientImageType >
-    FixedIteratorType;
-  FixedIteratorType fixedIteratorx( this->m_FixedSobelFilters[ 0 ]->GetOutput(),
-  this->GetFixedImageRegion() );
-  FixedIteratorType fixedIteratory( this->m_FixedSobelFilters[ 1 ]->GetOutput(),
-  this->GetFixedImageRegion() );
-
-  fixedIteratorx.GoToBegin();
-  fixedIteratory.GoToBegin();
-
-  bool                   sampleOK = false;
-  FixedGradientPixelType fixedGradient[ FixedImageDimension ];
-  for( int i = 0; i < FixedImageDimension; i++ )
+  /** Option to compute single-threadedly. */
+  if( !this->m_UseMultiThread )
   {
-    fixedGradient[ i ] = 0.0;
+    this->ComputeMovedImageValuesOnRange( 0, this->m_SampleNeighborhoodBuffer->GetNumberOfPixels() );
+    return;
   }
 
-  unsigned long nPixels = 0;
+  /** Launch the threads. Each thread evaluates a different part of the
+   * pixels, so they write to different elements of the buffer.
+   */
+  this->m_Threader->SetSingleMethod( this->ComputeMovedImageValuesThreaderCallback,
+    const_cast< void * >( static_cast< const void * >(
+      &this->m_NormalizedGradientCorrelationThreaderParameters ) ) );
+  this->m_Threader->SingleMethodExecute();
 
-  if( this->m_FixedImageMask.IsNull() )
-  {
-    sampleOK = true;
-  }
+} // end ComputeMovedImageValues()
 
-  while( !fixedIteratorx.IsAtEnd() )
-  {
-    /** Get current index */
-    currentIndex = fixedIteratorx.GetIndex();
-    this->m_FixedImage->TransformIndexToPhysicalPoint( currentIndex, point );
 
-    /** if fixedMask is given */
-    if( !this->m_FixedImageMask.IsNull() )
-    {
-      if( this->m_FixedImageMask->IsInside( point ) )
-      {
-        sampleOK = true;
-      }
-      else
-      {
-        sampleOK = false;
-      }
-    }
+/**
+ * ***************** ThreadedComputeMovedImageValues *****************
+ */
 
-    if( sampleOK )
-    {
-      fixedGradient[ 0 ] += fixedIteratorx.Get();
-      fixedGradient[ 1 ] += fixedIteratory.Get();
-      nPixels++;
-    }
+template< class TFixedImage, class TMovingImage >
+void
+NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedComputeMovedImageValues( ThreadIdType threadId )
+{
+  /** Get the pixels for this thread. */
+  const SizeValueType numberOfPixels = this->m_SampleNeighborhoodBuffer->GetNumberOfPixels();
+  const SizeValueType nrOfPixelsPerThreads
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( numberOfPixels )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
 
-    ++fixedIteratorx;
-    ++fixedIteratory;
-  } // end while
+  SizeValueType pos_begin = nrOfPixelsPerThreads * threadId;
+  SizeValueType pos_end   = nrOfPixelsPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > numberOfPixels ) ? numberOfPixels : pos_begin;
+  pos_end   = ( pos_end > numberOfPixels ) ? numberOfPixels : pos_end;
 
-  this->m_MeanFixedGradient[ 0 ] = fixedGradient[ 0 ] / nPixels;
-  this->m_MeanFixedGradient[ 1 ] = fixedGradient[ 1 ] / nPixels;
+  this->ComputeMovedImageValuesOnRange( pos_begin, pos_end );
 
-} // end ComputeMeanFixedGradient()
+} // end ThreadedComputeMovedImageValues()
 
 
 /**
- * ***************** ComputeMeanMovedGradient *****************
+ * ***************** ComputeMovedImageValuesOnRange *****************
  */
 
 template< class TFixedImage, class TMovingImage >
 void
 NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeMeanMovedGradient( void ) const
+::ComputeMovedImageValuesOnRange( SizeValueType begin, SizeValueType end ) const
 {
-  typename MovedGradientImageType::IndexType currentIndex;
-  typename MovedGradientImageType::PointType point;
-
-  for( int iDimension = 0; iDimension < MovedImageDimension; iDimension++ )
+  /** The moved image value at a pixel is the ray cast from the transformed
+   * pixel, as in a ResampleImageFilter with the transform of the ray caster.
+   */
+  typename FixedImageType::PointType point;
+  for( SizeValueType p = begin; p < end; ++p )
   {
-    this->m_MovedSobelFilters[ iDimension ]->UpdateLargestPossibleRegion();
+    this->m_FixedImage->TransformIndexToPhysicalPoint(
+      this->m_SampleNeighborhoodBuffer->GetPixelIndex( p ), point );
+    this->m_SampleNeighborhoodBuffer->SetPixelValue( p, static_cast< double >(
+        this->m_RayCastInterpolator->Evaluate( this->m_RayCastTransform->TransformPoint( point ) ) ) );
   }
 
-  typedef  itk::ImageRegionConstIteratorWithIndex< MovedGradientImageType >
-    MovedIteratorType;
+} // end ComputeMovedImageValuesOnRange()
 
-  MovedIteratorType movedIteratorx( this->m_MovedSobelFilters[ 0 ]->GetOutput(),
-  this->GetFixedImageRegion() );
-  MovedIteratorType movedIteratory( this->m_MovedSobelFilters[ 1 ]->GetOutput(),
-  this->GetFixedImageRegion() );
 
-  movedIteratorx.GoToBegin();
-  movedIteratory.GoToBegin();
+/**
+ * **************** ComputeMovedImageValuesThreaderCallback *******
+ */
 
-  bool sampleOK = false;
+template< class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeMovedImageValuesThreaderCallback( void * arg )
+{
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadId   = infoStruct->ThreadID;
 
-  if( this->m_FixedImageMask.IsNull() )
-  {
-    sampleOK = true;
-  }
+  NormalizedGradientCorrelationMultiThreaderParameterType * temp
+    = static_cast< NormalizedGradientCorrelationMultiThreaderParameterType * >( infoStruct->UserData );
 
-  MovedGradientPixelType movedGradient[ MovedImageDimension ];
+  temp->m_Metric->ThreadedComputeMovedImageValues( threadId );
 
-  for( int i = 0; i < MovedImageDimension; i++ )
-  {
-    movedGradient[ i ] = 0.0;
-  }
+  return ITK_THREAD_RETURN_VALUE;
 
-  unsigned long nPixels = 0;
+} // end ComputeMovedImageValuesThreaderCallback()
 
-  while( !movedIteratorx.IsAtEnd() )
-  {
-    /** Get current index */
-    currentIndex = movedIteratorx.GetIndex();
-    this->m_FixedImage->TransformIndexToPhysicalPoint( currentIndex, point );
 
-    /** if fixedMask is given */
-    if( !this->m_FixedImageMask.IsNull() )
-    {
-      if( this->m_FixedImageMask->IsInside( point ) )
-      {
-        sampleOK = true;
-      }
-      else
-      {
-        sampleOK = false;
-      }
-    }
+/**
+ * ***************** GetValue *****************
+ */
 
-    if( sampleOK )
-    {
-      movedGradient[ 0 ] += movedIteratorx.Get();
-      movedGradient[ 1 ] += movedIteratory.Get();
-      nPixels++;
-    } // end if sampleOK
+template< class TFixedImage, class TMovingImage >
+typename NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >::MeasureType
+NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
+::GetValue( const TransformParametersType & parameters ) const
+{
+  /** Call non-thread-safe stuff, such as:
+   *   this->SetTransformParameters( parameters );
+   *   this->GetImageSampler()->Update();
+   * Because of these calls GetValueAndDerivative itself is not thread-safe,
+   * so cannot be called multiple times simultaneously.
+   * This is however needed in the CombinationImageToImageMetric.
+   * In that case, you need to:
+   * - switch the use of this function to on, using m_UseMetricSingleThreaded = true
+   * - call BeforeThreadedGetValueAndDerivative once (single-threaded) before
+   *   calling GetValueAndDerivative
+   * - switch the use of this function to off, using m_UseMetricSingleThreaded = false
+   * - Now you can call GetValueAndDerivative multi-threaded.
+   */
+  this->BeforeThreadedGetValueAndDerivative( parameters );
 
-    ++movedIteratorx;
-    ++movedIteratory;
-  } // end while
+  /** Determine the pixels that are needed for the Sobel gradients at the
+   * samples. This is only done when the samples have changed, so not for
+   * the finite difference derivative.
+   */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+  this->m_SampleNeighborhoodBuffer->Update( sampleContainer );
 
-  this->m_MeanMovedGradient[ 0 ] = movedGradient[ 0 ] / nPixels;
-  this->m_MeanMovedGradient[ 1 ] = movedGradient[ 1 ] / nPixels;
+  /** Evaluate the moved image at these pixels. */
+  this->ComputeMovedImageValues();
 
-} // end ComputeMeanMovedGradient()
+  /** Compute the sums over the samples. */
+  if( !this->m_UseMultiThread )
+  {
+    this->ThreadedGetValueOnSampleRange( 0, 0, sampleContainer->Size() );
+  }
+  else
+  {
+    this->LaunchGetValueThreaderCallback();
+  }
+
+  /** Gather the sums of all threads. */
+  MeasureType value = NumericTraits< MeasureType >::Zero;
+  this->AfterThreadedGetValue( value );
+
+  return value;
+
+} // end GetValue()
 
 
 /**
- * ***************** ComputeMeasure *****************
+ * ***************** ThreadedGetValue *****************
  */
 
 template< class TFixedImage, class TMovingImage >
-typename NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >::MeasureType
+void
 NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
-::ComputeMeasure( const TransformParametersType & parameters ) const
+::ThreadedGetValue( ThreadIdType threadId )
 {
-  this->SetTransformParameters( parameters );
-  this->m_TransformMovingImageFilter->Modified();
-  this->m_TransformMovingImageFilter->UpdateLargestPossibleRegion();
-
-  typename FixedImageType::IndexType currentIndex;
-  typename FixedImageType::PointType point;
-
-  MeasureType measure = NumericTraits< MeasureType >::Zero;
+  /** Get the size of the sample container. */
+  const SizeValueType sampleContainerSize = this->GetImageSampler()->GetOutput()->Size();
 
-  MovedGradientPixelType NmovedGradient[ FixedImageDimension ];
-  FixedGradientPixelType NfixedGradient[ FixedImageDimension ];
+  /** Get the samples for this thread. */
+  const SizeValueType nrOfSamplesPerThreads
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( sampleContainerSize )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
 
-  MeasureType NGcrosscorrelation      = NumericTraits< MeasureType >::Zero;
-  MeasureType NGautocorrelationfixed  = NumericTraits< MeasureType >::Zero;
-  MeasureType NGautocorrelationmoving = NumericTraits< MeasureType >::Zero;
+  SizeValueType pos_begin = nrOfSamplesPerThreads * threadId;
+  SizeValueType pos_end   = nrOfSamplesPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
+  pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
 
-  /** Make sure all is updated */
-  for( int iDimension = 0; iDimension < FixedImageDimension; iDimension++ )
-  {
-    this->m_FixedSobelFilters[ iDimension ]->UpdateLargestPossibleRegion();
-    this->m_MovedSobelFilters[ iDimension ]->UpdateLargestPossibleRegion();
-  }
-
-  typedef  itk::ImageRegionConstIteratorWithIndex< FixedGradientImageType >
-    FixedIteratorType;
+  this->ThreadedGetValueOnSampleRange( threadId, pos_begin, pos_end );
 
-  FixedIteratorType fixedIteratorx( this->m_FixedSobelFilters[ 0 ]->GetOutput(),
-  this->GetFixedImageRegion() );
-  FixedIteratorType fixedIteratory( this->m_FixedSobelFilters[ 1 ]->GetOutput(),
-  this->GetFixedImageRegion() );
+} // end ThreadedGetValue()
 
-  fixedIteratorx.GoToBegin();
-  fixedIteratory.GoToBegin();
 
-  typedef  itk::ImageRegionConstIteratorWithIndex< MovedGradientImageType >
-    MovedIteratorType;
-
-  MovedIteratorType movedIteratorx( this->m_MovedSobelFilters[ 0 ]->GetOutput(),
-  this->GetFixedImageRegion() );
-  MovedIteratorType movedIteratory( this->m_MovedSobelFilters[ 1 ]->GetOutput(),
-  this->GetFixedImageRegion() );
+/**
+ * ***************** ThreadedGetValueOnSampleRange *****************
+ */
 
-  movedIteratorx.GoToBegin();
-  movedIteratory.GoToBegin();
+template< class TFixedImage, class TMovingImage >
+void
+NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValueOnSampleRange( ThreadIdType threadId,
+  SizeValueType pos_begin, SizeValueType pos_end )
+{
+  /** The moved image values in the neighborhood of a sample. */
+  const SizeValueType     neighborhoodSize = this->m_SobelOffsets.size();
+  std::vector< RealType > neighborhoodValues( neighborhoodSize );
 
-  this->m_NumberOfPixelsCounted = 0;
-  bool sampleOK = false;
+  const FixedGradientImageType * fixedGradientImages[ FixedImageDimension ];
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    fixedGradientImages[ d ] = this->m_FixedSobelFilters[ d ]->GetOutput();
+  }
 
-  if( this->m_FixedImageMask.IsNull() )
+  /** Create variables to store intermediate results. circumvent false sharing */
+  const AccumulateType zero = NumericTraits< AccumulateType >::Zero;
+  AccumulateType       sf[ FixedImageDimension ];
+  AccumulateType       sm[ FixedImageDimension ];
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
   {
-    sampleOK = true;
+    sf[ d ] = zero;
+    sm[ d ] = zero;
   }
+  AccumulateType sff = zero;
+  AccumulateType smm = zero;
+  AccumulateType sfm = zero;
 
-  while( !fixedIteratorx.IsAtEnd() )
+  /** Loop over the samples. */
+  for( SizeValueType s = pos_begin; s < pos_end; ++s )
   {
-    currentIndex = fixedIteratorx.GetIndex();
-    this->m_FixedImage->TransformIndexToPhysicalPoint( currentIndex, point );
+    const FixedImageIndexType & index = this->m_SampleNeighborhoodBuffer->GetSampleIndex( s );
 
-    /** if fixedMask is given */
-    if( !this->m_FixedImageMask.IsNull() )
+    /** Gather the moved image values of the neighbors once for all dimensions. */
+    for( SizeValueType i = 0; i < neighborhoodSize; ++i )
     {
-      if( this->m_FixedImageMask->IsInside( point ) )
-      {
-        sampleOK = true;
-      }
-      else
-      {
-        sampleOK = false;
-      }
+      neighborhoodValues[ i ] = this->m_SampleNeighborhoodBuffer->GetValue( index + this->m_SobelOffsets[ i ] );
     }
 
-    if( sampleOK )
+    for( unsigned int d = 0; d < FixedImageDimension; ++d )
     {
-      NmovedGradient[ 0 ]      = movedIteratorx.Get() - this->m_MeanMovedGradient[ 0 ];
-      NfixedGradient[ 0 ]      = fixedIteratorx.Get() - this->m_MeanFixedGradient[ 0 ];
-      NmovedGradient[ 1 ]      = movedIteratory.Get() - this->m_MeanMovedGradient[ 1 ];
-      NfixedGradient[ 1 ]      = fixedIteratory.Get() - this->m_MeanFixedGradient[ 1 ];
-      NGcrosscorrelation      += NmovedGradient[ 0 ] * NfixedGradient[ 0 ] + NmovedGradient[ 1 ] * NfixedGradient[ 1 ];
-      NGautocorrelationmoving += NmovedGradient[ 0 ] * NmovedGradient[ 0 ] + NmovedGradient[ 1 ] * NmovedGradient[ 1 ];
-      NGautocorrelationfixed  += NfixedGradient[ 0 ] * NfixedGradient[ 0 ] + NfixedGradient[ 1 ] * NfixedGradient[ 1 ];
-
-    } // end if sampleOK
+      /** The Sobel gradient of the moved image is a dot product. */
+      const RealType * weights       = &this->m_SobelWeights[ d * neighborhoodSize ];
+      RealType         movedGradient = NumericTraits< RealType >::Zero;
+      for( SizeValueType i = 0; i < neighborhoodSize; ++i )
+      {
+        movedGradient += weights[ i ] * neighborhoodValues[ i ];
+      }
 
-    ++fixedIteratorx;
-    ++fixedIteratory;
-    ++movedIteratorx;
-    ++movedIteratory;
+      const RealType fixedGradient = fixedGradientImages[ d ]->GetPixel( index );
 
-  } // end while
+      sf[ d ] += fixedGradient;
+      sm[ d ] += movedGradient;
+      sff     += fixedGradient * fixedGradient;
+      smm     += movedGradient * movedGradient;
+      sfm     += fixedGradient * movedGradient;
+    }
+  }
 
-  measure = -1.0 * ( NGcrosscorrelation
-    / ( std::sqrt( NGautocorrelationfixed ) * std::sqrt( NGautocorrelationmoving ) ) );
-  return measure;
+  /** Only update these variables at the end to prevent unnecessary "false sharing".
+   * A thread may process several sample ranges, so add to them. */
+  AlignedNormalizedGradientCorrelationGetValuePerThreadStruct & threadVariables
+    = this->m_NormalizedGradientCorrelationGetValuePerThreadVariables[ threadId ];
+  threadVariables.st_NumberOfPixelsCounted += pos_end - pos_begin;
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    threadVariables.st_Sf[ d ] += sf[ d ];
+    threadVariables.st_Sm[ d ] += sm[ d ];
+  }
+  threadVariables.st_Sff += sff;
+  threadVariables.st_Smm += smm;
+  threadVariables.st_Sfm += sfm;
 
-} // end ComputeMeasure()
+} // end ThreadedGetValueOnSampleRange()
 
 
 /**
- * ***************** GetValue *****************
+ * ***************** AfterThreadedGetValue *****************
  */
 
 template< class TFixedImage, class TMovingImage >
-typename NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >::MeasureType
+void
 NormalizedGradientCorrelationImageToImageMetric< TFixedImage, TMovingImage >
-::GetValue( const TransformParametersType & parameters ) const
+::AfterThreadedGetValue( MeasureType & value ) const
 {
-  /** Call non-thread-safe stuff, such as:
-   *   this->SetTransformParameters( parameters );
-   *   this->GetImageSampler()->Update();
-   * Because of these calls GetValueAndDerivative itself is not thread-safe,
-   * so cannot be called multiple times simultaneously.
-   * This is however needed in the CombinationImageToImageMetric.
-   * In that case, you need to:
-   * - switch the use of this function to on, using m_UseMetricSingleThreaded = true
-   * - call BeforeThreadedGetValueAndDerivative once (single-threaded) before
-   *   calling GetValueAndDerivative
-   * - switch the use of this function to off, using m_UseMetricSingleThreaded = false
-   * - Now you can call GetValueAndDerivative multi-threaded.
-   */
-  this->BeforeThreadedGetValueAndDerivative( parameters );
-  //this->SetTransformParameters( parameters );
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
 
-  unsigned int iFilter;
-  this->m_TransformMovingImageFilter->Modified();
-  this->m_TransformMovingImageFilter->UpdateLargestPossibleRegion();
+  /** Accumulate the sums of the threads, and reset them for the next iteration. */
+  const AccumulateType zero = NumericTraits< AccumulateType >::Zero;
+  AccumulateType       sf[ FixedImageDimension ];
+  AccumulateType       sm[ FixedImageDimension ];
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    sf[ d ] = zero;
+    sm[ d ] = zero;
+  }
+  AccumulateType sff = zero;
+  AccumulateType smm = zero;
+  AccumulateType sfm = zero;
 
-  for( iFilter = 0; iFilter < MovedImageDimension; iFilter++ )
+  this->m_NumberOfPixelsCounted = 0;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
   {
-    this->m_MovedSobelFilters[ iFilter ]->UpdateLargestPossibleRegion();
+    AlignedNormalizedGradientCorrelationGetValuePerThreadStruct & threadVariables
+      = this->m_NormalizedGradientCorrelationGetValuePerThreadVariables[ i ];
+
+    this->m_NumberOfPixelsCounted += threadVariables.st_NumberOfPixelsCounted;
+    for( unsigned int d = 0; d < FixedImageDimension; ++d )
+    {
+      sf[ d ]                   += threadVariables.st_Sf[ d ];
+      sm[ d ]                   += threadVariables.st_Sm[ d ];
+      threadVariables.st_Sf[ d ] = zero;
+      threadVariables.st_Sm[ d ] = zero;
+    }
+    sff += threadVariables.st_Sff;
+    smm += threadVariables.st_Smm;
+    sfm += threadVariables.st_Sfm;
+
+    threadVariables.st_NumberOfPixelsCounted = 0;
+    threadVariables.st_Sff                   = zero;
+    threadVariables.st_Smm                   = zero;
+    threadVariables.st_Sfm                   = zero;
   }
 
-  this->ComputeMeanMovedGradient();
-  MeasureType currentMeasure = this->ComputeMeasure( parameters );
+  /** Check if enough samples were valid. */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+  this->CheckNumberOfSamples(
+    sampleContainer->Size(), this->m_NumberOfPixelsCounted );
 
-  return currentMeasure;
+  /** Subtract the mean gradients, i.e. compute the (co)variances. */
+  const AccumulateType N = static_cast< AccumulateType >( this->m_NumberOfPixelsCounted );
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    sff -= sf[ d ] * sf[ d ] / N;
+    smm -= sm[ d ] * sm[ d ] / N;
+    sfm -= sf[ d ] * sm[ d ] / N;
+  }
 
-} // end GetValue()
+  /** Check for a sufficiently large denominator. */
+  const AccumulateType denom = std::sqrt( sff ) * std::sqrt( smm );
+  if( denom < 1e-14 )
+  {
+    value = NumericTraits< MeasureType >::Zero;
+    return;
+  }
+
+  value = -1.0 * ( sfm / denom );
+
+} // end AfterThreadedGetValue()
 
 
 /**
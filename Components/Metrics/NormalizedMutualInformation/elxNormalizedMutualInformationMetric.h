@@ -64,6 +64,16 @@ namespace elastix
  *    useful if you use high order B-spline interpolator for the moving image.\n
  *    example: <tt>(MovingLimitRangeRatio 0.001 0.01 0.01)</tt> \n
  *    The default value is 0.01. Can be given for each resolution, or for all resolutions at once.
+ * \parameter UseFastAndLowMemoryVersion: Switch between a version of
+ *    normalized mutual information that explicitely computes the derivatives of the
+ *    joint histogram to each transformation parameter (false) and a
+ *    version that computes the derivative in a second, multi-threaded loop over
+ *    the samples (true). The first option allocates a large 3D matrix of size:
+ *    NumberOfFixedHistogramBins * NumberOfMovingHistogramBins * number
+ *    of transformation parameters, and computes the derivative single-threadedly.
+ *    Can be given for each resolution. \n
+ *    example: <tt>(UseFastAndLowMemoryVersion "false")</tt> \n
+ *    The default is "true".
  *
  * \sa ParzenWindowNormalizedMutualInformationImageToImageMetric
  * \ingroup Metrics
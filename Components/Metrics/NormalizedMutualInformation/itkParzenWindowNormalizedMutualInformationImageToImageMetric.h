@@ -20,6 +20,7 @@
 #define __itkParzenWindowNormalizedMutualInformationImageToImageMetric_H__
 
 #include "itkParzenWindowHistogramImageToImageMetric.h"
+#include "itkArray2D.h"
 
 namespace itk
 {
@@ -39,6 +40,11 @@ namespace itk
  * Construction of the PDFs is implemented in the superclass
  * ParzenWindowHistogramImageToImageMetric.
  *
+ * If UseExplicitPDFDerivatives is false, the derivative is computed without
+ * the joint histogram derivatives, in a second (multi-threaded) loop over
+ * the samples, like the low memory variant of the
+ * ParzenWindowMutualInformationImageToImageMetric.
+ *
  * This implementation of the NormalizedMutualInformation is based on the
  * AdvancedImageToImageMetric, which means that:
  * \li It uses the ImageSampler-framework
@@ -118,6 +124,7 @@ public:
   typedef typename Superclass::MovingImageMaskPointer     MovingImageMaskPointer;
   typedef typename Superclass::MeasureType                MeasureType;
   typedef typename Superclass::DerivativeType             DerivativeType;
+  typedef typename Superclass::DerivativeValueType        DerivativeValueType;
   typedef typename Superclass::ParametersType             ParametersType;
   typedef typename Superclass::FixedImagePixelType        FixedImagePixelType;
   typedef typename Superclass::MovingImageRegionType      MovingImageRegionType;
@@ -126,6 +133,8 @@ public:
   typedef typename Superclass::ImageSampleContainerType   ImageSampleContainerType;
   typedef typename
     Superclass::ImageSampleContainerPointer ImageSampleContainerPointer;
+  typedef typename
+    Superclass::ImageSampleWeightContainerType ImageSampleWeightContainerType;
   typedef typename Superclass::FixedImageLimiterType  FixedImageLimiterType;
   typedef typename Superclass::MovingImageLimiterType MovingImageLimiterType;
   typedef typename
@@ -134,6 +143,8 @@ public:
     Superclass::MovingImageLimiterOutputType MovingImageLimiterOutputType;
   typedef typename
     Superclass::MovingImageDerivativeScalesType MovingImageDerivativeScalesType;
+  typedef typename Superclass::ThreaderType   ThreaderType;
+  typedef typename Superclass::ThreadInfoType ThreadInfoType;
 
   /** The fixed image dimension. */
   itkStaticConstMacro( FixedImageDimension, unsigned int,
@@ -153,7 +164,7 @@ public:
 protected:
 
   /** The constructor. */
-  ParzenWindowNormalizedMutualInformationImageToImageMetric() {}
+  ParzenWindowNormalizedMutualInformationImageToImageMetric();
 
   /** The destructor. */
   virtual ~ParzenWindowNormalizedMutualInformationImageToImageMetric() {}
@@ -187,6 +198,8 @@ protected:
   typedef typename Superclass::ParzenValueContainerType            ParzenValueContainerType;
   typedef typename Superclass::KernelFunctionType                  KernelFunctionType;
   typedef typename Superclass::NonZeroJacobianIndicesType          NonZeroJacobianIndicesType;
+  typedef typename Superclass::PRatioType                          PRatioType;
+  typedef typename Superclass::PRatioArrayType                     PRatioArrayType;
 
   /** Replace the marginal probabilities by log(probabilities)
    * Changes the input pdf since they are not needed anymore! */
@@ -200,6 +213,17 @@ protected:
    */
   virtual MeasureType ComputeNormalizedMutualInformation( MeasureType & jointEntropy ) const;
 
+  /** Some initialization functions, called by Initialize. */
+  virtual void InitializeHistograms( void );
+
+  /** Get the value and derivative without the joint histogram derivatives.
+   * Called by GetValueAndDerivative if UseExplicitPDFDerivatives == false.
+   * Loops over the samples twice: once for the joint histogram, and once
+   * for the derivative, both multi-threadedly when m_UseMultiThread == true.
+   */
+  virtual void GetValueAndDerivativeLowMemory( const ParametersType & parameters,
+    MeasureType & value, DerivativeType & derivative ) const;
+
 private:
 
   /** The private constructor. */
@@ -207,6 +231,14 @@ private:
   /** The private copy constructor. */
   void operator=( const Self & );                               // purposely not implemented
 
+  /** Helper array for storing the weights of the joint histogram derivatives
+   * in the derivative: alpha * ( NMI log(p) - log(pf) - log(pm) ) / Ej.
+   */
+  mutable PRatioArrayType m_PRatioArray;
+
+  /** Helper function to compute m_PRatioArray; assumes the marginal pdfs are log'ed. */
+  void ComputePRatioArray( const MeasureType & nMI, const MeasureType & jointEntropy ) const;
+
 };
 
 } // end namespace itk
@@ -22,11 +22,23 @@
 #include "itkParzenWindowNormalizedMutualInformationImageToImageMetric.h"
 
 #include "itkImageLinearConstIteratorWithIndex.h"
+#include "itkImageScanlineConstIterator.h"
 #include "vnl/vnl_math.h"
 
 namespace itk
 {
 
+/**
+ * ********************* Constructor ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+ParzenWindowNormalizedMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ParzenWindowNormalizedMutualInformationImageToImageMetric()
+{
+} // end constructor
+
+
 /**
  * ********************* PrintSelf ******************************
  *
@@ -46,6 +58,29 @@ ParzenWindowNormalizedMutualInformationImageToImageMetric< TFixedImage, TMovingI
 } // end PrintSelf()
 
 
+/**
+ * ********************* InitializeHistograms ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowNormalizedMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::InitializeHistograms( void )
+{
+  /** Call Superclass implementation. */
+  this->Superclass::InitializeHistograms();
+
+  /** Allocate small amount of memory for the m_PRatioArray. */
+  if( !this->GetUseExplicitPDFDerivatives() )
+  {
+    this->m_PRatioArray.SetSize(
+      this->GetNumberOfFixedHistogramBins(),
+      this->GetNumberOfMovingHistogramBins() );
+  }
+
+} // end InitializeHistograms()
+
+
 /**
  * ********************** ComputeLogMarginalPDF***********************
  */
@@ -181,6 +216,13 @@ ParzenWindowNormalizedMutualInformationImageToImageMetric< TFixedImage, TMovingI
   MeasureType & value,
   DerivativeType & derivative ) const
 {
+  /** Low memory variant. */
+  if( !this->GetUseExplicitPDFDerivatives() )
+  {
+    this->GetValueAndDerivativeLowMemory( parameters, value, derivative );
+    return;
+  }
+
   /** Initialize some variables */
   value      = NumericTraits< MeasureType >::Zero;
   derivative = DerivativeType( this->GetNumberOfParameters() );
@@ -280,6 +322,108 @@ ParzenWindowNormalizedMutualInformationImageToImageMetric< TFixedImage, TMovingI
 } // end GetValueAndDerivative
 
 
+/**
+ * ******************** GetValueAndDerivativeLowMemory *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowNormalizedMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::GetValueAndDerivativeLowMemory(
+  const ParametersType & parameters,
+  MeasureType & value,
+  DerivativeType & derivative ) const
+{
+  /** Construct the JointPDF and Alpha.
+   * This function contains a loop over the samples.
+   * It executes multi-threadedly when m_UseMultiThread == true.
+   */
+  this->ComputePDFs( parameters );
+
+  /** Normalize the pdfs: p = alpha h */
+  this->NormalizeJointPDF( this->m_JointPDF, this->m_Alpha );
+
+  /** Compute the fixed and moving marginal pdf by summing over the histogram */
+  this->ComputeMarginalPDF( this->m_JointPDF, this->m_FixedImageMarginalPDF, 0 );
+  this->ComputeMarginalPDF( this->m_JointPDF, this->m_MovingImageMarginalPDF, 1 );
+
+  /** Replace the probabilities by log(probabilities) */
+  this->ComputeLogMarginalPDF( this->m_FixedImageMarginalPDF );
+  this->ComputeLogMarginalPDF( this->m_MovingImageMarginalPDF );
+
+  /** Compute the measure and joint entropy (which we both need to compute the derivative) */
+  MeasureType       jointEntropy = 0.0;
+  const MeasureType nMI          = this->ComputeNormalizedMutualInformation( jointEntropy );
+  value = static_cast< MeasureType >( -1.0 * nMI );
+
+  /** Compute the weights of the joint histogram derivatives. */
+  this->ComputePRatioArray( nMI, jointEntropy );
+
+  /* Compute the derivative.
+   * This function contains a second loop over the samples.
+   * It executes multi-threadedly when m_UseMultiThread == true.
+   */
+  this->ComputeDerivativeLowMemory( this->m_PRatioArray, derivative );
+
+} // end GetValueAndDerivativeLowMemory()
+
+
+/**
+ * ******************* ComputePRatioArray *******************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+ParzenWindowNormalizedMutualInformationImageToImageMetric< TFixedImage, TMovingImage >
+::ComputePRatioArray( const MeasureType & nMI, const MeasureType & jointEntropy ) const
+{
+  /** Setup iterators. */
+  typedef ImageScanlineConstIterator< JointPDFType > JointPDFConstIteratorType;
+  typedef typename MarginalPDFType::const_iterator   MarginalPDFConstIteratorType;
+
+  JointPDFConstIteratorType jointPDFconstit(
+    this->m_JointPDF, this->m_JointPDF->GetLargestPossibleRegion() );
+  MarginalPDFConstIteratorType       fixedPDFconstit  = this->m_FixedImageMarginalPDF.begin();
+  MarginalPDFConstIteratorType       movingPDFconstit = this->m_MovingImageMarginalPDF.begin();
+  const MarginalPDFConstIteratorType fixedPDFend      = this->m_FixedImageMarginalPDF.end();
+  const MarginalPDFConstIteratorType movingPDFend     = this->m_MovingImageMarginalPDF.end();
+
+  /** Initialize */
+  this->m_PRatioArray.Fill( itk::NumericTraits< PRatioType >::ZeroValue() );
+
+  /** Loop over the joint histogram, see GetValueAndDerivative(). */
+  const double alphaEj     = this->m_Alpha / jointEntropy;
+  unsigned int fixedIndex  = 0;
+  unsigned int movingIndex = 0;
+  while( fixedPDFconstit != fixedPDFend )
+  {
+    const double logFixedImagePDFValue = *fixedPDFconstit;
+    movingPDFconstit = this->m_MovingImageMarginalPDF.begin();
+    movingIndex      = 0;
+    while( movingPDFconstit != movingPDFend )
+    {
+      const double logMovingImagePDFValue = *movingPDFconstit;
+      const double jointPDFValue          = jointPDFconstit.Get();
+
+      /** Check for non-zero bin contribution. */
+      if( jointPDFValue > 1e-16 )
+      {
+        this->m_PRatioArray[ fixedIndex ][ movingIndex ] = static_cast< PRatioType >(
+          alphaEj * ( nMI * std::log( jointPDFValue )
+          - logFixedImagePDFValue - logMovingImagePDFValue ) );
+      }
+      ++movingPDFconstit;
+      ++jointPDFconstit;
+      ++movingIndex;
+    }    // end while-loop over moving index
+    ++fixedPDFconstit;
+    jointPDFconstit.NextLine();
+    ++fixedIndex;
+  }    // end while-loop over fixed index
+
+} // end ComputePRatioArray()
+
+
 } // end namespace itk
 
 #endif // end #ifndef _itkParzenWindowNormalizedMutualInformationImageToImageMetric_HXX__
@@ -192,7 +192,10 @@ PCAMetric< TFixedImage, TMovingImage >
   MeasureType measure = NumericTraits< MeasureType >::Zero;
 
   /** Update the imageSampler and get a handle to the sample container. */
-  this->GetImageSampler()->Update();
+  if( this->GetUpdateImageSampler() )
+  {
+    this->GetImageSampler()->Update();
+  }
   ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
 
   /** Create iterator over the sample container. */
@@ -439,7 +442,10 @@ PCAMetric< TFixedImage, TMovingImage >
   this->SetTransformParameters( parameters );
 
   /** Update the imageSampler and get a handle to the sample container. */
-  this->GetImageSampler()->Update();
+  if( this->GetUpdateImageSampler() )
+  {
+    this->GetImageSampler()->Update();
+  }
   ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
 
   /** Create iterator over the sample container. */
@@ -178,7 +178,10 @@ PCAMetric2< TFixedImage, TMovingImage >
   MeasureType measure = NumericTraits< MeasureType >::Zero;
 
   /** Update the imageSampler and get a handle to the sample container. */
-  this->GetImageSampler()->Update();
+  if( this->GetUpdateImageSampler() )
+  {
+    this->GetImageSampler()->Update();
+  }
   ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
 
   /** Create iterator over the sample container. */
@@ -385,7 +388,10 @@ PCAMetric2< TFixedImage, TMovingImage >
   this->SetTransformParameters( parameters );
 
   /** Update the imageSampler and get a handle to the sample container. */
-  this->GetImageSampler()->Update();
+  if( this->GetUpdateImageSampler() )
+  {
+    this->GetImageSampler()->Update();
+  }
   ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
 
   /** Create iterator over the sample container. */
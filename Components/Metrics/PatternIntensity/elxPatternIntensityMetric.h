@@ -28,6 +28,9 @@ namespace elastix
  * \class PatternIntensityMetric
  * \brief An metric based on the itk::PatternIntensityImageToImageMetric.
  *
+ * The pattern intensity is summed over the samples of the ImageSampler
+ * whose neighborhood lies inside the fixed image. With
+ * <tt>(ImageSampler "Full")</tt> it is summed over all pixels.
  *
  * \ingroup Metrics
  *
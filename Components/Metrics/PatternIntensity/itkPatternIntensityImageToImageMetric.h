@@ -21,14 +21,12 @@
 #include "itkAdvancedImageToImageMetric.h"
 
 #include "itkPoint.h"
-#include "itkCastImageFilter.h"
-#include "itkResampleImageFilter.h"
-#include "itkMultiplyImageFilter.h"
-#include "itkSubtractImageFilter.h"
 #include "itkOptimizer.h"
-#include "itkRescaleIntensityImageFilter.h"
 #include "itkAdvancedCombinationTransform.h"
 #include "itkAdvancedRayCastInterpolateImageFunction.h"
+#include "itkSampleNeighborhoodBuffer.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -36,7 +34,24 @@ namespace itk
 /** \class PatternIntensityImageToImageMetric
  * \brief Computes similarity between two objects to be registered
  *
+ * The pattern intensity compares each pixel of the difference image
+ * \f$ D = F - \lambda M \f$ to its neighbors within NeighborhoodRadius in
+ * the first two dimensions, with \f$ \sigma^2 / ( \sigma^2 + ( D(x) - D(y) )^2 ) \f$,
+ * and subtracts the same sum for the fixed image. The moved image \f$ M \f$
+ * is the projection of the moving image computed by the ray cast
+ * interpolator, for 2D-3D registration.
+ *
+ * The metric is computed at the samples of the image sampler. Samples closer
+ * than NeighborhoodRadius to the border of the fixed image are skipped. The
+ * moved image is only evaluated at the pixels in the neighborhoods of the
+ * samples; see SampleNeighborhoodBuffer. A full image sampler gives the
+ * same value as the difference image of the complete fixed image.
  *
+ * The derivative follows from the chain rule. Because the ray cast
+ * interpolator has no analytic derivative, the derivative of the moved
+ * image to each parameter is computed by central differences of the
+ * projections at the same pixels. The projections and the sums over the
+ * samples are multi-threaded.
  *
  * \ingroup RegistrationMetrics
  */
@@ -114,31 +129,22 @@ public:
   itkStaticConstMacro( FixedImageDimension, unsigned int,
     FixedImageType::ImageDimension );
 
-  typedef itk::Image< FixedImagePixelType,
-    itkGetStaticConstMacro( FixedImageDimension ) >       TransformedMovingImageType;
   typedef typename itk::AdvancedCombinationTransform<
     ScalarType, FixedImageDimension >                      CombinationTransformType;
   typedef typename CombinationTransformType::Pointer CombinationTransformPointer;
   typedef typename itk::AdvancedRayCastInterpolateImageFunction<
     MovingImageType, ScalarType >                         RayCastInterpolatorType;
-  typedef typename RayCastInterpolatorType::Pointer RayCastInterpolatorPointer;
-  typedef itk::ResampleImageFilter<
-    MovingImageType, TransformedMovingImageType >         TransformMovingImageFilterType;
-  typedef typename TransformMovingImageFilterType::Pointer TransformMovingImageFilterPointer;
-  typedef itk::RescaleIntensityImageFilter<
-    TransformedMovingImageType, TransformedMovingImageType > RescaleIntensityImageFilterType;
-  typedef typename RescaleIntensityImageFilterType::Pointer RescaleIntensityImageFilterPointer;
-
-  typedef itk::SubtractImageFilter<
-    FixedImageType,
-    TransformedMovingImageType,
-    TransformedMovingImageType >        DifferenceImageFilterType;
-  typedef typename DifferenceImageFilterType::Pointer DifferenceImageFilterPointer;
-  typedef itk::MultiplyImageFilter<
-    TransformedMovingImageType,
-    TransformedMovingImageType,
-    TransformedMovingImageType >         MultiplyImageFilterType;
-  typedef typename MultiplyImageFilterType::Pointer MultiplyImageFilterPointer;
+  typedef typename RayCastInterpolatorType::Pointer          RayCastInterpolatorPointer;
+  typedef typename RayCastInterpolatorType::TransformType    RayCastTransformType;
+  typedef typename RayCastInterpolatorType::TransformPointer RayCastTransformPointer;
+  typedef typename FixedImageType::IndexType                 FixedImageIndexType;
+  typedef typename FixedImageType::OffsetType                FixedImageOffsetType;
+  typedef typename Superclass::ThreaderType                  ThreaderType;
+  typedef typename Superclass::ThreadInfoType                ThreadInfoType;
+
+  /** The buffer for the moved image at the neighborhoods of the samples. */
+  typedef SampleNeighborhoodBuffer< FixedImageType >     SampleNeighborhoodBufferType;
+  typedef typename SampleNeighborhoodBufferType::Pointer SampleNeighborhoodBufferPointer;
 
   /** The moving image dimension. */
   itkStaticConstMacro( MovingImageDimension, unsigned int,
@@ -174,36 +180,138 @@ public:
   itkSetMacro( OptimizeNormalizationFactor, bool );
   itkGetConstReferenceMacro( OptimizeNormalizationFactor, bool );
 
+  /** Set/Get the value of Delta used for computing the derivatives of the
+   * projections by central differences. */
+  itkSetMacro( DerivativeDelta, double );
+  itkGetConstReferenceMacro( DerivativeDelta, double );
+
 protected:
 
   PatternIntensityImageToImageMetric();
-  virtual ~PatternIntensityImageToImageMetric() {}
+  virtual ~PatternIntensityImageToImageMetric();
   void PrintSelf( std::ostream & os, Indent indent ) const;
 
-  /** Compute the pattern intensity fixed image*/
+  /** Compute the pattern intensity of the fixed image at the samples. */
   MeasureType ComputePIFixed( void ) const;
 
-  /** Compute the pattern intensity difference image. */
-  MeasureType ComputePIDiff( const TransformParametersType & parameters, float scalingfactor ) const;
+  /** Compute the pattern intensity of the difference image at the samples,
+   * for the projections computed by ComputeProjections().
+   */
+  MeasureType ComputePIDiff( const double scalingfactor ) const;
+
+  /** Compute the value for the current transform parameters, and the
+   * normalization factor that was used for it.
+   */
+  MeasureType ComputeValue( const TransformParametersType & parameters,
+    double & scalingfactor ) const;
+
+  /** Initialize some multi-threading related parameters. */
+  virtual void InitializeThreadingParameters( void ) const;
+
+  /** What ComputeProjectionsOnRange() stores. The central differences are
+   * computed from the forward projections stored before.
+   */
+  typedef enum { Projection, ForwardProjection, CentralDifference } ProjectionModeType;
+
+  /** Compute the projections at the pixels in the neighborhoods of the
+   * samples, multi-threaded if m_UseMultiThread == true.
+   */
+  void ComputeProjections( const ProjectionModeType mode ) const;
+
+  /** Compute the projections at the pixels [ begin, end ) of the
+   * SampleNeighborhoodBuffer.
+   */
+  void ComputeProjectionsOnRange( SizeValueType begin, SizeValueType end ) const;
+
+  /** Multi-threaded version of ComputeProjections(). */
+  inline void ThreadedComputeProjections( ThreadIdType threadId );
+
+  /** Helper function to launch the threads. */
+  static ITK_THREAD_RETURN_TYPE ComputeProjectionsThreaderCallback( void * arg );
+
+  /** Returns true if the neighborhood of the sample is inside the fixed image. */
+  bool IsValidSample( const FixedImageIndexType & index ) const;
+
+  /** Compute the pattern intensity of the difference image over the
+   * samples [ begin, end ).
+   */
+  virtual void ThreadedGetValue( ThreadIdType threadId );
+
+  virtual void ThreadedGetValueOnSampleRange( ThreadIdType threadId,
+    SizeValueType begin, SizeValueType end );
+
+  /** Gather the pattern intensities of the threads. */
+  virtual void AfterThreadedGetValue( MeasureType & value ) const;
+
+  /** Compute the derivative of the pattern intensity of the difference
+   * image to the current parameter over the samples [ begin, end ).
+   */
+  virtual void ThreadedGetValueAndDerivative( ThreadIdType threadId );
+
+  virtual void ThreadedGetValueAndDerivativeOnSampleRange( ThreadIdType threadId,
+    SizeValueType begin, SizeValueType end );
+
+  /** Gather the derivatives of the threads to the current parameter. */
+  virtual void AfterThreadedGetValueAndDerivative(
+    MeasureType & value, DerivativeType & derivative ) const;
+
+  /** Threading related parameters. */
+  struct PatternIntensityMultiThreaderParameterType
+  {
+    Self * m_Metric;
+  };
+  PatternIntensityMultiThreaderParameterType m_PatternIntensityThreaderParameters;
+
+  /** The sums over the samples per thread. */
+  typedef typename NumericTraits< MeasureType >::AccumulateType AccumulateType;
+  struct PatternIntensityGetValuePerThreadStruct
+  {
+    SizeValueType  st_NumberOfPixelsCounted;
+    AccumulateType st_Value;
+    AccumulateType st_Derivative;
+  };
+  itkPadStruct( ITK_CACHE_LINE_ALIGNMENT, PatternIntensityGetValuePerThreadStruct,
+    PaddedPatternIntensityGetValuePerThreadStruct );
+  itkAlignedTypedef( ITK_CACHE_LINE_ALIGNMENT, PaddedPatternIntensityGetValuePerThreadStruct,
+    AlignedPatternIntensityGetValuePerThreadStruct );
+  mutable AlignedPatternIntensityGetValuePerThreadStruct * m_PatternIntensityGetValuePerThreadVariables;
+  mutable ThreadIdType                                     m_PatternIntensityGetValuePerThreadVariablesSize;
 
 private:
 
   PatternIntensityImageToImageMetric( const Self & ); // purposely not implemented
   void operator=( const Self & );                     // purposely not implemented
 
-  TransformMovingImageFilterPointer  m_TransformMovingImageFilter;
-  DifferenceImageFilterPointer       m_DifferenceImageFilter;
-  RescaleIntensityImageFilterPointer m_RescaleImageFilter;
-  MultiplyImageFilterPointer         m_MultiplyImageFilter;
-  double                             m_NoiseConstant;
-  unsigned int                       m_NeighborhoodRadius;
-  double                             m_DerivativeDelta;
-  double                             m_NormalizationFactor;
-  double                             m_Rescalingfactor;
-  bool                               m_OptimizeNormalizationFactor;
-  ScalesType                         m_Scales;
-  MeasureType                        m_FixedMeasure;
-  CombinationTransformPointer        m_CombinationTransform;
+  double                      m_NoiseConstant;
+  unsigned int                m_NeighborhoodRadius;
+  double                      m_DerivativeDelta;
+  double                      m_NormalizationFactor;
+  double                      m_Rescalingfactor;
+  bool                        m_OptimizeNormalizationFactor;
+  ScalesType                  m_Scales;
+  mutable MeasureType         m_FixedMeasure;
+  CombinationTransformPointer m_CombinationTransform;
+
+  /** The ray cast interpolator and its transform, which map a point of the
+   * fixed image to the moved image.
+   */
+  RayCastInterpolatorPointer m_RayCastInterpolator;
+  RayCastTransformPointer    m_RayCastTransform;
+
+  /** The projections at the pixels in the neighborhoods of the samples,
+   * and their derivatives to the current parameter.
+   */
+  SampleNeighborhoodBufferPointer m_SampleNeighborhoodBuffer;
+  SampleNeighborhoodBufferPointer m_ProjectionDerivativeBuffer;
+
+  /** The offsets of the neighbors, in the first two dimensions. */
+  std::vector< FixedImageOffsetType > m_NeighborhoodOffsets;
+
+  /** The state of the threaded computations. */
+  mutable ProjectionModeType m_ProjectionMode;
+  mutable double             m_CurrentDerivativeDelta;
+  mutable double             m_CurrentScalingFactor;
+  mutable unsigned int       m_CurrentParameter;
 
 };
 
@@ -19,14 +19,9 @@
 #define __itkPatternIntensityImageToImageMetric_hxx
 
 #include "itkPatternIntensityImageToImageMetric.h"
-#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkNumericTraits.h"
 
 #include <cmath>
-#include <iostream>
-#include <iomanip>
-#include <stdio.h>
-#include "itkSimpleFilterWatcher.h"
 
 namespace itk
 {
@@ -46,15 +41,37 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
   this->m_NeighborhoodRadius          = 3;
   this->m_FixedMeasure                = 0;
   this->m_OptimizeNormalizationFactor = false;
-  this->m_TransformMovingImageFilter  = TransformMovingImageFilterType::New();
   this->m_CombinationTransform        = CombinationTransformType::New();
-  this->m_RescaleImageFilter          = RescaleIntensityImageFilterType::New();
-  this->m_DifferenceImageFilter       = DifferenceImageFilterType::New();
-  this->m_MultiplyImageFilter         = MultiplyImageFilterType::New();
+  this->m_SampleNeighborhoodBuffer    = SampleNeighborhoodBufferType::New();
+  this->m_ProjectionDerivativeBuffer  = SampleNeighborhoodBufferType::New();
+  this->m_ProjectionMode              = Projection;
+  this->m_CurrentDerivativeDelta      = 0.0;
+  this->m_CurrentScalingFactor        = 1.0;
+  this->m_CurrentParameter            = 0;
+
+  this->SetUseImageSampler( true );
+  this->SetSupportsSampleRangeThreading( true );
+
+  // Multi-threading structs
+  this->m_PatternIntensityThreaderParameters.m_Metric     = this;
+  this->m_PatternIntensityGetValuePerThreadVariables     = NULL;
+  this->m_PatternIntensityGetValuePerThreadVariablesSize = 0;
 
 } // end Constructor
 
 
+/**
+ * ********************* Destructor ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::~PatternIntensityImageToImageMetric()
+{
+  delete[] this->m_PatternIntensityGetValuePerThreadVariables;
+} // end Destructor
+
+
 /**
  * ********************* Initialize ******************************
  */
@@ -66,44 +83,61 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
 {
   Superclass::Initialize();
 
-  /** Resampling for 3D->2D */
+  /** Projection for 3D->2D */
   RayCastInterpolatorType * rayCaster = dynamic_cast< RayCastInterpolatorType * >(
     const_cast< InterpolatorType * >( this->GetInterpolator() ) );
   if( rayCaster != 0 )
   {
-    this->m_TransformMovingImageFilter->SetTransform( rayCaster->GetTransform() );
+    this->m_RayCastInterpolator = rayCaster;
+    this->m_RayCastTransform    = rayCaster->GetTransform();
   }
   else
   {
-    itkExceptionMacro( << "ERROR: the NormalizedGradientCorrelationImageToImageMetric is currently "
+    itkExceptionMacro( << "ERROR: the PatternIntensityImageToImageMetric is currently "
                        << "only suitable for 2D-3D registration.\n"
                        << "  Therefore it expects an interpolator of type RayCastInterpolator." );
   }
-  this->m_TransformMovingImageFilter->SetInterpolator( this->m_Interpolator );
-  this->m_TransformMovingImageFilter->SetInput( this->m_MovingImage );
-  this->m_TransformMovingImageFilter->SetDefaultPixelValue( 0 );
-
-  this->m_TransformMovingImageFilter->SetSize(
-    this->m_FixedImage->GetLargestPossibleRegion().GetSize() );
-  this->m_TransformMovingImageFilter->SetOutputOrigin(
-    this->m_FixedImage->GetOrigin() );
-  this->m_TransformMovingImageFilter->SetOutputSpacing(
-    this->m_FixedImage->GetSpacing() );
-  this->m_TransformMovingImageFilter->SetOutputDirection(
-    this->m_FixedImage->GetDirection() );
-  this->m_TransformMovingImageFilter->UpdateLargestPossibleRegion();
 
   //this->InitializeLimiters();
 
   this->m_NormalizationFactor = this->m_FixedImageTrueMax / this->m_MovingImageTrueMax;
-  this->m_MultiplyImageFilter->SetInput(
-    this->m_TransformMovingImageFilter->GetOutput() );
-  this->m_MultiplyImageFilter->SetConstant(
-    this->m_NormalizationFactor );
-  this->m_DifferenceImageFilter->SetInput1( this->m_FixedImage );
-  this->m_DifferenceImageFilter->SetInput2( this->m_MultiplyImageFilter->GetOutput() );
-  this->m_DifferenceImageFilter->UpdateLargestPossibleRegion();
-  this->m_FixedMeasure = this->ComputePIFixed();
+
+  /** The neighbors of a pixel, in the first two dimensions only. */
+  const IndexValueType radius = static_cast< IndexValueType >( this->m_NeighborhoodRadius );
+  typename FixedImageType::SizeType neighborhoodRadius;
+  neighborhoodRadius.Fill( 0 );
+  FixedImageOffsetType offset;
+  offset.Fill( 0 );
+  this->m_NeighborhoodOffsets.clear();
+  for( IndexValueType j = -radius; j <= radius; ++j )
+  {
+    for( IndexValueType i = -radius; i <= radius; ++i )
+    {
+      offset[ 0 ] = i;
+      offset[ 1 ] = j;
+      this->m_NeighborhoodOffsets.push_back( offset );
+    }
+  }
+  neighborhoodRadius[ 0 ] = this->m_NeighborhoodRadius;
+  neighborhoodRadius[ 1 ] = this->m_NeighborhoodRadius;
+
+  /** The projections are only computed in the neighborhoods of the samples.
+   * Make sure that the pattern intensity of the fixed image is recomputed,
+   * since the noise constant may have changed.
+   */
+  this->m_SampleNeighborhoodBuffer->SetImage( this->m_FixedImage );
+  this->m_SampleNeighborhoodBuffer->SetRadius( neighborhoodRadius );
+  this->m_SampleNeighborhoodBuffer->Modified();
+  this->m_ProjectionDerivativeBuffer->SetImage( this->m_FixedImage );
+  this->m_ProjectionDerivativeBuffer->SetRadius( neighborhoodRadius );
+
+  /** The sums are stored per thread, also when the metric is not computed
+   * multi-threadedly.
+   */
+  if( !this->m_UseMultiThread )
+  {
+    this->InitializeThreadingParameters();
+  }
 
   /* to rescale the similarity measure between 0-1;*/
   MeasureType tmpmeasure = this->GetValue( this->m_Transform->GetParameters() );
@@ -116,6 +150,41 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
 } // end Initialize()
 
 
+/**
+ * ********************* InitializeThreadingParameters ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::InitializeThreadingParameters( void ) const
+{
+  /** Initialize the superclass parameters. */
+  Superclass::InitializeThreadingParameters();
+
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
+
+  /** Only resize the array of structs when it is too small. */
+  if( this->m_PatternIntensityGetValuePerThreadVariablesSize < numberOfThreads )
+  {
+    delete[] this->m_PatternIntensityGetValuePerThreadVariables;
+    this->m_PatternIntensityGetValuePerThreadVariables
+      = new AlignedPatternIntensityGetValuePerThreadStruct[ numberOfThreads ];
+    this->m_PatternIntensityGetValuePerThreadVariablesSize = numberOfThreads;
+    ++this->m_NumberOfPerThreadAllocations;
+  }
+
+  /** Some initialization. */
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_NumberOfPixelsCounted = NumericTraits< SizeValueType >::Zero;
+    this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_Value                 = NumericTraits< AccumulateType >::Zero;
+    this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_Derivative            = NumericTraits< AccumulateType >::Zero;
+  }
+
+} // end InitializeThreadingParameters()
+
+
 /**
  * ********************* PrintSelf ******************************
  */
@@ -127,10 +196,41 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
 {
   Superclass::PrintSelf( os, indent );
   os << indent << "DerivativeDelta: " << this->m_DerivativeDelta << std::endl;
+  os << indent << "NoiseConstant: " << this->m_NoiseConstant << std::endl;
+  os << indent << "NeighborhoodRadius: " << this->m_NeighborhoodRadius << std::endl;
+  os << indent << "NormalizationFactor: " << this->m_NormalizationFactor << std::endl;
+  os << indent << "OptimizeNormalizationFactor: " << this->m_OptimizeNormalizationFactor << std::endl;
 
 } // end PrintSelf()
 
 
+/**
+ * ********************* IsValidSample ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+bool
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::IsValidSample( const FixedImageIndexType & index ) const
+{
+  /** The neighborhood of the sample should be inside the image. */
+  const FixedImageRegionType & region = this->m_FixedImage->GetLargestPossibleRegion();
+  const IndexValueType         radius = static_cast< IndexValueType >( this->m_NeighborhoodRadius );
+  for( unsigned int i = 0; i < 2; ++i ) // Only 2D
+  {
+    const IndexValueType first = region.GetIndex()[ i ] + radius;
+    const IndexValueType last  = region.GetIndex()[ i ]
+      + static_cast< IndexValueType >( region.GetSize()[ i ] ) - radius;
+    if( index[ i ] < first || index[ i ] >= last )
+    {
+      return false;
+    }
+  }
+  return true;
+
+} // end IsValidSample()
+
+
 /**
  * ********************* ComputePIFixed ******************************
  */
@@ -143,85 +243,143 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
   MeasureType measure = NumericTraits< MeasureType >::Zero;
   MeasureType diff    = NumericTraits< MeasureType >::Zero;
 
-  typename FixedImageType::SizeType iterationSize
-    = this->m_FixedImage->GetLargestPossibleRegion().GetSize();
-  typename FixedImageType::IndexType iterationStartIndex, currentIndex, neighborIndex;
-  typename FixedImageType::SizeType neighborIterationSize;
-  typename FixedImageType::PointType point;
-
-  iterationSize.Fill( 1 ); neighborIterationSize.Fill( 1 ); iterationStartIndex.Fill( 0 );
-  for( unsigned int i = 0; i < 2; ++i ) // Only 2D
+  const SizeValueType numberOfSamples  = this->m_SampleNeighborhoodBuffer->GetNumberOfSamples();
+  const SizeValueType neighborhoodSize = this->m_NeighborhoodOffsets.size();
+  for( SizeValueType s = 0; s < numberOfSamples; ++s )
   {
-    iterationSize[ i ]        -= static_cast< int >( 2 * this->m_NeighborhoodRadius );
-    iterationStartIndex[ i ]   = static_cast< int >( this->m_NeighborhoodRadius );
-    neighborIterationSize[ i ] = static_cast< int >( 2 * this->m_NeighborhoodRadius ) + 1;
+    const FixedImageIndexType & index = this->m_SampleNeighborhoodBuffer->GetSampleIndex( s );
+    if( !this->IsValidSample( index ) )
+    {
+      continue;
+    }
+
+    const RealType fixedValue = this->m_FixedImage->GetPixel( index );
+    for( SizeValueType i = 0; i < neighborhoodSize; ++i )
+    {
+      diff     = fixedValue - this->m_FixedImage->GetPixel( index + this->m_NeighborhoodOffsets[ i ] );
+      measure += ( this->m_NoiseConstant ) / ( this->m_NoiseConstant + ( diff * diff ) );
+    }
   }
 
-  typename FixedImageType::RegionType iterationRegion, neighboriterationRegion;
-  iterationRegion.SetIndex( iterationStartIndex );
-  iterationRegion.SetSize( iterationSize );
+  return measure;
 
-  typedef  itk::ImageRegionConstIteratorWithIndex< FixedImageType > FixedImageTypeIteratorType;
+} // end ComputePIFixed()
 
-  FixedImageTypeIteratorType fixedImageIt( this->m_FixedImage, iterationRegion );
-  fixedImageIt.GoToBegin();
 
-  neighboriterationRegion.SetSize( neighborIterationSize );
+/**
+ * ********************* ComputeProjections ******************************
+ */
 
-  bool sampleOK = false;
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeProjections( const ProjectionModeType mode ) const
+{
+  this->m_ProjectionMode = mode;
 
-  if( this->m_FixedImageMask.IsNull() )
+  /** Option to compute single-threadedly. */
+  if( !this->m_UseMultiThread )
   {
-    sampleOK = true;
+    this->ComputeProjectionsOnRange( 0, this->m_SampleNeighborhoodBuffer->GetNumberOfPixels() );
+    return;
   }
 
-  while( !fixedImageIt.IsAtEnd() )
+  /** Launch the threads. Each thread computes a different part of the
+   * pixels, so they write to different elements of the buffer.
+   */
+  this->m_Threader->SetSingleMethod( this->ComputeProjectionsThreaderCallback,
+    const_cast< void * >( static_cast< const void * >(
+      &this->m_PatternIntensityThreaderParameters ) ) );
+  this->m_Threader->SingleMethodExecute();
+
+} // end ComputeProjections()
+
+
+/**
+ * ********************* ThreadedComputeProjections ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedComputeProjections( ThreadIdType threadId )
+{
+  /** Get the pixels for this thread. */
+  const SizeValueType numberOfPixels = this->m_SampleNeighborhoodBuffer->GetNumberOfPixels();
+  const SizeValueType nrOfPixelsPerThreads
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( numberOfPixels )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
+
+  SizeValueType pos_begin = nrOfPixelsPerThreads * threadId;
+  SizeValueType pos_end   = nrOfPixelsPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > numberOfPixels ) ? numberOfPixels : pos_begin;
+  pos_end   = ( pos_end > numberOfPixels ) ? numberOfPixels : pos_end;
+
+  this->ComputeProjectionsOnRange( pos_begin, pos_end );
+
+} // end ThreadedComputeProjections()
+
+
+/**
+ * ********************* ComputeProjectionsOnRange ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeProjectionsOnRange( SizeValueType begin, SizeValueType end ) const
+{
+  /** Both buffers contain the same pixels, since they are updated with the
+   * same samples, image and radius.
+   */
+  SampleNeighborhoodBufferType * buffer = this->m_ProjectionMode == Projection
+    ? this->m_SampleNeighborhoodBuffer.GetPointer()
+    : this->m_ProjectionDerivativeBuffer.GetPointer();
+
+  /** The projection at a pixel is the ray cast from the transformed pixel,
+   * as in a ResampleImageFilter with the transform of the ray caster.
+   */
+  typename FixedImageType::PointType point;
+  for( SizeValueType p = begin; p < end; ++p )
   {
-    /** Get current index */
-    currentIndex = fixedImageIt.GetIndex();
-    this->m_FixedImage->TransformIndexToPhysicalPoint( currentIndex, point );
+    this->m_FixedImage->TransformIndexToPhysicalPoint( buffer->GetPixelIndex( p ), point );
+    const double projection = static_cast< double >(
+      this->m_RayCastInterpolator->Evaluate( this->m_RayCastTransform->TransformPoint( point ) ) );
 
-    /** if fixedMask is given */
-    if( !this->m_FixedImageMask.IsNull() )
+    if( this->m_ProjectionMode == CentralDifference )
     {
-      if( this->m_FixedImageMask->IsInside( point ) )
-      {
-        sampleOK = true;
-      }
-      else
-      {
-        sampleOK = false;
-      }
+      buffer->SetPixelValue( p, ( buffer->GetPixelValue( p ) - projection )
+        / ( 2.0 * this->m_CurrentDerivativeDelta ) );
     }
-
-    if( sampleOK )
+    else
     {
-      /** setup the neighborhood iterator */
-      neighborIndex.Fill( 0 );
-      for( unsigned int i = 0; i < 2; ++i ) // 2D only
-      {
-        neighborIndex[ i ] = currentIndex[ i ] - this->m_NeighborhoodRadius;
-      }
+      buffer->SetPixelValue( p, projection );
+    }
+  }
 
-      neighboriterationRegion.SetIndex( neighborIndex );
-      FixedImageTypeIteratorType neighborIt( this->m_FixedImage, neighboriterationRegion );
-      neighborIt.GoToBegin();
+} // end ComputeProjectionsOnRange()
 
-      while( !neighborIt.IsAtEnd() )
-      {
-        diff     = fixedImageIt.Value() - neighborIt.Value();
-        measure += ( this->m_NoiseConstant ) / ( this->m_NoiseConstant + ( diff * diff ) );
-        ++neighborIt;
-      } // end while neighborIt
 
-    } // end if sampleOK
+/**
+ * ********************* ComputeProjectionsThreaderCallback ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+ITK_THREAD_RETURN_TYPE
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::ComputeProjectionsThreaderCallback( void * arg )
+{
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType     threadId   = infoStruct->ThreadID;
 
-    ++fixedImageIt;
-  } //end while fixedImageIt
+  PatternIntensityMultiThreaderParameterType * temp
+    = static_cast< PatternIntensityMultiThreaderParameterType * >( infoStruct->UserData );
 
-  return measure;
+  temp->m_Metric->ThreadedComputeProjections( threadId );
 
-} // end ComputePIFixed()
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end ComputeProjectionsThreaderCallback()
 
 
 /**
@@ -231,120 +389,146 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
 template< class TFixedImage, class TMovingImage >
 typename PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >::MeasureType
 PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
-::ComputePIDiff( const TransformParametersType & parameters, float scalingfactor ) const
+::ComputePIDiff( const double scalingfactor ) const
 {
-  /** Call non-thread-safe stuff, such as:
-   *   this->SetTransformParameters( parameters );
-   *   this->GetImageSampler()->Update();
-   * Because of these calls GetValueAndDerivative itself is not thread-safe,
-   * so cannot be called multiple times simultaneously.
-   * This is however needed in the CombinationImageToImageMetric.
-   * In that case, you need to:
-   * - switch the use of this function to on, using m_UseMetricSingleThreaded = true
-   * - call BeforeThreadedGetValueAndDerivative once (single-threaded) before
-   *   calling GetValueAndDerivative
-   * - switch the use of this function to off, using m_UseMetricSingleThreaded = false
-   * - Now you can call GetValueAndDerivative multi-threaded.
+  /** The projections do not depend on the scaling factor, so they are
+   * computed only once by the caller.
    */
-  this->BeforeThreadedGetValueAndDerivative( parameters );
-  //this->SetTransformParameters( parameters );
+  this->m_CurrentScalingFactor = scalingfactor;
+
+  if( !this->m_UseMultiThread )
+  {
+    this->ThreadedGetValueOnSampleRange( 0, 0, this->GetImageSampler()->GetOutput()->Size() );
+  }
+  else
+  {
+    this->LaunchGetValueThreaderCallback();
+  }
 
-  this->m_TransformMovingImageFilter->Modified();
-  this->m_MultiplyImageFilter->SetConstant( scalingfactor );
-  this->m_DifferenceImageFilter->UpdateLargestPossibleRegion();
   MeasureType measure = NumericTraits< MeasureType >::Zero;
-  MeasureType diff    = NumericTraits< MeasureType >::Zero;
+  this->AfterThreadedGetValue( measure );
 
-  typename FixedImageType::SizeType iterationSize
-    = this->m_FixedImage->GetLargestPossibleRegion().GetSize();
-  typename FixedImageType::IndexType iterationStartIndex, currentIndex, neighborIndex;
-  typename FixedImageType::SizeType neighborIterationSize;
-  typename FixedImageType::PointType point;
+  return measure;
 
-  iterationSize.Fill( 1 ); neighborIterationSize.Fill( 1 ); iterationStartIndex.Fill( 0 );
-  for( unsigned int i = 0; i < 2; ++i ) // Only 2D
-  {
-    iterationSize[ i ]        -= static_cast< int >( 2 * this->m_NeighborhoodRadius );
-    iterationStartIndex[ i ]   = static_cast< int >( this->m_NeighborhoodRadius );
-    neighborIterationSize[ i ] = static_cast< int >( 2 * this->m_NeighborhoodRadius + 1 );
-  }
+} // end ComputePIDiff()
 
-  typename FixedImageType::RegionType iterationRegion, neighboriterationRegion;
-  iterationRegion.SetIndex( iterationStartIndex );
-  iterationRegion.SetSize( iterationSize );
 
-  typedef itk::ImageRegionConstIteratorWithIndex< TransformedMovingImageType >
-    DifferenceImageIteratorType;
-  DifferenceImageIteratorType differenceImageIt(
-  this->m_DifferenceImageFilter->GetOutput(), iterationRegion );
-  differenceImageIt.GoToBegin();
+/**
+ * ********************* ThreadedGetValue ******************************
+ */
 
-  neighboriterationRegion.SetSize( neighborIterationSize );
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValue( ThreadIdType threadId )
+{
+  /** Get the size of the sample container. */
+  const SizeValueType sampleContainerSize = this->GetImageSampler()->GetOutput()->Size();
 
-  bool sampleOK = false;
-  if( this->m_FixedImageMask.IsNull() )
-  {
-    sampleOK = true;
-  }
+  /** Get the samples for this thread. */
+  const SizeValueType nrOfSamplesPerThreads
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( sampleContainerSize )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
 
-  while( !differenceImageIt.IsAtEnd() )
-  {
-    /** Get current index */
-    currentIndex = differenceImageIt.GetIndex();
-    this->m_FixedImage->TransformIndexToPhysicalPoint( currentIndex, point );
+  SizeValueType pos_begin = nrOfSamplesPerThreads * threadId;
+  SizeValueType pos_end   = nrOfSamplesPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
+  pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
+
+  this->ThreadedGetValueOnSampleRange( threadId, pos_begin, pos_end );
+
+} // end ThreadedGetValue()
+
+
+/**
+ * ********************* ThreadedGetValueOnSampleRange ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValueOnSampleRange( ThreadIdType threadId,
+  SizeValueType pos_begin, SizeValueType pos_end )
+{
+  const SizeValueType neighborhoodSize = this->m_NeighborhoodOffsets.size();
+  const RealType      scalingfactor    = this->m_CurrentScalingFactor;
+  const RealType      noiseConstant    = this->m_NoiseConstant;
 
-    /** if fixedMask is given */
-    if( !this->m_FixedImageMask.IsNull() )
+  /** Create variables to store intermediate results. circumvent false sharing */
+  SizeValueType  numberOfPixelsCounted = 0;
+  AccumulateType measure               = NumericTraits< AccumulateType >::Zero;
+
+  /** Loop over the samples. */
+  for( SizeValueType s = pos_begin; s < pos_end; ++s )
+  {
+    const FixedImageIndexType & index = this->m_SampleNeighborhoodBuffer->GetSampleIndex( s );
+    if( !this->IsValidSample( index ) )
     {
-      if( this->m_FixedImageMask->IsInside( point ) )
-      {
-        sampleOK = true;
-      }
-      else
-      {
-        sampleOK = false;
-      }
+      continue;
     }
+    ++numberOfPixelsCounted;
 
-    if( sampleOK )
+    /** The difference image at the sample and its neighbors. */
+    const RealType difference = this->m_FixedImage->GetPixel( index )
+      - scalingfactor * this->m_SampleNeighborhoodBuffer->GetValue( index );
+    for( SizeValueType i = 0; i < neighborhoodSize; ++i )
     {
-      /** setup the neighborhood iterator */
-      neighborIndex.Fill( 0 );
-      for( unsigned int i = 0; i < 2; ++i ) // 2D only
-      {
-        neighborIndex[ i ] = currentIndex[ i ] - this->m_NeighborhoodRadius;
-      }
+      const FixedImageIndexType neighbor = index + this->m_NeighborhoodOffsets[ i ];
+      const RealType            diff     = difference - ( this->m_FixedImage->GetPixel( neighbor )
+        - scalingfactor * this->m_SampleNeighborhoodBuffer->GetValue( neighbor ) );
+      measure += noiseConstant / ( noiseConstant + diff * diff );
+    }
+  }
 
-      neighboriterationRegion.SetIndex( neighborIndex );
-      DifferenceImageIteratorType neighborIt(
-      this->m_DifferenceImageFilter->GetOutput(), neighboriterationRegion );
-      neighborIt.GoToBegin();
+  /** Only update these variables at the end to prevent unnecessary "false sharing".
+   * A thread may process several sample ranges, so add to them. */
+  this->m_PatternIntensityGetValuePerThreadVariables[ threadId ].st_NumberOfPixelsCounted += numberOfPixelsCounted;
+  this->m_PatternIntensityGetValuePerThreadVariables[ threadId ].st_Value                 += measure;
 
-      while( !neighborIt.IsAtEnd() )
-      {
-        diff     = differenceImageIt.Value() - neighborIt.Value();
-        measure += this->m_NoiseConstant / ( this->m_NoiseConstant + ( diff * diff ) );
-        ++neighborIt;
-      } // end while neighborIt
+} // end ThreadedGetValueOnSampleRange()
 
-    } // end if sampleOK
 
-    ++differenceImageIt;
-  } // end while differenceImageIt
+/**
+ * ********************* AfterThreadedGetValue ******************************
+ */
 
-  return measure;
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::AfterThreadedGetValue( MeasureType & value ) const
+{
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
 
-} // end ComputePIDiff()
+  /** Accumulate the sums of the threads, and reset them. */
+  AccumulateType measure = NumericTraits< AccumulateType >::Zero;
+  this->m_NumberOfPixelsCounted = 0;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    this->m_NumberOfPixelsCounted += this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_NumberOfPixelsCounted;
+    measure                       += this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_Value;
+
+    this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_NumberOfPixelsCounted = 0;
+    this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_Value                 = NumericTraits< AccumulateType >::Zero;
+  }
+
+  /** Check if enough samples were valid. */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+  this->CheckNumberOfSamples(
+    sampleContainer->Size(), this->m_NumberOfPixelsCounted );
+
+  value = static_cast< MeasureType >( measure );
+
+} // end AfterThreadedGetValue()
 
 
 /**
- * ********************* GetValue ******************************
+ * ********************* ComputeValue ******************************
  */
 
 template< class TFixedImage, class TMovingImage >
 typename PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >::MeasureType
 PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
-::GetValue( const TransformParametersType & parameters ) const
+::ComputeValue( const TransformParametersType & parameters, double & scalingfactor ) const
 {
   /** Call non-thread-safe stuff, such as:
    *   this->SetTransformParameters( parameters );
@@ -360,10 +544,20 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
    * - Now you can call GetValueAndDerivative multi-threaded.
    */
   this->BeforeThreadedGetValueAndDerivative( parameters );
-  //this->SetTransformParameters( parameters );
 
-  this->m_TransformMovingImageFilter->Modified();
-  this->m_DifferenceImageFilter->UpdateLargestPossibleRegion();
+  /** Determine the pixels in the neighborhoods of the samples. The fixed
+   * image only contributes a constant, which is recomputed when the samples
+   * change.
+   */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+  if( this->m_SampleNeighborhoodBuffer->Update( sampleContainer ) )
+  {
+    this->m_FixedMeasure = this->ComputePIFixed();
+  }
+
+  /** Compute the projections at these pixels. */
+  this->ComputeProjections( Projection );
+
   MeasureType measure        = 1e10;
   MeasureType currentMeasure = 1e10;
 
@@ -371,18 +565,18 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
   {
     float tmpfactor  =  0.0;
     float factorstep =  ( this->m_NormalizationFactor * 10 - tmpfactor ) / 100;
-    //float bestfactor = tmpfactor;
     MeasureType tmpMeasure = 1e10;
 
+    scalingfactor = tmpfactor;
     while( tmpfactor <=  this->m_NormalizationFactor * 1.0 )
     {
-      measure    = this->ComputePIDiff( parameters, tmpfactor );
+      measure    = this->ComputePIDiff( tmpfactor );
       tmpMeasure = ( measure - this->m_FixedMeasure ) / -this->m_Rescalingfactor;
 
       if( tmpMeasure < currentMeasure )
       {
         currentMeasure = tmpMeasure;
-        //bestfactor = tmpfactor;
+        scalingfactor  = tmpfactor;
       }
 
       tmpfactor += factorstep;
@@ -390,12 +584,28 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
   }
   else
   {
-    measure        = this->ComputePIDiff( parameters, this->m_NormalizationFactor );
+    scalingfactor  = this->m_NormalizationFactor;
+    measure        = this->ComputePIDiff( scalingfactor );
     currentMeasure = -( measure - this->m_FixedMeasure ) / this->m_Rescalingfactor;
   }
 
   return currentMeasure;
 
+} // end ComputeValue()
+
+
+/**
+ * ********************* GetValue ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+typename PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >::MeasureType
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::GetValue( const TransformParametersType & parameters ) const
+{
+  double scalingfactor = this->m_NormalizationFactor;
+  return this->ComputeValue( parameters, scalingfactor );
+
 } // end GetValue()
 
 
@@ -409,20 +619,13 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
 ::GetDerivative( const TransformParametersType & parameters,
   DerivativeType & derivative ) const
 {
-  TransformParametersType testPoint;
-  testPoint = parameters;
-  const unsigned int numberOfParameters = this->GetNumberOfParameters();
-  derivative = DerivativeType( numberOfParameters );
-
-  for( unsigned int i = 0; i < numberOfParameters; i++ )
-  {
-    testPoint[ i ] -= this->m_DerivativeDelta / std::sqrt( this->m_Scales[ i ] );
-    const MeasureType valuep0 = this->GetValue( testPoint );
-    testPoint[ i ] += 2 * this->m_DerivativeDelta / std::sqrt( this->m_Scales[ i ] );
-    const MeasureType valuep1 = this->GetValue( testPoint );
-    derivative[ i ] = ( valuep1 - valuep0 ) / ( 2 * this->m_DerivativeDelta / std::sqrt( this->m_Scales[ i ] ) );
-    testPoint[ i ]  = parameters[ i ];
-  }
+  /** When the derivative is calculated, all information for calculating
+   * the metric value is available. It does not cost anything to calculate
+   * the metric value now. Therefore, we have chosen to only implement the
+   * GetValueAndDerivative(), supplying it with a dummy value variable.
+   */
+  MeasureType dummyvalue = NumericTraits< MeasureType >::Zero;
+  this->GetValueAndDerivative( parameters, dummyvalue, derivative );
 
 } // end GetDerivative()
 
@@ -437,12 +640,180 @@ PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
 ::GetValueAndDerivative( const TransformParametersType & parameters,
   MeasureType & Value, DerivativeType & derivative ) const
 {
-  Value = this->GetValue( parameters );
-  this->GetDerivative( parameters, derivative );
+  /** Compute the value and the projections. */
+  double scalingfactor = this->m_NormalizationFactor;
+  Value = this->ComputeValue( parameters, scalingfactor );
+
+  const unsigned int numberOfParameters = this->GetNumberOfParameters();
+  derivative = DerivativeType( numberOfParameters );
+  derivative.Fill( NumericTraits< typename DerivativeType::ValueType >::Zero );
+
+  /** The difference image does not depend on the parameters when the
+   * projection is not used.
+   */
+  if( scalingfactor == 0.0 )
+  {
+    return;
+  }
+  this->m_CurrentScalingFactor = scalingfactor;
+
+  /** The derivative buffer contains the same pixels as the projections. */
+  ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
+  this->m_ProjectionDerivativeBuffer->Update( sampleContainer );
+
+  /** The parameters are handled one by one, since the transform of the ray
+   * caster cannot be changed by the threads. For each parameter the
+   * derivatives of the projections are computed by central differences,
+   * and multiplied with the derivative of the pattern intensity to the
+   * projections.
+   */
+  TransformParametersType testPoint = parameters;
+  for( unsigned int mu = 0; mu < numberOfParameters; ++mu )
+  {
+    double scale = 1.0;
+    if( this->m_Scales.Size() == numberOfParameters )
+    {
+      scale = this->m_Scales[ mu ];
+    }
+    this->m_CurrentDerivativeDelta = this->m_DerivativeDelta / std::sqrt( scale );
+    this->m_CurrentParameter       = mu;
+
+    testPoint[ mu ] = parameters[ mu ] + this->m_CurrentDerivativeDelta;
+    this->SetTransformParameters( testPoint );
+    this->ComputeProjections( ForwardProjection );
+
+    testPoint[ mu ] = parameters[ mu ] - this->m_CurrentDerivativeDelta;
+    this->SetTransformParameters( testPoint );
+    this->ComputeProjections( CentralDifference );
+
+    testPoint[ mu ] = parameters[ mu ];
+
+    if( !this->m_UseMultiThread )
+    {
+      this->ThreadedGetValueAndDerivativeOnSampleRange( 0, 0, sampleContainer->Size() );
+    }
+    else
+    {
+      this->LaunchGetValueAndDerivativeThreaderCallback();
+    }
+    this->AfterThreadedGetValueAndDerivative( Value, derivative );
+  }
+
+  /** Restore the transform parameters. */
+  this->SetTransformParameters( parameters );
 
 } // end GetValueAndDerivative()
 
 
+/**
+ * ********************* ThreadedGetValueAndDerivative ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValueAndDerivative( ThreadIdType threadId )
+{
+  /** Get the size of the sample container. */
+  const SizeValueType sampleContainerSize = this->GetImageSampler()->GetOutput()->Size();
+
+  /** Get the samples for this thread. */
+  const SizeValueType nrOfSamplesPerThreads
+    = static_cast< SizeValueType >( std::ceil( static_cast< double >( sampleContainerSize )
+    / static_cast< double >( Self::GetNumberOfThreads() ) ) );
+
+  SizeValueType pos_begin = nrOfSamplesPerThreads * threadId;
+  SizeValueType pos_end   = nrOfSamplesPerThreads * ( threadId + 1 );
+  pos_begin = ( pos_begin > sampleContainerSize ) ? sampleContainerSize : pos_begin;
+  pos_end   = ( pos_end > sampleContainerSize ) ? sampleContainerSize : pos_end;
+
+  this->ThreadedGetValueAndDerivativeOnSampleRange( threadId, pos_begin, pos_end );
+
+} // end ThreadedGetValueAndDerivative()
+
+
+/**
+ * ********************* ThreadedGetValueAndDerivativeOnSampleRange ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::ThreadedGetValueAndDerivativeOnSampleRange( ThreadIdType threadId,
+  SizeValueType pos_begin, SizeValueType pos_end )
+{
+  const SizeValueType neighborhoodSize = this->m_NeighborhoodOffsets.size();
+  const RealType      scalingfactor    = this->m_CurrentScalingFactor;
+  const RealType      noiseConstant    = this->m_NoiseConstant;
+
+  /** Create variables to store intermediate results. circumvent false sharing */
+  AccumulateType derivative = NumericTraits< AccumulateType >::Zero;
+
+  /** Loop over the samples. */
+  for( SizeValueType s = pos_begin; s < pos_end; ++s )
+  {
+    const FixedImageIndexType & index = this->m_SampleNeighborhoodBuffer->GetSampleIndex( s );
+    if( !this->IsValidSample( index ) )
+    {
+      continue;
+    }
+
+    /** The difference image and the derivative of the projection at the
+     * sample and its neighbors. The derivative of
+     * sigma^2 / ( sigma^2 + diff^2 ) to diff is
+     * -2 sigma^2 diff / ( sigma^2 + diff^2 )^2.
+     */
+    const RealType difference = this->m_FixedImage->GetPixel( index )
+      - scalingfactor * this->m_SampleNeighborhoodBuffer->GetValue( index );
+    const RealType projectionDerivative = this->m_ProjectionDerivativeBuffer->GetValue( index );
+    for( SizeValueType i = 0; i < neighborhoodSize; ++i )
+    {
+      const FixedImageIndexType neighbor = index + this->m_NeighborhoodOffsets[ i ];
+      const RealType            diff     = difference - ( this->m_FixedImage->GetPixel( neighbor )
+        - scalingfactor * this->m_SampleNeighborhoodBuffer->GetValue( neighbor ) );
+      const RealType denominator = noiseConstant + diff * diff;
+
+      derivative += -2.0 * noiseConstant * diff / ( denominator * denominator )
+        * ( projectionDerivative - this->m_ProjectionDerivativeBuffer->GetValue( neighbor ) );
+    }
+  }
+
+  /** Only update these variables at the end to prevent unnecessary "false sharing".
+   * A thread may process several sample ranges, so add to them. */
+  this->m_PatternIntensityGetValuePerThreadVariables[ threadId ].st_Derivative += derivative;
+
+} // end ThreadedGetValueAndDerivativeOnSampleRange()
+
+
+/**
+ * ********************* AfterThreadedGetValueAndDerivative ******************************
+ */
+
+template< class TFixedImage, class TMovingImage >
+void
+PatternIntensityImageToImageMetric< TFixedImage, TMovingImage >
+::AfterThreadedGetValueAndDerivative(
+  MeasureType & itkNotUsed( value ), DerivativeType & derivative ) const
+{
+  const ThreadIdType numberOfThreads = Self::GetNumberOfThreads();
+
+  /** Accumulate the derivatives of the threads, and reset them. */
+  AccumulateType sum = NumericTraits< AccumulateType >::Zero;
+  for( ThreadIdType i = 0; i < numberOfThreads; ++i )
+  {
+    sum += this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_Derivative;
+    this->m_PatternIntensityGetValuePerThreadVariables[ i ].st_Derivative = NumericTraits< AccumulateType >::Zero;
+  }
+
+  /** The difference image is F - scalingfactor * M, and the measure is
+   * negated and rescaled.
+   */
+  derivative[ this->m_CurrentParameter ]
+    = this->m_CurrentScalingFactor * sum / this->m_Rescalingfactor;
+
+} // end AfterThreadedGetValueAndDerivative()
+
+
 } // end namespace itk
 
 #endif // end __itkPatternIntensityImageToImageMetric_hxx
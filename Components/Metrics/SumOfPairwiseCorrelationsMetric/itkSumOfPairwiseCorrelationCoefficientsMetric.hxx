@@ -157,7 +157,10 @@ SumOfPairwiseCorrelationCoefficientsMetric< TFixedImage, TMovingImage >
   MeasureType measure = NumericTraits< MeasureType >::Zero;
 
   /** Update the imageSampler and get a handle to the sample container. */
-  this->GetImageSampler()->Update();
+  if( this->GetUpdateImageSampler() )
+  {
+    this->GetImageSampler()->Update();
+  }
   ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
 
   /** Create iterator over the sample container. */
@@ -336,7 +339,10 @@ SumOfPairwiseCorrelationCoefficientsMetric< TFixedImage, TMovingImage >
   this->SetTransformParameters( parameters );
 
   /** Update the imageSampler and get a handle to the sample container. */
-  this->GetImageSampler()->Update();
+  if( this->GetUpdateImageSampler() )
+  {
+    this->GetImageSampler()->Update();
+  }
   ImageSampleContainerPointer sampleContainer = this->GetImageSampler()->GetOutput();
 
   /** Create iterator over the sample container. */
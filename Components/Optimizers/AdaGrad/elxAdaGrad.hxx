@@ -323,6 +323,13 @@ AdaGrad< TElastix >
     xl::xout[ "iteration" ][ "4b:||SearchDirection||" ] << this->GetSearchDirection().magnitude();
   }
 
+  /** Stop if the convergence monitor decided that the optimization has converged. */
+  if( this->UpdateConvergenceMonitor( this->GetValue(), this->GetGradient().magnitude() ) )
+  {
+    this->m_StopCondition = ConvergenceCriterion;
+    this->StopOptimization();
+  }
+
   /** Select new spatial samples for the computation of the metric. */
   if( this->GetNewSamplesEveryIteration() )
   {
@@ -349,7 +356,8 @@ AdaGrad< TElastix >
    * typedef enum {
    *   MaximumNumberOfIterations,
    *   MetricError,
-   *   MinimumStepSize } StopConditionType;
+   *   MinimumStepSize,
+   *   ConvergenceCriterion } StopConditionType;
    */
   std::string stopcondition;
 
@@ -367,6 +375,10 @@ AdaGrad< TElastix >
       stopcondition = "The minimum step length has been reached";
       break;
 
+    case ConvergenceCriterion:
+      stopcondition = "The convergence monitor detected convergence";
+      break;
+
     default:
       stopcondition = "Unknown";
       break;
@@ -182,6 +182,13 @@ namespace elastix
  *   The parameter can be specified for each resolution, or for all resolutions at once.\n
  *   example: <tt>(NoiseCompensation "true")</tt>\n
  *   Default/recommended: true.
+ * \parameter AutomaticParameterEstimationCacheFileName: The name of a text file in which
+ *   the automatically estimated parameters are stored, so that a next run with the same
+ *   fixed image geometry, transform grid and estimation settings reads them instead of
+ *   estimating them again. The image intensities are not part of the key, so only share
+ *   the file between runs of similar images. The file is created if it does not exist.\n
+ *   example: <tt>(AutomaticParameterEstimationCacheFileName "asgd_cache.txt")</tt>\n
+ *   Default: "", which means that no cache is used.
  *
  * \todo: this class contains a lot of functional code, which actually does not belong here.
  *
@@ -381,6 +388,23 @@ protected:
    */
   virtual void AutomaticParameterEstimationUsingDisplacementDistribution( void );
 
+  /** Compute the key of the automatic parameter estimation in the cache file:
+   * a hash of the estimation method, the resolution, the geometry of the fixed
+   * image, the transform and its fixed parameters (e.g. the B-spline grid),
+   * and the settings that influence the estimation.
+   */
+  virtual std::string ComputeParameterEstimationCacheKey( const std::string & method );
+
+  /** Read the parameters of the given key from the cache file, and set them.
+   * Returns false if the file does not exist or does not contain the key.
+   */
+  virtual bool ReadParameterEstimationCache( const std::string & fileName,
+    const std::string & key, const std::string & method );
+
+  /** Append the current parameters to the cache file. */
+  virtual void WriteParameterEstimationCache( const std::string & fileName,
+    const std::string & key ) const;
+
   /** Measure some derivatives, exact and approximated. Returns
    * the squared magnitude of the gradient and approximation error.
    * Needed for the automatic parameter estimation.
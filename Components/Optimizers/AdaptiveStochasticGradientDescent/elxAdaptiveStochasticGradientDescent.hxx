@@ -21,6 +21,7 @@
 #include "elxAdaptiveStochasticGradientDescent.h"
 
 #include <iomanip>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -298,6 +299,13 @@ AdaptiveStochasticGradientDescent< TElastix >
     xl::xout[ "iteration" ][ "4:||Gradient||" ] << this->GetGradient().magnitude();
   }
 
+  /** Stop if the convergence monitor decided that the optimization has converged. */
+  if( this->UpdateConvergenceMonitor( this->GetValue(), this->GetGradient().magnitude() ) )
+  {
+    this->m_StopCondition = ConvergenceCriterion;
+    this->StopOptimization();
+  }
+
   /** Select new spatial samples for the computation of the metric. */
   if( this->GetNewSamplesEveryIteration() )
   {
@@ -324,7 +332,8 @@ AdaptiveStochasticGradientDescent< TElastix >
    * typedef enum {
    *   MaximumNumberOfIterations,
    *   MetricError,
-   *   MinimumStepSize } StopConditionType;
+   *   MinimumStepSize,
+   *   ConvergenceCriterion } StopConditionType;
    */
   std::string stopcondition;
 
@@ -342,6 +351,10 @@ AdaptiveStochasticGradientDescent< TElastix >
       stopcondition = "The minimum step length has been reached";
       break;
 
+    case ConvergenceCriterion:
+      stopcondition = "The convergence monitor detected convergence";
+      break;
+
     default:
       stopcondition = "Unknown";
       break;
@@ -506,6 +519,23 @@ AdaptiveStochasticGradientDescent< TElastix >
   this->GetConfiguration()->ReadParameter( asgdParameterEstimationMethod,
     "ASGDParameterEstimationMethod", this->GetComponentLabel(), 0, 0 );
 
+  /** Use the parameters of a previous run with the same settings, if desired. */
+  std::string cacheFileName = "";
+  this->GetConfiguration()->ReadParameter( cacheFileName,
+    "AutomaticParameterEstimationCacheFileName", this->GetComponentLabel(), 0, -1, false );
+  std::string cacheKey = "";
+  if( cacheFileName != "" )
+  {
+    cacheKey = this->ComputeParameterEstimationCacheKey( asgdParameterEstimationMethod );
+    if( this->ReadParameterEstimationCache( cacheFileName, cacheKey, asgdParameterEstimationMethod ) )
+    {
+      timer1.Stop();
+      elxout << "  Read the parameters from the cache file \""
+             << cacheFileName << "\" (key " << cacheKey << ")." << std::endl;
+      return;
+    }
+  }
+
   /** Perform automatic optimizer parameter estimation by the desired method. */
   if( asgdParameterEstimationMethod == "Original" )
   {
@@ -525,6 +555,12 @@ AdaptiveStochasticGradientDescent< TElastix >
     this->AutomaticParameterEstimationUsingDisplacementDistribution();
   }
 
+  /** Store the estimated parameters for a next run. */
+  if( cacheFileName != "" )
+  {
+    this->WriteParameterEstimationCache( cacheFileName, cacheKey );
+  }
+
   /** Print the elapsed time. */
   timer1.Stop();
   elxout << "Automatic parameter estimation took "
@@ -808,6 +844,169 @@ AdaptiveStochasticGradientDescent< TElastix >
 } // end AutomaticParameterEstimationUsingDisplacementDistribution()
 
 
+/**
+ * *************** ComputeParameterEstimationCacheKey *****
+ */
+
+template< class TElastix >
+std::string
+AdaptiveStochasticGradientDescent< TElastix >
+::ComputeParameterEstimationCacheKey( const std::string & method )
+{
+  /** Cast to advanced metric type. */
+  typedef typename ElastixType::MetricBaseType::AdvancedMetricType MetricType;
+  MetricType * testPtr = dynamic_cast< MetricType * >(
+    this->GetElastix()->GetElxMetricBase()->GetAsITKBaseType() );
+  if( !testPtr )
+  {
+    itkExceptionMacro( << "ERROR: AdaptiveStochasticGradientDescent expects "
+                       << "the metric to be of type AdvancedImageToImageMetric!" );
+  }
+
+  /** Write everything that determines the estimated parameters to a string.
+   * The image intensities are left out, to keep the key cheap to compute.
+   */
+  std::ostringstream signature;
+  signature << std::setprecision( 10 );
+  signature << method << ' '
+            << this->m_Registration->GetAsITKBaseType()->GetCurrentLevel() << ' '
+            << testPtr->GetNameOfClass() << ' ';
+
+  const typename MetricType::FixedImageType * fixedImage = testPtr->GetFixedImage();
+  signature << fixedImage->GetLargestPossibleRegion().GetSize() << ' '
+            << fixedImage->GetSpacing() << ' '
+            << fixedImage->GetOrigin() << ' '
+            << fixedImage->GetDirection() << ' '
+            << testPtr->GetFixedImageRegion().GetIndex() << ' '
+            << testPtr->GetFixedImageRegion().GetSize() << ' '
+            << ( testPtr->GetFixedImageMask() != 0 ) << ' ';
+  if( testPtr->GetImageSampler() != 0 )
+  {
+    signature << testPtr->GetImageSampler()->GetNameOfClass() << ' '
+              << testPtr->GetImageSampler()->GetNumberOfSamples() << ' ';
+  }
+
+  const TransformType * transform
+    = this->GetRegistration()->GetAsITKBaseType()->GetModifiableTransform();
+  signature << transform->GetNameOfClass() << ' '
+            << transform->GetNumberOfParameters() << ' '
+            << transform->GetFixedParameters() << ' ';
+
+  signature << this->GetMaximumStepLength() << ' '
+            << this->GetParam_A() << ' '
+            << this->m_NumberOfJacobianMeasurements << ' '
+            << this->m_NumberOfGradientMeasurements << ' '
+            << this->m_NumberOfSamplesForExactGradient << ' '
+            << this->m_SigmoidScaleFactor << ' '
+            << this->GetUseScales();
+  if( this->GetUseScales() )
+  {
+    signature << ' ' << this->m_ScaledCostFunction->GetScales();
+  }
+
+  /** Hash the string with the 64-bit FNV-1a hash. */
+  const std::string  text = signature.str();
+  unsigned long long hash = 14695981039346656037ULL;
+  for( std::string::size_type i = 0; i < text.size(); ++i )
+  {
+    hash ^= static_cast< unsigned char >( text[ i ] );
+    hash *= 1099511628211ULL;
+  }
+
+  std::ostringstream key;
+  key << std::hex << std::setw( 16 ) << std::setfill( '0' ) << hash;
+  return key.str();
+
+} // end ComputeParameterEstimationCacheKey()
+
+
+/**
+ * *************** ReadParameterEstimationCache *****
+ */
+
+template< class TElastix >
+bool
+AdaptiveStochasticGradientDescent< TElastix >
+::ReadParameterEstimationCache( const std::string & fileName,
+  const std::string & key, const std::string & method )
+{
+  std::ifstream cacheFile( fileName.c_str() );
+  if( !cacheFile.is_open() )
+  {
+    return false;
+  }
+
+  /** Each line holds a key, a, alpha, SigmoidMax, SigmoidMin and SigmoidScale.
+   * If a key occurs multiple times, the last line is used.
+   */
+  bool        found = false;
+  double      a = 0.0, alpha = 0.0, fmax = 0.0, fmin = 0.0, omega = 0.0;
+  std::string line;
+  while( std::getline( cacheFile, line ) )
+  {
+    std::istringstream lineStream( line );
+    std::string        lineKey;
+    double             values[ 5 ];
+    if( !( lineStream >> lineKey >> values[ 0 ] >> values[ 1 ]
+           >> values[ 2 ] >> values[ 3 ] >> values[ 4 ] ) )
+    {
+      continue;
+    }
+    if( lineKey == key )
+    {
+      a     = values[ 0 ]; alpha = values[ 1 ];
+      fmax  = values[ 2 ]; fmin  = values[ 3 ]; omega = values[ 4 ];
+      found = true;
+    }
+  }
+  if( !found )
+  {
+    return false;
+  }
+
+  /** Set the parameters, as the estimation method would have done. */
+  this->SetParam_a( a );
+  this->SetParam_alpha( alpha );
+  if( method == "Original" )
+  {
+    this->SetSigmoidMax( fmax );
+    this->SetSigmoidMin( fmin );
+    this->SetSigmoidScale( omega );
+  }
+
+  return true;
+
+} // end ReadParameterEstimationCache()
+
+
+/**
+ * *************** WriteParameterEstimationCache *****
+ */
+
+template< class TElastix >
+void
+AdaptiveStochasticGradientDescent< TElastix >
+::WriteParameterEstimationCache( const std::string & fileName,
+  const std::string & key ) const
+{
+  std::ofstream cacheFile( fileName.c_str(), std::ios::out | std::ios::app );
+  if( !cacheFile.is_open() )
+  {
+    xl::xout[ "warning" ] << "WARNING: the automatic parameter estimation cache file \""
+                          << fileName << "\" could not be opened for writing." << std::endl;
+    return;
+  }
+
+  cacheFile << std::setprecision( 17 ) << key << ' '
+            << this->GetParam_a() << ' '
+            << this->GetParam_alpha() << ' '
+            << this->GetSigmoidMax() << ' '
+            << this->GetSigmoidMin() << ' '
+            << this->GetSigmoidScale() << std::endl;
+
+} // end WriteParameterEstimationCache()
+
+
 /**
  * ******************** SampleGradients **********************
  */
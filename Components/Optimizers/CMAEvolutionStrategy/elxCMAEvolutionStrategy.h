@@ -35,6 +35,9 @@ namespace elastix
  * the offspring generation). The theory doesn't say anything about such a
  * situation, so, think twice before using the NewSamplesEveryIteration option.
  *
+ * The offspring are evaluated concurrently, with a copy of the metric for
+ * every thread, see the UseConcurrentEvaluation parameter of the OptimizerBase.
+ *
  * The parameters used in this class are:
  * \parameter Optimizer: Select this optimizer as follows:\n
  *    <tt>(Optimizer "CMAEvolutionStrategy")</tt>
@@ -106,7 +109,18 @@ namespace elastix
  *    covariance matrix is updated. If 0, the optimizer estimates a value. The actual value used is
  *    reported back in the elastix.log file. This parameter can be specified for each resolution. \n
  *    example: <tt>(UpdateBDPeriod 0 0 50)</tt> \n
- *    Default: 0 (so, automatically determined).
+ *    Default: 0 (so, automatically determined).\n
+ * \parameter MaximumNumberOfRestarts: the maximum number of times the optimization is restarted
+ *    from the initial position with a larger population, after it stopped because of the
+ *    PositionToleranceMin or the ValueTolerance. The MaximumNumberOfIterations counts the
+ *    iterations of all runs together, and the best position of all runs is the result.
+ *    Restarts help to escape from local optima, for example in a rigid initialization.\n
+ *    example: <tt>(MaximumNumberOfRestarts 0 3 0)</tt> \n
+ *    Default: 0. Can be specified for each resolution.\n
+ * \parameter PopulationSizeIncreaseFactor: the factor by which the PopulationSize is multiplied
+ *    at each restart. The NumberOfParents is then automatically determined.\n
+ *    example: <tt>(PopulationSizeIncreaseFactor 2.0)</tt> \n
+ *    Default: 2.0. Can be specified for each resolution.
  *
  * \ingroup Optimizers
  */
@@ -140,12 +154,13 @@ public:
   elxClassNameMacro( "CMAEvolutionStrategy" );
 
   /** Typedef's inherited from Superclass1.*/
-  typedef Superclass1::CostFunctionType    CostFunctionType;
-  typedef Superclass1::CostFunctionPointer CostFunctionPointer;
-  typedef Superclass1::StopConditionType   StopConditionType;
-  typedef Superclass1::ParametersType      ParametersType;
-  typedef Superclass1::DerivativeType      DerivativeType;
-  typedef Superclass1::ScalesType          ScalesType;
+  typedef Superclass1::CostFunctionType          CostFunctionType;
+  typedef Superclass1::CostFunctionPointer       CostFunctionPointer;
+  typedef Superclass1::CostFunctionContainerType CostFunctionContainerType;
+  typedef Superclass1::StopConditionType         StopConditionType;
+  typedef Superclass1::ParametersType            ParametersType;
+  typedef Superclass1::DerivativeType            DerivativeType;
+  typedef Superclass1::ScalesType                ScalesType;
 
   /** Typedef's inherited from Elastix.*/
   typedef typename Superclass2::ElastixType          ElastixType;
@@ -157,7 +172,8 @@ public:
   typedef typename Superclass2::ITKBaseType          ITKBaseType;
 
   /** Check if any scales are set, and set the UseScales flag on or off;
-   * after that call the superclass' implementation */
+   * create the copies of the metric for the concurrent evaluation of the
+   * offspring; after that call the superclass' implementation */
   virtual void StartOptimization( void );
 
   /** Methods to set parameters and print output at different stages
@@ -49,6 +49,11 @@ CMAEvolutionStrategy< TElastix >::StartOptimization( void )
     }
   }
 
+  /** Create the copies of the metric that evaluate the offspring concurrently. */
+  CostFunctionContainerType parallelCostFunctions;
+  this->CreateConcurrentCostFunctions( parallelCostFunctions );
+  this->SetParallelCostFunctions( parallelCostFunctions );
+
   /** Call the superclass */
   this->Superclass1::StartOptimization();
 
@@ -208,6 +213,18 @@ CMAEvolutionStrategy< TElastix >
     "MinimumDeviation", this->GetComponentLabel(), level, 0 );
   this->SetMinimumDeviation( minimumDeviation );
 
+  /** Set MaximumNumberOfRestarts */
+  unsigned int maximumNumberOfRestarts = 0;
+  this->m_Configuration->ReadParameter( maximumNumberOfRestarts,
+    "MaximumNumberOfRestarts", this->GetComponentLabel(), level, 0 );
+  this->SetMaximumNumberOfRestarts( maximumNumberOfRestarts );
+
+  /** Set PopulationSizeIncreaseFactor */
+  double populationSizeIncreaseFactor = 2.0;
+  this->m_Configuration->ReadParameter( populationSizeIncreaseFactor,
+    "PopulationSizeIncreaseFactor", this->GetComponentLabel(), level, 0 );
+  this->SetPopulationSizeIncreaseFactor( populationSizeIncreaseFactor );
+
 } // end BeforeEachResolution
 
 
@@ -235,6 +252,12 @@ CMAEvolutionStrategy< TElastix >
   if( this->GetNewSamplesEveryIteration() )
   {
     this->SelectNewSamples();
+
+    /** The copies of the metric do not update the samples themselves. */
+    if( !this->GetParallelCostFunctions().empty() )
+    {
+      this->UpdateImageSamplers();
+    }
   }
 
 } // end AfterEachIteration
@@ -292,8 +315,15 @@ CMAEvolutionStrategy< TElastix >
       break;
   }
 
+  /** Release the copies of the metric. */
+  this->SetParallelCostFunctions( CostFunctionContainerType() );
+
   /** Print the stopping condition */
   elxout << "Stopping condition: " << stopcondition << "." << std::endl;
+  if( this->GetCurrentNumberOfRestarts() > 0 )
+  {
+    elxout << "Number of restarts: " << this->GetCurrentNumberOfRestarts() << std::endl;
+  }
 
 } // end AfterEachResolution
 
@@ -46,6 +46,10 @@ CMAEvolutionStrategyOptimizer::CMAEvolutionStrategyOptimizer()
   this->m_StopCondition    = Unknown;
   this->m_Stop             = false;
 
+  this->m_CurrentNumberOfRestarts = 0;
+  this->m_RunStartIteration       = 0;
+  this->m_BestValue               = NumericTraits< MeasureType >::Zero;
+
   this->m_UseCovarianceMatrixAdaptation = true;
   this->m_PopulationSize                = 0;
   this->m_NumberOfParents               = 0;
@@ -65,17 +69,25 @@ CMAEvolutionStrategyOptimizer::CMAEvolutionStrategyOptimizer()
   this->m_CurrentSigma = 0.0;
   this->m_Heaviside    = false;
 
-  this->m_MaximumNumberOfIterations  = 100;
-  this->m_UseDecayingSigma           = false;
-  this->m_InitialSigma               = 1.0;
-  this->m_SigmaDecayA                = 50;
-  this->m_SigmaDecayAlpha            = 0.602;
-  this->m_RecombinationWeightsPreset = "superlinear";
-  this->m_MaximumDeviation           = NumericTraits< double >::max();
-  this->m_MinimumDeviation           = 0.0;
-  this->m_PositionToleranceMin       = 1e-12;
-  this->m_PositionToleranceMax       = 1e8;
-  this->m_ValueTolerance             = 1e-12;
+  this->m_MaximumNumberOfIterations    = 100;
+  this->m_UseDecayingSigma             = false;
+  this->m_InitialSigma                 = 1.0;
+  this->m_SigmaDecayA                  = 50;
+  this->m_SigmaDecayAlpha              = 0.602;
+  this->m_RecombinationWeightsPreset   = "superlinear";
+  this->m_MaximumDeviation             = NumericTraits< double >::max();
+  this->m_MinimumDeviation             = 0.0;
+  this->m_PositionToleranceMin         = 1e-12;
+  this->m_PositionToleranceMax         = 1e8;
+  this->m_ValueTolerance               = 1e-12;
+  this->m_MaximumNumberOfRestarts      = 0;
+  this->m_PopulationSizeIncreaseFactor = 2.0;
+
+  this->m_Threader = ThreaderType::New();
+#if ITK_VERSION_MAJOR < 5
+  this->m_Threader->SetUseThreadPool( false );
+#endif
+  this->m_ThreaderParameters.st_Self = this;
 
 } // end constructor
 
@@ -94,6 +106,9 @@ CMAEvolutionStrategyOptimizer::PrintSelf( std::ostream & os, Indent indent ) con
   os << indent << "m_CurrentIteration: " << this->m_CurrentIteration << std::endl;
   os << indent << "m_StopCondition: " << this->m_StopCondition << std::endl;
   os << indent << "m_Stop: " << this->m_Stop << std::endl;
+  os << indent << "m_CurrentNumberOfRestarts: " << this->m_CurrentNumberOfRestarts << std::endl;
+  os << indent << "m_RunStartIteration: " << this->m_RunStartIteration << std::endl;
+  os << indent << "m_BestValue: " << this->m_BestValue << std::endl;
 
   os << indent << "m_UseCovarianceMatrixAdaptation: " << this->m_UseCovarianceMatrixAdaptation << std::endl;
   os << indent << "m_PopulationSize: " << this->m_PopulationSize << std::endl;
@@ -125,6 +140,9 @@ CMAEvolutionStrategyOptimizer::PrintSelf( std::ostream & os, Indent indent ) con
   os << indent << "m_PositionToleranceMin: " << this->m_PositionToleranceMin << std::endl;
   os << indent << "m_PositionToleranceMax: " << this->m_PositionToleranceMax << std::endl;
   os << indent << "m_ValueTolerance: " << this->m_ValueTolerance << std::endl;
+  os << indent << "m_MaximumNumberOfRestarts: " << this->m_MaximumNumberOfRestarts << std::endl;
+  os << indent << "m_PopulationSizeIncreaseFactor: " << this->m_PopulationSizeIncreaseFactor << std::endl;
+  os << indent << "m_ParallelCostFunctions: " << this->m_ParallelCostFunctions.size() << " cost functions" << std::endl;
 
   os << indent << "m_RecombinationWeights: " << this->m_RecombinationWeights << std::endl;
   os << indent << "m_C: " << this->m_C << std::endl;
@@ -152,6 +170,10 @@ CMAEvolutionStrategyOptimizer::StartOptimization()
   this->m_Stop             = false;
   this->m_StopCondition    = Unknown;
 
+  this->m_CurrentNumberOfRestarts = 0;
+  this->m_RunStartIteration       = 0;
+  this->m_BestScaledPosition.SetSize( 0 );
+
   /** Get the number of parameters; checks also if a cost function has been set at all.
   * if not: an exception is thrown */
   this->GetScaledCostFunction()->GetNumberOfParameters();
@@ -159,6 +181,18 @@ CMAEvolutionStrategyOptimizer::StartOptimization()
   /** Initialize the scaledCostFunction with the currently set scales */
   this->InitializeScales();
 
+  /** Let the parallel cost functions use the same scales */
+  this->m_ParallelScaledCostFunctions.clear();
+  for( unsigned int i = 0; i < this->m_ParallelCostFunctions.size(); ++i )
+  {
+    ScaledCostFunctionPointer scaledCostFunction = ScaledCostFunctionType::New();
+    scaledCostFunction->SetUnscaledCostFunction( this->m_ParallelCostFunctions[ i ] );
+    scaledCostFunction->SetUseScales( this->GetUseScales() );
+    scaledCostFunction->SetSquaredScales( this->GetScales() );
+    scaledCostFunction->SetNegateCostFunction( this->GetMaximize() );
+    this->m_ParallelScaledCostFunctions.push_back( scaledCostFunction );
+  }
+
   /** Set the current position as the scaled initial position */
   this->SetCurrentPosition( this->GetInitialPosition() );
 
@@ -248,9 +282,10 @@ CMAEvolutionStrategyOptimizer::ResumeOptimization()
     this->UpdateBD();
     this->FixNumericalErrors();
 
-    /** Test if convergence has occured in some sense */
+    /** Test if convergence has occured in some sense, and if so,
+     * possibly restart with a larger population */
     convergence = this->TestConvergence( false );
-    if( convergence )
+    if( convergence && !this->RestartOptimization() )
     {
       this->StopOptimization();
       break;
@@ -261,6 +296,14 @@ CMAEvolutionStrategyOptimizer::ResumeOptimization()
 
   } // end while !m_Stop
 
+  /** End at the best position of all runs */
+  if( this->m_CurrentNumberOfRestarts > 0 )
+  {
+    this->UpdateBestPosition();
+    this->SetScaledCurrentPosition( this->m_BestScaledPosition );
+    this->m_CurrentValue = this->m_BestValue;
+  }
+
 } // end ResumeOptimization
 
 
@@ -277,6 +320,85 @@ CMAEvolutionStrategyOptimizer::StopOptimization()
 } // end StopOptimization()
 
 
+/**
+ * *********************** SetParallelCostFunctions *****************************
+ */
+
+void
+CMAEvolutionStrategyOptimizer::SetParallelCostFunctions( const CostFunctionContainerType & costFunctions )
+{
+  this->m_ParallelCostFunctions = costFunctions;
+  this->Modified();
+
+} // end SetParallelCostFunctions()
+
+
+/**
+ * *********************** RestartOptimization *****************************
+ */
+
+bool
+CMAEvolutionStrategyOptimizer::RestartOptimization( void )
+{
+  /** Only restart after stagnation, not if the budget of iterations is spent
+   * or the steps became too large. */
+  if( this->m_CurrentNumberOfRestarts >= this->m_MaximumNumberOfRestarts
+    || ( this->m_StopCondition != PositionToleranceMin
+    && this->m_StopCondition != ValueTolerance ) )
+  {
+    return false;
+  }
+
+  itkDebugMacro( "RestartOptimization" );
+
+  this->UpdateBestPosition();
+  ++( this->m_CurrentNumberOfRestarts );
+  this->m_RunStartIteration = this->m_CurrentIteration + 1;
+  this->m_StopCondition     = Unknown;
+
+  /** Increase the population size; the other constants follow from it */
+  this->m_PopulationSize = static_cast< unsigned int >( std::ceil(
+    this->m_PopulationSizeIncreaseFactor * this->m_PopulationSize ) );
+  this->m_NumberOfParents = 0;
+  this->InitializeConstants();
+  this->InitializeProgressVariables();
+  this->InitializeBCD();
+
+  /** Start again at the initial position */
+  this->SetCurrentPosition( this->GetInitialPosition() );
+  try
+  {
+    this->m_CurrentValue = this->GetScaledValue( this->GetScaledCurrentPosition() );
+  }
+  catch( ExceptionObject & err )
+  {
+    this->m_StopCondition = MetricError;
+    this->StopOptimization();
+    throw err;
+  }
+
+  return true;
+
+} // end RestartOptimization()
+
+
+/**
+ * *********************** UpdateBestPosition *****************************
+ */
+
+void
+CMAEvolutionStrategyOptimizer::UpdateBestPosition( void )
+{
+  if( this->m_BestScaledPosition.GetSize() == 0
+    || this->m_CurrentValue < this->m_BestValue )
+  {
+    this->m_BestScaledPosition = this->GetScaledCurrentPosition();
+    this->m_BestValue          = this->m_CurrentValue;
+  }
+
+} // end UpdateBestPosition()
+
+
 /**
  * ****************** InitializeConstants *********************
  */
@@ -501,39 +623,25 @@ CMAEvolutionStrategyOptimizer::GenerateOffspring( void )
 {
   itkDebugMacro( "GenerateOffspring" );
 
-  /** Get the number of parameters from the cost function */
-  const unsigned int numberOfParameters
-    = this->GetScaledCostFunction()->GetNumberOfParameters();
-
   /** Some casts/aliases: */
-  const unsigned int N      = numberOfParameters;
   const unsigned int lambda = this->m_PopulationSize;
 
   /** Clear the old values */
   this->m_CostFunctionValues.clear();
 
+  /** Evaluate the offspring concurrently, if possible */
+  if( this->m_ParallelScaledCostFunctions.size() > 1 )
+  {
+    this->EvaluateOffspringInParallel();
+    return;
+  }
+
   /** Fill the m_NormalizedSearchDirs and SearchDirs */
   unsigned int lam       = 0;
   unsigned int nrOfFails = 0;
   while( lam < lambda )
   {
-    /** draw from distribution N(0,I) */
-    for( unsigned int par = 0; par < N; ++par )
-    {
-      this->m_NormalizedSearchDirs[ lam ][ par ]
-        = this->m_RandomGenerator->GetNormalVariate();
-    }
-    /** Make like it was drawn from N(0,C) */
-    if( this->GetUseCovarianceMatrixAdaptation() )
-    {
-      this->m_SearchDirs[ lam ] = this->m_B * ( this->m_D * this->m_NormalizedSearchDirs[ lam ] );
-    }
-    else
-    {
-      this->m_SearchDirs[ lam ] = this->m_NormalizedSearchDirs[ lam ];
-    }
-    /** Make like it was drawn from N( 0, sigma^2 C ) */
-    this->m_SearchDirs[ lam ] *= this->m_CurrentSigma;
+    this->DrawSearchDirection( lam );
 
     /** Compute the cost function */
     MeasureType costFunctionValue = 0.0;
@@ -573,6 +681,152 @@ CMAEvolutionStrategyOptimizer::GenerateOffspring( void )
 } // end GenerateOffspring
 
 
+/**
+ * ****************** DrawSearchDirection *********************
+ */
+
+void
+CMAEvolutionStrategyOptimizer::DrawSearchDirection( unsigned int lam )
+{
+  /** Get the number of parameters from the cost function */
+  const unsigned int N = this->GetScaledCostFunction()->GetNumberOfParameters();
+
+  /** draw from distribution N(0,I) */
+  for( unsigned int par = 0; par < N; ++par )
+  {
+    this->m_NormalizedSearchDirs[ lam ][ par ]
+      = this->m_RandomGenerator->GetNormalVariate();
+  }
+  /** Make like it was drawn from N(0,C) */
+  if( this->GetUseCovarianceMatrixAdaptation() )
+  {
+    this->m_SearchDirs[ lam ] = this->m_B * ( this->m_D * this->m_NormalizedSearchDirs[ lam ] );
+  }
+  else
+  {
+    this->m_SearchDirs[ lam ] = this->m_NormalizedSearchDirs[ lam ];
+  }
+  /** Make like it was drawn from N( 0, sigma^2 C ) */
+  this->m_SearchDirs[ lam ] *= this->m_CurrentSigma;
+
+} // end DrawSearchDirection
+
+
+/**
+ * ****************** EvaluateOffspringInParallel *********************
+ */
+
+void
+CMAEvolutionStrategyOptimizer::EvaluateOffspringInParallel( void )
+{
+  itkDebugMacro( "EvaluateOffspringInParallel" );
+
+  /** Some casts/aliases: */
+  const unsigned int lambda = this->m_PopulationSize;
+
+  /** Draw all search directions first, in the same order as the
+   * sequential evaluation does. */
+  for( unsigned int lam = 0; lam < lambda; ++lam )
+  {
+    this->DrawSearchDirection( lam );
+  }
+
+  /** Evaluate the offspring concurrently, one thread per cost function. */
+  this->m_OffspringValues.assign( lambda, NumericTraits< MeasureType >::Zero );
+  this->m_OffspringEvaluated.assign( lambda, 0 );
+  const ThreadIdType numberOfThreads = static_cast< ThreadIdType >( std::min(
+    this->m_ParallelScaledCostFunctions.size(), static_cast< std::size_t >( lambda ) ) );
+  this->m_Threader->SetNumberOfThreads( numberOfThreads );
+  this->m_Threader->SetSingleMethod( EvaluateOffspringThreaderCallback,
+    static_cast< void * >( &this->m_ThreaderParameters ) );
+  this->m_Threader->SingleMethodExecute();
+
+  /** Offspring for which the cost function evaluation failed are
+   * redrawn and evaluated sequentially, like in GenerateOffspring(). */
+  for( unsigned int lam = 0; lam < lambda; ++lam )
+  {
+    unsigned int nrOfFails = 0;
+    while( !this->m_OffspringEvaluated[ lam ] )
+    {
+      this->DrawSearchDirection( lam );
+      ParametersType x_lam = this->GetScaledCurrentPosition();
+      x_lam += this->m_SearchDirs[ lam ];
+      try
+      {
+        this->m_OffspringValues[ lam ]    = this->GetScaledValue( x_lam );
+        this->m_OffspringEvaluated[ lam ] = 1;
+      }
+      catch( ExceptionObject & err )
+      {
+        ++nrOfFails;
+        if( nrOfFails > 10 )
+        {
+          this->m_StopCondition = MetricError;
+          this->StopOptimization();
+          throw err;
+        }
+      }
+    }
+
+    this->m_CostFunctionValues.push_back(
+      MeasureIndexPairType( this->m_OffspringValues[ lam ], lam ) );
+  }
+
+} // end EvaluateOffspringInParallel
+
+
+/**
+ * ****************** EvaluateOffspringThreaderCallback *********************
+ */
+
+ITK_THREAD_RETURN_TYPE
+CMAEvolutionStrategyOptimizer::EvaluateOffspringThreaderCallback( void * arg )
+{
+  /** Get the current thread id and user data. */
+  ThreadInfoType *             infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType                 threadID   = infoStruct->ThreadID;
+  MultiThreaderParameterType * temp
+    = static_cast< MultiThreaderParameterType * >( infoStruct->UserData );
+
+  /** Call the real implementation. */
+  temp->st_Self->ThreadedEvaluateOffspring( threadID );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end EvaluateOffspringThreaderCallback
+
+
+/**
+ * ****************** ThreadedEvaluateOffspring *********************
+ */
+
+void
+CMAEvolutionStrategyOptimizer::ThreadedEvaluateOffspring( ThreadIdType threadID )
+{
+  const unsigned int lambda          = this->m_PopulationSize;
+  const ThreadIdType numberOfThreads = this->m_Threader->GetNumberOfThreads();
+  const ScaledCostFunctionType * costFunction
+    = this->m_ParallelScaledCostFunctions[ threadID ].GetPointer();
+
+  for( unsigned int lam = threadID; lam < lambda; lam += numberOfThreads )
+  {
+    /** x_lam = m + d_lam */
+    ParametersType x_lam = this->GetScaledCurrentPosition();
+    x_lam += this->m_SearchDirs[ lam ];
+    try
+    {
+      this->m_OffspringValues[ lam ]    = costFunction->GetValue( x_lam );
+      this->m_OffspringEvaluated[ lam ] = 1;
+    }
+    catch( ExceptionObject & )
+    {
+      /** The offspring is redrawn by EvaluateOffspringInParallel(). */
+    }
+  }
+
+} // end ThreadedEvaluateOffspring
+
+
 /**
  * ****************** SortCostFunctionValues *********************
  */
@@ -685,7 +939,7 @@ CMAEvolutionStrategyOptimizer::UpdateHeaviside( void )
   const unsigned int N       = numberOfParameters;
   const double       Nd      = static_cast< double >( N );
   const double       c_sigma = this->m_ConjugateEvolutionPathConstant;
-  const int          nextit  = static_cast< int >( this->GetCurrentIteration() + 1 );
+  const int          nextit  = static_cast< int >( this->GetCurrentIteration() - this->m_RunStartIteration + 1 );
   const double       chiN    = this->m_ExpectationNormNormalDistribution;
 
   /** Compute the Heaviside function: */
@@ -805,7 +1059,7 @@ CMAEvolutionStrategyOptimizer::UpdateSigma( void )
 
   if( this->GetUseDecayingSigma() )
   {
-    const double it  = static_cast< double >( this->GetCurrentIteration() );
+    const double it  = static_cast< double >( this->GetCurrentIteration() - this->m_RunStartIteration );
     const double num = std::pow( this->m_SigmaDecayA + it, this->m_SigmaDecayAlpha );
     const double den = std::pow( this->m_SigmaDecayA + it + 1.0, this->m_SigmaDecayAlpha );
     this->m_CurrentSigma *= num / den;
@@ -837,7 +1091,7 @@ CMAEvolutionStrategyOptimizer::UpdateBD( void )
 
   /** Some casts/aliases: */
   const unsigned int N      = numberOfParameters;
-  const int          nextit = static_cast< int >( this->GetCurrentIteration() + 1 );
+  const int          nextit = static_cast< int >( this->GetCurrentIteration() - this->m_RunStartIteration + 1 );
 
   /** Update only every 'm_UpdateBDPeriod' iterations */
   unsigned int periodover = nextit % this->m_UpdateBDPeriod;
@@ -930,7 +1184,7 @@ CMAEvolutionStrategyOptimizer::FixNumericalErrors( void )
   const double       d_sigma         = this->m_SigmaDampingConstant;
   const double       strange_factor  = std::exp( 0.05 + c_sigma / d_sigma );
   const double       strange_factor2 = std::exp( 0.2 + c_sigma / d_sigma );
-  const unsigned int nextit          = this->m_CurrentIteration + 1;
+  const unsigned int nextit          = this->m_CurrentIteration - this->m_RunStartIteration + 1;
 
   /** Check if m_MaximumDeviation and m_MinimumDeviation are satisfied. This
    * check is different depending on the m_UseCovarianceMatrixAdaptation flag */
@@ -27,6 +27,7 @@
 #include "itkArray.h"
 #include "itkArray2D.h"
 #include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "itkMultiThreader.h"
 #include "vnl/vnl_diag_matrix.h"
 
 namespace itk
@@ -43,6 +44,20 @@ namespace itk
  *   - See also the Matlab code, cmaes.m, which you can download from the
  *     website mentioned above.
  *
+ * The offspring of a generation can be evaluated concurrently, if
+ * independent copies of the cost function are supplied by
+ * SetParallelCostFunctions(): each thread then evaluates its offspring with
+ * its own copy. A copy of an image registration metric needs its own
+ * transform, since evaluating the metric sets the transform parameters.
+ *
+ * Optionally, the optimization is restarted with a larger population when it
+ * stagnates (IPOP-CMA-ES, Auger and Hansen, "A Restart CMA Evolution Strategy
+ * With Increasing Population Size", CEC 2005). Each restart starts again at
+ * the initial position, with the initial sigma, and the population size
+ * multiplied by the PopulationSizeIncreaseFactor. The iterations of all runs
+ * count for the MaximumNumberOfIterations, and the optimization ends at the
+ * best position of all runs.
+ *
  * \ingroup Numerics Optimizers
  */
 
@@ -60,12 +75,16 @@ public:
   itkTypeMacro( CMAEvolutionStrategyOptimizer,
     ScaledSingleValuedNonLinearOptimizer );
 
-  typedef Superclass::ParametersType         ParametersType;
-  typedef Superclass::DerivativeType         DerivativeType;
-  typedef Superclass::CostFunctionType       CostFunctionType;
-  typedef Superclass::ScaledCostFunctionType ScaledCostFunctionType;
-  typedef Superclass::MeasureType            MeasureType;
-  typedef Superclass::ScalesType             ScalesType;
+  typedef Superclass::ParametersType            ParametersType;
+  typedef Superclass::DerivativeType            DerivativeType;
+  typedef Superclass::CostFunctionType          CostFunctionType;
+  typedef Superclass::CostFunctionPointer       CostFunctionPointer;
+  typedef Superclass::ScaledCostFunctionType    ScaledCostFunctionType;
+  typedef Superclass::ScaledCostFunctionPointer ScaledCostFunctionPointer;
+  typedef Superclass::MeasureType               MeasureType;
+  typedef Superclass::ScalesType                ScalesType;
+
+  typedef std::vector< CostFunctionPointer > CostFunctionContainerType;
 
   typedef enum {
     MetricError,
@@ -83,9 +102,12 @@ public:
 
   virtual void StopOptimization( void );
 
-  /** Get the current iteration number: */
+  /** Get the current iteration number, counted over all runs: */
   itkGetConstMacro( CurrentIteration, unsigned long );
 
+  /** Get the number of restarts so far */
+  itkGetConstMacro( CurrentNumberOfRestarts, unsigned int );
+
   /** Get the metric value at the current position */
   itkGetConstMacro( CurrentValue, MeasureType );
 
@@ -219,6 +241,31 @@ public:
   itkSetMacro( ValueTolerance, double );
   itkGetConstMacro( ValueTolerance, double );
 
+  /** Setting: the maximum number of restarts with a larger population after
+   * the optimization stagnated, i.e. stopped because of the
+   * PositionToleranceMin or the ValueTolerance.
+   * Default: 0 */
+  itkSetMacro( MaximumNumberOfRestarts, unsigned int );
+  itkGetConstMacro( MaximumNumberOfRestarts, unsigned int );
+
+  /** Setting: the factor by which the population size is multiplied at
+   * each restart. At a restart, the NumberOfParents is reset to its default.
+   * Default: 2.0 */
+  itkSetClampMacro( PopulationSizeIncreaseFactor, double, 1.0, NumericTraits< double >::max() );
+  itkGetConstMacro( PopulationSizeIncreaseFactor, double );
+
+  /** Setting: independent copies of the cost function, used to evaluate the
+   * offspring concurrently, one thread per copy. They get the same scales
+   * as the cost function set by SetCostFunction(), which is still used for
+   * the value at the mean of the distribution and for offspring whose
+   * evaluation failed. If a copy is multi-threaded itself, it should use
+   * its share of the threads only. Fewer than two copies disable the
+   * concurrent evaluation.
+   * Default: empty */
+  virtual void SetParallelCostFunctions( const CostFunctionContainerType & costFunctions );
+  virtual const CostFunctionContainerType & GetParallelCostFunctions( void ) const
+  { return this->m_ParallelCostFunctions; }
+
 protected:
 
   typedef Array< double >               RecombinationWeightsType;
@@ -245,6 +292,14 @@ protected:
   /** The stop condition */
   StopConditionType m_StopCondition;
 
+  /** The number of restarts so far, and the iteration at which the current run started */
+  unsigned int  m_CurrentNumberOfRestarts;
+  unsigned long m_RunStartIteration;
+
+  /** The best position and value at the end of the runs so far */
+  ParametersType m_BestScaledPosition;
+  MeasureType    m_BestValue;
+
   /** Boolean that indicates whether the optimizer should stop */
   bool m_Stop;
 
@@ -358,6 +413,22 @@ protected:
    * and m_CostFunctionValues */
   virtual void GenerateOffspring( void );
 
+  /** Draw m_NormalizedSearchDirs[ lam ] from N(0,I), and m_SearchDirs[ lam ]
+   * from N( 0, sigma^2 C ) accordingly */
+  virtual void DrawSearchDirection( unsigned int lam );
+
+  /** Evaluate the cost function for all offspring concurrently, using the
+   * parallel cost functions. Offspring for which the evaluation failed are
+   * redrawn and evaluated sequentially. */
+  virtual void EvaluateOffspringInParallel( void );
+
+  /** Restart the optimization with a larger population, if it stagnated
+   * and restarts are left. Returns false if no restart was done. */
+  virtual bool RestartOptimization( void );
+
+  /** Remember the current position if it is the best of all runs so far. */
+  virtual void UpdateBestPosition( void );
+
   /** Sort the m_CostFunctionValues vector and update m_MeasureHistory */
   virtual void SortCostFunctionValues( void );
 
@@ -410,6 +481,33 @@ private:
   CMAEvolutionStrategyOptimizer( const Self & ); // purposely not implemented
   void operator=( const Self & );                // purposely not implemented
 
+  /** Typedefs for multi-threading. */
+  typedef itk::MultiThreader             ThreaderType;
+  typedef ThreaderType::ThreadInfoStruct ThreadInfoType;
+
+  /** The threaded evaluation of the offspring: evaluates every
+   * numberOfThreads-th offspring, starting at threadID. */
+  void ThreadedEvaluateOffspring( ThreadIdType threadID );
+
+  /** Threader callback function. */
+  static ITK_THREAD_RETURN_TYPE EvaluateOffspringThreaderCallback( void * arg );
+
+  /** To give the threads access to all member variables and functions. */
+  struct MultiThreaderParameterType
+  {
+    Self * st_Self;
+  };
+  MultiThreaderParameterType m_ThreaderParameters;
+
+  ThreaderType::Pointer                    m_Threader;
+  CostFunctionContainerType                m_ParallelCostFunctions;
+  std::vector< ScaledCostFunctionPointer > m_ParallelScaledCostFunctions;
+
+  /** The results of the concurrent evaluation, per offspring. The success
+   * flags are stored as chars, since threads may not share a vector< bool >. */
+  std::vector< MeasureType >   m_OffspringValues;
+  std::vector< unsigned char > m_OffspringEvaluated;
+
   /** Settings that are only inspected/changed by the associated get/set member functions. */
   unsigned long m_MaximumNumberOfIterations;
   bool          m_UseDecayingSigma;
@@ -422,6 +520,8 @@ private:
   double        m_PositionToleranceMax;
   double        m_PositionToleranceMin;
   double        m_ValueTolerance;
+  unsigned int  m_MaximumNumberOfRestarts;
+  double        m_PopulationSizeIncreaseFactor;
 
 };
 
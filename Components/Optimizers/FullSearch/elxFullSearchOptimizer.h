@@ -21,8 +21,8 @@
 #include "elxIncludes.h" // include first to avoid MSVS warning
 #include "itkFullSearchOptimizer.h"
 #include <map>
-
-#include "itkNDImageBase.h"
+#include <fstream>
+#include <vector>
 
 namespace elastix
 {
@@ -34,10 +34,16 @@ namespace elastix
  * Optimizer that scans a subspace of the parameter space
  * and searches for the best parameters.
  *
- * The results are written to the output-directory as an image
+ * The results can be written to the output-directory as an image
  * OptimizationSurface.\<elastixlevel\>.R\<resolution\>.mhd",
  * which is an N-dimensional float image, where N is the
- * dimension of the search space.
+ * dimension of the search space. The image is streamed to disk point
+ * by point, so it is never held in memory. It is always written in the
+ * MetaImage format, whatever the ResultImageFormat.
+ *
+ * The points are evaluated concurrently, with a copy of the metric for
+ * every thread, see the UseConcurrentEvaluation parameter of the
+ * OptimizerBase.
  *
  * The parameters used in this class are:
  * \parameter Optimizer: Select this optimizer as follows:\n
@@ -48,6 +54,23 @@ namespace elastix
  *   This varies the second transform parameter in the range [-4.0 3.0] with steps of 1.0
  *   and the third parameter in the range [-1.0 1.0] with steps of 0.5. The names are used
  *   as column headers in the screen output.
+ * \parameter WriteOptimizationSurfaceEachResolution: Whether to write the
+ *   optimization surface image. \n
+ *   example: <tt>(WriteOptimizationSurfaceEachResolution "true")</tt> \n
+ *   Default is "false".
+ * \parameter NumberOfCoarseToFineLevels: The number of levels of the
+ *   coarse-to-fine search. The first level scans the search space with
+ *   steps that are 2^NumberOfCoarseToFineLevels times the given steps,
+ *   and each next level halves the steps around the best points so far.
+ *   0 scans the full search space. Points that are not scanned are NaN in
+ *   the optimization surface image. Can be given for each resolution.\n
+ *   example: <tt>(NumberOfCoarseToFineLevels 3 3 0)</tt> \n
+ *   Default is 0.
+ * \parameter NumberOfCellsToRefine: The number of best points around
+ *   which each level of the coarse-to-fine search is refined. Can be given
+ *   for each resolution.\n
+ *   example: <tt>(NumberOfCellsToRefine 4)</tt> \n
+ *   Default is 1.
  *
  * \ingroup Optimizers
  * \sa FullSearchOptimizer
@@ -82,19 +105,20 @@ public:
   elxClassNameMacro( "FullSearch" );
 
   /** Typedef's inherited from Superclass1.*/
-  typedef Superclass1::CostFunctionType        CostFunctionType;
-  typedef Superclass1::CostFunctionPointer     CostFunctionPointer;
-  typedef Superclass1::ParametersType          ParametersType;
-  typedef Superclass1::MeasureType             MeasureType;
-  typedef Superclass1::ParameterValueType      ParameterValueType;
-  typedef Superclass1::RangeValueType          RangeValueType;
-  typedef Superclass1::RangeType               RangeType;
-  typedef Superclass1::SearchSpaceType         SearchSpaceType;
-  typedef Superclass1::SearchSpacePointer      SearchSpacePointer;
-  typedef Superclass1::SearchSpaceIteratorType SearchSpaceIteratorType;
-  typedef Superclass1::SearchSpacePointType    SearchSpacePointType;
-  typedef Superclass1::SearchSpaceIndexType    SearchSpaceIndexType;
-  typedef Superclass1::SearchSpaceSizeType     SearchSpaceSizeType;
+  typedef Superclass1::CostFunctionType          CostFunctionType;
+  typedef Superclass1::CostFunctionPointer       CostFunctionPointer;
+  typedef Superclass1::ParametersType            ParametersType;
+  typedef Superclass1::MeasureType               MeasureType;
+  typedef Superclass1::ParameterValueType        ParameterValueType;
+  typedef Superclass1::RangeValueType            RangeValueType;
+  typedef Superclass1::RangeType                 RangeType;
+  typedef Superclass1::SearchSpaceType           SearchSpaceType;
+  typedef Superclass1::SearchSpacePointer        SearchSpacePointer;
+  typedef Superclass1::SearchSpaceIteratorType   SearchSpaceIteratorType;
+  typedef Superclass1::SearchSpacePointType      SearchSpacePointType;
+  typedef Superclass1::SearchSpaceIndexType      SearchSpaceIndexType;
+  typedef Superclass1::SearchSpaceSizeType       SearchSpaceSizeType;
+  typedef Superclass1::CostFunctionContainerType CostFunctionContainerType;
 
   /** Typedef's inherited from Elastix.*/
   typedef typename Superclass2::ElastixType          ElastixType;
@@ -105,14 +129,14 @@ public:
   typedef typename Superclass2::RegistrationPointer  RegistrationPointer;
   typedef typename Superclass2::ITKBaseType          ITKBaseType;
 
-  /** To store the results of the full search */
-  typedef itk::NDImageBase< float >     NDImageType;
-  typedef typename NDImageType::Pointer NDImagePointer;
-
   /** To store the names of the search space dimensions */
   typedef std::map< unsigned int, std::string >         DimensionNameMapType;
   typedef typename DimensionNameMapType::const_iterator NameIteratorType;
 
+  /** Create the copies of the metric for the concurrent evaluation of
+   * the points; after that call the superclass' implementation. */
+  virtual void StartOptimization( void );
+
   /** Methods that have to be present everywhere.*/
   virtual void BeforeRegistration( void );
 
@@ -126,15 +150,28 @@ public:
 
   /** \todo BeforeAll, checking parameters. */
 
-  /** Get a pointer to the image containing the optimization surface. */
-  itkGetModifiableObjectMacro( OptimizationSurface, NDImageType );
-
 protected:
 
   FullSearch();
   virtual ~FullSearch() {}
 
-  NDImagePointer m_OptimizationSurface;
+  /** To stream the optimization surface to a raw file. Consecutive
+   * points are collected in a buffer, which starts at the point with
+   * linear index m_OptimizationSurfaceBufferStart.
+   */
+  std::ofstream        m_OptimizationSurfaceStream;
+  std::string          m_OptimizationSurfaceFileName;
+  std::vector< float > m_OptimizationSurfaceBuffer;
+  std::streamoff       m_OptimizationSurfaceBufferStart;
+
+  /** Write the MetaImage header of the streamed optimization surface, open
+   * its raw data file, and fill it with NaN.
+   */
+  virtual void InitializeOptimizationSurfaceStream( const std::string & fileName );
+
+  /** Write the buffered points of the optimization surface to the raw file. */
+  virtual void FlushOptimizationSurfaceBuffer( void );
+
 
   DimensionNameMapType m_SearchSpaceDimensionNames;
 
@@ -22,7 +22,11 @@
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <algorithm>
+#include <limits>
+#include <vector>
 #include "vnl/vnl_math.h"
+#include "itkByteSwapper.h"
 
 namespace elastix
 {
@@ -35,11 +39,31 @@ template< class TElastix >
 FullSearch< TElastix >
 ::FullSearch()
 {
-  this->m_OptimizationSurface = 0;
+  this->m_OptimizationSurfaceBufferStart = 0;
 
 } // end Constructor
 
 
+/**
+ * ***************** StartOptimization ************************
+ */
+
+template< class TElastix >
+void
+FullSearch< TElastix >
+::StartOptimization( void )
+{
+  /** Create the copies of the metric that evaluate the points concurrently. */
+  CostFunctionContainerType parallelCostFunctions;
+  this->CreateConcurrentCostFunctions( parallelCostFunctions );
+  this->SetParallelCostFunctions( parallelCostFunctions );
+
+  /** Call the superclass */
+  this->Superclass1::StartOptimization();
+
+} // end StartOptimization()
+
+
 /**
  * ***************** BeforeRegistration ***********************
  */
@@ -75,15 +99,14 @@ FullSearch< TElastix >
 
   /** declare variables */
   std::string        name( "" );
-  unsigned int       param_nr                  = 0;
-  double             minimum                   = 0;
-  double             maximum                   = 0;
-  double             stepsize                  = 0;
-  const std::string  prefix                    = "FS";
-  unsigned int       entry_nr                  = 0;
-  unsigned int       nrOfSearchSpaceDimensions = 0;
-  bool               found                     = true;
-  bool               realGood                  = true;
+  unsigned int       param_nr = 0;
+  double             minimum  = 0;
+  double             maximum  = 0;
+  double             stepsize = 0;
+  const std::string  prefix   = "FS";
+  unsigned int       entry_nr = 0;
+  bool               found    = true;
+  bool               realGood = true;
   std::ostringstream makeString( "" );
 
   /** Create fullFieldName, which is "FullSearchSpace0" at level 0. */
@@ -165,33 +188,40 @@ FullSearch< TElastix >
 
   if( realGood )
   {
-    /** The number of dimensions. */
-    nrOfSearchSpaceDimensions = this->GetNumberOfSearchSpaceDimensions();
-
-    /** Create the image that will store the results of the full search. */
-    this->m_OptimizationSurface
-      = NDImageType::NewNDImage( nrOfSearchSpaceDimensions );
-    this->m_OptimizationSurface->CreateNewImage();
-    /** \todo don't do this if more than max allowable dimensions. */
-
-    /** Set the correct size and allocate memory. */
-    this->m_OptimizationSurface->SetRegions(
-      this->GetSearchSpaceSize() );
-    this->m_OptimizationSurface->Allocate();
-    /** \todo try/catch block around Allocate? */
-
-    /** Set the name of this image on disk. */
-    std::string resultImageFormat = "mhd";
-    this->m_Configuration->ReadParameter(
-      resultImageFormat, "ResultImageFormat", 0, false );
+    /** Set the coarse-to-fine options. */
+    unsigned int numberOfCoarseToFineLevels = 0;
+    this->GetConfiguration()->ReadParameter( numberOfCoarseToFineLevels,
+      "NumberOfCoarseToFineLevels", this->GetComponentLabel(), level, 0 );
+    this->SetNumberOfCoarseToFineLevels( numberOfCoarseToFineLevels );
+
+    unsigned int numberOfCellsToRefine = 1;
+    this->GetConfiguration()->ReadParameter( numberOfCellsToRefine,
+      "NumberOfCellsToRefine", this->GetComponentLabel(), level, 0 );
+    this->SetNumberOfCellsToRefine( numberOfCellsToRefine );
+
+    /** Check if the optimization surface should be written. */
+    bool writeSurfaceEachResolution = false;
+    this->GetConfiguration()->ReadParameter( writeSurfaceEachResolution,
+      "WriteOptimizationSurfaceEachResolution", 0, false );
+
+    /** Set the name of this image on disk. The image is streamed to disk,
+     * which is only possible in the MetaImage format, so the
+     * ResultImageFormat is not used.
+     */
     makeString.str( "" );
     makeString
       << this->GetConfiguration()->GetCommandLineArgument( "-out" )
       << "OptimizationSurface."
       << this->GetConfiguration()->GetElastixLevel()
       << ".R" << level
-      << "." << resultImageFormat;
-    this->m_OptimizationSurface->SetOutputFileName( makeString.str().c_str() );
+      << ".mhd";
+    this->m_OptimizationSurfaceFileName = makeString.str();
+
+    if( writeSurfaceEachResolution )
+    {
+      /** Stream the results of the full search to disk. */
+      this->InitializeOptimizationSurfaceStream( this->m_OptimizationSurfaceFileName );
+    }
 
     elxout
       << "Total number of iterations needed in this resolution: "
@@ -220,11 +250,35 @@ FullSearch< TElastix >
   /** Print some information. */
   xl::xout[ "iteration" ][ "2:Metric" ] << this->GetValue();
 
-  this->m_OptimizationSurface->SetPixel(
-    this->GetCurrentIndexInSearchSpace(), this->GetValue() );
+  /** Store the value in the optimization surface. */
+  if( this->m_OptimizationSurfaceStream.is_open() )
+  {
+    const SearchSpaceIndexType & index         = this->GetCurrentIndexInSearchSpace();
+    const SearchSpaceSizeType &  size          = this->GetSearchSpaceSize();
+    std::streamoff               linearIndex   = 0;
+    std::streamoff               dimensionStep = 1;
+    for( unsigned int dim = 0; dim < index.GetSize(); dim++ )
+    {
+      linearIndex   += index[ dim ] * dimensionStep;
+      dimensionStep *= size[ dim ];
+    }
+
+    /** Points are mostly visited in index order. Start a new buffer only
+     * if this point does not follow the buffered ones, or the buffer is full.
+     */
+    const std::streamoff bufferEnd = this->m_OptimizationSurfaceBufferStart
+      + static_cast< std::streamoff >( this->m_OptimizationSurfaceBuffer.size() );
+    if( linearIndex != bufferEnd
+      || this->m_OptimizationSurfaceBuffer.size() == this->m_OptimizationSurfaceBuffer.capacity() )
+    {
+      this->FlushOptimizationSurfaceBuffer();
+      this->m_OptimizationSurfaceBufferStart = linearIndex;
+    }
+    this->m_OptimizationSurfaceBuffer.push_back( static_cast< float >( this->GetValue() ) );
+  }
 
   SearchSpacePointType currentPoint = this->GetCurrentPointInSearchSpace();
-  unsigned int         nrOfSSDims   = currentPoint.GetSize();
+  unsigned int         nrOfSSDims = currentPoint.GetSize();
   NameIteratorType     name_it      = this->m_SearchSpaceDimensionNames.begin();
 
   for( unsigned int dim = 0; dim < nrOfSSDims; dim++ )
@@ -245,7 +299,7 @@ void
 FullSearch< TElastix >
 ::AfterEachResolution( void )
 {
-  //typedef enum {FullRangeSearched,  MetricError } StopConditionType;
+  //typedef enum {FullRangeSearched,  MetricError, CoarseToFineSearched } StopConditionType;
   std::string stopcondition;
 
   switch( this->GetStopCondition() )
@@ -258,38 +312,42 @@ FullSearch< TElastix >
       stopcondition = "Error in metric";
       break;
 
+    case CoarseToFineSearched:
+      stopcondition = "The coarse-to-fine search has finished";
+      break;
+
     default:
       stopcondition = "Unknown";
       break;
   }
 
+  /** Release the copies of the metric. */
+  this->SetParallelCostFunctions( CostFunctionContainerType() );
+
   /** Print the stopping condition */
   elxout << "Stopping condition: " << stopcondition << "." << std::endl;
 
   /** Write the optimization surface to disk */
-  bool writeSurfaceEachResolution = false;
-  this->GetConfiguration()->ReadParameter( writeSurfaceEachResolution,
-      "WriteOptimizationSurfaceEachResolution", 0, false );
-  if( writeSurfaceEachResolution )
+  if( this->m_OptimizationSurfaceStream.is_open() )
   {
-    try
-    {
-      this->m_OptimizationSurface->Write();
-      elxout
-        << "\nThe scanned optimization surface is saved as: "
-        << this->m_OptimizationSurface->GetOutputFileName()
-        << std::endl;
-    }
-    catch( itk::ExceptionObject & err )
+    this->FlushOptimizationSurfaceBuffer();
+    this->m_OptimizationSurfaceStream.close();
+    if( this->m_OptimizationSurfaceStream.fail() )
     {
       xl::xout[ "error" ]
         << "ERROR: Saving "
-        << this->m_OptimizationSurface->GetOutputFileName()
+        << this->m_OptimizationSurfaceFileName
         << " failed."
         << std::endl;
-      xl::xout[ "error" ] << err << std::endl;
-      // do not throw an error, since we would like to go on.
     }
+    else
+    {
+      elxout
+        << "\nThe scanned optimization surface is saved as: "
+        << this->m_OptimizationSurfaceFileName
+        << std::endl;
+    }
+    this->m_OptimizationSurfaceStream.clear();
   }
 
   /** Print the best metric value */
@@ -330,7 +388,7 @@ FullSearch< TElastix >
   /** Clear the dimension names of the previous resolution's search space. */
   this->m_SearchSpaceDimensionNames.clear();
 
-  /** Clear the full search ranges */
+  /** Clear the full search ranges. */
   this->SetSearchSpace( 0 );
 
 } // end AfterEachResolution()
@@ -345,12 +403,120 @@ FullSearch< TElastix >
 ::AfterRegistration( void )
 {
   /** Print the best metric value. */
-  double bestValue = this->GetBestValue();
+  double bestValue            = this->GetBestValue();
   elxout << std::endl << "Final metric value  = " << bestValue << std::endl;
 
 } // end AfterRegistration()
 
 
+/**
+ * ************ InitializeOptimizationSurfaceStream *************
+ */
+
+template< class TElastix >
+void
+FullSearch< TElastix >
+::InitializeOptimizationSurfaceStream( const std::string & fileName )
+{
+  const SearchSpaceSizeType & size       = this->GetSearchSpaceSize();
+  const unsigned int          nrOfSSDims = size.GetSize();
+
+  /** The raw data file has the same name as the header, with extension raw. */
+  std::string rawFileName = fileName;
+  rawFileName.replace( rawFileName.rfind( "." ), std::string::npos, ".raw" );
+  std::string            rawFileNameWithoutPath = rawFileName;
+  std::string::size_type slash                  = rawFileName.find_last_of( "/\\" );
+  if( slash != std::string::npos )
+  {
+    rawFileNameWithoutPath = rawFileName.substr( slash + 1 );
+  }
+
+  /** Write the MetaImage header. */
+  std::ofstream header( fileName.c_str() );
+  if( !header.is_open() )
+  {
+    itkExceptionMacro( << "ERROR: could not open " << fileName << " for writing." );
+  }
+  header << "ObjectType = Image\n";
+  header << "NDims = " << nrOfSSDims << "\n";
+  header << "BinaryData = True\n";
+  header << "BinaryDataByteOrderMSB = "
+         << ( itk::ByteSwapper< float >::SystemIsBigEndian() ? "True" : "False" ) << "\n";
+  header << "CompressedData = False\n";
+  header << "Offset =";
+  for( unsigned int dim = 0; dim < nrOfSSDims; dim++ )
+  {
+    header << " 0";
+  }
+  header << "\nElementSpacing =";
+  for( unsigned int dim = 0; dim < nrOfSSDims; dim++ )
+  {
+    header << " 1";
+  }
+  header << "\nDimSize =";
+  for( unsigned int dim = 0; dim < nrOfSSDims; dim++ )
+  {
+    header << " " << size[ dim ];
+  }
+  header << "\nElementType = MET_FLOAT\n";
+  header << "ElementDataFile = " << rawFileNameWithoutPath << std::endl;
+  header.close();
+
+  /** Open the raw data file. */
+  this->m_OptimizationSurfaceStream.open( rawFileName.c_str(),
+    std::ios::out | std::ios::binary | std::ios::trunc );
+  if( !this->m_OptimizationSurfaceStream.is_open() )
+  {
+    itkExceptionMacro( << "ERROR: could not open " << rawFileName << " for writing." );
+  }
+
+  /** Mark all points as not visited first, so that the raw file has the
+   * size given in the header, also if not all points are visited: in the
+   * coarse-to-fine mode, or when the search stops early.
+   */
+  const std::vector< float > chunk( 65536, std::numeric_limits< float >::quiet_NaN() );
+  unsigned long              numberOfPointsLeft = this->GetNumberOfIterations();
+  while( numberOfPointsLeft > 0 )
+  {
+    const unsigned long numberOfPoints = std::min(
+      numberOfPointsLeft, static_cast< unsigned long >( chunk.size() ) );
+    this->m_OptimizationSurfaceStream.write(
+      reinterpret_cast< const char * >( &chunk[ 0 ] ), numberOfPoints * sizeof( float ) );
+    numberOfPointsLeft -= numberOfPoints;
+  }
+
+  /** Prepare the buffer of visited points. */
+  this->m_OptimizationSurfaceBuffer.clear();
+  this->m_OptimizationSurfaceBuffer.reserve( chunk.size() );
+  this->m_OptimizationSurfaceBufferStart = 0;
+
+} // end InitializeOptimizationSurfaceStream()
+
+
+/**
+ * ************ FlushOptimizationSurfaceBuffer *************
+ */
+
+template< class TElastix >
+void
+FullSearch< TElastix >
+::FlushOptimizationSurfaceBuffer( void )
+{
+  if( this->m_OptimizationSurfaceBuffer.empty() )
+  {
+    return;
+  }
+
+  this->m_OptimizationSurfaceStream.seekp(
+    this->m_OptimizationSurfaceBufferStart * static_cast< std::streamoff >( sizeof( float ) ) );
+  this->m_OptimizationSurfaceStream.write(
+    reinterpret_cast< const char * >( &this->m_OptimizationSurfaceBuffer[ 0 ] ),
+    this->m_OptimizationSurfaceBuffer.size() * sizeof( float ) );
+  this->m_OptimizationSurfaceBuffer.clear();
+
+} // end FlushOptimizationSurfaceBuffer()
+
+
 /**
  * ************ CheckSearchSpaceRangeDefinition *****************
  */
@@ -25,6 +25,10 @@
 #include "itkExceptionObject.h"
 #include "itkNumericTraits.h"
 
+#include <algorithm>
+#include <functional>
+#include <set>
+
 namespace itk
 {
 
@@ -45,6 +49,14 @@ FullSearchOptimizer
   m_NumberOfSearchSpaceDimensions = 0;
   m_SearchSpace                   = 0;
   m_LastSearchSpaceChanges        = 0;
+  m_NumberOfCoarseToFineLevels    = 0;
+  m_NumberOfCellsToRefine         = 1;
+
+  m_Threader = ThreaderType::New();
+#if ITK_VERSION_MAJOR < 5
+  m_Threader->SetUseThreadPool( false );
+#endif
+  m_ThreaderParameters.st_Self = this;
 
 }   //end constructor
 
@@ -98,6 +110,18 @@ FullSearchOptimizer
   m_Stop = false;
 
   InvokeEvent( StartEvent() );
+
+  if( m_NumberOfCoarseToFineLevels > 0 )
+  {
+    this->CoarseToFineSearch();
+    return;
+  }
+  if( m_ParallelCostFunctions.size() > 1 )
+  {
+    this->ResumeParallelFullSearch();
+    return;
+  }
+
   while( !m_Stop )
   {
 
@@ -168,6 +192,343 @@ FullSearchOptimizer
 } // end function StopOptimization
 
 
+/**
+ * ******************** ResumeParallelFullSearch ****************
+ */
+void
+FullSearchOptimizer
+::ResumeParallelFullSearch( void )
+{
+  itkDebugMacro( "ResumeParallelFullSearch" );
+
+  const SizeValueType numberOfIterations = this->GetNumberOfIterations();
+  const SizeValueType blockSize          = 8 * m_ParallelCostFunctions.size();
+
+  /** Evaluate the points from the current one on, block by block. */
+  std::vector< SizeValueType > linearIndices;
+  while( !m_Stop && m_CurrentIteration < numberOfIterations )
+  {
+    const SizeValueType blockEnd = std::min( numberOfIterations,
+      static_cast< SizeValueType >( m_CurrentIteration + blockSize ) );
+    linearIndices.clear();
+    for( SizeValueType i = m_CurrentIteration; i < blockEnd; ++i )
+    {
+      linearIndices.push_back( i );
+    }
+    this->EvaluateSearchSpacePoints( linearIndices );
+
+    for( SizeValueType i = 0; i < linearIndices.size() && !m_Stop; ++i )
+    {
+      this->ReportSearchSpacePoint( linearIndices[ i ], m_EvaluationValues[ i ] );
+    }
+  }
+
+  if( !m_Stop )
+  {
+    m_StopCondition = FullRangeSearched;
+    StopOptimization();
+  }
+
+} // end ResumeParallelFullSearch
+
+
+/**
+ * ******************** CoarseToFineSearch **********************
+ */
+void
+FullSearchOptimizer
+::CoarseToFineSearch( void )
+{
+  itkDebugMacro( "CoarseToFineSearch" );
+
+  typedef std::pair< MeasureType, SizeValueType > ValueIndexPairType;
+
+  const unsigned int          searchSpaceDimension = this->GetNumberOfSearchSpaceDimensions();
+  const SearchSpaceSizeType & searchSpaceSize      = this->GetSearchSpaceSize();
+
+  m_CurrentIteration = 0;
+
+  /** The coarsest level: every stride-th point in each dimension. */
+  SizeValueType       stride = static_cast< SizeValueType >( 1 ) << m_NumberOfCoarseToFineLevels;
+  SearchSpaceSizeType coarseSize( searchSpaceDimension );
+  SizeValueType       numberOfCoarsePoints = 1;
+  for( unsigned int ssdim = 0; ssdim < searchSpaceDimension; ssdim++ )
+  {
+    coarseSize[ ssdim ]   = ( searchSpaceSize[ ssdim ] - 1 ) / stride + 1;
+    numberOfCoarsePoints *= coarseSize[ ssdim ];
+  }
+
+  std::set< SizeValueType > candidates;
+  for( SizeValueType coarseLinearIndex = 0; coarseLinearIndex < numberOfCoarsePoints; ++coarseLinearIndex )
+  {
+    SizeValueType rest          = coarseLinearIndex;
+    SizeValueType linearIndex   = 0;
+    SizeValueType dimensionStep = 1;
+    for( unsigned int ssdim = 0; ssdim < searchSpaceDimension; ssdim++ )
+    {
+      linearIndex   += ( rest % coarseSize[ ssdim ] ) * stride * dimensionStep;
+      rest          /= coarseSize[ ssdim ];
+      dimensionStep *= searchSpaceSize[ ssdim ];
+    }
+    candidates.insert( linearIndex );
+  }
+
+  std::set< SizeValueType >         evaluated;
+  std::vector< ValueIndexPairType > results;
+  for( unsigned int level = 0; level <= m_NumberOfCoarseToFineLevels; ++level )
+  {
+    /** Evaluate and report the candidates of this level. */
+    const std::vector< SizeValueType > linearIndices( candidates.begin(), candidates.end() );
+    this->EvaluateSearchSpacePoints( linearIndices );
+    for( SizeValueType i = 0; i < linearIndices.size(); ++i )
+    {
+      this->ReportSearchSpacePoint( linearIndices[ i ], m_EvaluationValues[ i ] );
+      if( m_Stop )
+      {
+        return;
+      }
+      evaluated.insert( linearIndices[ i ] );
+      results.push_back( ValueIndexPairType( m_EvaluationValues[ i ], linearIndices[ i ] ) );
+    }
+
+    if( level == m_NumberOfCoarseToFineLevels )
+    {
+      break;
+    }
+
+    /** Select the best points so far. */
+    const SizeValueType numberOfCells = std::min(
+      static_cast< SizeValueType >( m_NumberOfCellsToRefine ),
+      static_cast< SizeValueType >( results.size() ) );
+    if( m_Maximize )
+    {
+      std::partial_sort( results.begin(), results.begin() + numberOfCells, results.end(),
+        std::greater< ValueIndexPairType >() );
+    }
+    else
+    {
+      std::partial_sort( results.begin(), results.begin() + numberOfCells, results.end() );
+    }
+
+    /** The candidates of the next level are the neighbours of the best
+     * points at the halved stride, that have not been evaluated yet.
+     */
+    stride /= 2;
+    candidates.clear();
+    SizeValueType numberOfNeighbours = 1;
+    for( unsigned int ssdim = 0; ssdim < searchSpaceDimension; ssdim++ )
+    {
+      numberOfNeighbours *= 3;
+    }
+    for( SizeValueType cell = 0; cell < numberOfCells; ++cell )
+    {
+      const SearchSpaceIndexType center = this->LinearIndexToIndex( results[ cell ].second );
+      for( SizeValueType neighbour = 0; neighbour < numberOfNeighbours; ++neighbour )
+      {
+        SizeValueType rest          = neighbour;
+        SizeValueType linearIndex   = 0;
+        SizeValueType dimensionStep = 1;
+        bool          inside        = true;
+        for( unsigned int ssdim = 0; ssdim < searchSpaceDimension; ssdim++ )
+        {
+          const IndexValueType index = center[ ssdim ]
+            + ( static_cast< IndexValueType >( rest % 3 ) - 1 ) * static_cast< IndexValueType >( stride );
+          rest /= 3;
+          if( index < 0 || index >= static_cast< IndexValueType >( searchSpaceSize[ ssdim ] ) )
+          {
+            inside = false;
+            break;
+          }
+          linearIndex   += index * dimensionStep;
+          dimensionStep *= searchSpaceSize[ ssdim ];
+        }
+        if( inside && evaluated.find( linearIndex ) == evaluated.end() )
+        {
+          candidates.insert( linearIndex );
+        }
+      }
+    }
+  } // end for level
+
+  m_StopCondition = CoarseToFineSearched;
+  StopOptimization();
+
+} // end CoarseToFineSearch
+
+
+/**
+ * ******************** EvaluateSearchSpacePoints ***************
+ */
+void
+FullSearchOptimizer
+::EvaluateSearchSpacePoints( const std::vector< SizeValueType > & linearIndices )
+{
+  const SizeValueType numberOfPoints = linearIndices.size();
+  m_EvaluationValues.resize( numberOfPoints );
+  m_EvaluationPositions.resize( numberOfPoints );
+  for( SizeValueType i = 0; i < numberOfPoints; ++i )
+  {
+    m_EvaluationPositions[ i ] = this->IndexToPosition( this->LinearIndexToIndex( linearIndices[ i ] ) );
+  }
+
+  /** Sequential evaluation with the cost function. */
+  if( m_ParallelCostFunctions.size() < 2 )
+  {
+    for( SizeValueType i = 0; i < numberOfPoints; ++i )
+    {
+      try
+      {
+        m_EvaluationValues[ i ] = m_CostFunction->GetValue( m_EvaluationPositions[ i ] );
+      }
+      catch( ExceptionObject & err )
+      {
+        m_StopCondition = MetricError;
+        StopOptimization();
+        throw err;
+      }
+    }
+    return;
+  }
+
+  /** Concurrent evaluation, one thread per cost function. */
+  const ThreadIdType numberOfThreads = static_cast< ThreadIdType >( std::min(
+    static_cast< SizeValueType >( m_ParallelCostFunctions.size() ), numberOfPoints ) );
+  if( numberOfThreads == 0 )
+  {
+    return;
+  }
+  m_EvaluationFailed.assign( numberOfThreads, 0 );
+  m_EvaluationExceptions.resize( numberOfThreads );
+  m_Threader->SetNumberOfThreads( numberOfThreads );
+  m_Threader->SetSingleMethod( EvaluateSearchSpacePointsThreaderCallback,
+    static_cast< void * >( &m_ThreaderParameters ) );
+  m_Threader->SingleMethodExecute();
+
+  for( ThreadIdType threadID = 0; threadID < numberOfThreads; ++threadID )
+  {
+    if( m_EvaluationFailed[ threadID ] )
+    {
+      m_StopCondition = MetricError;
+      StopOptimization();
+      throw m_EvaluationExceptions[ threadID ];
+    }
+  }
+
+} // end EvaluateSearchSpacePoints
+
+
+/**
+ * ************ EvaluateSearchSpacePointsThreaderCallback *******
+ */
+ITK_THREAD_RETURN_TYPE
+FullSearchOptimizer
+::EvaluateSearchSpacePointsThreaderCallback( void * arg )
+{
+  /** Get the current thread id and user data. */
+  ThreadInfoType *             infoStruct = static_cast< ThreadInfoType * >( arg );
+  ThreadIdType                 threadID   = infoStruct->ThreadID;
+  MultiThreaderParameterType * temp
+    = static_cast< MultiThreaderParameterType * >( infoStruct->UserData );
+
+  /** Call the real implementation. */
+  temp->st_Self->ThreadedEvaluateSearchSpacePoints( threadID );
+
+  return ITK_THREAD_RETURN_VALUE;
+
+} // end EvaluateSearchSpacePointsThreaderCallback
+
+
+/**
+ * ************** ThreadedEvaluateSearchSpacePoints *************
+ */
+void
+FullSearchOptimizer
+::ThreadedEvaluateSearchSpacePoints( ThreadIdType threadID )
+{
+  const SizeValueType      numberOfPoints  = m_EvaluationPositions.size();
+  const ThreadIdType       numberOfThreads = m_Threader->GetNumberOfThreads();
+  const CostFunctionType * costFunction    = m_ParallelCostFunctions[ threadID ].GetPointer();
+
+  for( SizeValueType i = threadID; i < numberOfPoints; i += numberOfThreads )
+  {
+    try
+    {
+      m_EvaluationValues[ i ] = costFunction->GetValue( m_EvaluationPositions[ i ] );
+    }
+    catch( ExceptionObject & err )
+    {
+      m_EvaluationFailed[ threadID ]     = 1;
+      m_EvaluationExceptions[ threadID ] = err;
+      return;
+    }
+  }
+
+} // end ThreadedEvaluateSearchSpacePoints
+
+
+/**
+ * ******************** ReportSearchSpacePoint ******************
+ */
+void
+FullSearchOptimizer
+::ReportSearchSpacePoint( SizeValueType linearIndex, MeasureType value )
+{
+  m_CurrentIndexInSearchSpace = this->LinearIndexToIndex( linearIndex );
+  m_CurrentPointInSearchSpace = this->IndexToPoint( m_CurrentIndexInSearchSpace );
+  this->SetCurrentPosition( this->PointToPosition( m_CurrentPointInSearchSpace ) );
+  m_Value = value;
+
+  /** Check if the value is a minimum or maximum */
+  if( ( m_Value < m_BestValue )  ^  m_Maximize )         // ^ = xor, yields true if only one of the expressions is true
+  {
+    m_BestValue              = m_Value;
+    m_BestPointInSearchSpace = m_CurrentPointInSearchSpace;
+    m_BestIndexInSearchSpace = m_CurrentIndexInSearchSpace;
+  }
+
+  this->InvokeEvent( IterationEvent() );
+
+  m_CurrentIteration++;
+
+} // end ReportSearchSpacePoint
+
+
+/**
+ * ******************** SetParallelCostFunctions ****************
+ */
+void
+FullSearchOptimizer
+::SetParallelCostFunctions( const CostFunctionContainerType & costFunctions )
+{
+  m_ParallelCostFunctions = costFunctions;
+  this->Modified();
+
+} // end SetParallelCostFunctions
+
+
+/**
+ * ******************** LinearIndexToIndex **********************
+ */
+FullSearchOptimizer::SearchSpaceIndexType
+FullSearchOptimizer
+::LinearIndexToIndex( SizeValueType linearIndex )
+{
+  const unsigned int          searchSpaceDimension = this->GetNumberOfSearchSpaceDimensions();
+  const SearchSpaceSizeType & searchSpaceSize      = this->GetSearchSpaceSize();
+  SearchSpaceIndexType        index( searchSpaceDimension );
+
+  /** The first dimension varies fastest, see UpdateCurrentPosition() */
+  for( unsigned int ssdim = 0; ssdim < searchSpaceDimension; ssdim++ )
+  {
+    index[ ssdim ] = static_cast< IndexValueType >( linearIndex % searchSpaceSize[ ssdim ] );
+    linearIndex   /= searchSpaceSize[ ssdim ];
+  }
+
+  return index;
+
+} // end LinearIndexToIndex
+
+
 /**
  * ********************* UpdateCurrentPosition *******************
  *
@@ -24,6 +24,10 @@
 #include "itkImage.h"
 #include "itkArray.h"
 #include "itkFixedArray.h"
+#include "itkMultiThreader.h"
+#include "itkExceptionObject.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -35,6 +39,20 @@ namespace itk
  * Optimizer that scans a subspace of the parameter space
  * and searches for the best parameters.
  *
+ * The points of the search space can be evaluated concurrently, if
+ * independent copies of the cost function are supplied by
+ * SetParallelCostFunctions(). Each thread then evaluates its points with
+ * its own copy. The points are still reported in the same order, by an
+ * IterationEvent each.
+ *
+ * In the optional coarse-to-fine mode (NumberOfCoarseToFineLevels > 0),
+ * the search space is first scanned with steps that are 2^L times larger
+ * than the given steps, where L is the number of levels. In each following
+ * level the steps are halved, and only the neighbours of the
+ * NumberOfCellsToRefine best points found so far are evaluated. The final
+ * level uses the given steps. Points that have been evaluated before are
+ * skipped, so each point is reported at most once.
+ *
  * \todo This optimizer has similar functionality as the recently added
  * itkExhaustiveOptimizer. See if we can replace it by that optimizer,
  * or inherit from it.
@@ -62,7 +80,8 @@ public:
   /** Codes of stopping conditions */
   typedef enum {
     FullRangeSearched,
-    MetricError
+    MetricError,
+    CoarseToFineSearched
   } StopConditionType;
 
   /* Typedefs inherited from superclass */
@@ -77,6 +96,7 @@ public:
   typedef MapContainer< unsigned int, RangeType > SearchSpaceType;
   typedef SearchSpaceType::Pointer                SearchSpacePointer;
   typedef SearchSpaceType::ConstIterator          SearchSpaceIteratorType;
+  typedef std::vector< CostFunctionPointer >      CostFunctionContainerType;
 
   /** Type that stores the parameter values of the parameters to be optimized.
   * Updated every iteration. */
@@ -191,6 +211,29 @@ public:
   /** Get Stop condition. */
   itkGetConstMacro( StopCondition, StopConditionType );
 
+  /** Set/Get the number of coarse-to-fine levels. 0 searches the full
+   * range. Default: 0 */
+  itkSetMacro( NumberOfCoarseToFineLevels, unsigned int );
+  itkGetConstMacro( NumberOfCoarseToFineLevels, unsigned int );
+
+  /** Set/Get the number of best points around which each level of the
+   * coarse-to-fine search is refined. Default: 1 */
+  itkSetClampMacro( NumberOfCellsToRefine, unsigned int, 1, NumericTraits< unsigned int >::max() );
+  itkGetConstMacro( NumberOfCellsToRefine, unsigned int );
+
+  /** Set/Get independent copies of the cost function, used to evaluate the
+   * points of the search space concurrently, one thread per copy. If a copy
+   * is multi-threaded itself, it should use its share of the threads only.
+   * Fewer than two copies disable the concurrent evaluation.
+   * Default: empty */
+  virtual void SetParallelCostFunctions( const CostFunctionContainerType & costFunctions );
+  virtual const CostFunctionContainerType & GetParallelCostFunctions( void ) const
+  { return this->m_ParallelCostFunctions; }
+
+  /** Convert the linear index of a point, in the order in which the full
+   * search visits the points, to an index in the search space. */
+  virtual SearchSpaceIndexType LinearIndexToIndex( SizeValueType linearIndex );
+
 protected:
 
   FullSearchOptimizer();
@@ -215,6 +258,22 @@ protected:
   unsigned long m_LastSearchSpaceChanges;
   virtual void ProcessSearchSpaceChanges( void );
 
+  /** Scan the full range in blocks of points that are evaluated concurrently. */
+  virtual void ResumeParallelFullSearch( void );
+
+  /** Scan the search space from coarse to fine. */
+  virtual void CoarseToFineSearch( void );
+
+  /** Evaluate the cost function at the points with the given linear indices,
+   * concurrently if possible, and store the values in m_EvaluationValues. */
+  virtual void EvaluateSearchSpacePoints( const std::vector< SizeValueType > & linearIndices );
+
+  /** Make the point with the given linear index and value the current one,
+   * update the best point, and invoke an IterationEvent. */
+  virtual void ReportSearchSpacePoint( SizeValueType linearIndex, MeasureType value );
+
+  std::vector< MeasureType > m_EvaluationValues;
+
 private:
 
   FullSearchOptimizer( const Self & ); // purposely not implemented
@@ -222,6 +281,35 @@ private:
 
   unsigned long m_CurrentIteration;
 
+  unsigned int m_NumberOfCoarseToFineLevels;
+  unsigned int m_NumberOfCellsToRefine;
+
+  /** Typedefs for multi-threading. */
+  typedef itk::MultiThreader             ThreaderType;
+  typedef ThreaderType::ThreadInfoStruct ThreadInfoType;
+
+  /** The threaded evaluation: evaluates every numberOfThreads-th point,
+   * starting at threadID. */
+  void ThreadedEvaluateSearchSpacePoints( ThreadIdType threadID );
+
+  /** Threader callback function. */
+  static ITK_THREAD_RETURN_TYPE EvaluateSearchSpacePointsThreaderCallback( void * arg );
+
+  /** To give the threads access to all member variables and functions. */
+  struct MultiThreaderParameterType
+  {
+    Self * st_Self;
+  };
+  MultiThreaderParameterType m_ThreaderParameters;
+
+  ThreaderType::Pointer         m_Threader;
+  CostFunctionContainerType     m_ParallelCostFunctions;
+  std::vector< ParametersType > m_EvaluationPositions;
+
+  /** Per thread: whether an evaluation failed, and its exception. */
+  std::vector< unsigned char >   m_EvaluationFailed;
+  std::vector< ExceptionObject > m_EvaluationExceptions;
+
 };
 
 } // end namespace itk
@@ -327,6 +327,13 @@ PreconditionedStochasticGradientDescent< TElastix >
     xl::xout[ "iteration" ][ "4b:||SearchDirection||" ] << this->GetSearchDirection().magnitude();
   }
 
+  /** Stop if the convergence monitor decided that the optimization has converged. */
+  if( this->UpdateConvergenceMonitor( this->GetValue(), this->GetGradient().magnitude() ) )
+  {
+    this->m_StopCondition = ConvergenceCriterion;
+    this->StopOptimization();
+  }
+
   /** Select new spatial samples for the computation of the metric. */
   if( this->GetNewSamplesEveryIteration() )
   {
@@ -353,7 +360,8 @@ PreconditionedStochasticGradientDescent< TElastix >
    * typedef enum {
    *   MaximumNumberOfIterations,
    *   MetricError,
-   *   MinimumStepSize } StopConditionType;
+   *   MinimumStepSize,
+   *   ConvergenceCriterion } StopConditionType;
    */
   std::string stopcondition;
 
@@ -371,6 +379,10 @@ PreconditionedStochasticGradientDescent< TElastix >
       stopcondition = "The minimum step length has been reached";
       break;
 
+    case ConvergenceCriterion:
+      stopcondition = "The convergence monitor detected convergence";
+      break;
+
     default:
       stopcondition = "Unknown";
       break;
@@ -125,6 +125,13 @@ StandardGradientDescent< TElastix >
   xl::xout[ "iteration" ][ "3:StepSize" ] << this->GetLearningRate();
   xl::xout[ "iteration" ][ "4:||Gradient||" ] << this->GetGradient().magnitude();
 
+  /** Stop if the convergence monitor decided that the optimization has converged */
+  if( this->UpdateConvergenceMonitor( this->GetValue(), this->GetGradient().magnitude() ) )
+  {
+    this->m_StopCondition = ConvergenceCriterion;
+    this->StopOptimization();
+  }
+
   /** Select new spatial samples for the computation of the metric */
   if( this->GetNewSamplesEveryIteration() )
   {
@@ -144,7 +151,8 @@ StandardGradientDescent< TElastix >
 ::AfterEachResolution( void )
 {
   /**
-   * enum   StopConditionType {  MaximumNumberOfIterations, MetricError }
+   * enum   StopConditionType {  MaximumNumberOfIterations, MetricError,
+   *   MinimumStepSize, ConvergenceCriterion }
    */
   std::string stopcondition;
   switch( this->GetStopCondition() )
@@ -158,6 +166,10 @@ StandardGradientDescent< TElastix >
       stopcondition = "Error in metric";
       break;
 
+    case ConvergenceCriterion:
+      stopcondition = "The convergence monitor detected convergence";
+      break;
+
     default:
       stopcondition = "Unknown";
       break;
@@ -22,7 +22,9 @@
 #include "elxMacro.h"
 
 #include "elxBaseComponentSE.h"
+#include "elxComponentDatabase.h"
 #include "itkAdvancedImageToImageMetric.h"
+#include "itkWorkStealingThreadPool.h"
 #include "itkImageGridSampler.h"
 #include "itkPointSet.h"
 
@@ -63,6 +65,19 @@ namespace elastix
  *    CheckNumberOfSamples. \n
  *    example: <tt>(RequiredRatioOfValidSamples 0.1)</tt> \n
  *    The default is 0.25.
+ * \parameter UseWorkStealingThreadPool: Whether the metric is evaluated on the
+ *    persistent, global thread pool, instead of starting new threads at every
+ *    evaluation. The samples are processed in chunks, which are redistributed over
+ *    the threads when some threads finish early. Only used by metrics that support
+ *    it, and only when UseMultiThreadingForMetrics is true. \n
+ *    example: <tt>(UseWorkStealingThreadPool "true")</tt> \n
+ *    The default is false.
+ * \parameter ThreadPoolSize: The number of threads of the thread pool. \n
+ *    example: <tt>(ThreadPoolSize 64)</tt> \n
+ *    The default is the maximum number of threads, as set by -threads.
+ * \parameter ThreadPoolChunkSize: The number of samples per chunk. \n
+ *    example: <tt>(ThreadPoolChunkSize 512)</tt> \n
+ *    The default is 0, which gives each thread about eight chunks.
  *
  * \ingroup Metrics
  * \ingroup ComponentBaseClasses
@@ -127,6 +142,10 @@ public:
   /** Typedefs for sampler support. */
   typedef typename AdvancedMetricType::ImageSamplerType ImageSamplerBaseType;
 
+  /** Typedefs for the copies of the metric that are evaluated concurrently. */
+  typedef typename ITKBaseType::Pointer                         ITKBasePointer;
+  typedef typename AdvancedMetricType::CombinationTransformType CombinationTransformType;
+
   /** Return type of GetValue */
   typedef typename ITKBaseType::MeasureType MeasureType;
 
@@ -165,6 +184,12 @@ public:
    */
   virtual bool GetAdvancedMetricUseImageSampler( void ) const;
 
+  /** Returns whether the metric weights the samples by the importance weights
+   * of its image sampler. When the metric is not of AdvancedMetricType, the
+   * function returns false immediately.
+   */
+  virtual bool GetAdvancedMetricUseFixedImageSampleWeights( void ) const;
+
   /** Method to set the image sampler. The image sampler is only used when
    * the metric is of type AdvancedMetricType, and has UseImageSampler set
    * to true. In other cases, the function does nothing.
@@ -185,11 +210,37 @@ public:
   virtual MeasureType GetCurrentExactMetricValue( void ) const
   { return this->m_CurrentExactMetricValue; }
 
+  /** Get the metric value on a fixed grid of approximately numberOfSamples
+   * samples, for example to monitor the convergence of a stochastic
+   * optimizer. The grid is the same in every call within a resolution.
+   * Returns 0 if the metric does not use an image sampler.
+   */
+  virtual MeasureType GetValidationValue(
+    const typename ITKBaseType::ParametersType & parameters,
+    const unsigned long numberOfSamples );
+
+  /** Create a copy of this metric that can be evaluated concurrently with
+   * it, for optimizers that evaluate the cost function at several positions
+   * at the same time. The copy is created by the component database, and
+   * configured from the parameter file like this metric. It gets its own
+   * copy of the transform, and shares the images, masks, interpolator and
+   * image sampler with this metric, which are only read when it is
+   * evaluated. The copy does not update the shared image sampler, see
+   * UpdateImageSampler of the AdvancedMetricType; it is evaluated
+   * single-threadedly. Returns a null pointer if this metric is not of
+   * AdvancedMetricType, or if its transform can not be copied.
+   */
+  virtual ITKBasePointer CreateConcurrentCopy( void );
+
 protected:
 
   /** The parameters type. */
   typedef typename ITKBaseType::ParametersType ParametersType;
 
+  /** Typedef's from ComponentDatabase. */
+  typedef ComponentDatabase::PtrToCreator PtrToCreator;
+  typedef itk::Object                     ObjectType;
+
   /** The full sampler used by the GetExactValue method. */
   typedef itk::ImageGridSampler< FixedImageType >                     ExactMetricImageSamplerType;
   typedef typename ExactMetricImageSamplerType::Pointer               ExactMetricImageSamplerPointer;
@@ -211,6 +262,13 @@ protected:
    */
   virtual MeasureType GetExactValue( const ParametersType & parameters );
 
+  /** Compute the metric value with the given grid sampler, which gets the
+   * input, mask and region of the current sampler. Used by GetExactValue()
+   * and GetValidationValue().
+   */
+  virtual MeasureType GetValueWithGridSampler( const ParametersType & parameters,
+    ExactMetricImageSamplerType * gridSampler );
+
   /** \todo the method GetExactDerivative could as well be added here. */
 
   bool                             m_ShowExactMetricValue;
@@ -218,6 +276,7 @@ protected:
   MeasureType                      m_CurrentExactMetricValue;
   ExactMetricSampleGridSpacingType m_ExactMetricSampleGridSpacing;
   unsigned int                     m_ExactMetricEachXNumberOfIterations;
+  ExactMetricImageSamplerPointer   m_ValidationMetricSampler;
 
 private:
 
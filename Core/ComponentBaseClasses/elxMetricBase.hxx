@@ -34,6 +34,7 @@ MetricBase< TElastix >
   /** Initialize. */
   this->m_ShowExactMetricValue    = false;
   this->m_ExactMetricSampler      = 0;
+  this->m_ValidationMetricSampler = 0;
   this->m_CurrentExactMetricValue = 0.0;
   this->m_ExactMetricSampleGridSpacing.Fill( 1 );
   this->m_ExactMetricEachXNumberOfIterations = 1;
@@ -178,6 +179,30 @@ MetricBase< TElastix >
         const unsigned int nrOfThreads = atoi( tmp.c_str() );
         thisAsAdvanced->SetNumberOfThreads( nrOfThreads );
       }
+
+      /** Should the metric use the persistent work-stealing thread pool? */
+      bool useThreadPool = false;
+      this->GetConfiguration()->ReadParameter( useThreadPool,
+        "UseWorkStealingThreadPool", this->GetComponentLabel(), level, 0 );
+      thisAsAdvanced->SetUseWorkStealingThreadPool( useThreadPool );
+      if( useThreadPool )
+      {
+        /** The pool is shared by all components. By default it has as many
+         * threads as the global default, which respects the -threads argument.
+         * The metric then uses all of them. */
+        itk::WorkStealingThreadPool::Pointer threadPool
+          = itk::WorkStealingThreadPool::GetInstance();
+        unsigned int threadPoolSize = threadPool->GetNumberOfWorkers();
+        this->GetConfiguration()->ReadParameter( threadPoolSize,
+          "ThreadPoolSize", this->GetComponentLabel(), level, 0 );
+        threadPool->SetNumberOfWorkers( threadPoolSize );
+        thisAsAdvanced->SetNumberOfThreads( threadPool->GetNumberOfWorkers() );
+
+        unsigned long chunkSize = 0;
+        this->GetConfiguration()->ReadParameter( chunkSize,
+          "ThreadPoolChunkSize", this->GetComponentLabel(), level, 0 );
+        thisAsAdvanced->SetThreadPoolChunkSize( chunkSize );
+      }
     }
 
   } // end advanced metric
@@ -276,34 +301,198 @@ MetricBase< TElastix >
     return this->GetAsITKBaseType()->GetValue( parameters );
   }
 
-  /** We have to provide the metric a full (or actually 'grid') sampler,
-   * calls its GetValue and set back its original sampler.
-   */
+  /** We have to provide the metric a full (or actually 'grid') sampler. */
   if( this->m_ExactMetricSampler.IsNull() )
   {
     this->m_ExactMetricSampler = ExactMetricImageSamplerType::New();
   }
-
-  /** Copy settings from current sampler. */
-  this->m_ExactMetricSampler->SetInput( currentSampler->GetInput() );
-  this->m_ExactMetricSampler->SetMask( currentSampler->GetMask() );
-  this->m_ExactMetricSampler->SetInputImageRegion(
-    currentSampler->GetInputImageRegion() );
   this->m_ExactMetricSampler->SetSampleGridSpacing(
     this->m_ExactMetricSampleGridSpacing );
-  this->m_ExactMetricSampler->Update();
-  this->SetAdvancedMetricImageSampler( this->m_ExactMetricSampler );
 
   /** Compute the metric value on the full images. */
-  MeasureType exactValue
-    = this->GetAsITKBaseType()->GetValue( parameters );
+  return this->GetValueWithGridSampler( parameters, this->m_ExactMetricSampler );
+
+} // end GetExactValue()
+
+
+/**
+ * ********************* GetValidationValue ************************
+ */
+
+template< class TElastix >
+typename MetricBase< TElastix >::MeasureType
+MetricBase< TElastix >
+::GetValidationValue( const typename ITKBaseType::ParametersType & parameters,
+  const unsigned long numberOfSamples )
+{
+  /** Get the current image sampler. */
+  typename ImageSamplerBaseType::Pointer currentSampler
+    = this->GetAdvancedMetricImageSampler();
+  if( currentSampler.IsNull() )
+  {
+    return itk::NumericTraits< MeasureType >::Zero;
+  }
+
+  /** The grid sampler computes a grid spacing that gives approximately
+   * the desired number of samples, and only samples again when an input
+   * or this number changes. It needs its input for that.
+   */
+  if( this->m_ValidationMetricSampler.IsNull() )
+  {
+    this->m_ValidationMetricSampler = ExactMetricImageSamplerType::New();
+  }
+  this->m_ValidationMetricSampler->SetInput( currentSampler->GetInput() );
+  this->m_ValidationMetricSampler->SetInputImageRegion( currentSampler->GetInputImageRegion() );
+  this->m_ValidationMetricSampler->SetNumberOfSamples( numberOfSamples );
+
+  return this->GetValueWithGridSampler( parameters, this->m_ValidationMetricSampler );
+
+} // end GetValidationValue()
+
+
+/**
+ * ********************* GetValueWithGridSampler ************************
+ */
+
+template< class TElastix >
+typename MetricBase< TElastix >::MeasureType
+MetricBase< TElastix >
+::GetValueWithGridSampler( const ParametersType & parameters,
+  ExactMetricImageSamplerType * gridSampler )
+{
+  /** Get the current image sampler. */
+  typename ImageSamplerBaseType::Pointer currentSampler
+    = this->GetAdvancedMetricImageSampler();
 
-  /** Reset the original sampler. */
+  /** Copy settings from current sampler. */
+  gridSampler->SetInput( currentSampler->GetInput() );
+  gridSampler->SetMask( currentSampler->GetMask() );
+  gridSampler->SetInputImageRegion( currentSampler->GetInputImageRegion() );
+  gridSampler->Update();
+
+  /** Give the metric the grid sampler, call its GetValue and set back
+   * its original sampler.
+   */
+  this->SetAdvancedMetricImageSampler( gridSampler );
+  MeasureType value = this->GetAsITKBaseType()->GetValue( parameters );
   this->SetAdvancedMetricImageSampler( currentSampler );
 
-  return exactValue;
+  return value;
 
-} // end GetExactValue()
+} // end GetValueWithGridSampler()
+
+
+/**
+ * ********************* CreateConcurrentCopy ************************
+ */
+
+template< class TElastix >
+typename MetricBase< TElastix >::ITKBasePointer
+MetricBase< TElastix >
+::CreateConcurrentCopy( void )
+{
+  /** Only advanced metrics, with an advanced combination transform, can be copied. */
+  AdvancedMetricType * thisAsAdvanced = dynamic_cast< AdvancedMetricType * >( this );
+  if( thisAsAdvanced == 0 )
+  {
+    return 0;
+  }
+  const CombinationTransformType * transform
+    = dynamic_cast< const CombinationTransformType * >( thisAsAdvanced->GetTransform() );
+  if( transform == 0 || transform->GetCurrentTransform() == 0 )
+  {
+    return 0;
+  }
+
+  /** Copy the current transform: create another one of the same type, with
+   * the same fixed parameters and parameters. The initial transform is not
+   * changed during the optimization, so it is shared.
+   */
+  typedef typename CombinationTransformType::CurrentTransformType CurrentTransformType;
+  const CurrentTransformType *           currentTransform = transform->GetCurrentTransform();
+  typename CurrentTransformType::Pointer currentTransformCopy
+    = dynamic_cast< CurrentTransformType * >( currentTransform->CreateAnother().GetPointer() );
+  if( currentTransformCopy.IsNull() )
+  {
+    return 0;
+  }
+  currentTransformCopy->SetFixedParameters( currentTransform->GetFixedParameters() );
+  currentTransformCopy->SetParametersByValue( currentTransform->GetParameters() );
+
+  typename CombinationTransformType::Pointer transformCopy = CombinationTransformType::New();
+  transformCopy->SetUseAddition( transform->GetUseAddition() );
+  transformCopy->SetInitialTransform( const_cast< typename CombinationTransformType
+    ::InitialTransformType * >( transform->GetInitialTransform() ) );
+  transformCopy->SetCurrentTransform( currentTransformCopy );
+
+  /** Not all the state of a transform is in its fixed parameters, so check
+   * that the copy maps the center of the fixed image region like the original.
+   */
+  typedef typename AdvancedMetricType::FixedImageRegionType FixedImageRegionType;
+  const FixedImageRegionType & region = thisAsAdvanced->GetFixedImageRegion();
+  itk::ContinuousIndex< double, FixedImageDimension > centerIndex;
+  for( unsigned int d = 0; d < FixedImageDimension; ++d )
+  {
+    centerIndex[ d ] = region.GetIndex()[ d ] + 0.5 * ( region.GetSize()[ d ] - 1.0 );
+  }
+  FixedPointType center;
+  thisAsAdvanced->GetFixedImage()->TransformContinuousIndexToPhysicalPoint( centerIndex, center );
+  if( transformCopy->GetNumberOfParameters() != transform->GetNumberOfParameters()
+    || transformCopy->TransformPoint( center ).EuclideanDistanceTo(
+    transform->TransformPoint( center ) ) > 1e-6 )
+  {
+    return 0;
+  }
+
+  /** Create a metric of the same type, and configure it like this one. */
+  PtrToCreator creator = this->GetElastix()->GetComponentDatabase()
+    ->GetCreator( this->elxGetClassName(), this->GetElastix()->GetDBIndex() );
+  // Note that ObjectType::Pointer() yields a default-constructed SmartPointer (null).
+  ObjectType::Pointer  object         = creator ? creator() : ObjectType::Pointer();
+  Self *               copy           = dynamic_cast< Self * >( object.GetPointer() );
+  AdvancedMetricType * copyAsAdvanced = dynamic_cast< AdvancedMetricType * >( object.GetPointer() );
+  if( copy == 0 || copyAsAdvanced == 0 )
+  {
+    return 0;
+  }
+
+  unsigned int label = 0;
+  while( label < this->GetElastix()->GetNumberOfMetrics()
+    && this->GetElastix()->GetElxMetricBase( label ) != this )
+  {
+    ++label;
+  }
+  copy->SetComponentLabel( "Metric", label );
+  copy->SetElastix( this->GetElastix() );
+  copy->BeforeRegistrationBase();
+  copy->BeforeRegistration();
+  copy->BeforeEachResolutionBase();
+  copy->BeforeEachResolution();
+
+  /** Connect it like the registration connects this metric, but with the
+   * copy of the transform. The shared objects are only read.
+   */
+  copyAsAdvanced->SetFixedImage( thisAsAdvanced->GetFixedImage() );
+  copyAsAdvanced->SetMovingImage( thisAsAdvanced->GetMovingImage() );
+  copyAsAdvanced->SetFixedImageRegion( thisAsAdvanced->GetFixedImageRegion() );
+  copyAsAdvanced->SetFixedImageMask( const_cast< typename AdvancedMetricType
+    ::FixedImageMaskType * >( thisAsAdvanced->GetFixedImageMask() ) );
+  copyAsAdvanced->SetMovingImageMask( const_cast< typename AdvancedMetricType
+    ::MovingImageMaskType * >( thisAsAdvanced->GetMovingImageMask() ) );
+  copyAsAdvanced->SetInterpolator( const_cast< typename AdvancedMetricType
+    ::InterpolatorType * >( thisAsAdvanced->GetInterpolator() ) );
+  copyAsAdvanced->SetTransform( transformCopy );
+  if( thisAsAdvanced->GetUseImageSampler() )
+  {
+    copyAsAdvanced->SetImageSampler( thisAsAdvanced->GetImageSampler() );
+  }
+  copyAsAdvanced->SetUpdateImageSampler( false );
+  copyAsAdvanced->SetUseMultiThread( false );
+  copyAsAdvanced->Initialize();
+
+  return copy->GetAsITKBaseType();
+
+} // end CreateConcurrentCopy()
 
 
 /**
@@ -330,6 +519,30 @@ MetricBase< TElastix >
 } // end GetAdvancedMetricUseImageSampler()
 
 
+/**
+ * ************** GetAdvancedMetricUseFixedImageSampleWeights ***************
+ */
+
+template< class TElastix >
+bool
+MetricBase< TElastix >
+::GetAdvancedMetricUseFixedImageSampleWeights( void ) const
+{
+  /** Cast this to AdvancedMetricType. */
+  const AdvancedMetricType * thisAsAdvancedMetric
+    = dynamic_cast< const AdvancedMetricType * >( this );
+
+  /** If no AdvancedMetricType, return false. */
+  if( thisAsAdvancedMetric == 0 )
+  {
+    return false;
+  }
+
+  return thisAsAdvancedMetric->GetUseFixedImageSampleWeights();
+
+} // end GetAdvancedMetricUseFixedImageSampleWeights()
+
+
 /**
  * ******************* SetAdvancedMetricImageSampler ********************
  */
@@ -24,6 +24,10 @@
 
 #include "elxBaseComponentSE.h"
 #include "itkOptimizer.h"
+#include "itkSingleValuedCostFunction.h"
+#include "itkStochasticConvergenceMonitor.h"
+
+#include <vector>
 
 namespace elastix
 {
@@ -44,6 +48,66 @@ namespace elastix
  *    Choose one from {"true", "false"} for every resolution.\n
  *    example: <tt>(NewSamplesEveryIteration "true" "true" "true")</tt> \n
  *    Default is "false" for every resolution.\n
+ * \parameter UseConvergenceMonitor: if this flag is set to "true", stochastic
+ *    optimizers (AdaptiveStochasticGradientDescent, AdaGrad,
+ *    PreconditionedStochasticGradientDescent and StandardGradientDescent) stop
+ *    a resolution before the MaximumNumberOfIterations when a statistical test
+ *    on the history of the optimization decides that it has converged.
+ *    See itk::StochasticConvergenceMonitor for the criteria.\n
+ *    example: <tt>(UseConvergenceMonitor "true")</tt> \n
+ *    Default is "false" for every resolution.\n
+ * \parameter ConvergenceWindowSize: the number of iterations in which the trend of
+ *    the metric value is estimated.\n
+ *    example: <tt>(ConvergenceWindowSize 100)</tt> \n
+ *    Default is 100 for every resolution.\n
+ * \parameter ConvergenceMinimumNumberOfIterations: the number of iterations before
+ *    which the optimization is never stopped by the convergence monitor.\n
+ *    example: <tt>(ConvergenceMinimumNumberOfIterations 200)</tt> \n
+ *    Default is 0 for every resolution.\n
+ * \parameter ConvergenceRelativeValueTolerance: the optimization has converged if the
+ *    metric value is not expected to decrease more than this fraction of its
+ *    magnitude in the next ConvergenceWindowSize iterations. 0 disables this criterion.\n
+ *    example: <tt>(ConvergenceRelativeValueTolerance 0.001)</tt> \n
+ *    Default is 0.001 for every resolution.\n
+ * \parameter ConvergenceConfidenceFactor: the number of standard errors of the
+ *    estimated trend that is added to the expected decrease of the metric value.\n
+ *    example: <tt>(ConvergenceConfidenceFactor 2.0)</tt> \n
+ *    Default is 2.0 for every resolution.\n
+ * \parameter ConvergenceGradientMagnitudeTolerance: the optimization has converged if
+ *    the smoothed gradient magnitude has dropped below this fraction of its maximum.
+ *    0 disables this criterion.\n
+ *    example: <tt>(ConvergenceGradientMagnitudeTolerance 0.01)</tt> \n
+ *    Default is 0 for every resolution.\n
+ * \parameter ConvergenceSmoothingFactor: the weight of the newest gradient magnitude
+ *    in its exponential moving average, between 0 and 1.\n
+ *    example: <tt>(ConvergenceSmoothingFactor 0.1)</tt> \n
+ *    Default is 0.1 for every resolution.\n
+ * \parameter ConvergenceValidationInterval: every this number of iterations, the
+ *    sum of the metric values on a fixed grid of samples is computed. The
+ *    optimization has converged if this validation value stops improving.
+ *    Only metrics that use an image sampler contribute. 0 disables this criterion.\n
+ *    example: <tt>(ConvergenceValidationInterval 50)</tt> \n
+ *    Default is 0 for every resolution.\n
+ * \parameter ConvergenceValidationNumberOfSamples: the approximate number of samples
+ *    of the fixed grid on which the validation value is computed.\n
+ *    example: <tt>(ConvergenceValidationNumberOfSamples 20000)</tt> \n
+ *    Default is 10000 for every resolution.\n
+ * \parameter ConvergenceValidationPatience: the number of validation values without
+ *    improvement after which the optimization has converged.\n
+ *    example: <tt>(ConvergenceValidationPatience 3)</tt> \n
+ *    Default is 3 for every resolution.\n
+ * \parameter ConvergenceValidationRelativeTolerance: the relative decrease of the best
+ *    validation value that counts as an improvement.\n
+ *    example: <tt>(ConvergenceValidationRelativeTolerance 0.0001)</tt> \n
+ *    Default is 0.0001 for every resolution.\n
+ * \parameter UseConcurrentEvaluation: if this flag is set to "true", optimizers that
+ *    evaluate the metric at several positions per iteration (CMAEvolutionStrategy and
+ *    FullSearch) evaluate these positions concurrently, with a copy of the metric for
+ *    every thread. Only possible if a single metric is used, that inherits from the
+ *    itk::AdvancedImageToImageMetric; otherwise the positions are evaluated one after
+ *    another.\n
+ *    example: <tt>(UseConcurrentEvaluation "false")</tt> \n
+ *    Default is "true" for every resolution.\n
  *
  * \ingroup Optimizers
  * \ingroup ComponentBaseClasses
@@ -75,6 +139,15 @@ public:
   /** Typedef needed for the SetCurrentPositionPublic function. */
   typedef typename ITKBaseType::ParametersType ParametersType;
 
+  /** Typedefs for the copies of the cost function that are evaluated concurrently. */
+  typedef itk::SingleValuedCostFunction                  SingleValuedCostFunctionType;
+  typedef SingleValuedCostFunctionType::Pointer          SingleValuedCostFunctionPointer;
+  typedef std::vector< SingleValuedCostFunctionPointer > SingleValuedCostFunctionContainerType;
+
+  /** Typedefs for the convergence monitor. */
+  typedef itk::StochasticConvergenceMonitor ConvergenceMonitorType;
+  typedef ConvergenceMonitorType::Pointer   ConvergenceMonitorPointer;
+
   /** Cast to ITKBaseType. */
   virtual ITKBaseType * GetAsITKBaseType( void )
   {
@@ -94,6 +167,7 @@ public:
 
   /** Execute stuff before each new pyramid resolution:
    * \li Find out if new samples are used every new iteration in this resolution.
+   * \li Configure the convergence monitor.
    */
   virtual void BeforeEachResolutionBase() ITK_OVERRIDE;
 
@@ -123,6 +197,35 @@ protected:
   /** Check whether the user asked to select new samples every iteration. */
   virtual bool GetNewSamplesEveryIteration( void ) const;
 
+  /** Create a copy of the metric for every thread, for optimizers that
+   * evaluate the cost function at several positions concurrently; see
+   * MetricBase::CreateConcurrentCopy(). The copies share the image sampler of
+   * the metric, which is updated here. No copies are created if the user
+   * set UseConcurrentEvaluation to false, if there is only one thread, if the
+   * cost function is not a single metric, or if the metric can not be copied.
+   * To be called in StartOptimization(), after the registration has
+   * initialized the metric.
+   */
+  virtual void CreateConcurrentCostFunctions(
+    SingleValuedCostFunctionContainerType & costFunctions );
+
+  /** Update the image samplers of the metrics. The concurrent copies of a
+   * metric share its sampler, but do not update it themselves.
+   */
+  virtual void UpdateImageSamplers( void );
+
+  /** Add the metric value and gradient magnitude of the current iteration
+   * to the convergence monitor, and now and then the validation value.
+   * Returns true if the user asked for the convergence monitor and it
+   * decided that the optimization has converged. To be called by stochastic
+   * optimizers in AfterEachIteration().
+   */
+  virtual bool UpdateConvergenceMonitor( const double value,
+    const double gradientMagnitude );
+
+  /** The convergence monitor. */
+  ConvergenceMonitorPointer m_ConvergenceMonitor;
+
 private:
 
   /** The private constructor. */
@@ -135,6 +238,11 @@ private:
    */
   bool m_NewSamplesEveryIteration;
 
+  /** Settings of the convergence monitor. */
+  bool          m_UseConvergenceMonitor;
+  unsigned int  m_ConvergenceValidationInterval;
+  unsigned long m_ConvergenceValidationNumberOfSamples;
+
 };
 
 } // end namespace elastix
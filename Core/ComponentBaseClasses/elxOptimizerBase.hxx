@@ -21,6 +21,7 @@
 #include "elxOptimizerBase.h"
 
 #include "itkSingleValuedNonLinearOptimizer.h"
+#include "itkMultiThreader.h"
 #include "itk_zlib.h"
 
 namespace elastix
@@ -34,7 +35,11 @@ template< class TElastix >
 OptimizerBase< TElastix >
 ::OptimizerBase()
 {
-  this->m_NewSamplesEveryIteration = false;
+  this->m_NewSamplesEveryIteration             = false;
+  this->m_UseConvergenceMonitor                = false;
+  this->m_ConvergenceValidationInterval        = 0;
+  this->m_ConvergenceValidationNumberOfSamples = 10000;
+  this->m_ConvergenceMonitor                   = ConvergenceMonitorType::New();
 
 } // end Constructor
 
@@ -79,6 +84,58 @@ OptimizerBase< TElastix >
   this->GetConfiguration()->ReadParameter( this->m_NewSamplesEveryIteration,
     "NewSamplesEveryIteration", this->GetComponentLabel(), level, 0 );
 
+  /** Check if the convergence monitor may stop the optimization. */
+  this->m_UseConvergenceMonitor = false;
+  this->GetConfiguration()->ReadParameter( this->m_UseConvergenceMonitor,
+    "UseConvergenceMonitor", this->GetComponentLabel(), level, 0 );
+  if( !this->m_UseConvergenceMonitor )
+  {
+    return;
+  }
+
+  /** Read the settings of the convergence monitor. */
+  unsigned int  windowSize                  = 100;
+  unsigned long minimumNumberOfIterations   = 0;
+  double        relativeValueTolerance      = 1e-3;
+  double        confidenceFactor            = 2.0;
+  double        gradientMagnitudeTolerance  = 0.0;
+  double        smoothingFactor             = 0.1;
+  unsigned int  validationPatience          = 3;
+  double        validationRelativeTolerance = 1e-4;
+  this->m_ConvergenceValidationInterval        = 0;
+  this->m_ConvergenceValidationNumberOfSamples = 10000;
+
+  this->GetConfiguration()->ReadParameter( windowSize,
+    "ConvergenceWindowSize", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( minimumNumberOfIterations,
+    "ConvergenceMinimumNumberOfIterations", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( relativeValueTolerance,
+    "ConvergenceRelativeValueTolerance", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( confidenceFactor,
+    "ConvergenceConfidenceFactor", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( gradientMagnitudeTolerance,
+    "ConvergenceGradientMagnitudeTolerance", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( smoothingFactor,
+    "ConvergenceSmoothingFactor", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( this->m_ConvergenceValidationInterval,
+    "ConvergenceValidationInterval", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( this->m_ConvergenceValidationNumberOfSamples,
+    "ConvergenceValidationNumberOfSamples", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( validationPatience,
+    "ConvergenceValidationPatience", this->GetComponentLabel(), level, 0 );
+  this->GetConfiguration()->ReadParameter( validationRelativeTolerance,
+    "ConvergenceValidationRelativeTolerance", this->GetComponentLabel(), level, 0 );
+
+  this->m_ConvergenceMonitor->SetWindowSize( windowSize );
+  this->m_ConvergenceMonitor->SetMinimumNumberOfIterations( minimumNumberOfIterations );
+  this->m_ConvergenceMonitor->SetRelativeValueTolerance( relativeValueTolerance );
+  this->m_ConvergenceMonitor->SetConfidenceFactor( confidenceFactor );
+  this->m_ConvergenceMonitor->SetGradientMagnitudeTolerance( gradientMagnitudeTolerance );
+  this->m_ConvergenceMonitor->SetSmoothingFactor( smoothingFactor );
+  this->m_ConvergenceMonitor->SetValidationPatience( validationPatience );
+  this->m_ConvergenceMonitor->SetValidationRelativeTolerance( validationRelativeTolerance );
+  this->m_ConvergenceMonitor->Initialize();
+
 } // end BeforeEachResolutionBase()
 
 
@@ -151,6 +208,150 @@ OptimizerBase< TElastix >
 } // end GetNewSamplesEveryIteration()
 
 
+/**
+ * ****************** CreateConcurrentCostFunctions ********************
+ */
+
+template< class TElastix >
+void
+OptimizerBase< TElastix >
+::CreateConcurrentCostFunctions( SingleValuedCostFunctionContainerType & costFunctions )
+{
+  costFunctions.clear();
+
+  /** Check if the user wants the concurrent evaluation. */
+  const unsigned int level
+    = this->GetRegistration()->GetAsITKBaseType()->GetCurrentLevel();
+  bool useConcurrentEvaluation = true;
+  this->GetConfiguration()->ReadParameter( useConcurrentEvaluation,
+    "UseConcurrentEvaluation", this->GetComponentLabel(), level, 0 );
+  const unsigned int numberOfThreads
+    = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  if( !useConcurrentEvaluation || numberOfThreads < 2 )
+  {
+    return;
+  }
+
+  /** Only a single metric, that is the cost function itself, can be copied. */
+  const itk::SingleValuedNonLinearOptimizer * optimizer
+    = dynamic_cast< const itk::SingleValuedNonLinearOptimizer * >( this->GetAsITKBaseType() );
+  if( optimizer == 0 || this->GetElastix()->GetNumberOfMetrics() != 1
+    || optimizer->GetCostFunction() != this->GetElastix()->GetElxMetricBase()->GetAsITKBaseType() )
+  {
+    elxout << "The cost function is evaluated one position after another, "
+           << "since it is not a single metric." << std::endl;
+    return;
+  }
+
+  /** The copies share the samples of the metric. */
+  this->UpdateImageSamplers();
+
+  for( unsigned int i = 0; i < numberOfThreads; ++i )
+  {
+    SingleValuedCostFunctionPointer copy
+      = this->GetElastix()->GetElxMetricBase()->CreateConcurrentCopy();
+    if( copy.IsNull() )
+    {
+      elxout << "The cost function is evaluated one position after another, "
+             << "since the metric or transform can not be copied." << std::endl;
+      costFunctions.clear();
+      return;
+    }
+    costFunctions.push_back( copy );
+  }
+
+  elxout << "The cost function is evaluated at " << numberOfThreads
+         << " positions concurrently." << std::endl;
+
+} // end CreateConcurrentCostFunctions()
+
+
+/**
+ * ****************** UpdateImageSamplers ********************
+ */
+
+template< class TElastix >
+void
+OptimizerBase< TElastix >
+::UpdateImageSamplers( void )
+{
+  for( unsigned int i = 0; i < this->GetElastix()->GetNumberOfMetrics(); ++i )
+  {
+    if( this->GetElastix()->GetElxMetricBase( i )->GetAdvancedMetricImageSampler() )
+    {
+      this->GetElastix()->GetElxMetricBase( i )->GetAdvancedMetricImageSampler()->Update();
+    }
+  }
+
+} // end UpdateImageSamplers()
+
+
+/**
+ * ****************** UpdateConvergenceMonitor ********************
+ */
+
+template< class TElastix >
+bool
+OptimizerBase< TElastix >
+::UpdateConvergenceMonitor( const double value, const double gradientMagnitude )
+{
+  if( !this->m_UseConvergenceMonitor )
+  {
+    return false;
+  }
+
+  this->m_ConvergenceMonitor->AddIteration( value, gradientMagnitude );
+
+  /** Now and then compute the metric value on a fixed set of samples. The
+   * values of multiple metrics are simply added, without their weights.
+   */
+  const unsigned long iterationNumber = this->m_ConvergenceMonitor->GetNumberOfIterations();
+  if( this->m_ConvergenceValidationInterval > 0
+    && iterationNumber % this->m_ConvergenceValidationInterval == 0 )
+  {
+    double validationValue = 0.0;
+    for( unsigned int i = 0; i < this->GetElastix()->GetNumberOfMetrics(); ++i )
+    {
+      validationValue += this->GetElastix()->GetElxMetricBase( i )->GetValidationValue(
+        this->GetAsITKBaseType()->GetCurrentPosition(),
+        this->m_ConvergenceValidationNumberOfSamples );
+    }
+    this->m_ConvergenceMonitor->AddValidationValue( validationValue );
+  }
+
+  if( !this->m_ConvergenceMonitor->GetConverged() )
+  {
+    return false;
+  }
+
+  /** Report the criterion that decided the convergence. */
+  std::string criterion;
+  switch( this->m_ConvergenceMonitor->GetConvergenceCriterion() )
+  {
+    case ConvergenceMonitorType::ValueConverged:
+      criterion = "the metric value does not decrease significantly anymore";
+      break;
+
+    case ConvergenceMonitorType::GradientMagnitudeConverged:
+      criterion = "the smoothed gradient magnitude has become small";
+      break;
+
+    case ConvergenceMonitorType::ValidationValueConverged:
+      criterion = "the validation metric value does not improve anymore";
+      break;
+
+    default:
+      criterion = "unknown";
+      break;
+  }
+  elxout << "Convergence detected after " << iterationNumber
+         << " iterations: " << criterion << "." << std::endl;
+
+  return true;
+
+} // end UpdateConvergenceMonitor()
+
+
 /**
  * ****************** SetSinusScales ********************
  */
@@ -28,6 +28,9 @@
 #include "itkImageMaskSpatialObject2.h"
 #include "itkErodeMaskImageFilter.h"
 
+#include <future>
+#include <list>
+
 namespace elastix
 {
 
@@ -66,6 +69,12 @@ namespace elastix
  *    from one resolution level to another. Choose from {"true", "false"} \n
  *    example: <tt>(ErodeMovingMask2 "true" "false")</tt>
  *    This setting overrules ErodeMask and ErodeMovingMask.\n
+ * \parameter ErodeMaskInBackground: a flag to determine if the erosion of the masks
+ *    for the next resolution is started in a background thread, as soon as the masks of
+ *    the current resolution have been eroded. Choose from {"true", "false"} \n
+ *    example: <tt>(ErodeMaskInBackground "true")</tt> \n
+ *    The default is "false". The registration of the current resolution then overlaps
+ *    with the erosion for the next one, at the cost of one extra eroded mask in memory.\n
  *
  * \ingroup Registrations
  * \ingroup ComponentBaseClasses
@@ -210,6 +219,25 @@ protected:
     const MovingMaskImageType * maskImage, bool useMaskErosion,
     const MovingImagePyramidType * pyramid, unsigned int level ) const;
 
+  /** The schedule that determines the amount of erosion. */
+  typedef typename FixedMaskErodeFilterType::ScheduleType MaskErosionScheduleType;
+
+  /** Erode a mask image for a resolution level. If ErodeMaskInBackground
+   * is true, the erosion for the next level is started in the background,
+   * and used when that level is requested.
+   */
+  template< class TMaskImage >
+  typename TMaskImage::Pointer ErodeMask( const TMaskImage * maskImage,
+    const MaskErosionScheduleType & schedule, const bool isMovingMask,
+    const unsigned int level ) const;
+
+  /** Erode a mask image; the work done by ErodeMask(), also in the background. */
+  template< class TMaskImage >
+  static itk::DataObject::Pointer ErodeMaskImage(
+    typename TMaskImage::ConstPointer maskImage,
+    MaskErosionScheduleType schedule, const bool isMovingMask,
+    const unsigned int level );
+
 private:
 
   /** The private constructor. */
@@ -217,6 +245,22 @@ private:
   /** The private copy constructor. */
   void operator=( const Self & );     // purposely not implemented
 
+  /** An erosion that runs in the background. The mask image is held by a
+   * smart pointer, so that its address is not reused by another mask while
+   * the erosion is pending. The same mask may be eroded with the schedules
+   * of several pyramids.
+   */
+  struct BackgroundMaskErosionType
+  {
+    itk::DataObject::ConstPointer           m_MaskImage;
+    MaskErosionScheduleType                 m_Schedule;
+    bool                                    m_IsMovingMask;
+    unsigned int                            m_Level;
+    std::future< itk::DataObject::Pointer > m_ErodedMask;
+  };
+  typedef std::list< BackgroundMaskErosionType > BackgroundMaskErosionListType;
+  mutable BackgroundMaskErosionListType m_BackgroundMaskErosions;
+
 };
 
 } // end namespace elastix
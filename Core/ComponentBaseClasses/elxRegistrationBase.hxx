@@ -119,33 +119,8 @@ RegistrationBase< TElastix >
   }
 
   /** Erode, and convert to spatial object. */
-  FixedMaskErodeFilterPointer erosion = FixedMaskErodeFilterType::New();
-  erosion->SetInput( maskImage );
-  erosion->SetSchedule( pyramid->GetSchedule() );
-  erosion->SetIsMovingMask( false );
-  erosion->SetResolutionLevel( level );
-
-  /** Set output of the erosion to fixedImageMaskAsImage. */
-  FixedMaskImagePointer erodedFixedMaskAsImage = erosion->GetOutput();
-
-  /** Do the erosion. */
-  try
-  {
-    erodedFixedMaskAsImage->Update();
-  }
-  catch( itk::ExceptionObject & excp )
-  {
-    /** Add information to the exception. */
-    excp.SetLocation( "RegistrationBase - UpdateMasks()" );
-    std::string err_str = excp.GetDescription();
-    err_str += "\nError while eroding the fixed mask.\n";
-    excp.SetDescription( err_str );
-    /** Pass the exception to an higher level. */
-    throw excp;
-  }
-
-  /** Release some memory. */
-  erodedFixedMaskAsImage->DisconnectPipeline();
+  FixedMaskImagePointer erodedFixedMaskAsImage = this->ErodeMask(
+    maskImage, pyramid->GetSchedule(), false, level );
 
   fixedMaskSpatialObject->SetImage( erodedFixedMaskAsImage );
   return fixedMaskSpatialObject;
@@ -179,38 +154,124 @@ RegistrationBase< TElastix >
   }
 
   /** Erode, and convert to spatial object. */
-  MovingMaskErodeFilterPointer erosion = MovingMaskErodeFilterType::New();
+  MovingMaskImagePointer erodedMovingMaskAsImage = this->ErodeMask(
+    maskImage, pyramid->GetSchedule(), true, level );
+
+  movingMaskSpatialObject->SetImage( erodedMovingMaskAsImage );
+  return movingMaskSpatialObject;
+
+} // end GenerateMovingMaskSpatialObject()
+
+
+/**
+ * ******************* ErodeMask **********************
+ */
+
+template< class TElastix >
+template< class TMaskImage >
+typename TMaskImage::Pointer
+RegistrationBase< TElastix >
+::ErodeMask( const TMaskImage * maskImage, const MaskErosionScheduleType & schedule,
+  const bool isMovingMask, const unsigned int level ) const
+{
+  /** Wait for the erosion of this level, if it was started in the background.
+   * Erosions for other levels of this mask and schedule are not used anymore.
+   */
+  itk::DataObject::Pointer erodedMask;
+  typename BackgroundMaskErosionListType::iterator it = this->m_BackgroundMaskErosions.begin();
+  while( it != this->m_BackgroundMaskErosions.end() )
+  {
+    if( it->m_MaskImage.GetPointer() == maskImage && it->m_IsMovingMask == isMovingMask
+      && it->m_Schedule == schedule )
+    {
+      if( it->m_Level == level )
+      {
+        erodedMask = it->m_ErodedMask.get();
+      }
+      it = this->m_BackgroundMaskErosions.erase( it );
+    }
+    else
+    {
+      ++it;
+    }
+  }
+
+  if( erodedMask.IsNull() )
+  {
+    erodedMask = ErodeMaskImage< TMaskImage >( maskImage, schedule, isMovingMask, level );
+  }
+
+  /** Start the erosion for the next level. The background thread works on a
+   * graft of the mask image, so that it does not touch the pipeline of the mask.
+   */
+  bool erodeInBackground = false;
+  this->GetConfiguration()->ReadParameter( erodeInBackground,
+    "ErodeMaskInBackground", 0, false );
+  if( erodeInBackground && level + 1 < schedule.rows() )
+  {
+    typename TMaskImage::Pointer maskGraft = TMaskImage::New();
+    maskGraft->Graft( maskImage );
+    this->m_BackgroundMaskErosions.push_back( BackgroundMaskErosionType() );
+    BackgroundMaskErosionType & erosion = this->m_BackgroundMaskErosions.back();
+    erosion.m_MaskImage    = maskImage;
+    erosion.m_Schedule     = schedule;
+    erosion.m_IsMovingMask = isMovingMask;
+    erosion.m_Level        = level + 1;
+    erosion.m_ErodedMask   = std::async( std::launch::async, &Self::template ErodeMaskImage< TMaskImage >,
+      typename TMaskImage::ConstPointer( maskGraft.GetPointer() ), schedule, isMovingMask, level + 1 );
+  }
+
+  return dynamic_cast< TMaskImage * >( erodedMask.GetPointer() );
+
+} // end ErodeMask()
+
+
+/**
+ * ******************* ErodeMaskImage **********************
+ */
+
+template< class TElastix >
+template< class TMaskImage >
+itk::DataObject::Pointer
+RegistrationBase< TElastix >
+::ErodeMaskImage( typename TMaskImage::ConstPointer maskImage,
+  MaskErosionScheduleType schedule, const bool isMovingMask,
+  const unsigned int level )
+{
+  typedef itk::ErodeMaskImageFilter< TMaskImage > ErodeFilterType;
+  typename ErodeFilterType::Pointer erosion = ErodeFilterType::New();
   erosion->SetInput( maskImage );
-  erosion->SetSchedule( pyramid->GetSchedule() );
-  erosion->SetIsMovingMask( true );
+  erosion->SetSchedule( schedule );
+  erosion->SetIsMovingMask( isMovingMask );
   erosion->SetResolutionLevel( level );
 
-  /** Set output of the erosion to movingImageMaskAsImage. */
-  MovingMaskImagePointer erodedMovingMaskAsImage = erosion->GetOutput();
+  /** Set output of the erosion to erodedMaskAsImage. */
+  typename TMaskImage::Pointer erodedMaskAsImage = erosion->GetOutput();
 
   /** Do the erosion. */
   try
   {
-    erodedMovingMaskAsImage->Update();
+    erodedMaskAsImage->Update();
   }
   catch( itk::ExceptionObject & excp )
   {
     /** Add information to the exception. */
     excp.SetLocation( "RegistrationBase - UpdateMasks()" );
     std::string err_str = excp.GetDescription();
-    err_str += "\nError while eroding the moving mask.\n";
+    err_str += isMovingMask
+      ? "\nError while eroding the moving mask.\n"
+      : "\nError while eroding the fixed mask.\n";
     excp.SetDescription( err_str );
     /** Pass the exception to an higher level. */
     throw excp;
   }
 
-  /** Release some memory */
-  erodedMovingMaskAsImage->DisconnectPipeline();
+  /** Release some memory. */
+  erodedMaskAsImage->DisconnectPipeline();
 
-  movingMaskSpatialObject->SetImage( erodedMovingMaskAsImage );
-  return movingMaskSpatialObject;
+  return erodedMaskAsImage.GetPointer();
 
-} // end GenerateMovingMaskSpatialObject()
+} // end ErodeMaskImage()
 
 
 } // end namespace elastix
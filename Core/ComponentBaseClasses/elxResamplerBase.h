@@ -64,6 +64,16 @@ namespace elastix
  *    of the written image is desired.\n
  *    example: <tt>(CompressResultImage "true")</tt> \n
  *    The default is "false".
+ * \parameter NumberOfStreamDivisions: the number of slabs in which the result image
+ *    is resampled and written. Only one slab of the result image is kept in memory at
+ *    a time, so that images larger than the available memory can be produced. This
+ *    requires a file format that supports streamed writing, such as mhd, mha or nrrd,
+ *    without compression; otherwise the image is written at once. When the result
+ *    image is kept in memory, as in the elastix library, the resampling is still
+ *    done in slabs, which avoids holding the image in both pixel types. The
+ *    spatial Jacobian images of transformix, -jac and -jacmat, are streamed likewise.\n
+ *    example: <tt>(NumberOfStreamDivisions 16)</tt> \n
+ *    The default is 1, meaning no streaming.
  *
  * \ingroup Resamplers
  * \ingroup ComponentBaseClasses
@@ -191,6 +201,9 @@ protected:
   /** Method that sets the transform, the interpolator and the inputImage. */
   virtual void SetComponents( void );
 
+  /** Read the number of slabs in which the result image is produced. */
+  unsigned int GetNumberOfStreamDivisions( void ) const;
+
   /** Variable that defines to print the progress or not. */
   bool m_ShowProgress;
 
@@ -204,6 +217,13 @@ private:
   /** Release memory. */
   void ReleaseMemory( void );
 
+  /** Cast the result image to the pixel type TResultPixel, resampling it
+   * in the given number of slabs.
+   */
+  template< class TResultPixel >
+  itk::DataObject::Pointer CastResultImage( OutputImageType * image,
+    const unsigned int numberOfStreamDivisions ) const;
+
 };
 
 } // end namespace elastix
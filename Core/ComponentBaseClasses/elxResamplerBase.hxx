@@ -22,9 +22,12 @@
 
 #include "itkImageFileCastWriter.h"
 #include "itkChangeInformationImageFilter.h"
+#include "itkStreamingImageFilter.h"
 #include "itkAdvancedRayCastInterpolateImageFunction.h"
 #include "itkTimeProbe.h"
 
+#include <algorithm>
+
 namespace elastix
 {
 
@@ -337,21 +340,26 @@ ResamplerBase< TElastix >
   }
 #endif
 
-  /** Do the resampling. */
-  try
-  {
-    this->GetAsITKBaseType()->Update();
-  }
-  catch( itk::ExceptionObject & excp )
+  /** Do the resampling. When streaming, the writer resamples the image
+   * slab by slab instead.
+   */
+  if( this->GetNumberOfStreamDivisions() == 1 )
   {
-    /** Add information to the exception. */
-    excp.SetLocation( "ResamplerBase - WriteResultImage()" );
-    std::string err_str = excp.GetDescription();
-    err_str += "\nError occurred while resampling the image.\n";
-    excp.SetDescription( err_str );
-
-    /** Pass the exception to an higher level. */
-    throw excp;
+    try
+    {
+      this->GetAsITKBaseType()->Update();
+    }
+    catch( itk::ExceptionObject & excp )
+    {
+      /** Add information to the exception. */
+      excp.SetLocation( "ResamplerBase - WriteResultImage()" );
+      std::string err_str = excp.GetDescription();
+      err_str += "\nError occurred while resampling the image.\n";
+      excp.SetDescription( err_str );
+
+      /** Pass the exception to an higher level. */
+      throw excp;
+    }
   }
 
   /** Perform the writing. */
@@ -424,6 +432,14 @@ ResamplerBase< TElastix >
   infoChanger->SetChangeDirection( retdc & !this->GetElastix()->GetUseDirectionCosines() );
   infoChanger->SetInput( image );
 
+  /** Read the number of slabs in which the image is written. */
+  const unsigned int numberOfStreamDivisions = this->GetNumberOfStreamDivisions();
+  if( numberOfStreamDivisions > 1 && doCompression )
+  {
+    xl::xout[ "warning" ] << "WARNING: most image formats do not support streamed writing "
+                          << "with compression. The result image may be written at once." << std::endl;
+  }
+
   /** Create writer. */
   WriterPointer writer = WriterType::New();
 
@@ -432,6 +448,7 @@ ResamplerBase< TElastix >
   writer->SetFileName( filename );
   writer->SetOutputComponentType( resultImagePixelType.c_str() );
   writer->SetUseCompression( doCompression );
+  writer->SetNumberOfStreamDivisions( numberOfStreamDivisions );
 
   /** Do the writing. */
   if( showProgress )
@@ -480,21 +497,27 @@ ResamplerBase< TElastix >
   progressObserver->SetEndString( "%" );
 #endif
 
-  /** Do the resampling. */
-  try
-  {
-    this->GetAsITKBaseType()->Update();
-  }
-  catch( itk::ExceptionObject & excp )
+  /** Do the resampling. When streaming, the resampling is done slab by
+   * slab while casting.
+   */
+  const unsigned int numberOfStreamDivisions = this->GetNumberOfStreamDivisions();
+  if( numberOfStreamDivisions == 1 )
   {
-    /** Add information to the exception. */
-    excp.SetLocation( "ResamplerBase - WriteResultImage()" );
-    std::string err_str = excp.GetDescription();
-    err_str += "\nError occurred while resampling the image.\n";
-    excp.SetDescription( err_str );
-
-    /** Pass the exception to an higher level. */
-    throw excp;
+    try
+    {
+      this->GetAsITKBaseType()->Update();
+    }
+    catch( itk::ExceptionObject & excp )
+    {
+      /** Add information to the exception. */
+      excp.SetLocation( "ResamplerBase - WriteResultImage()" );
+      std::string err_str = excp.GetDescription();
+      err_str += "\nError occurred while resampling the image.\n";
+      excp.SetDescription( err_str );
+
+      /** Pass the exception to an higher level. */
+      throw excp;
+    }
   }
 
   /** Check if ResampleInterpolator is the RayCastResampleInterpolator */
@@ -533,97 +556,46 @@ ResamplerBase< TElastix >
   infoChanger->SetChangeDirection( retdc & !this->GetElastix()->GetUseDirectionCosines() );
   infoChanger->SetInput( this->GetAsITKBaseType()->GetOutput() );
 
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< char, InputImageType::ImageDimension > >            CastFilterChar;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< unsigned char, InputImageType::ImageDimension > >   CastFilterUChar;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< short, InputImageType::ImageDimension > >           CastFilterShort;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< unsigned short, InputImageType::ImageDimension > >  CastFilterUShort;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< int, InputImageType::ImageDimension > >             CastFilterInt;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< unsigned int, InputImageType::ImageDimension > >    CastFilterUInt;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< long, InputImageType::ImageDimension > >            CastFilterLong;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< unsigned long, InputImageType::ImageDimension > >  CastFilterULong;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< float, InputImageType::ImageDimension > >           CastFilterFloat;
-  typedef itk::CastImageFilter< InputImageType,
-    itk::Image< double, InputImageType::ImageDimension > >          CastFilterDouble;
-
   /** cast the image to the correct output image Type */
   if( resultImagePixelType.compare( "char" ) == 0 )
   {
-    typename CastFilterChar::Pointer castFilter = CastFilterChar::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< char >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   if( resultImagePixelType.compare( "unsigned char" ) == 0 )
   {
-    typename CastFilterUChar::Pointer castFilter = CastFilterUChar::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< unsigned char >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   else if( resultImagePixelType.compare( "short" ) == 0 )
   {
-    typename CastFilterShort::Pointer castFilter = CastFilterShort::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< short >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   else if( resultImagePixelType.compare( "ushort" ) == 0 || resultImagePixelType.compare( "unsigned short" ) == 0 ) // <-- ushort for backwards compatibility
   {
-    typename CastFilterUShort::Pointer castFilter = CastFilterUShort::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< unsigned short >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   else if( resultImagePixelType.compare( "int" ) == 0 )
   {
-    typename CastFilterInt::Pointer castFilter = CastFilterInt::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< int >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   else if( resultImagePixelType.compare( "unsigned int" ) == 0 )
   {
-    typename CastFilterUInt::Pointer castFilter = CastFilterUInt::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< unsigned int >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   else if( resultImagePixelType.compare( "long" ) == 0 )
   {
-    typename CastFilterLong::Pointer castFilter = CastFilterLong::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< long >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   else if( resultImagePixelType.compare( "unsigned long" ) == 0 )
   {
-    typename CastFilterULong::Pointer castFilter = CastFilterULong::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< unsigned long >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   else if( resultImagePixelType.compare( "float" ) == 0 )
   {
-    typename CastFilterFloat::Pointer castFilter = CastFilterFloat::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< float >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
   else if( resultImagePixelType.compare( "double" ) == 0 )
   {
-    typename CastFilterDouble::Pointer castFilter = CastFilterDouble::New();
-    castFilter->SetInput( infoChanger->GetOutput() );
-    castFilter->Update();
-    resultImage = castFilter->GetOutput();
+    resultImage = this->template CastResultImage< double >( infoChanger->GetOutput(), numberOfStreamDivisions );
   }
 
   if( resultImage.IsNull() )
@@ -644,6 +616,58 @@ ResamplerBase< TElastix >
 } // end CreateItkResultImage()
 
 
+/**
+ * ******************* CastResultImage ********************
+ */
+
+template< class TElastix >
+template< class TResultPixel >
+itk::DataObject::Pointer
+ResamplerBase< TElastix >
+::CastResultImage( OutputImageType * image,
+  const unsigned int numberOfStreamDivisions ) const
+{
+  typedef itk::Image< TResultPixel, ImageDimension >                    ResultImageType;
+  typedef itk::CastImageFilter< OutputImageType, ResultImageType >      CastFilterType;
+  typedef itk::StreamingImageFilter< ResultImageType, ResultImageType > StreamerType;
+
+  typename CastFilterType::Pointer castFilter = CastFilterType::New();
+  castFilter->SetInput( image );
+  if( numberOfStreamDivisions == 1 )
+  {
+    castFilter->Update();
+    return castFilter->GetOutput();
+  }
+
+  /** The streamer requests the image slab by slab, and assembles the
+   * result, so that only one slab of the resampled image is in memory.
+   */
+  typename StreamerType::Pointer streamer = StreamerType::New();
+  streamer->SetInput( castFilter->GetOutput() );
+  streamer->SetNumberOfStreamDivisions( numberOfStreamDivisions );
+  streamer->Update();
+  return streamer->GetOutput();
+
+} // end CastResultImage()
+
+
+/**
+ * ******************* GetNumberOfStreamDivisions ********************
+ */
+
+template< class TElastix >
+unsigned int
+ResamplerBase< TElastix >
+::GetNumberOfStreamDivisions( void ) const
+{
+  unsigned int numberOfStreamDivisions = 1;
+  this->m_Configuration->ReadParameter(
+    numberOfStreamDivisions, "NumberOfStreamDivisions", 0, false );
+  return std::max( numberOfStreamDivisions, 1u );
+
+} // end GetNumberOfStreamDivisions()
+
+
 /*
  * ************************* ReadFromFile ***********************
  */
@@ -774,6 +798,10 @@ ResamplerBase< TElastix >
   xl::xout[ "transpar" ] << "(CompressResultImage \""
                          << doCompression << "\")" << std::endl;
 
+  /** Write the number of slabs in which the result image is produced. */
+  xl::xout[ "transpar" ] << "(NumberOfStreamDivisions "
+                         << this->GetNumberOfStreamDivisions() << ")" << std::endl;
+
 } // end WriteToFile()
 
 
@@ -830,6 +858,14 @@ ResamplerBase< TElastix >
   paramsMap->insert( make_pair( parameterName, parameterValues ) );
   parameterValues.clear();
 
+  /** Write the number of slabs in which the result image is produced. */
+  std::ostringstream strNumberOfStreamDivisions;
+  strNumberOfStreamDivisions << this->GetNumberOfStreamDivisions();
+  parameterName = "NumberOfStreamDivisions";
+  parameterValues.push_back( strNumberOfStreamDivisions.str() );
+  paramsMap->insert( make_pair( parameterName, parameterValues ) );
+  parameterValues.clear();
+
 } // end CreateTransformParametersMap()
 
 
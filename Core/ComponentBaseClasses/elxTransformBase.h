@@ -26,6 +26,7 @@
 #include "itkAdvancedCombinationTransform.h"
 #include "elxComponentDatabase.h"
 #include "elxProgressCommand.h"
+#include "itkTransformParametersBinaryFile.h"
 
 #include <fstream>
 #include <iomanip>
@@ -99,6 +100,15 @@ namespace elastix
  * The number of entries is stored the NumberOfParameters entry.
  * \transformparameter NumberOfParameters: the length of the transform parameter vector.\n
  * example <tt>(NumberOfParameters 722)</tt>\n
+ * \transformparameter UseBinaryFormatForTransformationParameters: if "true", the
+ * TransformParameters entry contains the name of a binary file with the parameters,
+ * see itk::TransformParametersBinaryFile. Transformix maps this file into memory, instead
+ * of parsing the parameters as text. A relative file name is relative to the directory
+ * of the transform parameter file. Headerless files written by older versions are
+ * still read.\n
+ * example <tt>(TransformParameters "TransformParameters.0.txt.dat")</tt>\n
+ * example <tt>(UseBinaryFormatForTransformationParameters "true")</tt>\n
+ * Default: "false".
  * \transformparameter InitialTransformParametersFileName: The location/name of an initial
  * transform that will be loaded when loading the current transform parameter file. Note
  * that transform parameter file can also contain an initial transform. Recursively all
@@ -378,6 +388,17 @@ private:
   /** Boolean to decide whether or not the transform parameters are written in binary format. */
   bool m_UseBinaryFormatForTransformationParameters;
 
+  /** The binary file the transform parameters were read from. It is kept
+   * open, because m_TransformParametersPointer points into its memory.
+   */
+  itk::TransformParametersBinaryFile::Pointer m_TransformParametersBinaryFile;
+
+  /** The full name of the binary file the last WriteToFile() wrote the
+   * transform parameters to, and the number of parameters it wrote.
+   */
+  mutable std::string   m_WrittenTransformParametersBinaryFileName;
+  mutable unsigned int  m_WrittenTransformParametersBinaryFileSize;
+
 };
 
 } // end namespace elastix
@@ -26,7 +26,7 @@
 #include "vnl/vnl_math.h"
 #include <itksys/SystemTools.hxx>
 #include "itkVector.h"
-#include "itkTransformToDisplacementFieldFilter.h"
+#include "itkTransformToDisplacementFieldSource.h"
 #include "itkTransformToDeterminantOfSpatialJacobianSource.h"
 #include "itkTransformToSpatialJacobianSource.h"
 #include "itkImageFileWriter.h"
@@ -37,6 +37,7 @@
 #include "itkMeshFileReader.h"
 #include "itkMeshFileWriter.h"
 #include "itkTransformMeshFilter.h"
+#include <algorithm>
 
 namespace itk
 {
@@ -113,6 +114,7 @@ TransformBase< TElastix >
   this->m_TransformParametersPointer   = 0;
   this->m_ReadWriteTransformParameters = true;
   this->m_UseBinaryFormatForTransformationParameters = false;
+  this->m_WrittenTransformParametersBinaryFileSize    = 0;
 
 } // end Constructor()
 
@@ -415,23 +417,60 @@ TransformBase< TElastix >
     if( this->m_TransformParametersPointer )
     {
       delete this->m_TransformParametersPointer;
+      this->m_TransformParametersPointer = 0;
     }
-    this->m_TransformParametersPointer = new ParametersType( numberOfParameters );
 
     /** Read the TransformParameters. */
     std::size_t numberOfParametersFound = 0;
     std::vector< ValueType > vecPar;
     if( useBinaryFormatForTransformationParameters )
     {
+      /** A relative file name is relative to the transform parameter file,
+       * or else to the current directory, as in older versions.
+       */
       std::string dataFileName = "";
       this->m_Configuration->ReadParameter( dataFileName, "TransformParameters", 0 );
-      std::ifstream infile( dataFileName.c_str(), std::ios::in | std::ios::binary );
-      infile.read( reinterpret_cast<char *>( this->m_TransformParametersPointer->data_block() ), sizeof( ValueType ) * numberOfParameters );
-      numberOfParametersFound = infile.gcount() / sizeof( ValueType ); // for sanity check
-      infile.close();
+      if( !itksys::SystemTools::FileIsFullPath( dataFileName.c_str() ) )
+      {
+        const std::string parameterFilePath = itksys::SystemTools::GetFilenamePath(
+          this->m_Configuration->GetParameterFileName() );
+        const std::string relativeFileName = parameterFilePath.empty()
+          ? dataFileName : parameterFilePath + "/" + dataFileName;
+        if( itksys::SystemTools::FileExists( relativeFileName.c_str(), true ) )
+        {
+          dataFileName = relativeFileName;
+        }
+      }
+
+      if( itk::TransformParametersBinaryFile::IsBinaryFile( dataFileName ) )
+      {
+        /** Map the file, and let the parameters point into the mapping,
+         * so they do not allocate memory of their own.
+         */
+        this->m_TransformParametersPointer = new ParametersType();
+        this->m_TransformParametersBinaryFile = itk::TransformParametersBinaryFile::New();
+        this->m_TransformParametersBinaryFile->SetFileName( dataFileName );
+        this->m_TransformParametersBinaryFile->Read();
+        numberOfParametersFound = this->m_TransformParametersBinaryFile->GetNumberOfParameters();
+        if( numberOfParametersFound == numberOfParameters )
+        {
+          this->m_TransformParametersPointer->SetData( const_cast< ValueType * >(
+            this->m_TransformParametersBinaryFile->GetParameters() ), numberOfParameters, false );
+        }
+      }
+      else
+      {
+        /** A file without header, written by an older version. */
+        this->m_TransformParametersPointer = new ParametersType( numberOfParameters );
+        std::ifstream infile( dataFileName.c_str(), std::ios::in | std::ios::binary );
+        infile.read( reinterpret_cast<char *>( this->m_TransformParametersPointer->data_block() ), sizeof( ValueType ) * numberOfParameters );
+        numberOfParametersFound = infile.gcount() / sizeof( ValueType ); // for sanity check
+        infile.close();
+      }
     }
     else
     {
+      this->m_TransformParametersPointer = new ParametersType( numberOfParameters );
       vecPar.resize( numberOfParameters, itk::NumericTraits< ValueType >::ZeroValue() );
       this->m_Configuration->ReadParameter( vecPar, "TransformParameters",
         0, numberOfParameters - 1, true );
@@ -699,14 +738,21 @@ TransformBase< TElastix >
   {
     if( this->m_UseBinaryFormatForTransformationParameters )
     {
-      /** Writing in binary format is faster for large vectors, and slightly more accurate. */
+      /** Writing in binary format is faster for large vectors, and slightly more accurate.
+       * Only the file name is written, so that the output directory can be moved.
+       */
       std::string dataFileName = this->GetTransformParametersFileName();
       dataFileName += ".dat";
-      xout[ "transpar" ] << "(TransformParameters \"" << dataFileName << "\")" << std::endl;
+      xout[ "transpar" ] << "(TransformParameters \""
+                         << itksys::SystemTools::GetFilenameName( dataFileName ) << "\")" << std::endl;
+
+      itk::TransformParametersBinaryFile::Pointer binaryFile = itk::TransformParametersBinaryFile::New();
+      binaryFile->SetFileName( dataFileName );
+      binaryFile->Write( param.data_block(), nrP );
 
-      std::ofstream outfile( dataFileName.c_str(), ios::out | ios::binary );
-      outfile.write( reinterpret_cast<const char *>( param.data_block() ), sizeof( ValueType ) * nrP );
-      outfile.close();
+      /** Remember the file, for CreateTransformParametersMap(). */
+      this->m_WrittenTransformParametersBinaryFileName = itksys::SystemTools::CollapseFullPath( dataFileName );
+      this->m_WrittenTransformParametersBinaryFileSize = nrP;
     }
     else
     {
@@ -890,20 +936,48 @@ TransformBase< TElastix >
   paramsMap->insert( make_pair( parameterName, parameterValues ) );
   parameterValues.clear();
 
-  /** Write the parameters of this transform. */
+  /** Write the parameters of this transform. If WriteToFile() wrote these
+   * parameters to a binary file, refer to that file, which is faster for
+   * large vectors than converting them to text. The elastix template
+   * passes the same parameters to WriteToFile() and to this function, so
+   * the file is not read back; only its name and size are checked.
+   */
+  std::string dataFileName = "";
+  if( this->m_UseBinaryFormatForTransformationParameters
+    && !this->m_TransformParametersFileName.empty()
+    && this->m_WrittenTransformParametersBinaryFileSize == nrP
+    && this->m_WrittenTransformParametersBinaryFileName
+    == itksys::SystemTools::CollapseFullPath( this->m_TransformParametersFileName + ".dat" ) )
+  {
+    dataFileName = this->m_WrittenTransformParametersBinaryFileName;
+  }
+
   if( this->m_ReadWriteTransformParameters )
   {
-    /** In this case, write in a normal way to the parameter file. */
     parameterName = "TransformParameters";
-    for( unsigned int i = 0; i < nrP; i++ )
+    if( !dataFileName.empty() )
     {
-      tmpStream.str( "" ); tmpStream << param[ i ];
-      parameterValues.push_back( tmpStream.str() );
+      parameterValues.push_back( dataFileName );
+    }
+    else
+    {
+      /** In this case, write in a normal way to the parameter file. */
+      for( unsigned int i = 0; i < nrP; i++ )
+      {
+        tmpStream.str( "" ); tmpStream << param[ i ];
+        parameterValues.push_back( tmpStream.str() );
+      }
     }
     paramsMap->insert( make_pair( parameterName, parameterValues ) );
     parameterValues.clear();
   }
 
+  /** Write the way the transform parameters are written. */
+  parameterName = "UseBinaryFormatForTransformationParameters";
+  parameterValues.push_back( dataFileName.empty() ? "false" : "true" );
+  paramsMap->insert( make_pair( parameterName, parameterValues ) );
+  parameterValues.clear();
+
   /** Write the name of the parameters-file of the initial transform. */
   parameterName = "InitialTransformParametersFileName";
   parameterValues.push_back( this->GetInitialTransformParametersFileName() );
@@ -1495,21 +1569,23 @@ TransformBase< TElastix >
 {
   /** Typedef's. */
   typedef typename FixedImageType::DirectionType FixedImageDirectionType;
-  typedef itk::TransformToDisplacementFieldFilter<
+  typedef itk::TransformToDisplacementFieldSource<
     DeformationFieldImageType, CoordRepType >         DeformationFieldGeneratorType;
   typedef itk::ChangeInformationImageFilter<
     DeformationFieldImageType >                       ChangeInfoFilterType;
 
-  /** Create an setup deformation field generator. */
+  /** Create an setup deformation field generator. B-spline transforms,
+   * also when added to other transforms, are evaluated separably.
+   */
   typename DeformationFieldGeneratorType::Pointer defGenerator
     = DeformationFieldGeneratorType::New();
-  defGenerator->SetSize(
+  defGenerator->SetOutputSize(
     this->m_Elastix->GetElxResamplerBase()->GetAsITKBaseType()->GetSize() );
   defGenerator->SetOutputSpacing(
     this->m_Elastix->GetElxResamplerBase()->GetAsITKBaseType()->GetOutputSpacing() );
   defGenerator->SetOutputOrigin(
     this->m_Elastix->GetElxResamplerBase()->GetAsITKBaseType()->GetOutputOrigin() );
-  defGenerator->SetOutputStartIndex(
+  defGenerator->SetOutputIndex(
     this->m_Elastix->GetElxResamplerBase()->GetAsITKBaseType()->GetOutputStartIndex() );
   defGenerator->SetOutputDirection(
     this->m_Elastix->GetElxResamplerBase()->GetAsITKBaseType()->GetOutputDirection() );
@@ -1681,6 +1757,14 @@ TransformBase< TElastix >
   jacWriter->SetInput( infoChanger->GetOutput() );
   jacWriter->SetFileName( makeFileName.str().c_str() );
 
+  /** Stream the output in slabs, to limit the memory use for large images.
+   * B-spline transforms are evaluated separably within each slab.
+   */
+  unsigned int numberOfStreamDivisions = 1;
+  this->m_Configuration->ReadParameter(
+    numberOfStreamDivisions, "NumberOfStreamDivisions", 0, false );
+  jacWriter->SetNumberOfStreamDivisions( std::max( numberOfStreamDivisions, 1u ) );
+
   /** Do the writing. */
   elxout << "  Computing and writing the spatial Jacobian determinant..." << std::endl;
   try
@@ -1791,6 +1875,12 @@ TransformBase< TElastix >
     jacWriter->AddObserver( itk::StartEvent(), jacStartWriteCommand );
   }
 
+  /** Stream the output in slabs, as for the determinant. */
+  unsigned int numberOfStreamDivisions = 1;
+  this->m_Configuration->ReadParameter(
+    numberOfStreamDivisions, "NumberOfStreamDivisions", 0, false );
+  jacWriter->SetNumberOfStreamDivisions( std::max( numberOfStreamDivisions, 1u ) );
+
   /** Do the writing. */
   elxout << "  Computing and writing the spatial Jacobian..." << std::endl;
   try
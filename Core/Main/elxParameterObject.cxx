@@ -194,7 +194,9 @@ ParameterObject
   ParameterFileParserPointer parameterFileParser = ParameterFileParserType::New();
   parameterFileParser->SetParameterFileName( parameterFileName );
   parameterFileParser->ReadParameterFile();
-  this->SetParameterMap( ParameterMapVectorType( 1, parameterFileParser->GetParameterMap() ) );
+  ParameterMapType parameterMap = parameterFileParser->GetParameterMap();
+  ResolveBinaryTransformParametersFileName( parameterMap, parameterFileName );
+  this->SetParameterMap( ParameterMapVectorType( 1, parameterMap ) );
 }
 
 
@@ -236,7 +238,41 @@ ParameterObject
   ParameterFileParserPointer parameterFileParser = ParameterFileParserType::New();
   parameterFileParser->SetParameterFileName( parameterFileName );
   parameterFileParser->ReadParameterFile();
-  this->m_ParameterMap.push_back( parameterFileParser->GetParameterMap() );
+  ParameterMapType parameterMap = parameterFileParser->GetParameterMap();
+  ResolveBinaryTransformParametersFileName( parameterMap, parameterFileName );
+  this->m_ParameterMap.push_back( parameterMap );
+}
+
+
+/**
+ * ********************* ResolveBinaryTransformParametersFileName *********************
+ */
+
+void
+ParameterObject
+::ResolveBinaryTransformParametersFileName( ParameterMapType & parameterMap,
+  const ParameterFileNameType & parameterFileName )
+{
+  // A binary parameter file is stored next to the transform parameter file
+  // that refers to it. Make its name absolute, so that the map can be used
+  // from any directory, e.g. by the TransformixFilter.
+  ParameterMapIterator useBinaryFormat = parameterMap.find( "UseBinaryFormatForTransformationParameters" );
+  ParameterMapIterator transformParameters = parameterMap.find( "TransformParameters" );
+  if( useBinaryFormat == parameterMap.end() || useBinaryFormat->second.size() != 1
+    || useBinaryFormat->second[ 0 ] != "true"
+    || transformParameters == parameterMap.end() || transformParameters->second.size() != 1
+    || itksys::SystemTools::FileIsFullPath( transformParameters->second[ 0 ].c_str() ) )
+  {
+    return;
+  }
+
+  const std::string dataFileName = itksys::SystemTools::CollapseFullPath(
+    transformParameters->second[ 0 ], itksys::SystemTools::GetFilenamePath(
+    itksys::SystemTools::CollapseFullPath( parameterFileName ) ) );
+  if( itksys::SystemTools::FileExists( dataFileName.c_str(), true ) )
+  {
+    transformParameters->second[ 0 ] = dataFileName;
+  }
 }
 
 
@@ -95,6 +95,10 @@ protected:
 
 private:
 
+  /* Make the name of a binary transform parameter file relative to the parameter file absolute. */
+  static void ResolveBinaryTransformParametersFileName( ParameterMapType & parameterMap,
+    const ParameterFileNameType & parameterFileName );
+
   ParameterMapVectorType m_ParameterMap;
 
 };
@@ -60,12 +60,13 @@ public:
   typedef TransformixMainType::DataObjectContainerType    DataObjectContainerType;
   typedef TransformixMainType::DataObjectContainerPointer DataObjectContainerPointer;
 
-  typedef ParameterObject                               ParameterObjectType;
-  typedef ParameterObjectType::ParameterMapVectorType   ParameterMapVectorType;
-  typedef ParameterObjectType::ParameterMapType         ParameterMapType;
-  typedef ParameterObjectType::ParameterValueVectorType ParameterValueVectorType;
-  typedef typename ParameterObjectType::Pointer         ParameterObjectPointer;
-  typedef typename ParameterObjectType::ConstPointer    ParameterObjectConstPointer;
+  typedef ParameterObject                                ParameterObjectType;
+  typedef ParameterObjectType::ParameterMapVectorType    ParameterMapVectorType;
+  typedef ParameterObjectType::ParameterMapType          ParameterMapType;
+  typedef ParameterObjectType::ParameterMapConstIterator ParameterMapConstIterator;
+  typedef ParameterObjectType::ParameterValueVectorType  ParameterValueVectorType;
+  typedef typename ParameterObjectType::Pointer          ParameterObjectPointer;
+  typedef typename ParameterObjectType::ConstPointer     ParameterObjectConstPointer;
 
   typedef typename Superclass::OutputImageType OutputImageType;
   typedef typename itk::Image< itk::Vector< float, TMovingImage::ImageDimension >,
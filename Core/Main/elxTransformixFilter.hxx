@@ -196,6 +196,23 @@ TransformixFilter< TMovingImage >
       transformParameterMapVector[ i ][ "InitialTransformParametersFileName" ]
         = ParameterValueVectorType( 1, std::to_string( i - 1 ) );
     }
+
+    // Binary transform parameters are mapped from disk by the transform
+    // itself. Their file must exist, because the map has no directory to
+    // resolve a relative name against other than the current directory.
+    const ParameterMapType & transformParameterMap = transformParameterMapVector[ i ];
+    ParameterMapConstIterator useBinaryFormat
+      = transformParameterMap.find( "UseBinaryFormatForTransformationParameters" );
+    ParameterMapConstIterator transformParameters = transformParameterMap.find( "TransformParameters" );
+    if( useBinaryFormat != transformParameterMap.end() && useBinaryFormat->second.size() == 1
+      && useBinaryFormat->second[ 0 ] == "true" && transformParameters != transformParameterMap.end() )
+    {
+      if( transformParameters->second.size() != 1
+        || !itksys::SystemTools::FileExists( transformParameters->second[ 0 ].c_str(), true ) )
+      {
+        itkExceptionMacro( "Binary transform parameter file of parameter map " << i << " does not exist." );
+      }
+    }
   }
 
   // Run transformix
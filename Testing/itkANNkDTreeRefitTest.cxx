@@ -0,0 +1,166 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkListSampleCArray.h"
+#include "itkANNkDTree.h"
+#include "itkANNStandardTreeSearch.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+#include <string>
+#include <vector>
+
+// This test checks that the k nearest neighbours that are found in a kd-tree
+// that is refitted to moved points, are the same as the ones that are found
+// in a kd-tree that is built from scratch on the moved points. The points are
+// moved a little and a lot, so that the children of the refitted tree
+// overlap, for all splitting rules.
+
+typedef itk::Array< double >                                               MeasurementVectorType;
+typedef itk::Statistics::ListSampleCArray< MeasurementVectorType, double > ListSampleType;
+typedef itk::ANNkDTree< ListSampleType >                                   TreeType;
+typedef itk::ANNStandardTreeSearch< ListSampleType >                       TreeSearchType;
+typedef itk::Statistics::MersenneTwisterRandomVariateGenerator             RandomGeneratorType;
+
+const unsigned int Dimension         = 3;
+const unsigned int NumberOfPoints    = 2000;
+const unsigned int NumberOfQueries   = 200;
+const unsigned int KNearestNeighbors = 5;
+const unsigned int NumberOfMoves     = 4;
+
+/** Search the neighbours of the queries in tree. */
+void
+SearchNeighbours( TreeType * tree, const std::vector< MeasurementVectorType > & queries,
+  std::vector< TreeSearchType::IndexArrayType > & indices,
+  std::vector< TreeSearchType::DistanceArrayType > & distances )
+{
+  TreeSearchType::Pointer search = TreeSearchType::New();
+  search->SetBinaryTree( tree );
+  search->SetKNearestNeighbors( KNearestNeighbors );
+  search->SetErrorBound( 0.0 );
+
+  indices.resize( queries.size() );
+  distances.resize( queries.size() );
+  for( unsigned int q = 0; q < queries.size(); ++q )
+  {
+    search->Search( queries[ q ], indices[ q ], distances[ q ] );
+  }
+
+} // end SearchNeighbours()
+
+
+/** Test the refit for a splitting rule. */
+bool
+TestSplittingRule( const std::string & splittingRule )
+{
+  RandomGeneratorType::Pointer random = RandomGeneratorType::GetInstance();
+  random->SetSeed( 12345 );
+
+  /** Random points in the unit cube. */
+  ListSampleType::Pointer sample = ListSampleType::New();
+  sample->SetMeasurementVectorSize( Dimension );
+  sample->Resize( NumberOfPoints );
+  for( unsigned int i = 0; i < NumberOfPoints; ++i )
+  {
+    for( unsigned int d = 0; d < Dimension; ++d )
+    {
+      sample->SetMeasurement( i, d, random->GetUniformVariate( 0.0, 1.0 ) );
+    }
+  }
+
+  /** Random query points, partly outside the cube. */
+  std::vector< MeasurementVectorType > queries( NumberOfQueries, MeasurementVectorType( Dimension ) );
+  for( unsigned int q = 0; q < NumberOfQueries; ++q )
+  {
+    for( unsigned int d = 0; d < Dimension; ++d )
+    {
+      queries[ q ][ d ] = random->GetUniformVariate( -0.2, 1.2 );
+    }
+  }
+
+  /** The tree that is refitted. */
+  TreeType::Pointer refittedTree = TreeType::New();
+  refittedTree->SetBucketSize( 4 );
+  refittedTree->SetSplittingRule( splittingRule );
+  refittedTree->SetSample( sample );
+  refittedTree->GenerateTree();
+
+  for( unsigned int move = 0; move < NumberOfMoves; ++move )
+  {
+    /** Move the points in place, more with every move. */
+    const double stepSize = 0.01 * ( 1 << ( 2 * move ) );
+    for( unsigned int i = 0; i < NumberOfPoints; ++i )
+    {
+      for( unsigned int d = 0; d < Dimension; ++d )
+      {
+        const double value = sample->GetMeasurementVector( i )[ d ];
+        sample->SetMeasurement( i, d, value + random->GetUniformVariate( -stepSize, stepSize ) );
+      }
+    }
+
+    /** Refit the tree, and build a new one on the moved points. */
+    refittedTree->RefitTree();
+    TreeType::Pointer rebuiltTree = TreeType::New();
+    rebuiltTree->SetBucketSize( 4 );
+    rebuiltTree->SetSplittingRule( splittingRule );
+    rebuiltTree->SetSample( sample );
+    rebuiltTree->GenerateTree();
+
+    std::vector< TreeSearchType::IndexArrayType >    refittedIndices, rebuiltIndices;
+    std::vector< TreeSearchType::DistanceArrayType > refittedDistances, rebuiltDistances;
+    SearchNeighbours( refittedTree, queries, refittedIndices, refittedDistances );
+    SearchNeighbours( rebuiltTree, queries, rebuiltIndices, rebuiltDistances );
+
+    for( unsigned int q = 0; q < NumberOfQueries; ++q )
+    {
+      for( unsigned int k = 0; k < KNearestNeighbors; ++k )
+      {
+        if( refittedIndices[ q ][ k ] != rebuiltIndices[ q ][ k ]
+          || refittedDistances[ q ][ k ] != rebuiltDistances[ q ][ k ] )
+        {
+          std::cerr << "ERROR: " << splittingRule << ", move " << move << ", query " << q
+                    << ": neighbour " << k << " of the refitted tree is point "
+                    << refittedIndices[ q ][ k ] << " at distance " << refittedDistances[ q ][ k ]
+                    << ", of the rebuilt tree point " << rebuiltIndices[ q ][ k ]
+                    << " at distance " << rebuiltDistances[ q ][ k ] << std::endl;
+          return false;
+        }
+      }
+    }
+  }
+
+  std::cout << splittingRule << ": OK" << std::endl;
+  return true;
+
+} // end TestSplittingRule()
+
+
+int
+main( void )
+{
+  const char * splittingRules[ 4 ] = {
+    "ANN_KD_STD", "ANN_KD_MIDPT", "ANN_KD_FAIR", "ANN_KD_SL_MIDPT" };
+  for( unsigned int i = 0; i < 4; ++i )
+  {
+    if( !TestSplittingRule( splittingRules[ i ] ) )
+    {
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
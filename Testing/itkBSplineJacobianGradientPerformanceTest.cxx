@@ -25,6 +25,8 @@
 
 #include <fstream>
 #include <iomanip>
+#include <vector>
+#include <algorithm>
 
 //-------------------------------------------------------------------------------------
 
@@ -224,8 +226,55 @@ main( int argc, char * argv[] )
   }
   timeCollector.Stop( "JacobianGradient recursive new" );
 
+  /** Time the recursive batched way, on a set of different points. */
+  const unsigned int numberOfPoints = 64;
+  InputPointType              inputPoints[ numberOfPoints ];
+  MovingImageGradientType     movingImageGradients[ numberOfPoints ];
+  std::vector< DerivativeType >             imageJacobians( numberOfPoints, DerivativeType( nnzji ) );
+  std::vector< NonZeroJacobianIndicesType > nzjis( numberOfPoints, NonZeroJacobianIndicesType( nnzji ) );
+  for( unsigned int p = 0; p < numberOfPoints; ++p )
+  {
+    for( unsigned int j = 0; j < Dimension; ++j )
+    {
+      inputPoints[ p ][ j ]          = 4.1 + 2.9 * p - 80.0 * j;
+      movingImageGradients[ p ][ j ] = movingImageGradient[ j ] - 0.3 * p;
+    }
+  }
+
+  itk::TimeProbe timeProbePerPoint, timeProbeBatched;
+  timeProbePerPoint.Start();
+  for( unsigned int i = 0; i < N; i += numberOfPoints )
+  {
+    for( unsigned int p = 0; p < numberOfPoints; ++p )
+    {
+      recursiveTransform->EvaluateJacobianWithImageGradientProduct(
+        inputPoints[ p ], movingImageGradients[ p ],
+        imageJacobians[ p ], nzjis[ p ] );
+    }
+    sum += imageJacobians[ 0 ]( 0 ); // just to avoid compiler to optimize away
+  }
+  timeProbePerPoint.Stop();
+
+  timeProbeBatched.Start();
+  for( unsigned int i = 0; i < N; i += numberOfPoints )
+  {
+    recursiveTransform->EvaluateJacobianWithImageGradientProducts(
+      inputPoints, movingImageGradients,
+      &imageJacobians[ 0 ], &nzjis[ 0 ], numberOfPoints );
+    sum += imageJacobians[ 0 ]( 0 ); // just to avoid compiler to optimize away
+  }
+  timeProbeBatched.Stop();
+
   /** Report timings. */
   timeCollector.Report();
+  std::cerr << std::setprecision( 4 );
+  std::cerr << "Time recursive per point = " << timeProbePerPoint.GetMean()
+            << " " << timeProbePerPoint.GetUnit() << std::endl;
+  std::cerr << "Time recursive batched = " << timeProbeBatched.GetMean()
+            << " " << timeProbeBatched.GetUnit()
+            << " (" << itk::RecursiveBSplineBatchVector::Size << " points per batch)" << std::endl;
+  std::cerr << "Speedup factor batched = "
+            << timeProbePerPoint.GetMean() / timeProbeBatched.GetMean() << std::endl;
 
   // Avoid compiler optimizations, so use sum
   std::cerr << sum << std::endl; // works but ugly on screen
@@ -252,6 +301,29 @@ main( int argc, char * argv[] )
     return EXIT_FAILURE;
   }
 
+  /** Compare the batched results with the per point results. */
+  double maxDiffNorm = 0.0;
+  for( unsigned int p = 0; p < numberOfPoints; ++p )
+  {
+    imageJacobian_new.Fill( 0.0 ); // not set for points outside the valid region
+    recursiveTransform->EvaluateJacobianWithImageGradientProduct(
+      inputPoints[ p ], movingImageGradients[ p ],
+      imageJacobian_new, nzji );
+    if( nzji != nzjis[ p ] )
+    {
+      std::cerr << "ERROR: Recursive B-spline EvaluateJacobianWithImageGradientProducts() "
+                << "returning incorrect nonzero Jacobian indices." << std::endl;
+      return EXIT_FAILURE;
+    }
+    maxDiffNorm = std::max( maxDiffNorm, ( imageJacobian_new - imageJacobians[ p ] ).magnitude() );
+  }
+  std::cerr << "Recursive B-spline batched MSD with per point: " << maxDiffNorm << std::endl;
+  if( maxDiffNorm > 1e-5 )
+  {
+    std::cerr << "ERROR: Recursive B-spline EvaluateJacobianWithImageGradientProducts() returning incorrect result." << std::endl;
+    return EXIT_FAILURE;
+  }
+
   /** Return a value. */
   return EXIT_SUCCESS;
 
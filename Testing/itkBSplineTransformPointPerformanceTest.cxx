@@ -16,6 +16,7 @@
  *
  *=========================================================================*/
 #include "itkAdvancedBSplineDeformableTransform.h"
+#include "itkRecursiveBSplineTransform.h"
 
 #include "itkImageRegionIterator.h"
 
@@ -24,6 +25,7 @@
 
 #include <fstream>
 #include <iomanip>
+#include <algorithm>
 
 //-------------------------------------------------------------------------------------
 // Create a class that inherits from the B-spline transform,
@@ -286,6 +288,59 @@ main( int argc, char * argv[] )
   timeProbeNEW.Stop();
   const double newTime = timeProbeNEW.GetMean();
 
+  /** Compare the recursive TransformPoint with the batched version, on a
+   * set of different points. The last point lies outside the valid region.
+   */
+  typedef itk::RecursiveBSplineTransform<
+    CoordinateRepresentationType, Dimension, SplineOrder >    RecursiveTransformType;
+  RecursiveTransformType::Pointer recursiveTransform = RecursiveTransformType::New();
+  recursiveTransform->SetGridOrigin( gridOrigin );
+  recursiveTransform->SetGridSpacing( gridSpacing );
+  recursiveTransform->SetGridRegion( gridRegion );
+  recursiveTransform->SetGridDirection( gridDirection );
+  recursiveTransform->SetParameters( parameters );
+
+  const unsigned int numberOfPoints = 64;
+  InputPointType     inputPoints[ numberOfPoints ];
+  OutputPointType    outputPoints[ numberOfPoints ];
+  for( unsigned int p = 0; p < numberOfPoints; ++p )
+  {
+    for( unsigned int j = 0; j < Dimension; ++j )
+    {
+      inputPoints[ p ][ j ] = 4.1 + 2.9 * p - 80.0 * j;
+    }
+  }
+  inputPoints[ numberOfPoints - 1 ].Fill( 1.0e4 );
+
+  itk::TimeProbe timeProbeRecursive, timeProbeBatch;
+  timeProbeRecursive.Start();
+  for( unsigned int i = 0; i < N; i += numberOfPoints )
+  {
+    for( unsigned int p = 0; p < numberOfPoints; ++p )
+    {
+      outputPoints[ p ] = recursiveTransform->TransformPoint( inputPoints[ p ] );
+    }
+    sum += outputPoints[ 0 ][ 0 ];
+  }
+  timeProbeRecursive.Stop();
+  const double recursiveTime = timeProbeRecursive.GetMean();
+
+  timeProbeBatch.Start();
+  for( unsigned int i = 0; i < N; i += numberOfPoints )
+  {
+    recursiveTransform->TransformPoints( inputPoints, outputPoints, numberOfPoints );
+    sum += outputPoints[ 0 ][ 0 ];
+  }
+  timeProbeBatch.Stop();
+  const double batchTime = timeProbeBatch.GetMean();
+
+  double maxDifference = 0.0;
+  for( unsigned int p = 0; p < numberOfPoints; ++p )
+  {
+    const OutputPointType outputPoint_OLD = transform->TransformPoint_OLD( inputPoints[ p ] );
+    maxDifference = std::max( maxDifference, outputPoints[ p ].EuclideanDistanceTo( outputPoint_OLD ) );
+  }
+
   // Avoid compiler optimizations, so use sum
   std::cerr << sum << std::endl; // works but ugly on screen
   //  volatile double a = sum; // works but gives unused variable warning
@@ -297,6 +352,18 @@ main( int argc, char * argv[] )
   std::cerr << "Time OLD = " << oldTime << " " << timeProbeOLD.GetUnit() << std::endl;
   std::cerr << "Time NEW = " << newTime << " " << timeProbeNEW.GetUnit() << std::endl;
   std::cerr << "Speedup factor = " << oldTime / newTime << std::endl;
+  std::cerr << "Time recursive = " << recursiveTime << " " << timeProbeRecursive.GetUnit() << std::endl;
+  std::cerr << "Time batched = " << batchTime << " " << timeProbeBatch.GetUnit()
+            << " (" << itk::RecursiveBSplineBatchVector::Size << " points per batch)" << std::endl;
+  std::cerr << "Speedup factor batched = " << recursiveTime / batchTime << std::endl;
+
+  /** Check the batched results. */
+  std::cerr << "Maximum difference batched with previous: " << maxDifference << std::endl;
+  if( maxDifference > 1e-5 )
+  {
+    std::cerr << "ERROR: Recursive B-spline TransformPoints() returning incorrect result." << std::endl;
+    return 1;
+  }
 
   /** Return a value. */
   return 0;
@@ -0,0 +1,188 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkCMAEvolutionStrategyOptimizer.h"
+#include "itkSingleValuedCostFunction.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+#include <cmath>
+#include <vector>
+
+// This test minimizes an anisotropic quadratic function with the CMA-ES
+// optimizer, once evaluating the offspring sequentially and once
+// concurrently, with a copy of the cost function per thread. The random
+// sequence is the same in both cases, so the optimizations should end at
+// exactly the same position and value. Both optimizations should restart
+// after stagnating, and the copies should be used for the evaluations.
+
+namespace
+{
+
+class QuadraticCostFunction : public itk::SingleValuedCostFunction
+{
+public:
+
+  typedef QuadraticCostFunction           Self;
+  typedef itk::SingleValuedCostFunction   Superclass;
+  typedef itk::SmartPointer< Self >       Pointer;
+  typedef itk::SmartPointer< const Self > ConstPointer;
+  itkNewMacro( Self );
+
+  itkStaticConstMacro( SpaceDimension, unsigned int, 4 );
+
+  /** f(x) = sum_i (i+1)^2 ( x_i - (i+1) )^2, minimal at x_i = i+1. */
+  virtual MeasureType GetValue( const ParametersType & parameters ) const
+  {
+    ++this->m_NumberOfEvaluations;
+    MeasureType value = 0.0;
+    for( unsigned int i = 0; i < SpaceDimension; ++i )
+    {
+      const double d = ( i + 1.0 ) * ( parameters[ i ] - ( i + 1.0 ) );
+      value += d * d;
+    }
+    return value;
+  }
+
+
+  virtual void GetDerivative( const ParametersType &, DerivativeType & ) const
+  {
+    itkExceptionMacro( "ERROR: the derivative is not needed by CMA-ES." );
+  }
+
+
+  virtual unsigned int GetNumberOfParameters( void ) const
+  {
+    return SpaceDimension;
+  }
+
+
+  /** Each copy is used by a single thread, so no locking is needed. */
+  unsigned long GetNumberOfEvaluations( void ) const
+  {
+    return this->m_NumberOfEvaluations;
+  }
+
+
+protected:
+
+  QuadraticCostFunction() : m_NumberOfEvaluations( 0 ) {}
+  virtual ~QuadraticCostFunction() {}
+
+private:
+
+  mutable unsigned long m_NumberOfEvaluations;
+
+};
+
+typedef itk::CMAEvolutionStrategyOptimizer OptimizerType;
+
+/** Run the optimizer with the given number of parallel cost functions. */
+OptimizerType::Pointer
+Optimize( const unsigned int numberOfCopies,
+  std::vector< QuadraticCostFunction::Pointer > & copies )
+{
+  itk::Statistics::MersenneTwisterRandomVariateGenerator::GetInstance()->SetSeed( 1234 );
+
+  QuadraticCostFunction::Pointer costFunction = QuadraticCostFunction::New();
+  OptimizerType::ParametersType  initialPosition( QuadraticCostFunction::SpaceDimension );
+  initialPosition.Fill( 0.0 );
+
+  OptimizerType::Pointer optimizer = OptimizerType::New();
+  optimizer->SetCostFunction( costFunction );
+  optimizer->SetInitialPosition( initialPosition );
+  optimizer->SetInitialSigma( 1.0 );
+  optimizer->SetMaximumNumberOfIterations( 5000 );
+  optimizer->SetPositionToleranceMin( 1e-8 );
+  optimizer->SetValueTolerance( 1e-10 );
+  optimizer->SetMaximumNumberOfRestarts( 2 );
+  optimizer->SetPopulationSizeIncreaseFactor( 2.0 );
+
+  copies.clear();
+  OptimizerType::CostFunctionContainerType parallelCostFunctions;
+  for( unsigned int i = 0; i < numberOfCopies; ++i )
+  {
+    copies.push_back( QuadraticCostFunction::New() );
+    parallelCostFunctions.push_back( copies.back().GetPointer() );
+  }
+  optimizer->SetParallelCostFunctions( parallelCostFunctions );
+
+  optimizer->StartOptimization();
+
+  std::cout << numberOfCopies << " parallel cost functions: value "
+            << optimizer->GetCurrentValue() << " after "
+            << optimizer->GetCurrentIteration() << " iterations and "
+            << optimizer->GetCurrentNumberOfRestarts() << " restarts, population size "
+            << optimizer->GetPopulationSize() << std::endl;
+
+  return optimizer;
+
+} // end Optimize()
+
+} // end namespace
+
+
+int
+main( void )
+{
+  std::vector< QuadraticCostFunction::Pointer > copies;
+
+  OptimizerType::Pointer sequential = Optimize( 0, copies );
+  OptimizerType::Pointer parallel   = Optimize( 4, copies );
+
+  /** The copies should have done the evaluations of the offspring. */
+  for( unsigned int i = 0; i < copies.size(); ++i )
+  {
+    if( copies[ i ]->GetNumberOfEvaluations() == 0 )
+    {
+      std::cerr << "ERROR: parallel cost function " << i << " was not used." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  /** The optimization should have stagnated and restarted. */
+  if( sequential->GetCurrentNumberOfRestarts() == 0 )
+  {
+    std::cerr << "ERROR: the optimization did not restart." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** Sequential and concurrent evaluation should give identical results. */
+  if( parallel->GetCurrentNumberOfRestarts() != sequential->GetCurrentNumberOfRestarts()
+    || parallel->GetCurrentIteration() != sequential->GetCurrentIteration()
+    || parallel->GetCurrentValue() != sequential->GetCurrentValue()
+    || parallel->GetCurrentPosition() != sequential->GetCurrentPosition() )
+  {
+    std::cerr << "ERROR: the concurrent evaluation ended at\n  "
+              << parallel->GetCurrentPosition() << "\nthe sequential evaluation at\n  "
+              << sequential->GetCurrentPosition() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** The optimum is x_i = i+1. */
+  for( unsigned int i = 0; i < QuadraticCostFunction::SpaceDimension; ++i )
+  {
+    if( std::abs( sequential->GetCurrentPosition()[ i ] - ( i + 1.0 ) ) > 1e-3 )
+    {
+      std::cerr << "ERROR: the optimum was not found: "
+                << sequential->GetCurrentPosition() << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
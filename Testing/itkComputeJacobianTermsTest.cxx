@@ -0,0 +1,122 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkComputeJacobianTerms.h"
+#include "itkAdvancedBSplineDeformableTransform.h"
+
+#include <algorithm>
+#include <cmath>
+
+// This test checks that the multi-threaded computation of the Jacobian terms
+// for the automatic parameter estimation of the ASGD optimizer gives the same
+// terms as the single-threaded computation, with and without scales.
+
+const unsigned int Dimension = 3;
+typedef itk::Image< float, Dimension >                                  ImageType;
+typedef itk::AdvancedBSplineDeformableTransform< double, Dimension, 3 > TransformType;
+typedef itk::ComputeJacobianTerms< ImageType, TransformType >           ComputeJacobianTermsType;
+
+bool
+AlmostEqual( const double a, const double b )
+{
+  return std::abs( a - b ) <= 1e-9 * std::max( std::abs( a ), std::abs( b ) );
+}
+
+
+int
+main( void )
+{
+  /** Create the fixed image. */
+  ImageType::SizeType size;
+  size[ 0 ] = 40; size[ 1 ] = 36; size[ 2 ] = 30;
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( size );
+  image->Allocate();
+  image->FillBuffer( 0.0f );
+
+  /** Create a B-spline transform with a grid that covers the image. */
+  TransformType::RegionType::SizeType gridSize;
+  gridSize[ 0 ] = 12; gridSize[ 1 ] = 11; gridSize[ 2 ] = 10;
+  TransformType::RegionType gridRegion;
+  gridRegion.SetSize( gridSize );
+  TransformType::SpacingType gridSpacing;
+  gridSpacing.Fill( 5.0 );
+  TransformType::OriginType gridOrigin;
+  gridOrigin.Fill( -7.5 );
+  TransformType::DirectionType gridDirection;
+  gridDirection.SetIdentity();
+
+  TransformType::Pointer transform = TransformType::New();
+  transform->SetGridOrigin( gridOrigin );
+  transform->SetGridSpacing( gridSpacing );
+  transform->SetGridRegion( gridRegion );
+  transform->SetGridDirection( gridDirection );
+  TransformType::ParametersType parameters( transform->GetNumberOfParameters() );
+  parameters.Fill( 0.0 );
+  transform->SetParameters( parameters );
+
+  ComputeJacobianTermsType::ScalesType scales( transform->GetNumberOfParameters() );
+  for( unsigned int p = 0; p < scales.GetSize(); ++p )
+  {
+    scales[ p ] = 1.0 + ( p % 7 ) * 0.25;
+  }
+
+  ComputeJacobianTermsType::Pointer computeJacobianTerms = ComputeJacobianTermsType::New();
+  computeJacobianTerms->SetFixedImage( image );
+  computeJacobianTerms->SetFixedImageRegion( image->GetBufferedRegion() );
+  computeJacobianTerms->SetTransform( transform );
+  computeJacobianTerms->SetScales( scales );
+  computeJacobianTerms->SetNumberOfJacobianMeasurements( 5000 );
+  computeJacobianTerms->SetNumberOfBandStructureSamples( 10 );
+  computeJacobianTerms->SetNumberOfThreads( 4 );
+
+  /** A small band matrix, so that also the sparse matrix is used. */
+  computeJacobianTerms->SetMaxBandCovSize( 20 );
+
+  for( unsigned int useScales = 0; useScales < 2; ++useScales )
+  {
+    computeJacobianTerms->SetUseScales( useScales == 1 );
+
+    double TrC = 0.0, TrCC = 0.0, maxJJ = 0.0, maxJCJ = 0.0;
+    computeJacobianTerms->SetUseMultiThread( false );
+    computeJacobianTerms->Compute( TrC, TrCC, maxJJ, maxJCJ );
+
+    double TrC_MT = 0.0, TrCC_MT = 0.0, maxJJ_MT = 0.0, maxJCJ_MT = 0.0;
+    computeJacobianTerms->SetUseMultiThread( true );
+    computeJacobianTerms->Compute( TrC_MT, TrCC_MT, maxJJ_MT, maxJCJ_MT );
+
+    std::cout << "UseScales " << useScales << ":\n"
+              << "  single-threaded: " << TrC << " " << TrCC << " " << maxJJ << " " << maxJCJ << "\n"
+              << "  multi-threaded:  " << TrC_MT << " " << TrCC_MT << " " << maxJJ_MT << " " << maxJCJ_MT
+              << std::endl;
+
+    if( TrC <= 0.0 || TrCC <= 0.0 || maxJJ <= 0.0 || maxJCJ <= 0.0 )
+    {
+      std::cerr << "ERROR: the Jacobian terms should be positive." << std::endl;
+      return EXIT_FAILURE;
+    }
+    if( !AlmostEqual( TrC, TrC_MT ) || !AlmostEqual( TrCC, TrCC_MT )
+      || !AlmostEqual( maxJJ, maxJJ_MT ) || !AlmostEqual( maxJCJ, maxJCJ_MT ) )
+    {
+      std::cerr << "ERROR: the multi-threaded Jacobian terms differ from the single-threaded ones." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,251 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkFullSearchOptimizer.h"
+#include "itkSingleValuedCostFunction.h"
+#include "itkCommand.h"
+
+#include <set>
+#include <utility>
+#include <vector>
+
+// This test scans a three-dimensional search space of a smooth cost function
+// with the full search optimizer. The exhaustive sequential search is the
+// reference. The search with a copy of the cost function per thread should
+// report the same points, in the same order, with the same values. The
+// coarse-to-fine search, sequential and concurrent, should find the same best
+// point with fewer evaluations, and should report no point twice.
+
+namespace
+{
+
+class BowlCostFunction : public itk::SingleValuedCostFunction
+{
+public:
+
+  typedef BowlCostFunction                Self;
+  typedef itk::SingleValuedCostFunction   Superclass;
+  typedef itk::SmartPointer< Self >       Pointer;
+  typedef itk::SmartPointer< const Self > ConstPointer;
+  itkNewMacro( Self );
+
+  /** A bowl with some coupling between the parameters, minimal off the grid.
+   * The fourth parameter is not searched.
+   */
+  virtual MeasureType GetValue( const ParametersType & p ) const
+  {
+    const double d0 = p[ 0 ] - 1.3;
+    const double d1 = p[ 1 ] + 0.7;
+    const double d2 = p[ 2 ] - 0.4;
+    return d0 * d0 + 2.0 * d1 * d1 + 0.5 * d2 * d2 + 0.3 * d0 * d1 + p[ 3 ];
+  }
+
+
+  virtual void GetDerivative( const ParametersType &, DerivativeType & ) const
+  {
+    itkExceptionMacro( "ERROR: the derivative is not needed by the full search." );
+  }
+
+
+  virtual unsigned int GetNumberOfParameters( void ) const
+  {
+    return 4;
+  }
+
+
+protected:
+
+  BowlCostFunction() {}
+  virtual ~BowlCostFunction() {}
+
+};
+
+typedef itk::FullSearchOptimizer           OptimizerType;
+typedef std::pair< unsigned long, double > ReportedPointType;
+typedef std::vector< ReportedPointType >   ReportedPointContainerType;
+
+/** Records the linear index and value of every reported point. */
+class IterationRecorder : public itk::Command
+{
+public:
+
+  typedef IterationRecorder         Self;
+  typedef itk::Command              Superclass;
+  typedef itk::SmartPointer< Self > Pointer;
+  itkNewMacro( Self );
+
+  virtual void Execute( itk::Object * caller, const itk::EventObject & event )
+  {
+    this->Execute( static_cast< const itk::Object * >( caller ), event );
+  }
+
+
+  virtual void Execute( const itk::Object * caller, const itk::EventObject & event )
+  {
+    if( !itk::IterationEvent().CheckEvent( &event ) )
+    {
+      return;
+    }
+    OptimizerType * optimizer = const_cast< OptimizerType * >(
+      dynamic_cast< const OptimizerType * >( caller ) );
+    const OptimizerType::SearchSpaceIndexType & index         = optimizer->GetCurrentIndexInSearchSpace();
+    const OptimizerType::SearchSpaceSizeType &  size          = optimizer->GetSearchSpaceSize();
+    unsigned long                               linearIndex   = 0;
+    unsigned long                               dimensionStep = 1;
+    for( unsigned int dim = 0; dim < index.GetSize(); ++dim )
+    {
+      linearIndex   += index[ dim ] * dimensionStep;
+      dimensionStep *= size[ dim ];
+    }
+    this->m_Points.push_back( ReportedPointType( linearIndex, optimizer->GetValue() ) );
+  }
+
+
+  ReportedPointContainerType m_Points;
+
+protected:
+
+  IterationRecorder() {}
+  virtual ~IterationRecorder() {}
+
+};
+
+/** Run a search, and return the reported points. */
+OptimizerType::Pointer
+Search( const unsigned int numberOfCopies, const unsigned int numberOfLevels,
+  ReportedPointContainerType & points )
+{
+  OptimizerType::ParametersType initialPosition( 4 );
+  initialPosition.Fill( 0.0 );
+  initialPosition[ 3 ] = 10.0;
+
+  OptimizerType::Pointer optimizer = OptimizerType::New();
+  optimizer->SetCostFunction( BowlCostFunction::New() );
+  optimizer->SetInitialPosition( initialPosition );
+  optimizer->AddSearchDimension( 0, -4.0, 4.0, 0.25 );
+  optimizer->AddSearchDimension( 1, -3.0, 5.0, 0.5 );
+  optimizer->AddSearchDimension( 2, -2.0, 2.0, 0.25 );
+  optimizer->SetNumberOfCoarseToFineLevels( numberOfLevels );
+  optimizer->SetNumberOfCellsToRefine( 2 );
+
+  OptimizerType::CostFunctionContainerType parallelCostFunctions;
+  for( unsigned int i = 0; i < numberOfCopies; ++i )
+  {
+    parallelCostFunctions.push_back( BowlCostFunction::New().GetPointer() );
+  }
+  optimizer->SetParallelCostFunctions( parallelCostFunctions );
+
+  IterationRecorder::Pointer recorder = IterationRecorder::New();
+  optimizer->AddObserver( itk::IterationEvent(), recorder );
+  optimizer->StartOptimization();
+  points = recorder->m_Points;
+
+  std::cout << numberOfCopies << " parallel cost functions, " << numberOfLevels
+            << " coarse-to-fine levels: best value " << optimizer->GetBestValue()
+            << " at " << optimizer->GetBestPointInSearchSpace()
+            << ", " << points.size() << " evaluations" << std::endl;
+
+  return optimizer;
+
+} // end Search()
+
+} // end namespace
+
+
+int
+main( void )
+{
+  ReportedPointContainerType exhaustivePoints;
+  ReportedPointContainerType parallelPoints;
+  ReportedPointContainerType coarseToFinePoints;
+  ReportedPointContainerType parallelCoarseToFinePoints;
+
+  OptimizerType::Pointer exhaustive           = Search( 0, 0, exhaustivePoints );
+  OptimizerType::Pointer parallel             = Search( 4, 0, parallelPoints );
+  OptimizerType::Pointer coarseToFine         = Search( 0, 3, coarseToFinePoints );
+  OptimizerType::Pointer parallelCoarseToFine = Search( 4, 3, parallelCoarseToFinePoints );
+
+  /** The exhaustive search visits all points in scan order. */
+  if( exhaustivePoints.size() != exhaustive->GetNumberOfIterations() )
+  {
+    std::cerr << "ERROR: the exhaustive search reported " << exhaustivePoints.size()
+              << " points, expected " << exhaustive->GetNumberOfIterations() << std::endl;
+    return EXIT_FAILURE;
+  }
+  for( unsigned long i = 0; i < exhaustivePoints.size(); ++i )
+  {
+    if( exhaustivePoints[ i ].first != i )
+    {
+      std::cerr << "ERROR: the exhaustive search is not in scan order." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  /** The parallel search reports exactly the same points and values. */
+  if( parallelPoints != exhaustivePoints
+    || parallel->GetBestValue() != exhaustive->GetBestValue()
+    || parallel->GetBestIndexInSearchSpace() != exhaustive->GetBestIndexInSearchSpace()
+    || parallel->GetCurrentPosition() != exhaustive->GetCurrentPosition() )
+  {
+    std::cerr << "ERROR: the parallel search differs from the exhaustive search." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** The coarse-to-fine searches find the same optimum with fewer
+   * evaluations, and the parallel one reports the same points.
+   */
+  if( coarseToFine->GetBestValue() != exhaustive->GetBestValue()
+    || coarseToFine->GetBestIndexInSearchSpace() != exhaustive->GetBestIndexInSearchSpace()
+    || coarseToFine->GetCurrentPosition() != exhaustive->GetCurrentPosition() )
+  {
+    std::cerr << "ERROR: the coarse-to-fine search ended at "
+              << coarseToFine->GetBestPointInSearchSpace() << ", the exhaustive search at "
+              << exhaustive->GetBestPointInSearchSpace() << std::endl;
+    return EXIT_FAILURE;
+  }
+  if( coarseToFinePoints.size() >= exhaustivePoints.size() / 4 )
+  {
+    std::cerr << "ERROR: the coarse-to-fine search evaluated too many points." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if( parallelCoarseToFinePoints != coarseToFinePoints
+    || parallelCoarseToFine->GetBestIndexInSearchSpace() != coarseToFine->GetBestIndexInSearchSpace() )
+  {
+    std::cerr << "ERROR: the parallel coarse-to-fine search differs from the sequential one." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** No point is reported twice, and the values are those of the exhaustive search. */
+  std::set< unsigned long > visited;
+  for( unsigned long i = 0; i < coarseToFinePoints.size(); ++i )
+  {
+    const unsigned long linearIndex = coarseToFinePoints[ i ].first;
+    if( !visited.insert( linearIndex ).second )
+    {
+      std::cerr << "ERROR: point " << linearIndex << " was reported twice." << std::endl;
+      return EXIT_FAILURE;
+    }
+    if( coarseToFinePoints[ i ].second != exhaustivePoints[ linearIndex ].second )
+    {
+      std::cerr << "ERROR: point " << linearIndex << " has a different value." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,127 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkGenericMultiResolutionPyramidImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+// This test checks that computing the pyramid per level, with the next level
+// computed in the background, gives the same levels as computing all levels
+// at once, and that only the current level is kept in the outputs.
+
+const unsigned int Dimension = 3;
+typedef itk::Image< short, Dimension >                     InputImageType;
+typedef itk::Image< float, Dimension >                     OutputImageType;
+typedef itk::GenericMultiResolutionPyramidImageFilter<
+  InputImageType, OutputImageType >                        PyramidType;
+
+/** Check that two images have the same size and pixel values. */
+bool
+CompareImages( const OutputImageType * image1, const OutputImageType * image2,
+  const unsigned int level )
+{
+  if( image1->GetBufferedRegion() != image2->GetBufferedRegion() )
+  {
+    std::cerr << "ERROR: the buffered regions of level " << level << " differ." << std::endl;
+    return false;
+  }
+
+  itk::ImageRegionConstIterator< OutputImageType > it1( image1, image1->GetBufferedRegion() );
+  itk::ImageRegionConstIterator< OutputImageType > it2( image2, image2->GetBufferedRegion() );
+  for( ; !it1.IsAtEnd(); ++it1, ++it2 )
+  {
+    if( it1.Get() != it2.Get() )
+    {
+      std::cerr << "ERROR: level " << level << " differs at " << it1.GetIndex()
+                << ": " << it1.Get() << " != " << it2.Get() << std::endl;
+      return false;
+    }
+  }
+  return true;
+
+} // end CompareImages()
+
+
+int
+main( void )
+{
+  /** Create a random input image. */
+  InputImageType::SizeType size;
+  size[ 0 ] = 67; size[ 1 ] = 58; size[ 2 ] = 41;
+  InputImageType::SpacingType spacing;
+  spacing[ 0 ] = 0.8; spacing[ 1 ] = 1.0; spacing[ 2 ] = 1.5;
+
+  InputImageType::Pointer input = InputImageType::New();
+  input->SetRegions( size );
+  input->SetSpacing( spacing );
+  input->Allocate();
+
+  typedef itk::Statistics::MersenneTwisterRandomVariateGenerator RandomGeneratorType;
+  RandomGeneratorType::Pointer randomGenerator = RandomGeneratorType::New();
+  randomGenerator->SetSeed( 1234 );
+  itk::ImageRegionIterator< InputImageType > it( input, input->GetLargestPossibleRegion() );
+  for( ; !it.IsAtEnd(); ++it )
+  {
+    it.Set( static_cast< short >( randomGenerator->GetIntegerVariate( 1000 ) ) );
+  }
+
+  /** Test both the resampler and the shrinker. */
+  const unsigned int numberOfLevels = 4;
+  for( unsigned int useShrinker = 0; useShrinker < 2; ++useShrinker )
+  {
+    /** The reference: all levels at once. */
+    PyramidType::Pointer reference = PyramidType::New();
+    reference->SetNumberOfLevels( numberOfLevels );
+    reference->SetUseShrinkImageFilter( useShrinker == 1 );
+    reference->SetInput( input );
+    reference->Update();
+
+    /** Per level, with the next level in the background. */
+    PyramidType::Pointer pyramid = PyramidType::New();
+    pyramid->SetNumberOfLevels( numberOfLevels );
+    pyramid->SetUseShrinkImageFilter( useShrinker == 1 );
+    pyramid->SetComputeOnlyForCurrentLevel( true );
+    pyramid->SetComputeNextLevelInBackground( true );
+    pyramid->SetInput( input );
+
+    for( unsigned int level = 0; level < numberOfLevels; ++level )
+    {
+      pyramid->SetCurrentLevel( level );
+      pyramid->Update();
+
+      if( !CompareImages( reference->GetOutput( level ), pyramid->GetOutput( level ), level ) )
+      {
+        return EXIT_FAILURE;
+      }
+
+      for( unsigned int otherLevel = 0; otherLevel < numberOfLevels; ++otherLevel )
+      {
+        if( otherLevel != level
+          && pyramid->GetOutput( otherLevel )->GetBufferedRegion().GetNumberOfPixels() != 0 )
+        {
+          std::cerr << "ERROR: level " << otherLevel
+                    << " is still in memory at level " << level << "." << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
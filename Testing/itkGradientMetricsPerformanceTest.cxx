@@ -0,0 +1,349 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkNormalizedGradientCorrelationImageToImageMetric.h"
+#include "itkGradientDifferenceImageToImageMetric2.h"
+#include "itkAdvancedEuler3DTransform.h"
+#include "itkAdvancedRayCastInterpolateImageFunction.h"
+#include "itkCastImageFilter.h"
+#include "itkImageFullSampler.h"
+#include "itkImageRegionIterator.h"
+#include "itkNeighborhoodOperatorImageFilter.h"
+#include "itkSobelOperator.h"
+#include "itkTimeProbe.h"
+
+#include "itkRayCastTestHelper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+// This test compares the sample based normalized gradient correlation and
+// gradient difference metrics, which evaluate the moved image in the
+// neighborhoods of the samples only, using a full image sampler, with the
+// filter based computation they replace: a projection of the complete
+// moving image by a ResampleImageFilter, followed by Sobel filters. It
+// checks that the single-threaded, ITK-threaded and thread pool variants
+// give the same value and derivative, and reports the timings.
+
+const unsigned int Dimension = 3;
+typedef itk::Image< float, Dimension >                                 ImageType;
+typedef itk::Image< double, Dimension >                                GradientImageType;
+typedef itk::AdvancedEuler3DTransform< double >                        TransformType;
+typedef itk::AdvancedRayCastInterpolateImageFunction< ImageType, double > RayCastInterpolatorType;
+typedef itk::ImageFullSampler< ImageType >                             SamplerType;
+
+/** The Sobel gradients of an image, with the zero flux Neumann boundary
+ * condition, as used by the metrics.
+ */
+void
+ComputeGradients( const GradientImageType * image, GradientImageType::Pointer gradients[ Dimension ] )
+{
+  typedef itk::NeighborhoodOperatorImageFilter< GradientImageType, GradientImageType > SobelFilterType;
+  for( unsigned int d = 0; d < Dimension; ++d )
+  {
+    itk::SobelOperator< double, Dimension > sobelOperator;
+    sobelOperator.SetDirection( d );
+    sobelOperator.CreateDirectional();
+
+    SobelFilterType::Pointer sobelFilter = SobelFilterType::New();
+    sobelFilter->SetOperator( sobelOperator );
+    sobelFilter->SetInput( image );
+    sobelFilter->Update();
+    gradients[ d ] = sobelFilter->GetOutput();
+    gradients[ d ]->DisconnectPipeline();
+  }
+
+} // end ComputeGradients()
+
+
+/** The normalized gradient correlation, computed as by the filter based metric. */
+double
+ComputeNormalizedGradientCorrelation( GradientImageType::Pointer fixedGradients[ Dimension ],
+  GradientImageType::Pointer movedGradients[ Dimension ] )
+{
+  double sff = 0.0, smm = 0.0, sfm = 0.0;
+  double sf[ Dimension ], sm[ Dimension ];
+  double N = 0.0;
+  for( unsigned int d = 0; d < Dimension; ++d )
+  {
+    sf[ d ] = 0.0;
+    sm[ d ] = 0.0;
+    itk::ImageRegionConstIterator< GradientImageType > fit( fixedGradients[ d ],
+      fixedGradients[ d ]->GetLargestPossibleRegion() );
+    itk::ImageRegionConstIterator< GradientImageType > mit( movedGradients[ d ],
+      movedGradients[ d ]->GetLargestPossibleRegion() );
+    N = 0.0;
+    for( ; !fit.IsAtEnd(); ++fit, ++mit )
+    {
+      sf[ d ] += fit.Get();
+      sm[ d ] += mit.Get();
+      sff     += fit.Get() * fit.Get();
+      smm     += mit.Get() * mit.Get();
+      sfm     += fit.Get() * mit.Get();
+      N       += 1.0;
+    }
+  }
+  for( unsigned int d = 0; d < Dimension; ++d )
+  {
+    sff -= sf[ d ] * sf[ d ] / N;
+    smm -= sm[ d ] * sm[ d ] / N;
+    sfm -= sf[ d ] * sm[ d ] / N;
+  }
+  return -sfm / ( std::sqrt( sff ) * std::sqrt( smm ) );
+
+} // end ComputeNormalizedGradientCorrelation()
+
+
+/** The gradient difference measure, computed as by the filter based metric,
+ * without the rescaling and the sign.
+ */
+double
+ComputeGradientDifference( GradientImageType::Pointer fixedGradients[ Dimension ],
+  GradientImageType::Pointer movedGradients[ Dimension ] )
+{
+  double measure = 0.0;
+  for( unsigned int d = 0; d < Dimension; ++d )
+  {
+    /** The variance and maximum of the fixed gradients. */
+    const GradientImageType::RegionType region = fixedGradients[ d ]->GetLargestPossibleRegion();
+    itk::ImageRegionConstIterator< GradientImageType > fit( fixedGradients[ d ], region );
+    double mean = 0.0, maxFixed = 0.0, N = 0.0;
+    for( fit.GoToBegin(); !fit.IsAtEnd(); ++fit )
+    {
+      mean    += fit.Get();
+      maxFixed = std::max( maxFixed, fit.Get() );
+      N       += 1.0;
+    }
+    mean /= N;
+    double variance = 0.0;
+    for( fit.GoToBegin(); !fit.IsAtEnd(); ++fit )
+    {
+      variance += ( fit.Get() - mean ) * ( fit.Get() - mean );
+    }
+    variance /= N;
+    if( variance == 0.0 )
+    {
+      continue;
+    }
+
+    /** The maximum of the moved gradients. */
+    itk::ImageRegionConstIterator< GradientImageType > mit( movedGradients[ d ], region );
+    double maxMoved = itk::NumericTraits< double >::NonpositiveMin();
+    for( mit.GoToBegin(); !mit.IsAtEnd(); ++mit )
+    {
+      maxMoved = std::max( maxMoved, mit.Get() );
+    }
+    const double subtractionFactor = maxMoved != 0.0 ? maxFixed / maxMoved : 0.0;
+
+    for( fit.GoToBegin(), mit.GoToBegin(); !fit.IsAtEnd(); ++fit, ++mit )
+    {
+      const double diff = fit.Get() - subtractionFactor * mit.Get();
+      measure += variance / ( variance + diff * diff );
+    }
+  }
+  return measure;
+
+} // end ComputeGradientDifference()
+
+
+/** Run the single-threaded, ITK-threaded and thread pool variants of a
+ * metric, and compare them with each other and with the reference value.
+ */
+template< class TMetric >
+bool
+TestMetric( TMetric * metric, const char * metricName,
+  const typename TMetric::TransformParametersType & parameters,
+  const double referenceValue, const itk::TimeProbe & referenceTimer )
+{
+  typedef typename TMetric::MeasureType    MeasureType;
+  typedef typename TMetric::DerivativeType DerivativeType;
+
+  const unsigned int numberOfRepetitions = 3;
+  const char *       names[ 3 ] = { "single-threaded", "multi-threader", "thread pool" };
+  MeasureType        values[ 3 ];
+  DerivativeType     derivatives[ 3 ];
+  itk::TimeProbe     timers[ 3 ];
+  for( unsigned int variant = 0; variant < 3; ++variant )
+  {
+    metric->SetUseMultiThread( variant > 0 );
+    metric->SetUseWorkStealingThreadPool( variant == 2 );
+    metric->Initialize();
+
+    for( unsigned int r = 0; r < numberOfRepetitions; ++r )
+    {
+      timers[ variant ].Start();
+      metric->GetValueAndDerivative( parameters, values[ variant ], derivatives[ variant ] );
+      timers[ variant ].Stop();
+    }
+  }
+
+  /** Report the timings. The filter based time is for one value only. */
+  std::cout << std::setprecision( 4 ) << metricName << ":\n"
+            << "  Time filter based value = " << referenceTimer.GetMean()
+            << " " << referenceTimer.GetUnit() << std::endl;
+  for( unsigned int variant = 0; variant < 3; ++variant )
+  {
+    std::cout << "  Time " << names[ variant ] << " value and derivative = "
+              << timers[ variant ].GetMean() << " " << timers[ variant ].GetUnit() << std::endl;
+  }
+  std::cout << std::setprecision( 10 )
+            << "  Value filter based = " << referenceValue
+            << ", sample based = " << values[ 0 ] << std::endl;
+
+  /** Compare with the filter based computation. The values only differ in
+   * the order of summation.
+   */
+  const double tolerance = 1e-8;
+  if( std::abs( values[ 0 ] - referenceValue ) > tolerance * std::max( 1.0, std::abs( referenceValue ) ) )
+  {
+    std::cerr << "ERROR: the value of the " << metricName
+              << " metric differs from the filter based value." << std::endl;
+    return false;
+  }
+
+  if( derivatives[ 0 ].magnitude() == 0.0 )
+  {
+    std::cerr << "ERROR: the derivative of the " << metricName << " metric is zero." << std::endl;
+    return false;
+  }
+
+  /** Compare the threaded variants. Only the order of summation differs. */
+  for( unsigned int variant = 1; variant < 3; ++variant )
+  {
+    if( std::abs( values[ variant ] - values[ 0 ] ) > tolerance * std::max( 1.0, std::abs( values[ 0 ] ) ) )
+    {
+      std::cerr << "ERROR: the value of the " << names[ variant ] << " " << metricName
+                << " metric is " << values[ variant ] << ", expected " << values[ 0 ] << std::endl;
+      return false;
+    }
+
+    /** The finite difference derivatives amplify the differences in the
+     * values by 1 / ( 2 * DerivativeDelta ).
+     */
+    if( ( derivatives[ variant ] - derivatives[ 0 ] ).magnitude()
+      > 1e-4 * std::max( 1.0, derivatives[ 0 ].magnitude() ) )
+    {
+      std::cerr << "ERROR: the derivative of the " << names[ variant ] << " " << metricName
+                << " metric differs from the single-threaded derivative" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+
+} // end TestMetric()
+
+
+int
+main( void )
+{
+  /** Typedefs. */
+  typedef itk::NormalizedGradientCorrelationImageToImageMetric< ImageType, ImageType > NGCMetricType;
+  typedef itk::GradientDifferenceImageToImageMetric< ImageType, ImageType >            GDMetricType;
+  typedef NGCMetricType::ScalesType                                                    ScalesType;
+
+  const double derivativeDelta = 0.001;
+
+  /** Create the moving volume, the ray caster, and the fixed image, which is
+   * the projection with a known transform.
+   */
+  ImageType::Pointer               movingImage = CreateBlobVolume< ImageType >();
+  TransformType::Pointer           transform   = TransformType::New();
+  RayCastInterpolatorType::Pointer rayCaster   = RayCastInterpolatorType::New();
+  InitializeRayCaster( rayCaster.GetPointer(), transform.GetPointer(), movingImage.GetPointer() );
+  ImageType::Pointer fixedImage = CreateProjectedSlice( movingImage.GetPointer(),
+    transform.GetPointer(), rayCaster.GetPointer() );
+
+  const unsigned int            numberOfParameters = transform->GetNumberOfParameters();
+  TransformType::ParametersType parameters( numberOfParameters );
+  parameters.Fill( 0.0 );
+
+  /** The filter based computation. The fixed gradients are computed once,
+   * as by the metrics in Initialize().
+   */
+  typedef itk::CastImageFilter< ImageType, GradientImageType > CastFilterType;
+  CastFilterType::Pointer caster = CastFilterType::New();
+  caster->SetInput( fixedImage );
+  caster->Update();
+
+  GradientImageType::Pointer fixedGradients[ Dimension ];
+  GradientImageType::Pointer movedGradients[ Dimension ];
+  ComputeGradients( caster->GetOutput(), fixedGradients );
+
+  itk::TimeProbe ngcReferenceTimer;
+  ngcReferenceTimer.Start();
+  ComputeGradients( ComputeProjection< GradientImageType >( movingImage.GetPointer(),
+    fixedImage.GetPointer(), rayCaster.GetPointer() ), movedGradients );
+  const double ngcReferenceValue = ComputeNormalizedGradientCorrelation( fixedGradients, movedGradients );
+  ngcReferenceTimer.Stop();
+
+  /** Without limiters the rescaling factor of the gradient difference
+   * follows from the initial value.
+   */
+  itk::TimeProbe gdReferenceTimer;
+  gdReferenceTimer.Start();
+  ComputeGradients( ComputeProjection< GradientImageType >( movingImage.GetPointer(),
+    fixedImage.GetPointer(), rayCaster.GetPointer() ), movedGradients );
+  const double gdMeasure = ComputeGradientDifference( fixedGradients, movedGradients );
+  gdReferenceTimer.Stop();
+  double rescalingFactor = 1.0;
+  while( std::abs( gdMeasure ) / rescalingFactor > 1 )
+  {
+    rescalingFactor *= 10;
+  }
+  const double gdReferenceValue = -gdMeasure / rescalingFactor;
+
+  /** Create the metrics. */
+  ScalesType scales( numberOfParameters );
+  scales.Fill( 1.0 );
+
+  NGCMetricType::Pointer ngcMetric = NGCMetricType::New();
+  ngcMetric->SetFixedImage( fixedImage );
+  ngcMetric->SetFixedImageRegion( fixedImage->GetBufferedRegion() );
+  ngcMetric->SetMovingImage( movingImage );
+  ngcMetric->SetInterpolator( rayCaster );
+  ngcMetric->SetTransform( transform );
+  ngcMetric->SetImageSampler( SamplerType::New() );
+  ngcMetric->SetDerivativeDelta( derivativeDelta );
+  ngcMetric->SetScales( scales );
+
+  GDMetricType::Pointer gdMetric = GDMetricType::New();
+  gdMetric->SetFixedImage( fixedImage );
+  gdMetric->SetFixedImageRegion( fixedImage->GetBufferedRegion() );
+  gdMetric->SetMovingImage( movingImage );
+  gdMetric->SetInterpolator( rayCaster );
+  gdMetric->SetTransform( transform );
+  gdMetric->SetImageSampler( SamplerType::New() );
+  gdMetric->SetDerivativeDelta( derivativeDelta );
+  gdMetric->SetScales( scales );
+
+  if( !TestMetric< NGCMetricType >( ngcMetric, "normalized gradient correlation",
+    parameters, ngcReferenceValue, ngcReferenceTimer ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  if( !TestMetric< GDMetricType >( gdMetric, "gradient difference",
+    parameters, gdReferenceValue, gdReferenceTimer ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,197 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageImportanceSampler.h"
+#include "itkImageFullSampler.h"
+#include "itkImageRegionIterator.h"
+
+#include <cmath>
+
+// This test checks the importance sampler: most samples should be selected
+// near the edges of the image, the weighted mean of the samples should be an
+// unbiased estimate of the mean over all voxels, a weight image should
+// replace the gradient magnitude, and the multi-threaded samples and weights
+// should be the same as the single-threaded ones.
+
+const unsigned int Dimension = 3;
+typedef itk::Image< float, Dimension >              ImageType;
+typedef itk::ImageImportanceSampler< ImageType >    SamplerType;
+typedef itk::ImageFullSampler< ImageType >          FullSamplerType;
+typedef SamplerType::ImageSampleContainerType       ImageSampleContainerType;
+typedef SamplerType::ImageSampleWeightContainerType ImageSampleWeightContainerType;
+typedef SamplerType::WeightImageType                WeightImageType;
+typedef SamplerType::RandomGeneratorType            RandomGeneratorType;
+
+int
+main( void )
+{
+  /** Create an image with a bright block on a smooth background. */
+  ImageType::SizeType size;
+  size[ 0 ] = 48; size[ 1 ] = 40; size[ 2 ] = 32;
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( size );
+  image->Allocate();
+
+  itk::ImageRegionIterator< ImageType > it( image, image->GetLargestPossibleRegion() );
+  for( ; !it.IsAtEnd(); ++it )
+  {
+    const ImageType::IndexType index   = it.GetIndex();
+    const bool                 inBlock = index[ 0 ] >= 12 && index[ 0 ] < 30
+      && index[ 1 ] >= 10 && index[ 1 ] < 25 && index[ 2 ] >= 8 && index[ 2 ] < 20;
+    it.Set( static_cast< float >( 0.1 * index[ 0 ] + 0.05 * index[ 2 ] + ( inBlock ? 100.0 : 0.0 ) ) );
+  }
+
+  /** The reference: the mean over all voxels. */
+  FullSamplerType::Pointer fullSampler = FullSamplerType::New();
+  fullSampler->SetInput( image );
+  fullSampler->Update();
+  double referenceMean = 0.0;
+  for( unsigned long i = 0; i < fullSampler->GetOutput()->Size(); ++i )
+  {
+    referenceMean += fullSampler->GetOutput()->ElementAt( i ).m_ImageValue;
+  }
+  referenceMean /= fullSampler->GetOutput()->Size();
+
+  SamplerType::Pointer sampler = SamplerType::New();
+  sampler->SetInput( image );
+  sampler->SetNumberOfSamples( 100000 );
+  sampler->SetUniformWeightFraction( 0.1 );
+  RandomGeneratorType::GetInstance()->SetSeed( 4321 );
+  sampler->Update();
+
+  const ImageSampleContainerType *       samples = sampler->GetOutput();
+  const ImageSampleWeightContainerType & weights = sampler->GetSampleWeights();
+  if( weights.size() != samples->Size() )
+  {
+    std::cerr << "ERROR: " << weights.size() << " weights for " << samples->Size() << " samples." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** The samples should concentrate at the edges of the block, where the
+   * gradient magnitude is large. Less than 10% of the voxels is at an edge.
+   */
+  unsigned long numberOfEdgeSamples = 0;
+  double        weightedMean        = 0.0;
+  double        weightedMeanSquare  = 0.0;
+  for( unsigned long i = 0; i < samples->Size(); ++i )
+  {
+    ImageType::IndexType index;
+    image->TransformPhysicalPointToIndex( samples->ElementAt( i ).m_ImageCoordinates, index );
+    bool atEdge = false;
+    for( unsigned int d = 0; d < Dimension; ++d )
+    {
+      for( int step = -1; step <= 1; step += 2 )
+      {
+        ImageType::IndexType neighbour = index;
+        neighbour[ d ] += step;
+        if( image->GetLargestPossibleRegion().IsInside( neighbour )
+          && std::abs( image->GetPixel( neighbour ) - image->GetPixel( index ) ) > 10.0 )
+        {
+          atEdge = true;
+        }
+      }
+    }
+    numberOfEdgeSamples += atEdge ? 1 : 0;
+    const double weightedValue = weights[ i ] * samples->ElementAt( i ).m_ImageValue;
+    weightedMean       += weightedValue;
+    weightedMeanSquare += weightedValue * weightedValue;
+  }
+  weightedMean       /= samples->Size();
+  weightedMeanSquare /= samples->Size();
+
+  const double edgeFraction = numberOfEdgeSamples / static_cast< double >( samples->Size() );
+  std::cout << "Fraction of samples at an edge: " << edgeFraction << std::endl;
+  if( edgeFraction < 0.5 )
+  {
+    std::cerr << "ERROR: only a fraction " << edgeFraction << " of the samples is at an edge." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** The weighted mean should be an unbiased estimate of the mean, so it
+   * should differ less than four standard errors from the mean.
+   */
+  const double standardError = std::sqrt(
+    ( weightedMeanSquare - weightedMean * weightedMean ) / samples->Size() );
+  std::cout << "Weighted mean: " << weightedMean << " +/- " << standardError
+            << ", mean: " << referenceMean << std::endl;
+  if( std::abs( weightedMean - referenceMean ) > 4.0 * standardError )
+  {
+    std::cerr << "ERROR: the weighted mean of the samples differs from the mean." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** With a weight image that is zero in the lower half and no uniform
+   * fraction, no samples should be selected in the lower half.
+   */
+  WeightImageType::Pointer weightImage = WeightImageType::New();
+  weightImage->SetRegions( size );
+  weightImage->Allocate();
+  itk::ImageRegionIterator< WeightImageType > wit( weightImage, weightImage->GetLargestPossibleRegion() );
+  for( ; !wit.IsAtEnd(); ++wit )
+  {
+    wit.Set( wit.GetIndex()[ 2 ] < 16 ? 0.0f : 1.0f + wit.GetIndex()[ 0 ] );
+  }
+  sampler->SetWeightImage( weightImage );
+  sampler->SetUniformWeightFraction( 0.0 );
+  sampler->SetNumberOfSamples( 5000 );
+  sampler->Update();
+  for( unsigned long i = 0; i < sampler->GetOutput()->Size(); ++i )
+  {
+    if( sampler->GetOutput()->ElementAt( i ).m_ImageCoordinates[ 2 ] < 15.5 )
+    {
+      std::cerr << "ERROR: sample " << i << " has zero weight in the weight image." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  /** The multi-threaded samples and weights should be the same as the single-threaded ones. */
+  sampler->SetWeightImage( 0 );
+  sampler->SetUniformWeightFraction( 0.1 );
+  sampler->SetUseCounterBasedRandomGenerator( true );
+  sampler->SetNumberOfSamples( 3001 );
+
+  ImageSampleContainerType::Pointer singleThreadedSamples = ImageSampleContainerType::New();
+  ImageSampleWeightContainerType    singleThreadedWeights;
+  for( unsigned int useMultiThread = 0; useMultiThread < 2; ++useMultiThread )
+  {
+    RandomGeneratorType::GetInstance()->SetSeed( 99 );
+    sampler->SetUseMultiThread( useMultiThread == 1 );
+    sampler->SelectNewSamplesOnUpdate();
+    sampler->Update();
+    if( useMultiThread == 0 )
+    {
+      singleThreadedSamples->CastToSTLContainer() = sampler->GetOutput()->CastToSTLConstContainer();
+      singleThreadedWeights                       = sampler->GetSampleWeights();
+      continue;
+    }
+
+    for( unsigned long i = 0; i < singleThreadedSamples->Size(); ++i )
+    {
+      if( sampler->GetOutput()->ElementAt( i ).m_ImageCoordinates
+        != singleThreadedSamples->ElementAt( i ).m_ImageCoordinates
+        || sampler->GetSampleWeights()[ i ] != singleThreadedWeights[ i ] )
+      {
+        std::cerr << "ERROR: multi-threaded sample " << i
+                  << " differs from the single-threaded one." << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
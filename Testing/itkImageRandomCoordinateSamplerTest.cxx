@@ -0,0 +1,151 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageRandomCoordinateSampler.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkImageRegionIterator.h"
+#include "itkTimeProbe.h"
+
+#include <cmath>
+#include <iomanip>
+
+// This test compares the low-discrepancy mode of the random coordinate
+// sampler with the independent random coordinates. For both, it reports the
+// error of the mean intensity, estimated from a sample set, against the time
+// per sample set. The low-discrepancy estimate should be more accurate for the
+// same number of samples. The test also checks that the multi-threaded
+// low-discrepancy samples are the same as the single-threaded ones.
+
+const unsigned int Dimension = 3;
+typedef itk::Image< float, Dimension >                           ImageType;
+typedef itk::ImageRandomCoordinateSampler< ImageType >           SamplerType;
+typedef SamplerType::ImageSampleContainerType                    ImageSampleContainerType;
+typedef itk::LinearInterpolateImageFunction< ImageType, double > InterpolatorType;
+
+/** Compute the mean intensity of the samples. */
+double
+ComputeMean( const ImageSampleContainerType * samples )
+{
+  double sum = 0.0;
+  for( unsigned long i = 0; i < samples->Size(); ++i )
+  {
+    sum += samples->ElementAt( i ).m_ImageValue;
+  }
+  return sum / samples->Size();
+
+} // end ComputeMean()
+
+
+int
+main( void )
+{
+  /** Create an image with structure at several scales. */
+  ImageType::SizeType size;
+  size[ 0 ] = 64; size[ 1 ] = 56; size[ 2 ] = 48;
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( size );
+  image->Allocate();
+
+  itk::ImageRegionIterator< ImageType > it( image, image->GetLargestPossibleRegion() );
+  for( ; !it.IsAtEnd(); ++it )
+  {
+    const ImageType::IndexType index = it.GetIndex();
+    it.Set( static_cast< float >( 100.0 * std::sin( 0.11 * index[ 0 ] ) * std::cos( 0.07 * index[ 1 ] )
+      + 40.0 * std::sin( 0.5 * index[ 2 ] + 0.2 * index[ 0 ] ) + 0.05 * index[ 1 ] * index[ 2 ] ) );
+  }
+
+  SamplerType::Pointer sampler = SamplerType::New();
+  sampler->SetInput( image );
+  sampler->SetInterpolator( InterpolatorType::New() );
+  SamplerType::RandomGeneratorType::GetInstance()->SetSeed( 5489 );
+
+  /** The reference mean, from a large low-discrepancy sample set. */
+  sampler->SetUseLowDiscrepancySequence( true );
+  sampler->SetNumberOfSamples( 1000000 );
+  sampler->Update();
+  const double referenceMean = ComputeMean( sampler->GetOutput() );
+
+  /** The low-discrepancy samples should not depend on the threading. */
+  sampler->SetNumberOfSamples( 5000 );
+  SamplerType::RandomGeneratorType::GetInstance()->SetSeed( 1 );
+  sampler->SetUseMultiThread( false );
+  sampler->SelectNewSamplesOnUpdate();
+  sampler->Update();
+  ImageSampleContainerType::Pointer singleThreadedSamples = ImageSampleContainerType::New();
+  singleThreadedSamples->CastToSTLContainer() = sampler->GetOutput()->CastToSTLConstContainer();
+
+  SamplerType::RandomGeneratorType::GetInstance()->SetSeed( 1 );
+  sampler->SetUseMultiThread( true );
+  sampler->SelectNewSamplesOnUpdate();
+  sampler->Update();
+  for( unsigned long i = 0; i < singleThreadedSamples->Size(); ++i )
+  {
+    if( sampler->GetOutput()->ElementAt( i ).m_ImageCoordinates
+      != singleThreadedSamples->ElementAt( i ).m_ImageCoordinates )
+    {
+      std::cerr << "ERROR: multi-threaded low-discrepancy sample " << i
+                << " differs from the single-threaded one." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  /** Compare the error of the estimated mean against the time per update. */
+  const unsigned int numberOfRepetitions = 200;
+  const unsigned int numberOfSamples[]   = { 500, 2000, 8000 };
+  double             rmsErrors[ 2 ][ 3 ];
+  std::cout << std::setprecision( 4 );
+  for( unsigned int useLowDiscrepancySequence = 0; useLowDiscrepancySequence < 2; ++useLowDiscrepancySequence )
+  {
+    sampler->SetUseLowDiscrepancySequence( useLowDiscrepancySequence == 1 );
+    for( unsigned int n = 0; n < 3; ++n )
+    {
+      sampler->SetNumberOfSamples( numberOfSamples[ n ] );
+
+      itk::TimeProbe timer;
+      double         sumOfSquaredErrors = 0.0;
+      for( unsigned int r = 0; r < numberOfRepetitions; ++r )
+      {
+        timer.Start();
+        sampler->SelectNewSamplesOnUpdate();
+        sampler->Update();
+        timer.Stop();
+
+        const double error = ComputeMean( sampler->GetOutput() ) - referenceMean;
+        sumOfSquaredErrors += error * error;
+      }
+      rmsErrors[ useLowDiscrepancySequence ][ n ] = std::sqrt( sumOfSquaredErrors / numberOfRepetitions );
+
+      std::cout << ( useLowDiscrepancySequence ? "low-discrepancy" : "random" )
+                << ", " << numberOfSamples[ n ] << " samples: RMS error = "
+                << rmsErrors[ useLowDiscrepancySequence ][ n ]
+                << ", time per update = " << timer.GetMean() << " " << timer.GetUnit() << std::endl;
+    }
+  }
+
+  for( unsigned int n = 0; n < 3; ++n )
+  {
+    if( rmsErrors[ 1 ][ n ] >= rmsErrors[ 0 ][ n ] )
+    {
+      std::cerr << "ERROR: with " << numberOfSamples[ n ] << " samples, the low-discrepancy "
+                << "error is not smaller than the random error." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
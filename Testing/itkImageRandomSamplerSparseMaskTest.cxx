@@ -0,0 +1,127 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageRandomSamplerSparseMask.h"
+#include "itkImageFullSampler.h"
+#include "itkImageMaskSpatialObject2.h"
+#include "itkImageRegionIterator.h"
+
+// This test checks that the sparse mask random sampler, which selects its
+// samples from a run-length index of the mask, selects the same samples as
+// the random selection from all masked voxels of the full sampler.
+
+const unsigned int Dimension = 3;
+typedef itk::Image< short, Dimension >                 ImageType;
+typedef itk::ImageMaskSpatialObject2< Dimension >      MaskSpatialObjectType;
+typedef MaskSpatialObjectType::ImageType               MaskImageType;
+typedef itk::ImageRandomSamplerSparseMask< ImageType > SparseMaskSamplerType;
+typedef itk::ImageFullSampler< ImageType >             FullSamplerType;
+typedef SparseMaskSamplerType::RandomGeneratorType     RandomGeneratorType;
+
+int
+main( void )
+{
+  /** Create an image, and a sparse mask with blobs and thin lines. */
+  ImageType::SizeType size;
+  size[ 0 ] = 47; size[ 1 ] = 38; size[ 2 ] = 29;
+  ImageType::SpacingType spacing;
+  spacing[ 0 ] = 0.7; spacing[ 1 ] = 1.0; spacing[ 2 ] = 1.6;
+
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( size );
+  image->SetSpacing( spacing );
+  image->Allocate();
+
+  MaskImageType::Pointer maskImage = MaskImageType::New();
+  maskImage->SetRegions( size );
+  maskImage->SetSpacing( spacing );
+  maskImage->Allocate();
+
+  itk::ImageRegionIterator< ImageType >     it( image, image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator< MaskImageType > mit( maskImage, maskImage->GetLargestPossibleRegion() );
+  for( ; !it.IsAtEnd(); ++it, ++mit )
+  {
+    const ImageType::IndexType index = it.GetIndex();
+    it.Set( static_cast< short >( index[ 0 ] + 7 * index[ 1 ] - 3 * index[ 2 ] ) );
+
+    const long dx     = index[ 0 ] - 20;
+    const long dy     = index[ 1 ] - 15;
+    const long dz     = index[ 2 ] - 12;
+    const bool inBlob = dx * dx + dy * dy + 4 * dz * dz < 60;
+    const bool inLine = index[ 1 ] == 30 && index[ 2 ] % 5 == 0 && index[ 0 ] % 3 != 0;
+    mit.Set( ( inBlob || inLine ) ? 1 : 0 );
+  }
+
+  MaskSpatialObjectType::Pointer mask = MaskSpatialObjectType::New();
+  mask->SetImage( maskImage );
+
+  /** The reference: all masked voxels. */
+  FullSamplerType::Pointer fullSampler = FullSamplerType::New();
+  fullSampler->SetInput( image );
+  fullSampler->SetMask( mask );
+  fullSampler->Update();
+  const FullSamplerType::ImageSampleContainerType * allValidSamples = fullSampler->GetOutput();
+
+  SparseMaskSamplerType::Pointer sampler = SparseMaskSamplerType::New();
+  sampler->SetInput( image );
+  sampler->SetMask( mask );
+  sampler->SetNumberOfSamples( 3000 );
+
+  RandomGeneratorType::Pointer randomGenerator = RandomGeneratorType::GetInstance();
+  for( unsigned int useMultiThread = 0; useMultiThread < 2; ++useMultiThread )
+  {
+    sampler->SetUseMultiThread( useMultiThread != 0 );
+    for( unsigned int iteration = 0; iteration < 3; ++iteration )
+    {
+      /** Select the samples, and the same random masked voxels of the reference. */
+      const RandomGeneratorType::IntegerType seed = 100 + 10 * useMultiThread + iteration;
+      randomGenerator->SetSeed( seed );
+      sampler->SelectNewSamplesOnUpdate();
+      sampler->Update();
+
+      if( sampler->GetNumberOfMaskedVoxels() != allValidSamples->Size() )
+      {
+        std::cerr << "ERROR: the sampler found " << sampler->GetNumberOfMaskedVoxels()
+                  << " masked voxels, expected " << allValidSamples->Size() << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      randomGenerator->SetSeed( seed );
+      const SparseMaskSamplerType::ImageSampleContainerType * samples = sampler->GetOutput();
+      for( unsigned int i = 0; i < samples->Size(); ++i )
+      {
+        const unsigned long randomIndex
+          = randomGenerator->GetIntegerVariate( allValidSamples->Size() - 1 );
+        const FullSamplerType::ImageSampleType & expected = allValidSamples->ElementAt( randomIndex );
+        const SparseMaskSamplerType::ImageSampleType & sample = samples->ElementAt( i );
+        if( sample.m_ImageCoordinates != expected.m_ImageCoordinates
+          || sample.m_ImageValue != expected.m_ImageValue )
+        {
+          std::cerr << "ERROR: sample " << i << " is " << sample.m_ImageCoordinates
+                    << ", expected " << expected.m_ImageCoordinates << std::endl;
+          return EXIT_FAILURE;
+        }
+      }
+    }
+  }
+
+  std::cout << sampler->GetNumberOfMaskedVoxels() << " masked voxels in "
+            << sampler->GetNumberOfMaskRuns() << " runs OK" << std::endl;
+
+  return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,146 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImageRandomSampler.h"
+#include "itkImageRandomSamplerSparseMask.h"
+#include "itkImageMaskSpatialObject2.h"
+#include "itkImageRegionIterator.h"
+
+// This test checks that the random samplers with the counter-based random
+// generator select the same samples single-threaded and multi-threaded, for
+// any number of threads, and that a new update selects new samples.
+
+const unsigned int Dimension = 3;
+typedef itk::Image< short, Dimension >                          ImageType;
+typedef itk::ImageMaskSpatialObject2< Dimension >               MaskSpatialObjectType;
+typedef MaskSpatialObjectType::ImageType                        MaskImageType;
+typedef itk::Statistics::MersenneTwisterRandomVariateGenerator RandomGeneratorType;
+
+/** Check that the sampler selects the same samples for all numbers of threads. */
+template< class TSampler >
+bool
+CheckSampler( TSampler * sampler, const char * name )
+{
+  typedef typename TSampler::ImageSampleContainerType ImageSampleContainerType;
+
+  sampler->SetUseCounterBasedRandomGenerator( true );
+  sampler->SetNumberOfSamples( 2001 );
+
+  typename ImageSampleContainerType::Pointer reference         = ImageSampleContainerType::New();
+  const unsigned int                         numberOfThreads[] = { 1, 1, 2, 3, 8 };
+  for( unsigned int t = 0; t < 5; ++t )
+  {
+    RandomGeneratorType::GetInstance()->SetSeed( 2020 );
+    sampler->SetUseMultiThread( t != 0 );
+    sampler->SetNumberOfThreads( numberOfThreads[ t ] );
+    sampler->SelectNewSamplesOnUpdate();
+    sampler->Update();
+
+    const ImageSampleContainerType * samples = sampler->GetOutput();
+    if( t == 0 )
+    {
+      reference->CastToSTLContainer() = samples->CastToSTLConstContainer();
+      continue;
+    }
+    if( samples->Size() != reference->Size() )
+    {
+      std::cerr << "ERROR: " << name << ": " << samples->Size() << " samples with "
+                << numberOfThreads[ t ] << " threads, expected " << reference->Size() << std::endl;
+      return false;
+    }
+    for( unsigned long i = 0; i < samples->Size(); ++i )
+    {
+      if( samples->ElementAt( i ).m_ImageCoordinates != reference->ElementAt( i ).m_ImageCoordinates
+        || samples->ElementAt( i ).m_ImageValue != reference->ElementAt( i ).m_ImageValue )
+      {
+        std::cerr << "ERROR: " << name << ": sample " << i << " with " << numberOfThreads[ t ]
+                  << " threads differs from the single-threaded sample." << std::endl;
+        return false;
+      }
+    }
+  }
+
+  /** The next update should select other samples. */
+  sampler->SelectNewSamplesOnUpdate();
+  sampler->Update();
+  unsigned long numberOfEqualSamples = 0;
+  for( unsigned long i = 0; i < reference->Size(); ++i )
+  {
+    if( sampler->GetOutput()->ElementAt( i ).m_ImageCoordinates == reference->ElementAt( i ).m_ImageCoordinates )
+    {
+      ++numberOfEqualSamples;
+    }
+  }
+  if( numberOfEqualSamples > reference->Size() / 10 )
+  {
+    std::cerr << "ERROR: " << name << ": " << numberOfEqualSamples
+              << " samples did not change in the next update." << std::endl;
+    return false;
+  }
+
+  std::cout << name << ": OK" << std::endl;
+  return true;
+
+} // end CheckSampler()
+
+
+int
+main( void )
+{
+  /** Create an image and a mask. */
+  ImageType::SizeType size;
+  size[ 0 ] = 41; size[ 1 ] = 36; size[ 2 ] = 27;
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( size );
+  image->Allocate();
+
+  MaskImageType::Pointer maskImage = MaskImageType::New();
+  maskImage->SetRegions( size );
+  maskImage->Allocate();
+
+  itk::ImageRegionIterator< ImageType >     it( image, image->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator< MaskImageType > mit( maskImage, maskImage->GetLargestPossibleRegion() );
+  for( ; !it.IsAtEnd(); ++it, ++mit )
+  {
+    const ImageType::IndexType index = it.GetIndex();
+    it.Set( static_cast< short >( 3 * index[ 0 ] - index[ 1 ] + 11 * index[ 2 ] ) );
+    mit.Set( ( index[ 0 ] + index[ 1 ] ) % 7 < 2 ? 1 : 0 );
+  }
+
+  MaskSpatialObjectType::Pointer mask = MaskSpatialObjectType::New();
+  mask->SetImage( maskImage );
+
+  typedef itk::ImageRandomSampler< ImageType > RandomSamplerType;
+  RandomSamplerType::Pointer randomSampler = RandomSamplerType::New();
+  randomSampler->SetInput( image );
+  if( !CheckSampler( randomSampler.GetPointer(), "RandomSampler" ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  typedef itk::ImageRandomSamplerSparseMask< ImageType > SparseMaskSamplerType;
+  SparseMaskSamplerType::Pointer sparseMaskSampler = SparseMaskSamplerType::New();
+  sparseMaskSampler->SetInput( image );
+  sparseMaskSampler->SetMask( mask );
+  if( !CheckSampler( sparseMaskSampler.GetPointer(), "RandomSamplerSparseMask" ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
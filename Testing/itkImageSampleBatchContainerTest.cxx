@@ -0,0 +1,209 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkImage.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageFullSampler.h"
+#include "itkImageGridSampler.h"
+#include "itkImageRandomCoordinateSampler.h"
+
+#include <algorithm>
+
+// This test checks that the structure-of-arrays sample batch container of
+// the image samplers contains the same samples as the sample container,
+// that it is only generated on request, that it detects a regenerated sample container, that its arrays are
+// aligned, and that it does not reallocate memory when new samples are
+// selected.
+
+typedef itk::Image< short, 3 > ImageType;
+
+template< class TSampler >
+bool
+CheckSampler( TSampler * sampler, const char * name, unsigned int expectedAllocations )
+{
+  typedef typename TSampler::ImageSampleContainerType      ImageSampleContainerType;
+  typedef typename TSampler::ImageSampleBatchContainerType ImageSampleBatchContainerType;
+
+  const ImageSampleContainerType *      sampleContainer      = sampler->GetOutput();
+  const ImageSampleBatchContainerType * sampleBatchContainer = sampler->GetSampleBatchContainer();
+
+  if( !sampleBatchContainer->IsCopyOf( sampleContainer ) )
+  {
+    std::cerr << "ERROR: " << name << ": the sample batch container is not up to date." << std::endl;
+    return false;
+  }
+
+  if( sampleBatchContainer->GetNumberOfSamples() != sampleContainer->Size() )
+  {
+    std::cerr << "ERROR: " << name << ": the sample batch container has "
+              << sampleBatchContainer->GetNumberOfSamples() << " samples, expected "
+              << sampleContainer->Size() << std::endl;
+    return false;
+  }
+
+  for( unsigned int d = 0; d < ImageType::ImageDimension; ++d )
+  {
+    if( reinterpret_cast< std::size_t >( sampleBatchContainer->GetCoordinates( d ) )
+      % ImageSampleBatchContainerType::Alignment != 0 )
+    {
+      std::cerr << "ERROR: " << name << ": coordinate array " << d << " is not aligned." << std::endl;
+      return false;
+    }
+  }
+
+  /** Read the samples in blocks, as the metrics do. */
+  const unsigned int                                blockSize = 16;
+  typename ImageSampleBatchContainerType::PointType points[ blockSize ];
+  double                                            values[ blockSize ];
+  for( unsigned long begin = 0; begin < sampleContainer->Size(); begin += blockSize )
+  {
+    const unsigned int numberOfSamples = static_cast< unsigned int >(
+      std::min< unsigned long >( blockSize, sampleContainer->Size() - begin ) );
+    sampleBatchContainer->GetSamples( begin, numberOfSamples, points, values );
+
+    for( unsigned int i = 0; i < numberOfSamples; ++i )
+    {
+      const typename TSampler::ImageSampleType & sample = sampleContainer->ElementAt( begin + i );
+      if( points[ i ] != sample.m_ImageCoordinates || values[ i ] != sample.m_ImageValue )
+      {
+        std::cerr << "ERROR: " << name << ": sample " << begin + i << " differs." << std::endl;
+        return false;
+      }
+    }
+  }
+
+  if( sampleBatchContainer->GetNumberOfAllocations() != expectedAllocations )
+  {
+    std::cerr << "ERROR: " << name << ": the sample batch container allocated memory "
+              << sampleBatchContainer->GetNumberOfAllocations() << " times, expected "
+              << expectedAllocations << std::endl;
+    return false;
+  }
+
+  std::cout << name << ": " << sampleContainer->Size() << " samples OK" << std::endl;
+  return true;
+
+} // end CheckSampler()
+
+
+int
+main( int argc, char * argv[] )
+{
+  /** Create an image with some structure. */
+  ImageType::SizeType size;
+  size.Fill( 20 );
+  ImageType::SpacingType spacing;
+  spacing[ 0 ] = 0.5; spacing[ 1 ] = 1.0; spacing[ 2 ] = 2.0;
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( size );
+  image->SetSpacing( spacing );
+  image->Allocate();
+
+  itk::ImageRegionIterator< ImageType > it( image, image->GetLargestPossibleRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+  {
+    const ImageType::IndexType index = it.GetIndex();
+    it.Set( static_cast< short >( index[ 0 ] + 3 * index[ 1 ] - 2 * index[ 2 ] ) );
+  }
+
+  /** Full sampler. */
+  typedef itk::ImageFullSampler< ImageType > FullSamplerType;
+  FullSamplerType::Pointer fullSampler = FullSamplerType::New();
+  fullSampler->SetInput( image );
+  fullSampler->Update();
+  if( fullSampler->GetSampleBatchContainer()->GetNumberOfSamples() != 0 )
+  {
+    std::cerr << "ERROR: the sample batch container should not be generated by default." << std::endl;
+    return EXIT_FAILURE;
+  }
+  fullSampler->SetGenerateSampleBatchContainer( true );
+  fullSampler->Update();
+  if( !CheckSampler( fullSampler.GetPointer(), "FullSampler", 1 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** Grid sampler. */
+  typedef itk::ImageGridSampler< ImageType > GridSamplerType;
+  GridSamplerType::Pointer gridSampler = GridSamplerType::New();
+  gridSampler->SetInput( image );
+  GridSamplerType::SampleGridSpacingType gridSpacing;
+  gridSpacing.Fill( 3 );
+  gridSampler->SetSampleGridSpacing( gridSpacing );
+  gridSampler->SetGenerateSampleBatchContainer( true );
+  gridSampler->Update();
+  if( !CheckSampler( gridSampler.GetPointer(), "GridSampler", 1 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** Random coordinate sampler, single-threaded and multi-threaded. New
+   * samples are selected every iteration; the memory should be reused.
+   */
+  typedef itk::ImageRandomCoordinateSampler< ImageType > RandomCoordinateSamplerType;
+  RandomCoordinateSamplerType::Pointer randomSampler = RandomCoordinateSamplerType::New();
+  randomSampler->SetInput( image );
+  randomSampler->SetNumberOfSamples( 1000 );
+  randomSampler->SetGenerateSampleBatchContainer( true );
+  for( unsigned int useMultiThread = 0; useMultiThread < 2; ++useMultiThread )
+  {
+    randomSampler->SetUseMultiThread( useMultiThread != 0 );
+    for( unsigned int iteration = 0; iteration < 5; ++iteration )
+    {
+      randomSampler->SelectNewSamplesOnUpdate();
+      randomSampler->Update();
+      if( !CheckSampler( randomSampler.GetPointer(), "RandomCoordinateSampler", 1 ) )
+      {
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  /** A sample container that is regenerated in another way than by
+   * Update() has a newer update time, so the batch container is stale,
+   * even though the number of samples is the same.
+   */
+  randomSampler->GetOutput()->DataHasBeenGenerated();
+  if( randomSampler->GetSampleBatchContainer()->IsCopyOf( randomSampler->GetOutput() ) )
+  {
+    std::cerr << "ERROR: the sample batch container should be stale." << std::endl;
+    return EXIT_FAILURE;
+  }
+  randomSampler->SelectNewSamplesOnUpdate();
+  randomSampler->Update();
+  if( !CheckSampler( randomSampler.GetPointer(), "RandomCoordinateSampler (regenerated)", 1 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** Fewer samples should not reallocate, more samples should. */
+  randomSampler->SetNumberOfSamples( 500 );
+  randomSampler->Update();
+  if( !CheckSampler( randomSampler.GetPointer(), "RandomCoordinateSampler (500)", 1 ) )
+  {
+    return EXIT_FAILURE;
+  }
+  randomSampler->SetNumberOfSamples( 2000 );
+  randomSampler->Update();
+  if( !CheckSampler( randomSampler.GetPointer(), "RandomCoordinateSampler (2000)", 2 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,232 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkKNNGraphAlphaMutualInformationImageToImageMetric.h"
+#include "itkAdvancedBSplineDeformableTransform.h"
+#include "itkBSplineInterpolateImageFunction.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkImageGridSampler.h"
+#include "itkImageRegionIterator.h"
+#include "itkTimeProbe.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <vector>
+
+// This test checks that the multi-threaded kNN graph alpha mutual
+// information metric, using either the ITK threader or the work-stealing
+// thread pool, gives the same value and derivative as the single-threaded
+// metric, and reports the timings of the three variants. It also checks that
+// refitting the kNN trees gives the same result as rebuilding them.
+
+const unsigned int Dimension = 2;
+typedef itk::Image< float, Dimension > ImageType;
+
+ImageType::Pointer
+CreateImage( const double shift, const double frequency )
+{
+  ImageType::SizeType size;
+  size.Fill( 64 );
+  ImageType::Pointer image = ImageType::New();
+  image->SetRegions( size );
+  image->Allocate();
+
+  itk::ImageRegionIterator< ImageType > it( image, image->GetLargestPossibleRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+  {
+    const ImageType::IndexType index = it.GetIndex();
+    const double               x     = index[ 0 ] - shift;
+    const double               y     = index[ 1 ];
+    it.Set( static_cast< float >( 100.0 * std::sin( frequency * x ) * std::cos( 0.07 * y )
+      + 0.5 * x + 0.25 * y ) );
+  }
+  return image;
+
+} // end CreateImage()
+
+
+int
+main( int argc, char * argv[] )
+{
+  /** Typedefs. */
+  typedef itk::KNNGraphAlphaMutualInformationImageToImageMetric<
+    ImageType, ImageType >                                    MetricType;
+  typedef MetricType::MeasureType                             MeasureType;
+  typedef MetricType::DerivativeType                          DerivativeType;
+  typedef itk::AdvancedBSplineDeformableTransform< double, Dimension, 3 > TransformType;
+  typedef itk::BSplineInterpolateImageFunction<
+    ImageType, double, double >                               InterpolatorType;
+  typedef itk::LinearInterpolateImageFunction<
+    ImageType, double >                                       FixedImageInterpolatorType;
+  typedef itk::ImageGridSampler< ImageType >                  SamplerType;
+
+  const unsigned int numberOfFeatures    = 2;
+  const unsigned int numberOfRepetitions = 5;
+
+  /** Create the transform. */
+  TransformType::Pointer transform = TransformType::New();
+  TransformType::OriginType gridOrigin;
+  gridOrigin.Fill( -16.0 );
+  TransformType::SpacingType gridSpacing;
+  gridSpacing.Fill( 16.0 );
+  TransformType::RegionType::SizeType gridSize;
+  gridSize.Fill( 8 );
+  TransformType::RegionType gridRegion;
+  gridRegion.SetSize( gridSize );
+  transform->SetGridOrigin( gridOrigin );
+  transform->SetGridSpacing( gridSpacing );
+  transform->SetGridRegion( gridRegion );
+
+  TransformType::ParametersType parameters( transform->GetNumberOfParameters() );
+  for( unsigned int i = 0; i < parameters.GetSize(); ++i )
+  {
+    parameters[ i ] = 0.5 * std::sin( 0.37 * i );
+  }
+  transform->SetParameters( parameters );
+
+  /** Create the sampler. A grid sampler is used, so that all variants
+   * see the same samples.
+   */
+  SamplerType::Pointer sampler = SamplerType::New();
+  SamplerType::SampleGridSpacingType samplingGridSpacing;
+  samplingGridSpacing.Fill( 2 );
+  sampler->SetSampleGridSpacing( samplingGridSpacing );
+
+  /** Create the metric. */
+  MetricType::Pointer metric = MetricType::New();
+  metric->SetNumberOfFixedImages( numberOfFeatures );
+  metric->SetNumberOfFixedImageRegions( numberOfFeatures );
+  metric->SetNumberOfFixedImageInterpolators( numberOfFeatures );
+  metric->SetNumberOfMovingImages( numberOfFeatures );
+  metric->SetNumberOfInterpolators( numberOfFeatures );
+  for( unsigned int i = 0; i < numberOfFeatures; ++i )
+  {
+    ImageType::Pointer fixedImage  = CreateImage( 0.0, 0.1 + 0.05 * i );
+    ImageType::Pointer movingImage = CreateImage( 1.5, 0.1 + 0.05 * i );
+    metric->SetFixedImage( fixedImage, i );
+    metric->SetFixedImageRegion( fixedImage->GetBufferedRegion(), i );
+    metric->SetFixedImageInterpolator( FixedImageInterpolatorType::New(), i );
+    metric->SetMovingImage( movingImage, i );
+    metric->SetInterpolator( InterpolatorType::New(), i );
+  }
+  metric->SetTransform( transform );
+  metric->SetImageSampler( sampler );
+  metric->SetANNkDTree( 1, "ANN_KD_SL_MIDPT" );
+  metric->SetANNStandardTreeSearch( 5, 0.0 );
+  metric->SetAlpha( 0.99 );
+
+  /** Run the single-threaded, ITK-threaded and thread pool variants. */
+  const char * names[ 3 ] = { "single-threaded", "multi-threader", "thread pool" };
+  MeasureType    values[ 3 ];
+  DerivativeType derivatives[ 3 ];
+  itk::TimeProbe timers[ 3 ];
+  for( unsigned int variant = 0; variant < 3; ++variant )
+  {
+    metric->SetUseMultiThread( variant > 0 );
+    metric->SetUseWorkStealingThreadPool( variant == 2 );
+    metric->Initialize();
+
+    for( unsigned int r = 0; r < numberOfRepetitions; ++r )
+    {
+      timers[ variant ].Start();
+      metric->GetValueAndDerivative( parameters, values[ variant ], derivatives[ variant ] );
+      timers[ variant ].Stop();
+    }
+  }
+
+  /** Report the timings. */
+  std::cout << std::setprecision( 4 );
+  for( unsigned int variant = 0; variant < 3; ++variant )
+  {
+    std::cout << "Time " << names[ variant ] << " = " << timers[ variant ].GetMean()
+              << " " << timers[ variant ].GetUnit()
+              << ", speedup = " << timers[ 0 ].GetMean() / timers[ variant ].GetMean()
+              << std::endl;
+  }
+
+  /** Compare the results. Only the order of summation differs. */
+  const double tolerance = 1e-8;
+  for( unsigned int variant = 1; variant < 3; ++variant )
+  {
+    const double valueDifference = std::abs( values[ variant ] - values[ 0 ] );
+    if( valueDifference > tolerance * std::max( 1.0, std::abs( values[ 0 ] ) ) )
+    {
+      std::cerr << "ERROR: the value of the " << names[ variant ] << " metric is "
+                << values[ variant ] << ", expected " << values[ 0 ] << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    const double derivativeDifference = ( derivatives[ variant ] - derivatives[ 0 ] ).magnitude();
+    if( derivativeDifference > tolerance * std::max( 1.0, derivatives[ 0 ].magnitude() ) )
+    {
+      std::cerr << "ERROR: the derivative of the " << names[ variant ] << " metric differs "
+                << derivativeDifference << " from the single-threaded derivative" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  /** Refit the trees instead of rebuilding them, while the transform
+   * changes. The refitted trees should give the same neighbours.
+   */
+  metric->SetUseMultiThread( false );
+  metric->SetUseWorkStealingThreadPool( false );
+  std::vector< TransformType::ParametersType > stepParameters( numberOfRepetitions, parameters );
+  for( unsigned int r = 0; r < numberOfRepetitions; ++r )
+  {
+    for( unsigned int i = 0; i < parameters.GetSize(); ++i )
+    {
+      stepParameters[ r ][ i ] += 0.05 * r * std::cos( 0.11 * i );
+    }
+  }
+
+  std::vector< MeasureType >    refitValues( numberOfRepetitions );
+  std::vector< DerivativeType > refitDerivatives( numberOfRepetitions );
+  itk::TimeProbe                refitTimer;
+  metric->SetTreeRebuildInterval( numberOfRepetitions + 1 );
+  for( unsigned int r = 0; r < numberOfRepetitions; ++r )
+  {
+    refitTimer.Start();
+    metric->GetValueAndDerivative( stepParameters[ r ], refitValues[ r ], refitDerivatives[ r ] );
+    refitTimer.Stop();
+  }
+
+  itk::TimeProbe rebuildTimer;
+  metric->SetTreeRebuildInterval( 1 );
+  for( unsigned int r = 0; r < numberOfRepetitions; ++r )
+  {
+    MeasureType    rebuildValue;
+    DerivativeType rebuildDerivative;
+    rebuildTimer.Start();
+    metric->GetValueAndDerivative( stepParameters[ r ], rebuildValue, rebuildDerivative );
+    rebuildTimer.Stop();
+
+    if( std::abs( refitValues[ r ] - rebuildValue ) > tolerance * std::max( 1.0, std::abs( rebuildValue ) )
+      || ( refitDerivatives[ r ] - rebuildDerivative ).magnitude()
+      > tolerance * std::max( 1.0, rebuildDerivative.magnitude() ) )
+    {
+      std::cerr << "ERROR: the metric with refitted trees differs from the metric "
+                << "with rebuilt trees: " << refitValues[ r ] << " vs " << rebuildValue << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  std::cout << "Time rebuilding trees = " << rebuildTimer.GetMean() << " " << rebuildTimer.GetUnit()
+            << ", refitting trees = " << refitTimer.GetMean() << " " << refitTimer.GetUnit() << std::endl;
+
+  return EXIT_SUCCESS;
+
+} // end main
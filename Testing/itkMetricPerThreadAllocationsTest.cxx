@@ -0,0 +1,142 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkAdvancedMeanSquaresImageToImageMetric.h"
+#include "itkParzenWindowMutualInformationImageToImageMetric.h"
+#include "itkAdvancedBSplineDeformableTransform.h"
+#include "itkBSplineInterpolateImageFunction.h"
+#include "itkImageRandomSampler.h"
+
+#include "itkMetricTestHelper.h"
+
+// This test checks that the multi-threaded metrics allocate their per-thread
+// variables and scratch memory when they are initialized, and not during the
+// iterations: GetNumberOfPerThreadAllocations() should stay the same while
+// GetValueAndDerivative() is called with new samples and parameters. A new
+// resolution with the same sizes should not allocate either; more threads
+// should.
+
+const unsigned int Dimension = 2;
+typedef itk::Image< float, Dimension >                                  ImageType;
+typedef itk::AdvancedBSplineDeformableTransform< double, Dimension, 3 > TransformType;
+typedef itk::BSplineInterpolateImageFunction< ImageType, double, double > InterpolatorType;
+typedef itk::ImageRandomSampler< ImageType >                            SamplerType;
+
+template< class TMetric >
+bool
+TestMetric( TMetric * metric, const char * name )
+{
+  typedef typename TMetric::MeasureType    MeasureType;
+  typedef typename TMetric::DerivativeType DerivativeType;
+
+  ImageType::Pointer fixedImage  = CreateBlobImage< ImageType >( 0.0 );
+  ImageType::Pointer movingImage = CreateBlobImage< ImageType >( 1.5 );
+
+  TransformType::Pointer        transform = TransformType::New();
+  TransformType::ParametersType parameters;
+  InitializeBlobBSplineTransform( transform.GetPointer(), parameters );
+
+  InterpolatorType::Pointer interpolator = InterpolatorType::New();
+  interpolator->SetSplineOrder( 3 );
+
+  SamplerType::Pointer sampler = SamplerType::New();
+  sampler->SetNumberOfSamples( 500 );
+
+  metric->SetFixedImage( fixedImage );
+  metric->SetFixedImageRegion( fixedImage->GetBufferedRegion() );
+  metric->SetMovingImage( movingImage );
+  metric->SetInterpolator( interpolator );
+  metric->SetTransform( transform );
+  metric->SetImageSampler( sampler );
+  metric->SetUseMultiThread( true );
+  metric->SetNumberOfThreads( 3 );
+  metric->Initialize();
+
+  /** The first iteration may still size memory that depends on the samples. */
+  MeasureType    value;
+  DerivativeType derivative;
+  metric->GetValueAndDerivative( parameters, value, derivative );
+  const itk::SizeValueType numberOfAllocations = metric->GetNumberOfPerThreadAllocations();
+  std::cout << name << ": " << numberOfAllocations << " per-thread allocations" << std::endl;
+  if( numberOfAllocations == 0 )
+  {
+    std::cerr << "ERROR: " << name << ": no per-thread allocations were counted." << std::endl;
+    return false;
+  }
+
+  /** Iterate with new samples and new parameters. */
+  for( unsigned int iteration = 0; iteration < 10; ++iteration )
+  {
+    sampler->SelectNewSamplesOnUpdate();
+    parameters *= 0.9;
+    metric->GetValueAndDerivative( parameters, value, derivative );
+    if( metric->GetNumberOfPerThreadAllocations() != numberOfAllocations )
+    {
+      std::cerr << "ERROR: " << name << ": iteration " << iteration << " allocated per-thread memory: "
+                << metric->GetNumberOfPerThreadAllocations() << " allocations, expected "
+                << numberOfAllocations << std::endl;
+      return false;
+    }
+  }
+
+  /** A new resolution with the same sizes reuses the memory. */
+  metric->Initialize();
+  metric->GetValueAndDerivative( parameters, value, derivative );
+  if( metric->GetNumberOfPerThreadAllocations() != numberOfAllocations )
+  {
+    std::cerr << "ERROR: " << name << ": re-initialization allocated per-thread memory." << std::endl;
+    return false;
+  }
+
+  /** More threads need more memory. */
+  metric->SetNumberOfThreads( 4 );
+  metric->Initialize();
+  metric->GetValueAndDerivative( parameters, value, derivative );
+  if( metric->GetNumberOfPerThreadAllocations() <= numberOfAllocations )
+  {
+    std::cerr << "ERROR: " << name << ": more threads did not allocate per-thread memory." << std::endl;
+    return false;
+  }
+
+  return true;
+
+} // end TestMetric()
+
+
+int
+main( void )
+{
+  typedef itk::AdvancedMeanSquaresImageToImageMetric< ImageType, ImageType > MeanSquaresMetricType;
+  MeanSquaresMetricType::Pointer meanSquares = MeanSquaresMetricType::New();
+  if( !TestMetric( meanSquares.GetPointer(), "AdvancedMeanSquares" ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  typedef itk::ParzenWindowMutualInformationImageToImageMetric< ImageType, ImageType > MattesMetricType;
+  MattesMetricType::Pointer mattes = MattesMetricType::New();
+  mattes->SetNumberOfFixedHistogramBins( 32 );
+  mattes->SetNumberOfMovingHistogramBins( 32 );
+  mattes->SetUseDerivative( true );
+  if( !TestMetric( mattes.GetPointer(), "AdvancedMattesMutualInformation" ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,89 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkMetricTestHelper_h
+#define __itkMetricTestHelper_h
+
+#include "itkImageRegionIterator.h"
+
+#include <cmath>
+
+// Fixtures for the tests of the image to image metrics: a 2D image with two
+// blobs, and a cubic B-spline transform whose grid covers that image.
+
+/** Create a 48x48 image with two blobs, shifted in x over shift pixels. */
+template< class TImage >
+typename TImage::Pointer
+CreateBlobImage( const double shift )
+{
+  typename TImage::SizeType size;
+  size.Fill( 48 );
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions( size );
+  image->Allocate();
+
+  itk::ImageRegionIterator< TImage > it( image, image->GetLargestPossibleRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+  {
+    const double x = it.GetIndex()[ 0 ] - 24.0 - shift;
+    const double y = it.GetIndex()[ 1 ] - 20.0;
+    it.Set( static_cast< typename TImage::PixelType >(
+      100.0 * std::exp( -( x * x + y * y ) / 80.0 )
+      + 40.0 * std::exp( -( ( x + 10.0 ) * ( x + 10.0 ) + ( y - 14.0 ) * ( y - 14.0 ) ) / 30.0 ) ) );
+  }
+  return image;
+
+} // end CreateBlobImage()
+
+
+/** Set the grid of a 2D B-spline transform, such that it covers the blob
+ * image, and set parameters that deform the image smoothly. The transform
+ * refers to the parameters, so they are owned by the caller.
+ */
+template< class TTransform >
+void
+InitializeBlobBSplineTransform( TTransform * transform,
+  typename TTransform::ParametersType & parameters )
+{
+  typename TTransform::RegionType::SizeType gridSize;
+  gridSize.Fill( 10 );
+  typename TTransform::RegionType gridRegion;
+  gridRegion.SetSize( gridSize );
+  typename TTransform::SpacingType gridSpacing;
+  gridSpacing.Fill( 8.0 );
+  typename TTransform::OriginType gridOrigin;
+  gridOrigin.Fill( -12.0 );
+  typename TTransform::DirectionType gridDirection;
+  gridDirection.SetIdentity();
+
+  transform->SetGridOrigin( gridOrigin );
+  transform->SetGridSpacing( gridSpacing );
+  transform->SetGridRegion( gridRegion );
+  transform->SetGridDirection( gridDirection );
+
+  const unsigned int numberOfParameters = transform->GetNumberOfParameters();
+  parameters.SetSize( numberOfParameters );
+  for( unsigned int p = 0; p < numberOfParameters; ++p )
+  {
+    parameters[ p ] = 0.3 * std::sin( 0.7 * p );
+  }
+  transform->SetParameters( parameters );
+
+} // end InitializeBlobBSplineTransform()
+
+
+#endif // end #ifndef __itkMetricTestHelper_h
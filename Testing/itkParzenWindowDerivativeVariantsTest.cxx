@@ -0,0 +1,156 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkParzenWindowMutualInformationImageToImageMetric.h"
+#include "itkParzenWindowNormalizedMutualInformationImageToImageMetric.h"
+#include "itkAdvancedBSplineDeformableTransform.h"
+#include "itkBSplineInterpolateImageFunction.h"
+#include "itkImageFullSampler.h"
+
+#include "itkMetricTestHelper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+// This test checks that the variants of the derivative of the Parzen window
+// metrics give the same value and derivative as the explicit joint histogram
+// derivatives: the low memory variant, which loops over the samples a second
+// time, and the sparse joint histogram derivatives of the Mattes mutual
+// information. All variants are computed single-threadedly and
+// multi-threadedly. Only the order of summation differs.
+
+const unsigned int Dimension = 2;
+typedef itk::Image< float, Dimension >                                  ImageType;
+typedef itk::AdvancedBSplineDeformableTransform< double, Dimension, 3 > TransformType;
+typedef itk::BSplineInterpolateImageFunction< ImageType, double, double > InterpolatorType;
+typedef itk::ImageFullSampler< ImageType >                              SamplerType;
+
+/** Compare the value and derivative of the variants of a metric with the
+ * explicit, single-threaded variant. Variants 0 and 1 use the explicit joint
+ * histogram derivatives, 2 and 3 the low memory derivative, and 4 and 5 the
+ * sparse ones; odd variants are multi-threaded.
+ */
+template< class TMetric >
+bool
+TestMetric( TMetric * metric, const char * name, const unsigned int numberOfVariants )
+{
+  typedef typename TMetric::MeasureType    MeasureType;
+  typedef typename TMetric::DerivativeType DerivativeType;
+
+  ImageType::Pointer fixedImage  = CreateBlobImage< ImageType >( 0.0 );
+  ImageType::Pointer movingImage = CreateBlobImage< ImageType >( 1.5 );
+
+  TransformType::Pointer        transform = TransformType::New();
+  TransformType::ParametersType parameters;
+  InitializeBlobBSplineTransform( transform.GetPointer(), parameters );
+
+  InterpolatorType::Pointer interpolator = InterpolatorType::New();
+  interpolator->SetSplineOrder( 3 );
+
+  metric->SetFixedImage( fixedImage );
+  metric->SetFixedImageRegion( fixedImage->GetBufferedRegion() );
+  metric->SetMovingImage( movingImage );
+  metric->SetInterpolator( interpolator );
+  metric->SetTransform( transform );
+  metric->SetImageSampler( SamplerType::New() );
+  metric->SetNumberOfFixedHistogramBins( 32 );
+  metric->SetNumberOfMovingHistogramBins( 32 );
+  metric->SetUseDerivative( true );
+  metric->SetNumberOfThreads( 4 );
+
+  const char * names[ 6 ] = {
+    "explicit, single-threaded", "explicit, multi-threaded",
+    "low memory, single-threaded", "low memory, multi-threaded",
+    "sparse, single-threaded", "sparse, multi-threaded" };
+
+  MeasureType    explicitValue = 0.0;
+  DerivativeType explicitDerivative;
+  for( unsigned int variant = 0; variant < numberOfVariants; ++variant )
+  {
+    metric->SetUseExplicitPDFDerivatives( variant < 2 || variant >= 4 );
+    metric->SetUseSparsePDFDerivatives( variant >= 4 );
+    metric->SetUseMultiThread( variant % 2 == 1 );
+    metric->Initialize();
+
+    MeasureType    value;
+    DerivativeType derivative;
+    metric->GetValueAndDerivative( parameters, value, derivative );
+
+    if( variant == 0 )
+    {
+      explicitValue      = value;
+      explicitDerivative = derivative;
+      std::cout << std::setprecision( 10 ) << name << ", " << names[ variant ]
+                << ": value = " << value
+                << ", derivative magnitude = " << derivative.magnitude() << std::endl;
+      if( derivative.magnitude() == 0.0 )
+      {
+        std::cerr << "ERROR: " << name << ": the explicit derivative is zero." << std::endl;
+        return false;
+      }
+      continue;
+    }
+
+    const double valueDifference      = std::abs( value - explicitValue );
+    const double derivativeDifference = ( derivative - explicitDerivative ).magnitude();
+    std::cout << name << ", " << names[ variant ] << ": value difference = " << valueDifference
+              << ", derivative difference = " << derivativeDifference << std::endl;
+
+    /** The joint histogram derivatives are stored in float, so the
+     * derivatives are compared with a single precision tolerance.
+     */
+    if( valueDifference > 1e-8 * std::max( 1.0, std::abs( explicitValue ) ) )
+    {
+      std::cerr << "ERROR: " << name << ", " << names[ variant ] << ": the value is "
+                << value << ", expected " << explicitValue << std::endl;
+      return false;
+    }
+    if( derivativeDifference > 1e-5 * explicitDerivative.magnitude() )
+    {
+      std::cerr << "ERROR: " << name << ", " << names[ variant ]
+                << ": the derivative differs from the explicit, single-threaded derivative" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+
+} // end TestMetric()
+
+
+int
+main( void )
+{
+  typedef itk::ParzenWindowMutualInformationImageToImageMetric< ImageType, ImageType > MattesMetricType;
+  MattesMetricType::Pointer mattes = MattesMetricType::New();
+  if( !TestMetric( mattes.GetPointer(), "AdvancedMattesMutualInformation", 6 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** The normalized mutual information does not support sparse joint histogram derivatives. */
+  typedef itk::ParzenWindowNormalizedMutualInformationImageToImageMetric< ImageType, ImageType > NMIMetricType;
+  NMIMetricType::Pointer nmi = NMIMetricType::New();
+  if( !TestMetric( nmi.GetPointer(), "NormalizedMutualInformation", 4 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
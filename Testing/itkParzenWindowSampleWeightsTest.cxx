@@ -0,0 +1,222 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkParzenWindowMutualInformationImageToImageMetric.h"
+#include "itkParzenWindowNormalizedMutualInformationImageToImageMetric.h"
+#include "itkAdvancedBSplineDeformableTransform.h"
+#include "itkBSplineInterpolateImageFunction.h"
+#include "itkImageSamplerBase.h"
+
+#include "itkMetricTestHelper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+// This test checks that the Parzen window metrics weight the samples by the
+// importance weights of the image sampler: a sample with an integer weight w
+// should count as w copies of an unweighted sample. The value and derivative
+// of the Mattes and normalized mutual information are compared for a list of
+// weighted samples and for the list in which every sample is repeated, for
+// all derivative variants, single- and multi-threadedly.
+
+const unsigned int Dimension = 2;
+typedef itk::Image< float, Dimension >                                  ImageType;
+typedef itk::AdvancedBSplineDeformableTransform< double, Dimension, 3 > TransformType;
+typedef itk::BSplineInterpolateImageFunction< ImageType, double, double > InterpolatorType;
+
+namespace itk
+{
+
+/** An image sampler that outputs a given list of samples, with given weights. */
+template< class TInputImage >
+class ListImageSampler : public ImageSamplerBase< TInputImage >
+{
+public:
+
+  typedef ListImageSampler                 Self;
+  typedef ImageSamplerBase< TInputImage >  Superclass;
+  typedef SmartPointer< Self >             Pointer;
+  typedef SmartPointer< const Self >       ConstPointer;
+
+  itkNewMacro( Self );
+  itkTypeMacro( ListImageSampler, ImageSamplerBase );
+
+  typedef typename Superclass::ImageSampleType                ImageSampleType;
+  typedef typename Superclass::ImageSampleWeightContainerType ImageSampleWeightContainerType;
+  typedef std::vector< ImageSampleType >                      ImageSampleListType;
+
+  /** Set the samples and their weights; no weights means uniform weights. */
+  void SetSamples( const ImageSampleListType & samples,
+    const ImageSampleWeightContainerType & weights )
+  {
+    this->m_Samples       = samples;
+    this->m_SampleWeights = weights;
+    this->Modified();
+  }
+
+protected:
+
+  ListImageSampler() {}
+  virtual ~ListImageSampler() {}
+
+  virtual void GenerateData( void )
+  {
+    this->GetOutput()->CastToSTLContainer() = this->m_Samples;
+  }
+
+private:
+
+  ListImageSampler( const Self & );   // purposely not implemented
+  void operator=( const Self & );     // purposely not implemented
+
+  ImageSampleListType m_Samples;
+};
+
+} // end namespace itk
+
+typedef itk::ListImageSampler< ImageType >      SamplerType;
+typedef SamplerType::ImageSampleType            ImageSampleType;
+typedef SamplerType::ImageSampleListType        ImageSampleListType;
+typedef SamplerType::ImageSampleWeightContainerType ImageSampleWeightContainerType;
+
+/** Compare the value and derivative of a metric for the weighted and the
+ * repeated samples. Variants 0 and 1 use the low memory derivative, 2 and 3
+ * the explicit joint histogram derivatives, 4 and 5 the sparse ones, and 6
+ * and 7 finite differences; odd variants are multi-threaded.
+ */
+template< class TMetric >
+bool
+TestMetric( TMetric * metric, const char * name, const unsigned int numberOfVariants )
+{
+  typedef typename TMetric::MeasureType    MeasureType;
+  typedef typename TMetric::DerivativeType DerivativeType;
+
+  ImageType::Pointer fixedImage  = CreateBlobImage< ImageType >( 0.0 );
+  ImageType::Pointer movingImage = CreateBlobImage< ImageType >( 1.5 );
+
+  TransformType::Pointer        transform = TransformType::New();
+  TransformType::ParametersType parameters;
+  InitializeBlobBSplineTransform( transform.GetPointer(), parameters );
+
+  InterpolatorType::Pointer interpolator = InterpolatorType::New();
+  interpolator->SetSplineOrder( 3 );
+
+  /** Weighted samples on every other voxel, with the weights 1, 2 and 3,
+   * and the same samples repeated as many times as their weight.
+   */
+  ImageSampleListType            weightedSamples;
+  ImageSampleWeightContainerType weights;
+  ImageSampleListType            repeatedSamples;
+  for( unsigned int y = 4; y < 44; y += 2 )
+  {
+    for( unsigned int x = 4; x < 44; x += 2 )
+    {
+      ImageType::IndexType index;
+      index[ 0 ] = x; index[ 1 ] = y;
+      ImageSampleType sample;
+      fixedImage->TransformIndexToPhysicalPoint( index, sample.m_ImageCoordinates );
+      sample.m_ImageValue = fixedImage->GetPixel( index );
+
+      const unsigned int weight = 1 + ( x + 3 * y ) % 3;
+      weightedSamples.push_back( sample );
+      weights.push_back( weight );
+      repeatedSamples.insert( repeatedSamples.end(), weight, sample );
+    }
+  }
+
+  SamplerType::Pointer weightedSampler = SamplerType::New();
+  weightedSampler->SetSamples( weightedSamples, weights );
+  SamplerType::Pointer repeatedSampler = SamplerType::New();
+  repeatedSampler->SetSamples( repeatedSamples, ImageSampleWeightContainerType() );
+
+  metric->SetFixedImage( fixedImage );
+  metric->SetFixedImageRegion( fixedImage->GetBufferedRegion() );
+  metric->SetMovingImage( movingImage );
+  metric->SetInterpolator( interpolator );
+  metric->SetTransform( transform );
+  metric->SetNumberOfFixedHistogramBins( 32 );
+  metric->SetNumberOfMovingHistogramBins( 32 );
+  metric->SetUseDerivative( true );
+  metric->SetNumberOfThreads( 3 );
+
+  for( unsigned int variant = 0; variant < numberOfVariants; ++variant )
+  {
+    metric->SetUseExplicitPDFDerivatives( variant >= 2 && variant < 6 );
+    metric->SetUseSparsePDFDerivatives( variant >= 4 && variant < 6 );
+    metric->SetUseFiniteDifferenceDerivative( variant >= 6 );
+    metric->SetUseMultiThread( variant % 2 == 1 );
+
+    MeasureType    weightedValue, repeatedValue;
+    DerivativeType weightedDerivative, repeatedDerivative;
+    metric->SetImageSampler( weightedSampler );
+    metric->Initialize();
+    metric->GetValueAndDerivative( parameters, weightedValue, weightedDerivative );
+    metric->SetImageSampler( repeatedSampler );
+    metric->Initialize();
+    metric->GetValueAndDerivative( parameters, repeatedValue, repeatedDerivative );
+
+    const double valueDifference      = std::abs( weightedValue - repeatedValue );
+    const double derivativeDifference = ( weightedDerivative - repeatedDerivative ).magnitude();
+    std::cout << std::setprecision( 10 ) << name << ", variant " << variant
+              << ": value = " << weightedValue << ", value difference = " << valueDifference
+              << ", derivative difference = " << derivativeDifference << std::endl;
+
+    if( repeatedDerivative.magnitude() == 0.0 )
+    {
+      std::cerr << "ERROR: " << name << ", variant " << variant << ": the derivative is zero." << std::endl;
+      return false;
+    }
+
+    /** The joint histogram derivatives are stored in float, so the
+     * derivatives are compared with a single precision tolerance.
+     */
+    if( valueDifference > 1e-8 * std::max( 1.0, std::abs( repeatedValue ) )
+      || derivativeDifference > 1e-5 * repeatedDerivative.magnitude() )
+    {
+      std::cerr << "ERROR: " << name << ", variant " << variant
+                << ": the weighted samples give value " << weightedValue
+                << ", the repeated samples " << repeatedValue << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+
+} // end TestMetric()
+
+
+int
+main( void )
+{
+  typedef itk::ParzenWindowMutualInformationImageToImageMetric< ImageType, ImageType > MattesMetricType;
+  MattesMetricType::Pointer mattes = MattesMetricType::New();
+  if( !TestMetric( mattes.GetPointer(), "AdvancedMattesMutualInformation", 8 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  typedef itk::ParzenWindowNormalizedMutualInformationImageToImageMetric< ImageType, ImageType > NMIMetricType;
+  NMIMetricType::Pointer nmi = NMIMetricType::New();
+  if( !TestMetric( nmi.GetPointer(), "NormalizedMutualInformation", 4 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
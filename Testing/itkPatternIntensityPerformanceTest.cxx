@@ -0,0 +1,238 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkPatternIntensityImageToImageMetric.h"
+#include "itkAdvancedEuler3DTransform.h"
+#include "itkAdvancedRayCastInterpolateImageFunction.h"
+#include "itkImageFullSampler.h"
+#include "itkTimeProbe.h"
+
+#include "itkRayCastTestHelper.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+// This test compares the sample based pattern intensity metric, using a
+// full image sampler, with the filter based computation it replaces: a
+// projection of the complete moving image by a ResampleImageFilter, and a
+// derivative by finite differences of the value. It checks that the
+// single-threaded, ITK-threaded and thread pool variants give the same
+// result, and reports the timings.
+
+const unsigned int Dimension = 3;
+typedef itk::Image< float, Dimension >                                 ImageType;
+typedef itk::Image< double, Dimension >                                ProjectionType;
+typedef itk::AdvancedEuler3DTransform< double >                        TransformType;
+typedef itk::AdvancedRayCastInterpolateImageFunction< ImageType, double > RayCastInterpolatorType;
+
+/** The pattern intensity of F - factor * P, computed as by the filter based
+ * metric, on all pixels at least radius from the border.
+ */
+double
+ComputePatternIntensity( const ImageType * fixedImage, const ProjectionType * projection,
+  const double factor, const double noiseConstant, const int radius )
+{
+  const ImageType::SizeType size    = fixedImage->GetLargestPossibleRegion().GetSize();
+  double                    measure = 0.0;
+
+  ImageType::IndexType index, neighbor;
+  for( index[ 2 ] = 0; index[ 2 ] < static_cast< int >( size[ 2 ] ); ++index[ 2 ] )
+  {
+    for( index[ 1 ] = radius; index[ 1 ] < static_cast< int >( size[ 1 ] ) - radius; ++index[ 1 ] )
+    {
+      for( index[ 0 ] = radius; index[ 0 ] < static_cast< int >( size[ 0 ] ) - radius; ++index[ 0 ] )
+      {
+        const double difference = fixedImage->GetPixel( index )
+          - factor * projection->GetPixel( index );
+        neighbor[ 2 ] = index[ 2 ];
+        for( int j = -radius; j <= radius; ++j )
+        {
+          for( int i = -radius; i <= radius; ++i )
+          {
+            neighbor[ 0 ] = index[ 0 ] + i;
+            neighbor[ 1 ] = index[ 1 ] + j;
+            const double diff = difference
+              - ( fixedImage->GetPixel( neighbor ) - factor * projection->GetPixel( neighbor ) );
+            measure += noiseConstant / ( noiseConstant + diff * diff );
+          }
+        }
+      }
+    }
+  }
+  return measure;
+
+} // end ComputePatternIntensity()
+
+
+int
+main( int argc, char * argv[] )
+{
+  /** Typedefs. */
+  typedef itk::PatternIntensityImageToImageMetric< ImageType, ImageType > MetricType;
+  typedef MetricType::MeasureType                                         MeasureType;
+  typedef MetricType::DerivativeType                                      DerivativeType;
+  typedef MetricType::ScalesType                                          ScalesType;
+  typedef itk::ImageFullSampler< ImageType >                              SamplerType;
+
+  const unsigned int numberOfRepetitions = 3;
+  const double       noiseConstant       = 10000.0;
+  const int          radius              = 3;
+  const double       derivativeDelta     = 0.001;
+
+  /** Create the moving volume, the ray caster, and the fixed image, which is
+   * the projection with a known transform.
+   */
+  ImageType::Pointer               movingImage = CreateBlobVolume< ImageType >();
+  TransformType::Pointer           transform   = TransformType::New();
+  RayCastInterpolatorType::Pointer rayCaster   = RayCastInterpolatorType::New();
+  InitializeRayCaster( rayCaster.GetPointer(), transform.GetPointer(), movingImage.GetPointer() );
+  ImageType::Pointer fixedImage = CreateProjectedSlice( movingImage.GetPointer(),
+    transform.GetPointer(), rayCaster.GetPointer() );
+
+  const unsigned int            numberOfParameters = transform->GetNumberOfParameters();
+  TransformType::ParametersType parameters( numberOfParameters );
+  parameters.Fill( 0.0 );
+
+  /** The filter based computation. Without limiters the normalization
+   * factor is one, and the rescaling factor follows from the initial value.
+   */
+  itk::TimeProbe referenceTimer;
+  referenceTimer.Start();
+  const double fixedMeasure = ComputePatternIntensity( fixedImage, ComputeProjection< ProjectionType >(
+    movingImage.GetPointer(), fixedImage.GetPointer(), rayCaster.GetPointer() ), 0.0, noiseConstant, radius );
+  const double initialMeasure = -( ComputePatternIntensity( fixedImage, ComputeProjection< ProjectionType >(
+    movingImage.GetPointer(), fixedImage.GetPointer(), rayCaster.GetPointer() ), 1.0, noiseConstant, radius )
+    - fixedMeasure );
+  double rescalingFactor = 1.0;
+  while( std::abs( initialMeasure ) / rescalingFactor > 1 )
+  {
+    rescalingFactor *= 10;
+  }
+
+  const MeasureType referenceValue = initialMeasure / rescalingFactor;
+  DerivativeType    referenceDerivative( numberOfParameters );
+  TransformType::ParametersType testPoint = parameters;
+  for( unsigned int i = 0; i < numberOfParameters; ++i )
+  {
+    double values[ 2 ];
+    for( unsigned int k = 0; k < 2; ++k )
+    {
+      testPoint[ i ] = parameters[ i ] + ( k == 0 ? -derivativeDelta : derivativeDelta );
+      transform->SetParameters( testPoint );
+      values[ k ] = -( ComputePatternIntensity( fixedImage, ComputeProjection< ProjectionType >(
+        movingImage.GetPointer(), fixedImage.GetPointer(), rayCaster.GetPointer() ), 1.0, noiseConstant, radius )
+        - fixedMeasure ) / rescalingFactor;
+    }
+    referenceDerivative[ i ] = ( values[ 1 ] - values[ 0 ] ) / ( 2.0 * derivativeDelta );
+    testPoint[ i ]           = parameters[ i ];
+  }
+  transform->SetParameters( parameters );
+  referenceTimer.Stop();
+
+  /** Create the metric. */
+  ScalesType scales( numberOfParameters );
+  scales.Fill( 1.0 );
+
+  MetricType::Pointer metric = MetricType::New();
+  metric->SetFixedImage( fixedImage );
+  metric->SetFixedImageRegion( fixedImage->GetBufferedRegion() );
+  metric->SetMovingImage( movingImage );
+  metric->SetInterpolator( rayCaster );
+  metric->SetTransform( transform );
+  metric->SetImageSampler( SamplerType::New() );
+  metric->SetNoiseConstant( noiseConstant );
+  metric->SetDerivativeDelta( derivativeDelta );
+  metric->SetScales( scales );
+
+  /** Run the single-threaded, ITK-threaded and thread pool variants. */
+  const char *   names[ 3 ] = { "single-threaded", "multi-threader", "thread pool" };
+  MeasureType    values[ 3 ];
+  DerivativeType derivatives[ 3 ];
+  itk::TimeProbe timers[ 3 ];
+  for( unsigned int variant = 0; variant < 3; ++variant )
+  {
+    metric->SetUseMultiThread( variant > 0 );
+    metric->SetUseWorkStealingThreadPool( variant == 2 );
+    metric->Initialize();
+
+    for( unsigned int r = 0; r < numberOfRepetitions; ++r )
+    {
+      timers[ variant ].Start();
+      metric->GetValueAndDerivative( parameters, values[ variant ], derivatives[ variant ] );
+      timers[ variant ].Stop();
+    }
+  }
+
+  /** Report the timings. */
+  std::cout << std::setprecision( 4 );
+  std::cout << "Time filter based = " << referenceTimer.GetMean() << " " << referenceTimer.GetUnit() << std::endl;
+  for( unsigned int variant = 0; variant < 3; ++variant )
+  {
+    std::cout << "Time " << names[ variant ] << " = " << timers[ variant ].GetMean()
+              << " " << timers[ variant ].GetUnit()
+              << ", speedup = " << referenceTimer.GetMean() / timers[ variant ].GetMean()
+              << std::endl;
+  }
+
+  /** Compare with the filter based computation. The values only differ in
+   * the order of summation. The derivatives differ in the order of the
+   * finite differences, which is second order in the delta.
+   */
+  std::cout << std::setprecision( 10 )
+            << "Value filter based = " << referenceValue << ", sample based = " << values[ 0 ] << "\n"
+            << "Derivative filter based = " << referenceDerivative << "\n"
+            << "Derivative sample based = " << derivatives[ 0 ] << std::endl;
+
+  if( std::abs( values[ 0 ] - referenceValue ) > 1e-8 * std::max( 1.0, std::abs( referenceValue ) ) )
+  {
+    std::cerr << "ERROR: the value differs from the filter based value." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const double derivativeDifference = ( derivatives[ 0 ] - referenceDerivative ).magnitude();
+  if( referenceDerivative.magnitude() == 0.0
+    || derivativeDifference > 1e-3 * referenceDerivative.magnitude() )
+  {
+    std::cerr << "ERROR: the derivative differs " << derivativeDifference
+              << " from the filter based derivative." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** Compare the threaded variants. Only the order of summation differs. */
+  const double tolerance = 1e-8;
+  for( unsigned int variant = 1; variant < 3; ++variant )
+  {
+    if( std::abs( values[ variant ] - values[ 0 ] ) > tolerance * std::max( 1.0, std::abs( values[ 0 ] ) ) )
+    {
+      std::cerr << "ERROR: the value of the " << names[ variant ] << " metric is "
+                << values[ variant ] << ", expected " << values[ 0 ] << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if( ( derivatives[ variant ] - derivatives[ 0 ] ).magnitude()
+      > tolerance * std::max( 1.0, derivatives[ 0 ].magnitude() ) )
+    {
+      std::cerr << "ERROR: the derivative of the " << names[ variant ]
+                << " metric differs from the single-threaded derivative" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,131 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#ifndef __itkRayCastTestHelper_h
+#define __itkRayCastTestHelper_h
+
+#include "itkImageRegionIterator.h"
+#include "itkResampleImageFilter.h"
+
+#include <cmath>
+
+// Fixtures for the tests of the 2D/3D metrics: a 3D volume with two blobs,
+// a ray caster, and a single slice fixed image that is the projection of
+// the volume with a known rigid transform.
+
+/** Create a 32x32x32 volume with two blobs, centred at the origin. */
+template< class TImage >
+typename TImage::Pointer
+CreateBlobVolume( void )
+{
+  typename TImage::SizeType size;
+  size.Fill( 32 );
+  typename TImage::PointType origin;
+  origin.Fill( -15.5 );
+  typename TImage::Pointer image = TImage::New();
+  image->SetRegions( size );
+  image->SetOrigin( origin );
+  image->Allocate();
+
+  itk::ImageRegionIterator< TImage > it( image, image->GetLargestPossibleRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+  {
+    typename TImage::PointType p;
+    image->TransformIndexToPhysicalPoint( it.GetIndex(), p );
+    it.Set( static_cast< typename TImage::PixelType >(
+        10.0 * std::exp( -( ( p[ 0 ] - 3.0 ) * ( p[ 0 ] - 3.0 ) + ( p[ 1 ] + 2.0 ) * ( p[ 1 ] + 2.0 )
+        + p[ 2 ] * p[ 2 ] ) / 40.0 )
+        + 5.0 * std::exp( -( ( p[ 0 ] + 6.0 ) * ( p[ 0 ] + 6.0 ) / 8.0
+        + ( p[ 1 ] - 5.0 ) * ( p[ 1 ] - 5.0 ) / 30.0 + ( p[ 2 ] - 2.0 ) * ( p[ 2 ] - 2.0 ) / 20.0 ) ) ) );
+  }
+
+  return image;
+
+} // end CreateBlobVolume()
+
+
+/** Let the ray caster project the moving image with the transform, from a
+ * focal point behind the volume.
+ */
+template< class TRayCaster, class TTransform, class TImage >
+void
+InitializeRayCaster( TRayCaster * rayCaster, TTransform * transform, const TImage * movingImage )
+{
+  typename TRayCaster::InputPointType focalPoint;
+  focalPoint[ 0 ] = 0.0; focalPoint[ 1 ] = 0.0; focalPoint[ 2 ] = -500.0;
+  rayCaster->SetTransform( transform );
+  rayCaster->SetFocalPoint( focalPoint );
+  rayCaster->SetThreshold( 0.0 );
+  rayCaster->SetInputImage( movingImage );
+
+} // end InitializeRayCaster()
+
+
+/** The projection of the complete moving image on the fixed image grid. */
+template< class TProjection, class TImage, class TRayCaster >
+typename TProjection::Pointer
+ComputeProjection( const TImage * movingImage, const TImage * fixedImage, TRayCaster * rayCaster )
+{
+  typedef itk::ResampleImageFilter< TImage, TProjection > ResampleFilterType;
+  typename ResampleFilterType::Pointer resampler = ResampleFilterType::New();
+  resampler->SetInput( movingImage );
+  resampler->SetTransform( rayCaster->GetTransform() );
+  resampler->SetInterpolator( rayCaster );
+  resampler->SetDefaultPixelValue( 0 );
+  resampler->SetOutputParametersFromImage( fixedImage );
+  resampler->Update();
+
+  typename TProjection::Pointer projection = resampler->GetOutput();
+  projection->DisconnectPipeline();
+  return projection;
+
+} // end ComputeProjection()
+
+
+/** Create the fixed image: a 40x40 slice between the volume and the focal
+ * point, filled with the projection of the moving image with a known rigid
+ * transform. Afterwards the transform parameters are reset to zero.
+ */
+template< class TImage, class TTransform, class TRayCaster >
+typename TImage::Pointer
+CreateProjectedSlice( const TImage * movingImage, TTransform * transform, TRayCaster * rayCaster )
+{
+  typename TImage::SizeType size;
+  size[ 0 ] = 40; size[ 1 ] = 40; size[ 2 ] = 1;
+  typename TImage::PointType origin;
+  origin[ 0 ] = -19.5; origin[ 1 ] = -19.5; origin[ 2 ] = 50.0;
+  typename TImage::Pointer grid = TImage::New();
+  grid->SetRegions( size );
+  grid->SetOrigin( origin );
+  grid->Allocate();
+
+  typename TTransform::ParametersType parameters( transform->GetNumberOfParameters() );
+  parameters[ 0 ] = 0.05; parameters[ 1 ] = -0.03; parameters[ 2 ] = 0.02;
+  parameters[ 3 ] = 1.0;  parameters[ 4 ] = -0.5;  parameters[ 5 ] = 0.0;
+  transform->SetParameters( parameters );
+
+  typename TImage::Pointer fixedImage = ComputeProjection< TImage >( movingImage,
+    grid.GetPointer(), rayCaster );
+
+  parameters.Fill( 0.0 );
+  transform->SetParameters( parameters );
+  return fixedImage;
+
+} // end CreateProjectedSlice()
+
+
+#endif // end #ifndef __itkRayCastTestHelper_h
@@ -0,0 +1,136 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkSparseJointPDFDerivatives.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// This test checks that the sparse joint histogram derivatives give the
+// same weighted sum as the dense joint histogram derivatives, as used by
+// the explicit derivative of the Mattes mutual information, and that the
+// memory use depends on the touched parameters only.
+
+typedef itk::SparseJointPDFDerivatives< float >                   SparseJointPDFDerivativesType;
+typedef SparseJointPDFDerivativesType::NonZeroJacobianIndicesType NonZeroJacobianIndicesType;
+
+int
+main( void )
+{
+  const unsigned long numberOfBins       = 32 * 32;
+  const unsigned long numberOfParameters = 20000;
+  const unsigned int  numberOfSamples    = 100;
+  const unsigned int  numberOfNonZeros   = 192;
+
+  SparseJointPDFDerivativesType::Pointer sparse = SparseJointPDFDerivativesType::New();
+  sparse->Initialize( numberOfBins, numberOfParameters, 8 );
+
+  /** The weights of the bins. */
+  std::vector< double > binWeights( numberOfBins );
+  for( unsigned long bin = 0; bin < numberOfBins; ++bin )
+  {
+    binWeights[ bin ] = std::sin( 0.01 * bin );
+  }
+
+  /** The reference derivative. Since the weighted sum is linear in the
+   * joint histogram derivatives, it is accumulated directly, instead of
+   * storing the dense joint histogram derivatives.
+   */
+  std::vector< double > denseDerivative( numberOfParameters, 0.0 );
+
+  /** Update both with pseudo-random samples, that each touch 4 x 4 bins
+   * and a sorted, non-contiguous set of parameters.
+   */
+  std::srand( 7 );
+  NonZeroJacobianIndicesType nzji( numberOfNonZeros );
+  std::vector< double >      imageJacobian( numberOfNonZeros );
+  for( unsigned int s = 0; s < numberOfSamples; ++s )
+  {
+    const unsigned long firstParameter = std::rand() % ( numberOfParameters - 3 * numberOfNonZeros );
+    for( unsigned int i = 0; i < numberOfNonZeros; ++i )
+    {
+      nzji[ i ]          = firstParameter + 3 * i;
+      imageJacobian[ i ] = static_cast< double >( std::rand() ) / RAND_MAX - 0.5;
+    }
+
+    const unsigned long fixedBin  = std::rand() % 28;
+    const unsigned long movingBin = std::rand() % 28;
+    for( unsigned int f = 0; f < 4; ++f )
+    {
+      for( unsigned int m = 0; m < 4; ++m )
+      {
+        const unsigned long bin    = ( movingBin + m ) + ( fixedBin + f ) * 32;
+        const double        factor = 0.1 * ( f + 1 ) - 0.05 * m;
+        sparse->UpdateBin( bin, factor, &imageJacobian[ 0 ], nzji );
+        for( unsigned int i = 0; i < numberOfNonZeros; ++i )
+        {
+          denseDerivative[ nzji[ i ] ] += binWeights[ bin ]
+            * static_cast< float >( imageJacobian[ i ] * factor );
+        }
+      }
+    }
+  }
+
+  /** Compare the weighted sums. */
+  std::vector< double > sparseDerivative( numberOfParameters, 0.0 );
+  sparse->AddWeightedSum( &binWeights[ 0 ], -1.0, &sparseDerivative[ 0 ] );
+
+  double maxDifference = 0.0;
+  double maxValue      = 0.0;
+  for( unsigned long mu = 0; mu < numberOfParameters; ++mu )
+  {
+    maxDifference = std::max( maxDifference, std::abs( sparseDerivative[ mu ] - denseDerivative[ mu ] ) );
+    maxValue      = std::max( maxValue, std::abs( denseDerivative[ mu ] ) );
+  }
+
+  const unsigned long sparseSize = sparse->GetAllocatedMemorySize();
+  const unsigned long denseSize  = numberOfBins * numberOfParameters * sizeof( float );
+  std::cout << "Number of active blocks: " << sparse->GetNumberOfActiveBlocks() << "\n"
+            << "Memory sparse: " << sparseSize << " bytes, dense: " << denseSize << " bytes\n"
+            << "Maximum difference: " << maxDifference << " (maximum value: " << maxValue << ")"
+            << std::endl;
+
+  if( maxValue == 0.0 || maxDifference > 1e-4 * maxValue )
+  {
+    std::cerr << "ERROR: the sparse derivative differs from the dense derivative." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** Each sample touches at most 16 bins times 73 blocks of 8 parameters. */
+  if( sparse->GetNumberOfActiveBlocks() > numberOfSamples * 16 * 73 || sparseSize >= denseSize / 4 )
+  {
+    std::cerr << "ERROR: the sparse derivatives use too much memory." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** Reset() should remove all values. */
+  sparse->Reset();
+  std::fill( sparseDerivative.begin(), sparseDerivative.end(), 0.0 );
+  sparse->AddWeightedSum( &binWeights[ 0 ], 1.0, &sparseDerivative[ 0 ] );
+  if( sparse->GetNumberOfActiveBlocks() != 0
+    || *std::max_element( sparseDerivative.begin(), sparseDerivative.end() ) != 0.0 )
+  {
+    std::cerr << "ERROR: Reset() did not remove all values." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
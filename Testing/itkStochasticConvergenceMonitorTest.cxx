@@ -0,0 +1,124 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkStochasticConvergenceMonitor.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+#include <cmath>
+
+// This test feeds the convergence monitor with the noisy metric values of a
+// simulated stochastic optimization, which decrease exponentially to 1. The
+// value criterion should detect convergence after the decrease has become
+// small, but not while the values still decrease steeply. The validation
+// criterion should detect convergence after the configured number of
+// validation values without improvement.
+
+typedef itk::StochasticConvergenceMonitor                     MonitorType;
+typedef itk::Statistics::MersenneTwisterRandomVariateGenerator RandomGeneratorType;
+
+int
+main( void )
+{
+  RandomGeneratorType::Pointer randomGenerator = RandomGeneratorType::New();
+  randomGenerator->SetSeed( 1234 );
+
+  MonitorType::Pointer monitor = MonitorType::New();
+  monitor->SetWindowSize( 100 );
+  monitor->SetRelativeValueTolerance( 1e-3 );
+  monitor->SetConfidenceFactor( 2.0 );
+  monitor->SetGradientMagnitudeTolerance( 0.0 );
+  monitor->Initialize();
+
+  /** Simulate f(k) = 1 + 10 exp( -k / 200 ) + noise. */
+  unsigned long convergedIteration = 0;
+  for( unsigned long k = 0; k < 5000 && !monitor->GetConverged(); ++k )
+  {
+    const double value = 1.0 + 10.0 * std::exp( k / -200.0 )
+      + 0.05 * randomGenerator->GetNormalVariate();
+    monitor->AddIteration( value, 10.0 * std::exp( k / -200.0 ) );
+    convergedIteration = k + 1;
+  }
+  std::cout << "Converged after " << convergedIteration << " iterations, slope: "
+            << monitor->GetValueSlope() << " +/- " << monitor->GetValueSlopeStandardError()
+            << std::endl;
+
+  if( !monitor->GetConverged()
+    || monitor->GetConvergenceCriterion() != MonitorType::ValueConverged )
+  {
+    std::cerr << "ERROR: the value criterion did not detect convergence." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** At convergence, the remaining decrease 10 exp( -k / 200 ) should be
+   * of the order of the tolerance, so k should be at least 200 log( 100 ),
+   * and not much larger than 200 log( 10000 ).
+   */
+  if( convergedIteration < 900 || convergedIteration > 2500 )
+  {
+    std::cerr << "ERROR: convergence was detected after " << convergedIteration
+              << " iterations, expected between 900 and 2500." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** The minimum number of iterations should postpone the convergence. */
+  monitor->SetMinimumNumberOfIterations( 3000 );
+  monitor->Initialize();
+  randomGenerator->SetSeed( 1234 );
+  for( unsigned long k = 0; k < 2999; ++k )
+  {
+    const double value = 1.0 + 10.0 * std::exp( k / -200.0 )
+      + 0.05 * randomGenerator->GetNormalVariate();
+    monitor->AddIteration( value, 1.0 );
+  }
+  if( monitor->GetConverged() )
+  {
+    std::cerr << "ERROR: convergence was detected before the minimum number of iterations." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** Validation values that stop improving should stop the optimization
+   * after ValidationPatience values.
+   */
+  monitor->SetMinimumNumberOfIterations( 0 );
+  monitor->SetRelativeValueTolerance( 0.0 );
+  monitor->SetValidationPatience( 3 );
+  monitor->SetValidationRelativeTolerance( 1e-4 );
+  monitor->Initialize();
+
+  const double validationValues[ 7 ] = { 5.0, 4.0, 3.5, 3.5, 3.49999, 3.6, 3.5 };
+  for( unsigned int i = 0; i < 7; ++i )
+  {
+    monitor->AddIteration( validationValues[ i ], 1.0 );
+    monitor->AddValidationValue( validationValues[ i ] );
+    const bool expectConverged = i >= 5;
+    if( monitor->GetConverged() != expectConverged )
+    {
+      std::cerr << "ERROR: after validation value " << i << " the monitor reports converged = "
+                << monitor->GetConverged() << ", expected " << expectConverged << "." << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  if( monitor->GetConvergenceCriterion() != MonitorType::ValidationValueConverged
+    || monitor->GetBestValidationValue() != 3.5 )
+  {
+    std::cerr << "ERROR: wrong convergence criterion or best validation value." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
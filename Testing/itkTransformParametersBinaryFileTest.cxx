@@ -0,0 +1,140 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkTransformParametersBinaryFile.h"
+
+#include <cmath>
+#include <fstream>
+#include <vector>
+
+// This test checks that transform parameters written to a binary file are
+// read back exactly, and that invalid files are rejected.
+
+typedef itk::TransformParametersBinaryFile BinaryFileType;
+
+bool
+ExpectReadFailure( const std::string & fileName, const char * description )
+{
+  BinaryFileType::Pointer reader = BinaryFileType::New();
+  reader->SetFileName( fileName );
+  try
+  {
+    reader->Read();
+  }
+  catch( itk::ExceptionObject & )
+  {
+    std::cout << "Reading a " << description << " file failed, as expected." << std::endl;
+    return true;
+  }
+  std::cerr << "ERROR: reading a " << description << " file did not fail." << std::endl;
+  return false;
+
+} // end ExpectReadFailure()
+
+
+int
+main( int argc, char * argv[] )
+{
+  /** Check number of arguments. */
+  if( argc != 2 )
+  {
+    std::cerr << "ERROR: You should specify the output directory." << std::endl;
+    return EXIT_FAILURE;
+  }
+  const std::string fileName = std::string( argv[ 1 ] ) + "/TransformParametersBinaryFileTest.dat";
+
+  /** Write some parameters, including values that do not survive text output. */
+  const unsigned int    numberOfParameters = 10007;
+  std::vector< double > parameters( numberOfParameters );
+  for( unsigned int i = 0; i < numberOfParameters; ++i )
+  {
+    parameters[ i ] = std::sin( 0.1 * i ) / 3.0 + 1e-300 * i;
+  }
+
+  BinaryFileType::Pointer writer = BinaryFileType::New();
+  writer->SetFileName( fileName );
+  writer->Write( &parameters[ 0 ], numberOfParameters );
+
+  if( !BinaryFileType::IsBinaryFile( fileName ) )
+  {
+    std::cerr << "ERROR: the written file is not recognized." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** Read them back, and compare bit-wise. */
+  BinaryFileType::Pointer reader = BinaryFileType::New();
+  reader->SetFileName( fileName );
+  reader->Read();
+  std::cout << "Read " << reader->GetNumberOfParameters() << " parameters, memory mapped: "
+            << ( reader->GetIsMemoryMapped() ? "yes" : "no" ) << std::endl;
+
+  if( reader->GetNumberOfParameters() != numberOfParameters )
+  {
+    std::cerr << "ERROR: read " << reader->GetNumberOfParameters()
+              << " parameters, expected " << numberOfParameters << std::endl;
+    return EXIT_FAILURE;
+  }
+  for( unsigned int i = 0; i < numberOfParameters; ++i )
+  {
+    if( reader->GetParameters()[ i ] != parameters[ i ] )
+    {
+      std::cerr << "ERROR: parameter " << i << " is " << reader->GetParameters()[ i ]
+                << ", expected " << parameters[ i ] << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+  reader->Close();
+
+  /** A file without header, as written by older versions. */
+  const std::string legacyFileName = std::string( argv[ 1 ] ) + "/TransformParametersBinaryFileTestLegacy.dat";
+  {
+    std::ofstream legacyFile( legacyFileName.c_str(), std::ios::out | std::ios::binary );
+    legacyFile.write( reinterpret_cast< const char * >( &parameters[ 0 ] ), numberOfParameters * sizeof( double ) );
+  }
+  if( BinaryFileType::IsBinaryFile( legacyFileName ) )
+  {
+    std::cerr << "ERROR: a file without header is recognized." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if( !ExpectReadFailure( legacyFileName, "headerless" ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** A truncated file. */
+  const std::string truncatedFileName = std::string( argv[ 1 ] ) + "/TransformParametersBinaryFileTestTruncated.dat";
+  {
+    std::ifstream input( fileName.c_str(), std::ios::in | std::ios::binary );
+    std::vector< char > buffer( BinaryFileType::HeaderSize + 100 * sizeof( double ) );
+    input.read( &buffer[ 0 ], buffer.size() );
+    std::ofstream output( truncatedFileName.c_str(), std::ios::out | std::ios::binary );
+    output.write( &buffer[ 0 ], buffer.size() );
+  }
+  if( !ExpectReadFailure( truncatedFileName, "truncated" ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** A file that does not exist. */
+  if( !ExpectReadFailure( std::string( argv[ 1 ] ) + "/DoesNotExist.dat", "non-existing" ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
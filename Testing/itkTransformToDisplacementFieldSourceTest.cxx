@@ -0,0 +1,174 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkTransformToDisplacementFieldSource.h"
+#include "itkAdvancedBSplineDeformableTransform.h"
+#include "itkAdvancedCombinationTransform.h"
+#include "itkAdvancedTranslationTransform.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkTimeProbe.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+// This test checks that the separable evaluation of B-spline transforms in
+// the TransformToDisplacementFieldSource gives the same displacement field as
+// the point-wise evaluation, for a B-spline transform on its own, added to a
+// translation, and with a rotated grid, and reports the speedup.
+
+const unsigned int Dimension = 3;
+typedef itk::Vector< float, Dimension >                                  VectorType;
+typedef itk::Image< VectorType, Dimension >                              DisplacementFieldType;
+typedef itk::TransformToDisplacementFieldSource<
+  DisplacementFieldType, double >                                        SourceType;
+typedef SourceType::TransformType                                        TransformType;
+typedef itk::AdvancedBSplineDeformableTransform< double, Dimension, 3 > BSplineTransformType;
+typedef itk::AdvancedCombinationTransform< double, Dimension >           CombinationTransformType;
+typedef itk::AdvancedTranslationTransform< double, Dimension >           TranslationTransformType;
+
+/** Generate the displacement field separably and point-wise, and compare. */
+bool
+CompareDisplacementFields( const TransformType * transform, const char * description,
+  const unsigned int expectedNumberOfSeparableTerms )
+{
+  DisplacementFieldType::SizeType size;
+  size[ 0 ] = 97; size[ 1 ] = 83; size[ 2 ] = 61;
+  DisplacementFieldType::IndexType index;
+  index[ 0 ] = 2; index[ 1 ] = -3; index[ 2 ] = 0;
+  DisplacementFieldType::RegionType region( index, size );
+  DisplacementFieldType::SpacingType spacing;
+  spacing[ 0 ] = 1.1; spacing[ 1 ] = 0.9; spacing[ 2 ] = 1.3;
+  DisplacementFieldType::PointType origin;
+  origin[ 0 ] = -5.0; origin[ 1 ] = 3.0; origin[ 2 ] = 1.5;
+
+  DisplacementFieldType::Pointer fields[ 2 ];
+  itk::TimeProbe                 timers[ 2 ];
+  for( unsigned int i = 0; i < 2; ++i )
+  {
+    SourceType::Pointer source = SourceType::New();
+    source->SetOutputRegion( region );
+    source->SetOutputSpacing( spacing );
+    source->SetOutputOrigin( origin );
+    source->SetTransform( transform );
+    source->SetUseSeparableBSplineEvaluation( i == 0 );
+
+    timers[ i ].Start();
+    source->Update();
+    timers[ i ].Stop();
+    fields[ i ] = source->GetOutput();
+
+    if( i == 0 && source->GetNumberOfSeparableTerms() != expectedNumberOfSeparableTerms )
+    {
+      std::cerr << "ERROR: " << description << ": " << source->GetNumberOfSeparableTerms()
+                << " separable terms, expected " << expectedNumberOfSeparableTerms << std::endl;
+      return false;
+    }
+  }
+
+  std::cout << std::setprecision( 4 ) << description
+            << ": separable " << timers[ 0 ].GetMean() << " " << timers[ 0 ].GetUnit()
+            << ", point-wise " << timers[ 1 ].GetMean() << " " << timers[ 1 ].GetUnit()
+            << ", speedup = " << timers[ 1 ].GetMean() / timers[ 0 ].GetMean() << std::endl;
+
+  /** Only the order of summation differs, apart from rounding to float. */
+  double maximumDifference = 0.0;
+  itk::ImageRegionConstIterator< DisplacementFieldType > it0( fields[ 0 ], region );
+  itk::ImageRegionConstIterator< DisplacementFieldType > it1( fields[ 1 ], region );
+  for( ; !it0.IsAtEnd(); ++it0, ++it1 )
+  {
+    maximumDifference = std::max( maximumDifference,
+      static_cast< double >( ( it0.Get() - it1.Get() ).GetNorm() ) );
+  }
+  if( maximumDifference > 1e-4 )
+  {
+    std::cerr << "ERROR: " << description << ": the separable displacement field differs "
+              << maximumDifference << " from the point-wise displacement field." << std::endl;
+    return false;
+  }
+  return true;
+
+} // end CompareDisplacementFields()
+
+
+int
+main( void )
+{
+  /** Create a B-spline transform with a grid that does not cover the whole
+   * image, so that the displacement is zero outside the valid region.
+   */
+  BSplineTransformType::Pointer bspline = BSplineTransformType::New();
+  BSplineTransformType::OriginType gridOrigin;
+  gridOrigin[ 0 ] = -10.0; gridOrigin[ 1 ] = -8.0; gridOrigin[ 2 ] = -4.0;
+  BSplineTransformType::SpacingType gridSpacing;
+  gridSpacing[ 0 ] = 12.0; gridSpacing[ 1 ] = 10.0; gridSpacing[ 2 ] = 9.0;
+  BSplineTransformType::RegionType::SizeType gridSize;
+  gridSize[ 0 ] = 10; gridSize[ 1 ] = 9; gridSize[ 2 ] = 8;
+  BSplineTransformType::RegionType gridRegion;
+  gridRegion.SetSize( gridSize );
+  bspline->SetGridOrigin( gridOrigin );
+  bspline->SetGridSpacing( gridSpacing );
+  bspline->SetGridRegion( gridRegion );
+
+  BSplineTransformType::ParametersType parameters( bspline->GetNumberOfParameters() );
+  for( unsigned int i = 0; i < parameters.GetSize(); ++i )
+  {
+    parameters[ i ] = 2.0 * std::sin( 0.37 * i ) + std::cos( 0.011 * i );
+  }
+  bspline->SetParameters( parameters );
+
+  if( !CompareDisplacementFields( bspline, "B-spline", 1 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** Add the B-spline transform to a translation, as elastix does. */
+  TranslationTransformType::Pointer translation = TranslationTransformType::New();
+  TranslationTransformType::OutputVectorType offset;
+  offset[ 0 ] = 1.5; offset[ 1 ] = -0.5; offset[ 2 ] = 0.25;
+  translation->SetOffset( offset );
+
+  CombinationTransformType::Pointer combination = CombinationTransformType::New();
+  combination->SetInitialTransform( translation );
+  combination->SetCurrentTransform( bspline );
+  combination->SetUseAddition( true );
+  if( !CompareDisplacementFields( combination, "translation + B-spline", 1 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** A composition is evaluated point-wise. */
+  combination->SetUseComposition( true );
+  if( !CompareDisplacementFields( combination, "B-spline o translation", 0 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  /** A rotated grid is evaluated point-wise. */
+  BSplineTransformType::DirectionType gridDirection;
+  gridDirection.SetIdentity();
+  gridDirection[ 0 ][ 0 ] = std::cos( 0.2 ); gridDirection[ 0 ][ 1 ] = -std::sin( 0.2 );
+  gridDirection[ 1 ][ 0 ] = std::sin( 0.2 ); gridDirection[ 1 ][ 1 ] = std::cos( 0.2 );
+  bspline->SetGridDirection( gridDirection );
+  if( !CompareDisplacementFields( bspline, "rotated B-spline", 0 ) )
+  {
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+
+} // end main
@@ -0,0 +1,218 @@
+/*=========================================================================
+ *
+ *  Copyright UMC Utrecht and contributors
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0.txt
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *=========================================================================*/
+#include "itkWorkStealingThreadPool.h"
+#include "itkMultiThreader.h"
+#include "itkTimeProbesCollectorBase.h"
+
+#include <vector>
+#include <cmath>
+#include <iomanip>
+
+// This test compares the work-stealing thread pool with the MultiThreader,
+// on a workload where the cost per item is very unbalanced, similar to a
+// metric where only part of the samples map inside the moving mask.
+
+struct WorkloadType
+{
+  std::vector< double > m_Input;
+  std::vector< double > m_PerThreadSum;
+  unsigned int          m_NumberOfThreads;
+};
+
+// Only one in ten items in the first half is expensive.
+inline double
+ProcessItem( const WorkloadType * workload, unsigned long i )
+{
+  double value = workload->m_Input[ i ];
+  if( i < workload->m_Input.size() / 2 && i % 10 == 0 )
+  {
+    for( unsigned int k = 0; k < 2000; ++k )
+    {
+      value = std::sqrt( value * value + 1.0 ) - 1.0 + workload->m_Input[ i ];
+    }
+  }
+  return value;
+}
+
+
+ITK_THREAD_RETURN_TYPE
+ThreaderCallback( void * arg )
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+  ThreadInfoType * infoStruct = static_cast< ThreadInfoType * >( arg );
+  WorkloadType *   workload   = static_cast< WorkloadType * >( infoStruct->UserData );
+
+  const unsigned long size    = workload->m_Input.size();
+  const unsigned long subSize = ( size + infoStruct->NumberOfThreads - 1 ) / infoStruct->NumberOfThreads;
+  const unsigned long begin   = std::min( size, infoStruct->ThreadID * subSize );
+  const unsigned long end     = std::min( size, ( infoStruct->ThreadID + 1 ) * subSize );
+
+  double sum = 0.0;
+  for( unsigned long i = begin; i < end; ++i )
+  {
+    sum += ProcessItem( workload, i );
+  }
+  workload->m_PerThreadSum[ infoStruct->ThreadID ] += sum;
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+
+void
+ThreadPoolCallback( void * arg, itk::ThreadIdType threadID,
+  itk::SizeValueType begin, itk::SizeValueType end )
+{
+  WorkloadType * workload = static_cast< WorkloadType * >( arg );
+
+  double sum = 0.0;
+  for( itk::SizeValueType i = begin; i < end; ++i )
+  {
+    sum += ProcessItem( workload, i );
+  }
+  workload->m_PerThreadSum[ threadID ] += sum;
+}
+
+
+void
+ThrowingCallback( void *, itk::ThreadIdType,
+  itk::SizeValueType begin, itk::SizeValueType )
+{
+  if( begin > 0 )
+  {
+    itkGenericExceptionMacro( << "Expected exception from chunk " << begin );
+  }
+}
+
+
+double
+SumAndReset( WorkloadType & workload )
+{
+  double sum = 0.0;
+  for( unsigned int i = 0; i < workload.m_NumberOfThreads; ++i )
+  {
+    sum += workload.m_PerThreadSum[ i ];
+    workload.m_PerThreadSum[ i ] = 0.0;
+  }
+  return sum;
+}
+
+
+int
+main( int argc, char * argv[] )
+{
+  std::cout << std::fixed << std::showpoint << std::setprecision( 6 );
+
+  itk::WorkStealingThreadPool::Pointer threadPool = itk::WorkStealingThreadPool::GetInstance();
+  itk::MultiThreader::Pointer          threader   = itk::MultiThreader::New();
+  const unsigned int                   nrOfThreads = threader->GetNumberOfThreads();
+  threadPool->SetNumberOfWorkers( nrOfThreads );
+
+  std::cout << "Number of threads: " << nrOfThreads << std::endl;
+
+  /** Setup the workload. */
+  WorkloadType workload;
+  workload.m_NumberOfThreads = nrOfThreads;
+  workload.m_PerThreadSum.assign( nrOfThreads, 0.0 );
+  workload.m_Input.resize( 100000 );
+  for( unsigned long i = 0; i < workload.m_Input.size(); ++i )
+  {
+    workload.m_Input[ i ] = static_cast< double >( i % 17 ) / 17.0;
+  }
+
+  const unsigned int           repetitions = 20;
+  itk::TimeProbesCollectorBase timeCollector;
+  double                       sumThreader = 0.0;
+  double                       sumPool     = 0.0;
+
+  /** Time the MultiThreader, with equally sized parts per thread. */
+  for( unsigned int r = 0; r < repetitions; ++r )
+  {
+    timeCollector.Start( "MultiThreader" );
+    threader->SetSingleMethod( ThreaderCallback, &workload );
+    threader->SingleMethodExecute();
+    timeCollector.Stop( "MultiThreader" );
+    sumThreader = SumAndReset( workload );
+  }
+
+  /** Time the thread pool, with automatic and fixed chunk sizes. */
+  for( unsigned int r = 0; r < repetitions; ++r )
+  {
+    timeCollector.Start( "ThreadPool (auto chunks)" );
+    threadPool->ParallelFor( workload.m_Input.size(), 0, nrOfThreads,
+      ThreadPoolCallback, &workload );
+    timeCollector.Stop( "ThreadPool (auto chunks)" );
+    sumPool = SumAndReset( workload );
+
+    if( std::abs( sumPool - sumThreader ) > 1e-6 * std::abs( sumThreader ) )
+    {
+      std::cerr << "ERROR: thread pool result " << sumPool
+                << " differs from MultiThreader result " << sumThreader << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  for( unsigned int r = 0; r < repetitions; ++r )
+  {
+    timeCollector.Start( "ThreadPool (256 items)" );
+    threadPool->ParallelFor( workload.m_Input.size(), 256, nrOfThreads,
+      ThreadPoolCallback, &workload );
+    timeCollector.Stop( "ThreadPool (256 items)" );
+    sumPool = SumAndReset( workload );
+
+    if( std::abs( sumPool - sumThreader ) > 1e-6 * std::abs( sumThreader ) )
+    {
+      std::cerr << "ERROR: thread pool result " << sumPool
+                << " differs from MultiThreader result " << sumThreader << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  /** Restricting the number of participating workers should give the same result. */
+  threadPool->ParallelFor( workload.m_Input.size(), 100, 1,
+    ThreadPoolCallback, &workload );
+  const double sumFirstWorker = workload.m_PerThreadSum[ 0 ];
+  if( sumFirstWorker != SumAndReset( workload ) )
+  {
+    std::cerr << "ERROR: a job restricted to one worker ran on multiple workers." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** Exceptions thrown by a job should end up at the calling thread. */
+  bool exceptionCaught = false;
+  try
+  {
+    threadPool->ParallelFor( 1000, 10, 0, ThrowingCallback, 0 );
+  }
+  catch( itk::ExceptionObject & err )
+  {
+    std::cout << "Caught expected exception: " << err.GetDescription() << std::endl;
+    exceptionCaught = true;
+  }
+  if( !exceptionCaught )
+  {
+    std::cerr << "ERROR: the exception thrown inside a job was not propagated." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /** Report timings. */
+  std::cout << "Number of stolen chunks: " << threadPool->GetNumberOfStolenChunks() << std::endl;
+  timeCollector.Report();
+
+  return EXIT_SUCCESS;
+
+} // end main